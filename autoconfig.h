@@ -129,9 +129,6 @@
 /* see upnpconfig.h */
 /* #undef UPNP_ENABLE_IPV6 */
 
-/* see upnpconfig.h */
-#define UPNP_ENABLE_NOTIFICATION_REORDERING 1
-
 /* see upnpconfig.h */
 /* #undef UPNP_ENABLE_UNSPECIFIED_SERVER */
 
@@ -181,12 +181,20 @@ typedef struct _IXML_Node
 } IXML_Node;
 
 
+/*!
+ * \brief Allocator of the nodes of an arena document, opaque.
+ */
+typedef struct _IXML_Arena IXML_Arena;
+
+
 /*!
  * \brief Data structure representing the DOM Document.
  */
 typedef struct _IXML_Document
 {
 	IXML_Node n;
+	/*! The allocator of the nodes, NULL for a heap document. */
+	IXML_Arena *arena;
 } IXML_Document;
 
 
@@ -234,8 +242,12 @@ typedef struct _IXML_Text
  */
 typedef struct _IXML_NodeList
 {
-	IXML_Node *nodeItem;
-	struct  _IXML_NodeList *next;
+	/*! The nodes of the list. */
+	IXML_Node **nodeItems;
+	/*! Number of nodes in the list. */
+	unsigned long length;
+	/*! Number of nodes nodeItems can hold. */
+	unsigned long capacity;
 } IXML_NodeList;
 
 
@@ -741,6 +753,38 @@ EXPORT_SPEC int ixmlDocument_createDocumentEx(
 EXPORT_SPEC IXML_Document *ixmlDocument_createDocument(void);
 
 
+/*!
+ * \brief Creates a new empty arena \b Document node.
+ *
+ * The nodes and strings of an arena document are allocated from blocks
+ * owned by the document and are all released at once by
+ * \b ixmlDocument_free, which makes it much cheaper to build and free a
+ * short lived tree. The document can be modified as any other; replaced
+ * strings and nodes removed from it keep their memory until the document
+ * is freed, so \b ixmlNode_free on one of its nodes releases nothing and
+ * such a node must not be used after the document is freed. Nodes imported
+ * or cloned into the document stay on the heap and are freed by
+ * \b ixmlDocument_free as usual.
+ *
+ * \return An integer representing one of the following:
+ *      \li \c IXML_SUCCESS: The operation completed successfully.
+ *      \li \c IXML_INSUFFICIENT_MEMORY: Not enough free memory exists 
+ *            to complete this operation.
+ */
+EXPORT_SPEC int ixmlDocument_createDocumentArenaEx(
+	/*! [out] Pointer to a \b Document where the new object will be stored. */
+	IXML_Document **doc);
+
+
+/*!
+ * \brief Creates a new empty arena \b Document node.
+ *
+ * \return A pointer to the new \b Document object, see
+ * \b ixmlDocument_createDocumentArenaEx, or \c NULL on failure.
+ */
+EXPORT_SPEC IXML_Document *ixmlDocument_createDocumentArena(void);
+
+
 /*!
  * \brief Creates a new \b Element node with the given tag name.
  *
@@ -1769,6 +1813,97 @@ EXPORT_SPEC int ixmlParseBufferEx(
 	IXML_Document** doc);
 
 
+/*!
+ * \brief Parses an XML text buffer into an arena \b Document.
+ *
+ * Use it for documents that are read and freed, see
+ * \b ixmlDocument_createDocumentArenaEx.
+ *
+ * \return The same as \b ixmlParseBufferEx.
+ */
+EXPORT_SPEC int ixmlParseBufferArenaEx(
+	/*! [in] The buffer that contains the XML text to convert to a \b Document. */
+	const char *buffer,
+	/*! [out] A point to store the \b Document if file correctly parses or \b NULL on an error. */
+	IXML_Document** doc);
+
+
+/*!
+ * \brief Parses an XML text buffer into an arena \b Document.
+ *
+ * \return A \b Document if the buffer correctly parses or \c NULL on an error. 
+ */
+EXPORT_SPEC IXML_Document *ixmlParseBufferArena(
+	/*! [in] The buffer that contains the XML text to convert to a \b Document. */
+	const char *buffer);
+
+
+/*!
+ * \brief Callbacks of \b ixmlSaxParse.
+ *
+ * A callback returns \c IXML_SUCCESS to continue the parse. It can return
+ * \c IXML_FILE_DONE to stop it early without error; any other value aborts
+ * the parse and is returned by \b ixmlSaxParse. A \c NULL callback is
+ * skipped. The strings passed to the callbacks are only valid during the call.
+ */
+typedef struct _IXML_SaxHandler
+{
+	/*! Called once the start tag and all its attributes have been read. */
+	int (*startElement)(
+		/*! [in] The cookie given to \b ixmlSaxParse. */
+		void *cookie,
+		/*! [in] The qualified name of the element. */
+		const char *name,
+		/*! [in] The namespace URI of the element, or \c NULL. */
+		const char *namespaceURI,
+		/*! [in] The attribute names and values, one after the other,
+		 * terminated by \c NULL. */
+		const char **attributes);
+	/*! Called at the end tag of an element, including an empty one. */
+	int (*endElement)(
+		/*! [in] The cookie given to \b ixmlSaxParse. */
+		void *cookie,
+		/*! [in] The qualified name of the element. */
+		const char *name);
+	/*! Called for each text node and CDATA section, with the entities
+	 * decoded. Text made only of whitespace is not reported. */
+	int (*characters)(
+		/*! [in] The cookie given to \b ixmlSaxParse. */
+		void *cookie,
+		/*! [in] The text. */
+		const char *text);
+} IXML_SaxHandler;
+
+
+/*!
+ * \brief Parses an XML text buffer and reports its elements and text to
+ * callbacks, without building a DOM representation.
+ *
+ * The buffer is parsed in place. Only the current start tag and the stack of
+ * open elements are kept in memory, so large documents can be processed in
+ * little memory, and the parse can be stopped once the needed data is found.
+ * The document is checked as \b ixmlParseBufferEx does, but the callbacks
+ * made before a syntax error is found are not undone.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c IXML_SUCCESS: The whole document was parsed, or a callback
+ *           returned \c IXML_FILE_DONE.
+ *     \li \c IXML_INVALID_PARAMETER: The \b buffer or \b handler is not a
+ *           valid pointer.
+ *     \li \c IXML_SYNTAX_ERR: The document is not well formed.
+ *     \li \c IXML_INSUFFICIENT_MEMORY: Not enough free memory exists
+ *           to complete this operation.
+ *     \li Any other value returned by a callback.
+ */
+EXPORT_SPEC int ixmlSaxParse(
+	/*! [in] The buffer that contains the XML text to parse. */
+	const char *buffer,
+	/*! [in] The callbacks to report the document to. */
+	const IXML_SaxHandler *handler,
+	/*! [in] A pointer passed to the callbacks. */
+	void *cookie);
+
+
 /*!
  * \brief Parses an XML text file converting it into an IXML DOM representation.
  *
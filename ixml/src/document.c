@@ -106,6 +106,10 @@ int ixmlDocument_importNode(
 		return IXML_FAILED;
 	}
 
+	if (doc->arena != NULL) {
+		/* the clone stays on the heap */
+		doc->arena->foreign = TRUE;
+	}
 	ixmlDocument_setOwnerDocument(doc, newNode);
 	*rtNode = newNode;
 
@@ -126,14 +130,16 @@ int ixmlDocument_createElementEx(
 		goto ErrorHandler;
 	}
 
-	newElement = (IXML_Element *) malloc(sizeof(IXML_Element));
+	newElement = (IXML_Element *)ixml_doc_malloc(doc, sizeof(IXML_Element));
 	if (newElement == NULL) {
 		errCode = IXML_INSUFFICIENT_MEMORY;
 		goto ErrorHandler;
 	}
 
 	ixmlElement_init(newElement);
-	newElement->tagName = strdup(tagName);
+	newElement->n.ownerDocument = doc;
+	newElement->n.nodeType = eELEMENT_NODE;
+	newElement->tagName = ixml_node_strdup(&newElement->n, tagName);
 	if (newElement->tagName == NULL) {
 		ixmlElement_free(newElement);
 		newElement = NULL;
@@ -141,18 +147,14 @@ int ixmlDocument_createElementEx(
 		goto ErrorHandler;
 	}
 	/* set the node fields */
-	newElement->n.nodeType = eELEMENT_NODE;
-	newElement->n.nodeName = strdup(tagName);
+	newElement->n.nodeName = ixml_node_strdup(&newElement->n, tagName);
 	if (newElement->n.nodeName == NULL) {
-		free(newElement->tagName);
 		ixmlElement_free(newElement);
 		newElement = NULL;
 		errCode = IXML_INSUFFICIENT_MEMORY;
 		goto ErrorHandler;
 	}
 
-	newElement->n.ownerDocument = doc;
-
 ErrorHandler:
 	*rtElement = newElement;
 
@@ -218,6 +220,53 @@ IXML_Document *ixmlDocument_createDocument()
 }
 
 
+int ixmlDocument_createDocumentArenaEx(IXML_Document **rtDoc)
+{
+	IXML_Arena *arena;
+	IXML_Document *doc = NULL;
+	int errCode = IXML_SUCCESS;
+
+	arena = ixml_arena_new();
+	if (arena == NULL) {
+		errCode = IXML_INSUFFICIENT_MEMORY;
+		goto ErrorHandler;
+	}
+	/* the document is the first node of its arena */
+	doc = (IXML_Document *)ixml_arena_alloc(arena, sizeof (IXML_Document));
+	if (doc == NULL) {
+		ixml_arena_delete(arena);
+		errCode = IXML_INSUFFICIENT_MEMORY;
+		goto ErrorHandler;
+	}
+
+	ixmlDocument_init(doc);
+	doc->arena = arena;
+	doc->n.nodeType = eDOCUMENT_NODE;
+	doc->n.ownerDocument = doc;
+	doc->n.nodeName = ixml_node_strdup(&doc->n, DOCUMENTNODENAME);
+	if (doc->n.nodeName == NULL) {
+		ixmlDocument_free(doc);
+		doc = NULL;
+		errCode = IXML_INSUFFICIENT_MEMORY;
+		goto ErrorHandler;
+	}
+
+ErrorHandler:
+	*rtDoc = doc;
+	return errCode;
+}
+
+
+IXML_Document *ixmlDocument_createDocumentArena(void)
+{
+	IXML_Document *doc = NULL;
+
+	ixmlDocument_createDocumentArenaEx(&doc);
+
+	return doc;
+}
+
+
 int ixmlDocument_createTextNodeEx(
 	IXML_Document *doc,
 	const DOMString data,
@@ -232,15 +281,16 @@ int ixmlDocument_createTextNodeEx(
 		goto ErrorHandler;
 	}
 
-	returnNode = (IXML_Node *)malloc(sizeof (IXML_Node));
+	returnNode = (IXML_Node *)ixml_doc_malloc(doc, sizeof (IXML_Node));
 	if (returnNode == NULL) {
 		rc = IXML_INSUFFICIENT_MEMORY;
 		goto ErrorHandler;
 	}
 	/* initialize the node */
 	ixmlNode_init(returnNode);
+	returnNode->ownerDocument = doc;
 
-	returnNode->nodeName = strdup((const char*)TEXTNODENAME);
+	returnNode->nodeName = ixml_node_strdup(returnNode, TEXTNODENAME);
 	if (returnNode->nodeName == NULL) {
 		ixmlNode_free(returnNode);
 		returnNode = NULL;
@@ -249,7 +299,7 @@ int ixmlDocument_createTextNodeEx(
 	}
 	/* add in node value */
 	if (data != NULL) {
-		returnNode->nodeValue = strdup(data);
+		returnNode->nodeValue = ixml_node_strdup(returnNode, data);
 		if (returnNode->nodeValue == NULL) {
 			ixmlNode_free(returnNode);
 			returnNode = NULL;
@@ -259,7 +309,6 @@ int ixmlDocument_createTextNodeEx(
 	}
 
 	returnNode->nodeType = eTEXT_NODE;
-	returnNode->ownerDocument = doc;
 
 ErrorHandler:
 	*textNode = returnNode;
@@ -287,24 +336,23 @@ int ixmlDocument_createAttributeEx(
 	IXML_Attr *attrNode = NULL;
 	int errCode = IXML_SUCCESS;
 
-	attrNode = (IXML_Attr *)malloc(sizeof (IXML_Attr));
-	if (attrNode == NULL) {
-		errCode = IXML_INSUFFICIENT_MEMORY;
+	if (doc == NULL || name == NULL) {
+		errCode = IXML_INVALID_PARAMETER;
 		goto ErrorHandler;
 	}
 
-	if (doc == NULL || name == NULL) {
-		ixmlAttr_free(attrNode);
-		attrNode = NULL;
-		errCode = IXML_INVALID_PARAMETER;
+	attrNode = (IXML_Attr *)ixml_doc_malloc(doc, sizeof (IXML_Attr));
+	if (attrNode == NULL) {
+		errCode = IXML_INSUFFICIENT_MEMORY;
 		goto ErrorHandler;
 	}
 
 	ixmlAttr_init(attrNode);
 	attrNode->n.nodeType = eATTRIBUTE_NODE;
+	attrNode->n.ownerDocument = doc;
 
 	/* set the node fields */
-	attrNode->n.nodeName = strdup(name);
+	attrNode->n.nodeName = ixml_node_strdup(&attrNode->n, name);
 	if (attrNode->n.nodeName == NULL) {
 		ixmlAttr_free(attrNode);
 		attrNode = NULL;
@@ -312,8 +360,6 @@ int ixmlDocument_createAttributeEx(
 		goto ErrorHandler;
 	}
 
-	attrNode->n.ownerDocument = doc;
-
 ErrorHandler:
 	*rtAttr = attrNode;
 	return errCode;
@@ -353,7 +399,7 @@ int ixmlDocument_createAttributeNSEx(
 		goto ErrorHandler;
 	}
 	/* set the namespaceURI field */
-	attrNode->n.namespaceURI = strdup(namespaceURI);
+	attrNode->n.namespaceURI = ixml_node_strdup(&attrNode->n, namespaceURI);
 	if (attrNode->n.namespaceURI == NULL) {
 		ixmlAttr_free(attrNode);
 		attrNode = NULL;
@@ -402,7 +448,8 @@ int ixmlDocument_createCDATASectionEx(
 		goto ErrorHandler;
 	}
 
-	cDSectionNode = (IXML_CDATASection *)malloc(sizeof (IXML_CDATASection));
+	cDSectionNode = (IXML_CDATASection *)ixml_doc_malloc(doc,
+		sizeof (IXML_CDATASection));
 	if (cDSectionNode == NULL) {
 		errCode = IXML_INSUFFICIENT_MEMORY;
 		goto ErrorHandler;
@@ -410,7 +457,9 @@ int ixmlDocument_createCDATASectionEx(
 
 	ixmlCDATASection_init(cDSectionNode);
 	cDSectionNode->n.nodeType = eCDATA_SECTION_NODE;
-	cDSectionNode->n.nodeName = strdup((const char*)CDATANODENAME);
+	cDSectionNode->n.ownerDocument = doc;
+	cDSectionNode->n.nodeName = ixml_node_strdup(&cDSectionNode->n,
+		CDATANODENAME);
 	if (cDSectionNode->n.nodeName == NULL) {
 		ixmlCDATASection_free(cDSectionNode);
 		cDSectionNode = NULL;
@@ -418,7 +467,7 @@ int ixmlDocument_createCDATASectionEx(
 		goto ErrorHandler;
 	}
 
-	cDSectionNode->n.nodeValue = strdup(data);
+	cDSectionNode->n.nodeValue = ixml_node_strdup(&cDSectionNode->n, data);
 	if (cDSectionNode->n.nodeValue == NULL) {
 		ixmlCDATASection_free( cDSectionNode );
 		cDSectionNode = NULL;
@@ -426,8 +475,6 @@ int ixmlDocument_createCDATASectionEx(
 		goto ErrorHandler;
 	}
 
-	cDSectionNode->n.ownerDocument = doc;
-
 ErrorHandler:
 	*rtCD = cDSectionNode;
 	return errCode;
@@ -468,7 +515,8 @@ int ixmlDocument_createElementNSEx(
 		goto ErrorHandler;
 	}
 	/* set the namespaceURI field */
-	newElement->n.namespaceURI = strdup(namespaceURI);
+	newElement->n.namespaceURI = ixml_node_strdup(&newElement->n,
+		namespaceURI);
 	if (newElement->n.namespaceURI == NULL) {
 		line = __LINE__;
 		ixmlElement_free(newElement);
@@ -72,9 +72,9 @@ int ixmlElement_setTagName(IXML_Element *element, const char *tagName)
 	}
 
 	if (element->tagName != NULL) {
-		free(element->tagName);
+		ixml_node_mfree(&element->n, element->tagName);
 	}
-	element->tagName = strdup(tagName);
+	element->tagName = ixml_node_strdup(&element->n, tagName);
 	if (element->tagName == NULL) {
 		rc = IXML_INSUFFICIENT_MEMORY;
 	}
@@ -142,7 +142,7 @@ int ixmlElement_setAttribute(
 		}
 
 		attrNode = (IXML_Node *)newAttrNode;
-		attrNode->nodeValue = strdup(value);
+		attrNode->nodeValue = ixml_node_strdup(attrNode, value);
 		if (attrNode->nodeValue == NULL) {
 		ixmlAttr_free(newAttrNode);
 		errCode = IXML_INSUFFICIENT_MEMORY;
@@ -157,9 +157,9 @@ int ixmlElement_setAttribute(
 	} else {
 		if (attrNode->nodeValue != NULL) {
 			/* Attribute name has a value already */
-			free(attrNode->nodeValue);
+			ixml_node_mfree(attrNode, attrNode->nodeValue);
 		}
-		attrNode->nodeValue = strdup(value);
+		attrNode->nodeValue = ixml_node_strdup(attrNode, value);
 		if (attrNode->nodeValue == NULL) {
 			errCode = IXML_INSUFFICIENT_MEMORY;
 		}
@@ -190,7 +190,7 @@ int ixmlElement_removeAttribute(IXML_Element *element, const DOMString name)
 	if (attrNode != NULL) {
 		/* Has the attribute */
 		if (attrNode->nodeValue != NULL) {
-			free(attrNode->nodeValue);
+			ixml_node_mfree(attrNode, attrNode->nodeValue);
 			attrNode->nodeValue = NULL;
 		}
 	}
@@ -452,11 +452,12 @@ int ixmlElement_setAttributeNS(
 	if (attrNode != NULL) {
 		if (attrNode->prefix != NULL) {
 			/* Remove the old prefix */
-			free(attrNode->prefix);
+			ixml_node_mfree(attrNode, attrNode->prefix);
 		}
 		/* replace it with the new prefix */
 		if (newAttrNode.prefix != NULL) {
-			attrNode->prefix = strdup( newAttrNode.prefix );
+			attrNode->prefix = ixml_node_strdup(attrNode,
+				newAttrNode.prefix);
 			if (attrNode->prefix == NULL) {
 				Parser_freeNodeContent(&newAttrNode);
 				return IXML_INSUFFICIENT_MEMORY;
@@ -465,11 +466,11 @@ int ixmlElement_setAttributeNS(
 			attrNode->prefix = newAttrNode.prefix;
 
 		if (attrNode->nodeValue != NULL) {
-			free(attrNode->nodeValue);
+			ixml_node_mfree(attrNode, attrNode->nodeValue);
 		}
-		attrNode->nodeValue = strdup(value);
+		attrNode->nodeValue = ixml_node_strdup(attrNode, value);
 		if (attrNode->nodeValue == NULL) {
-			free(attrNode->prefix);
+			ixml_node_mfree(attrNode, attrNode->prefix);
 			Parser_freeNodeContent(&newAttrNode);
 			return IXML_INSUFFICIENT_MEMORY;
 		}
@@ -484,7 +485,7 @@ int ixmlElement_setAttributeNS(
 			Parser_freeNodeContent(&newAttrNode);
 			return rc;
 		}
-		newAttr->n.nodeValue = strdup(value);
+		newAttr->n.nodeValue = ixml_node_strdup(&newAttr->n, value);
 		if (newAttr->n.nodeValue == NULL) {
 			ixmlAttr_free(newAttr);
 			Parser_freeNodeContent(&newAttrNode);
@@ -526,7 +527,7 @@ int ixmlElement_removeAttributeNS(
 	if(attrNode != NULL) {
 		/* Has the attribute */
 		if(attrNode->nodeValue != NULL) {
-			free(attrNode->nodeValue);
+			ixml_node_mfree(attrNode, attrNode->nodeValue);
 			attrNode->nodeValue = NULL;
 		}
 	}
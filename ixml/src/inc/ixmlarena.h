@@ -0,0 +1,197 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+
+#ifndef IXML_ARENA_H
+#define IXML_ARENA_H
+
+
+/*!
+ * \file
+ *
+ * \brief Per document arena allocator.
+ *
+ * The nodes and strings of an arena document are bump allocated from a list
+ * of chunks and released all at once by ixmlDocument_free(). A node lives
+ * either in the arena of its owner document or on the heap, and its strings
+ * always live with it, so the setters use ixml_node_strdup() and
+ * ixml_node_mfree() instead of strdup() and free().
+ *
+ * Heap nodes enter an arena document through ixmlDocument_importNode() and
+ * through ixmlNode_appendChild() of a cloned node. Such an arena is marked
+ * foreign: its nodes are then located by address, and freeing the document
+ * walks the tree to free the heap nodes.
+ */
+
+
+#include "ixml.h"
+
+
+#include <stdlib.h> /* for size_t */
+
+
+/*! Size of the first chunk of an arena. */
+#define IXML_ARENA_FIRST_CHUNK 4096u
+
+/*! The chunks double in size up to this size. */
+#define IXML_ARENA_MAX_CHUNK (256u * 1024u)
+
+
+/*!
+ * \brief A chunk of an arena.
+ */
+typedef struct _IXML_ArenaChunk
+{
+	/*! Next older chunk. */
+	struct _IXML_ArenaChunk *next;
+	/*! End of the chunk. */
+	char *end;
+} IXML_ArenaChunk;
+
+
+/*!
+ * \brief The arena of a document.
+ */
+struct _IXML_Arena
+{
+	/*! Most recent chunk. */
+	IXML_ArenaChunk *chunks;
+	/*! Free space of the most recent chunk. */
+	char *cur;
+	/*! End of the most recent chunk. */
+	char *end;
+	/*! Size of the next chunk. */
+	size_t nextSize;
+	/*! TRUE once a heap node was adopted by the document. */
+	int foreign;
+};
+
+
+/*!
+ * \brief Creates an empty arena.
+ *
+ * \return The arena, or NULL if there is not enough memory.
+ */
+IXML_Arena *ixml_arena_new(void);
+
+
+/*!
+ * \brief Frees an arena and everything allocated from it.
+ */
+void ixml_arena_delete(
+	/*! [in] The arena to free. */
+	IXML_Arena *arena);
+
+
+/*!
+ * \brief Allocates pointer aligned memory from an arena.
+ *
+ * \return The memory, or NULL if there is not enough memory.
+ */
+void *ixml_arena_alloc(
+	/*! [in] The arena. */
+	IXML_Arena *arena,
+	/*! [in] Number of bytes to allocate. */
+	size_t size);
+
+
+/*!
+ * \brief Reports whether a pointer was allocated from an arena.
+ *
+ * \return TRUE if the pointer lies in one of the chunks of the arena.
+ */
+int ixml_arena_owns(
+	/*! [in] The arena. */
+	const IXML_Arena *arena,
+	/*! [in] The pointer to look for. */
+	const void *p);
+
+
+/*!
+ * \brief Returns the arena a node was allocated from.
+ *
+ * \return The arena of the owner document of the node, or NULL if the node
+ * lives on the heap.
+ */
+IXML_Arena *ixml_node_arena(
+	/*! [in] The node. */
+	const IXML_Node *nodeptr);
+
+
+/*!
+ * \brief Allocates the memory of a new node of a document.
+ *
+ * \return The memory, from the arena of the document if it has one.
+ */
+void *ixml_doc_malloc(
+	/*! [in] The document, may be NULL. */
+	IXML_Document *doc,
+	/*! [in] Number of bytes to allocate. */
+	size_t size);
+
+
+/*!
+ * \brief Allocates memory that lives with a node.
+ *
+ * \return The memory, or NULL if there is not enough memory.
+ */
+void *ixml_node_malloc(
+	/*! [in] The node the memory belongs to. */
+	const IXML_Node *nodeptr,
+	/*! [in] Number of bytes to allocate. */
+	size_t size);
+
+
+/*!
+ * \brief Duplicates a string that lives with a node.
+ *
+ * \return The copy, or NULL if there is not enough memory.
+ */
+char *ixml_node_strdup(
+	/*! [in] The node the string belongs to. */
+	const IXML_Node *nodeptr,
+	/*! [in] The string to copy. */
+	const char *s);
+
+
+/*!
+ * \brief Frees memory that lives with a node.
+ *
+ * Memory of an arena node is only reclaimed with its document.
+ */
+void ixml_node_mfree(
+	/*! [in] The node the memory belongs to. */
+	const IXML_Node *nodeptr,
+	/*! [in] The memory to free, may be NULL. */
+	void *p);
+
+
+#endif /* IXML_ARENA_H */
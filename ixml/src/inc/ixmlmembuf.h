@@ -53,6 +53,13 @@
 #define MEMBUF_DEF_SIZE_INC 20u
 
 
+/*!
+ * \brief Largest number of bytes added when a buffer grows. Below it, the
+ * capacity doubles.
+ */
+#define MEMBUF_MAX_GROWTH ((size_t)262144)
+
+
 /*!
  * \brief The ixml_membuf type.
  */
@@ -40,6 +40,7 @@
 
 
 #include "ixml.h"
+#include "ixmlarena.h"
 #include "ixmlmembuf.h"
 
 
@@ -128,7 +129,20 @@ void Parser_freeNodeContent(
 	/*! [in] The Node to process. */
 	IXML_Node *IXML_Nodeptr);
 
-int Parser_LoadDocument(IXML_Document **retDoc, const char * xmlFile, BOOL file);
+int Parser_LoadDocument(IXML_Document **retDoc, const char * xmlFile, BOOL file, BOOL arena);
+
+/*!
+ * \brief Parses a xml buffer and reports it to SAX callbacks.
+ *
+ * \return IXML_SUCCESS or an error code, see ixmlSaxParse().
+ */
+int Parser_SaxParse(
+	/*! [in] The buffer to parse, it is not copied. */
+	const char *buffer,
+	/*! [in] The callbacks. */
+	const IXML_SaxHandler *handler,
+	/*! [in] The cookie passed to the callbacks. */
+	void *cookie);
 
 int Parser_setNodePrefixAndLocalName(IXML_Node *newIXML_NodeIXML_Attr);
 
@@ -330,7 +330,7 @@ int ixmlLoadDocumentEx(const char *xmlFile, IXML_Document **doc)
 		return IXML_INVALID_PARAMETER;
 	}
 
-	return Parser_LoadDocument(doc, xmlFile, TRUE);
+	return Parser_LoadDocument(doc, xmlFile, TRUE, FALSE);
 }
 
 
@@ -428,7 +428,38 @@ int ixmlParseBufferEx(const char *buffer, IXML_Document **retDoc)
 		return IXML_INVALID_PARAMETER;
 	}
 
-	return Parser_LoadDocument(retDoc, buffer, FALSE);
+	return Parser_LoadDocument(retDoc, buffer, FALSE, FALSE);
+}
+
+
+int ixmlParseBufferArenaEx(const char *buffer, IXML_Document **retDoc)
+{
+	if (buffer == NULL || retDoc == NULL) {
+		return IXML_INVALID_PARAMETER;
+	}
+
+	if (buffer[0] == '\0') {
+		return IXML_INVALID_PARAMETER;
+	}
+
+	return Parser_LoadDocument(retDoc, buffer, FALSE, TRUE);
+}
+
+
+int ixmlSaxParse(
+	const char *buffer,
+	const IXML_SaxHandler *handler,
+	void *cookie)
+{
+	if (buffer == NULL || handler == NULL) {
+		return IXML_INVALID_PARAMETER;
+	}
+
+	if (buffer[0] == '\0') {
+		return IXML_INVALID_PARAMETER;
+	}
+
+	return Parser_SaxParse(buffer, handler, cookie);
 }
 
 
@@ -442,6 +473,16 @@ IXML_Document *ixmlParseBuffer(const char *buffer)
 }
 
 
+IXML_Document *ixmlParseBufferArena(const char *buffer)
+{
+	IXML_Document *doc = NULL;
+
+	ixmlParseBufferArenaEx(buffer, &doc);
+
+	return doc;
+}
+
+
 DOMString ixmlCloneDOMString(const DOMString src)
 {
 	if (src == NULL) {
@@ -0,0 +1,224 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+
+/*!
+ * \file
+ */
+
+
+#include "ixmlarena.h"
+
+
+#include <assert.h>
+#include <string.h>
+
+
+/*! Alignment of the arena allocations. */
+#define IXML_ARENA_ALIGN sizeof(void *)
+
+/*! Rounds a size up to the arena alignment. */
+#define IXML_ARENA_ROUND(s) \
+	(((s) + IXML_ARENA_ALIGN - 1u) & ~(IXML_ARENA_ALIGN - 1u))
+
+/*! Offset of the memory of a chunk, after its header. */
+#define IXML_CHUNK_HEADER IXML_ARENA_ROUND(sizeof(IXML_ArenaChunk))
+
+
+/*!
+ * \brief Adds a chunk to an arena.
+ *
+ * Requests larger than a quarter of the next chunk get a chunk of their own,
+ * which does not replace the current chunk.
+ *
+ * \return The allocated memory, or NULL if there is not enough memory.
+ */
+static void *ixml_arena_grow(
+	/*! [in] The arena. */
+	IXML_Arena *arena,
+	/*! [in] Rounded number of bytes to allocate. */
+	size_t size)
+{
+	IXML_ArenaChunk *chunk;
+	size_t chunkSize;
+	char *p;
+
+	if (size > arena->nextSize / 4u) {
+		chunk = malloc(IXML_CHUNK_HEADER + size);
+		if (chunk == NULL)
+			return NULL;
+		chunk->end = (char *)chunk + IXML_CHUNK_HEADER + size;
+		/* keep the current chunk first */
+		chunk->next = arena->chunks->next;
+		arena->chunks->next = chunk;
+
+		return (char *)chunk + IXML_CHUNK_HEADER;
+	}
+	chunkSize = arena->nextSize;
+	chunk = malloc(chunkSize);
+	if (chunk == NULL)
+		return NULL;
+	if (arena->nextSize < IXML_ARENA_MAX_CHUNK)
+		arena->nextSize *= 2u;
+	chunk->end = (char *)chunk + chunkSize;
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+	p = (char *)chunk + IXML_CHUNK_HEADER;
+	arena->cur = p + size;
+	arena->end = chunk->end;
+
+	return p;
+}
+
+
+IXML_Arena *ixml_arena_new(void)
+{
+	IXML_ArenaChunk *chunk;
+	IXML_Arena *arena;
+
+	/* the arena lives at the start of its first chunk */
+	chunk = malloc(IXML_ARENA_FIRST_CHUNK);
+	if (chunk == NULL)
+		return NULL;
+	chunk->next = NULL;
+	chunk->end = (char *)chunk + IXML_ARENA_FIRST_CHUNK;
+	arena = (IXML_Arena *)((char *)chunk + IXML_CHUNK_HEADER);
+	arena->chunks = chunk;
+	arena->cur = (char *)arena + IXML_ARENA_ROUND(sizeof(IXML_Arena));
+	arena->end = chunk->end;
+	arena->nextSize = IXML_ARENA_FIRST_CHUNK * 2u;
+	arena->foreign = FALSE;
+
+	return arena;
+}
+
+
+void ixml_arena_delete(IXML_Arena *arena)
+{
+	IXML_ArenaChunk *chunk;
+	IXML_ArenaChunk *next;
+
+	if (arena == NULL)
+		return;
+	chunk = arena->chunks;
+	while (chunk != NULL) {
+		next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+}
+
+
+void *ixml_arena_alloc(IXML_Arena *arena, size_t size)
+{
+	char *p;
+
+	assert(arena != NULL);
+
+	size = IXML_ARENA_ROUND(size);
+	if ((size_t)(arena->end - arena->cur) < size)
+		return ixml_arena_grow(arena, size);
+	p = arena->cur;
+	arena->cur += size;
+
+	return p;
+}
+
+
+int ixml_arena_owns(const IXML_Arena *arena, const void *p)
+{
+	const IXML_ArenaChunk *chunk;
+	const char *c = p;
+
+	for (chunk = arena->chunks; chunk != NULL; chunk = chunk->next) {
+		if (c >= (const char *)chunk && c < chunk->end)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+
+IXML_Arena *ixml_node_arena(const IXML_Node *nodeptr)
+{
+	IXML_Arena *arena;
+
+	if (nodeptr->ownerDocument == NULL)
+		return NULL;
+	arena = nodeptr->ownerDocument->arena;
+	if (arena == NULL)
+		return NULL;
+	/* without adopted nodes, every node of the document is in the arena */
+	if (arena->foreign && !ixml_arena_owns(arena, nodeptr))
+		return NULL;
+
+	return arena;
+}
+
+
+void *ixml_doc_malloc(IXML_Document *doc, size_t size)
+{
+	if (doc != NULL && doc->arena != NULL)
+		return ixml_arena_alloc(doc->arena, size);
+
+	return malloc(size);
+}
+
+
+void *ixml_node_malloc(const IXML_Node *nodeptr, size_t size)
+{
+	IXML_Arena *arena = ixml_node_arena(nodeptr);
+
+	if (arena != NULL)
+		return ixml_arena_alloc(arena, size);
+
+	return malloc(size);
+}
+
+
+char *ixml_node_strdup(const IXML_Node *nodeptr, const char *s)
+{
+	size_t length = strlen(s) + (size_t)1;
+	char *copy;
+
+	copy = ixml_node_malloc(nodeptr, length);
+	if (copy != NULL)
+		memcpy(copy, s, length);
+
+	return copy;
+}
+
+
+void ixml_node_mfree(const IXML_Node *nodeptr, void *p)
+{
+	if (p != NULL && ixml_node_arena(nodeptr) == NULL)
+		free(p);
+}
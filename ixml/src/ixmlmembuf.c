@@ -61,7 +61,7 @@ static int ixml_membuf_set_size(
 	/*! [in] The new lenght. */
 	IN size_t new_length)
 {
-	size_t diff;
+	size_t growth;
 	size_t alloc_len;
 	char *temp_buf;
 
@@ -73,17 +73,22 @@ static int ixml_membuf_set_size(
 			return 0;
 		}
 
-		diff = new_length - m->length;
-		alloc_len = MAXVAL(m->size_inc, diff) + m->capacity;
+		/* double the capacity, by at least size_inc and at most
+		 * MEMBUF_MAX_GROWTH bytes */
+		growth = MINVAL(MAXVAL(m->capacity, m->size_inc),
+				MEMBUF_MAX_GROWTH);
+		alloc_len = MAXVAL(m->capacity + growth, new_length);
 	} else {
 		/* decrease length */
 		assert(new_length <= m->length);
 
-		/* if diff is 0..m->size_inc, don't free */
-		if ((m->capacity - new_length) <= m->size_inc) {
+		/* if diff is 0..m->size_inc, or the buffer stays at least a
+		 * quarter full, don't free */
+		if ((m->capacity - new_length) <= m->size_inc ||
+		    new_length >= m->capacity / 4u) {
 			return 0;
 		}
-		alloc_len = new_length + m->size_inc;
+		alloc_len = new_length + MAXVAL(m->size_inc, new_length);
 	}
 
 	assert(alloc_len >= new_length);
@@ -557,12 +557,17 @@ static int Parser_setLastElem(
 
 /*!
  * \brief Clear token buffer.
+ *
+ * The memory is kept for the next token, Parser_free() releases it.
  */
 static void Parser_clearTokenBuf(
 	/*! [in] The XML parser. */
 	Parser *xmlParser)
 {
-    ixml_membuf_destroy( &( xmlParser->tokenBuf ) );
+    if( xmlParser->tokenBuf.buf != NULL ) {
+        xmlParser->tokenBuf.length = ( size_t )0;
+        xmlParser->tokenBuf.buf[0] = '\0';
+    }
 }
 
 
@@ -1513,7 +1518,8 @@ static int Parser_addNamespace(
 		if (pCur->namespaceUri) {
 			/* it would be wrong that pNode->namespace != NULL. */
 			assert(pNode->namespaceURI == NULL);
-			pNode->namespaceURI = safe_strdup(pCur->namespaceUri);
+			pNode->namespaceURI = ixml_node_strdup(pNode,
+				pCur->namespaceUri);
 			if (!pNode->namespaceURI)
 				return IXML_INSUFFICIENT_MEMORY;
 		}
@@ -1525,7 +1531,8 @@ static int Parser_addNamespace(
 			return IXML_FAILED;
 		namespaceUri = Parser_getNameSpace(xmlParser, pCur->prefix);
 		if (namespaceUri) {
-			pNode->namespaceURI = safe_strdup(namespaceUri);
+			pNode->namespaceURI = ixml_node_strdup(pNode,
+				namespaceUri);
 			if (!pNode->namespaceURI)
 				return IXML_INSUFFICIENT_MEMORY;
 			xmlParser->pNeedPrefixNode = NULL;
@@ -1986,7 +1993,8 @@ static int Parser_setElementNamespace(
         if( newElement->n.namespaceURI != NULL ) {
             return IXML_SYNTAX_ERR;
         } else {
-            ( newElement->n ).namespaceURI = safe_strdup( nsURI );
+            ( newElement->n ).namespaceURI =
+                ixml_node_strdup( &newElement->n, nsURI ? nsURI : "" );
             if( ( newElement->n ).namespaceURI == NULL ) {
                 return IXML_INSUFFICIENT_MEMORY;
             }
@@ -2339,7 +2347,9 @@ static int Parser_parseDocument(
 	/*! [out] The XML document. */
 	IXML_Document **retDoc,
 	/*! [in] The XML parser. */
-	Parser *xmlParser)
+	Parser *xmlParser,
+	/*! [in] TRUE to build an arena document. */
+	BOOL arena)
 {
     IXML_Document *gRootDoc = NULL;
     IXML_Node newNode;
@@ -2352,7 +2362,11 @@ static int Parser_parseDocument(
      * can go wrong on the error handler. */
     ixmlNode_init( &newNode );
 
-    rc = ixmlDocument_createDocumentEx( &gRootDoc );
+    if( arena ) {
+        rc = ixmlDocument_createDocumentArenaEx( &gRootDoc );
+    } else {
+        rc = ixmlDocument_createDocumentEx( &gRootDoc );
+    }
     if( rc != IXML_SUCCESS ) {
         goto ErrorHandler;
     }
@@ -2470,6 +2484,302 @@ ErrorHandler:
 }
 
 
+/*!
+ * \brief State of a streaming parse, see Parser_parseSax().
+ */
+typedef struct _SaxState
+{
+	/*! The callbacks. */
+	const IXML_SaxHandler *handler;
+	/*! The cookie passed to the callbacks. */
+	void *cookie;
+	/*! Name of the element whose start tag is being read, or \c NULL. */
+	char *pendingName;
+	/*! Attribute names and values of that element, \c NULL terminated. */
+	char **attrs;
+	/*! Number of strings in attrs. */
+	size_t numAttrs;
+	/*! Allocated size of attrs. */
+	size_t attrsSize;
+} SaxState;
+
+
+/*!
+ * \brief Frees the pending start tag of a streaming parse.
+ */
+static void Parser_saxFreePending(
+	/*! [in] The streaming parse state. */
+	SaxState *sax)
+{
+	size_t i;
+
+	free(sax->pendingName);
+	sax->pendingName = NULL;
+	for (i = 0; i < sax->numAttrs; ++i)
+		free(sax->attrs[i]);
+	sax->numAttrs = 0;
+}
+
+
+/*!
+ * \brief Moves an attribute node into the pending start tag.
+ *
+ * \return IXML_SUCCESS, IXML_SYNTAX_ERR for a duplicate attribute or
+ * IXML_INSUFFICIENT_MEMORY.
+ */
+static int Parser_saxAddAttribute(
+	/*! [in] The streaming parse state. */
+	SaxState *sax,
+	/*! [in] The attribute node, its name and value are taken. */
+	IXML_Node *node)
+{
+	char **attrs;
+	size_t size;
+	size_t i;
+
+	for (i = 0; i < sax->numAttrs; i += 2)
+		if (strcmp(sax->attrs[i], node->nodeName) == 0)
+			return IXML_SYNTAX_ERR;
+	/* room for the pair and the terminating NULL */
+	if (sax->numAttrs + 3 > sax->attrsSize) {
+		size = sax->attrsSize ? 2 * sax->attrsSize : 9;
+		attrs = realloc(sax->attrs, size * sizeof (char *));
+		if (attrs == NULL)
+			return IXML_INSUFFICIENT_MEMORY;
+		sax->attrs = attrs;
+		sax->attrsSize = size;
+	}
+	sax->attrs[sax->numAttrs++] = node->nodeName;
+	sax->attrs[sax->numAttrs++] = node->nodeValue;
+	node->nodeName = NULL;
+	node->nodeValue = NULL;
+
+	return IXML_SUCCESS;
+}
+
+
+/*!
+ * \brief Resolves the namespace of the element on top of the stack once
+ * its attributes, and so its namespace definitions, have been read.
+ *
+ * The URI is stored in the stack item, where the descendants look for it.
+ *
+ * \return IXML_SUCCESS or IXML_INSUFFICIENT_MEMORY.
+ */
+static int Parser_saxNamespace(
+	/*! [in] The XML parser. */
+	Parser *xmlParser,
+	/*! [in] The streaming parse state. */
+	SaxState *sax,
+	/*! [out] The namespace URI, or \c NULL. */
+	const char **nsURI)
+{
+	IXML_ElementStack *pCur = xmlParser->pCurElement;
+	IXML_Node node;
+	char *resolved = NULL;
+	size_t prefixLen = strlen("xmlns:");
+	size_t i;
+
+	if (pCur->prefix != NULL) {
+		/* Parser_xmlNamespace() stores both a "xmlns" and a
+		 * "xmlns:prefix" definition in the stack item, so look for the
+		 * latter in the attributes. */
+		for (i = 0; i < sax->numAttrs; i += 2)
+			if (strncmp(sax->attrs[i], "xmlns:", prefixLen) == 0 &&
+			    strcmp(sax->attrs[i] + prefixLen, pCur->prefix) == 0)
+				resolved = sax->attrs[i + 1];
+	} else {
+		resolved = pCur->namespaceUri;
+	}
+	if (resolved == NULL) {
+		/* not defined by the element itself, look at the ancestors as
+		 * Parser_processElementName() does before the push */
+		xmlParser->pCurElement = pCur->nextElement;
+		if (pCur->prefix != NULL) {
+			ixmlNode_init(&node);
+			node.prefix = pCur->prefix;
+			Parser_ElementPrefixDefined(xmlParser, &node, &resolved);
+		} else {
+			Parser_hasDefaultNamespace(xmlParser, &resolved);
+		}
+		xmlParser->pCurElement = pCur;
+	}
+	if (resolved != pCur->namespaceUri) {
+		free(pCur->namespaceUri);
+		pCur->namespaceUri = NULL;
+		if (resolved != NULL) {
+			pCur->namespaceUri = safe_strdup(resolved);
+			if (pCur->namespaceUri == NULL)
+				return IXML_INSUFFICIENT_MEMORY;
+		}
+	}
+	*nsURI = pCur->namespaceUri;
+
+	return IXML_SUCCESS;
+}
+
+
+/*!
+ * \brief Reports the pending start tag, if any.
+ *
+ * \return IXML_SUCCESS or the error to stop the parse with.
+ */
+static int Parser_saxStartElement(
+	/*! [in] The XML parser. */
+	Parser *xmlParser,
+	/*! [in] The streaming parse state. */
+	SaxState *sax)
+{
+	static const char *noAttrs[] = { NULL };
+	const char **attrs = noAttrs;
+	const char *nsURI;
+	int rc;
+
+	if (sax->pendingName == NULL)
+		return IXML_SUCCESS;
+	rc = Parser_saxNamespace(xmlParser, sax, &nsURI);
+	if (rc == IXML_SUCCESS && sax->handler->startElement != NULL) {
+		if (sax->numAttrs > 0) {
+			sax->attrs[sax->numAttrs] = NULL;
+			attrs = (const char **)sax->attrs;
+		}
+		rc = sax->handler->startElement(sax->cookie, sax->pendingName,
+			nsURI, attrs);
+	}
+	Parser_saxFreePending(sax);
+
+	return rc;
+}
+
+
+/*!
+ * \brief Parses the xml document and reports it to the SAX callbacks,
+ * without building a DOM tree.
+ *
+ * The loop is the one of Parser_parseDocument(): only the handling of the
+ * nodes returned by Parser_getNextNode() differs.
+ *
+ * \return IXML_SUCCESS, a parse error, or the error returned by a callback.
+ */
+static int Parser_parseSax(
+	/*! [in] The XML parser. */
+	Parser *xmlParser,
+	/*! [in] The callbacks. */
+	const IXML_SaxHandler *handler,
+	/*! [in] The cookie passed to the callbacks. */
+	void *cookie)
+{
+	SaxState sax;
+	IXML_Node newNode;
+	BOOL bETag = FALSE;
+	int rc = IXML_SUCCESS;
+
+	memset(&sax, 0, sizeof (sax));
+	sax.handler = handler;
+	sax.cookie = cookie;
+	ixmlNode_init(&newNode);
+
+	rc = Parser_skipProlog(xmlParser);
+	if (rc != IXML_SUCCESS)
+		goto ExitFunction;
+	while (bETag == FALSE) {
+		ixmlNode_init(&newNode);
+		if (Parser_getNextNode(xmlParser, &newNode, &bETag) ==
+		    IXML_SUCCESS) {
+			if (bETag == FALSE) {
+				switch (newNode.nodeType) {
+				case eELEMENT_NODE:
+					rc = Parser_saxStartElement(xmlParser,
+						&sax);
+					if (rc != IXML_SUCCESS)
+						goto ExitFunction;
+					if (xmlParser->bHasTopLevel &&
+					    isTopLevelElement(xmlParser)) {
+						rc = IXML_SYNTAX_ERR;
+						goto ExitFunction;
+					}
+					xmlParser->bHasTopLevel = TRUE;
+					rc = Parser_pushElement(xmlParser,
+						&newNode);
+					if (rc != IXML_SUCCESS)
+						goto ExitFunction;
+					/* reported once its attributes are read */
+					sax.pendingName = newNode.nodeName;
+					newNode.nodeName = NULL;
+					break;
+				case eTEXT_NODE:
+				case eCDATA_SECTION_NODE:
+					if (handler->characters != NULL) {
+						rc = handler->characters(cookie,
+							newNode.nodeValue);
+						if (rc != IXML_SUCCESS)
+							goto ExitFunction;
+					}
+					break;
+				case eATTRIBUTE_NODE:
+					if (sax.pendingName == NULL) {
+						rc = IXML_SYNTAX_ERR;
+						goto ExitFunction;
+					}
+					rc = Parser_saxAddAttribute(&sax,
+						&newNode);
+					if (rc != IXML_SUCCESS)
+						goto ExitFunction;
+					break;
+				default:
+					break;
+				}
+			} else {
+				/* end tag, or the end of an empty element */
+				rc = Parser_saxStartElement(xmlParser, &sax);
+				if (rc != IXML_SUCCESS)
+					goto ExitFunction;
+				if (!Parser_isValidEndElement(xmlParser,
+							      &newNode)) {
+					rc = IXML_SYNTAX_ERR;
+					goto ExitFunction;
+				}
+				Parser_popElement(xmlParser);
+				if (handler->endElement != NULL) {
+					rc = handler->endElement(cookie,
+						newNode.nodeName);
+					if (rc != IXML_SUCCESS)
+						goto ExitFunction;
+				}
+				xmlParser->state = eCONTENT;
+			}
+			if (xmlParser->state == eCONTENT) {
+				/* the start tag is complete */
+				rc = Parser_saxStartElement(xmlParser, &sax);
+				if (rc != IXML_SUCCESS)
+					goto ExitFunction;
+			}
+			bETag = FALSE;
+		} else if (bETag == TRUE) {
+			/* file is done */
+			break;
+		} else {
+			rc = IXML_FAILED;
+			goto ExitFunction;
+		}
+		Parser_freeNodeContent(&newNode);
+	}
+	if (xmlParser->pCurElement != NULL)
+		rc = IXML_SYNTAX_ERR;
+
+ExitFunction:
+	if (rc == IXML_FILE_DONE)
+		/* stopped by a callback */
+		rc = IXML_SUCCESS;
+	Parser_freeNodeContent(&newNode);
+	Parser_saxFreePending(&sax);
+	free(sax.attrs);
+	Parser_free(xmlParser);
+
+	return rc;
+}
+
+
 BOOL Parser_isValidXmlName(const DOMString name)
 {
 	const char *pstr = NULL;
@@ -2585,7 +2895,9 @@ int Parser_LoadDocument(
 	const char *xmlFileName,
 	/*! [in] TRUE if you want to read from a file, false if xmlFileName is
 	 * the buffer to copy to the parser. */
-	BOOL file)
+	BOOL file,
+	/*! [in] TRUE to build an arena document. */
+	BOOL arena)
 {
     int rc = IXML_SUCCESS;
     Parser *xmlParser = NULL;
@@ -2602,12 +2914,32 @@ int Parser_LoadDocument(
     }
 
     xmlParser->curPtr = xmlParser->dataBuffer;
-    rc = Parser_parseDocument( retDoc, xmlParser );
+    rc = Parser_parseDocument( retDoc, xmlParser, arena );
     return rc;
 
 }
 
 
+int Parser_SaxParse(
+	const char *buffer,
+	const IXML_SaxHandler *handler,
+	void *cookie)
+{
+	Parser *xmlParser = NULL;
+
+	xmlParser = Parser_init();
+	if (xmlParser == NULL) {
+		return IXML_INSUFFICIENT_MEMORY;
+	}
+	/* the parser never writes to its input, so parse the caller's
+	 * buffer in place rather than a copy of it */
+	xmlParser->dataBuffer = NULL;
+	xmlParser->curPtr = (char *)buffer;
+
+	return Parser_parseSax(xmlParser, handler, cookie);
+}
+
+
 void Parser_freeNodeContent(IXML_Node *nodeptr)
 {
     if( nodeptr == NULL ) {
@@ -2656,7 +2988,7 @@ int Parser_setNodePrefixAndLocalName(
     pStrPrefix = strchr( node->nodeName, ':' );
     if( pStrPrefix == NULL ) {
         node->prefix = NULL;
-        node->localName = safe_strdup( node->nodeName );
+        node->localName = ixml_node_strdup( node, node->nodeName );
         if( node->localName == NULL ) {
             return IXML_INSUFFICIENT_MEMORY;
         }
@@ -2665,7 +2997,7 @@ int Parser_setNodePrefixAndLocalName(
         /* fill in the local name and prefix */
         pLocalName = ( char * )pStrPrefix + 1;
         nPrefix = pStrPrefix - node->nodeName;
-        node->prefix = malloc((size_t)nPrefix + (size_t)1);
+        node->prefix = ixml_node_malloc(node, (size_t)nPrefix + (size_t)1);
         if (!node->prefix) {
             return IXML_INSUFFICIENT_MEMORY;
         }
@@ -2673,9 +3005,9 @@ int Parser_setNodePrefixAndLocalName(
         memset(node->prefix, 0, (size_t)nPrefix + (size_t)1);
         strncpy(node->prefix, node->nodeName, (size_t)nPrefix);
 
-        node->localName = safe_strdup( pLocalName );
+        node->localName = ixml_node_strdup( node, pLocalName );
         if( node->localName == NULL ) {
-            free( node->prefix );
+            ixml_node_mfree( node, node->prefix );
 	    /* no need to free really, main loop will frees it
 	     * when return code is not success */
             node->prefix = NULL;
@@ -76,6 +76,10 @@ static void ixmlNode_freeSingleNode(
 	IXML_Element *element = NULL;
 
 	if (nodeptr != NULL) {
+		if (ixml_node_arena(nodeptr) != NULL) {
+			/* released with the arena */
+			return;
+		}
 		if (nodeptr->nodeName != NULL) {
 			free(nodeptr->nodeName);
 		}
@@ -106,11 +110,22 @@ static void ixmlNode_freeSingleNode(
 
 void ixmlNode_free(IXML_Node *nodeptr)
 {
+	IXML_Arena *arena;
+
 	if (nodeptr != NULL) {
-		ixmlNode_free(nodeptr->firstChild);
-		ixmlNode_free(nodeptr->nextSibling);
-		ixmlNode_free(nodeptr->firstAttr);
-		ixmlNode_freeSingleNode(nodeptr);
+		arena = ixml_node_arena(nodeptr);
+		/* without adopted heap nodes, nothing below an arena node
+		 * needs to be freed */
+		if (arena == NULL || arena->foreign) {
+			ixmlNode_free(nodeptr->firstChild);
+			ixmlNode_free(nodeptr->nextSibling);
+			ixmlNode_free(nodeptr->firstAttr);
+			ixmlNode_freeSingleNode(nodeptr);
+		}
+		if (arena != NULL &&
+		    nodeptr == (IXML_Node *)nodeptr->ownerDocument) {
+			ixml_arena_delete(arena);
+		}
 	}
 }
 
@@ -149,12 +164,12 @@ static int ixmlNode_setNamespaceURI(
 	}
 
 	if (nodeptr->namespaceURI != NULL) {
-		free(nodeptr->namespaceURI);
+		ixml_node_mfree(nodeptr, nodeptr->namespaceURI);
 		nodeptr->namespaceURI = NULL;
 	}
 
 	if (namespaceURI != NULL) {
-		nodeptr->namespaceURI = strdup(namespaceURI);
+		nodeptr->namespaceURI = ixml_node_strdup(nodeptr, namespaceURI);
 		if (nodeptr->namespaceURI == NULL) {
 			return IXML_INSUFFICIENT_MEMORY;
 		}
@@ -178,12 +193,12 @@ static int ixmlNode_setPrefix(
 	}
 
 	if (nodeptr->prefix != NULL) {
-		free(nodeptr->prefix);
+		ixml_node_mfree(nodeptr, nodeptr->prefix);
 		nodeptr->prefix = NULL;
 	}
 
 	if (prefix != NULL) {
-		nodeptr->prefix = strdup(prefix);
+		nodeptr->prefix = ixml_node_strdup(nodeptr, prefix);
 		if(nodeptr->prefix == NULL) {
 			return IXML_INSUFFICIENT_MEMORY;
 		}
@@ -207,12 +222,12 @@ static int ixmlNode_setLocalName(
 	assert(nodeptr != NULL);
 
 	if (nodeptr->localName != NULL) {
-		free(nodeptr->localName);
+		ixml_node_mfree(nodeptr, nodeptr->localName);
 		nodeptr->localName = NULL;
 	}
 
 	if (localName != NULL) {
-		nodeptr->localName = strdup(localName);
+		nodeptr->localName = ixml_node_strdup(nodeptr, localName);
 		if (nodeptr->localName == NULL) {
 			return IXML_INSUFFICIENT_MEMORY;
 		}
@@ -265,12 +280,12 @@ int ixmlNode_setNodeValue(IXML_Node *nodeptr, const char *newNodeValue)
 	}
 
 	if (nodeptr->nodeValue != NULL) {
-		free(nodeptr->nodeValue);
+		ixml_node_mfree(nodeptr, nodeptr->nodeValue);
 		nodeptr->nodeValue = NULL;
 	}
 
 	if (newNodeValue != NULL) {
-		nodeptr->nodeValue = strdup(newNodeValue);
+		nodeptr->nodeValue = ixml_node_strdup(nodeptr, newNodeValue);
 		if (nodeptr->nodeValue == NULL) {
 			return IXML_INSUFFICIENT_MEMORY;
 		}
@@ -626,6 +641,12 @@ int ixmlNode_appendChild(IXML_Node *nodeptr, IXML_Node *newChild)
 	}
 	/* set the parent node pointer */
 	newChild->parentNode = nodeptr;
+	if (newChild->ownerDocument == NULL &&
+	    nodeptr->ownerDocument != NULL &&
+	    nodeptr->ownerDocument->arena != NULL) {
+		/* a cloned heap node joins an arena document */
+		nodeptr->ownerDocument->arena->foreign = TRUE;
+	}
 	newChild->ownerDocument = nodeptr->ownerDocument;
 
 	/* if the first child */
@@ -1206,7 +1227,9 @@ static void ixmlNode_getElementsByTagNameRecursive(
 {
 	const char *name;
 
-	if (n != NULL) {
+	/* recurse on the children only, a long list of siblings must not
+	 * exhaust the stack */
+	for (; n != NULL; n = ixmlNode_getNextSibling(n)) {
 		if (ixmlNode_getNodeType(n) == eELEMENT_NODE) {
 			name = ixmlNode_getNodeName(n);
 			if (strcmp(tagname, name) == 0 || strcmp(tagname, "*") == 0) {
@@ -1214,7 +1237,6 @@ static void ixmlNode_getElementsByTagNameRecursive(
 			}
 		}
 		ixmlNode_getElementsByTagNameRecursive(ixmlNode_getFirstChild(n), tagname, list);
-		ixmlNode_getElementsByTagNameRecursive(ixmlNode_getNextSibling(n), tagname, list);
 	}
 }
 
@@ -1254,7 +1276,7 @@ static void ixmlNode_getElementsByTagNameNSRecursive(
 	const DOMString nsURI;
 	const DOMString name;
 
-	if (n != NULL) {
+	for (; n != NULL; n = ixmlNode_getNextSibling(n)) {
 		if (ixmlNode_getNodeType(n) == eELEMENT_NODE) {
 			name = ixmlNode_getLocalName(n);
 			nsURI = ixmlNode_getNamespaceURI(n);
@@ -1269,8 +1291,6 @@ static void ixmlNode_getElementsByTagNameNSRecursive(
 		}
 		ixmlNode_getElementsByTagNameNSRecursive(
 			ixmlNode_getFirstChild(n), namespaceURI, localName, list);
-		ixmlNode_getElementsByTagNameNSRecursive(
-			ixmlNode_getNextSibling(n), namespaceURI, localName, list);
 	}
 }
 
@@ -1312,20 +1332,20 @@ int ixmlNode_setNodeName(
 	assert( node != NULL );
 
 	if (node->nodeName != NULL) {
-		free(node->nodeName);
+		ixml_node_mfree(node, node->nodeName);
 		node->nodeName = NULL;
 	}
 
 	if (qualifiedName != NULL) {
 		/* set the name part */
-		node->nodeName = strdup(qualifiedName);
+		node->nodeName = ixml_node_strdup(node, qualifiedName);
 		if (node->nodeName == NULL) {
 			return IXML_INSUFFICIENT_MEMORY;
 		}
 
 		rc = Parser_setNodePrefixAndLocalName(node);
 		if (rc != IXML_SUCCESS) {
-			free(node->nodeName);
+			ixml_node_mfree(node, node->nodeName);
 		}
 	}
 
@@ -1365,15 +1385,15 @@ int ixmlNode_setNodeProperties(
 
 ErrorHandler:
 	if(destNode->nodeName != NULL) {
-		free(destNode->nodeName);
+		ixml_node_mfree(destNode, destNode->nodeName);
 		destNode->nodeName = NULL;
 	}
 	if(destNode->nodeValue != NULL) {
-		free(destNode->nodeValue);
+		ixml_node_mfree(destNode, destNode->nodeValue);
 		destNode->nodeValue = NULL;
 	}
 	if(destNode->localName != NULL) {
-		free(destNode->localName);
+		ixml_node_mfree(destNode, destNode->localName);
 		destNode->localName = NULL;
 	}
 
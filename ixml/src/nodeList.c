@@ -43,6 +43,10 @@
 #include <string.h>
 
 
+/*! Number of nodes of the first allocation of a list. */
+#define NODELIST_FIRST_CAPACITY 8lu
+
+
 void ixmlNodeList_init(IXML_NodeList *nList)
 {
 	assert(nList != NULL);
@@ -55,37 +59,24 @@ IXML_Node *ixmlNodeList_item(
 	IXML_NodeList *nList,
 	unsigned long index)
 {
-	IXML_NodeList *next;
-	unsigned int i;
-
 	/* if the list ptr is NULL */
 	if (nList == NULL) {
 		return NULL;
 	}
 	/* if index is more than list length */
-	if (index > ixmlNodeList_length(nList) - 1lu) {
-		return NULL;
-	}
-
-	next = nList;
-	for (i = 0u; i < index && next != NULL; ++i) {
-		next = next->next;
-	}
-
-	if (next == NULL) {
+	if (index >= nList->length) {
 		return NULL;
 	}
 
-	return next->nodeItem;
+	return nList->nodeItems[index];
 }
 
 int ixmlNodeList_addToNodeList(
 	IXML_NodeList **nList,
 	IXML_Node *add)
 {
-	IXML_NodeList *traverse = NULL;
-	IXML_NodeList *p = NULL;
-	IXML_NodeList *newListItem;
+	IXML_Node **items;
+	unsigned long capacity;
 
 	assert(add != NULL);
 
@@ -103,23 +94,19 @@ int ixmlNodeList_addToNodeList(
 		ixmlNodeList_init(*nList);
 	}
 
-	if ((*nList)->nodeItem == NULL) {
-		(*nList)->nodeItem = add;
-	} else {
-		traverse = *nList;
-		while (traverse != NULL) {
-			p = traverse;
-			traverse = traverse->next;
-		}
-
-		newListItem = (IXML_NodeList *)malloc(sizeof (IXML_NodeList));
-		if (newListItem == NULL) {
+	if ((*nList)->length == (*nList)->capacity) {
+		/* double the array, appends are amortized O(1) */
+		capacity = (*nList)->capacity == 0lu ?
+			NODELIST_FIRST_CAPACITY : (*nList)->capacity * 2lu;
+		items = (IXML_Node **)realloc((*nList)->nodeItems,
+			capacity * sizeof (IXML_Node *));
+		if (items == NULL) {
 			return IXML_INSUFFICIENT_MEMORY;
 		}
-		p->next = newListItem;
-		newListItem->nodeItem = add;
-		newListItem->next = NULL;
+		(*nList)->nodeItems = items;
+		(*nList)->capacity = capacity;
 	}
+	(*nList)->nodeItems[(*nList)->length++] = add;
 
 	return IXML_SUCCESS;
 }
@@ -127,27 +114,18 @@ int ixmlNodeList_addToNodeList(
 
 unsigned long ixmlNodeList_length(IXML_NodeList *nList)
 {
-	IXML_NodeList *list;
-	unsigned long length = 0lu;
-
-	list = nList;
-	while (list != NULL) {
-		++length;
-		list = list->next;
+	if (nList == NULL) {
+		return 0lu;
 	}
 
-	return length;
+	return nList->length;
 }
 
 
 void ixmlNodeList_free(IXML_NodeList *nList)
 {
-	IXML_NodeList *next;
-
-	while (nList != NULL) {
-		next = nList->next;
+	if (nList != NULL) {
+		free(nList->nodeItems);
 		free(nList);
-		nList = next;
 	}
 }
-
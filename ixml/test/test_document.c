@@ -34,9 +34,14 @@
 #include "ixml.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <ctype.h>
 
 
+/* Items of the flat document. */
+#define FLAT_ITEMS 5000
+
+
 static const char*
 get_ixml_error_string (IXML_ERRORCODE code)
 {
@@ -73,9 +78,381 @@ get_ixml_error_string (IXML_ERRORCODE code)
 
 
 
+/*
+ * Trace of the tags and text of a document, one line each, written by the
+ * SAX callbacks and by trace_dom () alike so that both parsers can be
+ * compared. A SAX parse can be stopped at a given start tag.
+ */
+typedef struct {
+	char* buf;
+	size_t length;
+	size_t size;
+	/* start tags seen */
+	int starts;
+	/* start tag returning stop_rc, 0 for none */
+	int stop_at;
+	int stop_rc;
+} trace;
+
+
+static void
+trace_add (trace* t, const char* s)
+{
+	size_t n = strlen (s);
+
+	if (t->length + n + 1 > t->size) {
+		t->size = 2 * (t->length + n + 1);
+		t->buf = realloc (t->buf, t->size);
+		if (t->buf == NULL) {
+			fprintf (stderr, "** error : out of memory\n");
+			exit (EXIT_FAILURE); // ---------->
+		}
+	}
+	memcpy (t->buf + t->length, s, n + 1);
+	t->length += n;
+}
+
+
+static void
+trace_start (trace* t, const char* name, const char* namespaceURI)
+{
+	trace_add (t, "<");
+	trace_add (t, name);
+	if (namespaceURI != NULL) {
+		trace_add (t, " {");
+		trace_add (t, namespaceURI);
+		trace_add (t, "}");
+	}
+}
+
+
+static void
+trace_attribute (trace* t, const char* name, const char* value)
+{
+	trace_add (t, " ");
+	trace_add (t, name);
+	trace_add (t, "=");
+	trace_add (t, value);
+}
+
+
+static int
+sax_start (void* cookie, const char* name, const char* namespaceURI,
+	   const char** attributes)
+{
+	trace* t = cookie;
+
+	trace_start (t, name, namespaceURI);
+	for (; attributes[0] != NULL; attributes += 2)
+		trace_attribute (t, attributes[0], attributes[1]);
+	trace_add (t, ">\n");
+	if (++t->starts == t->stop_at)
+		return t->stop_rc;
+	return IXML_SUCCESS;
+}
+
+
+static int
+sax_end (void* cookie, const char* name)
+{
+	trace* t = cookie;
+
+	trace_add (t, "</");
+	trace_add (t, name);
+	trace_add (t, ">\n");
+	return IXML_SUCCESS;
+}
+
+
+static int
+sax_characters (void* cookie, const char* text)
+{
+	trace* t = cookie;
+
+	trace_add (t, "[");
+	trace_add (t, text);
+	trace_add (t, "]\n");
+	return IXML_SUCCESS;
+}
+
+
+static void
+trace_dom (trace* t, IXML_Node* node)
+{
+	IXML_NamedNodeMap* attributes;
+	IXML_Node* child;
+	IXML_Node* attr;
+	const char* value;
+	unsigned long i;
+
+	for (child = ixmlNode_getFirstChild (node); child != NULL;
+	     child = ixmlNode_getNextSibling (child)) {
+		switch (ixmlNode_getNodeType (child)) {
+		case eELEMENT_NODE:
+			trace_start (t, ixmlNode_getNodeName (child),
+				     ixmlNode_getNamespaceURI (child));
+			attributes = ixmlNode_getAttributes (child);
+			for (i = 0; i < ixmlNamedNodeMap_getLength (attributes);
+			     i++) {
+				attr = ixmlNamedNodeMap_item (attributes, i);
+				trace_attribute (t, ixmlNode_getNodeName (attr),
+						 ixmlNode_getNodeValue (attr));
+			}
+			ixmlNamedNodeMap_free (attributes);
+			trace_add (t, ">\n");
+			trace_dom (t, child);
+			sax_end (t, ixmlNode_getNodeName (child));
+			break;
+		case eTEXT_NODE:
+		case eCDATA_SECTION_NODE:
+			value = ixmlNode_getNodeValue (child);
+			if (value != NULL && value[strspn (value, " \t\r\n")])
+				sax_characters (t, value);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+
+static int
+count_elements (IXML_Node* node)
+{
+	IXML_Node* child;
+	int n = 0;
+
+	for (child = ixmlNode_getFirstChild (node); child != NULL;
+	     child = ixmlNode_getNextSibling (child)) {
+		if (ixmlNode_getNodeType (child) == eELEMENT_NODE)
+			n += 1 + count_elements (child);
+	}
+	return n;
+}
+
+
+/*
+ * Checks the child lists of a node and of all its descendants against
+ * their sibling links.
+ */
+static int
+check_child_nodes (IXML_Node* node)
+{
+	IXML_NodeList* list;
+	IXML_Node* child;
+	unsigned long i = 0;
+	int ok;
+
+	list = ixmlNode_getChildNodes (node);
+	ok = list != NULL;
+	for (child = ixmlNode_getFirstChild (node); ok && child != NULL;
+	     child = ixmlNode_getNextSibling (child), i++) {
+		ok = ixmlNodeList_item (list, i) == child &&
+			check_child_nodes (child);
+	}
+	ok = ok && ixmlNodeList_length (list) == i &&
+		ixmlNodeList_item (list, i) == NULL;
+	ixmlNodeList_free (list);
+	return ok;
+}
+
+
+/*
+ * Checks that a list holds the elements named tagname ("*" for all) of a
+ * subtree, node included, in document order, from position *pos on.
+ */
+static int
+check_elements (IXML_Node* node, const char* tagname, IXML_NodeList* list,
+		unsigned long* pos)
+{
+	IXML_Node* child;
+
+	if (ixmlNode_getNodeType (node) == eELEMENT_NODE &&
+	    (strcmp (tagname, "*") == 0 ||
+	     strcmp (tagname, ixmlNode_getNodeName (node)) == 0)) {
+		if (ixmlNodeList_item (list, *pos) != node)
+			return FALSE;
+		(*pos)++;
+	}
+	for (child = ixmlNode_getFirstChild (node); child != NULL;
+	     child = ixmlNode_getNextSibling (child)) {
+		if (!check_elements (child, tagname, list, pos))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+
+/*
+ * Checks a list returned by getElementsByTagName on a subtree, NULL when
+ * nothing matched, and frees it.
+ */
+static int
+check_tag_list (IXML_Node* node, const char* tagname, IXML_NodeList* list)
+{
+	unsigned long pos = 0;
+	int ok;
+
+	ok = check_elements (node, tagname, list, &pos) &&
+		ixmlNodeList_length (list) == pos &&
+		ixmlNodeList_item (list, pos) == NULL &&
+		(pos > 0) == (list != NULL);
+	ixmlNodeList_free (list);
+	return ok;
+}
+
+
+/*
+ * Checks the node lists of a document: the child lists of every node, and
+ * the lists of all the elements and of the elements named as the last
+ * child element of the root, from the document and from the root.
+ */
+static int
+check_node_lists (IXML_Document* doc)
+{
+	IXML_Node* root;
+	IXML_Node* child;
+	const char* name;
+
+	root = ixmlNode_getFirstChild ((IXML_Node*)doc);
+	while (root != NULL && ixmlNode_getNodeType (root) != eELEMENT_NODE)
+		root = ixmlNode_getNextSibling (root);
+	if (root == NULL || !check_child_nodes ((IXML_Node*)doc))
+		return FALSE;
+	name = ixmlNode_getNodeName (root);
+	for (child = ixmlNode_getFirstChild (root); child != NULL;
+	     child = ixmlNode_getNextSibling (child)) {
+		if (ixmlNode_getNodeType (child) == eELEMENT_NODE)
+			name = ixmlNode_getNodeName (child);
+	}
+	return check_tag_list ((IXML_Node*)doc, "*",
+			       ixmlDocument_getElementsByTagName (doc, "*")) &&
+		check_tag_list ((IXML_Node*)doc, name,
+				ixmlDocument_getElementsByTagName (doc,
+								   name)) &&
+		check_tag_list (root, "*", ixmlElement_getElementsByTagName (
+					(IXML_Element*)root, "*")) &&
+		check_tag_list (root, name, ixmlElement_getElementsByTagName (
+					(IXML_Element*)root, name)) &&
+		check_tag_list ((IXML_Node*)doc, "none",
+				ixmlDocument_getElementsByTagName (doc,
+								   "none"));
+}
+
+
+/*
+ * Checks the lists of a long flat document, as a Browse result.
+ */
+static int
+check_flat_list (void)
+{
+	const char* item = "<item>x</item>";
+	IXML_Document* doc = NULL;
+	IXML_NodeList* list;
+	IXML_Node* root;
+	char* buf;
+	char* p;
+	int ok;
+	int i;
+
+	buf = malloc (strlen ("<list></list>") +
+		      FLAT_ITEMS * strlen (item) + 1);
+	if (buf == NULL)
+		return FALSE;
+	strcpy (buf, "<list>");
+	p = buf + strlen (buf);
+	for (i = 0; i < FLAT_ITEMS; i++, p += strlen (item))
+		strcpy (p, item);
+	strcpy (p, "</list>");
+	ok = ixmlParseBufferEx (buf, &doc) == IXML_SUCCESS;
+	free (buf);
+	if (!ok)
+		return FALSE;
+	root = ixmlNode_getFirstChild ((IXML_Node*)doc);
+	list = ixmlDocument_getElementsByTagName (doc, "item");
+	ok = ixmlNodeList_length (list) == FLAT_ITEMS &&
+		check_tag_list (root, "item", list) &&
+		check_child_nodes (root) &&
+		ixmlNodeList_length (NULL) == 0 &&
+		ixmlNodeList_item (NULL, 0) == NULL;
+	ixmlDocument_free (doc);
+	return ok;
+}
+
+
+static char*
+read_file (const char* filename)
+{
+	FILE* f;
+	long size;
+	char* buf = NULL;
+
+	f = fopen (filename, "rb");
+	if (f == NULL)
+		return NULL;
+	if (fseek (f, 0, SEEK_END) == 0 && (size = ftell (f)) > 0 &&
+	    fseek (f, 0, SEEK_SET) == 0) {
+		buf = malloc ((size_t)size + 1);
+		if (buf != NULL) {
+			buf[fread (buf, 1, (size_t)size, f)] = '\0';
+		}
+	}
+	fclose (f);
+	return buf;
+}
+
+
+/*
+ * Modifies an arena document with both arena and heap nodes: imports the
+ * root element of the heap document, appends a clone of the arena root,
+ * replaces attribute values and removes a child.
+ */
+static int
+mutate_arena (IXML_Document* doc, IXML_Document* arena_doc)
+{
+	IXML_Element* root;
+	IXML_Node* node = NULL;
+	IXML_Node* child;
+	int rc;
+
+	root = (IXML_Element*)ixmlNode_getFirstChild ((IXML_Node*)arena_doc);
+	rc = ixmlDocument_importNode (arena_doc,
+				      ixmlNode_getFirstChild ((IXML_Node*)doc),
+				      TRUE, &node);
+	if (rc != IXML_SUCCESS)
+		return rc;
+	rc = ixmlNode_appendChild ((IXML_Node*)root, node);
+	if (rc != IXML_SUCCESS)
+		return rc;
+	rc = ixmlNode_appendChild ((IXML_Node*)root,
+				   ixmlNode_cloneNode ((IXML_Node*)root, FALSE));
+	if (rc != IXML_SUCCESS)
+		return rc;
+	rc = ixmlElement_setAttribute (root, "arena", "one");
+	if (rc != IXML_SUCCESS)
+		return rc;
+	rc = ixmlElement_setAttribute (root, "arena", "two");
+	if (rc != IXML_SUCCESS)
+		return rc;
+	rc = ixmlElement_setAttribute ((IXML_Element*)node, "heap", "one");
+	if (rc != IXML_SUCCESS)
+		return rc;
+	child = ixmlNode_getFirstChild ((IXML_Node*)root);
+	rc = ixmlNode_setNodeValue (child, "changed");
+	if (rc != IXML_SUCCESS)
+		return rc;
+	return ixmlNode_removeChild ((IXML_Node*)root, child, NULL);
+}
+
+
 int
 main (int argc, char* argv[])
 {
+	IXML_SaxHandler handler = { sax_start, sax_end, sax_characters };
+	IXML_SaxHandler no_handler = { NULL, NULL, NULL };
+	trace sax;
+	trace dom;
+	int elements;
 	int i;
 
 	if (argc < 2) {
@@ -83,12 +460,26 @@ main (int argc, char* argv[])
 			 argv[0]);
 		exit (EXIT_FAILURE); // ---------->
 	}
+	if (ixmlSaxParse (NULL, &handler, NULL) != IXML_INVALID_PARAMETER ||
+	    ixmlSaxParse ("<a/>", NULL, NULL) != IXML_INVALID_PARAMETER ||
+	    ixmlSaxParse ("<a/>", &no_handler, NULL) != IXML_SUCCESS ||
+	    ixmlSaxParse ("<a><b></a>", &no_handler, NULL) !=
+	    IXML_SYNTAX_ERR) {
+		fprintf (stderr, "** error : bad ixmlSaxParse () checks\n");
+		exit (EXIT_FAILURE); // ---------->
+	}
+	if (!check_flat_list ()) {
+		fprintf (stderr, "** error : bad list of a flat document\n");
+		exit (EXIT_FAILURE); // ---------->
+	}
 
 	for (i = 1; i < argc; i++) {
 		int rc;
 		IXML_Document* doc = NULL;
+		IXML_Document* arena_doc = NULL;
 		DOMString s;
 		char* p;
+		char* q;
 
 		printf ("Test \"%s\" \n", argv[i]);
 		printf ("    Loading ... ");
@@ -127,6 +518,128 @@ main (int argc, char* argv[])
 
 		printf ("OK\n");
 
+		printf ("    Streaming ... ");
+		fflush (stdout);
+
+		p = read_file (argv[i]);
+		if (p == NULL) {
+			fprintf (stderr,
+				 "** error : can't read document %s\n",
+				 argv[i]);
+			exit (EXIT_FAILURE); // ---------->
+		}
+		memset (&sax, 0, sizeof (sax));
+		memset (&dom, 0, sizeof (dom));
+		trace_add (&sax, "");
+		trace_add (&dom, "");
+		rc = ixmlSaxParse (p, &handler, &sax);
+		if (rc != IXML_SUCCESS) {
+			fprintf (stderr,
+				 "** error : can't stream document %s : "
+				 "error %d (%s)\n",
+				 argv[i], rc, get_ixml_error_string (rc));
+			exit (EXIT_FAILURE); // ---------->
+		}
+		trace_dom (&dom, (IXML_Node*)doc);
+		if (strcmp (sax.buf, dom.buf) != 0) {
+			fprintf (stderr,
+				 "** error : document %s streams as\n%s"
+				 "but parses as\n%s",
+				 argv[i], sax.buf, dom.buf);
+			exit (EXIT_FAILURE); // ---------->
+		}
+
+		/* stopped by a callback, without or with an error */
+		elements = count_elements ((IXML_Node*)doc);
+		sax.length = 0;
+		sax.starts = 0;
+		sax.stop_at = elements < 2 ? elements : 2;
+		sax.stop_rc = IXML_FILE_DONE;
+		rc = ixmlSaxParse (p, &handler, &sax);
+		if (rc != IXML_SUCCESS || sax.starts != sax.stop_at) {
+			fprintf (stderr,
+				 "** error : stopping document %s : error %d "
+				 "(%s) after %d start tags\n",
+				 argv[i], rc, get_ixml_error_string (rc),
+				 sax.starts);
+			exit (EXIT_FAILURE); // ---------->
+		}
+		sax.starts = 0;
+		sax.stop_rc = IXML_FAILED;
+		rc = ixmlSaxParse (p, &handler, &sax);
+		if (rc != IXML_FAILED || sax.starts != sax.stop_at) {
+			fprintf (stderr,
+				 "** error : failing document %s : error %d "
+				 "(%s) after %d start tags\n",
+				 argv[i], rc, get_ixml_error_string (rc),
+				 sax.starts);
+			exit (EXIT_FAILURE); // ---------->
+		}
+		free (sax.buf);
+		free (dom.buf);
+
+		/* cut in the middle, failing as the DOM parser does */
+		q = strdup (p);
+		if (q == NULL) {
+			fprintf (stderr, "** error : out of memory\n");
+			exit (EXIT_FAILURE); // ---------->
+		}
+		q[strlen (q) / 2] = '\0';
+		rc = ixmlSaxParse (q, &no_handler, NULL);
+		if (rc == IXML_SUCCESS ||
+		    rc != ixmlParseBufferEx (q, &arena_doc)) {
+			fprintf (stderr,
+				 "** error : streamed half of document %s : "
+				 "error %d (%s)\n",
+				 argv[i], rc, get_ixml_error_string (rc));
+			exit (EXIT_FAILURE); // ---------->
+		}
+		free (q);
+
+		printf ("OK\n");
+
+		printf ("    Arena ... ");
+		fflush (stdout);
+
+		rc = ixmlParseBufferArenaEx (p, &arena_doc);
+		if (rc != IXML_SUCCESS) {
+			fprintf (stderr,
+				 "** error : can't parse document %s in an "
+				 "arena : error %d (%s)\n",
+				 argv[i], rc, get_ixml_error_string (rc));
+			exit (EXIT_FAILURE); // ---------->
+		}
+		free (p);
+		p = ixmlPrintDocument (arena_doc);
+		if (p == NULL || strcmp (p, s) != 0) {
+			fprintf (stderr,
+				 "** error : arena document %s prints "
+				 "differently\n", argv[i]);
+			exit (EXIT_FAILURE); // ---------->
+		}
+		ixmlFreeDOMString (p);
+		if (mutate_arena (doc, arena_doc) != IXML_SUCCESS) {
+			fprintf (stderr,
+				 "** error : can't modify arena document %s\n",
+				 argv[i]);
+			exit (EXIT_FAILURE); // ---------->
+		}
+		ixmlDocument_free (arena_doc);
+
+		printf ("OK\n");
+
+		printf ("    Node lists ... ");
+		fflush (stdout);
+
+		if (!check_node_lists (doc)) {
+			fprintf (stderr,
+				 "** error : bad node lists of document %s\n",
+				 argv[i]);
+			exit (EXIT_FAILURE); // ---------->
+		}
+
+		printf ("OK\n");
+
 		ixmlFreeDOMString (s);
 		ixmlDocument_free (doc);
 	}
@@ -0,0 +1,222 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * * Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * * Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * * Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+#ifndef HASH_TABLE_H
+#define HASH_TABLE_H
+
+/*!
+ * \file
+ */
+
+#include "LinkedList.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Minimum number of slots allocated by a hash table. */
+#define HASHTABLE_MIN_SIZE 16
+
+/*! Hash table slot. Stores the key, its hash and the generic item.
+ * \internal
+ */
+typedef struct HASHTABLESLOT
+{
+	/*! Key of the item, owned by the item. NULL for an empty slot. */
+	const char *key;
+	/*! Cached hash value of key. */
+	unsigned int hash;
+	/*! Item stored in the slot. */
+	void *item;
+} HashTableSlot;
+
+/*!
+ * Open addressing hash table keyed by strings (no protection).
+ *
+ * Collisions are resolved by linear probing in a power of two sized
+ * slot array. Keys are not copied: the caller must keep the key alive
+ * (usually it is a member of the item) for as long as the item is in
+ * the table. Deleted slots are marked as tombstones and reclaimed when
+ * the table is rehashed.
+ *
+ * To iterate through the table:
+ *
+ *	HashTable h;
+ *	long pos = 0;
+ *	void *item;
+ *	while ((item = HashTableIterNext(&h, &pos)) != NULL) {
+ *	}
+ *
+ * \internal
+ */
+typedef struct HASHTABLE
+{
+	/*! Slot array, capacity entries. */
+	HashTableSlot *slots;
+	/*! Number of slots, always a power of two. */
+	long capacity;
+	/*! Number of items stored. */
+	long size;
+	/*! Number of tombstones. */
+	long deleted;
+} HashTable;
+
+/*!
+ * \brief Computes the hash value of a key (32 bit FNV-1a).
+ *
+ * \return The hash value.
+ */
+unsigned int HashTableHashKey(
+	/*! NULL terminated key. */
+	const char *key);
+
+/*!
+ * \brief Computes the hash value of the first length bytes of key.
+ *
+ * \return The hash value, equal to HashTableHashKey() of the same bytes.
+ */
+unsigned int HashTableHashKeyN(
+	/*! Key, not necessarily NULL terminated. */
+	const char *key,
+	/*! Length of key. */
+	size_t length);
+
+/*!
+ * \brief Initializes a HashTable. Must be called first and only once.
+ *
+ * \return 0 on success, EOUTOFMEM on failure.
+ */
+int HashTableInit(
+	/*! Must be valid, non null, pointer to a hash table. */
+	HashTable *table,
+	/*! Expected number of items, 0 for the default. */
+	long sizeHint);
+
+/*!
+ * \brief Removes all memory associated with the table. Does not free
+ * HashTable *table.
+ *
+ * Precondition: The table has been initialized.
+ */
+void HashTableDestroy(
+	/*! Must be valid, non null, pointer to a hash table. */
+	HashTable *table,
+	/*! If not NULL, called for every item remaining in the table. */
+	free_function free_func);
+
+/*!
+ * \brief Finds the item stored under key.
+ *
+ * Precondition: The table has been initialized.
+ *
+ * \return The item, NULL if no item is stored under key.
+ */
+void *HashTableFind(
+	/*! Must be valid, non null, pointer to a hash table. */
+	HashTable *table,
+	/*! NULL terminated key. */
+	const char *key);
+
+/*!
+ * \brief Finds the item stored under the first length bytes of key, for
+ * keys that are not NULL terminated (e.g. tokens of a parsed message).
+ *
+ * Precondition: The table has been initialized.
+ *
+ * \return The item, NULL if no item is stored under key.
+ */
+void *HashTableFindN(
+	/*! Must be valid, non null, pointer to a hash table. */
+	HashTable *table,
+	/*! Key, not necessarily NULL terminated. */
+	const char *key,
+	/*! Length of key. */
+	size_t length);
+
+/*!
+ * \brief Stores an item under key. If an item is already stored under
+ * key, it is replaced.
+ *
+ * Precondition: The table has been initialized.
+ *
+ * \return 0 on success, EOUTOFMEM on failure.
+ */
+int HashTableAdd(
+	/*! Must be valid, non null, pointer to a hash table. */
+	HashTable *table,
+	/*! NULL terminated key, must stay valid while the item is stored. */
+	const char *key,
+	/*! Item to be added. */
+	void *item,
+	/*! If not NULL, receives the replaced item or NULL. */
+	void **oldItem);
+
+/*!
+ * \brief Removes the item stored under key. The item is not freed.
+ *
+ * Precondition: The table has been initialized.
+ *
+ * \return The removed item, NULL if no item is stored under key.
+ */
+void *HashTableRemove(
+	/*! Must be valid, non null, pointer to a hash table. */
+	HashTable *table,
+	/*! NULL terminated key. */
+	const char *key);
+
+/*!
+ * \brief Returns the next item of the table in unspecified order.
+ *
+ * The table must not be modified during the iteration, except through
+ * HashTableRemove() of the item just returned.
+ *
+ * \return The next item, NULL when all items have been visited.
+ */
+void *HashTableIterNext(
+	/*! Must be valid, non null, pointer to a hash table. */
+	HashTable *table,
+	/*! Iteration cursor, must be 0 on the first call. */
+	long *pos);
+
+/*!
+ * \brief Returns the number of items in the table.
+ *
+ * \return The number of items in the table.
+ */
+long HashTableSize(
+	/*! Must be valid, non null, pointer to a hash table. */
+	HashTable *table);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HASH_TABLE_H */
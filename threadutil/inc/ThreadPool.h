@@ -89,6 +89,16 @@ typedef enum priority {
 	HIGH_PRIORITY
 } ThreadPriority;
 
+/*! Scheduler modes, see TPAttrSetSchedulerMode(). */
+typedef enum schedulerMode {
+	/*! All workers take jobs from one set of priority queues protected
+	 * by the thread pool mutex. */
+	TP_SCHED_SHARED,
+	/*! Jobs are pushed to a lock-free inbox, moved to per-worker queues
+	 * by the worker that drains it, and stolen by idle workers. */
+	TP_SCHED_WORK_STEALING
+} SchedulerMode;
+
 /*! default priority used by TPJobInit */
 #define DEFAULT_PRIORITY MED_PRIORITY
 
@@ -116,6 +126,13 @@ typedef enum priority {
 /*! default max jobs used TPAttrInit */
 #define DEFAULT_MAX_JOBS_TOTAL 100
 
+/*! default scheduler mode used by TPAttrInit */
+#define DEFAULT_SCHEDULER_MODE TP_SCHED_SHARED
+
+/*! maximum number of per-worker queues of a work stealing pool, used when
+ * the maximum number of threads is INFINITE_THREADS. */
+#define MAX_WORKER_QUEUES 64
+
 /*!
  * \brief Statistics.
  *
@@ -157,6 +174,8 @@ typedef struct THREADPOOLATTR
 	int starvationTime;
 	/*! scheduling policy to use. */
 	PolicyType schedPolicy;
+	/*! how jobs are queued and dispatched, only read by ThreadPoolInit. */
+	SchedulerMode schedulerMode;
 } ThreadPoolAttr;
 
 /*! Internal ThreadPool Job. */
@@ -168,6 +187,8 @@ typedef struct THREADPOOLJOB
 	struct timeval requestTime;
 	ThreadPriority priority;
 	int jobId;
+	/*! next job in the inbox of a work stealing pool. */
+	struct THREADPOOLJOB *next;
 } ThreadPoolJob;
 
 /*! Structure to hold statistics. */
@@ -194,6 +215,27 @@ typedef struct TPOOLSTATS
 	int currentJobsMQ;
 } ThreadPoolStats;
 
+/*!
+ * \brief Job queues of one worker of a work stealing pool.
+ */
+typedef struct TPWORKERQ
+{
+	/*! Mutex to protect the queues and the statistics, taken by the
+	 * owner and by the workers stealing from it. */
+	ithread_mutex_t mutex;
+	/*! whether a worker thread owns these queues. */
+	int inUse;
+	/*! low priority job Q */
+	LinkedList lowJobQ;
+	/*! med priority job Q */
+	LinkedList medJobQ;
+	/*! high priority job Q */
+	LinkedList highJobQ;
+	/*! statistics of the jobs run by the owner, added up by
+	 * ThreadPoolGetStats. */
+	ThreadPoolStats stats;
+} TPWorkerQ;
+
 /*!
  * \brief A thread pool similar to the thread pool in the UPnP SDK.
  *
@@ -208,6 +250,13 @@ typedef struct TPOOLSTATS
  * becomes greater than the set ratio and the thread pool currently has
  * less than the maximum threads then a new thread will
  * be created.
+ *
+ * In TP_SCHED_WORK_STEALING mode, ThreadPoolAdd does not take the thread
+ * pool mutex unless a worker has to be woken up or created: the job is
+ * pushed to a lock-free inbox. A worker without work drains the inbox into
+ * its own queues and wakes another worker if it took more than one job;
+ * workers with empty queues steal from the others. Priorities and the
+ * starvation bumping apply within each worker's queues.
  */
 typedef struct THREADPOOL
 {
@@ -239,6 +288,20 @@ typedef struct THREADPOOL
 	LinkedList highJobQ;
 	/*! persistent job */
 	ThreadPoolJob *persistentJob;
+	/*! scheduler mode, fixed by ThreadPoolInit */
+	SchedulerMode schedulerMode;
+	/*! lock-free stack of the jobs added to a work stealing pool */
+	ThreadPoolJob *inbox;
+	/*! per-worker queues of a work stealing pool */
+	TPWorkerQ *workerQs;
+	/*! number of per-worker queues */
+	int numWorkerQs;
+	/*! number of queued jobs of a work stealing pool */
+	int queuedJobs;
+	/*! number of jobs in the inbox of a work stealing pool, by priority */
+	int inboxJobs[HIGH_PRIORITY + 1];
+	/*! number of workers of a work stealing pool waiting for a job */
+	int sleepingThreads;
 	/*! thread pool attributes */
 	ThreadPoolAttr attr;
 	/*! statistics */
@@ -494,6 +557,20 @@ int TPAttrSetMaxJobsTotal(
 	/*! maximum number of jobs. */
 	int maxJobsTotal);
 
+/*!
+ * \brief Sets the scheduler mode for the thread pool attributes.
+ *
+ * TP_SCHED_WORK_STEALING requires atomic operations; where the compiler
+ * does not provide them ThreadPoolInit falls back to TP_SCHED_SHARED.
+ *
+ * \return Always returns 0.
+ */
+int TPAttrSetSchedulerMode(
+	/*! must be valid thread pool attributes. */
+	ThreadPoolAttr *attr,
+	/*! TP_SCHED_SHARED or TP_SCHED_WORK_STEALING. */
+	SchedulerMode schedulerMode);
+
 /*!
  * \brief Returns various statistics about the thread pool.
  *
@@ -38,8 +38,8 @@
 
 #include "FreeList.h"
 #include "ithread.h"
-#include "LinkedList.h"
 #include "ThreadPool.h"
+#include "UpnpStdInt.h" /* for int64_t */
 
 #ifdef __cplusplus
 extern "C" {
@@ -52,7 +52,9 @@ typedef enum timeoutType {
 	/*! seconds from Jan 1, 1970. */
 	ABS_SEC,
 	/*! seconds from current time. */
-	REL_SEC
+	REL_SEC,
+	/*! milliseconds from current time. */
+	REL_MSEC
 } TimeoutType;
 
 /*!
@@ -62,6 +64,10 @@ typedef enum timeoutType {
  * Because the timer thread uses the thread pool there is no 
  * gurantee of timing, only approximate timing.
  *
+ * Events are kept in a binary heap ordered by their time on a monotonic
+ * clock, with millisecond resolution, and indexed by id: scheduling and
+ * removal are O(log n).
+ *
  * Uses ThreadPool, Mutex, Condition, Thread.
  */
 typedef struct TIMERTHREAD
@@ -69,7 +75,18 @@ typedef struct TIMERTHREAD
 	ithread_mutex_t mutex;
 	ithread_cond_t condition;
 	int lastEventId;
-	LinkedList eventQ;
+	/*! Binary heap of the pending events, the next event first. */
+	struct TIMEREVENT **eventQ;
+	/*! Number of pending events. */
+	long eventQSize;
+	/*! Number of slots of eventQ. */
+	long eventQCapacity;
+	/*! Open addressing table of the pending events, by id. */
+	struct TIMEREVENT **idIndex;
+	/*! Number of slots of idIndex, a power of two. */
+	long idIndexSize;
+	/*! Number of used or deleted slots of idIndex. */
+	long idIndexUsed;
 	int shutdown;
 	FreeList freeEvents;
 	ThreadPool *tp;
@@ -83,11 +100,14 @@ typedef struct TIMERTHREAD
 typedef struct TIMEREVENT
 {
 	ThreadPoolJob job;
-	/*! [in] Absolute time for event in seconds since Jan 1, 1970. */
-	time_t eventTime;
+	/*! [in] Time of the event in milliseconds, on the clock used by the
+	 * timer thread (monotonic where available). */
+	int64_t eventTime;
 	/*! [in] Long term or short term job. */
 	Duration persistent;
 	int id;
+	/*! Position of the event in the heap. */
+	long heapIndex;
 } TimerEvent;
 
 /*!
@@ -113,10 +133,11 @@ int TimerThreadSchedule(
 	/*! [in] Valid timer thread pointer. */
 	TimerThread* timer,
 	/*! [in] time of event. Either in absolute seconds, or relative
-	 * seconds in the future. */
+	 * seconds or milliseconds in the future. */
 	time_t time, 
-	/*! [in] either ABS_SEC, or REL_SEC. If REL_SEC, then the event
-	 * will be scheduled at the current time + REL_SEC. */
+	/*! [in] either ABS_SEC, REL_SEC or REL_MSEC. If REL_SEC (REL_MSEC),
+	 * then the event will be scheduled at the current time + time
+	 * seconds (milliseconds). */
 	TimeoutType type,
 	/*! [in] Valid Thread pool job with following fields. */
 	ThreadPoolJob *job,
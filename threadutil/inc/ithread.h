@@ -42,8 +42,14 @@
 #endif
 
 #include "UpnpGlobal.h" /* For UPNP_INLINE, EXPORT_SPEC */
+#include "UpnpStdInt.h" /* for int64_t */
 #include "UpnpUniStd.h" /* for close() */
 
+#if !defined(WIN32)
+	#include <sys/time.h> /* for gettimeofday() */
+#endif
+#include <time.h> /* for clock_gettime() */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -186,6 +192,29 @@ typedef pthread_rwlockattr_t ithread_rwlockattr_t;
 #endif /* UPNP_USE_RWLOCK */
 
 
+/****************************************************************************
+ * Name: ithread_key_t
+ *
+ *  Description:
+ *      Key of thread-specific data.
+ *      typedef to pthread_key_t
+ *      Internal Use Only
+ ***************************************************************************/
+typedef pthread_key_t ithread_key_t;
+
+
+/****************************************************************************
+ * Name: ithread_once_t
+ *
+ *  Description:
+ *      Once-only initialization control.
+ *      typedef to pthread_once_t
+ *      Internal Use Only
+ ***************************************************************************/
+typedef pthread_once_t ithread_once_t;
+#define ITHREAD_ONCE_INIT PTHREAD_ONCE_INIT
+
+
 /****************************************************************************
  * Function: ithread_initialize_library
  *
@@ -728,6 +757,53 @@ static UPNP_INLINE int ithread_cleanup_thread(void) {
    ***************************************************************************/
 #define ithread_cond_destroy pthread_cond_destroy
 
+  /****************************************************************************
+   * Function: ithread_condattr_init
+   *
+   *  Description:
+   *      Initialises condition variable attribute object.
+   *  Parameters:
+   *      ithread_condattr_t *attr (must be valid non NULL pointer to
+   *      ithread_condattr_t)
+   *  Returns:
+   *      0 on success. Nonzero on failure.
+   *      See man page for pthread_condattr_init
+   ***************************************************************************/
+#define ithread_condattr_init pthread_condattr_init
+
+  /****************************************************************************
+   * Function: ithread_condattr_destroy
+   *
+   *  Description:
+   *      Destroys condition variable attribute object.
+   *  Parameters:
+   *      ithread_condattr_t *attr (must be valid non NULL pointer to
+   *      ithread_condattr_t)
+   *  Returns:
+   *      0 on success. Nonzero on failure.
+   *      See man page for pthread_condattr_destroy
+   ***************************************************************************/
+#define ithread_condattr_destroy pthread_condattr_destroy
+
+  /****************************************************************************
+   * Function: ithread_condattr_setclock
+   *
+   *  Description:
+   *      Sets the clock used to measure the absolute time given to
+   *      ithread_cond_timedwait.
+   *      Only defined where the platform supports it.
+   *  Parameters:
+   *      ithread_condattr_t *attr (must be valid non NULL pointer to
+   *      ithread_condattr_t)
+   *      clockid_t clock_id (CLOCK_REALTIME or CLOCK_MONOTONIC)
+   *  Returns:
+   *      0 on success. Nonzero on failure.
+   *      See man page for pthread_condattr_setclock
+   ***************************************************************************/
+#if !defined(WIN32) && !defined(__APPLE__) && defined(CLOCK_MONOTONIC)
+	#define ithread_condattr_setclock pthread_condattr_setclock
+#endif
+
   /****************************************************************************
    * Function: ithread_attr_init
    *
@@ -890,6 +966,62 @@ static UPNP_INLINE int ithread_cleanup_thread(void) {
    *     See man page for pthread_join
    ***************************************************************************/
 #define ithread_join pthread_join
+
+
+  /****************************************************************************
+   * Function: ithread_once
+   *
+   *  Description:
+   *		Calls an initialization routine once, whichever thread gets
+   *      there first.
+   *  Parameters:
+   *      ithread_once_t *once_control (initialized to ITHREAD_ONCE_INIT)
+   *      void (*init_routine)(void)
+   *  Returns:
+   *		0 on success, Nonzero on failure.
+   *     See man page for pthread_once
+   ***************************************************************************/
+#define ithread_once pthread_once
+
+
+  /****************************************************************************
+   * Function: ithread_key_create
+   *
+   *  Description:
+   *		Creates a key of thread-specific data. The destructor, if
+   *      not NULL, is called with the value of the key when a thread
+   *      exits with a non NULL value.
+   *  Parameters:
+   *      ithread_key_t *key
+   *      void (*destructor)(void *)
+   *  Returns:
+   *		0 on success, Nonzero on failure.
+   *     See man page for pthread_key_create
+   ***************************************************************************/
+#define ithread_key_create pthread_key_create
+
+
+  /****************************************************************************
+   * Function: ithread_getspecific
+   *
+   *  Description:
+   *		Returns the value of a key for the calling thread, NULL if
+   *      it was never set.
+   *     See man page for pthread_getspecific
+   ***************************************************************************/
+#define ithread_getspecific pthread_getspecific
+
+
+  /****************************************************************************
+   * Function: ithread_setspecific
+   *
+   *  Description:
+   *		Sets the value of a key for the calling thread.
+   *  Returns:
+   *		0 on success, Nonzero on failure.
+   *     See man page for pthread_setspecific
+   ***************************************************************************/
+#define ithread_setspecific pthread_setspecific
   
 
 /****************************************************************************
@@ -932,6 +1064,36 @@ static UPNP_INLINE int ithread_cleanup_thread(void) {
 #endif
 
 
+/****************************************************************************
+ * Function: imillinow
+ *
+ *  Description:
+ *		Returns the current time in milliseconds. Uses the monotonic
+ *      clock when condition variables can wait on it (see
+ *      ithread_condattr_setclock), the wall clock otherwise.
+ *  Parameters:
+ *      none
+ *  Returns:
+ *		The current time in milliseconds.
+ *****************************************************************************/
+static UPNP_INLINE int64_t imillinow(void)
+{
+#ifdef ithread_condattr_setclock
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#else /* ithread_condattr_setclock */
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+#endif /* ithread_condattr_setclock */
+}
+
+
 #if !defined(PTHREAD_MUTEX_RECURSIVE) && !defined(__DragonFly__) && !defined(UPNP_USE_MSVCPP)
 /* !defined(UPNP_USE_MSVCPP) should probably also have pthreads version check - but it's not clear if that is possible */
 /* NK: Added for satisfying the gcc compiler */
@@ -0,0 +1,262 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+#include "HashTable.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*! Key marking a slot whose item has been removed. */
+static const char tombstone[] = "";
+
+#define IS_FREE(slot) ((slot)->key == NULL)
+#define IS_TOMBSTONE(slot) ((slot)->key == tombstone)
+#define IS_USED(slot) (!IS_FREE(slot) && !IS_TOMBSTONE(slot))
+
+unsigned int HashTableHashKey(const char *key)
+{
+	return HashTableHashKeyN(key, strlen(key));
+}
+
+unsigned int HashTableHashKeyN(const char *key, size_t length)
+{
+	unsigned int hash = 2166136261u;
+	const unsigned char *p = (const unsigned char *)key;
+	const unsigned char *end = p + length;
+
+	while (p < end) {
+		hash ^= *p++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/*!
+ * \brief Returns the slot holding key, or the slot where key should be
+ * inserted (the first tombstone or free slot on its probe sequence).
+ */
+static HashTableSlot *LookupSlot(
+	/*! The table to search. */
+	HashTable *table,
+	/*! Key, not necessarily NULL terminated. */
+	const char *key,
+	/*! Length of key. */
+	size_t length,
+	/*! Hash value of key. */
+	unsigned int hash)
+{
+	unsigned long mask = (unsigned long)table->capacity - 1;
+	unsigned long i = hash & mask;
+	HashTableSlot *firstTombstone = NULL;
+	HashTableSlot *slot;
+
+	for (;;) {
+		slot = &table->slots[i];
+		if (IS_FREE(slot))
+			return firstTombstone ? firstTombstone : slot;
+		if (IS_TOMBSTONE(slot)) {
+			if (!firstTombstone)
+				firstTombstone = slot;
+		} else if (slot->hash == hash &&
+			   strncmp(slot->key, key, length) == 0 &&
+			   slot->key[length] == '\0') {
+			return slot;
+		}
+		i = (i + 1) & mask;
+	}
+}
+
+/*!
+ * \brief Reallocates the slot array with newCapacity slots and reinserts
+ * every item, dropping the tombstones.
+ *
+ * \return 0 on success, EOUTOFMEM on failure.
+ */
+static int Rehash(HashTable *table, long newCapacity)
+{
+	HashTableSlot *oldSlots = table->slots;
+	long oldCapacity = table->capacity;
+	long i;
+
+	table->slots = calloc((size_t)newCapacity, sizeof(HashTableSlot));
+	if (!table->slots) {
+		table->slots = oldSlots;
+		return EOUTOFMEM;
+	}
+	table->capacity = newCapacity;
+	table->deleted = 0;
+	for (i = 0; i < oldCapacity; i++) {
+		if (IS_USED(&oldSlots[i]))
+			*LookupSlot(table, oldSlots[i].key,
+				    strlen(oldSlots[i].key),
+				    oldSlots[i].hash) =
+				oldSlots[i];
+	}
+	free(oldSlots);
+
+	return 0;
+}
+
+int HashTableInit(HashTable *table, long sizeHint)
+{
+	long capacity = HASHTABLE_MIN_SIZE;
+
+	assert(table != NULL);
+
+	/* Keep the load factor under 1/2. */
+	while (capacity < sizeHint * 2)
+		capacity <<= 1;
+	table->slots = calloc((size_t)capacity, sizeof(HashTableSlot));
+	if (!table->slots)
+		return EOUTOFMEM;
+	table->capacity = capacity;
+	table->size = 0;
+	table->deleted = 0;
+
+	return 0;
+}
+
+void HashTableDestroy(HashTable *table, free_function free_func)
+{
+	long i;
+
+	assert(table != NULL);
+
+	if (!table->slots)
+		return;
+	if (free_func) {
+		for (i = 0; i < table->capacity; i++)
+			if (IS_USED(&table->slots[i]))
+				free_func(table->slots[i].item);
+	}
+	free(table->slots);
+	table->slots = NULL;
+	table->capacity = 0;
+	table->size = 0;
+	table->deleted = 0;
+}
+
+void *HashTableFind(HashTable *table, const char *key)
+{
+	assert(key != NULL);
+
+	return HashTableFindN(table, key, strlen(key));
+}
+
+void *HashTableFindN(HashTable *table, const char *key, size_t length)
+{
+	HashTableSlot *slot;
+
+	assert(table != NULL && key != NULL);
+
+	slot = LookupSlot(table, key, length, HashTableHashKeyN(key, length));
+
+	return IS_USED(slot) ? slot->item : NULL;
+}
+
+int HashTableAdd(HashTable *table, const char *key, void *item, void **oldItem)
+{
+	size_t length;
+	unsigned int hash;
+	HashTableSlot *slot;
+	int ret;
+
+	assert(table != NULL && key != NULL);
+
+	if (oldItem)
+		*oldItem = NULL;
+	/* Grow (or purge tombstones) before the table becomes half full. */
+	if ((table->size + table->deleted + 1) * 2 > table->capacity) {
+		ret = Rehash(table, table->size * 4 > table->capacity ?
+			table->capacity * 2 : table->capacity);
+		if (ret != 0)
+			return ret;
+	}
+	length = strlen(key);
+	hash = HashTableHashKeyN(key, length);
+	slot = LookupSlot(table, key, length, hash);
+	if (IS_USED(slot)) {
+		if (oldItem)
+			*oldItem = slot->item;
+	} else {
+		if (IS_TOMBSTONE(slot))
+			table->deleted--;
+		table->size++;
+	}
+	slot->key = key;
+	slot->hash = hash;
+	slot->item = item;
+
+	return 0;
+}
+
+void *HashTableRemove(HashTable *table, const char *key)
+{
+	HashTableSlot *slot;
+	size_t length;
+	void *item;
+
+	assert(table != NULL && key != NULL);
+
+	length = strlen(key);
+	slot = LookupSlot(table, key, length, HashTableHashKeyN(key, length));
+	if (!IS_USED(slot))
+		return NULL;
+	item = slot->item;
+	slot->key = tombstone;
+	slot->item = NULL;
+	table->size--;
+	table->deleted++;
+
+	return item;
+}
+
+void *HashTableIterNext(HashTable *table, long *pos)
+{
+	assert(table != NULL && pos != NULL);
+
+	while (*pos < table->capacity) {
+		HashTableSlot *slot = &table->slots[(*pos)++];
+		if (IS_USED(slot))
+			return slot->item;
+	}
+
+	return NULL;
+}
+
+long HashTableSize(HashTable *table)
+{
+	assert(table != NULL);
+
+	return table->size;
+}
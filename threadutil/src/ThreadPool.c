@@ -47,6 +47,19 @@
 #include <stdio.h>
 #include <string.h>	/* for memset()*/
 
+#if defined(__GNUC__) && defined(__ATOMIC_SEQ_CST)
+	/* The work stealing scheduler needs these; without them
+	 * ThreadPoolInit falls back to the shared scheduler. */
+	#define TP_HAVE_ATOMICS 1
+	#define TP_ATOMIC_LOAD(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)
+	#define TP_ATOMIC_ADD(p, v) __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+	#define TP_ATOMIC_EXCHANGE(p, v) \
+		__atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+	#define TP_ATOMIC_CAS(p, expected, desired) \
+		__atomic_compare_exchange_n((p), (expected), (desired), 0, \
+			__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
+#endif
+
 /*!
  * \brief Returns the difference in milliseconds between two timeval structures.
  *
@@ -109,12 +122,12 @@ static void StatsInit(
  */
 static void StatsAccountLQ(
 	/*! . */
-	ThreadPool *tp,
+	ThreadPoolStats *stats,
 	/*! . */
 	long diffTime)
 {
-	tp->stats.totalJobsLQ++;
-	tp->stats.totalTimeLQ += (double)diffTime;
+	stats->totalJobsLQ++;
+	stats->totalTimeLQ += (double)diffTime;
 }
 
 /*!
@@ -124,12 +137,12 @@ static void StatsAccountLQ(
  */
 static void StatsAccountMQ(
 	/*! . */
-	ThreadPool *tp,
+	ThreadPoolStats *stats,
 	/*! . */
 	long diffTime)
 {
-	tp->stats.totalJobsMQ++;
-	tp->stats.totalTimeMQ += (double)diffTime;
+	stats->totalJobsMQ++;
+	stats->totalTimeMQ += (double)diffTime;
 }
 
 /*!
@@ -139,12 +152,12 @@ static void StatsAccountMQ(
  */
 static void StatsAccountHQ(
 	/*! . */
-	ThreadPool *tp,
+	ThreadPoolStats *stats,
 	/*! . */
 	long diffTime)
 {
-	tp->stats.totalJobsHQ++;
-	tp->stats.totalTimeHQ += (double)diffTime;
+	stats->totalJobsHQ++;
+	stats->totalTimeHQ += (double)diffTime;
 }
 
 /*!
@@ -157,8 +170,8 @@ static void StatsAccountHQ(
  * \internal
  */
 static void CalcWaitTime(
-	/*! . */
-	ThreadPool *tp,
+	/*! Statistics to update. */
+	ThreadPoolStats *stats,
 	/*! . */
 	ThreadPriority p,
 	/*! . */
@@ -167,20 +180,20 @@ static void CalcWaitTime(
 	struct timeval now;
 	long diff;
 
-	assert(tp != NULL);
+	assert(stats != NULL);
 	assert(job != NULL);
 
 	gettimeofday(&now, NULL);
 	diff = DiffMillis(&now, &job->requestTime);
 	switch (p) {
 	case LOW_PRIORITY:
-		StatsAccountLQ(tp, diff);
+		StatsAccountLQ(stats, diff);
 		break;
 	case MED_PRIORITY:
-		StatsAccountMQ(tp, diff);
+		StatsAccountMQ(stats, diff);
 		break;
 	case HIGH_PRIORITY:
-		StatsAccountHQ(tp, diff);
+		StatsAccountHQ(stats, diff);
 		break;
 	default:
 		assert(0);
@@ -206,10 +219,10 @@ static time_t StatsTime(
 }
 #else /* STATS */
 static UPNP_INLINE void StatsInit(ThreadPoolStats *stats) {}
-static UPNP_INLINE void StatsAccountLQ(ThreadPool *tp, long diffTime) {}
-static UPNP_INLINE void StatsAccountMQ(ThreadPool *tp, long diffTime) {}
-static UPNP_INLINE void StatsAccountHQ(ThreadPool *tp, long diffTime) {}
-static UPNP_INLINE void CalcWaitTime(ThreadPool *tp, ThreadPriority p, ThreadPoolJob *job) {}
+static UPNP_INLINE void StatsAccountLQ(ThreadPoolStats *stats, long diffTime) {}
+static UPNP_INLINE void StatsAccountMQ(ThreadPoolStats *stats, long diffTime) {}
+static UPNP_INLINE void StatsAccountHQ(ThreadPoolStats *stats, long diffTime) {}
+static UPNP_INLINE void CalcWaitTime(ThreadPoolStats *stats, ThreadPriority p, ThreadPoolJob *job) {}
 static UPNP_INLINE time_t StatsTime(time_t *t) { return 0; }
 #endif /* STATS */
 
@@ -239,7 +252,12 @@ static void FreeThreadPoolJob(
 	/*! Must be allocated with CreateThreadPoolJob. */
 	ThreadPoolJob *tpj)
 {
-	FreeListFree(&tp->jobFreeList, tpj);
+	/* the free list is protected by tp->mutex, which a work stealing
+	 * pool does not hold when it frees a job. */
+	if (tp->schedulerMode == TP_SCHED_WORK_STEALING)
+		free(tpj);
+	else
+		FreeListFree(&tp->jobFreeList, tpj);
 }
 
 /*!
@@ -338,7 +356,7 @@ exit_function:
  * \brief Determines whether any jobs need to be bumped to a higher priority Q
  * and bumps them.
  *
- * tp->mutex must be locked.
+ * The mutex protecting the Qs must be locked.
  *
  * \internal
  * 
@@ -346,7 +364,15 @@ exit_function:
  */
 static void BumpPriority(
 	/*! . */
-	ThreadPool *tp)
+	ThreadPool *tp,
+	/*! Statistics to update. */
+	ThreadPoolStats *stats,
+	/*! High priority Q. */
+	LinkedList *highJobQ,
+	/*! Med priority Q. */
+	LinkedList *medJobQ,
+	/*! Low priority Q. */
+	LinkedList *lowJobQ)
 {
 	int done = 0;
 	struct timeval now;
@@ -355,27 +381,27 @@ static void BumpPriority(
 
 	gettimeofday(&now, NULL);	
 	while (!done) {
-		if (tp->medJobQ.size) {
-			tempJob = (ThreadPoolJob *)tp->medJobQ.head.next->item;
+		if (medJobQ->size) {
+			tempJob = (ThreadPoolJob *)medJobQ->head.next->item;
 			diffTime = DiffMillis(&now, &tempJob->requestTime);
 			if (diffTime >= tp->attr.starvationTime) {
 				/* If job has waited longer than the starvation time
 				* bump priority (add to higher priority Q) */
-				StatsAccountMQ(tp, diffTime);
-				ListDelNode(&tp->medJobQ, tp->medJobQ.head.next, 0);
-				ListAddTail(&tp->highJobQ, tempJob);
+				StatsAccountMQ(stats, diffTime);
+				ListDelNode(medJobQ, medJobQ->head.next, 0);
+				ListAddTail(highJobQ, tempJob);
 				continue;
 			}
 		}
-		if (tp->lowJobQ.size) {
-			tempJob = (ThreadPoolJob *)tp->lowJobQ.head.next->item;
+		if (lowJobQ->size) {
+			tempJob = (ThreadPoolJob *)lowJobQ->head.next->item;
 			diffTime = DiffMillis(&now, &tempJob->requestTime);
 			if (diffTime >= tp->attr.maxIdleTime) {
 				/* If job has waited longer than the starvation time
 				 * bump priority (add to higher priority Q) */
-				StatsAccountLQ(tp, diffTime);
-				ListDelNode(&tp->lowJobQ, tp->lowJobQ.head.next, 0);
-				ListAddTail(&tp->medJobQ, tempJob);
+				StatsAccountLQ(stats, diffTime);
+				ListDelNode(lowJobQ, lowJobQ->head.next, 0);
+				ListAddTail(medJobQ, tempJob);
 				continue;
 			}
 		}
@@ -514,7 +540,8 @@ static void *WorkerThread(
 		/* work time */
 		StatsTime(&start);
 		/* bump priority of starved jobs */
-		BumpPriority(tp);
+		BumpPriority(tp, &tp->stats,
+			&tp->highJobQ, &tp->medJobQ, &tp->lowJobQ);
 		/* if shutdown then stop */
 		if (tp->shutdown) {
 			goto exit_function;
@@ -537,7 +564,7 @@ static void *WorkerThread(
 						goto exit_function;
 					}
 					job = (ThreadPoolJob *) head->item;
-					CalcWaitTime(tp, HIGH_PRIORITY, job);
+					CalcWaitTime(&tp->stats, HIGH_PRIORITY, job);
 					ListDelNode(&tp->highJobQ, head, 0);
 				} else if (tp->medJobQ.size > 0) {
 					head = ListHead(&tp->medJobQ);
@@ -546,7 +573,7 @@ static void *WorkerThread(
 						goto exit_function;
 					}
 					job = (ThreadPoolJob *) head->item;
-					CalcWaitTime(tp, MED_PRIORITY, job);
+					CalcWaitTime(&tp->stats, MED_PRIORITY, job);
 					ListDelNode(&tp->medJobQ, head, 0);
 				} else if (tp->lowJobQ.size > 0) {
 					head = ListHead(&tp->lowJobQ);
@@ -555,7 +582,7 @@ static void *WorkerThread(
 						goto exit_function;
 					}
 					job = (ThreadPoolJob *) head->item;
-					CalcWaitTime(tp, LOW_PRIORITY, job);
+					CalcWaitTime(&tp->stats, LOW_PRIORITY, job);
 					ListDelNode(&tp->lowJobQ, head, 0);
 				} else {
 					/* Should never get here */
@@ -587,6 +614,435 @@ exit_function:
 	return NULL;
 }
 
+#ifdef TP_HAVE_ATOMICS
+/*!
+ * \brief Returns the index of the Q of a priority, unknown priorities
+ * being low.
+ *
+ * \internal
+ */
+static UPNP_INLINE int JobQIndex(
+	/*! . */
+	ThreadPriority priority)
+{
+	switch (priority) {
+	case HIGH_PRIORITY:
+	case MED_PRIORITY:
+		return (int)priority;
+	default:
+		return (int)LOW_PRIORITY;
+	}
+}
+
+/*!
+ * \brief Returns the Q of a worker for a priority.
+ *
+ * \internal
+ */
+static LinkedList *WorkerQList(
+	/*! . */
+	TPWorkerQ *q,
+	/*! . */
+	ThreadPriority priority)
+{
+	switch (JobQIndex(priority)) {
+	case HIGH_PRIORITY:
+		return &q->highJobQ;
+	case MED_PRIORITY:
+		return &q->medJobQ;
+	default:
+		return &q->lowJobQ;
+	}
+}
+
+/*!
+ * \brief Removes the oldest job of a Q.
+ *
+ * \internal
+ *
+ * \return The job, or NULL if the Q is empty.
+ */
+static ThreadPoolJob *ListPopJob(
+	/*! . */
+	LinkedList *list)
+{
+	ListNode *head = ListHead(list);
+	ThreadPoolJob *job;
+
+	if (head == NULL)
+		return NULL;
+	job = (ThreadPoolJob *)head->item;
+	ListDelNode(list, head, 0);
+
+	return job;
+}
+
+/*!
+ * \brief Pushes a job to the inbox of a work stealing pool.
+ *
+ * \internal
+ */
+static void InboxPush(
+	/*! . */
+	ThreadPool *tp,
+	/*! . */
+	ThreadPoolJob *job)
+{
+	ThreadPoolJob *head = TP_ATOMIC_LOAD(&tp->inbox);
+
+	do {
+		job->next = head;
+	} while (!TP_ATOMIC_CAS(&tp->inbox, &head, job));
+}
+
+/*!
+ * \brief Takes all the jobs of the inbox of a work stealing pool.
+ *
+ * Jobs are only ever removed all at once, so the inbox is not subject to
+ * the ABA problem.
+ *
+ * \internal
+ *
+ * \return The jobs, linked by their next field, oldest first.
+ */
+static ThreadPoolJob *InboxTakeAll(
+	/*! . */
+	ThreadPool *tp)
+{
+	ThreadPoolJob *head = TP_ATOMIC_EXCHANGE(&tp->inbox, (ThreadPoolJob *)NULL);
+	ThreadPoolJob *fifo = NULL;
+	ThreadPoolJob *next;
+
+	while (head) {
+		next = head->next;
+		head->next = fifo;
+		fifo = head;
+		head = next;
+	}
+
+	return fifo;
+}
+
+/*!
+ * \brief Wakes up a worker waiting for a job, if any.
+ *
+ * \internal
+ */
+static void WakeWorker(
+	/*! . */
+	ThreadPool *tp)
+{
+	if (TP_ATOMIC_LOAD(&tp->sleepingThreads) > 0) {
+		ithread_mutex_lock(&tp->mutex);
+		ithread_cond_signal(&tp->condition);
+		ithread_mutex_unlock(&tp->mutex);
+	}
+}
+
+/*!
+ * \brief Takes the next job from the Qs of a worker, highest priority
+ * first.
+ *
+ * \internal
+ *
+ * \return The job, or NULL if the Qs are empty.
+ */
+static ThreadPoolJob *WorkerQTake(
+	/*! . */
+	ThreadPool *tp,
+	/*! . */
+	TPWorkerQ *q,
+	/*! Whether to bump the priority of starved jobs, only done by the
+	 * owner of the Qs. */
+	int bump)
+{
+	ThreadPoolJob *job;
+	ThreadPriority p = HIGH_PRIORITY;
+
+	ithread_mutex_lock(&q->mutex);
+	if (bump)
+		BumpPriority(tp, &q->stats,
+			&q->highJobQ, &q->medJobQ, &q->lowJobQ);
+	job = ListPopJob(&q->highJobQ);
+	if (job == NULL) {
+		p = MED_PRIORITY;
+		job = ListPopJob(&q->medJobQ);
+	}
+	if (job == NULL) {
+		p = LOW_PRIORITY;
+		job = ListPopJob(&q->lowJobQ);
+	}
+	if (job)
+		CalcWaitTime(&q->stats, p, job);
+	ithread_mutex_unlock(&q->mutex);
+	if (job)
+		TP_ATOMIC_ADD(&tp->queuedJobs, -1);
+
+	return job;
+}
+
+/*!
+ * \brief Moves the jobs of the inbox to the Qs of a worker.
+ *
+ * \internal
+ *
+ * \return The number of jobs moved.
+ */
+static int WorkerQFill(
+	/*! . */
+	ThreadPool *tp,
+	/*! . */
+	TPWorkerQ *q)
+{
+	ThreadPoolJob *job = InboxTakeAll(tp);
+	ThreadPoolJob *dropped = NULL;
+	ThreadPoolJob *next;
+	int n = 0;
+
+	if (job == NULL)
+		return 0;
+	ithread_mutex_lock(&q->mutex);
+	for (; job; job = next) {
+		next = job->next;
+		TP_ATOMIC_ADD(&tp->inboxJobs[JobQIndex(job->priority)], -1);
+		if (ListAddTail(WorkerQList(q, job->priority), job) == NULL) {
+			/* not enough memory: drop the job */
+			job->next = dropped;
+			dropped = job;
+			TP_ATOMIC_ADD(&tp->queuedJobs, -1);
+			continue;
+		}
+		n++;
+	}
+	ithread_mutex_unlock(&q->mutex);
+	/* free functions may add jobs: call them without the lock. */
+	for (job = dropped; job; job = next) {
+		next = job->next;
+		if (job->free_func)
+			job->free_func(job->arg);
+		FreeThreadPoolJob(tp, job);
+	}
+
+	return n;
+}
+
+/*!
+ * \brief Steals a job from the Qs of another worker.
+ *
+ * \internal
+ *
+ * \return The job, or NULL if all the Qs are empty.
+ */
+static ThreadPoolJob *WorkerQSteal(
+	/*! . */
+	ThreadPool *tp,
+	/*! Qs of the calling worker. */
+	TPWorkerQ *self)
+{
+	TPWorkerQ *q;
+	ThreadPoolJob *job;
+	int first = (int)(self - tp->workerQs);
+	int i;
+
+	for (i = 1; i < tp->numWorkerQs; i++) {
+		q = &tp->workerQs[(first + i) % tp->numWorkerQs];
+		/* unlocked peek, the Qs are checked again under the lock */
+		if (q->highJobQ.size + q->medJobQ.size + q->lowJobQ.size == 0)
+			continue;
+		job = WorkerQTake(tp, q, 0);
+		if (job) {
+			/* let another idle worker share the rest */
+			if (q->highJobQ.size + q->medJobQ.size +
+			    q->lowJobQ.size > 0)
+				WakeWorker(tp);
+			return job;
+		}
+	}
+
+	return NULL;
+}
+
+/*!
+ * \brief Finds the next job of a worker: from its own Qs, then from the
+ * inbox, then from the other workers.
+ *
+ * \internal
+ *
+ * \return The job, or NULL if there is no queued job.
+ */
+static ThreadPoolJob *StealNextJob(
+	/*! . */
+	ThreadPool *tp,
+	/*! Qs of the calling worker. */
+	TPWorkerQ *self)
+{
+	ThreadPoolJob *job;
+	int n;
+
+	job = WorkerQTake(tp, self, 1);
+	if (job)
+		return job;
+	n = WorkerQFill(tp, self);
+	if (n > 1)
+		/* let an idle worker steal from us */
+		WakeWorker(tp);
+	if (n > 0) {
+		job = WorkerQTake(tp, self, 0);
+		if (job)
+			return job;
+	}
+
+	return WorkerQSteal(tp, self);
+}
+
+/*!
+ * \brief Runs the pending persistent job, if any.
+ *
+ * \internal
+ *
+ * \return 1 if a persistent job was run, 0 otherwise.
+ */
+static int RunPersistentJob(
+	/*! . */
+	ThreadPool *tp)
+{
+	ThreadPoolJob *job;
+
+	ithread_mutex_lock(&tp->mutex);
+	job = tp->persistentJob;
+	if (job == NULL) {
+		ithread_mutex_unlock(&tp->mutex);
+		return 0;
+	}
+	tp->persistentJob = NULL;
+	tp->persistentThreads++;
+	ithread_cond_broadcast(&tp->start_and_shutdown);
+	ithread_mutex_unlock(&tp->mutex);
+
+	SetPriority(job->priority);
+	job->func(job->arg);
+	SetPriority(DEFAULT_PRIORITY);
+
+	ithread_mutex_lock(&tp->mutex);
+	/* Persistent thread becomes a regular thread */
+	tp->persistentThreads--;
+	ithread_mutex_unlock(&tp->mutex);
+	FreeThreadPoolJob(tp, job);
+
+	return 1;
+}
+
+/*!
+ * \brief Implements a worker of a work stealing pool.
+ *
+ * The worker runs the jobs of its own Qs, refills them from the inbox, or
+ * steals from the other workers. It only takes the thread pool mutex to
+ * pick up a persistent job or to wait when no job is queued anywhere.
+ *
+ * If worker remains idle for more than specified max, the worker is released.
+ *
+ * \internal
+ */
+static void *StealWorkerThread(
+	/*! arg -> is cast to (ThreadPool *). */
+	void *arg)
+{
+	time_t start = 0;
+	ThreadPoolJob *job = NULL;
+	TPWorkerQ *q = NULL;
+	struct timespec timeout;
+	int retCode = 0;
+	int i;
+	ThreadPool *tp = (ThreadPool *)arg;
+
+	ithread_initialize_thread();
+
+	/* Increment total thread count and take free Qs */
+	ithread_mutex_lock(&tp->mutex);
+	for (i = 0; i < tp->numWorkerQs; i++) {
+		if (!tp->workerQs[i].inUse) {
+			q = &tp->workerQs[i];
+			q->inUse = 1;
+			break;
+		}
+	}
+	tp->totalThreads++;
+	tp->pendingWorkerThreadStart = 0;
+	ithread_cond_broadcast(&tp->start_and_shutdown);
+	if (q == NULL)
+		/* CreateWorker checks there are free Qs */
+		goto exit_function;
+	ithread_mutex_unlock(&tp->mutex);
+
+	SetSeed();
+	while (!TP_ATOMIC_LOAD(&tp->shutdown)) {
+		/* the Qs must be empty: nobody else fills them. */
+		if (TP_ATOMIC_LOAD(&tp->persistentJob) != NULL &&
+		    q->highJobQ.size + q->medJobQ.size + q->lowJobQ.size == 0 &&
+		    RunPersistentJob(tp))
+			continue;
+		job = StealNextJob(tp, q);
+		if (job) {
+			StatsTime(&start);
+			/* In the future can log info */
+			if (SetPriority(job->priority) != 0) {
+			} else {
+			}
+			/* run the job */
+			job->func(job->arg);
+			/* return to Normal */
+			SetPriority(DEFAULT_PRIORITY);
+			ithread_mutex_lock(&q->mutex);
+			q->stats.totalWorkTime +=
+				(double)StatsTime(NULL) - (double)start;
+			ithread_mutex_unlock(&q->mutex);
+			FreeThreadPoolJob(tp, job);
+			continue;
+		}
+		/* No job anywhere: wait for one. Producers check
+		 * sleepingThreads after queueing, we check queuedJobs after
+		 * incrementing it, so no wake up is lost. */
+		ithread_mutex_lock(&tp->mutex);
+		TP_ATOMIC_ADD(&tp->sleepingThreads, 1);
+		retCode = 0;
+		if (!tp->shutdown && !tp->persistentJob &&
+		    TP_ATOMIC_LOAD(&tp->queuedJobs) == 0) {
+			StatsTime(&start);
+			SetRelTimeout(&timeout, tp->attr.maxIdleTime);
+			/* wait for a job up to the specified max time */
+			retCode = ithread_cond_timedwait(
+				&tp->condition, &tp->mutex, &timeout);
+			tp->stats.totalIdleTime +=
+				(double)StatsTime(NULL) - (double)start;
+		}
+		TP_ATOMIC_ADD(&tp->sleepingThreads, -1);
+		/* If wait timed out and we currently have more than the
+		 * min threads, or if we have more than the max threads
+		 * (only possible if the attributes have been reset)
+		 * let this thread die. Its Qs are empty. */
+		if (TP_ATOMIC_LOAD(&tp->queuedJobs) == 0 &&
+		    ((retCode == ETIMEDOUT &&
+		      tp->totalThreads > tp->attr.minThreads) ||
+		     (tp->attr.maxThreads != -1 &&
+		      tp->totalThreads > tp->attr.maxThreads))) {
+			goto exit_function;
+		}
+		ithread_mutex_unlock(&tp->mutex);
+	}
+	ithread_mutex_lock(&tp->mutex);
+
+exit_function:
+	if (q)
+		q->inUse = 0;
+	tp->totalThreads--;
+	ithread_cond_broadcast(&tp->start_and_shutdown);
+	ithread_mutex_unlock(&tp->mutex);
+	ithread_cleanup_thread();
+
+	return NULL;
+}
+#endif /* TP_HAVE_ATOMICS */
+
 /*!
  * \brief Creates a Thread Pool Job. (Dynamically allocated)
  *
@@ -604,7 +1060,10 @@ static ThreadPoolJob *CreateThreadPoolJob(
 {
 	ThreadPoolJob *newJob = NULL;
 
-	newJob = (ThreadPoolJob *)FreeListAlloc(&tp->jobFreeList);
+	if (tp->schedulerMode == TP_SCHED_WORK_STEALING)
+		newJob = (ThreadPoolJob *)malloc(sizeof(ThreadPoolJob));
+	else
+		newJob = (ThreadPoolJob *)FreeListAlloc(&tp->jobFreeList);
 	if (newJob) {
 		*newJob = *job;
 		newJob->jobId = id;
@@ -648,6 +1107,16 @@ static int CreateWorker(
 	ithread_attr_init(&attr);
 	ithread_attr_setstacksize(&attr, tp->attr.stackSize);
 	ithread_attr_setdetachstate(&attr, ITHREAD_CREATE_DETACHED);
+#ifdef TP_HAVE_ATOMICS
+	if (tp->schedulerMode == TP_SCHED_WORK_STEALING) {
+		/* each worker owns one of the per-worker queues */
+		if (tp->totalThreads + 1 > tp->numWorkerQs) {
+			ithread_attr_destroy(&attr);
+			return EMAXTHREADS;
+		}
+		rc = ithread_create(&temp, &attr, StealWorkerThread, tp);
+	} else
+#endif /* TP_HAVE_ATOMICS */
 	rc = ithread_create(&temp, &attr, WorkerThread, tp);
 	ithread_attr_destroy(&attr);
 	if (rc == 0) {
@@ -697,6 +1166,185 @@ static void AddWorker(
 	}
 }
 
+#ifdef TP_HAVE_ATOMICS
+/*!
+ * \brief Wakes up an idle worker of a work stealing pool, or creates a
+ * worker if none is idle and the thread pool does not already have max
+ * threads.
+ *
+ * \internal
+ */
+static void StealAddWorker(
+	/*! A pointer to the ThreadPool object. */
+	ThreadPool *tp)
+{
+	/* all workers are busy and no new one can be created: the job will
+	 * be picked up when one of them is done, without locking. */
+	if (TP_ATOMIC_LOAD(&tp->sleepingThreads) == 0 &&
+	    tp->attr.maxThreads != INFINITE_THREADS &&
+	    TP_ATOMIC_LOAD(&tp->totalThreads) >= tp->attr.maxThreads)
+		return;
+	ithread_mutex_lock(&tp->mutex);
+	if (tp->sleepingThreads > 0)
+		ithread_cond_signal(&tp->condition);
+	else if (!tp->shutdown)
+		CreateWorker(tp);
+	ithread_mutex_unlock(&tp->mutex);
+}
+
+/*!
+ * \brief Allocates the per-worker Qs of a work stealing pool, one per
+ * thread the pool may have.
+ *
+ * \internal
+ *
+ * \return 0 on success, nonzero on failure.
+ */
+static int InitWorkerQs(
+	/*! A pointer to the ThreadPool object. */
+	ThreadPool *tp)
+{
+	int rc = 0;
+	int n = tp->attr.maxThreads;
+	int i;
+	TPWorkerQ *q;
+
+	if (n == INFINITE_THREADS || n > MAX_WORKER_QUEUES)
+		n = MAX_WORKER_QUEUES;
+	if (n < 1)
+		n = 1;
+	tp->workerQs = (TPWorkerQ *)calloc((size_t)n, sizeof(TPWorkerQ));
+	if (tp->workerQs == NULL)
+		return EOUTOFMEM;
+	for (i = 0; i < n; i++) {
+		q = &tp->workerQs[i];
+		rc += ithread_mutex_init(&q->mutex, NULL);
+		rc += ListInit(&q->highJobQ, CmpThreadPoolJob, NULL);
+		rc += ListInit(&q->medJobQ, CmpThreadPoolJob, NULL);
+		rc += ListInit(&q->lowJobQ, CmpThreadPoolJob, NULL);
+		StatsInit(&q->stats);
+		q->inUse = 0;
+	}
+	tp->numWorkerQs = n;
+
+	return rc;
+}
+
+/*!
+ * \brief Frees the jobs of a Q, calling their free functions.
+ *
+ * \internal
+ */
+static void FreeJobQ(
+	/*! A pointer to the ThreadPool object. */
+	ThreadPool *tp,
+	/*! . */
+	LinkedList *list)
+{
+	ThreadPoolJob *temp;
+
+	while ((temp = ListPopJob(list)) != NULL) {
+		if (temp->free_func)
+			temp->free_func(temp->arg);
+		FreeThreadPoolJob(tp, temp);
+	}
+	ListDestroy(list, 0);
+}
+
+/*!
+ * \brief Frees the inbox and the per-worker Qs of a work stealing pool and
+ * the jobs they hold. All workers must have exited.
+ *
+ * \internal
+ */
+static void DestroyWorkerQs(
+	/*! A pointer to the ThreadPool object. */
+	ThreadPool *tp)
+{
+	ThreadPoolJob *temp;
+	ThreadPoolJob *next;
+	TPWorkerQ *q;
+	int i;
+
+	for (temp = InboxTakeAll(tp); temp; temp = next) {
+		next = temp->next;
+		if (temp->free_func)
+			temp->free_func(temp->arg);
+		FreeThreadPoolJob(tp, temp);
+	}
+	for (i = 0; i < tp->numWorkerQs; i++) {
+		q = &tp->workerQs[i];
+		FreeJobQ(tp, &q->highJobQ);
+		FreeJobQ(tp, &q->medJobQ);
+		FreeJobQ(tp, &q->lowJobQ);
+		ithread_mutex_destroy(&q->mutex);
+	}
+	free(tp->workerQs);
+	tp->workerQs = NULL;
+	tp->numWorkerQs = 0;
+}
+
+/*!
+ * \brief Removes a queued job from a work stealing pool.
+ *
+ * \internal
+ *
+ * \return 0 on success, INVALID_JOB_ID if the job is not queued.
+ */
+static int StealRemove(
+	/*! A pointer to the ThreadPool object. */
+	ThreadPool *tp,
+	/*! id of job. */
+	int jobId,
+	/*! space for removed job. */
+	ThreadPoolJob *out)
+{
+	int ret = INVALID_JOB_ID;
+	ThreadPoolJob *temp;
+	ThreadPoolJob *next;
+	ThreadPoolJob *found = NULL;
+	ThreadPoolJob dummy;
+	ListNode *tempNode;
+	LinkedList *list;
+	TPWorkerQ *q;
+	int i;
+	int p;
+
+	/* take the inbox and push back the other jobs, oldest first. */
+	for (temp = InboxTakeAll(tp); temp; temp = next) {
+		next = temp->next;
+		if (found == NULL && temp->jobId == jobId) {
+			found = temp;
+			TP_ATOMIC_ADD(&tp->inboxJobs[JobQIndex(temp->priority)], -1);
+		} else {
+			InboxPush(tp, temp);
+		}
+	}
+	dummy.jobId = jobId;
+	for (i = 0; found == NULL && i < tp->numWorkerQs; i++) {
+		q = &tp->workerQs[i];
+		ithread_mutex_lock(&q->mutex);
+		for (p = LOW_PRIORITY; found == NULL && p <= HIGH_PRIORITY; p++) {
+			list = WorkerQList(q, (ThreadPriority)p);
+			tempNode = ListFind(list, NULL, &dummy);
+			if (tempNode) {
+				found = (ThreadPoolJob *)tempNode->item;
+				ListDelNode(list, tempNode, 0);
+			}
+		}
+		ithread_mutex_unlock(&q->mutex);
+	}
+	if (found) {
+		TP_ATOMIC_ADD(&tp->queuedJobs, -1);
+		*out = *found;
+		FreeThreadPoolJob(tp, found);
+		ret = 0;
+	}
+
+	return ret;
+}
+#endif /* TP_HAVE_ATOMICS */
+
 int ThreadPoolInit(ThreadPool *tp, ThreadPoolAttr *attr)
 {
 	int retCode = 0;
@@ -723,6 +1371,17 @@ int ThreadPoolInit(ThreadPool *tp, ThreadPoolAttr *attr)
 	} else {
 		TPAttrInit(&tp->attr);
 	}
+#ifdef TP_HAVE_ATOMICS
+	tp->schedulerMode = tp->attr.schedulerMode;
+#else /* TP_HAVE_ATOMICS */
+	tp->schedulerMode = TP_SCHED_SHARED;
+#endif /* TP_HAVE_ATOMICS */
+	tp->inbox = NULL;
+	tp->workerQs = NULL;
+	tp->numWorkerQs = 0;
+	tp->queuedJobs = 0;
+	memset(tp->inboxJobs, 0, sizeof(tp->inboxJobs));
+	tp->sleepingThreads = 0;
 	if (SetPolicyType(tp->attr.schedPolicy) != 0) {
 		ithread_mutex_unlock(&tp->mutex);
 		ithread_mutex_destroy(&tp->mutex);
@@ -737,6 +1396,10 @@ int ThreadPoolInit(ThreadPool *tp, ThreadPoolAttr *attr)
 	retCode += ListInit(&tp->highJobQ, CmpThreadPoolJob, NULL);
 	retCode += ListInit(&tp->medJobQ, CmpThreadPoolJob, NULL);
 	retCode += ListInit(&tp->lowJobQ, CmpThreadPoolJob, NULL);
+#ifdef TP_HAVE_ATOMICS
+	if (tp->schedulerMode == TP_SCHED_WORK_STEALING)
+		retCode += InitWorkerQs(tp);
+#endif /* TP_HAVE_ATOMICS */
 	if (retCode) {
 		retCode = EAGAIN;
 	} else {
@@ -769,6 +1432,7 @@ int ThreadPoolAddPersistent(ThreadPool *tp, ThreadPoolJob *job, int *jobId)
 {
 	int ret = 0;
 	int tempId = -1;
+	int id;
 	ThreadPoolJob *temp = NULL;
 
 	if (!tp || !job) {
@@ -792,7 +1456,14 @@ int ThreadPoolAddPersistent(ThreadPool *tp, ThreadPoolJob *job, int *jobId)
 			goto exit_function;
 		}
 	}
-	temp = CreateThreadPoolJob(job, tp->lastJobId, tp);
+#ifdef TP_HAVE_ATOMICS
+	/* work stealing producers do not hold the mutex */
+	if (tp->schedulerMode == TP_SCHED_WORK_STEALING)
+		id = TP_ATOMIC_ADD(&tp->lastJobId, 1) - 1;
+	else
+#endif /* TP_HAVE_ATOMICS */
+	id = tp->lastJobId++;
+	temp = CreateThreadPoolJob(job, id, tp);
 	if (!temp) {
 		ret = EOUTOFMEM;
 		goto exit_function;
@@ -805,7 +1476,7 @@ int ThreadPoolAddPersistent(ThreadPool *tp, ThreadPoolJob *job, int *jobId)
 	/* wait until long job has been picked up */
 	while (tp->persistentJob)
 		ithread_cond_wait(&tp->start_and_shutdown, &tp->mutex);
-	*jobId = tp->lastJobId++;
+	*jobId = id;
 
 exit_function:
 	ithread_mutex_unlock(&tp->mutex);
@@ -823,6 +1494,34 @@ int ThreadPoolAdd(ThreadPool *tp, ThreadPoolJob *job, int *jobId)
 	if (!tp || !job)
 		return EINVAL;
 
+#ifdef TP_HAVE_ATOMICS
+	if (tp->schedulerMode == TP_SCHED_WORK_STEALING) {
+		totalJobs = TP_ATOMIC_ADD(&tp->queuedJobs, 1);
+		if (totalJobs > tp->attr.maxJobsTotal) {
+			TP_ATOMIC_ADD(&tp->queuedJobs, -1);
+			fprintf(stderr, "total jobs = %ld, too many jobs",
+				totalJobs - 1);
+			return rc;
+		}
+		if (!jobId)
+			jobId = &tempId;
+		*jobId = INVALID_JOB_ID;
+		temp = CreateThreadPoolJob(job,
+			TP_ATOMIC_ADD(&tp->lastJobId, 1) - 1, tp);
+		if (!temp) {
+			TP_ATOMIC_ADD(&tp->queuedJobs, -1);
+			return rc;
+		}
+		*jobId = temp->jobId;
+		TP_ATOMIC_ADD(&tp->inboxJobs[JobQIndex(temp->priority)], 1);
+		InboxPush(tp, temp);
+		/* wake up or create a worker if appropriate */
+		StealAddWorker(tp);
+
+		return 0;
+	}
+#endif /* TP_HAVE_ATOMICS */
+
 	ithread_mutex_lock(&tp->mutex);
 
 	totalJobs = tp->highJobQ.size + tp->lowJobQ.size + tp->medJobQ.size;
@@ -879,6 +1578,13 @@ int ThreadPoolRemove(ThreadPool *tp, int jobId, ThreadPoolJob *out)
 
 	ithread_mutex_lock(&tp->mutex);
 
+#ifdef TP_HAVE_ATOMICS
+	if (tp->schedulerMode == TP_SCHED_WORK_STEALING) {
+		ret = StealRemove(tp, jobId, out);
+		if (ret == 0)
+			goto exit_function;
+	}
+#endif /* TP_HAVE_ATOMICS */
 	tempNode = ListFind(&tp->highJobQ, NULL, &dummy);
 	if (tempNode) {
 		temp = (ThreadPoolJob *)tempNode->item;
@@ -1039,6 +1745,11 @@ int ThreadPoolShutdown(ThreadPool *tp)
 	/* wait for all threads to finish */
 	while (tp->totalThreads > 0)
 		ithread_cond_wait(&tp->start_and_shutdown, &tp->mutex);
+#ifdef TP_HAVE_ATOMICS
+	/* clean up the jobs of a work stealing pool */
+	if (tp->workerQs)
+		DestroyWorkerQs(tp);
+#endif /* TP_HAVE_ATOMICS */
 	/* destroy condition */
 	while (ithread_cond_destroy(&tp->condition) != 0) {}
 	while (ithread_cond_destroy(&tp->start_and_shutdown) != 0) {}
@@ -1064,6 +1775,7 @@ int TPAttrInit(ThreadPoolAttr *attr)
 	attr->schedPolicy    = DEFAULT_POLICY;
 	attr->starvationTime = DEFAULT_STARVATION_TIME;
 	attr->maxJobsTotal   = DEFAULT_MAX_JOBS_TOTAL;
+	attr->schedulerMode  = DEFAULT_SCHEDULER_MODE;
 
 	return 0;
 }
@@ -1176,6 +1888,15 @@ int TPAttrSetMaxJobsTotal(ThreadPoolAttr *attr, int maxJobsTotal)
 	return 0;
 }
 
+int TPAttrSetSchedulerMode(ThreadPoolAttr *attr, SchedulerMode schedulerMode)
+{
+	if (!attr)
+		return EINVAL;
+	attr->schedulerMode = schedulerMode;
+
+	return 0;
+}
+
 #ifdef STATS
 void ThreadPoolPrintStats(ThreadPoolStats *stats)
 {
@@ -1198,6 +1919,47 @@ void ThreadPoolPrintStats(ThreadPoolStats *stats)
 	printf("Total Time spent Idle in seconds : %f\n", stats->totalIdleTime);
 }
 
+#ifdef TP_HAVE_ATOMICS
+/*!
+ * \brief Adds the statistics kept by the workers of a work stealing pool.
+ *
+ * tp->mutex must be locked.
+ *
+ * \internal
+ */
+static void AddWorkerQStats(
+	/*! Valid initialized threadpool. */
+	ThreadPool *tp,
+	/*! Valid stats, out parameter. */
+	ThreadPoolStats *stats)
+{
+	TPWorkerQ *q;
+	int i;
+
+	for (i = 0; i < tp->numWorkerQs; i++) {
+		q = &tp->workerQs[i];
+		ithread_mutex_lock(&q->mutex);
+		stats->totalJobsHQ += q->stats.totalJobsHQ;
+		stats->totalTimeHQ += q->stats.totalTimeHQ;
+		stats->totalJobsMQ += q->stats.totalJobsMQ;
+		stats->totalTimeMQ += q->stats.totalTimeMQ;
+		stats->totalJobsLQ += q->stats.totalJobsLQ;
+		stats->totalTimeLQ += q->stats.totalTimeLQ;
+		stats->totalWorkTime += q->stats.totalWorkTime;
+		stats->currentJobsHQ += (int)ListSize(&q->highJobQ);
+		stats->currentJobsMQ += (int)ListSize(&q->medJobQ);
+		stats->currentJobsLQ += (int)ListSize(&q->lowJobQ);
+		ithread_mutex_unlock(&q->mutex);
+	}
+	stats->currentJobsHQ += TP_ATOMIC_LOAD(&tp->inboxJobs[HIGH_PRIORITY]);
+	stats->currentJobsMQ += TP_ATOMIC_LOAD(&tp->inboxJobs[MED_PRIORITY]);
+	stats->currentJobsLQ += TP_ATOMIC_LOAD(&tp->inboxJobs[LOW_PRIORITY]);
+	stats->idleThreads = TP_ATOMIC_LOAD(&tp->sleepingThreads);
+	stats->workerThreads = tp->totalThreads - tp->persistentThreads -
+		stats->idleThreads;
+}
+#endif /* TP_HAVE_ATOMICS */
+
 int ThreadPoolGetStats(ThreadPool *tp, ThreadPoolStats *stats)
 {
 	if (tp == NULL || stats == NULL)
@@ -1207,6 +1969,13 @@ int ThreadPoolGetStats(ThreadPool *tp, ThreadPoolStats *stats)
 		ithread_mutex_lock(&tp->mutex);
 
 	*stats = tp->stats;
+	stats->currentJobsHQ = (int)ListSize(&tp->highJobQ);
+	stats->currentJobsLQ = (int)ListSize(&tp->lowJobQ);
+	stats->currentJobsMQ = (int)ListSize(&tp->medJobQ);
+#ifdef TP_HAVE_ATOMICS
+	if (tp->schedulerMode == TP_SCHED_WORK_STEALING)
+		AddWorkerQStats(tp, stats);
+#endif /* TP_HAVE_ATOMICS */
 	if (stats->totalJobsHQ > 0)
 		stats->avgWaitHQ = stats->totalTimeHQ / (double)stats->totalJobsHQ;
 	else
@@ -1221,9 +1990,6 @@ int ThreadPoolGetStats(ThreadPool *tp, ThreadPoolStats *stats)
 		stats->avgWaitLQ = 0.0;
 	stats->totalThreads = tp->totalThreads;
 	stats->persistentThreads = tp->persistentThreads;
-	stats->currentJobsHQ = (int)ListSize(&tp->highJobQ);
-	stats->currentJobsLQ = (int)ListSize(&tp->lowJobQ);
-	stats->currentJobsMQ = (int)ListSize(&tp->medJobQ);
 
 	/* if not shutdown then release mutex */
 	if (!tp->shutdown)
@@ -37,6 +37,22 @@
 #include "TimerThread.h"
 
 #include <assert.h>
+#include <stdlib.h>
+
+#ifdef ithread_condattr_setclock
+	/* The timer thread waits on the monotonic clock. */
+	#define TIMER_USE_MONOTONIC 1
+#endif
+
+/*! Initial number of slots of the event heap. */
+#define TIMER_MIN_HEAP 64
+
+/*! Initial number of slots of the id index. Must be a power of two. */
+#define TIMER_MIN_INDEX 64
+
+/*! Marks a deleted slot of the id index. */
+static TimerEvent deletedEvent;
+#define DELETED_EVENT (&deletedEvent)
 
 /*!
  * \brief Deallocates a dynamically allocated TimerEvent.
@@ -52,6 +68,232 @@ static void FreeTimerEvent(
 	FreeListFree(&timer->freeEvents, event);
 }
 
+/*!
+ * \brief Stores an event in a slot of the heap.
+ */
+static UPNP_INLINE void HeapSet(
+	/*! [in] Valid timer thread pointer. */
+	TimerThread *timer,
+	/*! [in] Slot. */
+	long i,
+	/*! [in] Event. */
+	TimerEvent *event)
+{
+	timer->eventQ[i] = event;
+	event->heapIndex = i;
+}
+
+/*!
+ * \brief Moves the event of a slot of the heap towards the root until its
+ * parent is not later than it.
+ */
+static void HeapSiftUp(
+	/*! [in] Valid timer thread pointer. */
+	TimerThread *timer,
+	/*! [in] Slot. */
+	long i)
+{
+	TimerEvent *event = timer->eventQ[i];
+	long parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (timer->eventQ[parent]->eventTime <= event->eventTime)
+			break;
+		HeapSet(timer, i, timer->eventQ[parent]);
+		i = parent;
+	}
+	HeapSet(timer, i, event);
+}
+
+/*!
+ * \brief Moves the event of a slot of the heap towards the leaves until its
+ * children are not earlier than it.
+ */
+static void HeapSiftDown(
+	/*! [in] Valid timer thread pointer. */
+	TimerThread *timer,
+	/*! [in] Slot. */
+	long i)
+{
+	TimerEvent *event = timer->eventQ[i];
+	long child;
+
+	while ((child = 2 * i + 1) < timer->eventQSize) {
+		if (child + 1 < timer->eventQSize &&
+		    timer->eventQ[child + 1]->eventTime <
+		    timer->eventQ[child]->eventTime)
+			child++;
+		if (event->eventTime <= timer->eventQ[child]->eventTime)
+			break;
+		HeapSet(timer, i, timer->eventQ[child]);
+		i = child;
+	}
+	HeapSet(timer, i, event);
+}
+
+/*!
+ * \brief Adds an event to the heap.
+ *
+ * \return 0 on success, EOUTOFMEM if the heap could not grow.
+ */
+static int HeapInsert(
+	/*! [in] Valid timer thread pointer. */
+	TimerThread *timer,
+	/*! [in] Event. */
+	TimerEvent *event)
+{
+	TimerEvent **newQ;
+	long newCapacity;
+
+	if (timer->eventQSize == timer->eventQCapacity) {
+		newCapacity = timer->eventQCapacity ?
+			timer->eventQCapacity * 2 : TIMER_MIN_HEAP;
+		newQ = realloc(timer->eventQ,
+			       sizeof(TimerEvent *) * (size_t)newCapacity);
+		if (newQ == NULL)
+			return EOUTOFMEM;
+		timer->eventQ = newQ;
+		timer->eventQCapacity = newCapacity;
+	}
+	HeapSet(timer, timer->eventQSize++, event);
+	HeapSiftUp(timer, event->heapIndex);
+
+	return 0;
+}
+
+/*!
+ * \brief Removes an event from the heap.
+ */
+static void HeapRemove(
+	/*! [in] Valid timer thread pointer. */
+	TimerThread *timer,
+	/*! [in] Event, must be in the heap. */
+	TimerEvent *event)
+{
+	long i = event->heapIndex;
+	TimerEvent *last = timer->eventQ[--timer->eventQSize];
+
+	if (last == event)
+		return;
+	HeapSet(timer, i, last);
+	if (i > 0 && timer->eventQ[(i - 1) / 2]->eventTime > last->eventTime)
+		HeapSiftUp(timer, i);
+	else
+		HeapSiftDown(timer, i);
+}
+
+/*!
+ * \brief Returns the first slot of the id index to probe for an id.
+ */
+static UPNP_INLINE long IndexHash(
+	/*! [in] Valid timer thread pointer. */
+	TimerThread *timer,
+	/*! [in] Event id. */
+	int id)
+{
+	return (long)(((unsigned)id * 2654435761u) &
+		      (unsigned)(timer->idIndexSize - 1));
+}
+
+/*!
+ * \brief Finds the slot of the id index holding an event.
+ *
+ * \return The slot, or -1 if no pending event has this id.
+ */
+static long IndexFind(
+	/*! [in] Valid timer thread pointer. */
+	TimerThread *timer,
+	/*! [in] Event id. */
+	int id)
+{
+	long i;
+	TimerEvent *event;
+
+	if (timer->idIndexSize == 0)
+		return -1;
+	i = IndexHash(timer, id);
+	while ((event = timer->idIndex[i]) != NULL) {
+		if (event != DELETED_EVENT && event->id == id)
+			return i;
+		i = (i + 1) & (timer->idIndexSize - 1);
+	}
+
+	return -1;
+}
+
+/*!
+ * \brief Stores an event in the first free slot of the id index.
+ */
+static void IndexPut(
+	/*! [in] Valid timer thread pointer. */
+	TimerThread *timer,
+	/*! [in] Event. */
+	TimerEvent *event)
+{
+	long i = IndexHash(timer, event->id);
+
+	while (timer->idIndex[i] != NULL && timer->idIndex[i] != DELETED_EVENT)
+		i = (i + 1) & (timer->idIndexSize - 1);
+	if (timer->idIndex[i] == NULL)
+		timer->idIndexUsed++;
+	timer->idIndex[i] = event;
+}
+
+/*!
+ * \brief Adds an event to the id index. The index is rebuilt from the heap,
+ * without its deleted slots, when it is half full.
+ *
+ * Must be called before the event is added to the heap.
+ *
+ * \return 0 on success, EOUTOFMEM if the index could not grow.
+ */
+static int IndexAdd(
+	/*! [in] Valid timer thread pointer. */
+	TimerThread *timer,
+	/*! [in] Event. */
+	TimerEvent *event)
+{
+	TimerEvent **newIndex;
+	long newSize;
+	long i;
+
+	if ((timer->idIndexUsed + 1) * 2 > timer->idIndexSize) {
+		newSize = TIMER_MIN_INDEX;
+		while (newSize < (timer->eventQSize + 1) * 4)
+			newSize *= 2;
+		newIndex = calloc((size_t)newSize, sizeof(TimerEvent *));
+		if (newIndex == NULL)
+			return EOUTOFMEM;
+		free(timer->idIndex);
+		timer->idIndex = newIndex;
+		timer->idIndexSize = newSize;
+		timer->idIndexUsed = 0;
+		for (i = 0; i < timer->eventQSize; i++)
+			IndexPut(timer, timer->eventQ[i]);
+	}
+	IndexPut(timer, event);
+
+	return 0;
+}
+
+/*!
+ * \brief Removes a pending event from the heap and the id index.
+ */
+static void RemoveTimerEvent(
+	/*! [in] Valid timer thread pointer. */
+	TimerThread *timer,
+	/*! [in] Event, must be pending. */
+	TimerEvent *event)
+{
+	long i = IndexFind(timer, event->id);
+
+	assert(i >= 0);
+	if (i >= 0)
+		timer->idIndex[i] = DELETED_EVENT;
+	HeapRemove(timer, event);
+}
+
 /*!
  * \brief Implements timer thread.
  *
@@ -61,95 +303,86 @@ static void *TimerThreadWorker(
 	/*! [in] arg is cast to (TimerThread *). */
 	void *arg)
 {
-    TimerThread *timer = ( TimerThread * ) arg;
-    ListNode *head = NULL;
-    TimerEvent *nextEvent = NULL;
-    time_t currentTime = 0;
-    time_t nextEventTime = 0;
-    struct timespec timeToWait;
-    int tempId;
-
-    assert( timer != NULL );
-
-    ithread_mutex_lock( &timer->mutex );
-    while (1) {
-        /* mutex should always be locked at top of loop */
-	/* Check for shutdown. */
-        if (timer->shutdown) {
-            timer->shutdown = 0;
-            ithread_cond_signal( &timer->condition );
-            ithread_mutex_unlock( &timer->mutex );
-            return NULL;
-        }
-        nextEvent = NULL;
-        /* Get the next event if possible. */
-        if (timer->eventQ.size > 0) {
-            head = ListHead( &timer->eventQ );
-            if (head == NULL) {
-                ithread_mutex_unlock( &timer->mutex );
-                return NULL;
-            }
-            nextEvent = ( TimerEvent * ) head->item;
-            nextEventTime = nextEvent->eventTime;
-        }
-        currentTime = time(NULL);
-        /* If time has elapsed, schedule job. */
-        if (nextEvent && currentTime >= nextEventTime) {
-            if( nextEvent->persistent ) {
-                if (ThreadPoolAddPersistent( timer->tp, &nextEvent->job, &tempId ) != 0) {
-			if (nextEvent->job.arg != NULL && nextEvent->job.free_func != NULL) {
-				nextEvent->job.free_func(nextEvent->job.arg);
-			}
+	TimerThread *timer = (TimerThread *)arg;
+	TimerEvent *nextEvent = NULL;
+	struct timespec timeToWait;
+	int tempId;
+
+	assert(timer != NULL);
+
+	ithread_mutex_lock(&timer->mutex);
+	while (1) {
+		/* mutex should always be locked at top of loop */
+		/* Check for shutdown. */
+		if (timer->shutdown) {
+			timer->shutdown = 0;
+			ithread_cond_signal(&timer->condition);
+			ithread_mutex_unlock(&timer->mutex);
+			return NULL;
 		}
-            } else {
-                if (ThreadPoolAdd( timer->tp, &nextEvent->job, &tempId ) != 0) {
-			if (nextEvent->job.arg != NULL && nextEvent->job.free_func != NULL) {
-				nextEvent->job.free_func(nextEvent->job.arg);
+		nextEvent = NULL;
+		/* Get the next event if possible. */
+		if (timer->eventQSize > 0)
+			nextEvent = timer->eventQ[0];
+		/* If time has elapsed, schedule job. */
+		if (nextEvent && imillinow() >= nextEvent->eventTime) {
+			if (nextEvent->persistent) {
+				if (ThreadPoolAddPersistent(timer->tp,
+					&nextEvent->job, &tempId) != 0) {
+					if (nextEvent->job.arg != NULL &&
+					    nextEvent->job.free_func != NULL) {
+						nextEvent->job.free_func(
+							nextEvent->job.arg);
+					}
+				}
+			} else {
+				if (ThreadPoolAdd(timer->tp, &nextEvent->job,
+					&tempId) != 0) {
+					if (nextEvent->job.arg != NULL &&
+					    nextEvent->job.free_func != NULL) {
+						nextEvent->job.free_func(
+							nextEvent->job.arg);
+					}
+				}
 			}
+			RemoveTimerEvent(timer, nextEvent);
+			FreeTimerEvent(timer, nextEvent);
+			continue;
+		}
+		if (nextEvent) {
+			timeToWait.tv_sec = (time_t)(nextEvent->eventTime / 1000);
+			timeToWait.tv_nsec =
+				(long)(nextEvent->eventTime % 1000) * 1000000;
+			ithread_cond_timedwait(&timer->condition,
+					       &timer->mutex, &timeToWait);
+		} else {
+			ithread_cond_wait(&timer->condition, &timer->mutex);
 		}
-            }
-            ListDelNode( &timer->eventQ, head, 0 );
-            FreeTimerEvent( timer, nextEvent );
-            continue;
-        }
-        if (nextEvent) {
-            timeToWait.tv_nsec = 0;
-            timeToWait.tv_sec = (long)nextEvent->eventTime;
-            ithread_cond_timedwait( &timer->condition, &timer->mutex,
-                                    &timeToWait );
-        } else {
-            ithread_cond_wait( &timer->condition, &timer->mutex );
-        }
-    }
+	}
 }
 
-
 /*!
- * \brief Calculates the appropriate timeout in absolute seconds
- * since Jan 1, 1970.
+ * \brief Calculates the time of an event in milliseconds, on the clock of
+ * imillinow().
  *
- * \return 
+ * \return The time of the event.
  */
-static int CalculateEventTime(
+static int64_t CalculateEventTime(
 	/*! [in] Timeout. */
-	time_t *timeout,
+	time_t timeout,
 	/*! [in] Timeout type. */
 	TimeoutType type)
 {
-    time_t now;
-
-    assert( timeout != NULL );
-
-    switch (type) {
-    case ABS_SEC:
-        return 0;
-    default: /* REL_SEC) */
-        time(&now);
-        ( *timeout ) += now;
-        return 0;
-    }
-
-    return -1;
+	int64_t now = imillinow();
+
+	switch (type) {
+	case ABS_SEC:
+		return now + ((int64_t)timeout - (int64_t)time(NULL)) * 1000;
+	case REL_MSEC:
+		return now + (int64_t)timeout;
+	default: /* REL_SEC */
+		return now + (int64_t)timeout * 1000;
+	}
 }
 
 /*!
@@ -164,82 +397,90 @@ static TimerEvent *CreateTimerEvent(
 	ThreadPoolJob *job,
 	/*! [in] . */
 	Duration persistent,
-	/*! [in] The absoule time of the event in seconds from Jan, 1970. */
-	time_t eventTime,
+	/*! [in] The time of the event, see CalculateEventTime(). */
+	int64_t eventTime,
 	/*! [in] Id of job. */
 	int id)
 {
-    TimerEvent *temp = NULL;
-
-    assert( timer != NULL );
-    assert( job != NULL );
+	TimerEvent *temp = NULL;
 
-    temp = ( TimerEvent * ) FreeListAlloc( &timer->freeEvents );
-    if( temp == NULL )
-        return temp;
-    temp->job = ( *job );
-    temp->persistent = persistent;
-    temp->eventTime = eventTime;
-    temp->id = id;
-
-    return temp;
+	assert(timer != NULL);
+	assert(job != NULL);
+
+	temp = (TimerEvent *)FreeListAlloc(&timer->freeEvents);
+	if (temp == NULL)
+		return temp;
+	temp->job = *job;
+	temp->persistent = persistent;
+	temp->eventTime = eventTime;
+	temp->id = id;
+	temp->heapIndex = -1;
+
+	return temp;
 }
 
-
 int TimerThreadInit(TimerThread *timer, ThreadPool *tp)
 {
+	int rc = 0;
+	ThreadPoolJob timerThreadWorker;
+#ifdef TIMER_USE_MONOTONIC
+	ithread_condattr_t attr;
+#endif /* TIMER_USE_MONOTONIC */
 
-    int rc = 0;
-
-    ThreadPoolJob timerThreadWorker;
-
-    assert( timer != NULL );
-    assert( tp != NULL );
-
-    if( ( timer == NULL ) || ( tp == NULL ) ) {
-        return EINVAL;
-    }
-
-    rc += ithread_mutex_init( &timer->mutex, NULL );
-
-    assert( rc == 0 );
-
-    rc += ithread_mutex_lock( &timer->mutex );
-    assert( rc == 0 );
-
-    rc += ithread_cond_init( &timer->condition, NULL );
-    assert( rc == 0 );
-
-    rc += FreeListInit( &timer->freeEvents, sizeof( TimerEvent ), 100 );
-    assert( rc == 0 );
-
-    timer->shutdown = 0;
-    timer->tp = tp;
-    timer->lastEventId = 0;
-    rc += ListInit( &timer->eventQ, NULL, NULL );
-
-    assert( rc == 0 );
-
-    if( rc != 0 ) {
-        rc = EAGAIN;
-    } else {
-
-        TPJobInit( &timerThreadWorker, TimerThreadWorker, timer );
-        TPJobSetPriority( &timerThreadWorker, HIGH_PRIORITY );
-
-        rc = ThreadPoolAddPersistent( tp, &timerThreadWorker, NULL );
-    }
-
-    ithread_mutex_unlock( &timer->mutex );
-
-    if( rc != 0 ) {
-        ithread_cond_destroy( &timer->condition );
-        ithread_mutex_destroy( &timer->mutex );
-        FreeListDestroy( &timer->freeEvents );
-        ListDestroy( &timer->eventQ, 0 );
-    }
-
-    return rc;
+	assert(timer != NULL);
+	assert(tp != NULL);
+
+	if ((timer == NULL) || (tp == NULL)) {
+		return EINVAL;
+	}
+
+	rc += ithread_mutex_init(&timer->mutex, NULL);
+	assert(rc == 0);
+
+	rc += ithread_mutex_lock(&timer->mutex);
+	assert(rc == 0);
+
+#ifdef TIMER_USE_MONOTONIC
+	rc += ithread_condattr_init(&attr);
+	rc += ithread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	rc += ithread_cond_init(&timer->condition, &attr);
+	ithread_condattr_destroy(&attr);
+#else /* TIMER_USE_MONOTONIC */
+	rc += ithread_cond_init(&timer->condition, NULL);
+#endif /* TIMER_USE_MONOTONIC */
+	assert(rc == 0);
+
+	rc += FreeListInit(&timer->freeEvents, sizeof(TimerEvent), 100);
+	assert(rc == 0);
+
+	timer->shutdown = 0;
+	timer->tp = tp;
+	timer->lastEventId = 0;
+	timer->eventQ = NULL;
+	timer->eventQSize = 0;
+	timer->eventQCapacity = 0;
+	timer->idIndex = NULL;
+	timer->idIndexSize = 0;
+	timer->idIndexUsed = 0;
+
+	if (rc != 0) {
+		rc = EAGAIN;
+	} else {
+		TPJobInit(&timerThreadWorker, TimerThreadWorker, timer);
+		TPJobSetPriority(&timerThreadWorker, HIGH_PRIORITY);
+
+		rc = ThreadPoolAddPersistent(tp, &timerThreadWorker, NULL);
+	}
+
+	ithread_mutex_unlock(&timer->mutex);
+
+	if (rc != 0) {
+		ithread_cond_destroy(&timer->condition);
+		ithread_mutex_destroy(&timer->mutex);
+		FreeListDestroy(&timer->freeEvents);
+	}
+
+	return rc;
 }
 
 int TimerThreadSchedule(
@@ -250,65 +491,52 @@ int TimerThreadSchedule(
 	Duration duration,
 	int *id)
 {
-    int rc = EOUTOFMEM;
-    int found = 0;
-    int tempId = 0;
-
-    ListNode *tempNode = NULL;
-    TimerEvent *temp = NULL;
-    TimerEvent *newEvent = NULL;
-
-    assert( timer != NULL );
-    assert( job != NULL );
-
-    if( ( timer == NULL ) || ( job == NULL ) ) {
-        return EINVAL;
-    }
-
-    CalculateEventTime( &timeout, type );
-    ithread_mutex_lock( &timer->mutex );
-
-    if( id == NULL )
-        id = &tempId;
-
-    ( *id ) = INVALID_EVENT_ID;
-
-    newEvent = CreateTimerEvent( timer, job, duration, timeout,
-                                 timer->lastEventId );
-
-    if( newEvent == NULL ) {
-        ithread_mutex_unlock( &timer->mutex );
-        return rc;
-    }
-
-    tempNode = ListHead( &timer->eventQ );
-    /* add job to Q. Q is ordered by eventTime with the head of the Q being
-     * the next event. */
-    while( tempNode != NULL ) {
-        temp = ( TimerEvent * ) tempNode->item;
-        if( temp->eventTime >= timeout ) {
-            if (ListAddBefore( &timer->eventQ, newEvent, tempNode))
-                rc = 0;
-            found = 1;
-            break;
-        }
-        tempNode = ListNext( &timer->eventQ, tempNode );
-    }
-    /* add to the end of Q. */
-    if (!found) {
-        if( ListAddTail( &timer->eventQ, newEvent ) != NULL )
-            rc = 0;
-    }
-    /* signal change in Q. */
-    if( rc == 0 ) {
-        ithread_cond_signal( &timer->condition );
-    } else {
-        FreeTimerEvent( timer, newEvent );
-    }
-    ( *id ) = timer->lastEventId++;
-    ithread_mutex_unlock( &timer->mutex );
-
-    return rc;
+	int rc = EOUTOFMEM;
+	int tempId = 0;
+	int64_t eventTime;
+	TimerEvent *newEvent = NULL;
+
+	assert(timer != NULL);
+	assert(job != NULL);
+
+	if ((timer == NULL) || (job == NULL)) {
+		return EINVAL;
+	}
+
+	eventTime = CalculateEventTime(timeout, type);
+	ithread_mutex_lock(&timer->mutex);
+
+	if (id == NULL)
+		id = &tempId;
+
+	*id = INVALID_EVENT_ID;
+
+	newEvent = CreateTimerEvent(timer, job, duration, eventTime,
+				    timer->lastEventId);
+	if (newEvent == NULL) {
+		ithread_mutex_unlock(&timer->mutex);
+		return rc;
+	}
+	/* add job to Q. Q is a heap ordered by eventTime with the root of the
+	 * Q being the next event. */
+	if (IndexAdd(timer, newEvent) == 0) {
+		rc = HeapInsert(timer, newEvent);
+		if (rc != 0)
+			timer->idIndex[IndexFind(timer, newEvent->id)] =
+				DELETED_EVENT;
+	}
+	/* signal change in Q. */
+	if (rc == 0) {
+		/* the timer thread only cares about a new next event. */
+		if (newEvent->heapIndex == 0)
+			ithread_cond_signal(&timer->condition);
+	} else {
+		FreeTimerEvent(timer, newEvent);
+	}
+	*id = timer->lastEventId++;
+	ithread_mutex_unlock(&timer->mutex);
+
+	return rc;
 }
 
 int TimerThreadRemove(
@@ -316,86 +544,81 @@ int TimerThreadRemove(
 	int id,
 	ThreadPoolJob *out)
 {
-    int rc = INVALID_EVENT_ID;
-    ListNode *tempNode = NULL;
-    TimerEvent *temp = NULL;
-
-    assert( timer != NULL );
+	int rc = INVALID_EVENT_ID;
+	long i;
+	TimerEvent *temp = NULL;
 
-    if( timer == NULL ) {
-        return EINVAL;
-    }
+	assert(timer != NULL);
 
-    ithread_mutex_lock( &timer->mutex );
+	if (timer == NULL) {
+		return EINVAL;
+	}
 
-    tempNode = ListHead( &timer->eventQ );
+	ithread_mutex_lock(&timer->mutex);
 
-    while( tempNode != NULL ) {
-        temp = ( TimerEvent * ) tempNode->item;
-        if( temp->id == id )
-        {
+	i = IndexFind(timer, id);
+	if (i >= 0) {
+		temp = timer->idIndex[i];
+		RemoveTimerEvent(timer, temp);
+		if (out != NULL)
+			*out = temp->job;
+		FreeTimerEvent(timer, temp);
+		rc = 0;
+	}
 
-            ListDelNode( &timer->eventQ, tempNode, 0 );
-            if( out != NULL )
-                ( *out ) = temp->job;
-            FreeTimerEvent( timer, temp );
-            rc = 0;
-            break;
-        }
-        tempNode = ListNext( &timer->eventQ, tempNode );
-    }
+	ithread_mutex_unlock(&timer->mutex);
 
-    ithread_mutex_unlock( &timer->mutex );
-    return rc;
+	return rc;
 }
 
 int TimerThreadShutdown(TimerThread *timer)
 {
-    ListNode *tempNode2 = NULL;
-    ListNode *tempNode = NULL;
-
-    assert( timer != NULL );
+	TimerEvent *temp;
+	long i;
 
-    if( timer == NULL ) {
-        return EINVAL;
-    }
-
-    ithread_mutex_lock( &timer->mutex );
-
-    timer->shutdown = 1;
-    tempNode = ListHead( &timer->eventQ );
-
-    /* Delete nodes in Q. Call registered free function on argument. */
-    while( tempNode != NULL ) {
-        TimerEvent *temp = ( TimerEvent * ) tempNode->item;
-
-        tempNode2 = ListNext( &timer->eventQ, tempNode );
-        ListDelNode( &timer->eventQ, tempNode, 0 );
-        if( temp->job.free_func ) {
-            temp->job.free_func( temp->job.arg );
-        }
-        FreeTimerEvent( timer, temp );
-        tempNode = tempNode2;
-    }
-
-    ListDestroy( &timer->eventQ, 0 );
-    FreeListDestroy( &timer->freeEvents );
+	assert(timer != NULL);
 
-    ithread_cond_broadcast( &timer->condition );
+	if (timer == NULL) {
+		return EINVAL;
+	}
 
-    while (timer->shutdown) {
-	/* wait for timer thread to shutdown. */
-        ithread_cond_wait( &timer->condition, &timer->mutex );
-    }
-    ithread_mutex_unlock(&timer->mutex);
+	ithread_mutex_lock(&timer->mutex);
 
-    /* destroy condition. */
-    while(ithread_cond_destroy(&timer->condition) != 0) {
-    }
-    /* destroy mutex. */
-    while (ithread_mutex_destroy(&timer->mutex) != 0) {
-    }
+	timer->shutdown = 1;
 
-    return 0;
+	/* Delete events in Q. Call registered free function on argument. */
+	for (i = 0; i < timer->eventQSize; i++) {
+		temp = timer->eventQ[i];
+		if (temp->job.free_func) {
+			temp->job.free_func(temp->job.arg);
+		}
+		FreeTimerEvent(timer, temp);
+	}
+	free(timer->eventQ);
+	timer->eventQ = NULL;
+	timer->eventQSize = 0;
+	timer->eventQCapacity = 0;
+	free(timer->idIndex);
+	timer->idIndex = NULL;
+	timer->idIndexSize = 0;
+	timer->idIndexUsed = 0;
+
+	FreeListDestroy(&timer->freeEvents);
+
+	ithread_cond_broadcast(&timer->condition);
+
+	while (timer->shutdown) {
+		/* wait for timer thread to shutdown. */
+		ithread_cond_wait(&timer->condition, &timer->mutex);
+	}
+	ithread_mutex_unlock(&timer->mutex);
+
+	/* destroy condition. */
+	while (ithread_cond_destroy(&timer->condition) != 0) {
+	}
+	/* destroy mutex. */
+	while (ithread_mutex_destroy(&timer->mutex) != 0) {
+	}
+
+	return 0;
 }
-
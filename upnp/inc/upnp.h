@@ -539,7 +539,20 @@ enum Upnp_EventType_e {
 	 * if auto-renewal of subscriptions is disabled.
 	 * The \b Event parameter is a \b UpnpEventSubscribe
 	 * structure. The subscription is no longer valid. */
-	UPNP_EVENT_SUBSCRIPTION_EXPIRED
+	UPNP_EVENT_SUBSCRIPTION_EXPIRED,
+
+	/*! Received by a control point that sequences its events when
+	 * events of a subscription are missing and will not be delivered.
+	 * The \b Event parameter is a \b Upnp_Event_Gap structure. See
+	 * \b UpnpSetEventSequencing. */
+	UPNP_EVENT_SEQUENCE_GAP,
+
+	/*! Received by a control point using the device registry when the
+	 * advertisement of a registered device expires. The device has
+	 * been removed from the registry. The \b Event parameter is a \b
+	 * Upnp_Discovery structure with the \b DeviceId, \b DeviceType
+	 * and \b Location of the device. See \b UpnpRegistry_Enable. */
+	UPNP_DISCOVERY_DEVICE_EXPIRED
 };
 
 typedef enum Upnp_EventType_e Upnp_EventType;
@@ -711,11 +724,44 @@ struct Upnp_Event
   /** The event sequence number. */
   int EventKey;
 
-  /** The DOM tree representing the changes generating the event. */
+  /** The DOM tree representing the changes generating the event. It is
+      {\tt NULL} if the event was streamed to the callbacks set with
+      {\bf UpnpSetEventSaxHandler}. */
   IXML_Document *ChangedVariables;
 
 };
 
+/** Passed as the cookie to the SAX callbacks set with
+    {\bf UpnpSetEventSaxHandler}. */
+
+struct Upnp_Event_Sax
+{
+  /** The subscription ID for this subscription. */
+  const char *Sid;
+
+  /** The event sequence number. */
+  int EventKey;
+
+  /** The cookie given to {\bf UpnpSetEventSaxHandler}. */
+  void *Cookie;
+
+};
+
+/** Returned along with a {\bf UPNP_EVENT_SEQUENCE_GAP} callback. */
+
+struct Upnp_Event_Gap
+{
+  /** The subscription ID for this subscription. */
+  Upnp_SID Sid;
+
+  /** The sequence number of the first missing event. */
+  int EventKey;
+
+  /** The number of missing events. */
+  int Missing;
+
+};
+
 /*
  * This typedef is required by Doc++ to parse the last entry of the 
  * Upnp_Discovery structure correctly.
@@ -759,6 +805,88 @@ struct Upnp_Discovery
 	struct sockaddr_storage DestAddr;
 };
 
+/** Counters of the duplicate suppression of the discovery callbacks, see
+ * {\bf UpnpSetDiscoveryDedup}. */
+struct Upnp_Discovery_Dedup_Stats
+{
+	/** The advertisements and byebyes passed on to the control point. */
+	unsigned long Advertisements;
+
+	/** The advertisements and byebyes dropped as duplicates. */
+	unsigned long SuppressedAdvertisements;
+
+	/** The search replies passed on to the searches. */
+	unsigned long SearchResults;
+
+	/** The search replies dropped as duplicates. */
+	unsigned long SuppressedSearchResults;
+};
+
+/** Maximum number of discovery lanes, see {\bf UpnpSetDiscoveryLanes}. */
+#define UPNP_DISCOVERY_LANES_MAX 64
+
+/** Counters of a discovery lane, see {\bf UpnpGetDiscoveryLaneStats}. */
+struct Upnp_Discovery_Lane_Stats
+{
+	/** The messages waiting in the lane. */
+	int Depth;
+
+	/** The largest number of messages that waited in the lane. */
+	int MaxDepth;
+
+	/** The messages taken from the lane and handled. */
+	unsigned long Handled;
+};
+
+/** Device returned by the device registry, see {\bf UpnpRegistry_GetDevice}. */
+struct Upnp_Registry_Device
+{
+	/** The unique device identifier. */
+	char DeviceId[LINE_SIZE];
+
+	/** The device type, empty if unknown. */
+	char DeviceType[LINE_SIZE];
+
+	/** The friendly name, empty until the description is registered. */
+	char FriendlyName[LINE_SIZE];
+
+	/** The URL to the UPnP description document for the device. */
+	char Location[LINE_SIZE];
+
+	/** The number of seconds before the advertisement expires. */
+	int Expires;
+
+	/** The number of registered services of the device. */
+	int ServiceCount;
+};
+
+/** Service returned by the device registry, see {\bf
+ * UpnpRegistry_GetServiceByUSN}. */
+struct Upnp_Registry_Service
+{
+	/** The unique identifier of the device offering the service. */
+	char DeviceId[LINE_SIZE];
+
+	/** The service type. */
+	char ServiceType[LINE_SIZE];
+
+	/** The service identifier, empty until the description is
+	 *  registered. */
+	char ServiceId[LINE_SIZE];
+
+	/** The absolute control URL, empty until the description is
+	 *  registered. */
+	char ControlURL[LINE_SIZE];
+
+	/** The absolute event subscription URL, empty until the description
+	 *  is registered. */
+	char EventURL[LINE_SIZE];
+
+	/** The SID of the subscription of the control point to the service,
+	 *  empty if not subscribed. */
+	Upnp_SID Sid;
+};
+
 /** Returned along with a {\bf UPNP_EVENT_SUBSCRIBE_COMPLETE} or {\bf
  * UPNP_EVENT_UNSUBSCRIBE_COMPLETE} callback.  */
 
@@ -858,6 +986,30 @@ typedef int (*Upnp_FunPtr)(
 	/*! [in] .*/
 	void *Cookie);
 
+/*!
+ * \brief Function called by \b UpnpRegistry_ForEachDevice for every
+ * registered device.
+ *
+ * \return 0 to go on, any other value to stop the iteration.
+ */
+typedef int (*Upnp_RegistryDeviceVisitor)(
+	/*! [in] Copy of the device. */
+	const struct Upnp_Registry_Device *Device,
+	/*! [in] The cookie given to \b UpnpRegistry_ForEachDevice. */
+	void *Cookie);
+
+/*!
+ * \brief Function called by \b UpnpRegistry_ForEachService for every
+ * registered service.
+ *
+ * \return 0 to go on, any other value to stop the iteration.
+ */
+typedef int (*Upnp_RegistryServiceVisitor)(
+	/*! [in] Copy of the service. */
+	const struct Upnp_Registry_Service *Service,
+	/*! [in] The cookie given to \b UpnpRegistry_ForEachService. */
+	void *Cookie);
+
 /* @} Constants and Types */
 
 #ifdef __cplusplus
@@ -1501,6 +1653,141 @@ EXPORT_SPEC int UpnpSendAdvertisementLowPower(
         /*! RegistrationState as defined by UPnP Low Power. */
         int RegistrationState);
 
+/*!
+ * \brief Suppresses the duplicate discovery callbacks of a control point.
+ *
+ * Devices send each advertisement several times, and answer each copy of a
+ * search request, so that a device coming online makes many identical
+ * callbacks. Once this function is called with a non zero \b Window, an
+ * advertisement, byebye or search reply with the same USN, LOCATION,
+ * BOOTID.UPNP.ORG, CONFIGID.UPNP.ORG and kind as one received less than
+ * \b Window milliseconds earlier is dropped before any callback. A byebye
+ * forgets the advertisement of the same USN and the other way around, and
+ * a new search forgets the replies received before it.
+ *
+ * Calling the function resets the counters returned by \b
+ * UpnpGetDiscoveryDedupStats.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized.
+ *     \li \c UPNP_E_INVALID_HANDLE: The handle is not a valid control
+ *             point handle.
+ *     \li \c UPNP_E_INVALID_PARAM: \b Window is negative.
+ */
+EXPORT_SPEC int UpnpSetDiscoveryDedup(
+	/*! [in] The handle of the control point. */
+	UpnpClient_Handle Hnd,
+	/*! [in] The time a message is remembered, in milliseconds, or 0 to
+	 * pass every message on. */
+	int Window);
+
+/*!
+ * \brief Returns the counters of the duplicate suppression of a control
+ * point since the last \b UpnpSetDiscoveryDedup call.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized.
+ *     \li \c UPNP_E_INVALID_HANDLE: The handle is not a valid control
+ *             point handle.
+ *     \li \c UPNP_E_INVALID_PARAM: \b Stats is not a valid pointer.
+ */
+EXPORT_SPEC int UpnpGetDiscoveryDedupStats(
+	/*! [in] The handle of the control point. */
+	UpnpClient_Handle Hnd,
+	/*! [out] The counters. */
+	struct Upnp_Discovery_Dedup_Stats *Stats);
+
+/*!
+ * \brief Restricts the discovery messages a control point handles.
+ *
+ * Once a filter is set, an advertisement, byebye or search reply is dropped
+ * unless the value of its NT, ST or USN header starts with one of the
+ * \b Prefixes, compared without case. The check is done on the raw
+ * datagram, before it is parsed or queued to a thread, so that the
+ * messages of the other devices of the network cost little. Search
+ * requests are not affected.
+ *
+ * Note that the replies to a search are filtered too, and that the byebye
+ * of a root device has an NT of {\tt upnp:rootdevice}: a prefix such as
+ * {\tt uuid:} followed by the UDN lets every message of a known device
+ * through.
+ *
+ * The prefixes are copied. The filter is removed by a \b Count of 0, or
+ * when the control point is unregistered.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized.
+ *     \li \c UPNP_E_INVALID_HANDLE: The handle is not a valid control
+ *             point handle.
+ *     \li \c UPNP_E_INVALID_PARAM: \b Count is negative, or \b Prefixes
+ *             or one of the prefixes is \c NULL.
+ *     \li \c UPNP_E_OUTOF_MEMORY: Insufficient resources exist to
+ *             set the filter.
+ */
+EXPORT_SPEC int UpnpSetDiscoveryFilter(
+	/*! [in] The handle of the control point. */
+	UpnpClient_Handle Hnd,
+	/*! [in] The prefixes of the NT, ST or USN values wanted, for instance
+	 * {\tt urn:schemas-upnp-org:device:MediaRenderer:}. */
+	const char **Prefixes,
+	/*! [in] The number of prefixes, 0 to handle every message. */
+	int Count);
+
+/*!
+ * \brief Delivers the discovery callbacks of each device in order, and
+ * those of distinct devices in parallel.
+ *
+ * By default the advertisements, byebyes and search replies are handled
+ * by whichever thread of the receive pool picks them up, so that a byebye
+ * may reach the callback before the advertisement that preceded it. With
+ * \b Lanes lanes, each message is queued on receipt in the lane of the UDN
+ * of its USN header. A lane is handled by one thread at a time, in the
+ * order its messages were received, while distinct lanes run in parallel.
+ * The search results then reach the callback from the lane too, rather
+ * than from a thread of their own.
+ *
+ * Setting the number of lanes resets the counters returned by \b
+ * UpnpGetDiscoveryLaneStats. The messages received before a change of the
+ * number of lanes may be delivered out of order with the later ones.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized.
+ *     \li \c UPNP_E_INVALID_HANDLE: The handle is not a valid control
+ *             point handle.
+ *     \li \c UPNP_E_INVALID_PARAM: \b Lanes is negative or larger than
+ *             \c UPNP_DISCOVERY_LANES_MAX.
+ */
+EXPORT_SPEC int UpnpSetDiscoveryLanes(
+	/*! [in] The handle of the control point. */
+	UpnpClient_Handle Hnd,
+	/*! [in] The number of lanes, 0 to deliver the callbacks from any
+	 * thread in any order. */
+	int Lanes);
+
+/*!
+ * \brief Returns the counters of the discovery lanes of a control point.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized.
+ *     \li \c UPNP_E_INVALID_HANDLE: The handle is not a valid control
+ *             point handle.
+ *     \li \c UPNP_E_INVALID_PARAM: \b Stats or \b Count is not a valid
+ *             pointer.
+ */
+EXPORT_SPEC int UpnpGetDiscoveryLaneStats(
+	/*! [in] The handle of the control point. */
+	UpnpClient_Handle Hnd,
+	/*! [out] The counters, one element per lane. */
+	struct Upnp_Discovery_Lane_Stats *Stats,
+	/*! [in,out] The number of elements of \b Stats, set to the number
+	 * of lanes, which may be larger. */
+	int *Count);
+
 /* @} Discovery */
 
 /******************************************************************************
@@ -1663,6 +1950,46 @@ EXPORT_SPEC int UpnpSendActionEx(
 	 * this document and the caller needs to free it. */
 	IXML_Document **RespNode);
 
+/*!
+ * \brief Sends a message to change a state variable in a service, and streams
+ * the response to SAX callbacks instead of building a DOM document.
+ *
+ * This is a synchronous call that does not return until the action is
+ * complete. The callbacks see the whole SOAP envelope of the response: the
+ * output arguments are the children of its \c <ActionName>Response element.
+ * A callback can return \c IXML_FILE_DONE to skip the rest of the response,
+ * see \b ixmlSaxParse.
+ *
+ * As for \b UpnpSendAction, a positive return value is a SOAP-protocol error
+ * code. The callbacks then see the SOAP fault instead of the response.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_INVALID_HANDLE: The handle is not a valid control
+ *             point handle.
+ *     \li \c UPNP_E_INVALID_URL: \b ActionUrl is not a valid URL.
+ *     \li \c UPNP_E_INVALID_ACTION: This action is not valid.
+ *     \li \c UPNP_E_INVALID_PARAM: \b ServiceType, \b Action,
+ *             \b ActionUrl, or \b Handler is not a valid pointer.
+ *     \li \c UPNP_E_BAD_RESPONSE: The response is not a well formed
+ *             XML document, or a callback stopped the parse with an error.
+ *     \li \c UPNP_E_OUTOF_MEMORY: Insufficient resources exist to
+ *             complete this operation.
+ */
+EXPORT_SPEC int UpnpSendActionSax(
+	/*! [in] The handle of the control point sending the action. */
+	UpnpClient_Handle Hnd,
+	/*! [in] The action URL of the service. */
+	const char *ActionURL,
+	/*! [in] The type of the service. */
+	const char *ServiceType,
+	/*! [in] The DOM document for the action. */
+	IXML_Document *Action,
+	/*! [in] The callbacks the response is reported to. */
+	const IXML_SaxHandler *Handler,
+	/*! [in] Pointer to user data passed to the callbacks. */
+	const void *Cookie);
+
 /*!
  * \brief Sends a message to change a state variable in a service, generating a
  * callback when the operation is complete.
@@ -1905,6 +2232,49 @@ EXPORT_SPEC int UpnpNotifyExt(
 	 * Plug and Play Device Architecture specification. */
 	IXML_Document *PropSet);
 
+/*!
+ * \brief Moderates the events of a state variable, as the maximumRate and
+ * minimumDelta of moderated variables in the UPnP Device Architecture.
+ *
+ * A change of the variable is sent at most once every \b MaxRate
+ * milliseconds: a change coming sooner is held back, and only the latest
+ * held back value is sent when the period ends. A numeric value that
+ * differs from the last sent one by less than \b MinDelta is not sent.
+ *
+ * When an event waits to be sent to a control point, a newer event of the
+ * same service is merged into it, so that the control point receives the
+ * latest values in one property set. Two events setting the same variable
+ * are merged only if the variable is moderated, which it is after this call
+ * even with \b MaxRate and \b MinDelta set to 0.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_INVALID_HANDLE: The handle is not a valid device 
+ *             handle.
+ *     \li \c UPNP_E_INVALID_SERVICE: The \b DevId/\b ServId 
+ *             pair refers to an invalid service.
+ *     \li \c UPNP_E_INVALID_PARAM: Either \b DevID, \b ServID or
+ *             \b VarName is not a valid pointer, or \b MaxRate or
+ *             \b MinDelta is negative.
+ *     \li \c UPNP_E_OUTOF_MEMORY: Insufficient resources exist to 
+ *             complete this operation.
+ */
+EXPORT_SPEC int UpnpSetEventModeration(
+	/*! [in] The handle to the device sending the events. */
+	UpnpDevice_Handle Hnd,
+	/*! [in] The device ID of the subdevice of the service. */
+	const char *DevID,
+	/*! [in] The unique identifier of the service. */
+	const char *ServID,
+	/*! [in] The name of the state variable. */
+	const char *VarName,
+	/*! [in] The minimum time between two events of the variable, in
+	 * milliseconds, 0 for no limit. */
+	int MaxRate,
+	/*! [in] The minimum change of a numeric value to be evented, 0 to
+	 * event every change. */
+	double MinDelta);
+
 /*!
  * \brief Renews a subscription that is about to expire.
  *
@@ -2238,6 +2608,70 @@ EXPORT_SPEC int UpnpUnSubscribeAsync(
 	/*! [in] Pointer to user data to pass to the callback function when invoked. */
 	const void *Cookie);
 
+/*!
+ * \brief Streams the bodies of the events received by a control point to SAX
+ * callbacks instead of parsing them into DOM documents.
+ *
+ * The property set of each event is reported to \b Handler, with a
+ * \b Upnp_Event_Sax structure identifying the subscription as the cookie.
+ * The \b UPNP_EVENT_RECEIVED callback is then made as usual, with a
+ * \c NULL \b ChangedVariables. If the body is not well formed, the event is
+ * rejected and no \b UPNP_EVENT_RECEIVED callback is made, but the SAX
+ * callbacks made before the error was found are not undone.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_INVALID_HANDLE: The handle is not a valid control
+ *             point handle.
+ */
+EXPORT_SPEC int UpnpSetEventSaxHandler(
+	/*! [in] The handle of the control point. */
+	UpnpClient_Handle Hnd,
+	/*! [in] The callbacks, copied by the SDK, or \c NULL to go back to
+	 * DOM documents. */
+	const IXML_SaxHandler *Handler,
+	/*! [in] Pointer to user data passed in the \b Upnp_Event_Sax
+	 * structure. */
+	const void *Cookie);
+
+/*!
+ * \brief Delivers the events received by a control point in the order of
+ * their sequence numbers.
+ *
+ * Events are sent by the devices on separate connections and may be
+ * received out of order. Once this function is called, an event received
+ * before the previous ones of its subscription is held back until they
+ * arrive, and the \b UPNP_EVENT_RECEIVED callbacks of a subscription are
+ * made one at a time, in order. The events of different subscriptions are
+ * still delivered in parallel.
+ *
+ * An event that is still missing when \b Window later events are held
+ * back, or after \b GapTimeout milliseconds, is given up: a
+ * \b UPNP_EVENT_SEQUENCE_GAP callback reports it, and the held back events
+ * are delivered. An event arriving after it was given up, or twice, is
+ * dropped.
+ *
+ * With SAX callbacks set by \b UpnpSetEventSaxHandler, the body of an event
+ * is streamed when the event is delivered; if it is not well formed, the
+ * event has already been accepted and no \b UPNP_EVENT_RECEIVED callback
+ * is made.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_INVALID_HANDLE: The handle is not a valid control
+ *             point handle.
+ *     \li \c UPNP_E_INVALID_PARAM: \b Window or \b GapTimeout is
+ *             negative.
+ */
+EXPORT_SPEC int UpnpSetEventSequencing(
+	/*! [in] The handle of the control point. */
+	UpnpClient_Handle Hnd,
+	/*! [in] The number of events held back per subscription, or 0 to
+	 * deliver the events as they arrive. */
+	int Window,
+	/*! [in] The time a missing event is waited for, in milliseconds. */
+	int GapTimeout);
+
 /*! @} Eventing */
 
 
@@ -2620,8 +3054,253 @@ EXPORT_SPEC int UpnpDownloadXmlDoc(
 	/*! [out] A pointer in which to store the XML document. */
 	IXML_Document **xmlDoc);
 
+/*!
+ * \brief Same as \b UpnpDownloadXmlDoc, but the document is taken from the
+ * SDK description cache when possible.
+ *
+ * Documents are cached by (\b url, \b usn), so that a device announcing
+ * several services at the same LOCATION is only downloaded once. A cached
+ * document is returned without any network traffic for \b maxAge seconds;
+ * after that, it is revalidated with a conditional GET (IF-NONE-MATCH and
+ * IF-MODIFIED-SINCE), and downloaded again only if it has changed. Control
+ * points typically pass the \b Location, \b DeviceId and \b Expires fields
+ * of the discovery event.
+ *
+ * The application owns the returned document and must free it, as with
+ * \b UpnpDownloadXmlDoc.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized.
+ *     \li \c UPNP_E_INVALID_PARAM: Either \b url or \b xmlDoc
+ *             is not a valid pointer.
+ *     \li Any other error code of \b UpnpDownloadXmlDoc.
+ */
+EXPORT_SPEC int UpnpDownloadXmlDocCached(
+	/*! [in] URL of the XML document. */
+	const char *url,
+	/*! [in] USN or UDN of the advertisement, may be \c NULL. */
+	const char *usn,
+	/*! [in] Number of seconds the document may be used without being
+	 * revalidated, usually the CACHE-CONTROL max-age of the advertisement.
+	 * 0 or a negative value selects the SDK default. */
+	int maxAge,
+	/*! [out] A pointer in which to store the XML document. */
+	IXML_Document **xmlDoc);
+
+/*!
+ * \brief Removes documents from the SDK description cache.
+ *
+ * Control points should call it when a device leaves the network
+ * (byebye or expired advertisement). A \c NULL argument matches any
+ * value: passing \c NULL for both flushes the whole cache.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized.
+ */
+EXPORT_SPEC int UpnpInvalidateXmlDocCache(
+	/*! [in] URL of the XML document, or \c NULL. */
+	const char *url,
+	/*! [in] USN or UDN of the advertisement, or \c NULL. */
+	const char *usn);
+
 /*! @} Control Point HTTP API */
 
+/******************************************************************************
+ ******************************************************************************
+ *                                                                            *
+ *                        D E V I C E  R E G I S T R Y                        *
+ *                                                                            *
+ ******************************************************************************
+ ******************************************************************************/
+
+/*!
+ * \name Control Point Device Registry API
+ *
+ * The SDK can keep track of the devices and services discovered by the
+ * control point, so that applications do not have to maintain their own
+ * device list. Devices are recorded from the SSDP advertisements and search
+ * replies, and removed on byebye or when their advertisement expires; the
+ * descriptions registered with \b UpnpRegistry_AddDescription add the
+ * services with their control and event URLs, and successful \b
+ * UpnpSubscribe calls record the SID of the services they subscribe to.
+ *
+ * Devices are found by UDN (or any USN of the device), and services by USN
+ * ("UDN::serviceType"), SID or control URL, in constant time. Lookups copy
+ * the entry out of the registry and may run concurrently.
+ *
+ * @{
+ */
+
+/*!
+ * \brief Enables or disables the device registry of a control point.
+ *
+ * Once enabled, the SDK records the devices of the discovery callbacks
+ * and makes a \b UPNP_DISCOVERY_DEVICE_EXPIRED callback for each device
+ * whose advertisement expires. Disabling the registry, or unregistering
+ * the control point, drops every entry.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized.
+ *     \li \c UPNP_E_INVALID_HANDLE: The handle is not a valid control
+ *             point handle.
+ */
+EXPORT_SPEC int UpnpRegistry_Enable(
+	/*! [in] The handle of the control point. */
+	UpnpClient_Handle Hnd,
+	/*! [in] Non zero to enable the registry, 0 to disable it. */
+	int Enable);
+
+/*!
+ * \brief Registers the devices and services of a description document.
+ *
+ * Every device element of the document is registered, with its services.
+ * Relative URLs are resolved against the URLBase of the document, or
+ * \b Location. The document is not kept by the SDK.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized or the registry
+ *             is not enabled.
+ *     \li \c UPNP_E_INVALID_PARAM: \b Location or \b DescDoc is not a
+ *             valid pointer.
+ *     \li \c UPNP_E_INVALID_DESC: The document has no device element.
+ *     \li \c UPNP_E_OUTOF_MEMORY: Insufficient resources exist to
+ *             register the document.
+ */
+EXPORT_SPEC int UpnpRegistry_AddDescription(
+	/*! [in] The URL the document was downloaded from. */
+	const char *Location,
+	/*! [in] The description document. */
+	IXML_Document *DescDoc,
+	/*! [in] The number of seconds the devices that have not been
+	 * advertised yet are kept, usually the \b Expires field of the
+	 * discovery event. 0 or a negative value selects the SDK default. */
+	int Expires);
+
+/*!
+ * \brief Removes a device and its services from the registry.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized.
+ *     \li \c UPNP_E_INVALID_PARAM: \b UDN is not a valid pointer.
+ *     \li \c UPNP_E_INVALID_DEVICE: The device is not registered.
+ */
+EXPORT_SPEC int UpnpRegistry_RemoveDevice(
+	/*! [in] The UDN, or a USN, of the device. */
+	const char *UDN);
+
+/*!
+ * \brief Looks a device up in the registry.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized or the registry
+ *             is not enabled.
+ *     \li \c UPNP_E_INVALID_PARAM: \b UDN or \b Device is not a valid
+ *             pointer.
+ *     \li \c UPNP_E_INVALID_DEVICE: The device is not registered.
+ */
+EXPORT_SPEC int UpnpRegistry_GetDevice(
+	/*! [in] The UDN, or a USN, of the device. */
+	const char *UDN,
+	/*! [out] The copy of the device. */
+	struct Upnp_Registry_Device *Device);
+
+/*!
+ * \brief Looks a service up in the registry by USN.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized or the registry
+ *             is not enabled.
+ *     \li \c UPNP_E_INVALID_PARAM: \b USN or \b Service is not a valid
+ *             pointer.
+ *     \li \c UPNP_E_INVALID_SERVICE: The service is not registered.
+ */
+EXPORT_SPEC int UpnpRegistry_GetServiceByUSN(
+	/*! [in] The USN of the service, "UDN::serviceType". */
+	const char *USN,
+	/*! [out] The copy of the service. */
+	struct Upnp_Registry_Service *Service);
+
+/*!
+ * \brief Looks a service up in the registry by the SID of the subscription
+ * of the control point, e.g. for a \b UPNP_EVENT_RECEIVED callback.
+ *
+ * \return Same as \b UpnpRegistry_GetServiceByUSN.
+ */
+EXPORT_SPEC int UpnpRegistry_GetServiceBySid(
+	/*! [in] The SID of the subscription. */
+	const char *Sid,
+	/*! [out] The copy of the service. */
+	struct Upnp_Registry_Service *Service);
+
+/*!
+ * \brief Looks a service up in the registry by its absolute control URL,
+ * e.g. for a \b UPNP_CONTROL_ACTION_COMPLETE callback.
+ *
+ * \return Same as \b UpnpRegistry_GetServiceByUSN.
+ */
+EXPORT_SPEC int UpnpRegistry_GetServiceByControlURL(
+	/*! [in] The absolute control URL of the service. */
+	const char *ControlURL,
+	/*! [out] The copy of the service. */
+	struct Upnp_Registry_Service *Service);
+
+/*!
+ * \brief Calls \b Visitor for every registered device, in no particular
+ * order, until it returns a non zero value.
+ *
+ * \b Visitor is called, without any lock held, for copies of the devices
+ * registered when the iteration started: it may subscribe to their
+ * services or call any \b UpnpRegistry function.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized or the registry
+ *             is not enabled.
+ *     \li \c UPNP_E_INVALID_PARAM: \b Visitor is not a valid pointer.
+ *     \li \c UPNP_E_OUTOF_MEMORY: Insufficient resources exist to copy
+ *             the devices.
+ */
+EXPORT_SPEC int UpnpRegistry_ForEachDevice(
+	/*! [in] The function to call. */
+	Upnp_RegistryDeviceVisitor Visitor,
+	/*! [in] Pointer to user data passed to \b Visitor. */
+	void *Cookie);
+
+/*!
+ * \brief Calls \b Visitor for every registered service of a device, or of
+ * every device, until it returns a non zero value.
+ *
+ * As for \b UpnpRegistry_ForEachDevice, \b Visitor is called without any
+ * lock held, for copies of the services registered when the iteration
+ * started.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized or the registry
+ *             is not enabled.
+ *     \li \c UPNP_E_INVALID_PARAM: \b Visitor is not a valid pointer.
+ *     \li \c UPNP_E_INVALID_DEVICE: The device is not registered.
+ *     \li \c UPNP_E_OUTOF_MEMORY: Insufficient resources exist to copy
+ *             the services.
+ */
+EXPORT_SPEC int UpnpRegistry_ForEachService(
+	/*! [in] The UDN, or a USN, of the device, or \c NULL for every
+	 * device. */
+	const char *UDN,
+	/*! [in] The function to call. */
+	Upnp_RegistryServiceVisitor Visitor,
+	/*! [in] Pointer to user data passed to \b Visitor. */
+	void *Cookie);
+
+/*! @} Control Point Device Registry API */
+
 /******************************************************************************
  ******************************************************************************
  *                                                                            *
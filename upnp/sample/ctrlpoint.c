@@ -90,6 +90,20 @@ int CtrlPointStart(void)
 	{
 		DEBUG("Success registering ctrlpoint: %d\n", rc);
 	}
+	/* only handle the messages of the renderers and their services */
+	{
+		const char *prefixes[SERVICE_SERVCOUNT + 1];
+		int i;
+
+		prefixes[0] = DeviceType;
+		for (i = 0; i < SERVICE_SERVCOUNT; i++)
+			prefixes[i + 1] = ServiceType[i];
+		rc = UpnpSetDiscoveryFilter(ctrlpt_handle, prefixes, SERVICE_SERVCOUNT + 1);
+		if (rc != UPNP_E_SUCCESS)
+		{
+			DEBUG("Error setting the discovery filter: %d\n", rc);
+		}
+	}
 	CtrlPointRefresh();
 
 	/* start a timer thread */
@@ -115,7 +129,8 @@ int CtrlPointCallbackEventHandler(Upnp_EventType EventType, void *Event, void *C
 				{
 					DEBUG("Error in Discovery Callback -- %d\n", d_event->ErrCode);
 				}
-				ret = UpnpDownloadXmlDoc(d_event->Location, &DescDoc);
+				ret = UpnpDownloadXmlDocCached(d_event->Location,
+						d_event->DeviceId, d_event->Expires, &DescDoc);
 				if (ret != UPNP_E_SUCCESS) 
 				{
 					DEBUG("Error obtaining device description from %s -- "
@@ -151,6 +166,7 @@ int CtrlPointCallbackEventHandler(Upnp_EventType EventType, void *Event, void *C
 				}
 				DEBUG("Received ByeBye for Device: %s\n", d_event->DeviceId);
 				CtrlPointRemoveDevice(d_event->DeviceId);
+				UpnpInvalidateXmlDocCache(NULL, d_event->DeviceId);
 				DEBUG("After byebye:\n");
 #if __DEBUG__
 				CtrlPointPrintList();
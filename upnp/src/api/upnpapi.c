@@ -42,8 +42,12 @@
 
 #include "upnpapi.h"
 
+#include "desc_cache.h"
+#include "httpasync.h"
+
 #include "httpreadwrite.h"
 #include "membuffer.h"
+#include "registry.h"
 #include "ssdplib.h"
 #include "soaplib.h"
 #include "sysdep.h"
@@ -243,11 +247,39 @@ static int UpnpInitMutexes(void)
 	if (ithread_mutex_init(&gUUIDMutex, NULL) != 0) {
 		return UPNP_E_INIT_FAILED;
 	}
+	/* initialize the pool of client connections. */
+	if (http_ConnPoolInit() != UPNP_E_SUCCESS) {
+		return UPNP_E_INIT_FAILED;
+	}
+#if EXCLUDE_SSDP == 0
+	/* initialize the SSDP receive ring. */
+	if (initSSDPRecvRing() != UPNP_E_SUCCESS) {
+		return UPNP_E_INIT_FAILED;
+	}
+#endif
 	/* initialize subscribe mutex. */
 #ifdef INCLUDE_CLIENT_APIS
 	if (ithread_mutex_init(&GlobalClientSubscribeMutex, NULL) != 0) {
 		return UPNP_E_INIT_FAILED;
 	}
+	/* initialize the description document cache. */
+	if (DescCacheInit() != UPNP_E_SUCCESS) {
+		return UPNP_E_INIT_FAILED;
+	}
+	/* initialize the device registry. */
+	if (RegistryInit() != UPNP_E_SUCCESS) {
+		return UPNP_E_INIT_FAILED;
+	}
+#if EXCLUDE_SSDP == 0
+	/* initialize the M-SEARCH transmissions, the search index, the
+	 * duplicate filter and the discovery filter. */
+	if (initSSDPSearchTx() != UPNP_E_SUCCESS ||
+	    initSSDPSearchIndex() != UPNP_E_SUCCESS ||
+	    initSSDPDedup() != UPNP_E_SUCCESS ||
+	    initSSDPFilter() != UPNP_E_SUCCESS) {
+		return UPNP_E_INIT_FAILED;
+	}
+#endif
 #endif
 	return UPNP_E_SUCCESS;
 }
@@ -378,6 +410,14 @@ static int UpnpInitPreamble(void)
 		return retVal;
 	}
 
+#ifdef INCLUDE_CLIENT_APIS
+	/* Start the asynchronous HTTP client. Without it the asynchronous
+	 * requests run in jobs of the send thread pool. */
+	if (http_AsyncInit(&gSendThreadPool) != UPNP_E_SUCCESS)
+		UpnpPrintf(UPNP_CRITICAL, API, __FILE__, __LINE__,
+			"Asynchronous HTTP client not started\n");
+#endif /* INCLUDE_CLIENT_APIS */
+
 	return UPNP_E_SUCCESS;
 }
 
@@ -643,6 +683,9 @@ int UpnpFinish(void)
 	}
 #endif
 	TimerThreadShutdown(&gTimerThread);
+#ifdef INCLUDE_CLIENT_APIS
+	http_AsyncShutdown();
+#endif /* INCLUDE_CLIENT_APIS */
 #if EXCLUDE_MINISERVER == 0
 	StopMiniServer();
 #endif
@@ -660,7 +703,19 @@ int UpnpFinish(void)
 		"Recv Thread Pool");
 #ifdef INCLUDE_CLIENT_APIS
 	ithread_mutex_destroy(&GlobalClientSubscribeMutex);
+	DescCacheDestroy();
+	RegistryDestroy();
+#if EXCLUDE_SSDP == 0
+	destroySSDPSearchTx();
+	destroySSDPSearchIndex();
+	destroySSDPDedup();
+	destroySSDPFilter();
+#endif
+#endif
+#if EXCLUDE_SSDP == 0
+	destroySSDPRecvRing();
 #endif
+	http_ConnPoolDestroy();
 	ithread_rwlock_destroy(&GlobalHndRWLock);
 	ithread_mutex_destroy(&gUUIDMutex);
 	/* remove all virtual dirs */
@@ -835,8 +890,10 @@ int UpnpRegisterRootDevice(
 	HInfo->ServiceList = NULL;
 	HInfo->DescDocument = NULL;
 #ifdef INCLUDE_CLIENT_APIS
-	ListInit(&HInfo->SsdpSearchList, NULL, NULL);
-	HInfo->ClientSubList = NULL;
+	ClientSubTableInit(&HInfo->ClientSubs);
+	HInfo->EventSaxEnabled = FALSE;
+	HInfo->EventSeqWindow = 0;
+	HInfo->DiscoveryDedupWindow = 0;
 #endif /* INCLUDE_CLIENT_APIS */
 	HInfo->MaxSubscriptions = UPNP_INFINITE;
 	HInfo->MaxSubscriptionTimeOut = UPNP_INFINITE;
@@ -847,9 +904,6 @@ int UpnpRegisterRootDevice(
 		UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__,
 			"UpnpRegisterRootDevice: error downloading Document: %d\n",
 			retVal);
-#ifdef INCLUDE_CLIENT_APIS
-		ListDestroy(&HInfo->SsdpSearchList, 0);
-#endif /* INCLUDE_CLIENT_APIS */
 		FreeHandle(*Hnd);
 		goto exit_function;
 	}
@@ -861,9 +915,6 @@ int UpnpRegisterRootDevice(
 	HInfo->DeviceList =
 		ixmlDocument_getElementsByTagName(HInfo->DescDocument, "device");
 	if (!HInfo->DeviceList) {
-#ifdef INCLUDE_CLIENT_APIS
-		ListDestroy(&HInfo->SsdpSearchList, 0);
-#endif /* INCLUDE_CLIENT_APIS */
 		ixmlDocument_free(HInfo->DescDocument);
 		FreeHandle(*Hnd);
 		UpnpPrintf(UPNP_CRITICAL, API, __FILE__, __LINE__,
@@ -1009,8 +1060,10 @@ int UpnpRegisterRootDevice2(
 	HInfo->DeviceList = NULL;
 	HInfo->ServiceList = NULL;
 #ifdef INCLUDE_CLIENT_APIS
-	ListInit(&HInfo->SsdpSearchList, NULL, NULL);
-	HInfo->ClientSubList = NULL;
+	ClientSubTableInit(&HInfo->ClientSubs);
+	HInfo->EventSaxEnabled = FALSE;
+	HInfo->EventSeqWindow = 0;
+	HInfo->DiscoveryDedupWindow = 0;
 #endif /* INCLUDE_CLIENT_APIS */
 	HInfo->MaxSubscriptions = UPNP_INFINITE;
 	HInfo->MaxSubscriptionTimeOut = UPNP_INFINITE;
@@ -1024,9 +1077,6 @@ int UpnpRegisterRootDevice2(
 	HInfo->DeviceList =
 		ixmlDocument_getElementsByTagName( HInfo->DescDocument, "device" );
 	if (!HInfo->DeviceList) {
-#ifdef INCLUDE_CLIENT_APIS
-		ListDestroy(&HInfo->SsdpSearchList, 0);
-#endif /* INCLUDE_CLIENT_APIS */
 		ixmlDocument_free(HInfo->DescDocument);
 		FreeHandle(*Hnd);
 		UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__,
@@ -1175,17 +1225,16 @@ int UpnpRegisterRootDevice4(
 	HInfo->ServiceList = NULL;
 	HInfo->DescDocument = NULL;
 #ifdef INCLUDE_CLIENT_APIS
-	ListInit(&HInfo->SsdpSearchList, NULL, NULL);
-	HInfo->ClientSubList = NULL;
+	ClientSubTableInit(&HInfo->ClientSubs);
+	HInfo->EventSaxEnabled = FALSE;
+	HInfo->EventSeqWindow = 0;
+	HInfo->DiscoveryDedupWindow = 0;
 #endif /* INCLUDE_CLIENT_APIS */
 	HInfo->MaxSubscriptions = UPNP_INFINITE;
 	HInfo->MaxSubscriptionTimeOut = UPNP_INFINITE;
 	HInfo->DeviceAf = AddressFamily;
 	retVal = UpnpDownloadXmlDoc(HInfo->DescURL, &(HInfo->DescDocument));
 	if (retVal != UPNP_E_SUCCESS) {
-#ifdef INCLUDE_CLIENT_APIS
-		ListDestroy(&HInfo->SsdpSearchList, 0);
-#endif /* INCLUDE_CLIENT_APIS */
 		FreeHandle(*Hnd);
 		goto exit_function;
 	}
@@ -1197,9 +1246,6 @@ int UpnpRegisterRootDevice4(
 	HInfo->DeviceList = ixmlDocument_getElementsByTagName(
 		HInfo->DescDocument, "device");
 	if (!HInfo->DeviceList) {
-#ifdef INCLUDE_CLIENT_APIS
-		ListDestroy(&HInfo->SsdpSearchList, 0);
-#endif /* INCLUDE_CLIENT_APIS */
 		ixmlDocument_free(HInfo->DescDocument);
 		FreeHandle(*Hnd);
 		UpnpPrintf(UPNP_CRITICAL, API, __FILE__, __LINE__,
@@ -1312,9 +1358,6 @@ int UpnpUnRegisterRootDeviceLowPower(UpnpDevice_Handle Hnd, int PowerState,
 	ixmlNodeList_free(HInfo->DeviceList);
 	ixmlNodeList_free(HInfo->ServiceList);
 	ixmlDocument_free(HInfo->DescDocument);
-#ifdef INCLUDE_CLIENT_APIS
-	ListDestroy(&HInfo->SsdpSearchList, 0);
-#endif /* INCLUDE_CLIENT_APIS */
 #ifdef INTERNAL_WEB_SERVER
 	if (HInfo->aliasInstalled)
 		web_server_set_alias(NULL, NULL, 0, 0);
@@ -1369,8 +1412,10 @@ int UpnpRegisterClient(Upnp_FunPtr Fun, const void *Cookie,
 	HInfo->HType = HND_CLIENT;
 	HInfo->Callback = Fun;
 	HInfo->Cookie = (void *)Cookie;
-	HInfo->ClientSubList = NULL;
-	ListInit(&HInfo->SsdpSearchList, NULL, NULL);
+	ClientSubTableInit(&HInfo->ClientSubs);
+	HInfo->EventSaxEnabled = FALSE;
+	HInfo->EventSeqWindow = 0;
+	HInfo->DiscoveryDedupWindow = 0;
 #ifdef INCLUDE_DEVICE_APIS
 	HInfo->MaxAge = 0;
 	HInfo->MaxSubscriptions = UPNP_INFINITE;
@@ -1391,8 +1436,6 @@ int UpnpRegisterClient(Upnp_FunPtr Fun, const void *Cookie,
 int UpnpUnRegisterClient(UpnpClient_Handle Hnd)
 {
 	struct Handle_Info *HInfo;
-	ListNode *node = NULL;
-	SsdpSearchArg *searchArg = NULL;
 
 	if (UpnpSdkInit != 1)
 		return UPNP_E_FINISH;
@@ -1418,21 +1461,16 @@ int UpnpUnRegisterClient(UpnpClient_Handle Hnd)
 	default:
 		break;
 	}
-	/* clean up search list */
-	node = ListHead(&HInfo->SsdpSearchList);
-	while (node != NULL) {
-		searchArg = (SsdpSearchArg *) node->item;
-		if (searchArg) {
-			free(searchArg->searchTarget);
-			free(searchArg);
-		}
-		ListDelNode(&HInfo->SsdpSearchList, node, 0);
-		node = ListHead(&HInfo->SsdpSearchList);
-	}
-	ListDestroy(&HInfo->SsdpSearchList, 0);
+#if EXCLUDE_SSDP == 0
+	/* the pending searches are freed when they time out */
+	ssdp_clear_searches();
+	ssdp_set_filter(NULL, 0);
+	ssdp_set_lanes(0);
+#endif
 	FreeHandle(Hnd);
 	UpnpSdkClientRegistered = 0;
 	HandleUnlock();
+	RegistryEnable(FALSE);
 
 	UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__,
 		   "Exiting UpnpUnRegisterClient \n");
@@ -1831,6 +1869,156 @@ int UpnpSearchAsync(
     return UPNP_E_SUCCESS;
 
 }
+
+
+int UpnpSetDiscoveryDedup(UpnpClient_Handle Hnd, int Window)
+{
+	struct Handle_Info *SInfo = NULL;
+
+	if (UpnpSdkInit != 1)
+		return UPNP_E_FINISH;
+
+	UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__,
+		"Inside UpnpSetDiscoveryDedup\n");
+
+	if (Window < 0)
+		return UPNP_E_INVALID_PARAM;
+	HandleLock();
+	switch (GetHandleInfo(Hnd, &SInfo)) {
+	case HND_CLIENT:
+		break;
+	default:
+		HandleUnlock();
+		return UPNP_E_INVALID_HANDLE;
+	}
+	SInfo->DiscoveryDedupWindow = Window;
+	ssdp_reset_dedup();
+	HandleUnlock();
+
+	UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__,
+		"Exiting UpnpSetDiscoveryDedup\n");
+
+	return UPNP_E_SUCCESS;
+}
+
+
+int UpnpGetDiscoveryDedupStats(
+	UpnpClient_Handle Hnd,
+	struct Upnp_Discovery_Dedup_Stats *Stats)
+{
+	struct Handle_Info *SInfo = NULL;
+
+	if (UpnpSdkInit != 1)
+		return UPNP_E_FINISH;
+	if (Stats == NULL)
+		return UPNP_E_INVALID_PARAM;
+	HandleReadLock();
+	switch (GetHandleInfo(Hnd, &SInfo)) {
+	case HND_CLIENT:
+		break;
+	default:
+		HandleUnlock();
+		return UPNP_E_INVALID_HANDLE;
+	}
+	ssdp_get_dedup_stats(Stats);
+	HandleUnlock();
+
+	return UPNP_E_SUCCESS;
+}
+
+
+int UpnpSetDiscoveryFilter(
+	UpnpClient_Handle Hnd,
+	const char **Prefixes,
+	int Count)
+{
+	struct Handle_Info *SInfo = NULL;
+	int retVal;
+	int i;
+
+	if (UpnpSdkInit != 1)
+		return UPNP_E_FINISH;
+
+	UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__,
+		"Inside UpnpSetDiscoveryFilter\n");
+
+	if (Count < 0 || (Count > 0 && Prefixes == NULL))
+		return UPNP_E_INVALID_PARAM;
+	for (i = 0; i < Count; i++)
+		if (Prefixes[i] == NULL)
+			return UPNP_E_INVALID_PARAM;
+	HandleLock();
+	switch (GetHandleInfo(Hnd, &SInfo)) {
+	case HND_CLIENT:
+		break;
+	default:
+		HandleUnlock();
+		return UPNP_E_INVALID_HANDLE;
+	}
+	retVal = ssdp_set_filter(Prefixes, Count);
+	HandleUnlock();
+
+	UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__,
+		"Exiting UpnpSetDiscoveryFilter, retVal=%d\n", retVal);
+
+	return retVal;
+}
+
+
+int UpnpSetDiscoveryLanes(UpnpClient_Handle Hnd, int Lanes)
+{
+	struct Handle_Info *SInfo = NULL;
+
+	if (UpnpSdkInit != 1)
+		return UPNP_E_FINISH;
+
+	UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__,
+		"Inside UpnpSetDiscoveryLanes\n");
+
+	if (Lanes < 0 || Lanes > UPNP_DISCOVERY_LANES_MAX)
+		return UPNP_E_INVALID_PARAM;
+	HandleLock();
+	switch (GetHandleInfo(Hnd, &SInfo)) {
+	case HND_CLIENT:
+		break;
+	default:
+		HandleUnlock();
+		return UPNP_E_INVALID_HANDLE;
+	}
+	ssdp_set_lanes(Lanes);
+	HandleUnlock();
+
+	UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__,
+		"Exiting UpnpSetDiscoveryLanes\n");
+
+	return UPNP_E_SUCCESS;
+}
+
+
+int UpnpGetDiscoveryLaneStats(
+	UpnpClient_Handle Hnd,
+	struct Upnp_Discovery_Lane_Stats *Stats,
+	int *Count)
+{
+	struct Handle_Info *SInfo = NULL;
+
+	if (UpnpSdkInit != 1)
+		return UPNP_E_FINISH;
+	if (Stats == NULL || Count == NULL)
+		return UPNP_E_INVALID_PARAM;
+	HandleReadLock();
+	switch (GetHandleInfo(Hnd, &SInfo)) {
+	case HND_CLIENT:
+		break;
+	default:
+		HandleUnlock();
+		return UPNP_E_INVALID_HANDLE;
+	}
+	*Count = ssdp_get_lane_stats(Stats, *Count);
+	HandleUnlock();
+
+	return UPNP_E_SUCCESS;
+}
 #endif /* INCLUDE_CLIENT_APIS */
 #endif
 
@@ -2177,6 +2365,79 @@ exit_function:
 
 	return retVal;
 }
+
+
+int UpnpSetEventSaxHandler(
+	UpnpClient_Handle Hnd,
+	const IXML_SaxHandler *Handler,
+	const void *Cookie)
+{
+	struct Handle_Info *SInfo = NULL;
+
+	if (UpnpSdkInit != 1)
+		return UPNP_E_FINISH;
+
+	UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__,
+		"Inside UpnpSetEventSaxHandler\n");
+
+	HandleLock();
+	switch (GetHandleInfo(Hnd, &SInfo)) {
+	case HND_CLIENT:
+		break;
+	default:
+		HandleUnlock();
+		return UPNP_E_INVALID_HANDLE;
+	}
+	if (Handler != NULL) {
+		SInfo->EventSaxHandler = *Handler;
+		SInfo->EventSaxCookie = (void *)Cookie;
+		SInfo->EventSaxEnabled = TRUE;
+	} else {
+		SInfo->EventSaxEnabled = FALSE;
+	}
+	HandleUnlock();
+
+	UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__,
+		"Exiting UpnpSetEventSaxHandler\n");
+
+	return UPNP_E_SUCCESS;
+}
+
+
+int UpnpSetEventSequencing(
+	UpnpClient_Handle Hnd,
+	int Window,
+	int GapTimeout)
+{
+	struct Handle_Info *SInfo = NULL;
+
+	if (UpnpSdkInit != 1)
+		return UPNP_E_FINISH;
+
+	UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__,
+		"Inside UpnpSetEventSequencing\n");
+
+	if (Window < 0 || GapTimeout < 0)
+		return UPNP_E_INVALID_PARAM;
+	HandleLock();
+	switch (GetHandleInfo(Hnd, &SInfo)) {
+	case HND_CLIENT:
+		break;
+	default:
+		HandleUnlock();
+		return UPNP_E_INVALID_HANDLE;
+	}
+	/* the sequencers of the subscriptions keep their held back events,
+	 * they are delivered as the missing ones arrive or are given up */
+	SInfo->EventSeqWindow = Window;
+	SInfo->EventSeqTimeout = GapTimeout;
+	HandleUnlock();
+
+	UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__,
+		"Exiting UpnpSetEventSequencing\n");
+
+	return UPNP_E_SUCCESS;
+}
 #endif /* INCLUDE_CLIENT_APIS */
 
 
@@ -2409,6 +2670,37 @@ int UpnpNotifyExt(
 #endif /* INCLUDE_DEVICE_APIS */
 
 
+#ifdef INCLUDE_DEVICE_APIS
+int UpnpSetEventModeration(
+	UpnpDevice_Handle Hnd,
+	const char *DevID,
+	const char *ServID,
+	const char *VarName,
+	int MaxRate,
+	double MinDelta)
+{
+	int retVal;
+
+	if (UpnpSdkInit != 1)
+		return UPNP_E_FINISH;
+
+	UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__,
+		"Inside UpnpSetEventModeration\n");
+
+	if (DevID == NULL || ServID == NULL || VarName == NULL ||
+	    MaxRate < 0 || MinDelta < 0)
+		return UPNP_E_INVALID_PARAM;
+	retVal = genaSetEventModeration(Hnd, DevID, ServID, VarName,
+		MaxRate, MinDelta);
+
+	UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__,
+		"Exiting UpnpSetEventModeration\n");
+
+	return retVal;
+}
+#endif /* INCLUDE_DEVICE_APIS */
+
+
 #ifdef INCLUDE_DEVICE_APIS
 int UpnpAcceptSubscription(
 	UpnpDevice_Handle Hnd,
@@ -2686,6 +2978,137 @@ int UpnpSendActionEx(
 }
 
 
+int UpnpSendActionSax(
+	UpnpClient_Handle Hnd,
+	const char *ActionURL_const,
+	const char *ServiceType_const,
+	IXML_Document *Action,
+	const IXML_SaxHandler *Handler,
+	const void *Cookie)
+{
+	struct Handle_Info *SInfo = NULL;
+	int retVal = 0;
+	char *ActionURL = (char *)ActionURL_const;
+	char *ServiceType = (char *)ServiceType_const;
+
+	if (UpnpSdkInit != 1)
+		return UPNP_E_FINISH;
+
+	UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__,
+		"Inside UpnpSendActionSax\n");
+
+	HandleReadLock();
+	switch (GetHandleInfo(Hnd, &SInfo)) {
+	case HND_CLIENT:
+		break;
+	default:
+		HandleUnlock();
+		return UPNP_E_INVALID_HANDLE;
+	}
+	HandleUnlock();
+
+	if (ActionURL == NULL || ServiceType == NULL || Action == NULL ||
+	    Handler == NULL)
+		return UPNP_E_INVALID_PARAM;
+
+	retVal = SoapSendActionSax(ActionURL, ServiceType, Action, Handler,
+		(void *)Cookie);
+
+	UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__,
+		"Exiting UpnpSendActionSax\n");
+
+	return retVal;
+}
+
+
+/*!
+ * \brief Delivers the completion of an asynchronous action to the client
+ * and frees its parameters.
+ */
+static void UpnpActionComplete(
+	/*! [in] Result of the action. */
+	int ErrCode,
+	/*! [in] Response of the action, freed here. */
+	IXML_Document *ActionResult,
+	/*! [in] Parameters of the action, freed here. */
+	void *Cookie)
+{
+	struct UpnpNonblockParam *Param = (struct UpnpNonblockParam *)Cookie;
+	struct Upnp_Action_Complete Evt;
+
+	memset(&Evt, 0, sizeof(Evt));
+	Evt.ErrCode = ErrCode;
+	Evt.ActionRequest = Param->Act;
+	Evt.ActionResult = ActionResult;
+	strncpy(Evt.CtrlUrl, Param->Url, sizeof(Evt.CtrlUrl) - 1);
+	Param->Fun(UPNP_CONTROL_ACTION_COMPLETE, &Evt, Param->Cookie);
+	ixmlDocument_free(Evt.ActionRequest);
+	ixmlDocument_free(Evt.ActionResult);
+	ixmlDocument_free(Param->Header);
+	free(Param);
+}
+
+
+/*!
+ * \brief Delivers the completion of an asynchronous state variable query
+ * to the client and frees its parameters.
+ */
+static void UpnpVarComplete(
+	/*! [in] Result of the query. */
+	int ErrCode,
+	/*! [in] Value of the variable, freed here. */
+	DOMString CurrentVal,
+	/*! [in] Parameters of the query, freed here. */
+	void *Cookie)
+{
+	struct UpnpNonblockParam *Param = (struct UpnpNonblockParam *)Cookie;
+	struct Upnp_State_Var_Complete Evt;
+
+	memset(&Evt, 0, sizeof(Evt));
+	Evt.ErrCode = ErrCode;
+	Evt.CurrentVal = CurrentVal;
+	strncpy(Evt.StateVarName, Param->VarName,
+		sizeof(Evt.StateVarName) - 1);
+	strncpy(Evt.CtrlUrl, Param->Url, sizeof(Evt.CtrlUrl) - 1);
+	Param->Fun(UPNP_CONTROL_GET_VAR_COMPLETE, &Evt, Param->Cookie);
+	free(Evt.CurrentVal);
+	free(Param);
+}
+
+
+/*!
+ * \brief Sends an asynchronous action or state variable query.
+ *
+ * The request goes to the asynchronous HTTP client, so that no thread
+ * waits for the response. If the client cannot take it, a job of the send
+ * thread pool sends it as before.
+ */
+static void UpnpSendNonblock(
+	/*! [in] Parameters of the request, freed once it completes. */
+	struct UpnpNonblockParam *Param)
+{
+	ThreadPoolJob job;
+	int rc;
+
+	if (Param->FunName == ACTION)
+		rc = SoapSendActionAsync(Param->Url, Param->ServiceType,
+			Param->Header, Param->Act, UpnpActionComplete, Param);
+	else
+		rc = SoapGetServiceVarStatusAsync(Param->Url, Param->VarName,
+			UpnpVarComplete, Param);
+	if (rc == UPNP_E_SUCCESS)
+		return;
+
+	memset(&job, 0, sizeof(job));
+	TPJobInit(&job, (start_routine)UpnpThreadDistribution, Param);
+	TPJobSetFreeFunction(&job, (free_routine)free);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	if (ThreadPoolAdd(&gSendThreadPool, &job, NULL) != 0) {
+		free(Param);
+	}
+}
+
+
 int UpnpSendActionAsync(
 	UpnpClient_Handle Hnd,
 	const char *ActionURL_const,
@@ -2696,7 +3119,6 @@ int UpnpSendActionAsync(
 	const void *Cookie_const)
 {
     int rc;
-    ThreadPoolJob job;
     struct Handle_Info *SInfo = NULL;
     struct UpnpNonblockParam *Param;
     DOMString tmpStr;
@@ -2705,8 +3127,6 @@ int UpnpSendActionAsync(
     /* udn not used? */
     /*char *DevUDN = (char *)DevUDN_const;*/
 
-    memset(&job, 0, sizeof(job));
-
     if(UpnpSdkInit != 1) {
         return UPNP_E_FINISH;
     }
@@ -2766,13 +3186,7 @@ int UpnpSendActionAsync(
     Param->Cookie = ( void * )Cookie_const;
     Param->Fun = Fun;
 
-    TPJobInit( &job, ( start_routine ) UpnpThreadDistribution, Param );
-    TPJobSetFreeFunction( &job, ( free_routine ) free );
-
-    TPJobSetPriority( &job, MED_PRIORITY );
-    if (ThreadPoolAdd( &gSendThreadPool, &job, NULL ) != 0) {
-	free(Param);
-    }
+    UpnpSendNonblock( Param );
 
     UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__,
         "Exiting UpnpSendActionAsync \n");
@@ -2797,11 +3211,8 @@ int UpnpSendActionExAsync(
     DOMString headerStr = NULL;
     char *ActionURL = ( char * )ActionURL_const;
     char *ServiceType = ( char * )ServiceType_const;
-    ThreadPoolJob job;
     int retVal = 0;
 
-    memset(&job, 0, sizeof(job));
-
     if( UpnpSdkInit != 1 ) {
         return UPNP_E_FINISH;
     }
@@ -2888,13 +3299,7 @@ int UpnpSendActionExAsync(
     Param->Cookie = ( void * )Cookie_const;
     Param->Fun = Fun;
 
-    TPJobInit( &job, ( start_routine ) UpnpThreadDistribution, Param );
-    TPJobSetFreeFunction( &job, ( free_routine ) free );
-
-    TPJobSetPriority( &job, MED_PRIORITY );
-    if (ThreadPoolAdd( &gSendThreadPool, &job, NULL ) != 0) {
-	free(Param);
-    }
+    UpnpSendNonblock( Param );
 
     UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__,
         "Exiting UpnpSendActionAsync\n");
@@ -2910,14 +3315,11 @@ int UpnpGetServiceVarStatusAsync(
 	Upnp_FunPtr Fun,
 	const void *Cookie_const)
 {
-    ThreadPoolJob job;
     struct Handle_Info *SInfo = NULL;
     struct UpnpNonblockParam *Param;
     char *ActionURL = (char *)ActionURL_const;
     char *VarName = (char *)VarName_const;
 
-    memset(&job, 0, sizeof(job));
-
     if( UpnpSdkInit != 1 ) {
         return UPNP_E_FINISH;
     }
@@ -2956,14 +3358,7 @@ int UpnpGetServiceVarStatusAsync(
     Param->Fun = Fun;
     Param->Cookie = ( void * )Cookie_const;
 
-    TPJobInit( &job, ( start_routine ) UpnpThreadDistribution, Param );
-    TPJobSetFreeFunction( &job, ( free_routine ) free );
-
-    TPJobSetPriority( &job, MED_PRIORITY );
-
-    if (ThreadPoolAdd( &gSendThreadPool, &job, NULL ) != 0) {
-	free(Param);
-    }
+    UpnpSendNonblock( Param );
 
     UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__,
         "Exiting UpnpGetServiceVarStatusAsync\n");
@@ -3205,6 +3600,166 @@ int UpnpDownloadXmlDoc(const char *url, IXML_Document **xmlDoc)
 }
 
 
+#ifdef INCLUDE_CLIENT_APIS
+int UpnpDownloadXmlDocCached(
+	const char *url,
+	const char *usn,
+	int maxAge,
+	IXML_Document **xmlDoc)
+{
+	if (UpnpSdkInit != 1)
+		return UPNP_E_FINISH;
+	if (url == NULL || xmlDoc == NULL)
+		return UPNP_E_INVALID_PARAM;
+
+	return DescCacheDownload(url, usn, maxAge, xmlDoc);
+}
+
+
+int UpnpInvalidateXmlDocCache(const char *url, const char *usn)
+{
+	if (UpnpSdkInit != 1)
+		return UPNP_E_FINISH;
+	DescCacheInvalidate(url, usn);
+
+	return UPNP_E_SUCCESS;
+}
+
+
+int UpnpRegistry_Enable(UpnpClient_Handle Hnd, int Enable)
+{
+	struct Handle_Info *SInfo = NULL;
+
+	if (UpnpSdkInit != 1)
+		return UPNP_E_FINISH;
+
+	UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__,
+		"Inside UpnpRegistry_Enable\n");
+
+	HandleReadLock();
+	switch (GetHandleInfo(Hnd, &SInfo)) {
+	case HND_CLIENT:
+		break;
+	default:
+		HandleUnlock();
+		return UPNP_E_INVALID_HANDLE;
+	}
+	HandleUnlock();
+	RegistryEnable(Enable);
+
+	UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__,
+		"Exiting UpnpRegistry_Enable\n");
+
+	return UPNP_E_SUCCESS;
+}
+
+
+int UpnpRegistry_AddDescription(
+	const char *Location,
+	IXML_Document *DescDoc,
+	int Expires)
+{
+	if (UpnpSdkInit != 1)
+		return UPNP_E_FINISH;
+	if (Location == NULL || DescDoc == NULL)
+		return UPNP_E_INVALID_PARAM;
+
+	return RegistryAddDescription(Location, DescDoc, Expires);
+}
+
+
+int UpnpRegistry_RemoveDevice(const char *UDN)
+{
+	if (UpnpSdkInit != 1)
+		return UPNP_E_FINISH;
+	if (UDN == NULL)
+		return UPNP_E_INVALID_PARAM;
+
+	return RegistryRemoveDevice(UDN);
+}
+
+
+int UpnpRegistry_GetDevice(
+	const char *UDN,
+	struct Upnp_Registry_Device *Device)
+{
+	if (UpnpSdkInit != 1)
+		return UPNP_E_FINISH;
+	if (UDN == NULL || Device == NULL)
+		return UPNP_E_INVALID_PARAM;
+
+	return RegistryGetDevice(UDN, Device);
+}
+
+
+int UpnpRegistry_GetServiceByUSN(
+	const char *USN,
+	struct Upnp_Registry_Service *Service)
+{
+	if (UpnpSdkInit != 1)
+		return UPNP_E_FINISH;
+	if (USN == NULL || Service == NULL)
+		return UPNP_E_INVALID_PARAM;
+
+	return RegistryGetService(REGISTRY_BY_USN, USN, Service);
+}
+
+
+int UpnpRegistry_GetServiceBySid(
+	const char *Sid,
+	struct Upnp_Registry_Service *Service)
+{
+	if (UpnpSdkInit != 1)
+		return UPNP_E_FINISH;
+	if (Sid == NULL || Service == NULL)
+		return UPNP_E_INVALID_PARAM;
+
+	return RegistryGetService(REGISTRY_BY_SID, Sid, Service);
+}
+
+
+int UpnpRegistry_GetServiceByControlURL(
+	const char *ControlURL,
+	struct Upnp_Registry_Service *Service)
+{
+	if (UpnpSdkInit != 1)
+		return UPNP_E_FINISH;
+	if (ControlURL == NULL || Service == NULL)
+		return UPNP_E_INVALID_PARAM;
+
+	return RegistryGetService(REGISTRY_BY_CONTROL_URL, ControlURL,
+		Service);
+}
+
+
+int UpnpRegistry_ForEachDevice(
+	Upnp_RegistryDeviceVisitor Visitor,
+	void *Cookie)
+{
+	if (UpnpSdkInit != 1)
+		return UPNP_E_FINISH;
+	if (Visitor == NULL)
+		return UPNP_E_INVALID_PARAM;
+
+	return RegistryForEachDevice(Visitor, Cookie);
+}
+
+
+int UpnpRegistry_ForEachService(
+	const char *UDN,
+	Upnp_RegistryServiceVisitor Visitor,
+	void *Cookie)
+{
+	if (UpnpSdkInit != 1)
+		return UPNP_E_FINISH;
+	if (Visitor == NULL)
+		return UPNP_E_INVALID_PARAM;
+
+	return RegistryForEachService(UDN, Visitor, Cookie);
+}
+#endif /* INCLUDE_CLIENT_APIS */
+
+
 int UpnpGetIfInfo(const char *IfName)
 {
 #ifdef WIN32
@@ -3664,34 +4219,30 @@ void UpnpThreadDistribution(struct UpnpNonblockParam *Param)
 #endif /* EXCLUDE_GENA == 0 */
 #if EXCLUDE_SOAP == 0
 	case ACTION: {
-		struct Upnp_Action_Complete Evt;
-		memset(&Evt, 0, sizeof(Evt));
-		Evt.ActionResult = NULL;
-		Evt.ErrCode = SoapSendAction(
-			Param->Url,
-			Param->ServiceType,
-			Param->Act, &Evt.ActionResult);
-		Evt.ActionRequest = Param->Act;
-		strncpy(Evt.CtrlUrl, Param->Url, sizeof(Evt.CtrlUrl) - 1);
-		Param->Fun(UPNP_CONTROL_ACTION_COMPLETE, &Evt, Param->Cookie);
-		ixmlDocument_free(Evt.ActionRequest);
-		ixmlDocument_free(Evt.ActionResult);
-		free(Param);
+		IXML_Document *ActionResult = NULL;
+		int ErrCode;
+		if (Param->Header != NULL)
+			ErrCode = SoapSendActionEx(
+				Param->Url,
+				Param->ServiceType,
+				Param->Header,
+				Param->Act, &ActionResult);
+		else
+			ErrCode = SoapSendAction(
+				Param->Url,
+				Param->ServiceType,
+				Param->Act, &ActionResult);
+		UpnpActionComplete(ErrCode, ActionResult, Param);
 		break;
 	}
 	case STATUS: {
-		struct Upnp_State_Var_Complete Evt;
-		memset(&Evt, 0, sizeof(Evt));
-		Evt.ErrCode = SoapGetServiceVarStatus(
+		DOMString CurrentVal = NULL;
+		int ErrCode;
+		ErrCode = SoapGetServiceVarStatus(
 			Param->Url,
 			Param->VarName,
-			&Evt.CurrentVal);
-		strncpy(Evt.StateVarName, Param->VarName,
-			sizeof(Evt.StateVarName) - 1);
-		strncpy(Evt.CtrlUrl, Param->Url, sizeof(Evt.CtrlUrl) - 1);
-		Param->Fun(UPNP_CONTROL_GET_VAR_COMPLETE, &Evt, Param->Cookie);
-		free(Evt.CurrentVal);
-		free(Param);
+			&CurrentVal);
+		UpnpVarComplete(ErrCode, CurrentVal, Param);
 		break;
 	}
 #endif /* EXCLUDE_SOAP == 0 */
@@ -47,11 +47,14 @@
 #include "httpparser.h"
 #include "httpreadwrite.h"
 #include "parsetools.h"
+#include "registry.h"
 #include "statcodes.h"
 #include "sysdep.h"
 #include "uuid.h"
 #include "upnpapi.h"
 
+#include <limits.h>
+
 #ifdef WIN32
 	#define snprintf _snprintf
 #endif
@@ -429,13 +432,13 @@ int genaUnregisterClient(UpnpClient_Handle client_handle)
 			return_code = GENA_E_BAD_HANDLE;
 			goto exit_function;
 		}
-		if (handle_info->ClientSubList == NULL) {
+		if (handle_info->ClientSubs.head == NULL) {
 			return_code = UPNP_E_SUCCESS;
 			break;
 		}
-		UpnpClientSubscription_assign(sub_copy, handle_info->ClientSubList);
+		UpnpClientSubscription_assign(sub_copy, handle_info->ClientSubs.head);
 		RemoveClientSubClientSID(
-			&handle_info->ClientSubList,
+			&handle_info->ClientSubs,
 			UpnpClientSubscription_get_SID(sub_copy));
 
 		HandleUnlock();
@@ -450,7 +453,7 @@ int genaUnregisterClient(UpnpClient_Handle client_handle)
 		free_client_subscription(sub_copy);
 	}
 
-	freeClientSubList(handle_info->ClientSubList);
+	ClientSubTableDestroy(&handle_info->ClientSubs);
 	HandleUnlock();
 
 exit_function:
@@ -477,7 +480,7 @@ int genaUnSubscribe(
 		return_code = GENA_E_BAD_HANDLE;
 		goto exit_function;
 	}
-	sub = GetClientSubClientSID(handle_info->ClientSubList, in_sid);
+	sub = GetClientSubClientSID(&handle_info->ClientSubs, in_sid);
 	if (sub == NULL) {
 		HandleUnlock();
 		return_code = GENA_E_BAD_SID;
@@ -501,7 +504,7 @@ int genaUnSubscribe(
 		return_code = GENA_E_BAD_HANDLE;
 		goto exit_function;
 	}
-	RemoveClientSubClientSID(&handle_info->ClientSubList, in_sid);
+	RemoveClientSubClientSID(&handle_info->ClientSubs, in_sid);
 	HandleUnlock();
 
 exit_function:
@@ -582,11 +585,20 @@ int genaSubscribe(
 	UpnpClientSubscription_set_SID(newSubscription, out_sid);
 	UpnpClientSubscription_set_ActualSID(newSubscription, ActualSID);
 	UpnpClientSubscription_set_EventURL(newSubscription, EventURL);
-	UpnpClientSubscription_set_Next(newSubscription, handle_info->ClientSubList);
-	handle_info->ClientSubList = newSubscription;
+	return_code = AddClientSub(&handle_info->ClientSubs, newSubscription);
+	if (return_code != UPNP_E_SUCCESS)
+		goto error_handler;
 
 	/* schedule expiration event */
 	return_code = ScheduleGenaAutoRenew(client_handle, *TimeOut, newSubscription);
+	if (return_code != UPNP_E_SUCCESS) {
+		/* the table frees it */
+		RemoveClientSubClientSID(&handle_info->ClientSubs, out_sid);
+		newSubscription = NULL;
+	} else {
+		RegistrySetSubscription(UpnpString_get_String(PublisherURL),
+			UpnpString_get_String(out_sid));
+	}
 
 error_handler:
 	UpnpString_delete(ActualSID);
@@ -623,7 +635,7 @@ int genaRenewSubscription(
 		goto exit_function;
 	}
 
-	sub = GetClientSubClientSID(handle_info->ClientSubList, in_sid);
+	sub = GetClientSubClientSID(&handle_info->ClientSubs, in_sid);
 	if (sub == NULL) {
 		HandleUnlock();
 
@@ -664,14 +676,14 @@ int genaRenewSubscription(
 	/*GetHandleInfo(client_handle, &handle_info); */
 	if (return_code != UPNP_E_SUCCESS) {
 		/* network failure (remove client sub) */
-		RemoveClientSubClientSID(&handle_info->ClientSubList, in_sid);
+		RemoveClientSubClientSID(&handle_info->ClientSubs, in_sid);
 		free_client_subscription(sub_copy);
 		HandleUnlock();
 		goto exit_function;
 	}
 
 	/* get subscription */
-	sub = GetClientSubClientSID(handle_info->ClientSubList, in_sid);
+	sub = GetClientSubClientSID(&handle_info->ClientSubs, in_sid);
 	if (sub == NULL) {
 		free_client_subscription(sub_copy);
 		HandleUnlock();
@@ -680,13 +692,19 @@ int genaRenewSubscription(
 	}
 
 	/* store actual sid */
-	UpnpClientSubscription_set_ActualSID(sub, ActualSID);
+	return_code = SetClientSubActualSID(&handle_info->ClientSubs, sub, ActualSID);
+	if (return_code != UPNP_E_SUCCESS) {
+		RemoveClientSubClientSID(&handle_info->ClientSubs, in_sid);
+		free_client_subscription(sub_copy);
+		HandleUnlock();
+		goto exit_function;
+	}
 
 	/* start renew subscription timer */
 	return_code = ScheduleGenaAutoRenew(client_handle, *TimeOut, sub);
 	if (return_code != GENA_SUCCESS) {
 		RemoveClientSubClientSID(
-			&handle_info->ClientSubList,
+			&handle_info->ClientSubs,
 			UpnpClientSubscription_get_SID(sub));
 	}
 	free_client_subscription(sub_copy);
@@ -699,11 +717,553 @@ exit_function:
 }
 
 
+/*!
+ * \brief Event, or gap, waiting in the sequencer of a subscription.
+ */
+typedef struct s_ClientSeqItem {
+	/*! SEQ of the event, or of the first missing event of a gap. */
+	int eventKey;
+	/*! Number of missing events of a gap, 0 for an event. */
+	int missing;
+	/*! Property set of the event, parsed into a DOM document. */
+	IXML_Document *changedVars;
+	/*! Body of the event, streamed to the SAX callbacks when the event is
+	 * delivered. */
+	char *body;
+	struct s_ClientSeqItem *next;
+} ClientSeqItem;
+
+
+/*!
+ * \brief Sequencer of the events of a subscription.
+ *
+ * The events are delivered in SEQ order by one thread at a time, the lane
+ * of the subscription: the thread that made an event ready delivers the
+ * ready events, unless another thread already does. All the fields are
+ * protected by HandleLock.
+ */
+struct s_ClientEventSeq {
+	/*! SID of the subscription given to the application. */
+	Upnp_SID sid;
+	/*! SEQ of the next event to deliver. */
+	int nextKey;
+	/*! Events received before nextKey, by SEQ. */
+	ClientSeqItem *held;
+	/*! Number of held events. */
+	int heldCount;
+	/*! Events and gaps ready to be delivered, in order. */
+	ClientSeqItem *readyHead;
+	/*! Last ready item. */
+	ClientSeqItem *readyTail;
+	/*! Time the missing events were first waited for, in ms. */
+	int64_t waitSince;
+	/*! TRUE while a timer is set to give up the missing events. */
+	int timerSet;
+	/*! TRUE while a thread delivers the ready items. */
+	int delivering;
+	/*! TRUE once the subscription is gone while a thread delivers, the
+	 * thread then frees the sequencer. */
+	int deleted;
+};
+
+
+/*!
+ * \brief Returns the SEQ following another, the device wraps to 1 after
+ * the largest SEQ.
+ */
+static int SeqNextKey(
+	/*! [in] SEQ. */
+	int key)
+{
+	return key == INT_MAX ? 1 : key + 1;
+}
+
+
+/*!
+ * \brief Computes the number of SEQ from one to another.
+ *
+ * \return The distance, or -1 if \b to comes before \b from.
+ */
+static int SeqDistance(
+	/*! [in] First SEQ. */
+	int from,
+	/*! [in] Second SEQ. */
+	int to)
+{
+	int d;
+
+	if (to >= from)
+		d = to - from;
+	else if (to > 0)
+		/* wrapped */
+		d = INT_MAX - from + to;
+	else
+		return -1;
+
+	return d > INT_MAX / 2 ? -1 : d;
+}
+
+
+/*!
+ * \brief Frees an item of a sequencer.
+ */
+static void FreeSeqItem(
+	/*! [in] Item. */
+	ClientSeqItem *item)
+{
+	ixmlDocument_free(item->changedVars);
+	free(item->body);
+	free(item);
+}
+
+
+/*!
+ * \brief Frees a list of items of a sequencer.
+ */
+static void FreeSeqItems(
+	/*! [in] First item of the list. */
+	ClientSeqItem *item)
+{
+	ClientSeqItem *next;
+
+	while (item != NULL) {
+		next = item->next;
+		FreeSeqItem(item);
+		item = next;
+	}
+}
+
+
+void ClientEventSeq_delete(ClientEventSeq *s)
+{
+	FreeSeqItems(s->held);
+	s->held = NULL;
+	s->heldCount = 0;
+	FreeSeqItems(s->readyHead);
+	s->readyHead = NULL;
+	s->readyTail = NULL;
+	if (s->delivering)
+		s->deleted = TRUE;
+	else
+		free(s);
+}
+
+
+/*!
+ * \brief Appends an item to the ready items of a sequencer.
+ */
+static void SeqPushReady(
+	/*! [in] Sequencer. */
+	ClientEventSeq *seq,
+	/*! [in] Item. */
+	ClientSeqItem *item)
+{
+	item->next = NULL;
+	if (seq->readyTail == NULL)
+		seq->readyHead = item;
+	else
+		seq->readyTail->next = item;
+	seq->readyTail = item;
+}
+
+
+/*!
+ * \brief Makes the held events that follow the delivered ones ready.
+ */
+static void SeqAdvance(
+	/*! [in] Sequencer. */
+	ClientEventSeq *seq)
+{
+	ClientSeqItem *item;
+
+	while ((item = seq->held) != NULL && item->eventKey == seq->nextKey) {
+		seq->held = item->next;
+		seq->heldCount--;
+		SeqPushReady(seq, item);
+		seq->nextKey = SeqNextKey(item->eventKey);
+	}
+}
+
+
+/*!
+ * \brief Gives up the events missing before the first held event.
+ *
+ * \return UPNP_E_SUCCESS, or UPNP_E_OUTOF_MEMORY if the gap could not be
+ * 	reported; the missing events are given up in both cases.
+ */
+static int SeqSkipGap(
+	/*! [in] Sequencer. */
+	ClientEventSeq *seq)
+{
+	ClientSeqItem *gap;
+	int ret = UPNP_E_SUCCESS;
+
+	gap = (ClientSeqItem *)calloc(1, sizeof (ClientSeqItem));
+	if (gap != NULL) {
+		gap->eventKey = seq->nextKey;
+		gap->missing = SeqDistance(seq->nextKey, seq->held->eventKey);
+		SeqPushReady(seq, gap);
+	} else
+		ret = UPNP_E_OUTOF_MEMORY;
+	UpnpPrintf(UPNP_INFO, GENA, __FILE__, __LINE__,
+		"Events %d to %d of SID %s are missing\n",
+		seq->nextKey, seq->held->eventKey - 1, seq->sid);
+	seq->nextKey = seq->held->eventKey;
+	SeqAdvance(seq);
+
+	return ret;
+}
+
+
+/*!
+ * \brief Timer job giving up the missing events of a subscription.
+ */
+static void GenaSeqTimeout(void *input);
+
+
+/*!
+ * \brief Sets the timer giving up the missing events of a subscription, if
+ * some are missing.
+ */
+static void SeqScheduleTimeout(
+	/*! [in] Sequencer. */
+	ClientEventSeq *seq,
+	/*! [in] Time the missing events are waited for, in ms. */
+	int timeout,
+	/*! [in] Current time, in ms. */
+	int64_t now)
+{
+	ThreadPoolJob job;
+	char *sid;
+	int64_t wait;
+
+	if (seq->held == NULL || seq->timerSet)
+		return;
+	sid = strdup(seq->sid);
+	if (sid == NULL)
+		/* given up when the window is full */
+		return;
+	wait = seq->waitSince + timeout - now;
+	memset(&job, 0, sizeof(job));
+	TPJobInit(&job, (start_routine)GenaSeqTimeout, sid);
+	TPJobSetFreeFunction(&job, (free_routine)free);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	if (TimerThreadSchedule(&gTimerThread, wait > 0 ? (time_t)wait : 0,
+		REL_MSEC, &job, SHORT_TERM, NULL) != 0) {
+		free(sid);
+		return;
+	}
+	seq->timerSet = TRUE;
+}
+
+
+/*!
+ * \brief Delivers a ready item of a sequencer to the application.
+ */
+static void SeqDeliverItem(
+	/*! [in] SID of the subscription. */
+	const char *sid,
+	/*! [in] Item. */
+	ClientSeqItem *item,
+	/*! [in] Callback of the control point. */
+	Upnp_FunPtr callback,
+	/*! [in] Cookie of the callback. */
+	void *cookie,
+	/*! [in] SAX callbacks, NULL if the events are parsed into DOM
+	 * documents. */
+	IXML_SaxHandler *sax_handler,
+	/*! [in] Cookie of the SAX callbacks. */
+	void *sax_cookie)
+{
+	struct Upnp_Event event_struct;
+	struct Upnp_Event_Gap gap_struct;
+	struct Upnp_Event_Sax sax_event;
+
+	if (item->missing > 0) {
+		memset(&gap_struct, 0, sizeof(gap_struct));
+		strncpy(gap_struct.Sid, sid, sizeof(gap_struct.Sid) - 1);
+		gap_struct.EventKey = item->eventKey;
+		gap_struct.Missing = item->missing;
+		callback(UPNP_EVENT_SEQUENCE_GAP, &gap_struct, cookie);
+		return;
+	}
+	memset(event_struct.Sid, 0, sizeof(event_struct.Sid));
+	strncpy(event_struct.Sid, sid, sizeof(event_struct.Sid) - 1);
+	event_struct.EventKey = item->eventKey;
+	if (item->body != NULL) {
+		if (sax_handler != NULL) {
+			sax_event.Sid = event_struct.Sid;
+			sax_event.EventKey = item->eventKey;
+			sax_event.Cookie = sax_cookie;
+			if (ixmlSaxParse(item->body, sax_handler,
+					 &sax_event) != IXML_SUCCESS) {
+				UpnpPrintf(UPNP_INFO, GENA, __FILE__, __LINE__,
+					"Event %d of SID %s is not well formed\n",
+					item->eventKey, sid);
+				return;
+			}
+		} else if (ixmlParseBufferArenaEx(item->body,
+			&item->changedVars) != IXML_SUCCESS) {
+			UpnpPrintf(UPNP_INFO, GENA, __FILE__, __LINE__,
+				"Event %d of SID %s is not well formed\n",
+				item->eventKey, sid);
+			return;
+		}
+	}
+	event_struct.ChangedVariables = item->changedVars;
+	callback(UPNP_EVENT_RECEIVED, &event_struct, cookie);
+}
+
+
+/*!
+ * \brief Delivers the ready items of a sequencer, until there is none.
+ *
+ * The calling thread must have set delivering. The sequencer is freed if
+ * the subscription went away meanwhile.
+ *
+ * Must be called with HandleLock held, returns with HandleLock held.
+ */
+static void SeqDeliver(
+	/*! [in] Sequencer. */
+	ClientEventSeq *seq)
+{
+	ClientSeqItem *item;
+	struct Handle_Info *handle_info;
+	UpnpClient_Handle client_handle;
+	Upnp_FunPtr callback;
+	void *cookie;
+	IXML_SaxHandler sax_handler;
+	void *sax_cookie;
+	int use_sax;
+
+	while (!seq->deleted && (item = seq->readyHead) != NULL) {
+		seq->readyHead = item->next;
+		if (seq->readyHead == NULL)
+			seq->readyTail = NULL;
+		if (GetClientHandleInfo(&client_handle, &handle_info) !=
+		    HND_CLIENT) {
+			FreeSeqItem(item);
+			continue;
+		}
+		callback = handle_info->Callback;
+		cookie = handle_info->Cookie;
+		use_sax = handle_info->EventSaxEnabled;
+		sax_handler = handle_info->EventSaxHandler;
+		sax_cookie = handle_info->EventSaxCookie;
+		HandleUnlock();
+
+		/* the sequencer stays allocated while delivering is set */
+		SeqDeliverItem(seq->sid, item, callback, cookie,
+			use_sax ? &sax_handler : NULL, sax_cookie);
+		FreeSeqItem(item);
+
+		HandleLock();
+	}
+	seq->delivering = FALSE;
+	if (seq->deleted)
+		free(seq);
+}
+
+
+/*!
+ * \brief Takes the delivery of the ready items of a sequencer, unless
+ * another thread has it.
+ *
+ * Must be called with HandleLock held.
+ *
+ * \return TRUE if the calling thread must call SeqDeliver().
+ */
+static int SeqClaimLane(
+	/*! [in] Sequencer. */
+	ClientEventSeq *seq)
+{
+	if (seq->delivering || seq->readyHead == NULL)
+		return FALSE;
+	seq->delivering = TRUE;
+
+	return TRUE;
+}
+
+
+/*!
+ * \brief Updates the time the missing events of a sequencer are waited
+ * for, after its next SEQ was changed.
+ */
+static void SeqUpdateWait(
+	/*! [in] Sequencer. */
+	ClientEventSeq *seq,
+	/*! [in] Next SEQ before the change. */
+	int prevKey,
+	/*! [in] Current time, in ms. */
+	int64_t now)
+{
+	if (seq->held == NULL)
+		seq->waitSince = 0;
+	else if (seq->waitSince == 0 || seq->nextKey != prevKey)
+		seq->waitSince = now;
+}
+
+
+static void GenaSeqTimeout(void *input)
+{
+	char *sid = (char *)input;
+	UpnpString *tmpSID;
+	ClientSubscription *sub;
+	ClientEventSeq *seq = NULL;
+	struct Handle_Info *handle_info;
+	UpnpClient_Handle client_handle;
+	int64_t now = imillinow();
+	int prevKey;
+
+	tmpSID = UpnpString_new();
+	if (tmpSID == NULL) {
+		free(sid);
+		return;
+	}
+	UpnpString_set_String(tmpSID, sid);
+	HandleLock();
+	if (GetClientHandleInfo(&client_handle, &handle_info) == HND_CLIENT) {
+		sub = GetClientSubClientSID(&handle_info->ClientSubs, tmpSID);
+		if (sub != NULL)
+			seq = UpnpClientSubscription_get_EventSeq(sub);
+	}
+	if (seq != NULL) {
+		seq->timerSet = FALSE;
+		/* the timer may fire a little early, it is then set again */
+		if (seq->held != NULL &&
+		    now - seq->waitSince >= handle_info->EventSeqTimeout) {
+			prevKey = seq->nextKey;
+			SeqSkipGap(seq);
+			SeqUpdateWait(seq, prevKey, now);
+		}
+		SeqScheduleTimeout(seq, handle_info->EventSeqTimeout, now);
+		if (SeqClaimLane(seq))
+			SeqDeliver(seq);
+	}
+	HandleUnlock();
+	UpnpString_delete(tmpSID);
+	free(sid);
+}
+
+
+/*!
+ * \brief Queues a received event in the sequencer of its subscription.
+ *
+ * \return GENA_SUCCESS if the event is owned by the sequencer, otherwise
+ * 	the appropriate error code.
+ */
+static int SeqQueueEvent(
+	/*! [in] Actual SID of the subscription. */
+	token *sid,
+	/*! [in] SEQ of the event. */
+	int eventKey,
+	/*! [in] Property set of the event, or NULL. */
+	IXML_Document *changedVars,
+	/*! [in] Body of the event to stream to the SAX callbacks, or NULL. */
+	char *body,
+	/*! [out] The sequencer if the calling thread must call SeqDeliver()
+	 * with HandleLock held, otherwise NULL. */
+	ClientEventSeq **lane)
+{
+	struct Handle_Info *handle_info;
+	UpnpClient_Handle client_handle;
+	ClientSubscription *sub;
+	ClientEventSeq *seq;
+	ClientSeqItem *item;
+	ClientSeqItem **link;
+	int64_t now = imillinow();
+	int prevKey;
+	int d;
+
+	*lane = NULL;
+	item = (ClientSeqItem *)malloc(sizeof (ClientSeqItem));
+	if (item == NULL)
+		return UPNP_E_OUTOF_MEMORY;
+	item->eventKey = eventKey;
+	item->missing = 0;
+	item->changedVars = changedVars;
+	item->body = body;
+	item->next = NULL;
+
+	HandleLock();
+	if (GetClientHandleInfo(&client_handle, &handle_info) != HND_CLIENT ||
+	    (sub = GetClientSubActualSID(&handle_info->ClientSubs, sid)) == NULL) {
+		HandleUnlock();
+		free(item);
+		return GENA_E_BAD_SID;
+	}
+	seq = UpnpClientSubscription_get_EventSeq(sub);
+	if (seq == NULL) {
+		seq = (ClientEventSeq *)calloc(1, sizeof (ClientEventSeq));
+		if (seq == NULL) {
+			HandleUnlock();
+			free(item);
+			return UPNP_E_OUTOF_MEMORY;
+		}
+		strncpy(seq->sid,
+			UpnpString_get_String(UpnpClientSubscription_get_SID(sub)),
+			sizeof(seq->sid) - 1);
+		UpnpClientSubscription_set_EventSeq(sub, seq);
+	}
+
+	prevKey = seq->nextKey;
+	if (eventKey == 0 && seq->nextKey != 0) {
+		/* the device restarted the sequence */
+		while (seq->held != NULL)
+			SeqSkipGap(seq);
+		seq->nextKey = 0;
+	}
+	d = SeqDistance(seq->nextKey, eventKey);
+	if (d < 0) {
+		UpnpPrintf(UPNP_INFO, GENA, __FILE__, __LINE__,
+			"Event %d of SID %s arrived too late, dropped\n",
+			eventKey, seq->sid);
+		FreeSeqItem(item);
+	} else if (d == 0) {
+		SeqPushReady(seq, item);
+		seq->nextKey = SeqNextKey(eventKey);
+		SeqAdvance(seq);
+	} else {
+		/* hold the event until the missing ones arrive */
+		link = &seq->held;
+		while (*link != NULL &&
+		       SeqDistance((*link)->eventKey, eventKey) > 0)
+			link = &(*link)->next;
+		if (*link != NULL && (*link)->eventKey == eventKey) {
+			UpnpPrintf(UPNP_INFO, GENA, __FILE__, __LINE__,
+				"Event %d of SID %s received twice, dropped\n",
+				eventKey, seq->sid);
+			FreeSeqItem(item);
+		} else {
+			item->next = *link;
+			*link = item;
+			seq->heldCount++;
+		}
+		while (seq->heldCount > handle_info->EventSeqWindow)
+			SeqSkipGap(seq);
+	}
+	SeqUpdateWait(seq, prevKey, now);
+	SeqScheduleTimeout(seq, handle_info->EventSeqTimeout, now);
+	if (SeqClaimLane(seq))
+		*lane = seq;
+	HandleUnlock();
+
+	return GENA_SUCCESS;
+}
+
+
 void gena_process_notification_event(
 	SOCKINFO *info,
 	http_message_t *event)
 {
 	struct Upnp_Event event_struct;
+	struct Upnp_Event_Sax sax_event;
+	IXML_SaxHandler sax_handler;
+	int use_sax;
+	int sequenced;
+	ClientEventSeq *lane;
+	char *body = NULL;
+	int ret;
 	IXML_Document *ChangedVars = NULL;
 	int eventKey;
 	token sid;
@@ -748,10 +1308,9 @@ void gena_process_notification_event(
 		goto exit_function;
 	}
 
-	/* parse the content (should be XML) */
-	if (!has_xml_content_type(event) ||
-	    event->msg.length == 0 ||
-	    ixmlParseBufferEx(event->entity.buf, &ChangedVars) != IXML_SUCCESS) {
+	/* the content should be XML; it is parsed once the subscription is
+	 * found */
+	if (!has_xml_content_type(event) || event->msg.length == 0) {
 		error_respond(info, HTTP_BAD_REQUEST, event);
 		goto exit_function;
 	}
@@ -766,7 +1325,7 @@ void gena_process_notification_event(
 	}
 
 	/* get subscription based on SID */
-	subscription = GetClientSubActualSID(handle_info->ClientSubList, &sid);
+	subscription = GetClientSubActualSID(&handle_info->ClientSubs, &sid);
 	if (subscription == NULL) {
 		if (eventKey == 0) {
 			/* wait until we've finished processing a subscription  */
@@ -789,7 +1348,7 @@ void gena_process_notification_event(
 				goto exit_function;
 			}
 
-			subscription = GetClientSubActualSID(handle_info->ClientSubList, &sid);
+			subscription = GetClientSubActualSID(&handle_info->ClientSubs, &sid);
 			if (subscription == NULL) {
 				error_respond( info, HTTP_PRECONDITION_FAILED, event );
 				SubscribeUnlock();
@@ -805,23 +1364,75 @@ void gena_process_notification_event(
 		}
 	}
 
-	/* success */
-	error_respond(info, HTTP_OK, event);
-
 	/* fill event struct */
 	tmpSID = UpnpClientSubscription_get_SID(subscription);
 	memset(event_struct.Sid, 0, sizeof(event_struct.Sid));
 	strncpy(event_struct.Sid, UpnpString_get_String(tmpSID),
 		sizeof(event_struct.Sid) - 1);
 	event_struct.EventKey = eventKey;
-	event_struct.ChangedVariables = ChangedVars;
 
 	/* copy callback */
 	callback = handle_info->Callback;
 	cookie = handle_info->Cookie;
+	use_sax = handle_info->EventSaxEnabled;
+	if (use_sax) {
+		sax_handler = handle_info->EventSaxHandler;
+		sax_event.Cookie = handle_info->EventSaxCookie;
+	}
+	/* a sequencer is kept until its held events are delivered */
+	sequenced = handle_info->EventSeqWindow > 0 ||
+		UpnpClientSubscription_get_EventSeq(subscription) != NULL;
 
 	HandleUnlock();
 
+	/* parse the content; a sequenced event is streamed to the SAX
+	 * callbacks when it is delivered */
+	if (use_sax && sequenced) {
+		body = (char *)malloc(event->entity.length + (size_t)1);
+		if (body == NULL) {
+			error_respond(info, HTTP_INTERNAL_SERVER_ERROR, event);
+			goto exit_function;
+		}
+		memcpy(body, event->entity.buf, event->entity.length);
+		body[event->entity.length] = '\0';
+	} else if (use_sax) {
+		sax_event.Sid = event_struct.Sid;
+		sax_event.EventKey = eventKey;
+		if (ixmlSaxParse(event->entity.buf, &sax_handler,
+				 &sax_event) != IXML_SUCCESS) {
+			error_respond(info, HTTP_BAD_REQUEST, event);
+			goto exit_function;
+		}
+	} else if (ixmlParseBufferArenaEx(event->entity.buf,
+					  &ChangedVars) != IXML_SUCCESS) {
+		error_respond(info, HTTP_BAD_REQUEST, event);
+		goto exit_function;
+	}
+	event_struct.ChangedVariables = ChangedVars;
+
+	if (sequenced) {
+		ret = SeqQueueEvent(&sid, eventKey, ChangedVars, body, &lane);
+		if (ret != GENA_SUCCESS) {
+			error_respond(info, ret == GENA_E_BAD_SID ?
+				HTTP_PRECONDITION_FAILED :
+				HTTP_INTERNAL_SERVER_ERROR, event);
+			goto exit_function;
+		}
+		/* owned by the sequencer */
+		ChangedVars = NULL;
+		body = NULL;
+		error_respond(info, HTTP_OK, event);
+		if (lane != NULL) {
+			HandleLock();
+			SeqDeliver(lane);
+			HandleUnlock();
+		}
+		goto exit_function;
+	}
+
+	/* success */
+	error_respond(info, HTTP_OK, event);
+
 	/* make callback with event struct */
 	/* In future, should find a way of mainting */
 	/* that the handle is not unregistered in the middle of a */
@@ -830,6 +1441,7 @@ void gena_process_notification_event(
 
 exit_function:
 	ixmlDocument_free(ChangedVars);
+	free(body);
 }
 
 
@@ -54,6 +54,17 @@
 	#define snprintf _snprintf
 #endif
 
+/*! Subscriptions with queued events waiting for a sender, oldest first.
+ * Protected by HandleLock. */
+static notify_thread_struct *gNotifyReadyHead = NULL;
+/*! Last subscription of the ready list. */
+static notify_thread_struct *gNotifyReadyTail = NULL;
+/*! Number of sender jobs added to gSendThreadPool and not yet finished,
+ * protected by HandleLock. */
+static int gNotifySenders = 0;
+
+static void free_notify_struct(notify_thread_struct *input);
+
 /*!
  * \brief Unregisters a device.
  *
@@ -65,6 +76,8 @@ int genaUnregisterDevice(
 {
 	int ret = 0;
 	struct Handle_Info *handle_info;
+	notify_thread_struct **link;
+	notify_thread_struct *in;
 
 	HandleLock();
 	if (GetHandleInfo(device_handle, &handle_info) != HND_DEVICE) {
@@ -74,6 +87,19 @@ int genaUnregisterDevice(
 		ret = GENA_E_BAD_HANDLE;
 	} else {
 		freeServiceTable(&handle_info->ServiceTable);
+		/* the ready list is left without senders when the thread
+		 * pool shuts down */
+		link = &gNotifyReadyHead;
+		gNotifyReadyTail = NULL;
+		while ((in = *link) != NULL) {
+			if (in->device_handle == device_handle) {
+				*link = in->next;
+				free_notify_struct(in);
+			} else {
+				gNotifyReadyTail = in;
+				link = &in->next;
+			}
+		}
 		ret = UPNP_E_SUCCESS;
 	}
 	HandleUnlock();
@@ -138,27 +164,40 @@ static int GeneratePropertySet(
 }
 
 /*!
- * \brief Frees memory used in notify_threads if the reference count is 0,
- * otherwise decrements the refrence count.
+ * \brief Frees a sender job.
  */
 static void free_notify_struct(
 	/*! [in] Notify structure. */
 	notify_thread_struct *input)
 {
-	(*input->reference_count)--;
-	if (*input->reference_count == 0) {
-		free(input->headers);
-		ixmlFreeDOMString(input->propertySet);
-		free(input->servId);
-		free(input->UDN);
-		free(input->reference_count);
-	}
+	sock_destroy(&input->conn, SD_BOTH);
+	free(input->servId);
+	free(input->UDN);
 	free(input);
 }
 
+/*!
+ * \brief Gives the connection kept by a sender job back to the pool.
+ */
+static void ReleaseNotifyConnection(
+	/*! [in] Sender job. */
+	notify_thread_struct *in)
+{
+	if (in->conn.socket == INVALID_SOCKET)
+		return;
+	http_ConnPoolRelease(&in->connPeer, in->conn.socket);
+	in->conn.socket = INVALID_SOCKET;
+}
+
 /*!
  * \brief Sends the notify message and returns a reply.
  *
+ * The connection kept from the previous event, or else an idle one of the
+ * pool, is used if there is one, and the connection is kept for the next
+ * event when the answer allows it. The event is sent again on a new
+ * connection only if the reused one was closed or reset by the control
+ * point before any answer.
+ *
  * \return on success returns UPNP_E_SUCCESS, otherwise returns a UPNP error.
  *
  * \note called by genaNotify
@@ -171,67 +210,82 @@ static UPNP_INLINE int notify_send_and_recv(
 	/*! [in] The evented XML. */
 	char *propertySet,
 	/*! [out] The response from the control point. */
-	http_parser_t *response)
+	http_parser_t *response,
+	/*! [in,out] Connection to destination_url kept from the previous
+	 * event, its socket is INVALID_SOCKET if there is none. */
+	SOCKINFO *conn)
 {
 	uri_type url;
-	SOCKET conn_fd;
 	membuffer start_msg;
 	int ret_code;
 	int err_code;
 	int timeout;
-	SOCKINFO info;
+	int reused = conn->socket != INVALID_SOCKET;
+	int attempt;
 	const char *CRLF = "\r\n";
 
-	/* connect */
 	UpnpPrintf(UPNP_ALL, GENA, __FILE__, __LINE__,
 		"gena notify to: %.*s\n",
 		(int)destination_url->hostport.text.size,
 		destination_url->hostport.text.buff);
 
-	conn_fd = http_Connect(destination_url, &url);
-	if (conn_fd < 0)
-		/* return UPNP error */
-		return UPNP_E_SOCKET_CONNECT;
-	ret_code = sock_init(&info, conn_fd);
-	if (ret_code) {
-		sock_destroy(&info, SD_BOTH);
-		return ret_code;
-	}
-	/* make start line and HOST header */
+	if (http_FixUrl(destination_url, &url) != UPNP_E_SUCCESS)
+		return UPNP_E_INVALID_URL;
+	/* make start line and HOST header, followed by the body so that the
+	 * request goes out in one write (note: end of notification will
+	 * contain "\r\n" twice) */
 	membuffer_init(&start_msg);
 	if (http_MakeMessage(
 			&start_msg, 1, 1,
 			"q" "s",
 			HTTPMETHOD_NOTIFY, &url,
-			mid_msg->buf) != 0) {
+			mid_msg->buf) != 0 ||
+	    membuffer_append_str(&start_msg, propertySet) != 0 ||
+	    membuffer_append_str(&start_msg, CRLF) != 0) {
 		membuffer_destroy(&start_msg);
-		sock_destroy(&info, SD_BOTH);
 		return UPNP_E_OUTOF_MEMORY;
 	}
-	timeout = GENA_NOTIFICATION_SENDING_TIMEOUT;
-	/* send msg (note: end of notification will contain "\r\n" twice) */
-	ret_code = http_SendMessage(&info, &timeout,
-		"bbb",
-		start_msg.buf, start_msg.length,
-		propertySet, strlen(propertySet),
-		CRLF, strlen(CRLF));
-	if (ret_code) {
-		membuffer_destroy(&start_msg);
-		sock_destroy(&info, SD_BOTH);
-		return ret_code;
+	for (attempt = 0; attempt < 2; attempt++) {
+		if (conn->socket == INVALID_SOCKET) {
+			/* connect, a retry always uses a new connection */
+			ret_code = http_ConnPoolAcquire(&url, attempt == 0,
+				conn, &reused);
+			if (ret_code != UPNP_E_SUCCESS) {
+				membuffer_destroy(&start_msg);
+				return ret_code;
+			}
+		}
+		timeout = GENA_NOTIFICATION_SENDING_TIMEOUT;
+		ret_code = http_SendMessage(conn, &timeout,
+			"b",
+			start_msg.buf, start_msg.length);
+		if (ret_code != 0) {
+			parser_response_init(response, HTTPMETHOD_NOTIFY);
+		} else {
+			timeout = GENA_NOTIFICATION_ANSWERING_TIMEOUT;
+			ret_code = http_RecvMessage(conn, response,
+				HTTPMETHOD_NOTIFY, &timeout, &err_code);
+		}
+		if (reused && http_IsStaleConnection(ret_code, errno, response)) {
+			/* The idle connection was closed by the control point
+			 * before it saw the event, try again on a new one. A
+			 * time out is not retried, the event may have been
+			 * seen. */
+			sock_destroy(conn, SD_BOTH);
+			httpmsg_destroy(&response->msg);
+			continue;
+		}
+		break;
 	}
-	timeout = GENA_NOTIFICATION_ANSWERING_TIMEOUT;
-	ret_code = http_RecvMessage(&info, response,
-		HTTPMETHOD_NOTIFY, &timeout, &err_code);
-	if (ret_code) {
-		membuffer_destroy(&start_msg);
-		sock_destroy(&info, SD_BOTH);
+	membuffer_destroy(&start_msg);
+	if (ret_code != 0) {
+		sock_destroy(conn, SD_BOTH);
 		httpmsg_destroy(&response->msg);
 		return ret_code;
 	}
-	/* should shutdown completely when closing socket */
-	sock_destroy(&info, SD_BOTH);
-	membuffer_destroy(&start_msg);
+	if (!http_IsPersistent(response))
+		/* should shutdown completely when closing socket */
+		sock_destroy(conn, SD_BOTH);
 
 	return UPNP_E_SUCCESS;
 }
@@ -252,8 +306,13 @@ static int genaNotify(
 	char *headers,
 	/*! [in] The evented XML. */
 	char *propertySet,
+	/*! [in] SEQ of the event. */
+	int eventKey,
 	/*! [in] subscription to be Notified, assumes this is valid for life of function. */
-	subscription *sub)
+	subscription *sub,
+	/*! [in,out] Sender job, keeps the connection from one event to the
+	 * next. */
+	notify_thread_struct *in)
 {
 	size_t i;
 	membuffer mid_msg;
@@ -266,15 +325,21 @@ static int genaNotify(
 			     "s" "ssc" "sdcc",
 			     headers,
 			     "SID: ", sub->sid,
-			     "SEQ: ", sub->ToSendEventKey) != 0) {
+			     "SEQ: ", eventKey) != 0) {
 		membuffer_destroy(&mid_msg);
 		return UPNP_E_OUTOF_MEMORY;
 	}
 	/* send a notify to each url until one goes thru */
 	for (i = 0; i < sub->DeliveryURLs.size; i++) {
 		url = &sub->DeliveryURLs.parsedURLs[i];
+		if (in->connURL != i)
+			ReleaseNotifyConnection(in);
 		return_code = notify_send_and_recv(
-			url, &mid_msg, propertySet, &response);
+			url, &mid_msg, propertySet, &response, &in->conn);
+		if (in->conn.socket != INVALID_SOCKET) {
+			in->connURL = i;
+			in->connPeer = url->hostport.IPaddress;
+		}
 		if (return_code == UPNP_E_SUCCESS)
 			break;
 	}
@@ -297,97 +362,227 @@ static int genaNotify(
 
 
 /*!
- * \brief Thread job to Notify a control point.
+ * \brief Finds the subscription a sender job is draining.
+ *
+ * Must be called with HandleLock held.
+ *
+ * \return The subscription, or NULL if it does not exist anymore.
+ */
+static subscription *GetNotifySubscription(
+	/*! [in] Sender job. */
+	notify_thread_struct *in,
+	/*! [out] Service of the subscription. */
+	service_info **service)
+{
+	struct Handle_Info *handle_info;
+
+	if (GetHandleInfo(in->device_handle, &handle_info) != HND_DEVICE)
+		return NULL;
+	*service = FindServiceId(&handle_info->ServiceTable, in->servId, in->UDN);
+	if (*service == NULL)
+		return NULL;
+
+	return GetSubscriptionSID(in->sid, *service);
+}
+
+
+/*!
+ * \brief Sends the oldest queued event of a subscription.
+ *
+ * The head of the queue is sent without holding the lock and removed once
+ * the control point answered, so the events of a subscription are sent in
+ * order by one sender at a time. If the control point did not answer, the
+ * events queued behind it are dropped: each of them would hold a sender
+ * for as long.
  *
- * It validates the subscription and copies the subscription. Also make sure
- * that events are sent in order.
+ * Must be called with HandleLock held, returns with HandleLock held.
+ *
+ * \return TRUE if the subscription has more events to send, FALSE if it is
+ * 	done with the senders.
  *
  * \note calls the genaNotify to do the actual work.
  */
-static void genaNotifyThread(
-	/*! [in] notify thread structure containing all the headers and property set info. */
-	void *input)
+static int SendQueuedEvent(
+	/*! [in] Subscription taken from the ready list. */
+	notify_thread_struct *in)
 {
 	subscription *sub;
 	service_info *service;
 	subscription sub_copy;
-	notify_thread_struct *in = (notify_thread_struct *) input;
+	notify_entry *entry;
+	notify_event *event;
 	int return_code;
-	struct Handle_Info *handle_info;
-	ThreadPoolJob job;
 
-	memset(&job, 0, sizeof(job));
-
-	/* This should be a HandleLock and not a HandleReadLock otherwise if there
-	 * is a lot of notifications, then multiple threads will acquire a read
-	 * lock and the thread which sends the notification will be blocked forever
-	 * on the HandleLock at the end of this function. */
-	/*HandleReadLock(); */
-	HandleLock();
-	/* validate context */
-
-	if (GetHandleInfo(in->device_handle, &handle_info) != HND_DEVICE) {
-		free_notify_struct(in);
-		HandleUnlock();
-		return;
+	sub = GetNotifySubscription(in, &service);
+	if (sub == NULL)
+		return FALSE;
+	entry = sub->queueHead;
+	if (entry == NULL) {
+		sub->sending = FALSE;
+		return FALSE;
 	}
-
-	if (!(service = FindServiceId(&handle_info->ServiceTable, in->servId, in->UDN)) ||
-	    !service->active ||
-	    !(sub = GetSubscriptionSID(in->sid, service)) ||
+	if (!service->active ||
 	    copy_subscription(sub, &sub_copy) != HTTP_SUCCESS) {
-		free_notify_struct(in);
-		HandleUnlock();
-		return;
-	}
-#ifdef UPNP_ENABLE_NOTIFICATION_REORDERING
-	/*If the event is out of order push it back to the job queue */
-	if (in->eventKey != sub->ToSendEventKey) {
-		TPJobInit(&job, (start_routine) genaNotifyThread, input);
-		TPJobSetFreeFunction(&job, (free_function) free_notify_struct);
-		TPJobSetPriority(&job, MED_PRIORITY);
-		/* Sleep a little before creating another thread otherwise if there is
-		 * a lot of notifications to send, the device will take 100% of the CPU
-		 * to create threads and push them back to the job queue. */
-		imillisleep(1);
-		ThreadPoolAdd(&gSendThreadPool, &job, NULL);
-		freeSubscription(&sub_copy);
-		HandleUnlock();
-		return;
+		freeNotifyQueue(sub);
+		sub->sending = FALSE;
+		return FALSE;
 	}
-#endif
-
+	/* the subscription may go away while the event is sent */
+	event = entry->event;
+	event->refcount++;
 	HandleUnlock();
 
 	/* send the notify */
-	return_code = genaNotify(in->headers, in->propertySet, &sub_copy);
+	return_code = genaNotify(event->headers, event->propertySet,
+		entry->eventKey, &sub_copy, in);
 	freeSubscription(&sub_copy);
+
 	HandleLock();
-	if (GetHandleInfo(in->device_handle, &handle_info) != HND_DEVICE) {
-		free_notify_struct(in);
-		HandleUnlock();
-		return;
+	releaseNotifyEvent(event);
+	sub = GetNotifySubscription(in, &service);
+	if (sub == NULL)
+		return FALSE;
+	/* the head is never dropped while it is being sent */
+	sub->queueHead = entry->next;
+	if (sub->queueHead == NULL)
+		sub->queueTail = NULL;
+	sub->queueLength--;
+	releaseNotifyEvent(entry->event);
+	free(entry);
+	if (return_code == GENA_E_NOTIFY_UNACCEPTED_REMOVE_SUB) {
+		RemoveSubscriptionSID(in->sid, service);
+		return FALSE;
 	}
-	/* validate context */
-	if (!(service = FindServiceId(&handle_info->ServiceTable, in->servId, in->UDN)) ||
-	    !service->active ||
-	    !(sub = GetSubscriptionSID(in->sid, service))) {
-		free_notify_struct(in);
-		HandleUnlock();
-		return;
+	if (return_code != GENA_SUCCESS &&
+	    return_code != GENA_E_NOTIFY_UNACCEPTED &&
+	    sub->queueLength > 0) {
+		UpnpPrintf(UPNP_INFO, GENA, __FILE__, __LINE__,
+			"GENA notify failed, dropping %d events for SID %s\n",
+			sub->queueLength, sub->sid);
+		freeNotifyQueue(sub);
 	}
-	sub->ToSendEventKey++;
-	if (sub->ToSendEventKey < 0)
-		/* wrap to 1 for overflow */
-		sub->ToSendEventKey = 1;
-	if (return_code == GENA_E_NOTIFY_UNACCEPTED_REMOVE_SUB)
-		RemoveSubscriptionSID(in->sid, service);
-	free_notify_struct(in);
+	if (sub->queueHead == NULL) {
+		sub->sending = FALSE;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+/*!
+ * \brief Thread job sending the events of the subscriptions of the ready
+ * list, until the list is empty.
+ *
+ * One event is sent at a time, the subscription then goes back to the end
+ * of the list: a slow control point does not hold a sender while the
+ * others wait.
+ */
+static void genaNotifyThread(
+	/*! [in] Unused. */
+	void *input)
+{
+	notify_thread_struct *in;
+
+	(void)input;
+	HandleLock();
+	while ((in = gNotifyReadyHead) != NULL) {
+		gNotifyReadyHead = in->next;
+		if (gNotifyReadyHead == NULL)
+			gNotifyReadyTail = NULL;
+		if (SendQueuedEvent(in)) {
+			/* keeps its connection for the next event */
+			in->next = NULL;
+			if (gNotifyReadyTail == NULL)
+				gNotifyReadyHead = in;
+			else
+				gNotifyReadyTail->next = in;
+			gNotifyReadyTail = in;
+		} else {
+			/* the connection may serve the next burst of events */
+			ReleaseNotifyConnection(in);
+			free_notify_struct(in);
+		}
+	}
+	gNotifySenders--;
+	HandleUnlock();
+}
+
+
+/*!
+ * \brief Takes a subscription out of the ready list.
+ *
+ * Must be called with HandleLock held.
+ */
+static void RemoveNotifyReady(
+	/*! [in] Subscription in the ready list. */
+	notify_thread_struct *in)
+{
+	notify_thread_struct **link = &gNotifyReadyHead;
 
+	gNotifyReadyTail = NULL;
+	while (*link != NULL) {
+		if (*link == in)
+			*link = in->next;
+		else {
+			gNotifyReadyTail = *link;
+			link = &(*link)->next;
+		}
+	}
+	in->next = NULL;
+}
+
+
+/*!
+ * \brief Accounts for a sender job that the thread pool dropped without
+ * running it.
+ */
+static void free_notify_sender(
+	/*! [in] Unused. */
+	void *input)
+{
+	(void)input;
+	HandleLock();
+	gNotifySenders--;
 	HandleUnlock();
 }
 
 
+/*!
+ * \brief Drops the oldest event of a full queue that may be dropped. The
+ * control point sees a gap in the SEQ numbers.
+ */
+static void DropQueuedEvent(
+	/*! [in] Subscription. */
+	subscription *sub)
+{
+	notify_entry *prev = NULL;
+	notify_entry *entry = sub->queueHead;
+
+	/* keep the event being sent and the initial event */
+	while (entry != NULL &&
+	       ((entry == sub->queueHead && sub->sending) ||
+		entry->eventKey == 0)) {
+		prev = entry;
+		entry = entry->next;
+	}
+	if (entry == NULL)
+		return;
+	if (prev == NULL)
+		sub->queueHead = entry->next;
+	else
+		prev->next = entry->next;
+	if (sub->queueTail == entry)
+		sub->queueTail = prev;
+	sub->queueLength--;
+	UpnpPrintf(UPNP_INFO, GENA, __FILE__, __LINE__,
+		"GENA queue full, dropping event %d for SID %s\n",
+		entry->eventKey, sub->sid);
+	releaseNotifyEvent(entry->event);
+	free(entry);
+}
+
+
 /*!
  * \brief Allocates the GENA header.
  *
@@ -443,210 +638,860 @@ ExitFunction:
 }
 
 
-int genaInitNotify(
-	UpnpDevice_Handle device_handle,
-	char *UDN,
-	char *servId,
-	char **VarNames,
-	char **VarValues,
-	int var_count,
-	const Upnp_SID sid)
+/*!
+ * \brief Creates an event to be queued for one or more subscriptions.
+ *
+ * The event is returned with one reference owned by the caller, to be
+ * dropped with releaseNotifyEvent() once it has been queued. Its variables
+ * are unknown until set by SetEventVariables() or SetEventVariablesExt().
+ *
+ * \return The event, or NULL if out of memory. The property set is owned
+ * 	by the event on success.
+ */
+static notify_event *NewNotifyEvent(
+	/*! [in] The evented XML. */
+	DOMString propertySet)
 {
-	int ret = GENA_SUCCESS;
-	int line = 0;
+	notify_event *event;
+
+	event = (notify_event *)malloc(sizeof (notify_event));
+	if (event == NULL)
+		return NULL;
+	event->headers = AllocGenaHeaders(propertySet);
+	if (event->headers == NULL) {
+		free(event);
+		return NULL;
+	}
+	event->refcount = 1;
+	event->propertySet = propertySet;
+	event->varCount = 0;
+	event->names = NULL;
+	event->values = NULL;
+
+	return event;
+}
 
-	int *reference_count = NULL;
-	char *UDN_copy = NULL;
-	char *servId_copy = NULL;
-	DOMString propertySet = NULL;
-	char *headers = NULL;
-	notify_thread_struct *thread_struct = NULL;
 
-	subscription *sub = NULL;
-	service_info *service = NULL;
-	struct Handle_Info *handle_info;
-	ThreadPoolJob job;
+/*!
+ * \brief Frees arrays of variable names and values.
+ */
+static void FreeVariables(
+	/*! [in] Names, may contain NULL entries. */
+	char **names,
+	/*! [in] Values, may contain NULL entries. */
+	char **values,
+	/*! [in] Number of entries of the arrays. */
+	int count)
+{
+	int i;
 
-	memset(&job, 0, sizeof(job));
+	for (i = 0; i < count; i++) {
+		if (names != NULL)
+			free(names[i]);
+		if (values != NULL)
+			free(values[i]);
+	}
+	free(names);
+	free(values);
+}
 
-	UpnpPrintf(UPNP_INFO, GENA, __FILE__, __LINE__,
-		"GENA BEGIN INITIAL NOTIFY");
 
-	reference_count = (int *)malloc(sizeof (int));
-	if (reference_count == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-		goto ExitFunction;
-	}
-	*reference_count = 0;
-	
-	UDN_copy = strdup(UDN);
-	if (UDN_copy == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-		goto ExitFunction;
+/*!
+ * \brief Allocates arrays of variable names and values, filled with NULL.
+ *
+ * \return UPNP_E_SUCCESS, or UPNP_E_OUTOF_MEMORY.
+ */
+static int AllocVariables(
+	/*! [in] Number of variables. */
+	int count,
+	/*! [out] Names. */
+	char ***names,
+	/*! [out] Values. */
+	char ***values)
+{
+	*names = (char **)calloc((size_t)count, sizeof (char *));
+	*values = (char **)calloc((size_t)count, sizeof (char *));
+	if (*names == NULL || *values == NULL) {
+		free(*names);
+		free(*values);
+		return UPNP_E_OUTOF_MEMORY;
 	}
 
-	servId_copy = strdup(servId);
-	if (servId_copy == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-		goto ExitFunction;
+	return UPNP_E_SUCCESS;
+}
+
+
+/*!
+ * \brief Gives an event a copy of its variables, so that it can be
+ * moderated and merged with another event.
+ *
+ * If out of memory, the variables stay unknown and the event is sent as it
+ * is.
+ */
+static void SetEventVariables(
+	/*! [in,out] Event. */
+	notify_event *event,
+	/*! [in] Names of the variables. */
+	char **names,
+	/*! [in] Values of the variables. */
+	char **values,
+	/*! [in] Number of variables. */
+	int count)
+{
+	char **n;
+	char **v;
+	int i;
+
+	if (count <= 0 || AllocVariables(count, &n, &v) != UPNP_E_SUCCESS)
+		return;
+	for (i = 0; i < count; i++) {
+		n[i] = strdup(names[i]);
+		v[i] = strdup(values[i]);
+		if (n[i] == NULL || v[i] == NULL) {
+			FreeVariables(n, v, count);
+			return;
+		}
 	}
+	event->names = n;
+	event->values = v;
+	event->varCount = count;
+}
 
-	HandleLock();
 
-	if (GetHandleInfo(device_handle, &handle_info) != HND_DEVICE) {
-		line = __LINE__;
-		ret = GENA_E_BAD_HANDLE;
-		goto ExitFunction;
+/*!
+ * \brief Gives an event the variables of the property set document it was
+ * printed from.
+ *
+ * The variables are set only if GeneratePropertySet() would print the same
+ * property set from them: every property holds one element without
+ * attributes, whose content is text. Otherwise they stay unknown and the
+ * event is sent as it is.
+ */
+static void SetEventVariablesExt(
+	/*! [in,out] Event. */
+	notify_event *event,
+	/*! [in] Property set document. */
+	IXML_Document *PropSet)
+{
+	IXML_Node *root;
+	IXML_Node *attr;
+	IXML_Node *property;
+	IXML_Node *var;
+	IXML_Node *text;
+	const char *value;
+	char **n;
+	char **v;
+	int count = 0;
+	int i;
+
+	root = ixmlNode_getFirstChild((IXML_Node *)PropSet);
+	if (root == NULL ||
+	    ixmlNode_getNodeType(root) != eELEMENT_NODE ||
+	    ixmlNode_getNextSibling(root) != NULL ||
+	    strcmp(ixmlNode_getNodeName(root), "e:propertyset") != 0)
+		return;
+	/* the namespace declaration of XML_PROPERTYSET_HEADER only */
+	attr = root->firstAttr;
+	if (attr == NULL || attr->nextSibling != NULL ||
+	    strcmp(ixmlNode_getNodeName(attr), "xmlns:e") != 0 ||
+	    (value = ixmlNode_getNodeValue(attr)) == NULL ||
+	    strcmp(value, "urn:schemas-upnp-org:event-1-0") != 0)
+		return;
+	for (property = ixmlNode_getFirstChild(root); property != NULL;
+	     property = ixmlNode_getNextSibling(property)) {
+		if (ixmlNode_getNodeType(property) != eELEMENT_NODE ||
+		    strcmp(ixmlNode_getNodeName(property), "e:property") != 0 ||
+		    property->firstAttr != NULL)
+			return;
+		var = ixmlNode_getFirstChild(property);
+		if (var == NULL ||
+		    ixmlNode_getNodeType(var) != eELEMENT_NODE ||
+		    ixmlNode_getNextSibling(var) != NULL ||
+		    var->firstAttr != NULL)
+			return;
+		text = ixmlNode_getFirstChild(var);
+		if (text != NULL &&
+		    (ixmlNode_getNodeType(text) != eTEXT_NODE ||
+		     ixmlNode_getNextSibling(text) != NULL))
+			return;
+		count++;
+	}
+	if (count == 0 || AllocVariables(count, &n, &v) != UPNP_E_SUCCESS)
+		return;
+	i = 0;
+	for (property = ixmlNode_getFirstChild(root); property != NULL;
+	     property = ixmlNode_getNextSibling(property), i++) {
+		var = ixmlNode_getFirstChild(property);
+		text = ixmlNode_getFirstChild(var);
+		n[i] = strdup(ixmlNode_getNodeName(var));
+		/* escaped, as printed in the property set */
+		if (text != NULL)
+			v[i] = ixmlNodetoString(text);
+		if (v[i] == NULL &&
+		    (text == NULL || ixmlNode_getNodeValue(text) == NULL ||
+		     ixmlNode_getNodeValue(text)[0] == '\0'))
+			v[i] = strdup("");
+		if (n[i] == NULL || v[i] == NULL) {
+			FreeVariables(n, v, count);
+			return;
+		}
 	}
+	event->names = n;
+	event->values = v;
+	event->varCount = count;
+}
 
-	service = FindServiceId(&handle_info->ServiceTable, servId, UDN);
-	if (service == NULL) {
-		line = __LINE__;
-		ret = GENA_E_BAD_SERVICE;
-		goto ExitFunction;
+
+/*!
+ * \brief Creates an event from its variables.
+ *
+ * \return The event, or NULL if out of memory. The arrays and their strings
+ * 	are owned by the event on success, and freed on failure.
+ */
+static notify_event *NewVariablesEvent(
+	/*! [in] Names of the variables. */
+	char **names,
+	/*! [in] Values of the variables. */
+	char **values,
+	/*! [in] Number of variables. */
+	int count)
+{
+	DOMString propertySet = NULL;
+	notify_event *event = NULL;
+
+	if (GeneratePropertySet(names, values, count, &propertySet) ==
+		XML_SUCCESS && propertySet != NULL)
+		event = NewNotifyEvent(propertySet);
+	if (event == NULL) {
+		ixmlFreeDOMString(propertySet);
+		FreeVariables(names, values, count);
+		return NULL;
 	}
-	UpnpPrintf(UPNP_INFO, GENA, __FILE__, __LINE__,
-		"FOUND SERVICE IN INIT NOTFY: UDN %s, ServID: %s",
-		UDN, servId);
+	event->names = names;
+	event->values = values;
+	event->varCount = count;
 
-	sub = GetSubscriptionSID(sid, service);
-	if (sub == NULL || sub->active) {
-		line = __LINE__;
-		ret = GENA_E_BAD_SID;
-		goto ExitFunction;
+	return event;
+}
+
+
+/*!
+ * \brief Finds the moderation of a state variable.
+ *
+ * Must be called with HandleLock held.
+ *
+ * \return The moderation, or NULL if the variable is not moderated.
+ */
+static event_moderation *FindEventModeration(
+	/*! [in] Service. */
+	service_info *service,
+	/*! [in] Name of the state variable. */
+	const char *name)
+{
+	event_moderation *m;
+
+	for (m = service->moderation; m != NULL; m = m->next)
+		if (strcmp(m->name, name) == 0)
+			return m;
+
+	return NULL;
+}
+
+
+/*!
+ * \brief Event merged into the last queued event of the subscriptions, while
+ * an event is queued for all the subscriptions of a service.
+ *
+ * The subscriptions were mostly sent the same events, so the merge is done
+ * once and its result is shared. References are held on both events.
+ */
+typedef struct {
+	/*! Event the new one was merged into, NULL if none. */
+	notify_event *older;
+	/*! Result of the merge. */
+	notify_event *merged;
+} notify_merge;
+
+
+/*!
+ * \brief Merges an event into an older one, the values of the newer event
+ * replacing those of the older.
+ *
+ * Two values of the same variable are merged only if the variable is
+ * moderated: the others, LastChange for instance, may carry a change that
+ * the newer value does not repeat, so every value is sent.
+ *
+ * Must be called with HandleLock held.
+ *
+ * \return The merged event, or NULL if the events cannot be merged.
+ */
+static notify_event *MergeNotifyEvents(
+	/*! [in] Service of the events. */
+	service_info *service,
+	/*! [in] Older event. */
+	notify_event *older,
+	/*! [in] Newer event. */
+	notify_event *newer)
+{
+	char **names;
+	char **values;
+	int count = older->varCount;
+	int size = older->varCount + newer->varCount;
+	int i;
+	int j;
+
+	if (older->varCount == 0 || newer->varCount == 0)
+		return NULL;
+	for (j = 0; j < newer->varCount; j++)
+		for (i = 0; i < older->varCount; i++)
+			if (strcmp(older->names[i], newer->names[j]) == 0 &&
+			    FindEventModeration(service, newer->names[j]) == NULL)
+				return NULL;
+	if (AllocVariables(size, &names, &values) != UPNP_E_SUCCESS)
+		return NULL;
+	for (i = 0; i < older->varCount; i++) {
+		names[i] = strdup(older->names[i]);
+		values[i] = strdup(older->values[i]);
+		if (names[i] == NULL || values[i] == NULL)
+			goto error_handler;
+	}
+	for (j = 0; j < newer->varCount; j++) {
+		for (i = 0; i < older->varCount; i++)
+			if (strcmp(names[i], newer->names[j]) == 0)
+				break;
+		if (i == older->varCount) {
+			i = count++;
+			names[i] = strdup(newer->names[j]);
+			if (names[i] == NULL)
+				goto error_handler;
+		} else
+			free(values[i]);
+		values[i] = strdup(newer->values[j]);
+		if (values[i] == NULL)
+			goto error_handler;
+	}
+
+	return NewVariablesEvent(names, values, count);
+
+error_handler:
+	FreeVariables(names, values, size);
+	return NULL;
+}
+
+
+/*!
+ * \brief Queues an event for a subscription, and puts the subscription in
+ * the ready list if no sender has it.
+ *
+ * If the last event of the queue is not being sent yet, the event is merged
+ * into it when possible: the control point then gets the latest values in
+ * one NOTIFY, and the merged event keeps its SEQ. Otherwise a full queue
+ * drops its oldest event.
+ *
+ * Must be called with HandleLock held.
+ *
+ * \return GENA_SUCCESS if the event was queued and a sender will send it,
+ * 	otherwise returns the appropriate error code. If no sender could be
+ * 	started, the event stays queued and is sent after the next one
+ * 	queued for the subscription.
+ */
+static int QueueNotify(
+	/*! [in] Device handle. */
+	UpnpDevice_Handle device_handle,
+	/*! [in] Device UDN. */
+	const char *UDN,
+	/*! [in] Service ID. */
+	const char *servId,
+	/*! [in] Service of the subscription. */
+	service_info *service,
+	/*! [in] Subscription. */
+	subscription *sub,
+	/*! [in] Event, shared by all the subscriptions. */
+	notify_event *event,
+	/*! [in,out] Merge shared by the subscriptions, NULL if the event must
+	 * not be merged. */
+	notify_merge *merge)
+{
+	notify_entry *entry;
+	notify_event *merged;
+	notify_thread_struct *thread_struct;
+	ThreadPoolJob job;
+	int ret;
+
+	entry = sub->queueTail;
+	if (merge != NULL && entry != NULL &&
+	    (entry != sub->queueHead || !sub->sending)) {
+		if (merge->older == entry->event) {
+			merged = merge->merged;
+		} else {
+			merged = MergeNotifyEvents(service, entry->event, event);
+			if (merged != NULL) {
+				if (merge->older != NULL) {
+					releaseNotifyEvent(merge->older);
+					releaseNotifyEvent(merge->merged);
+				}
+				merge->older = entry->event;
+				merge->older->refcount++;
+				merge->merged = merged;
+			}
+		}
+		if (merged != NULL) {
+			merged->refcount++;
+			releaseNotifyEvent(entry->event);
+			entry->event = merged;
+		}
+	} else
+		merged = NULL;
+
+	if (merged == NULL) {
+		entry = (notify_entry *)malloc(sizeof (notify_entry));
+		if (entry == NULL)
+			return UPNP_E_OUTOF_MEMORY;
+		entry->event = event;
+		entry->eventKey = sub->eventKey++;
+		/* if overflow, wrap to 1 */
+		if (sub->eventKey < 0)
+			sub->eventKey = 1;
+		entry->next = NULL;
+		event->refcount++;
+		if (sub->queueTail == NULL)
+			sub->queueHead = entry;
+		else
+			sub->queueTail->next = entry;
+		sub->queueTail = entry;
+		sub->queueLength++;
+		if (sub->queueLength > GENA_MAX_QUEUED_EVENTS)
+			/* the event could not be merged into the tail */
+			DropQueuedEvent(sub);
+	}
+	if (sub->sending)
+		return GENA_SUCCESS;
+
+	/* put the subscription in the ready list */
+	thread_struct = (notify_thread_struct *)malloc(sizeof (notify_thread_struct));
+	if (thread_struct == NULL)
+		return UPNP_E_OUTOF_MEMORY;
+	thread_struct->servId = strdup(servId);
+	thread_struct->UDN = strdup(UDN);
+	memset(thread_struct->sid, 0, sizeof(thread_struct->sid));
+	strncpy(thread_struct->sid, sub->sid, sizeof(thread_struct->sid) - 1);
+	thread_struct->device_handle = device_handle;
+	sock_init(&thread_struct->conn, INVALID_SOCKET);
+	thread_struct->connURL = 0;
+	thread_struct->next = NULL;
+	if (thread_struct->servId == NULL || thread_struct->UDN == NULL) {
+		/* the event stays queued, it will be sent with the next one */
+		free_notify_struct(thread_struct);
+		return UPNP_E_OUTOF_MEMORY;
 	}
-	UpnpPrintf( UPNP_INFO, GENA, __FILE__, __LINE__,
-		"FOUND SUBSCRIPTION IN INIT NOTIFY: SID %s", sid);
-	sub->active = 1;
+	if (gNotifyReadyTail == NULL)
+		gNotifyReadyHead = thread_struct;
+	else
+		gNotifyReadyTail->next = thread_struct;
+	gNotifyReadyTail = thread_struct;
+	sub->sending = TRUE;
+	if (gNotifySenders >= GENA_MAX_NOTIFY_SENDERS)
+		return GENA_SUCCESS;
 
-	if (var_count <= 0) {
-		line = __LINE__;
-		ret = GENA_SUCCESS;
-		goto ExitFunction;
+	/* start one more sender */
+	memset(&job, 0, sizeof(job));
+	TPJobInit(&job, (start_routine)genaNotifyThread, NULL);
+	TPJobSetFreeFunction(&job, (free_routine)free_notify_sender);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	ret = ThreadPoolAdd(&gSendThreadPool, &job, NULL);
+	if (ret != 0) {
+		/* the running senders will get to the subscription */
+		if (gNotifySenders > 0)
+			return GENA_SUCCESS;
+		/* none would ever take it from the ready list: the events
+		 * stay queued and the next one tries again */
+		RemoveNotifyReady(thread_struct);
+		free_notify_struct(thread_struct);
+		sub->sending = FALSE;
+		return ret == EOUTOFMEM ? UPNP_E_OUTOF_MEMORY : ret;
+	}
+	gNotifySenders++;
+
+	return GENA_SUCCESS;
+}
+
+
+/*!
+ * \brief Queues an event for all the subscriptions of a service.
+ *
+ * Must be called with HandleLock held.
+ *
+ * \return GENA_SUCCESS if successful, otherwise the appropriate error code.
+ */
+static int QueueNotifyAll(
+	/*! [in] Device handle. */
+	UpnpDevice_Handle device_handle,
+	/*! [in] Device UDN. */
+	const char *UDN,
+	/*! [in] Service ID. */
+	const char *servId,
+	/*! [in] Service. */
+	service_info *service,
+	/*! [in] Event. */
+	notify_event *event)
+{
+	notify_merge merge;
+	subscription *finger;
+	int ret = GENA_SUCCESS;
+	int sub_ret;
+
+	merge.older = NULL;
+	merge.merged = NULL;
+	/* all the queues share the event, an error on one of them does not
+	 * keep it from the others */
+	finger = GetFirstSubscription(service);
+	while (finger) {
+		sub_ret = QueueNotify(device_handle, UDN, servId, service,
+			finger, event, &merge);
+		if (ret == GENA_SUCCESS)
+			ret = sub_ret;
+		finger = GetNextSubscription(service, finger);
+	}
+	if (merge.older != NULL) {
+		releaseNotifyEvent(merge.older);
+		releaseNotifyEvent(merge.merged);
 	}
 
-	ret = GeneratePropertySet(VarNames, VarValues, var_count, &propertySet);
-	if (ret != XML_SUCCESS) {
-		line = __LINE__;
-		goto ExitFunction;
+	return ret;
+}
+
+
+/*!
+ * \brief Service whose held back values are sent by a timer.
+ */
+typedef struct {
+	/*! Device handle. */
+	UpnpDevice_Handle device_handle;
+	/*! Device UDN. */
+	char *UDN;
+	/*! Service ID. */
+	char *servId;
+	/*! Time the timer is set for, in ms. */
+	int64_t due;
+} moderation_timer;
+
+
+/*!
+ * \brief Frees a moderation timer job.
+ */
+static void free_moderation_timer(
+	/*! [in] Timer. */
+	moderation_timer *timer)
+{
+	free(timer->UDN);
+	free(timer->servId);
+	free(timer);
+}
+
+
+static void genaModerationThread(void *input);
+
+
+/*!
+ * \brief Sets the timer sending the held back values of a service, unless
+ * one is set to fire sooner.
+ *
+ * Must be called with HandleLock held.
+ */
+static void ScheduleModeration(
+	/*! [in] Device handle. */
+	UpnpDevice_Handle device_handle,
+	/*! [in] Device UDN. */
+	const char *UDN,
+	/*! [in] Service ID. */
+	const char *servId,
+	/*! [in] Service. */
+	service_info *service,
+	/*! [in] Time the next held back value is due, in ms. */
+	int64_t due,
+	/*! [in] Current time, in ms. */
+	int64_t now)
+{
+	moderation_timer *timer;
+	ThreadPoolJob job;
+
+	if (service->moderationDue != 0 && service->moderationDue <= due)
+		return;
+	timer = (moderation_timer *)malloc(sizeof (moderation_timer));
+	if (timer == NULL)
+		return;
+	timer->device_handle = device_handle;
+	timer->due = due;
+	timer->UDN = strdup(UDN);
+	timer->servId = strdup(servId);
+	if (timer->UDN == NULL || timer->servId == NULL) {
+		free_moderation_timer(timer);
+		return;
 	}
-	UpnpPrintf(UPNP_INFO, GENA, __FILE__, __LINE__,
-		"GENERATED PROPERTY SET IN INIT NOTIFY: %s",
-		propertySet);
+	memset(&job, 0, sizeof(job));
+	TPJobInit(&job, (start_routine)genaModerationThread, timer);
+	TPJobSetFreeFunction(&job, (free_routine)free_moderation_timer);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	if (TimerThreadSchedule(&gTimerThread,
+		due > now ? (time_t)(due - now) : 0, REL_MSEC,
+		&job, SHORT_TERM, NULL) != 0) {
+		/* the values are held until the next change */
+		free_moderation_timer(timer);
+		return;
+	}
+	service->moderationDue = due;
+}
 
-	headers = AllocGenaHeaders(propertySet);
-	if (headers == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
+
+/*!
+ * \brief Timer job sending the held back values of a service whose period
+ * has ended.
+ */
+static void genaModerationThread(
+	/*! [in] Timer. */
+	void *input)
+{
+	moderation_timer *timer = (moderation_timer *)input;
+	struct Handle_Info *handle_info;
+	service_info *service;
+	event_moderation *m;
+	notify_event *event;
+	char **names;
+	char **values;
+	int count = 0;
+	int64_t now = imillinow();
+	int64_t next = 0;
+
+	HandleLock();
+	if (GetHandleInfo(timer->device_handle, &handle_info) != HND_DEVICE)
+		goto ExitFunction;
+	service = FindServiceId(&handle_info->ServiceTable, timer->servId,
+		timer->UDN);
+	if (service == NULL)
 		goto ExitFunction;
+	/* the timer may fire a little before the values are due; another
+	 * one is then set for them */
+	if (service->moderationDue == timer->due)
+		service->moderationDue = 0;
+	for (m = service->moderation; m != NULL; m = m->next)
+		if (m->pendingValue != NULL)
+			count++;
+	if (count == 0 ||
+	    AllocVariables(count, &names, &values) != UPNP_E_SUCCESS)
+		goto ExitFunction;
+	count = 0;
+	for (m = service->moderation; m != NULL; m = m->next) {
+		if (m->pendingValue == NULL)
+			continue;
+		if (now - m->sentTime < m->maxRate) {
+			if (next == 0 || m->sentTime + m->maxRate < next)
+				next = m->sentTime + m->maxRate;
+			continue;
+		}
+		names[count] = strdup(m->name);
+		values[count] = strdup(m->pendingValue);
+		if (names[count] == NULL || values[count] == NULL) {
+			/* sent by the next timer */
+			free(names[count]);
+			free(values[count]);
+			names[count] = NULL;
+			values[count] = NULL;
+			next = now + m->maxRate;
+			continue;
+		}
+		free(m->sentValue);
+		m->sentValue = m->pendingValue;
+		m->pendingValue = NULL;
+		m->sentTime = now;
+		count++;
+	}
+	if (next != 0)
+		ScheduleModeration(timer->device_handle, timer->UDN,
+			timer->servId, service, next, now);
+	if (count == 0) {
+		FreeVariables(names, values, 0);
+		goto ExitFunction;
+	}
+	event = NewVariablesEvent(names, values, count);
+	if (event != NULL) {
+		QueueNotifyAll(timer->device_handle, timer->UDN,
+			timer->servId, service, event);
+		releaseNotifyEvent(event);
 	}
 
-	/* schedule thread for initial notification */
+ExitFunction:
+	HandleUnlock();
+	free_moderation_timer(timer);
+}
 
-	thread_struct = (notify_thread_struct *)malloc(sizeof (notify_thread_struct));
-	if (thread_struct == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-	} else {
-		*reference_count = 1;
-		thread_struct->servId = servId_copy;
-		thread_struct->UDN = UDN_copy;
-		thread_struct->headers = headers;
-		thread_struct->propertySet = propertySet;
-		memset(thread_struct->sid, 0, sizeof(thread_struct->sid));
-		strncpy(thread_struct->sid, sid,
-			sizeof(thread_struct->sid) - 1);
-		thread_struct->eventKey = sub->eventKey++;
-		thread_struct->reference_count = reference_count;
-		thread_struct->device_handle = device_handle;
-
-		TPJobInit(&job, (start_routine)genaNotifyThread, thread_struct);
-		TPJobSetFreeFunction(&job, (free_routine)free_notify_struct);
-		TPJobSetPriority(&job, MED_PRIORITY);
-
-		ret = ThreadPoolAdd(&gSendThreadPool, &job, NULL);
-		if (ret != 0) {
-			if (ret == EOUTOFMEM) {
-				line = __LINE__;
-				ret = UPNP_E_OUTOF_MEMORY;
+
+/*!
+ * \brief Parses a numeric value.
+ *
+ * \return TRUE if the whole value is a number.
+ */
+static int ParseNumber(
+	/*! [in] Value. */
+	const char *value,
+	/*! [out] Number. */
+	double *number)
+{
+	char *end;
+
+	if (*value == '\0')
+		return FALSE;
+	*number = strtod(value, &end);
+
+	return *end == '\0';
+}
+
+
+/*!
+ * \brief Applies the moderation of the state variables of a service to an
+ * event.
+ *
+ * A value changing less than the minimum delta of its variable is dropped,
+ * a value coming before the end of the period of its variable is held back
+ * and sent by a timer.
+ *
+ * Must be called with HandleLock held.
+ *
+ * \return The event to send, with one reference owned by the caller, or
+ * 	NULL if no value is left to send. If out of memory, the whole event
+ * 	is returned, so that no value recorded as sent is lost.
+ */
+static notify_event *ModerateEvent(
+	/*! [in] Device handle. */
+	UpnpDevice_Handle device_handle,
+	/*! [in] Device UDN. */
+	const char *UDN,
+	/*! [in] Service ID. */
+	const char *servId,
+	/*! [in] Service. */
+	service_info *service,
+	/*! [in] Event, the caller keeps its reference. */
+	notify_event *event)
+{
+	event_moderation *m;
+	notify_event *moderated;
+	char *value;
+	char **names;
+	char **values;
+	int *send;
+	int count = 0;
+	int i;
+	double sent;
+	double delta;
+	int64_t now = imillinow();
+
+	send = (int *)malloc(sizeof (int) * (size_t)event->varCount);
+	if (send == NULL) {
+		event->refcount++;
+		return event;
+	}
+	for (i = 0; i < event->varCount; i++) {
+		send[i] = FALSE;
+		m = FindEventModeration(service, event->names[i]);
+		if (m == NULL) {
+			send[i] = TRUE;
+			count++;
+			continue;
+		}
+		if (m->minDelta > 0 && m->sentValue != NULL &&
+		    ParseNumber(m->sentValue, &sent) &&
+		    ParseNumber(event->values[i], &delta)) {
+			delta -= sent;
+			if (delta < m->minDelta && -delta < m->minDelta) {
+				/* back near the sent value */
+				free(m->pendingValue);
+				m->pendingValue = NULL;
+				continue;
 			}
-		} else {
-			line = __LINE__;
-			ret = GENA_SUCCESS;
+		}
+		value = strdup(event->values[i]);
+		if (value == NULL) {
+			send[i] = TRUE;
+			count++;
+			continue;
+		}
+		if (m->sentValue != NULL && now - m->sentTime < m->maxRate) {
+			free(m->pendingValue);
+			m->pendingValue = value;
+			ScheduleModeration(device_handle, UDN, servId,
+				service, m->sentTime + m->maxRate, now);
+			continue;
+		}
+		free(m->sentValue);
+		m->sentValue = value;
+		m->sentTime = now;
+		free(m->pendingValue);
+		m->pendingValue = NULL;
+		send[i] = TRUE;
+		count++;
+	}
+	if (count == 0) {
+		free(send);
+		return NULL;
+	}
+	if (count == event->varCount) {
+		free(send);
+		event->refcount++;
+		return event;
+	}
+	if (AllocVariables(count, &names, &values) != UPNP_E_SUCCESS)
+		goto ExitFunction;
+	count = 0;
+	for (i = 0; i < event->varCount; i++) {
+		if (!send[i])
+			continue;
+		names[count] = strdup(event->names[i]);
+		values[count] = strdup(event->values[i]);
+		count++;
+		if (names[count - 1] == NULL || values[count - 1] == NULL) {
+			FreeVariables(names, values, count);
+			goto ExitFunction;
 		}
 	}
-
-ExitFunction:
-	if (ret != GENA_SUCCESS || var_count <= 0) {
-		free(thread_struct);
-		free(headers);
-		ixmlFreeDOMString(propertySet);
-		free(servId_copy);
-		free(UDN_copy);
-		free(reference_count);
+	moderated = NewVariablesEvent(names, values, count);
+	if (moderated != NULL) {
+		free(send);
+		return moderated;
 	}
 
-	HandleUnlock();
-
-	UpnpPrintf(UPNP_INFO, GENA, __FILE__, line,
-		"GENA END INITIAL NOTIFY, ret = %d",
-		ret);
+ExitFunction:
+	/* The moderation state already records the values as sent, so send
+	 * them all rather than lose them. */
+	free(send);
+	event->refcount++;
 
-	return ret;
+	return event;
 }
 
 
-int genaInitNotifyExt(
+/*!
+ * \brief Queues the initial event of a subscription.
+ *
+ * \return GENA_SUCCESS if successful, otherwise the appropriate error code.
+ */
+static int genaInitNotifyCommon(
+	/*! [in] Device handle. */
 	UpnpDevice_Handle device_handle,
+	/*! [in] Device UDN. */
 	char *UDN,
+	/*! [in] Service ID. */
 	char *servId,
-	IXML_Document *PropSet,
+	/*! [in] The event, NULL if there is no initial event. Its reference is
+	 * owned by this function. */
+	notify_event *event,
+	/*! [in] Subscription ID. */
 	const Upnp_SID sid)
 {
 	int ret = GENA_SUCCESS;
 	int line = 0;
 
-	int *reference_count = NULL;
-	char *UDN_copy = NULL;
-	char *servId_copy = NULL;
-	DOMString propertySet = NULL;
-	char *headers = NULL;
-	notify_thread_struct *thread_struct = NULL;
-
 	subscription *sub = NULL;
 	service_info *service = NULL;
 	struct Handle_Info *handle_info;
-	ThreadPoolJob job;
-
-	memset(&job, 0, sizeof(job));
-
-	UpnpPrintf(UPNP_INFO, GENA, __FILE__, __LINE__,
-		"GENA BEGIN INITIAL NOTIFY EXT");
-	
-	reference_count = (int *)malloc(sizeof (int));
-	if (reference_count == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-		goto ExitFunction;
-	}
-	*reference_count = 0;
-	
-	UDN_copy = strdup(UDN);
-	if (UDN_copy == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-		goto ExitFunction;
-	}
-
-	servId_copy = strdup(servId);
-	if( servId_copy == NULL ) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-		goto ExitFunction;
-	}
 
 	HandleLock();
 
@@ -663,7 +1508,7 @@ int genaInitNotifyExt(
 		goto ExitFunction;
 	}
 	UpnpPrintf(UPNP_INFO, GENA, __FILE__, __LINE__,
-		"FOUND SERVICE IN INIT NOTFY EXT: UDN %s, ServID: %s",
+		"FOUND SERVICE IN INIT NOTFY: UDN %s, ServID: %s",
 		UDN, servId);
 
 	sub = GetSubscriptionSID(sid, service);
@@ -673,152 +1518,126 @@ int genaInitNotifyExt(
 		goto ExitFunction;
 	}
 	UpnpPrintf( UPNP_INFO, GENA, __FILE__, __LINE__,
-		"FOUND SUBSCRIPTION IN INIT NOTIFY EXT: SID %s", sid);
+		"FOUND SUBSCRIPTION IN INIT NOTIFY: SID %s", sid);
 	sub->active = 1;
 
-	if (PropSet == 0) {
+	if (event == NULL) {
 		line = __LINE__;
 		ret = GENA_SUCCESS;
 		goto ExitFunction;
 	}
 
-	propertySet = ixmlPrintNode((IXML_Node *)PropSet);
-	if (propertySet == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_INVALID_PARAM;
-		goto ExitFunction;
-	}
-	UpnpPrintf(UPNP_INFO, GENA, __FILE__, __LINE__,
-		"GENERATED PROPERTY SET IN INIT EXT NOTIFY: %s",
-		propertySet);
-
-	headers = AllocGenaHeaders(propertySet);
-	if (headers == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-		goto ExitFunction;
-	}
-
-	/* schedule thread for initial notification */
-
-	thread_struct = (notify_thread_struct *)malloc(sizeof (notify_thread_struct));
-	if (thread_struct == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-	} else {
-		*reference_count = 1;
-		thread_struct->servId = servId_copy;
-		thread_struct->UDN = UDN_copy;
-		thread_struct->headers = headers;
-		thread_struct->propertySet = propertySet;
-		memset(thread_struct->sid, 0, sizeof(thread_struct->sid));
-		strncpy(thread_struct->sid, sid,
-			sizeof(thread_struct->sid) - 1);
-		thread_struct->eventKey = sub->eventKey++;
-		thread_struct->reference_count = reference_count;
-		thread_struct->device_handle = device_handle;
-
-		TPJobInit(&job, (start_routine)genaNotifyThread, thread_struct);
-		TPJobSetFreeFunction(&job, (free_routine)free_notify_struct);
-		TPJobSetPriority(&job, MED_PRIORITY);
-
-		ret = ThreadPoolAdd(&gSendThreadPool, &job, NULL);
-		if (ret != 0) {
-			if (ret == EOUTOFMEM) {
-				line = __LINE__;
-				ret = UPNP_E_OUTOF_MEMORY;
-			}
-		} else {
-			line = __LINE__;
-			ret = GENA_SUCCESS;
-		}
-	}
+	/* queue the initial notification, it is never merged */
+	line = __LINE__;
+	ret = QueueNotify(device_handle, UDN, servId, service, sub, event,
+		NULL);
 
 ExitFunction:
-	if (ret != GENA_SUCCESS || PropSet == 0) {
-		free(thread_struct);
-		free(headers);
-		ixmlFreeDOMString(propertySet);
-		free(servId_copy);
-		free(UDN_copy);
-		free(reference_count);
-	}
+	if (event != NULL)
+		releaseNotifyEvent(event);
 
 	HandleUnlock();
 
 	UpnpPrintf(UPNP_INFO, GENA, __FILE__, line,
-		"GENA END INITIAL NOTIFY EXT, ret = %d",
+		"GENA END INITIAL NOTIFY, ret = %d",
 		ret);
 
 	return ret;
 }
 
 
-int genaNotifyAllExt(
+int genaInitNotify(
 	UpnpDevice_Handle device_handle,
 	char *UDN,
 	char *servId,
-	IXML_Document *PropSet)
+	char **VarNames,
+	char **VarValues,
+	int var_count,
+	const Upnp_SID sid)
 {
-	int ret = GENA_SUCCESS;
-	int line = 0;
-
-	int *reference_count = NULL;
-	char *UDN_copy = NULL;
-	char *servId_copy = NULL;
+	int ret;
 	DOMString propertySet = NULL;
-	char *headers = NULL;
-	notify_thread_struct *thread_struct = NULL;
-
-	subscription *finger = NULL;
-	service_info *service = NULL;
-	struct Handle_Info *handle_info;
-	ThreadPoolJob job;
-
-	memset(&job, 0, sizeof(job));
+	notify_event *event = NULL;
 
 	UpnpPrintf(UPNP_INFO, GENA, __FILE__, __LINE__,
-		"GENA BEGIN NOTIFY ALL EXT");
+		"GENA BEGIN INITIAL NOTIFY");
 
-	reference_count = (int *)malloc(sizeof (int));
-	if (reference_count == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-		goto ExitFunction;
-	}
-	*reference_count = 0;
-	
-	UDN_copy = strdup(UDN);
-	if (UDN_copy == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-		goto ExitFunction;
+	if (var_count > 0) {
+		ret = GeneratePropertySet(VarNames, VarValues, var_count,
+			&propertySet);
+		if (ret != XML_SUCCESS)
+			return ret;
+		UpnpPrintf(UPNP_INFO, GENA, __FILE__, __LINE__,
+			"GENERATED PROPERTY SET IN INIT NOTIFY: %s",
+			propertySet);
+		event = NewNotifyEvent(propertySet);
+		if (event == NULL) {
+			ixmlFreeDOMString(propertySet);
+			return UPNP_E_OUTOF_MEMORY;
+		}
+		SetEventVariables(event, VarNames, VarValues, var_count);
 	}
 
-	servId_copy = strdup(servId);
-	if( servId_copy == NULL ) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-		goto ExitFunction;
-	}
+	return genaInitNotifyCommon(device_handle, UDN, servId, event, sid);
+}
+
+
+int genaInitNotifyExt(
+	UpnpDevice_Handle device_handle,
+	char *UDN,
+	char *servId,
+	IXML_Document *PropSet,
+	const Upnp_SID sid)
+{
+	DOMString propertySet = NULL;
+	notify_event *event = NULL;
 
-	propertySet = ixmlPrintNode((IXML_Node *)PropSet);
-	if (propertySet == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_INVALID_PARAM;
-		goto ExitFunction;
-	}
 	UpnpPrintf(UPNP_INFO, GENA, __FILE__, __LINE__,
-		"GENERATED PROPERTY SET IN EXT NOTIFY: %s",
-		propertySet);
+		"GENA BEGIN INITIAL NOTIFY EXT");
 
-	headers = AllocGenaHeaders(propertySet);
-	if (headers == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-		goto ExitFunction;
+	if (PropSet != 0) {
+		propertySet = ixmlPrintNode((IXML_Node *)PropSet);
+		if (propertySet == NULL)
+			return UPNP_E_INVALID_PARAM;
+		UpnpPrintf(UPNP_INFO, GENA, __FILE__, __LINE__,
+			"GENERATED PROPERTY SET IN INIT EXT NOTIFY: %s",
+			propertySet);
+		event = NewNotifyEvent(propertySet);
+		if (event == NULL) {
+			ixmlFreeDOMString(propertySet);
+			return UPNP_E_OUTOF_MEMORY;
+		}
+		SetEventVariablesExt(event, PropSet);
 	}
 
+	return genaInitNotifyCommon(device_handle, UDN, servId, event, sid);
+}
+
+
+/*!
+ * \brief Moderates an event and queues it for all the subscriptions of a
+ * service.
+ *
+ * \return GENA_SUCCESS if successful, otherwise the appropriate error code.
+ */
+static int genaNotifyAllCommon(
+	/*! [in] Device handle. */
+	UpnpDevice_Handle device_handle,
+	/*! [in] Device UDN. */
+	char *UDN,
+	/*! [in] Service ID. */
+	char *servId,
+	/*! [in] The event. Its reference is owned by this function. */
+	notify_event *event)
+{
+	int ret = GENA_SUCCESS;
+	int line = 0;
+
+	notify_event *moderated = NULL;
+
+	service_info *service = NULL;
+	struct Handle_Info *handle_info;
+
 	HandleLock();
 
 	if (GetHandleInfo(device_handle, &handle_info) != HND_DEVICE) {
@@ -827,46 +1646,18 @@ int genaNotifyAllExt(
 	} else {
 		service = FindServiceId(&handle_info->ServiceTable, servId, UDN);
 		if (service != NULL) {
-			finger = GetFirstSubscription(service);
-			while (finger) {
-				thread_struct = (notify_thread_struct *)malloc(sizeof (notify_thread_struct));
-				if (thread_struct == NULL) {
-					line = __LINE__;
-					ret = UPNP_E_OUTOF_MEMORY;
-					break;
-				}
-
-				(*reference_count)++;
-				thread_struct->reference_count = reference_count;
-				thread_struct->UDN = UDN_copy;
-				thread_struct->servId = servId_copy;
-				thread_struct->headers = headers;
-				thread_struct->propertySet = propertySet;
-				memset(thread_struct->sid, 0,
-					sizeof(thread_struct->sid));
-				strncpy(thread_struct->sid, finger->sid,
-					sizeof(thread_struct->sid) - 1);
-				thread_struct->eventKey = finger->eventKey++;
-				thread_struct->device_handle = device_handle;
-				/* if overflow, wrap to 1 */
-				if (finger->eventKey < 0) {
-					finger->eventKey = 1;
-				}
-
-				TPJobInit(&job, (start_routine)genaNotifyThread, thread_struct);
-				TPJobSetFreeFunction(&job, (free_routine)free_notify_struct);
-				TPJobSetPriority(&job, MED_PRIORITY);
-				ret = ThreadPoolAdd(&gSendThreadPool, &job, NULL);
-				if (ret != 0) {
+			if (service->moderation != NULL &&
+			    event->varCount > 0) {
+				moderated = ModerateEvent(device_handle, UDN,
+					servId, service, event);
+				releaseNotifyEvent(event);
+				event = moderated;
+			}
+			if (event != NULL) {
+				ret = QueueNotifyAll(device_handle, UDN, servId,
+					service, event);
+				if (ret != GENA_SUCCESS)
 					line = __LINE__;
-					if (ret == EOUTOFMEM) {
-						line = __LINE__;
-						ret = UPNP_E_OUTOF_MEMORY;
-					}
-					break;
-				}
-
-				finger = GetNextSubscription(service, finger);
 			}
 		} else {
 			line = __LINE__;
@@ -874,25 +1665,48 @@ int genaNotifyAllExt(
 		}
 	}
 
-ExitFunction:
-	if (ret != GENA_SUCCESS || *reference_count == 0) {
-		free(headers);
-		ixmlFreeDOMString(propertySet);
-		free(servId_copy);
-		free(UDN_copy);
-		free(reference_count);
-	}
+	if (event != NULL)
+		releaseNotifyEvent(event);
 
 	HandleUnlock();
 
 	UpnpPrintf(UPNP_INFO, GENA, __FILE__, line,
-		"GENA END NOTIFY ALL EXT, ret = %d",
+		"GENA END NOTIFY ALL, ret = %d",
 		ret);
 
 	return ret;
 }
 
 
+int genaNotifyAllExt(
+	UpnpDevice_Handle device_handle,
+	char *UDN,
+	char *servId,
+	IXML_Document *PropSet)
+{
+	DOMString propertySet = NULL;
+	notify_event *event;
+
+	UpnpPrintf(UPNP_INFO, GENA, __FILE__, __LINE__,
+		"GENA BEGIN NOTIFY ALL EXT");
+
+	propertySet = ixmlPrintNode((IXML_Node *)PropSet);
+	if (propertySet == NULL)
+		return UPNP_E_INVALID_PARAM;
+	UpnpPrintf(UPNP_INFO, GENA, __FILE__, __LINE__,
+		"GENERATED PROPERTY SET IN EXT NOTIFY: %s",
+		propertySet);
+	event = NewNotifyEvent(propertySet);
+	if (event == NULL) {
+		ixmlFreeDOMString(propertySet);
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	SetEventVariablesExt(event, PropSet);
+
+	return genaNotifyAllCommon(device_handle, UDN, servId, event);
+}
+
+
 int genaNotifyAll(
 	UpnpDevice_Handle device_handle,
 	char *UDN,
@@ -901,135 +1715,80 @@ int genaNotifyAll(
 	char **VarValues,
 	int var_count)
 {
-	int ret = GENA_SUCCESS;
-	int line = 0;
-
-	int *reference_count = NULL;
-	char *UDN_copy = NULL;
-	char *servId_copy = NULL;
+	int ret;
 	DOMString propertySet = NULL;
-	char *headers = NULL;
-	notify_thread_struct *thread_struct = NULL;
-
-	subscription *finger = NULL;
-	service_info *service = NULL;
-	struct Handle_Info *handle_info;
-	ThreadPoolJob job;
-
-	memset(&job, 0, sizeof(job));
+	notify_event *event;
 
 	UpnpPrintf(UPNP_INFO, GENA, __FILE__, __LINE__,
 		"GENA BEGIN NOTIFY ALL");
 
-	reference_count = (int *)malloc(sizeof (int));
-	if (reference_count == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-		goto ExitFunction;
-	}
-	*reference_count = 0;
-	
-	UDN_copy = strdup(UDN);
-	if (UDN_copy == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-		goto ExitFunction;
-	}
-
-	servId_copy = strdup(servId);
-	if( servId_copy == NULL ) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-		goto ExitFunction;
-	}
-
 	ret = GeneratePropertySet(VarNames, VarValues, var_count, &propertySet);
-	if (ret != XML_SUCCESS) {
-		line = __LINE__;
-		goto ExitFunction;
-	}
+	if (ret != XML_SUCCESS)
+		return ret;
 	UpnpPrintf(UPNP_INFO, GENA, __FILE__, __LINE__,
-		"GENERATED PROPERTY SET IN EXT NOTIFY: %s",
+		"GENERATED PROPERTY SET IN NOTIFY: %s",
 		propertySet);
-
-	headers = AllocGenaHeaders(propertySet);
-	if (headers == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-		goto ExitFunction;
+	event = NewNotifyEvent(propertySet);
+	if (event == NULL) {
+		ixmlFreeDOMString(propertySet);
+		return UPNP_E_OUTOF_MEMORY;
 	}
+	SetEventVariables(event, VarNames, VarValues, var_count);
 
-	HandleLock();
-
-	if (GetHandleInfo(device_handle, &handle_info) != HND_DEVICE) {
-		line = __LINE__;
-		ret = GENA_E_BAD_HANDLE;
-	} else {
-		service = FindServiceId(&handle_info->ServiceTable, servId, UDN);
-		if (service != NULL) {
-			finger = GetFirstSubscription(service);
-			while (finger) {
-				thread_struct = (notify_thread_struct *)malloc(sizeof (notify_thread_struct));
-				if (thread_struct == NULL) {
-					line = __LINE__;
-					ret = UPNP_E_OUTOF_MEMORY;
-					break;
-				}
+	return genaNotifyAllCommon(device_handle, UDN, servId, event);
+}
 
-				(*reference_count)++;
-				thread_struct->reference_count = reference_count;
-				thread_struct->UDN = UDN_copy;
-				thread_struct->servId = servId_copy;
-				thread_struct->headers = headers;
-				thread_struct->propertySet = propertySet;
-				memset(thread_struct->sid, 0,
-					sizeof(thread_struct->sid));
-				strncpy(thread_struct->sid, finger->sid,
-					sizeof(thread_struct->sid) - 1);
-				thread_struct->eventKey = finger->eventKey++;
-				thread_struct->device_handle = device_handle;
-				/* if overflow, wrap to 1 */
-				if (finger->eventKey < 0) {
-					finger->eventKey = 1;
-				}
 
+int genaSetEventModeration(
+	UpnpDevice_Handle device_handle,
+	const char *UDN,
+	const char *servId,
+	const char *varName,
+	int maxRate,
+	double minDelta)
+{
+	int ret = GENA_SUCCESS;
+	service_info *service;
+	struct Handle_Info *handle_info;
+	event_moderation *m;
 
-				TPJobInit(&job, (start_routine)genaNotifyThread, thread_struct);
-				TPJobSetFreeFunction(&job, (free_routine)free_notify_struct);
-				TPJobSetPriority(&job, MED_PRIORITY);
-				ret = ThreadPoolAdd(&gSendThreadPool, &job, NULL);
-				if (ret != 0) {
-					line = __LINE__;
-					if (ret == EOUTOFMEM) {
-						line = __LINE__;
-						ret = UPNP_E_OUTOF_MEMORY;
-					}
-					break;
-				}
+	HandleLock();
 
-				finger = GetNextSubscription(service, finger);
-			}
-		} else {
-			line = __LINE__;
-			ret = GENA_E_BAD_SERVICE;
+	if (GetHandleInfo(device_handle, &handle_info) != HND_DEVICE) {
+		ret = GENA_E_BAD_HANDLE;
+		goto ExitFunction;
+	}
+	service = FindServiceId(&handle_info->ServiceTable, servId, UDN);
+	if (service == NULL) {
+		ret = GENA_E_BAD_SERVICE;
+		goto ExitFunction;
+	}
+	m = FindEventModeration(service, varName);
+	if (m == NULL) {
+		m = (event_moderation *)malloc(sizeof (event_moderation));
+		if (m == NULL) {
+			ret = UPNP_E_OUTOF_MEMORY;
+			goto ExitFunction;
 		}
+		m->name = strdup(varName);
+		if (m->name == NULL) {
+			free(m);
+			ret = UPNP_E_OUTOF_MEMORY;
+			goto ExitFunction;
+		}
+		m->sentValue = NULL;
+		m->sentTime = 0;
+		m->pendingValue = NULL;
+		m->next = service->moderation;
+		service->moderation = m;
 	}
+	/* a held back value is sent when the new period ends */
+	m->maxRate = maxRate;
+	m->minDelta = minDelta;
 
 ExitFunction:
-	if (ret != GENA_SUCCESS || *reference_count == 0) {
-		free(headers);
-		ixmlFreeDOMString(propertySet);
-		free(servId_copy);
-		free(UDN_copy);
-		free(reference_count);
-	}
-
 	HandleUnlock();
 
-	UpnpPrintf(UPNP_INFO, GENA, __FILE__, line,
-		"GENA END NOTIFY ALL, ret = %d",
-		ret);
-
 	return ret;
 }
 
@@ -1278,8 +2037,11 @@ void gena_process_subscription_request(
 		goto exit_function;
 	}
 	sub->eventKey = 0;
-	sub->ToSendEventKey = 0;
 	sub->active = 0;
+	sub->queueHead = NULL;
+	sub->queueTail = NULL;
+	sub->queueLength = 0;
+	sub->sending = 0;
 	sub->next = NULL;
 	sub->DeliveryURLs.size = 0;
 	sub->DeliveryURLs.URLs = NULL;
@@ -1337,18 +2099,20 @@ void gena_process_subscription_request(
 	uuid_unpack(&uid, temp_sid);
 	rc = snprintf(sub->sid, sizeof(sub->sid), "uuid:%s", temp_sid);
 
-	/* respond OK */
+	/* add to subscription list */
 	if (rc < 0 || (unsigned int) rc >= sizeof(sub->sid) ||
-		(respond_ok(info, time_out,
-		sub, request) != UPNP_E_SUCCESS)) {
+	    AddSubscription(sub, service) != UPNP_E_SUCCESS) {
+		error_respond(info, HTTP_INTERNAL_SERVER_ERROR, request);
 		freeSubscriptionList(sub);
 		HandleUnlock();
 		goto exit_function;
 	}
-	/* add to subscription list */
-	sub->next = service->subscriptionList;
-	service->subscriptionList = sub;
-	service->TotalSubscriptions++;
+	/* respond OK */
+	if (respond_ok(info, time_out, sub, request) != UPNP_E_SUCCESS) {
+		RemoveSubscriptionSID(sub->sid, service);
+		HandleUnlock();
+		goto exit_function;
+	}
 
 	/* finally generate callback for init table dump */
 	request_struct.ServiceId = service->serviceId;
@@ -42,9 +42,20 @@
 
 
 #include "client_table.h"
+#include "registry.h"
 
 
 #ifdef INCLUDE_CLIENT_APIS
+
+#include <string.h> /* for memset() */
+
+
+void ClientSubTableInit(ClientSubTable *table)
+{
+	memset(table, 0, sizeof(*table));
+}
+
+
 #if EXCLUDE_GENA == 0
 
 #include <stdlib.h> /* for calloc(), free() */
@@ -55,7 +66,10 @@ struct SClientSubscription {
 	UpnpString *m_SID;
 	UpnpString *m_actualSID;
 	UpnpString *m_eventURL;
+	ClientEventSeq *m_eventSeq;
 	struct SClientSubscription *m_next;
+	/* Only maintained while the subscription is in a ClientSubTable. */
+	struct SClientSubscription *m_prev;
 };
 
 
@@ -119,8 +133,11 @@ void UpnpClientSubscription_assign(ClientSubscription *q, const ClientSubscripti
 		UpnpClientSubscription_set_SID(q, UpnpClientSubscription_get_SID(p));
 		UpnpClientSubscription_set_ActualSID(q, UpnpClientSubscription_get_ActualSID(p));
 		UpnpClientSubscription_set_EventURL(q, UpnpClientSubscription_get_EventURL(p));
+		/* Do not copy m_eventSeq, it belongs to the original */
+		((struct SClientSubscription *)q)->m_eventSeq = NULL;
 		/* Do not copy m_next */
 		((struct SClientSubscription *)q)->m_next = NULL;
+		((struct SClientSubscription *)q)->m_prev = NULL;
 	}
 }
 
@@ -230,6 +247,18 @@ void UpnpClientSubscription_set_Next(ClientSubscription *p, ClientSubscription *
 }
 
 
+ClientEventSeq *UpnpClientSubscription_get_EventSeq(const ClientSubscription *p)
+{
+	return ((struct SClientSubscription *)p)->m_eventSeq;
+}
+
+
+void UpnpClientSubscription_set_EventSeq(ClientSubscription *p, ClientEventSeq *s)
+{
+	((struct SClientSubscription *)p)->m_eventSeq = s;
+}
+
+
 void free_client_subscription(ClientSubscription *sub)
 {
 	upnp_timeout *event;
@@ -238,6 +267,10 @@ void free_client_subscription(ClientSubscription *sub)
 		int renewEventId = UpnpClientSubscription_get_RenewEventId(sub);
 		UpnpClientSubscription_strcpy_ActualSID(sub, "");
 		UpnpClientSubscription_strcpy_EventURL(sub, "");
+		if (UpnpClientSubscription_get_EventSeq(sub) != NULL) {
+			ClientEventSeq_delete(UpnpClientSubscription_get_EventSeq(sub));
+			UpnpClientSubscription_set_EventSeq(sub, NULL);
+		}
 		if (renewEventId != -1) {
 			/* do not remove timer event of copy */
 			/* invalid timer event id */
@@ -263,66 +296,124 @@ void freeClientSubList(ClientSubscription *list)
 }
 
 
-void RemoveClientSubClientSID(ClientSubscription **head, const UpnpString *sid)
+void ClientSubTableDestroy(ClientSubTable *table)
 {
-	ClientSubscription *finger = *head;
-	ClientSubscription *previous = NULL;
-	int found = 0;
-	while (finger) {
-		found = !strcmp(
-			UpnpString_get_String(sid),
-			UpnpClientSubscription_get_SID_cstr(finger));
-		if (found) {
-			if (previous) {
-				UpnpClientSubscription_set_Next(previous,
-					UpnpClientSubscription_get_Next(finger));
-			} else {
-				*head = UpnpClientSubscription_get_Next(finger);
-			}
-			UpnpClientSubscription_set_Next(finger, NULL);
-			freeClientSubList(finger);
-			finger = NULL;
-		} else {
-			previous = finger;
-			finger = UpnpClientSubscription_get_Next(finger);
-		}
-	}
+	HashTableDestroy(&table->bySID, NULL);
+	HashTableDestroy(&table->byActualSID, NULL);
+	freeClientSubList(table->head);
+	table->head = NULL;
 }
 
 
-ClientSubscription *GetClientSubClientSID(ClientSubscription *head, const UpnpString *sid)
+/*!
+ * \brief Allocates the indexes of the table on the first subscription.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_OUTOF_MEMORY.
+ */
+static int ClientSubTableReserve(ClientSubTable *table)
 {
-	ClientSubscription *next = head;
-	int found = 0;
-	while (next) {
-		found = !strcmp(
-			UpnpClientSubscription_get_SID_cstr(next),
-			UpnpString_get_String(sid));
-		if(found) {
-			break;
-		} else {
-			next = UpnpClientSubscription_get_Next(next);
-		}
-	}
+	if (table->bySID.slots == NULL &&
+	    HashTableInit(&table->bySID, 0) != 0)
+		return UPNP_E_OUTOF_MEMORY;
+	if (table->byActualSID.slots == NULL &&
+	    HashTableInit(&table->byActualSID, 0) != 0)
+		return UPNP_E_OUTOF_MEMORY;
+
+	return UPNP_E_SUCCESS;
+}
 
-	return next;
+
+/*!
+ * \brief Removes the actual SID index entry of a subscription, unless the
+ * entry belongs to another subscription with the same actual SID.
+ */
+static void UnindexActualSID(ClientSubTable *table, ClientSubscription *sub)
+{
+	const char *actualSID = UpnpClientSubscription_get_ActualSID_cstr(sub);
+
+	if (HashTableFind(&table->byActualSID, actualSID) == sub)
+		HashTableRemove(&table->byActualSID, actualSID);
 }
 
 
-ClientSubscription *GetClientSubActualSID(ClientSubscription *head, token *sid)
+int AddClientSub(ClientSubTable *table, ClientSubscription *sub)
 {
-	ClientSubscription *next = head;
-	while (next) {
-		if (!memcmp(
-			UpnpClientSubscription_get_ActualSID_cstr(next),
-			sid->buff, sid->size)) {
-			break;
-		} else {
-			next = UpnpClientSubscription_get_Next(next);
-		}
+	struct SClientSubscription *p = (struct SClientSubscription *)sub;
+
+	if (ClientSubTableReserve(table) != UPNP_E_SUCCESS)
+		return UPNP_E_OUTOF_MEMORY;
+	if (HashTableAdd(&table->bySID,
+		UpnpClientSubscription_get_SID_cstr(sub), sub, NULL) != 0)
+		return UPNP_E_OUTOF_MEMORY;
+	if (HashTableAdd(&table->byActualSID,
+		UpnpClientSubscription_get_ActualSID_cstr(sub), sub, NULL) != 0) {
+		HashTableRemove(&table->bySID,
+			UpnpClientSubscription_get_SID_cstr(sub));
+		return UPNP_E_OUTOF_MEMORY;
 	}
+	p->m_prev = NULL;
+	p->m_next = (struct SClientSubscription *)table->head;
+	if (p->m_next)
+		p->m_next->m_prev = p;
+	table->head = sub;
+
+	return UPNP_E_SUCCESS;
+}
+
+
+int SetClientSubActualSID(
+	ClientSubTable *table,
+	ClientSubscription *sub,
+	const UpnpString *actualSID)
+{
+	UnindexActualSID(table, sub);
+	/* the index points into the string, so it is replaced afterwards */
+	UpnpClientSubscription_set_ActualSID(sub, actualSID);
+	if (HashTableAdd(&table->byActualSID,
+		UpnpClientSubscription_get_ActualSID_cstr(sub), sub, NULL) != 0)
+		return UPNP_E_OUTOF_MEMORY;
+
+	return UPNP_E_SUCCESS;
+}
+
+
+void RemoveClientSubClientSID(ClientSubTable *table, const UpnpString *sid)
+{
+	struct SClientSubscription *p;
+
+	p = (struct SClientSubscription *)GetClientSubClientSID(table, sid);
+	if (!p)
+		return;
+	RegistryClearSubscription(UpnpString_get_String(p->m_SID));
+	HashTableRemove(&table->bySID, UpnpString_get_String(p->m_SID));
+	UnindexActualSID(table, (ClientSubscription *)p);
+	if (p->m_prev)
+		p->m_prev->m_next = p->m_next;
+	else
+		table->head = (ClientSubscription *)p->m_next;
+	if (p->m_next)
+		p->m_next->m_prev = p->m_prev;
+	p->m_next = NULL;
+	p->m_prev = NULL;
+	freeClientSubList((ClientSubscription *)p);
+}
+
+
+ClientSubscription *GetClientSubClientSID(ClientSubTable *table, const UpnpString *sid)
+{
+	if (table->bySID.slots == NULL)
+		return NULL;
+
+	return HashTableFind(&table->bySID, UpnpString_get_String(sid));
+}
+
+
+ClientSubscription *GetClientSubActualSID(ClientSubTable *table, token *sid)
+{
+	if (table->byActualSID.slots == NULL)
+		return NULL;
 
-	return next;
+	return HashTableFindN(&table->byActualSID, sid->buff, sid->size);
 }
 
 #endif /* EXCLUDE_GENA */
@@ -0,0 +1,395 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Cache of the description documents downloaded by the control point.
+ */
+
+
+#include "config.h"
+
+
+#include "desc_cache.h"
+
+
+#ifdef INCLUDE_CLIENT_APIS
+
+
+#include "HashTable.h"
+#include "httpreadwrite.h"
+#include "ithread.h"
+#include "LinkedList.h"
+#include "statcodes.h"
+#include "upnpapi.h"
+#include "upnpdebug.h"
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+/*!
+ * \brief Cached description document.
+ */
+typedef struct s_DescCacheEntry {
+	/*! "LOCATION\nUSN", key of the entry in gDescCache. */
+	char *key;
+	/*! Length of the LOCATION part of key. */
+	size_t urlLength;
+	/*! Parsed document, never handed out to the application. */
+	IXML_Document *doc;
+	/*! ETAG header of the last response. */
+	char etag[LINE_SIZE];
+	/*! LAST-MODIFIED header of the last response. */
+	char lastModified[LINE_SIZE];
+	/*! Time after which the document must be revalidated. */
+	time_t expires;
+	/*! Node of the entry in gDescCacheLru. */
+	ListNode *lruNode;
+} DescCacheEntry;
+
+
+/*! Entries by key. */
+static HashTable gDescCache;
+/*! Entries from the least to the most recently used. */
+static LinkedList gDescCacheLru;
+/*! Protects gDescCache and gDescCacheLru. */
+static ithread_mutex_t gDescCacheMutex;
+
+
+static void DescCacheEntry_delete(void *arg)
+{
+	DescCacheEntry *entry = (DescCacheEntry *)arg;
+
+	ixmlDocument_free(entry->doc);
+	free(entry->key);
+	free(entry);
+}
+
+
+/*!
+ * \brief Builds the cache key of (url, usn).
+ *
+ * \return The key, to be freed by the caller, or NULL if out of memory.
+ */
+static char *make_key(const char *url, const char *usn)
+{
+	size_t urlLength = strlen(url);
+	size_t usnLength = usn ? strlen(usn) : (size_t)0;
+	char *key = malloc(urlLength + usnLength + (size_t)2);
+
+	if (!key)
+		return NULL;
+	memcpy(key, url, urlLength);
+	key[urlLength] = '\n';
+	if (usnLength)
+		memcpy(key + urlLength + 1, usn, usnLength);
+	key[urlLength + 1 + usnLength] = '\0';
+
+	return key;
+}
+
+
+/*!
+ * \brief Copies a cached document for the application, so that the cached
+ * one is never modified or freed behind our back.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_OUTOF_MEMORY.
+ */
+static int clone_doc(IXML_Document *doc, IXML_Document **copy)
+{
+	IXML_Node *root;
+	IXML_Node *newRoot = NULL;
+
+	if (ixmlDocument_createDocumentEx(copy) != IXML_SUCCESS)
+		return UPNP_E_OUTOF_MEMORY;
+	root = ixmlNode_getFirstChild((IXML_Node *)doc);
+	if (root) {
+		if (ixmlDocument_importNode(*copy, root, TRUE, &newRoot) !=
+			IXML_SUCCESS ||
+		    ixmlNode_appendChild((IXML_Node *)*copy, newRoot) !=
+			IXML_SUCCESS) {
+			ixmlNode_free(newRoot);
+			ixmlDocument_free(*copy);
+			*copy = NULL;
+			return UPNP_E_OUTOF_MEMORY;
+		}
+	}
+
+	return UPNP_E_SUCCESS;
+}
+
+
+/*!
+ * \brief Drops the least recently used entries until the cache fits in
+ * DESC_CACHE_MAX_ENTRIES. Must be called with gDescCacheMutex held.
+ */
+static void evict_entries(void)
+{
+	ListNode *node;
+	DescCacheEntry *entry;
+
+	while (HashTableSize(&gDescCache) > DESC_CACHE_MAX_ENTRIES) {
+		node = ListHead(&gDescCacheLru);
+		if (!node)
+			break;
+		entry = (DescCacheEntry *)node->item;
+		ListDelNode(&gDescCacheLru, node, 0);
+		HashTableRemove(&gDescCache, entry->key);
+		DescCacheEntry_delete(entry);
+	}
+}
+
+
+/*!
+ * \brief Stores a copy of doc under key, replacing any previous entry.
+ * Failures are not reported: the document is simply not cached.
+ */
+static void store_doc(
+	/*! [in] Cache key, ownership is taken. */
+	char *key,
+	/*! [in] Length of the LOCATION part of key. */
+	size_t urlLength,
+	/*! [in] Document to cache, a copy is stored. */
+	IXML_Document *doc,
+	/*! [in] ETAG header of the response. */
+	const char *etag,
+	/*! [in] LAST-MODIFIED header of the response. */
+	const char *lastModified,
+	/*! [in] Expiration time of the document. */
+	time_t expires)
+{
+	DescCacheEntry *entry;
+	DescCacheEntry *old = NULL;
+
+	entry = calloc((size_t)1, sizeof(DescCacheEntry));
+	if (!entry || clone_doc(doc, &entry->doc) != UPNP_E_SUCCESS) {
+		free(entry);
+		free(key);
+		return;
+	}
+	entry->key = key;
+	entry->urlLength = urlLength;
+	strncpy(entry->etag, etag, LINE_SIZE - (size_t)1);
+	strncpy(entry->lastModified, lastModified, LINE_SIZE - (size_t)1);
+	entry->expires = expires;
+
+	ithread_mutex_lock(&gDescCacheMutex);
+	entry->lruNode = ListAddTail(&gDescCacheLru, entry);
+	if (!entry->lruNode ||
+	    HashTableAdd(&gDescCache, entry->key, entry, (void **)&old) != 0) {
+		if (entry->lruNode)
+			ListDelNode(&gDescCacheLru, entry->lruNode, 0);
+		DescCacheEntry_delete(entry);
+	} else if (old) {
+		ListDelNode(&gDescCacheLru, old->lruNode, 0);
+		DescCacheEntry_delete(old);
+	}
+	evict_entries();
+	ithread_mutex_unlock(&gDescCacheMutex);
+}
+
+
+/*!
+ * \brief Parses a downloaded description document.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_OUTOF_MEMORY or UPNP_E_INVALID_DESC.
+ */
+static int parse_doc(const char *xml_buf, IXML_Document **xmlDoc)
+{
+	int ret_code;
+
+	ret_code = ixmlParseBufferEx(xml_buf, xmlDoc);
+	if (ret_code == IXML_SUCCESS)
+		return UPNP_E_SUCCESS;
+	if (ret_code == IXML_INSUFFICIENT_MEMORY) {
+		UpnpPrintf(UPNP_CRITICAL, API, __FILE__, __LINE__,
+			"Out of memory, ixml error code: %d\n", ret_code);
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	UpnpPrintf(UPNP_CRITICAL, API, __FILE__, __LINE__,
+		"Invalid Description, ixml error code: %d\n", ret_code);
+
+	return UPNP_E_INVALID_DESC;
+}
+
+
+int DescCacheInit(void)
+{
+	if (ithread_mutex_init(&gDescCacheMutex, NULL) != 0)
+		return UPNP_E_INIT_FAILED;
+	if (HashTableInit(&gDescCache, DESC_CACHE_MAX_ENTRIES) != 0) {
+		ithread_mutex_destroy(&gDescCacheMutex);
+		return UPNP_E_INIT_FAILED;
+	}
+	ListInit(&gDescCacheLru, NULL, NULL);
+
+	return UPNP_E_SUCCESS;
+}
+
+
+void DescCacheDestroy(void)
+{
+	ithread_mutex_lock(&gDescCacheMutex);
+	ListDestroy(&gDescCacheLru, 0);
+	HashTableDestroy(&gDescCache, DescCacheEntry_delete);
+	ithread_mutex_unlock(&gDescCacheMutex);
+	ithread_mutex_destroy(&gDescCacheMutex);
+}
+
+
+int DescCacheDownload(
+	const char *url,
+	const char *usn,
+	int maxAge,
+	IXML_Document **xmlDoc)
+{
+	int ret_code;
+	char *key;
+	DescCacheEntry *entry;
+	char etag[LINE_SIZE];
+	char lastModified[LINE_SIZE];
+	char *xml_buf = NULL;
+	size_t xml_length;
+	time_t now;
+
+	if (maxAge <= 0)
+		maxAge = DEFAULT_MAXAGE;
+	key = make_key(url, usn);
+	if (!key)
+		return UPNP_E_OUTOF_MEMORY;
+	etag[0] = '\0';
+	lastModified[0] = '\0';
+
+	ithread_mutex_lock(&gDescCacheMutex);
+	entry = (DescCacheEntry *)HashTableFind(&gDescCache, key);
+	if (entry) {
+		if (time(NULL) < entry->expires) {
+			/* fresh hit */
+			ListDelNode(&gDescCacheLru, entry->lruNode, 0);
+			entry->lruNode = ListAddTail(&gDescCacheLru, entry);
+			ret_code = clone_doc(entry->doc, xmlDoc);
+			if (!entry->lruNode) {
+				HashTableRemove(&gDescCache, entry->key);
+				DescCacheEntry_delete(entry);
+			}
+			ithread_mutex_unlock(&gDescCacheMutex);
+			free(key);
+			return ret_code;
+		}
+		/* stale, revalidate with the validators of the cached copy */
+		strcpy(etag, entry->etag);
+		strcpy(lastModified, entry->lastModified);
+	}
+	ithread_mutex_unlock(&gDescCacheMutex);
+
+	UpnpPrintf(UPNP_INFO, API, __FILE__, __LINE__,
+		"Description cache miss for %s\n", url);
+	ret_code = http_DownloadEx(url, HTTP_DEFAULT_TIMEOUT, etag,
+		lastModified, &xml_buf, &xml_length, NULL, etag, lastModified);
+	now = time(NULL);
+	if (ret_code == HTTP_NOT_MODIFIED) {
+		ithread_mutex_lock(&gDescCacheMutex);
+		entry = (DescCacheEntry *)HashTableFind(&gDescCache, key);
+		if (entry) {
+			entry->expires = now + maxAge;
+			ret_code = clone_doc(entry->doc, xmlDoc);
+			ithread_mutex_unlock(&gDescCacheMutex);
+			free(key);
+			return ret_code;
+		}
+		ithread_mutex_unlock(&gDescCacheMutex);
+		/* evicted meanwhile, fetch it again */
+		ret_code = http_DownloadEx(url, HTTP_DEFAULT_TIMEOUT, NULL,
+			NULL, &xml_buf, &xml_length, NULL, etag, lastModified);
+	}
+	if (ret_code != UPNP_E_SUCCESS) {
+		UpnpPrintf(UPNP_CRITICAL, API, __FILE__, __LINE__,
+			"Error downloading document, retCode: %d\n", ret_code);
+		free(xml_buf);
+		free(key);
+		if (ret_code > 0)
+			/* error reply was received */
+			ret_code = UPNP_E_INVALID_URL;
+		return ret_code;
+	}
+	ret_code = parse_doc(xml_buf, xmlDoc);
+	free(xml_buf);
+	if (ret_code != UPNP_E_SUCCESS) {
+		free(key);
+		return ret_code;
+	}
+	store_doc(key, strlen(url), *xmlDoc, etag, lastModified, now + maxAge);
+
+	return UPNP_E_SUCCESS;
+}
+
+
+void DescCacheInvalidate(const char *url, const char *usn)
+{
+	char *key;
+	long pos = 0;
+	size_t urlLength = url ? strlen(url) : (size_t)0;
+	DescCacheEntry *entry;
+
+	ithread_mutex_lock(&gDescCacheMutex);
+	if (url && usn) {
+		key = make_key(url, usn);
+		if (key) {
+			entry = HashTableRemove(&gDescCache, key);
+			if (entry) {
+				ListDelNode(&gDescCacheLru, entry->lruNode, 0);
+				DescCacheEntry_delete(entry);
+			}
+			free(key);
+		}
+	} else {
+		while ((entry = HashTableIterNext(&gDescCache, &pos)) != NULL) {
+			if (url && (entry->urlLength != urlLength ||
+			    strncmp(entry->key, url, urlLength) != 0))
+				continue;
+			if (usn && strcmp(entry->key + entry->urlLength + 1,
+			    usn) != 0)
+				continue;
+			HashTableRemove(&gDescCache, entry->key);
+			ListDelNode(&gDescCacheLru, entry->lruNode, 0);
+			DescCacheEntry_delete(entry);
+		}
+	}
+	ithread_mutex_unlock(&gDescCacheMutex);
+}
+
+
+#endif /* INCLUDE_CLIENT_APIS */
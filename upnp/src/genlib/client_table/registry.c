@@ -0,0 +1,1032 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+
+/*!
+ * \file
+ *
+ * \brief Registry of the devices and services discovered by the control
+ * point.
+ */
+
+
+#include "config.h"
+
+
+#include "registry.h"
+
+
+#ifdef INCLUDE_CLIENT_APIS
+
+
+#include "HashTable.h"
+#include "ithread.h"
+#include "TimerThread.h"
+#include "upnpapi.h"
+#include "upnpdebug.h"
+#include "uri.h"
+
+
+#include <stdlib.h>
+#include <string.h>
+
+
+struct s_RegistryDevice;
+
+
+/*!
+ * \brief Registered service.
+ */
+typedef struct s_RegistryService {
+	/*! "UDN::serviceType", key in gRegistryServices. */
+	char *usn;
+	/*! serviceType. */
+	char *serviceType;
+	/*! serviceId, NULL until the description is known. */
+	char *serviceId;
+	/*! Absolute controlURL, key in gRegistryControlURLs. */
+	char *controlURL;
+	/*! Absolute eventSubURL, key in gRegistryEventURLs. */
+	char *eventURL;
+	/*! Client SID of the subscription, key in gRegistrySids. */
+	char *sid;
+	/*! Device offering the service. */
+	struct s_RegistryDevice *device;
+	/*! Next service of the device. */
+	struct s_RegistryService *next;
+} RegistryService;
+
+
+/*!
+ * \brief Registered device.
+ */
+typedef struct s_RegistryDevice {
+	/*! UDN, key in gRegistryDevices. */
+	char *udn;
+	/*! deviceType, NULL if unknown. */
+	char *deviceType;
+	/*! friendlyName, NULL until the description is known. */
+	char *friendlyName;
+	/*! LOCATION of the description document. */
+	char *location;
+	/*! Time the device expires, in ms. */
+	int64_t expires;
+	/*! Time the pending expiration timer is due, in ms, 0 if none. */
+	int64_t timerDue;
+	/*! Identifies this instance among the devices with the same UDN. */
+	unsigned long generation;
+	/*! Services of the device. */
+	RegistryService *services;
+} RegistryDevice;
+
+
+/*!
+ * \brief Argument of the expiration timer of a device.
+ */
+typedef struct s_RegistryTimer {
+	/*! UDN of the device. */
+	char *udn;
+	/*! Generation of the device. */
+	unsigned long generation;
+	/*! Time the timer is due, in ms. */
+	int64_t due;
+} RegistryTimer;
+
+
+/*! Devices by UDN. */
+static HashTable gRegistryDevices;
+/*! Services by USN. */
+static HashTable gRegistryServices;
+/*! Services by control URL. */
+static HashTable gRegistryControlURLs;
+/*! Services by event URL. */
+static HashTable gRegistryEventURLs;
+/*! Services by client SID. */
+static HashTable gRegistrySids;
+/*! Protects the registry. Lookups only take it for reading. It may be
+ * taken with HandleLock held, so it is never held while taking HandleLock
+ * or calling the application. */
+static ithread_rwlock_t gRegistryLock;
+/*! TRUE when the discoveries are recorded. */
+static int gRegistryEnabled = FALSE;
+/*! Last device generation. */
+static unsigned long gRegistryGeneration = 0;
+
+
+/*!
+ * \brief Replaces a string field.
+ *
+ * \return 0, or -1 if out of memory, in which case the field is unchanged.
+ */
+static int set_string(
+	/*! [in,out] Field. */
+	char **field,
+	/*! [in] New value, NULL to clear the field. */
+	const char *value)
+{
+	char *copy = NULL;
+
+	if (*field && value && strcmp(*field, value) == 0)
+		return 0;
+	if (value) {
+		copy = strdup(value);
+		if (!copy)
+			return -1;
+	}
+	free(*field);
+	*field = copy;
+
+	return 0;
+}
+
+
+/*!
+ * \brief Removes key from index if it refers to item.
+ */
+static void unindex(HashTable *index, const char *key, void *item)
+{
+	if (key && HashTableFind(index, key) == item)
+		HashTableRemove(index, key);
+}
+
+
+/*!
+ * \brief Replaces a string field that is a key of index. The item that
+ * was indexed by the new value, if any, loses that key.
+ *
+ * \return 0, or -1 if out of memory, in which case the field is cleared.
+ */
+static int set_indexed_string(
+	/*! [in] Index of the field. */
+	HashTable *index,
+	/*! [in,out] Field. */
+	char **field,
+	/*! [in] New value, NULL to clear the field. */
+	const char *value,
+	/*! [in] Item owning the field. */
+	void *item)
+{
+	if (*field && value && strcmp(*field, value) == 0)
+		return 0;
+	unindex(index, *field, item);
+	free(*field);
+	*field = NULL;
+	if (!value || !*value)
+		return 0;
+	*field = strdup(value);
+	if (!*field || HashTableAdd(index, *field, item, NULL) != 0) {
+		free(*field);
+		*field = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/*!
+ * \brief Returns the length of the UDN part of a USN.
+ */
+static size_t udn_length(const char *usn)
+{
+	const char *end = strstr(usn, "::");
+
+	return end ? (size_t)(end - usn) : strlen(usn);
+}
+
+
+/*!
+ * \brief Copies a string into a fixed size buffer of the public API.
+ */
+static void copy_string(char *dest, size_t size, const char *src)
+{
+	size_t length = src ? strlen(src) : (size_t)0;
+
+	/* no strncpy(), the lookups should not pay for the padding */
+	if (length >= size)
+		length = size - (size_t)1;
+	memcpy(dest, src, length);
+	dest[length] = '\0';
+}
+
+
+static void free_registry_timer(RegistryTimer *timer)
+{
+	free(timer->udn);
+	free(timer);
+}
+
+
+/*!
+ * \brief Removes a service from the indexes and frees it.
+ */
+static void remove_service(RegistryService *service)
+{
+	unindex(&gRegistryServices, service->usn, service);
+	unindex(&gRegistryControlURLs, service->controlURL, service);
+	unindex(&gRegistryEventURLs, service->eventURL, service);
+	unindex(&gRegistrySids, service->sid, service);
+	free(service->usn);
+	free(service->serviceType);
+	free(service->serviceId);
+	free(service->controlURL);
+	free(service->eventURL);
+	free(service->sid);
+	free(service);
+}
+
+
+/*!
+ * \brief Removes a device and its services from the indexes and frees
+ * them. A pending timer of the device finds nothing when it fires.
+ */
+static void remove_device(RegistryDevice *device)
+{
+	RegistryService *service;
+
+	while ((service = device->services) != NULL) {
+		device->services = service->next;
+		remove_service(service);
+	}
+	unindex(&gRegistryDevices, device->udn, device);
+	free(device->udn);
+	free(device->deviceType);
+	free(device->friendlyName);
+	free(device->location);
+	free(device);
+}
+
+
+/*!
+ * \brief Removes every device.
+ */
+static void remove_all_devices(void)
+{
+	long pos = 0;
+	RegistryDevice *device;
+
+	while ((device = HashTableIterNext(&gRegistryDevices, &pos)) != NULL)
+		remove_device(device);
+}
+
+
+/*!
+ * \brief Returns the device with the given UDN, creating it if needed.
+ *
+ * \return The device or NULL if out of memory.
+ */
+static RegistryDevice *get_device(
+	/*! [in] UDN of the device. */
+	const char *udn,
+	/*! [out] TRUE if the device was created. */
+	int *created)
+{
+	RegistryDevice *device;
+
+	*created = FALSE;
+	device = HashTableFind(&gRegistryDevices, udn);
+	if (device)
+		return device;
+	device = calloc((size_t)1, sizeof(RegistryDevice));
+	if (!device)
+		return NULL;
+	device->udn = strdup(udn);
+	if (!device->udn ||
+	    HashTableAdd(&gRegistryDevices, device->udn, device, NULL) != 0) {
+		free(device->udn);
+		free(device);
+		return NULL;
+	}
+	device->generation = ++gRegistryGeneration;
+	*created = TRUE;
+
+	return device;
+}
+
+
+/*!
+ * \brief Returns the service of a device with the given type, creating it
+ * if needed.
+ *
+ * \return The service or NULL if out of memory.
+ */
+static RegistryService *get_service(
+	/*! [in] Device offering the service. */
+	RegistryDevice *device,
+	/*! [in] serviceType of the service. */
+	const char *serviceType)
+{
+	RegistryService *service;
+	size_t udnLength = strlen(device->udn);
+	size_t typeLength = strlen(serviceType);
+
+	for (service = device->services; service; service = service->next)
+		if (strcmp(service->serviceType, serviceType) == 0)
+			return service;
+	service = calloc((size_t)1, sizeof(RegistryService));
+	if (!service)
+		return NULL;
+	service->usn = malloc(udnLength + typeLength + (size_t)3);
+	service->serviceType = strdup(serviceType);
+	if (!service->usn || !service->serviceType) {
+		free(service->usn);
+		free(service->serviceType);
+		free(service);
+		return NULL;
+	}
+	memcpy(service->usn, device->udn, udnLength);
+	memcpy(service->usn + udnLength, "::", (size_t)2);
+	memcpy(service->usn + udnLength + 2, serviceType, typeLength + 1);
+	if (HashTableAdd(&gRegistryServices, service->usn, service,
+		NULL) != 0) {
+		free(service->usn);
+		free(service->serviceType);
+		free(service);
+		return NULL;
+	}
+	service->device = device;
+	service->next = device->services;
+	device->services = service;
+
+	return service;
+}
+
+
+static void RegistryExpireThread(void *arg);
+
+
+/*!
+ * \brief Schedules the expiration timer of a device, unless one is already
+ * due no later than the device expires.
+ */
+static void schedule_expiry(
+	/*! [in] Device. */
+	RegistryDevice *device,
+	/*! [in] Current time, in ms. */
+	int64_t now)
+{
+	RegistryTimer *timer;
+	ThreadPoolJob job;
+
+	if (device->timerDue != 0 && device->timerDue <= device->expires)
+		return;
+	timer = (RegistryTimer *)malloc(sizeof (RegistryTimer));
+	if (timer == NULL)
+		return;
+	timer->udn = strdup(device->udn);
+	if (timer->udn == NULL) {
+		free(timer);
+		return;
+	}
+	timer->generation = device->generation;
+	timer->due = device->expires;
+	memset(&job, 0, sizeof(job));
+	TPJobInit(&job, (start_routine)RegistryExpireThread, timer);
+	TPJobSetFreeFunction(&job, (free_routine)free_registry_timer);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	if (TimerThreadSchedule(&gTimerThread,
+		timer->due > now ? (time_t)(timer->due - now) : 0, REL_MSEC,
+		&job, SHORT_TERM, NULL) != 0) {
+		/* the device stays until its next advertisement or byebye */
+		free_registry_timer(timer);
+		return;
+	}
+	device->timerDue = timer->due;
+}
+
+
+/*!
+ * \brief Sets the expiration time of a device.
+ */
+static void refresh_device(
+	/*! [in] Device. */
+	RegistryDevice *device,
+	/*! [in] Lifetime in seconds, <= 0 for DEFAULT_MAXAGE. */
+	int seconds,
+	/*! [in] Current time, in ms. */
+	int64_t now)
+{
+	if (seconds <= 0)
+		seconds = DEFAULT_MAXAGE;
+	device->expires = now + (int64_t)seconds * 1000;
+	schedule_expiry(device, now);
+}
+
+
+/*!
+ * \brief Timer of a device: removes it if it has expired and tells the
+ * control point with a UPNP_DISCOVERY_DEVICE_EXPIRED callback, otherwise
+ * waits for the new expiration time.
+ */
+static void RegistryExpireThread(
+	/*! [in] RegistryTimer of the device. */
+	void *arg)
+{
+	RegistryTimer *timer = (RegistryTimer *)arg;
+	RegistryDevice *device;
+	struct Upnp_Discovery param;
+	UpnpClient_Handle handle;
+	struct Handle_Info *handle_info;
+	Upnp_FunPtr callback;
+	void *cookie;
+	int64_t now;
+
+	ithread_rwlock_wrlock(&gRegistryLock);
+	device = gRegistryEnabled ?
+		HashTableFind(&gRegistryDevices, timer->udn) : NULL;
+	if (device == NULL || device->generation != timer->generation ||
+	    device->timerDue != timer->due) {
+		/* removed, replaced or superseded by an earlier timer */
+		ithread_rwlock_unlock(&gRegistryLock);
+		goto ExitFunction;
+	}
+	device->timerDue = 0;
+	now = imillinow();
+	if (device->expires > now) {
+		/* refreshed meanwhile */
+		schedule_expiry(device, now);
+		ithread_rwlock_unlock(&gRegistryLock);
+		goto ExitFunction;
+	}
+	memset(&param, 0, sizeof(param));
+	param.ErrCode = UPNP_E_SUCCESS;
+	copy_string(param.DeviceId, sizeof(param.DeviceId), device->udn);
+	copy_string(param.DeviceType, sizeof(param.DeviceType),
+		device->deviceType);
+	copy_string(param.Location, sizeof(param.Location), device->location);
+	remove_device(device);
+	ithread_rwlock_unlock(&gRegistryLock);
+	UpnpPrintf(UPNP_INFO, API, __FILE__, __LINE__,
+		"Registry: device %s expired\n", param.DeviceId);
+
+	HandleReadLock();
+	if (GetClientHandleInfo(&handle, &handle_info) != HND_CLIENT) {
+		HandleUnlock();
+		goto ExitFunction;
+	}
+	callback = handle_info->Callback;
+	cookie = handle_info->Cookie;
+	HandleUnlock();
+	callback(UPNP_DISCOVERY_DEVICE_EXPIRED, &param, cookie);
+
+ExitFunction:
+	free_registry_timer(timer);
+}
+
+
+/*!
+ * \brief Returns TRUE if node is an element with the given local name.
+ */
+static int is_element(IXML_Node *node, const char *name)
+{
+	const char *nodeName;
+
+	if (ixmlNode_getNodeType(node) != eELEMENT_NODE)
+		return FALSE;
+	nodeName = ixmlNode_getLocalName(node);
+	if (!nodeName)
+		nodeName = ixmlNode_getNodeName(node);
+
+	return nodeName && strcmp(nodeName, name) == 0;
+}
+
+
+/*!
+ * \brief Returns the first child element of node with the given name.
+ */
+static IXML_Node *child_element(IXML_Node *node, const char *name)
+{
+	IXML_Node *child;
+
+	for (child = ixmlNode_getFirstChild(node); child;
+	     child = ixmlNode_getNextSibling(child))
+		if (is_element(child, name))
+			return child;
+
+	return NULL;
+}
+
+
+/*!
+ * \brief Returns the text of the first child element of node with the
+ * given name, or NULL.
+ */
+static const char *child_value(IXML_Node *node, const char *name)
+{
+	IXML_Node *text;
+
+	node = child_element(node, name);
+	if (!node)
+		return NULL;
+	text = ixmlNode_getFirstChild(node);
+	if (!text || ixmlNode_getNodeType(text) != eTEXT_NODE)
+		return NULL;
+
+	return ixmlNode_getNodeValue(text);
+}
+
+
+/*!
+ * \brief Resolves a URL of the description and stores it in an indexed
+ * field.
+ *
+ * \return 0, or -1 if out of memory.
+ */
+static int set_url(
+	/*! [in] Index of the field. */
+	HashTable *index,
+	/*! [in,out] Field. */
+	char **field,
+	/*! [in] Base URL of the description. */
+	const char *base,
+	/*! [in] URL from the description, may be relative or NULL. */
+	const char *url,
+	/*! [in] Service owning the field. */
+	RegistryService *service)
+{
+	char *absolute;
+	int ret;
+
+	if (!url)
+		return 0;
+	absolute = resolve_rel_url((char *)base, (char *)url);
+	if (!absolute)
+		/* unusable URL, keep it as is */
+		return set_indexed_string(index, field, url, service);
+	ret = set_indexed_string(index, field, absolute, service);
+	free(absolute);
+
+	return ret;
+}
+
+
+/*!
+ * \brief Registers a device element of a description document.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_OUTOF_MEMORY.
+ */
+static int add_described_device(
+	/*! [in] device element. */
+	IXML_Node *node,
+	/*! [in] URL the document was downloaded from. */
+	const char *location,
+	/*! [in] Base URL of the relative URLs of the document. */
+	const char *base,
+	/*! [in] Lifetime of a new device in seconds. */
+	int seconds,
+	/*! [in] Current time, in ms. */
+	int64_t now)
+{
+	RegistryDevice *device;
+	RegistryService *service;
+	IXML_Node *child;
+	const char *udn;
+	const char *serviceType;
+	int created;
+	int err = 0;
+
+	udn = child_value(node, "UDN");
+	if (!udn)
+		return UPNP_E_SUCCESS;
+	device = get_device(udn, &created);
+	if (!device)
+		return UPNP_E_OUTOF_MEMORY;
+	err |= set_string(&device->location, location);
+	if (child_value(node, "deviceType"))
+		err |= set_string(&device->deviceType,
+			child_value(node, "deviceType"));
+	if (child_value(node, "friendlyName"))
+		err |= set_string(&device->friendlyName,
+			child_value(node, "friendlyName"));
+	if (created || device->expires < now + (int64_t)seconds * 1000)
+		refresh_device(device, seconds, now);
+	node = child_element(node, "serviceList");
+	for (child = node ? ixmlNode_getFirstChild(node) : NULL; child;
+	     child = ixmlNode_getNextSibling(child)) {
+		if (!is_element(child, "service"))
+			continue;
+		serviceType = child_value(child, "serviceType");
+		if (!serviceType)
+			continue;
+		service = get_service(device, serviceType);
+		if (!service)
+			return UPNP_E_OUTOF_MEMORY;
+		if (child_value(child, "serviceId"))
+			err |= set_string(&service->serviceId,
+				child_value(child, "serviceId"));
+		err |= set_url(&gRegistryControlURLs, &service->controlURL,
+			base, child_value(child, "controlURL"), service);
+		err |= set_url(&gRegistryEventURLs, &service->eventURL,
+			base, child_value(child, "eventSubURL"), service);
+	}
+
+	return err ? UPNP_E_OUTOF_MEMORY : UPNP_E_SUCCESS;
+}
+
+
+/*!
+ * \brief Copies a device for the application.
+ */
+static void copy_device(
+	/*! [in] Device. */
+	const RegistryDevice *device,
+	/*! [in] Current time, in ms. */
+	int64_t now,
+	/*! [out] Copy. */
+	struct Upnp_Registry_Device *out)
+{
+	const RegistryService *service;
+
+	copy_string(out->DeviceId, sizeof(out->DeviceId), device->udn);
+	copy_string(out->DeviceType, sizeof(out->DeviceType),
+		device->deviceType);
+	copy_string(out->FriendlyName, sizeof(out->FriendlyName),
+		device->friendlyName);
+	copy_string(out->Location, sizeof(out->Location), device->location);
+	out->Expires = device->expires > now ?
+		(int)((device->expires - now + 999) / 1000) : 0;
+	out->ServiceCount = 0;
+	for (service = device->services; service; service = service->next)
+		out->ServiceCount++;
+}
+
+
+/*!
+ * \brief Copies a service for the application.
+ */
+static void copy_service(
+	/*! [in] Service. */
+	const RegistryService *service,
+	/*! [out] Copy. */
+	struct Upnp_Registry_Service *out)
+{
+	copy_string(out->DeviceId, sizeof(out->DeviceId),
+		service->device->udn);
+	copy_string(out->ServiceType, sizeof(out->ServiceType),
+		service->serviceType);
+	copy_string(out->ServiceId, sizeof(out->ServiceId),
+		service->serviceId);
+	copy_string(out->ControlURL, sizeof(out->ControlURL),
+		service->controlURL);
+	copy_string(out->EventURL, sizeof(out->EventURL), service->eventURL);
+	copy_string(out->Sid, sizeof(out->Sid), service->sid);
+}
+
+
+/*!
+ * \brief Finds a device by UDN or USN. Must be called with gRegistryLock
+ * held.
+ */
+static RegistryDevice *find_device(const char *udn)
+{
+	return HashTableFindN(&gRegistryDevices, udn, udn_length(udn));
+}
+
+
+int RegistryInit(void)
+{
+	if (ithread_rwlock_init(&gRegistryLock, NULL) != 0)
+		return UPNP_E_INIT_FAILED;
+	if (HashTableInit(&gRegistryDevices, 0) != 0 ||
+	    HashTableInit(&gRegistryServices, 0) != 0 ||
+	    HashTableInit(&gRegistryControlURLs, 0) != 0 ||
+	    HashTableInit(&gRegistryEventURLs, 0) != 0 ||
+	    HashTableInit(&gRegistrySids, 0) != 0) {
+		RegistryDestroy();
+		return UPNP_E_INIT_FAILED;
+	}
+	gRegistryEnabled = FALSE;
+
+	return UPNP_E_SUCCESS;
+}
+
+
+void RegistryDestroy(void)
+{
+	ithread_rwlock_wrlock(&gRegistryLock);
+	remove_all_devices();
+	gRegistryEnabled = FALSE;
+	HashTableDestroy(&gRegistrySids, NULL);
+	HashTableDestroy(&gRegistryEventURLs, NULL);
+	HashTableDestroy(&gRegistryControlURLs, NULL);
+	HashTableDestroy(&gRegistryServices, NULL);
+	HashTableDestroy(&gRegistryDevices, NULL);
+	ithread_rwlock_unlock(&gRegistryLock);
+	ithread_rwlock_destroy(&gRegistryLock);
+}
+
+
+void RegistryEnable(int enable)
+{
+	ithread_rwlock_wrlock(&gRegistryLock);
+	if (!enable)
+		remove_all_devices();
+	gRegistryEnabled = enable ? TRUE : FALSE;
+	ithread_rwlock_unlock(&gRegistryLock);
+}
+
+
+void RegistryHandleDiscovery(
+	Upnp_EventType eventType,
+	const struct Upnp_Discovery *discovery)
+{
+	RegistryDevice *device;
+	int created;
+
+	/* cheap test for the control points not using the registry */
+	if (!gRegistryEnabled || discovery->DeviceId[0] == '\0')
+		return;
+	ithread_rwlock_wrlock(&gRegistryLock);
+	if (!gRegistryEnabled)
+		goto ExitFunction;
+	if (eventType == UPNP_DISCOVERY_ADVERTISEMENT_BYEBYE) {
+		device = HashTableFind(&gRegistryDevices, discovery->DeviceId);
+		if (device)
+			remove_device(device);
+		goto ExitFunction;
+	}
+	device = get_device(discovery->DeviceId, &created);
+	if (!device)
+		goto ExitFunction;
+	/* a failed copy keeps the previous value, there will be other
+	 * advertisements */
+	if (discovery->Location[0] != '\0')
+		set_string(&device->location, discovery->Location);
+	if (discovery->DeviceType[0] != '\0')
+		set_string(&device->deviceType, discovery->DeviceType);
+	if (discovery->ServiceType[0] != '\0')
+		get_service(device, discovery->ServiceType);
+	refresh_device(device, discovery->Expires, imillinow());
+
+ExitFunction:
+	ithread_rwlock_unlock(&gRegistryLock);
+}
+
+
+int RegistryAddDescription(
+	const char *location,
+	IXML_Document *descDoc,
+	int expires)
+{
+	IXML_NodeList *devices;
+	IXML_NodeList *urlBases;
+	IXML_Node *text = NULL;
+	const char *base = location;
+	unsigned long i;
+	unsigned long n;
+	int64_t now = imillinow();
+	int ret = UPNP_E_SUCCESS;
+
+	if (expires <= 0)
+		expires = DEFAULT_MAXAGE;
+	devices = ixmlDocument_getElementsByTagName(descDoc, "device");
+	if (!devices)
+		return UPNP_E_INVALID_DESC;
+	urlBases = ixmlDocument_getElementsByTagName(descDoc, "URLBase");
+	if (urlBases)
+		text = ixmlNode_getFirstChild(ixmlNodeList_item(urlBases, 0));
+	if (text && ixmlNode_getNodeType(text) == eTEXT_NODE &&
+	    ixmlNode_getNodeValue(text))
+		base = ixmlNode_getNodeValue(text);
+
+	ithread_rwlock_wrlock(&gRegistryLock);
+	if (!gRegistryEnabled) {
+		ret = UPNP_E_FINISH;
+	} else {
+		n = ixmlNodeList_length(devices);
+		for (i = 0; i < n && ret == UPNP_E_SUCCESS; i++)
+			ret = add_described_device(
+				ixmlNodeList_item(devices, i), location,
+				base, expires, now);
+	}
+	ithread_rwlock_unlock(&gRegistryLock);
+
+	ixmlNodeList_free(urlBases);
+	ixmlNodeList_free(devices);
+
+	return ret;
+}
+
+
+int RegistryRemoveDevice(const char *udn)
+{
+	RegistryDevice *device;
+
+	ithread_rwlock_wrlock(&gRegistryLock);
+	device = find_device(udn);
+	if (device)
+		remove_device(device);
+	ithread_rwlock_unlock(&gRegistryLock);
+
+	return device ? UPNP_E_SUCCESS : UPNP_E_INVALID_DEVICE;
+}
+
+
+void RegistrySetSubscription(const char *eventURL, const char *sid)
+{
+	RegistryService *service;
+
+	if (!gRegistryEnabled)
+		return;
+	ithread_rwlock_wrlock(&gRegistryLock);
+	service = HashTableFind(&gRegistryEventURLs, eventURL);
+	if (service)
+		set_indexed_string(&gRegistrySids, &service->sid, sid, service);
+	ithread_rwlock_unlock(&gRegistryLock);
+}
+
+
+void RegistryClearSubscription(const char *sid)
+{
+	RegistryService *service;
+
+	if (!gRegistryEnabled)
+		return;
+	ithread_rwlock_wrlock(&gRegistryLock);
+	service = HashTableRemove(&gRegistrySids, sid);
+	if (service) {
+		free(service->sid);
+		service->sid = NULL;
+	}
+	ithread_rwlock_unlock(&gRegistryLock);
+}
+
+
+int RegistryGetDevice(const char *udn, struct Upnp_Registry_Device *device)
+{
+	RegistryDevice *found;
+	int ret = UPNP_E_INVALID_DEVICE;
+
+	ithread_rwlock_rdlock(&gRegistryLock);
+	if (!gRegistryEnabled) {
+		ret = UPNP_E_FINISH;
+	} else {
+		found = find_device(udn);
+		if (found) {
+			copy_device(found, imillinow(), device);
+			ret = UPNP_E_SUCCESS;
+		}
+	}
+	ithread_rwlock_unlock(&gRegistryLock);
+
+	return ret;
+}
+
+
+int RegistryGetService(
+	RegistryIndex index,
+	const char *key,
+	struct Upnp_Registry_Service *service)
+{
+	RegistryService *found = NULL;
+	int ret = UPNP_E_INVALID_SERVICE;
+
+	ithread_rwlock_rdlock(&gRegistryLock);
+	if (!gRegistryEnabled) {
+		ret = UPNP_E_FINISH;
+		goto ExitFunction;
+	}
+	switch (index) {
+	case REGISTRY_BY_USN:
+		found = HashTableFind(&gRegistryServices, key);
+		break;
+	case REGISTRY_BY_SID:
+		found = HashTableFind(&gRegistrySids, key);
+		break;
+	case REGISTRY_BY_CONTROL_URL:
+		found = HashTableFind(&gRegistryControlURLs, key);
+		break;
+	}
+	if (found) {
+		copy_service(found, service);
+		ret = UPNP_E_SUCCESS;
+	}
+
+ExitFunction:
+	ithread_rwlock_unlock(&gRegistryLock);
+
+	return ret;
+}
+
+
+int RegistryForEachDevice(Upnp_RegistryDeviceVisitor visitor, void *cookie)
+{
+	struct Upnp_Registry_Device *copies = NULL;
+	RegistryDevice *device;
+	long count = 0;
+	long pos = 0;
+	long i;
+	int64_t now = imillinow();
+	int ret = UPNP_E_SUCCESS;
+
+	ithread_rwlock_rdlock(&gRegistryLock);
+	if (!gRegistryEnabled) {
+		ithread_rwlock_unlock(&gRegistryLock);
+		return UPNP_E_FINISH;
+	}
+	if (HashTableSize(&gRegistryDevices) > 0) {
+		copies = malloc((size_t)HashTableSize(&gRegistryDevices) *
+			sizeof(*copies));
+		if (copies == NULL)
+			ret = UPNP_E_OUTOF_MEMORY;
+	}
+	while (copies != NULL && (device = HashTableIterNext(
+		&gRegistryDevices, &pos)) != NULL)
+		copy_device(device, now, &copies[count++]);
+	ithread_rwlock_unlock(&gRegistryLock);
+	/* the visitor may subscribe, which takes HandleLock and then
+	 * gRegistryLock */
+	for (i = 0; i < count; i++)
+		if (visitor(&copies[i], cookie) != 0)
+			break;
+	free(copies);
+
+	return ret;
+}
+
+
+int RegistryForEachService(
+	const char *udn,
+	Upnp_RegistryServiceVisitor visitor,
+	void *cookie)
+{
+	struct Upnp_Registry_Service *copies = NULL;
+	RegistryDevice *device = NULL;
+	RegistryService *service;
+	long size = 0;
+	long count = 0;
+	long pos = 0;
+	long i;
+	int ret = UPNP_E_SUCCESS;
+
+	ithread_rwlock_rdlock(&gRegistryLock);
+	if (!gRegistryEnabled) {
+		ithread_rwlock_unlock(&gRegistryLock);
+		return UPNP_E_FINISH;
+	}
+	if (udn) {
+		device = find_device(udn);
+		if (!device) {
+			ithread_rwlock_unlock(&gRegistryLock);
+			return UPNP_E_INVALID_DEVICE;
+		}
+		for (service = device->services; service;
+		     service = service->next)
+			size++;
+	} else
+		size = HashTableSize(&gRegistryServices);
+	if (size > 0) {
+		copies = malloc((size_t)size * sizeof(*copies));
+		if (copies == NULL)
+			ret = UPNP_E_OUTOF_MEMORY;
+	}
+	if (copies != NULL && device != NULL) {
+		for (service = device->services; service;
+		     service = service->next)
+			copy_service(service, &copies[count++]);
+	} else if (copies != NULL) {
+		while ((service = HashTableIterNext(&gRegistryServices,
+			&pos)) != NULL)
+			copy_service(service, &copies[count++]);
+	}
+	ithread_rwlock_unlock(&gRegistryLock);
+	/* called without the lock, see RegistryForEachDevice */
+	for (i = 0; i < count; i++)
+		if (visitor(&copies[i], cookie) != 0)
+			break;
+	free(copies);
+
+	return ret;
+}
+
+
+#endif /* INCLUDE_CLIENT_APIS */
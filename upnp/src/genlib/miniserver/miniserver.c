@@ -65,9 +65,17 @@
 #include <string.h>
 #include <sys/types.h>
 
+#if MINISERVER_USE_EPOLL && defined(__linux__)
+	#define MSERV_HAVE_EPOLL
+	#include <sys/epoll.h>
+#endif
+
 /*! . */
 #define APPLICATION_LISTENING_PORT 49152
 
+/*! Maximum number of sockets watched by the miniserver. */
+#define MSERV_MAX_SOCKS 16
+
 struct mserv_request_t {
 	/*! Connection handle. */
 	SOCKET connfd;
@@ -289,14 +297,166 @@ static UPNP_INLINE void schedule_request_job(
 }
 #endif
 
-static UPNP_INLINE void fdset_if_valid(SOCKET sock, fd_set *set)
+/*!
+ * \brief Set of sockets watched by the miniserver.
+ *
+ * On Linux the sockets are registered once in an edge-triggered epoll
+ * instance, and the caller must drain every socket reported as ready
+ * until it would block. Elsewhere, or if epoll is not available at run
+ * time, the fd_sets are rebuilt and passed to select() on each wait and
+ * a single read per ready socket is enough.
+ */
+typedef struct {
+#ifdef MSERV_HAVE_EPOLL
+	/*! epoll instance, -1 when falling back to select(). */
+	int epfd;
+#endif /* MSERV_HAVE_EPOLL */
+	/*! Watched sockets. */
+	SOCKET socks[MSERV_MAX_SOCKS];
+	/*! Number of watched sockets. */
+	int numSocks;
+	/*! Highest watched socket, for select(). */
+	SOCKET maxSock;
+	/*! Socket also watched for exceptions, for select(). */
+	SOCKET stopSock;
+} MiniServerPoller;
+
+/*!
+ * \brief Initializes a poller with no socket.
+ */
+static void poller_init(
+	/*! [out] Poller. */
+	MiniServerPoller *poller)
+{
+	char errorBuffer[ERROR_BUFFER_LEN];
+
+	memset(poller, 0, sizeof(*poller));
+	poller->stopSock = INVALID_SOCKET;
+#ifdef MSERV_HAVE_EPOLL
+	poller->epfd = epoll_create(MSERV_MAX_SOCKS);
+	if (poller->epfd == -1) {
+		strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
+		UpnpPrintf(UPNP_INFO, MSERV, __FILE__, __LINE__,
+			"epoll not available, using select(): %s\n",
+			errorBuffer);
+	}
+#else /* MSERV_HAVE_EPOLL */
+	(void)errorBuffer;
+#endif /* MSERV_HAVE_EPOLL */
+}
+
+/*!
+ * \brief Tells whether the ready sockets must be drained until they would
+ * block.
+ */
+static UPNP_INLINE int poller_is_edge_triggered(MiniServerPoller *poller)
+{
+#ifdef MSERV_HAVE_EPOLL
+	return poller->epfd != -1;
+#else /* MSERV_HAVE_EPOLL */
+	(void)poller;
+	return FALSE;
+#endif /* MSERV_HAVE_EPOLL */
+}
+
+/*!
+ * \brief Adds a socket to the poller. Invalid sockets are ignored.
+ */
+static void poller_add(
+	/*! [in,out] Poller. */
+	MiniServerPoller *poller,
+	/*! [in] Socket to watch for reading. */
+	SOCKET sock)
+{
+#ifdef MSERV_HAVE_EPOLL
+	struct epoll_event ev;
+#endif /* MSERV_HAVE_EPOLL */
+
+	if (sock == INVALID_SOCKET || poller->numSocks >= MSERV_MAX_SOCKS)
+		return;
+#ifdef MSERV_HAVE_EPOLL
+	if (poller->epfd != -1) {
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN | EPOLLET;
+		ev.data.fd = sock;
+		if (sock_make_no_blocking(sock) == -1 ||
+		    epoll_ctl(poller->epfd, EPOLL_CTL_ADD, sock, &ev) == -1) {
+			UpnpPrintf(UPNP_CRITICAL, MSERV, __FILE__, __LINE__,
+				"Cannot watch socket %d with epoll\n", sock);
+			return;
+		}
+	}
+#endif /* MSERV_HAVE_EPOLL */
+	poller->socks[poller->numSocks++] = sock;
+	poller->maxSock = max(poller->maxSock, sock);
+}
+
+/*!
+ * \brief Waits until at least one socket is readable.
+ *
+ * \return The number of ready sockets stored in ready, or SOCKET_ERROR.
+ */
+static int poller_wait(
+	/*! [in] Poller. */
+	MiniServerPoller *poller,
+	/*! [out] Ready sockets, MSERV_MAX_SOCKS entries. */
+	SOCKET *ready)
 {
-	if (sock != INVALID_SOCKET) {
-		FD_SET(sock, set);
+	fd_set expSet;
+	fd_set rdSet;
+	int ret;
+	int i;
+	int numReady = 0;
+#ifdef MSERV_HAVE_EPOLL
+	struct epoll_event events[MSERV_MAX_SOCKS];
+
+	if (poller->epfd != -1) {
+		ret = epoll_wait(poller->epfd, events, MSERV_MAX_SOCKS, -1);
+		for (i = 0; i < ret; i++)
+			ready[i] = events[i].data.fd;
+		return ret;
+	}
+#endif /* MSERV_HAVE_EPOLL */
+	FD_ZERO(&rdSet);
+	FD_ZERO(&expSet);
+	if (poller->stopSock != INVALID_SOCKET)
+		FD_SET(poller->stopSock, &expSet);
+	for (i = 0; i < poller->numSocks; i++)
+		FD_SET(poller->socks[i], &rdSet);
+	ret = select((int)poller->maxSock + 1, &rdSet, NULL, &expSet, NULL);
+	if (ret == SOCKET_ERROR)
+		return ret;
+	for (i = 0; i < poller->numSocks; i++) {
+		if (FD_ISSET(poller->socks[i], &rdSet) ||
+		    FD_ISSET(poller->socks[i], &expSet))
+			ready[numReady++] = poller->socks[i];
 	}
+
+	return numReady;
+}
+
+/*!
+ * \brief Releases the poller. The watched sockets are not closed.
+ */
+static void poller_destroy(MiniServerPoller *poller)
+{
+#ifdef MSERV_HAVE_EPOLL
+	if (poller->epfd != -1)
+		close(poller->epfd);
+#else /* MSERV_HAVE_EPOLL */
+	(void)poller;
+#endif /* MSERV_HAVE_EPOLL */
 }
 
-static void web_server_accept(SOCKET lsock, fd_set *set)
+/*!
+ * \brief Accepts the pending connections of a listening socket and
+ * schedules a job for each of them.
+ */
+static void web_server_accept(
+	/*! [in] Listening socket. */
+	SOCKET lsock,
+	/*! [in] TRUE to accept until no connection is pending. */
+	int drain)
 {
 #ifdef INTERNAL_WEB_SERVER
 	SOCKET asock;
@@ -304,31 +464,40 @@ static void web_server_accept(SOCKET lsock, fd_set *set)
 	struct sockaddr_storage clientAddr;
 	char errorBuffer[ERROR_BUFFER_LEN];
 
-	if (lsock != INVALID_SOCKET && FD_ISSET(lsock, set)) {
+	do {
 		clientLen = sizeof(clientAddr);
 		asock = accept(lsock, (struct sockaddr *)&clientAddr,
 			&clientLen);
 		if (asock == INVALID_SOCKET) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
 			strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
 			UpnpPrintf(UPNP_INFO, MSERV, __FILE__, __LINE__,
 				"miniserver: Error in accept(): %s\n",
 				errorBuffer);
-		} else {
-			schedule_request_job(asock,
-				(struct sockaddr *)&clientAddr);
+			break;
 		}
-	}
+		schedule_request_job(asock, (struct sockaddr *)&clientAddr);
+	} while (drain);
 #endif /* INTERNAL_WEB_SERVER */
 }
 
-static void ssdp_read(SOCKET rsock, fd_set *set)
+/*!
+ * \brief Reads the pending datagrams of a SSDP socket.
+ */
+static void ssdp_read(
+	/*! [in] SSDP socket. */
+	SOCKET rsock,
+	/*! [in] TRUE to read until no datagram is pending. */
+	int drain)
 {
-	if (rsock != INVALID_SOCKET && FD_ISSET(rsock, set)) {
-		readFromSSDPSocket(rsock);
-	}
+	while (readFromSSDPSocket(rsock) == 0 && drain)
+		continue;
 }
 
-static int receive_from_stopSock(SOCKET ssock, fd_set *set)
+static int receive_from_stopSock(SOCKET ssock, int drain)
 {
 	ssize_t byteReceived;
 	socklen_t clientLen;
@@ -336,7 +505,7 @@ static int receive_from_stopSock(SOCKET ssock, fd_set *set)
 	char requestBuf[256];
 	char buf_ntop[INET6_ADDRSTRLEN];
 
-	if (FD_ISSET(ssock, set)) {
+	do {
 		clientLen = sizeof(clientAddr);
 		memset((char *)&clientAddr, 0, sizeof(clientAddr));
 		byteReceived = recvfrom(ssock, requestBuf,
@@ -356,7 +525,7 @@ static int receive_from_stopSock(SOCKET ssock, fd_set *set)
 				return 1;
 			}
 		}
-	}
+	} while (byteReceived > 0 && drain);
 
 	return 0;
 }
@@ -373,65 +542,52 @@ static void RunMiniServer(
 	MiniServerSockArray *miniSock)
 {
 	char errorBuffer[ERROR_BUFFER_LEN];
-	fd_set expSet;
-	fd_set rdSet;
-	SOCKET maxMiniSock;
-	int ret = 0;
+	MiniServerPoller poller;
+	SOCKET ready[MSERV_MAX_SOCKS];
+	SOCKET sock;
+	int numReady;
+	int drain;
+	int i;
 	int stopSock = 0;
 
-	maxMiniSock = 0;
-	maxMiniSock = max(maxMiniSock, miniSock->miniServerSock4);
-	maxMiniSock = max(maxMiniSock, miniSock->miniServerSock6);
-	maxMiniSock = max(maxMiniSock, miniSock->miniServerStopSock);
-	maxMiniSock = max(maxMiniSock, miniSock->ssdpSock4);
-	maxMiniSock = max(maxMiniSock, miniSock->ssdpSock6);
-	maxMiniSock = max(maxMiniSock, miniSock->ssdpSock6UlaGua);
+	poller_init(&poller);
+	poller.stopSock = miniSock->miniServerStopSock;
+	poller_add(&poller, miniSock->miniServerStopSock);
+	poller_add(&poller, miniSock->miniServerSock4);
+	poller_add(&poller, miniSock->miniServerSock6);
+	poller_add(&poller, miniSock->ssdpSock4);
+	poller_add(&poller, miniSock->ssdpSock6);
+	poller_add(&poller, miniSock->ssdpSock6UlaGua);
 #ifdef INCLUDE_CLIENT_APIS
-	maxMiniSock = max(maxMiniSock, miniSock->ssdpReqSock4);
-	maxMiniSock = max(maxMiniSock, miniSock->ssdpReqSock6);
+	poller_add(&poller, miniSock->ssdpReqSock4);
+	poller_add(&poller, miniSock->ssdpReqSock6);
 #endif /* INCLUDE_CLIENT_APIS */
-	++maxMiniSock;
+	drain = poller_is_edge_triggered(&poller);
 
 	gMServState = MSERV_RUNNING;
 	while (!stopSock) {
-		FD_ZERO(&rdSet);
-		FD_ZERO(&expSet);
-		/* FD_SET()'s */
-		FD_SET(miniSock->miniServerStopSock, &expSet);
-		FD_SET(miniSock->miniServerStopSock, &rdSet);
-		fdset_if_valid(miniSock->miniServerSock4, &rdSet);
-		fdset_if_valid(miniSock->miniServerSock6, &rdSet);
-		fdset_if_valid(miniSock->ssdpSock4, &rdSet);
-		fdset_if_valid(miniSock->ssdpSock6, &rdSet);
-		fdset_if_valid(miniSock->ssdpSock6UlaGua, &rdSet);
-#ifdef INCLUDE_CLIENT_APIS
-		fdset_if_valid(miniSock->ssdpReqSock4, &rdSet);
-		fdset_if_valid(miniSock->ssdpReqSock6, &rdSet);
-#endif /* INCLUDE_CLIENT_APIS */
-		/* select() */
-		ret = select((int) maxMiniSock, &rdSet, NULL, &expSet, NULL);
-		if (ret == SOCKET_ERROR && errno == EINTR) {
+		numReady = poller_wait(&poller, ready);
+		if (numReady == SOCKET_ERROR && errno == EINTR) {
 			continue;
 		}
-		if (ret == SOCKET_ERROR) {
+		if (numReady == SOCKET_ERROR) {
 			strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
 			UpnpPrintf(UPNP_CRITICAL, SSDP, __FILE__, __LINE__,
 				"Error in select(): %s\n", errorBuffer);
 			continue;
-		} else {
-			web_server_accept(miniSock->miniServerSock4, &rdSet);
-			web_server_accept(miniSock->miniServerSock6, &rdSet);
-#ifdef INCLUDE_CLIENT_APIS
-			ssdp_read(miniSock->ssdpReqSock4, &rdSet);
-			ssdp_read(miniSock->ssdpReqSock6, &rdSet);
-#endif /* INCLUDE_CLIENT_APIS */
-			ssdp_read(miniSock->ssdpSock4, &rdSet);
-			ssdp_read(miniSock->ssdpSock6, &rdSet);
-			ssdp_read(miniSock->ssdpSock6UlaGua, &rdSet);
-			stopSock = receive_from_stopSock(
-				miniSock->miniServerStopSock, &rdSet);
+		}
+		for (i = 0; i < numReady; i++) {
+			sock = ready[i];
+			if (sock == miniSock->miniServerSock4 ||
+			    sock == miniSock->miniServerSock6)
+				web_server_accept(sock, drain);
+			else if (sock == miniSock->miniServerStopSock)
+				stopSock |= receive_from_stopSock(sock, drain);
+			else
+				ssdp_read(sock, drain);
 		}
 	}
+	poller_destroy(&poller);
 	/* Close all sockets. */
 	sock_close(miniSock->miniServerSock4);
 	sock_close(miniSock->miniServerSock6);
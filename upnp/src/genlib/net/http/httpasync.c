@@ -0,0 +1,1110 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+
+/*!
+ * \file
+ *
+ * \brief Asynchronous HTTP client.
+ *
+ * Each event loop owns the requests assigned to it: it connects, sends and
+ * receives on non-blocking sockets, and keeps its requests in a list sorted
+ * by deadline, so that the next time out is always the first one. Other
+ * threads only hand new requests over through the incoming list of the loop
+ * and wake it with a byte on its pipe. Completed requests are queued and
+ * delivered by at most HTTP_ASYNC_WORKERS thread pool jobs.
+ */
+
+
+#include "config.h"
+
+
+#include "httpasync.h"
+
+
+#include "httpreadwrite.h"
+#include "ithread.h"
+#include "sock.h"
+#include "statcodes.h"
+#include "unixutil.h"
+#include "upnp.h"
+#include "upnpapi.h"
+#include "UpnpInet.h"
+#include "UpnpStdInt.h"
+
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#if HTTP_ASYNC_THREADS > 0 && !defined(WIN32)
+	#define HTTP_ASYNC_ENABLED
+#endif
+
+
+#ifdef HTTP_ASYNC_ENABLED
+
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+#ifdef __linux__
+	#define HTTP_ASYNC_HAVE_EPOLL
+	#include <sys/epoll.h>
+#else /* __linux__ */
+	#include <poll.h>
+#endif /* __linux__ */
+
+
+#ifndef MSG_NOSIGNAL
+	#define MSG_NOSIGNAL 0
+#endif
+
+
+/*! Time out of the connection, in milliseconds, as for a blocking connect. */
+#define HTTP_ASYNC_CONNECT_TIMEOUT 5000
+
+/*! Deadline of a request without time out. */
+#define HTTP_ASYNC_NO_DEADLINE INT64_MAX
+
+/*! Maximum number of reads on a socket per wake up of the loop, so that a
+ * fast sender cannot starve the other requests. */
+#define HTTP_ASYNC_MAX_READS 16
+
+/*! Wait, in milliseconds, before trying again to start a delivery job. */
+#define HTTP_ASYNC_RETRY_WAIT 100
+
+/*! Number of epoll events handled per wake up. */
+#define HTTP_ASYNC_MAX_EVENTS 64
+
+
+/*! State of a request in its event loop. */
+typedef enum {
+	/*! The non-blocking connect is in progress. */
+	HTTP_ASYNC_CONNECTING,
+	/*! The request is being sent. */
+	HTTP_ASYNC_SENDING,
+	/*! The response is being received. */
+	HTTP_ASYNC_RECEIVING
+} http_async_state;
+
+
+struct http_async_loop;
+
+
+/*! An asynchronous request. */
+typedef struct http_async_request {
+	/*! Previous request in the list the request is in. */
+	struct http_async_request *prev;
+	/*! Next request in the list the request is in. */
+	struct http_async_request *next;
+	/*! Address of the destination. */
+	struct sockaddr_storage peer;
+	/*! Connection, INVALID_SOCKET when not connected. */
+	SOCKET sock;
+	/*! State of the request. */
+	http_async_state state;
+	/*! TRUE if the connection came from the pool. */
+	int reused;
+	/*! TRUE if the request was already sent again on a new connection. */
+	int retried;
+	/*! TRUE while the request is in the deadline list of its loop. */
+	int active;
+	/*! Request to send. */
+	membuffer request;
+	/*! Number of bytes of the request already sent. */
+	size_t sent;
+	/*! Method of the request. */
+	http_method_t method;
+	/*! Response being parsed. */
+	http_parser_t response;
+	/*! TRUE if the response is complete when the peer closes. */
+	int okOnClose;
+	/*! End of the time out of the request, in milliseconds. */
+	int64_t endTime;
+	/*! Deadline of the current state, in milliseconds. */
+	int64_t deadline;
+	/*! Result passed to the callback. */
+	int ret;
+	/*! Completion callback. */
+	http_async_callback callback;
+	/*! Cookie of the callback. */
+	void *cookie;
+} http_async_request;
+
+
+/*! An event loop. */
+typedef struct http_async_loop {
+	/*! Protects incoming, incomingTail, wakePending and stop. */
+	ithread_mutex_t mutex;
+	/*! Requests handed over to the loop. */
+	http_async_request *incoming;
+	/*! Last request handed over to the loop. */
+	http_async_request *incomingTail;
+	/*! TRUE if a wake up byte was written to the pipe and not read yet. */
+	int wakePending;
+	/*! TRUE when the loop must exit. */
+	int stop;
+	/*! Read end of the wake up pipe. */
+	int wakeRead;
+	/*! Write end of the wake up pipe. */
+	int wakeWrite;
+#ifdef HTTP_ASYNC_HAVE_EPOLL
+	/*! epoll instance. */
+	int epfd;
+#else /* HTTP_ASYNC_HAVE_EPOLL */
+	/*! Descriptors passed to poll(). */
+	struct pollfd *fds;
+	/*! Request of each descriptor, NULL for the wake up pipe. */
+	http_async_request **fdReqs;
+	/*! Number of slots of fds and fdReqs. */
+	size_t fdSlots;
+#endif /* HTTP_ASYNC_HAVE_EPOLL */
+	/*! Requests being handled, sorted by deadline. */
+	http_async_request *first;
+	/*! Request with the latest deadline. */
+	http_async_request *last;
+	/*! Number of requests being handled. */
+	size_t numActive;
+} http_async_loop;
+
+
+/*! The event loops. */
+static http_async_loop gAsyncLoops[HTTP_ASYNC_THREADS];
+
+/*! Protects the globals below. */
+static ithread_mutex_t gAsyncMutex;
+
+/*! Signaled when a loop exits or the last delivery job ends. */
+static ithread_cond_t gAsyncCond;
+
+/*! TRUE between http_AsyncInit() and http_AsyncShutdown(). */
+static int gAsyncRunning = FALSE;
+
+/*! Thread pool running the loops and the delivery jobs. */
+static ThreadPool *gAsyncPool;
+
+/*! Loop the next request is assigned to. */
+static unsigned int gAsyncNextLoop;
+
+/*! Number of loops still running. */
+static int gAsyncLoopsRunning;
+
+/*! Completed requests waiting for their callback. */
+static http_async_request *gAsyncDone;
+
+/*! Last completed request. */
+static http_async_request *gAsyncDoneTail;
+
+/*! Number of delivery jobs running. */
+static int gAsyncWorkers;
+
+
+/*!
+ * \brief Delivers the completed requests to their callbacks.
+ *
+ * Runs as a thread pool job until the queue is empty.
+ */
+static void *http_async_worker(
+	/*! [in] Unused. */
+	void *arg)
+{
+	http_async_request *req;
+
+	(void)arg;
+	ithread_mutex_lock(&gAsyncMutex);
+	while ((req = gAsyncDone) != NULL) {
+		gAsyncDone = req->next;
+		if (gAsyncDone == NULL)
+			gAsyncDoneTail = NULL;
+		ithread_mutex_unlock(&gAsyncMutex);
+		req->callback(req->ret, &req->request, &req->response,
+			req->cookie);
+		httpmsg_destroy(&req->response.msg);
+		membuffer_destroy(&req->request);
+		free(req);
+		ithread_mutex_lock(&gAsyncMutex);
+	}
+	gAsyncWorkers--;
+	if (gAsyncWorkers == 0)
+		ithread_cond_broadcast(&gAsyncCond);
+	ithread_mutex_unlock(&gAsyncMutex);
+
+	return NULL;
+}
+
+
+/*!
+ * \brief Starts a delivery job if there are completed requests and fewer
+ * than HTTP_ASYNC_WORKERS jobs running.
+ *
+ * \return TRUE if completed requests are left without a job.
+ */
+static int http_async_start_worker(void)
+{
+	ThreadPoolJob job;
+	int start = FALSE;
+	int stalled = FALSE;
+
+	ithread_mutex_lock(&gAsyncMutex);
+	if (gAsyncDone != NULL && gAsyncWorkers < HTTP_ASYNC_WORKERS) {
+		gAsyncWorkers++;
+		start = TRUE;
+	}
+	ithread_mutex_unlock(&gAsyncMutex);
+	if (!start)
+		return FALSE;
+	memset(&job, 0, sizeof(job));
+	TPJobInit(&job, (start_routine)http_async_worker, NULL);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	if (ThreadPoolAdd(gAsyncPool, &job, NULL) != 0) {
+		ithread_mutex_lock(&gAsyncMutex);
+		gAsyncWorkers--;
+		stalled = gAsyncWorkers == 0;
+		ithread_mutex_unlock(&gAsyncMutex);
+	}
+
+	return stalled;
+}
+
+
+/*!
+ * \brief Inserts a request in the deadline list of its loop.
+ */
+static void http_async_link(
+	/*! [in] Loop of the request. */
+	http_async_loop *loop,
+	/*! [in] Request. */
+	http_async_request *req)
+{
+	http_async_request *p = loop->last;
+
+	/* the deadlines mostly come in order: search from the end */
+	while (p != NULL && p->deadline > req->deadline)
+		p = p->prev;
+	req->prev = p;
+	req->next = p != NULL ? p->next : loop->first;
+	if (req->next != NULL)
+		req->next->prev = req;
+	else
+		loop->last = req;
+	if (p != NULL)
+		p->next = req;
+	else
+		loop->first = req;
+	req->active = TRUE;
+	loop->numActive++;
+}
+
+
+/*!
+ * \brief Removes a request from the deadline list of its loop.
+ */
+static void http_async_unlink(
+	/*! [in] Loop of the request. */
+	http_async_loop *loop,
+	/*! [in] Request. */
+	http_async_request *req)
+{
+	if (!req->active)
+		return;
+	if (req->prev != NULL)
+		req->prev->next = req->next;
+	else
+		loop->first = req->next;
+	if (req->next != NULL)
+		req->next->prev = req->prev;
+	else
+		loop->last = req->prev;
+	req->prev = NULL;
+	req->next = NULL;
+	req->active = FALSE;
+	loop->numActive--;
+}
+
+
+/*!
+ * \brief Sets the deadline of a request and moves it in the list.
+ */
+static void http_async_set_deadline(
+	/*! [in] Loop of the request. */
+	http_async_loop *loop,
+	/*! [in] Request. */
+	http_async_request *req,
+	/*! [in] New deadline. */
+	int64_t deadline)
+{
+	http_async_unlink(loop, req);
+	req->deadline = deadline;
+	http_async_link(loop, req);
+}
+
+
+/*!
+ * \brief Sets the events the loop waits for on the socket of a request.
+ */
+static void http_async_watch(
+	/*! [in] Loop of the request. */
+	http_async_loop *loop,
+	/*! [in] Request. */
+	http_async_request *req,
+	/*! [in] TRUE when the socket was not watched yet. */
+	int add)
+{
+#ifdef HTTP_ASYNC_HAVE_EPOLL
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = req->state == HTTP_ASYNC_RECEIVING ?
+		(uint32_t)EPOLLIN : (uint32_t)EPOLLOUT;
+	ev.data.ptr = req;
+	epoll_ctl(loop->epfd, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD,
+		req->sock, &ev);
+#else /* HTTP_ASYNC_HAVE_EPOLL */
+	/* the descriptors are rebuilt from the states before each poll() */
+	(void)loop;
+	(void)req;
+	(void)add;
+#endif /* HTTP_ASYNC_HAVE_EPOLL */
+}
+
+
+/*!
+ * \brief Stops watching the socket of a request.
+ */
+static void http_async_unwatch(
+	/*! [in] Loop of the request. */
+	http_async_loop *loop,
+	/*! [in] Request. */
+	http_async_request *req)
+{
+#ifdef HTTP_ASYNC_HAVE_EPOLL
+	struct epoll_event ev;
+
+	/* pooled sockets stay open: they must leave the epoll set */
+	memset(&ev, 0, sizeof(ev));
+	epoll_ctl(loop->epfd, EPOLL_CTL_DEL, req->sock, &ev);
+#else /* HTTP_ASYNC_HAVE_EPOLL */
+	(void)loop;
+	(void)req;
+#endif /* HTTP_ASYNC_HAVE_EPOLL */
+}
+
+
+/*!
+ * \brief Ends a request and queues it for its callback.
+ *
+ * The request belongs to the delivery jobs afterwards.
+ */
+static void http_async_finish(
+	/*! [in] Loop of the request, NULL if it never started. */
+	http_async_loop *loop,
+	/*! [in] Request. */
+	http_async_request *req,
+	/*! [in] Result. */
+	int ret)
+{
+	if (loop != NULL)
+		http_async_unlink(loop, req);
+	if (req->sock != INVALID_SOCKET) {
+		if (loop != NULL)
+			http_async_unwatch(loop, req);
+		if (ret == UPNP_E_SUCCESS && http_IsPersistent(&req->response) &&
+		    sock_make_blocking(req->sock) == 0) {
+			http_ConnPoolRelease(&req->peer, req->sock);
+		} else {
+			shutdown(req->sock, SD_BOTH);
+			sock_close(req->sock);
+		}
+		req->sock = INVALID_SOCKET;
+	}
+	if (ret != UPNP_E_SUCCESS)
+		UpnpPrintf(UPNP_ALL, HTTP, __FILE__, __LINE__,
+			"(http_async_finish): Error %d, http_error_code = %d.\n",
+			ret, req->response.http_error_code);
+	req->ret = ret;
+	req->prev = NULL;
+	req->next = NULL;
+	ithread_mutex_lock(&gAsyncMutex);
+	if (gAsyncDoneTail != NULL)
+		gAsyncDoneTail->next = req;
+	else
+		gAsyncDone = req;
+	gAsyncDoneTail = req;
+	ithread_mutex_unlock(&gAsyncMutex);
+	http_async_start_worker();
+}
+
+
+/*!
+ * \brief Connects a request, reusing an idle connection if allowed.
+ */
+static void http_async_connect(
+	/*! [in] Loop of the request. */
+	http_async_loop *loop,
+	/*! [in] Request. */
+	http_async_request *req,
+	/*! [in] TRUE if an idle connection may be used. */
+	int allowReuse)
+{
+	SOCKET sock = INVALID_SOCKET;
+	size_t sockaddr_len;
+	int64_t deadline = req->endTime;
+
+	if (allowReuse)
+		sock = http_ConnPoolTake(&req->peer);
+	req->reused = sock != INVALID_SOCKET;
+	req->state = HTTP_ASYNC_SENDING;
+	if (sock == INVALID_SOCKET) {
+		sock = socket((int)req->peer.ss_family, SOCK_STREAM, 0);
+		if (sock == INVALID_SOCKET) {
+			http_async_finish(loop, req, UPNP_E_SOCKET_ERROR);
+			return;
+		}
+	}
+	req->sock = sock;
+	if (sock_make_no_blocking(sock) == -1) {
+		http_async_finish(loop, req, UPNP_E_SOCKET_ERROR);
+		return;
+	}
+	if (!req->reused) {
+		sockaddr_len = req->peer.ss_family == AF_INET6 ?
+			sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+		if (connect(sock, (struct sockaddr *)&req->peer,
+			    (socklen_t)sockaddr_len) == -1) {
+			if (errno != EINPROGRESS) {
+				http_async_finish(loop, req,
+					UPNP_E_SOCKET_CONNECT);
+				return;
+			}
+			req->state = HTTP_ASYNC_CONNECTING;
+			if (imillinow() + HTTP_ASYNC_CONNECT_TIMEOUT <
+			    deadline)
+				deadline = imillinow() +
+					HTTP_ASYNC_CONNECT_TIMEOUT;
+		}
+	}
+	http_async_watch(loop, req, TRUE);
+	http_async_set_deadline(loop, req, deadline);
+}
+
+
+/*!
+ * \brief Fails a request on a socket error, or sends it again on a new
+ * connection if a reused one was closed before any byte of the response.
+ */
+static void http_async_fail(
+	/*! [in] Loop of the request. */
+	http_async_loop *loop,
+	/*! [in] Request. */
+	http_async_request *req,
+	/*! [in] Error. */
+	int ret)
+{
+	if (!req->reused || req->retried ||
+	    req->response.msg.msg.length > (size_t)0) {
+		http_async_finish(loop, req, ret);
+		return;
+	}
+	UpnpPrintf(UPNP_INFO, HTTP, __FILE__, __LINE__,
+		"Reused connection closed by peer, retrying\n");
+	http_async_unwatch(loop, req);
+	sock_close(req->sock);
+	req->sock = INVALID_SOCKET;
+	req->retried = TRUE;
+	req->sent = (size_t)0;
+	req->okOnClose = FALSE;
+	httpmsg_destroy(&req->response.msg);
+	parser_response_init(&req->response, req->method);
+	http_async_connect(loop, req, FALSE);
+}
+
+
+/*!
+ * \brief Receives what is available of the response.
+ */
+static void http_async_recv(
+	/*! [in] Loop of the request. */
+	http_async_loop *loop,
+	/*! [in] Request. */
+	http_async_request *req)
+{
+	char buf[2 * 1024];
+	http_parser_t *parser = &req->response;
+	parse_status_t status;
+	ssize_t num_read;
+	int i;
+
+	for (i = 0; i < HTTP_ASYNC_MAX_READS; i++) {
+		num_read = recv(req->sock, buf, sizeof buf, MSG_NOSIGNAL);
+		if (num_read > 0) {
+			status = parser_append(parser, buf, (size_t)num_read);
+			switch (status) {
+			case PARSE_SUCCESS:
+				UpnpPrintf(UPNP_INFO, HTTP, __FILE__, __LINE__,
+					"<<< (RECVD) <<<\n%s\n-----------------\n",
+					parser->msg.msg.buf);
+				print_http_headers(&parser->msg);
+				if (g_maxContentLength > (size_t)0 &&
+				    parser->content_length >
+				    (unsigned int)g_maxContentLength) {
+					parser->http_error_code =
+						HTTP_REQ_ENTITY_TOO_LARGE;
+					http_async_finish(loop, req,
+						UPNP_E_OUTOF_BOUNDS);
+				} else {
+					http_async_finish(loop, req,
+						UPNP_E_SUCCESS);
+				}
+				return;
+			case PARSE_FAILURE:
+			case PARSE_NO_MATCH:
+				http_async_finish(loop, req,
+					UPNP_E_BAD_HTTPMSG);
+				return;
+			case PARSE_INCOMPLETE_ENTITY:
+				/* read until close */
+				req->okOnClose = TRUE;
+				break;
+			default:
+				break;
+			}
+		} else if (num_read == 0) {
+			if (req->okOnClose) {
+				UpnpPrintf(UPNP_INFO, HTTP, __FILE__, __LINE__,
+					"<<< (RECVD) <<<\n%s\n-----------------\n",
+					parser->msg.msg.buf);
+				print_http_headers(&parser->msg);
+				http_async_finish(loop, req, UPNP_E_SUCCESS);
+			} else {
+				/* partial msg */
+				parser->http_error_code = HTTP_BAD_REQUEST;
+				http_async_fail(loop, req, UPNP_E_BAD_HTTPMSG);
+			}
+			return;
+		} else if (errno == EINTR) {
+			continue;
+		} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			return;
+		} else {
+			http_async_fail(loop, req, UPNP_E_SOCKET_ERROR);
+			return;
+		}
+	}
+}
+
+
+/*!
+ * \brief Sends what the socket accepts of the request.
+ */
+static void http_async_send(
+	/*! [in] Loop of the request. */
+	http_async_loop *loop,
+	/*! [in] Request. */
+	http_async_request *req)
+{
+	ssize_t num_written;
+
+	while (req->sent < req->request.length) {
+		num_written = send(req->sock, req->request.buf + req->sent,
+			req->request.length - req->sent,
+			MSG_DONTROUTE | MSG_NOSIGNAL);
+		if (num_written > 0) {
+			req->sent += (size_t)num_written;
+		} else if (num_written < 0 && errno == EINTR) {
+			continue;
+		} else if (num_written < 0 &&
+			   (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return;
+		} else {
+			http_async_fail(loop, req, UPNP_E_SOCKET_WRITE);
+			return;
+		}
+	}
+	req->state = HTTP_ASYNC_RECEIVING;
+	http_async_watch(loop, req, FALSE);
+}
+
+
+/*!
+ * \brief Handles a readiness event of the socket of a request.
+ */
+static void http_async_handle(
+	/*! [in] Loop of the request. */
+	http_async_loop *loop,
+	/*! [in] Request. */
+	http_async_request *req)
+{
+	int valopt = 0;
+	socklen_t len = sizeof(valopt);
+
+	switch (req->state) {
+	case HTTP_ASYNC_CONNECTING:
+		if (getsockopt(req->sock, SOL_SOCKET, SO_ERROR,
+			       (void *)&valopt, &len) < 0 || valopt != 0) {
+			http_async_finish(loop, req, UPNP_E_SOCKET_CONNECT);
+			return;
+		}
+		req->state = HTTP_ASYNC_SENDING;
+		http_async_set_deadline(loop, req, req->endTime);
+		http_async_send(loop, req);
+		break;
+	case HTTP_ASYNC_SENDING:
+		http_async_send(loop, req);
+		break;
+	case HTTP_ASYNC_RECEIVING:
+		http_async_recv(loop, req);
+		break;
+	}
+}
+
+
+/*!
+ * \brief Fails the requests whose deadline has passed.
+ *
+ * \return Time until the next deadline in milliseconds, -1 if none.
+ */
+static int http_async_expire(
+	/*! [in] Loop. */
+	http_async_loop *loop)
+{
+	http_async_request *req;
+	int64_t now = imillinow();
+	int64_t wait;
+
+	while ((req = loop->first) != NULL && req->deadline <= now)
+		http_async_finish(loop, req,
+			req->state == HTTP_ASYNC_CONNECTING ?
+			UPNP_E_SOCKET_CONNECT : UPNP_E_TIMEDOUT);
+	if (req == NULL || req->deadline == HTTP_ASYNC_NO_DEADLINE)
+		return -1;
+	wait = req->deadline - now;
+
+	return wait > INT_MAX ? INT_MAX : (int)wait;
+}
+
+
+/*!
+ * \brief Waits for events and handles them.
+ */
+static void http_async_poll(
+	/*! [in] Loop. */
+	http_async_loop *loop,
+	/*! [in] Time out in milliseconds, -1 for none. */
+	int timeout)
+{
+	char drain[64];
+#ifdef HTTP_ASYNC_HAVE_EPOLL
+	struct epoll_event events[HTTP_ASYNC_MAX_EVENTS];
+	int n;
+	int i;
+
+	n = epoll_wait(loop->epfd, events, HTTP_ASYNC_MAX_EVENTS, timeout);
+	for (i = 0; i < n; i++) {
+		if (events[i].data.ptr == NULL) {
+			while (read(loop->wakeRead, drain, sizeof drain) > 0)
+				continue;
+		} else {
+			http_async_handle(loop, events[i].data.ptr);
+		}
+	}
+#else /* HTTP_ASYNC_HAVE_EPOLL */
+	http_async_request *req;
+	http_async_request **reqs;
+	struct pollfd *fds;
+	size_t slots;
+	size_t n = (size_t)0;
+	size_t i;
+
+	if (loop->fdSlots < loop->numActive + (size_t)1) {
+		/* on failure the requests that do not fit just wait for their
+		 * deadline */
+		slots = 2 * (loop->numActive + (size_t)1);
+		fds = realloc(loop->fds, slots * sizeof(*fds));
+		if (fds != NULL)
+			loop->fds = fds;
+		reqs = realloc(loop->fdReqs, slots * sizeof(*reqs));
+		if (reqs != NULL)
+			loop->fdReqs = reqs;
+		if (fds != NULL && reqs != NULL)
+			loop->fdSlots = slots;
+	}
+	loop->fds[n].fd = loop->wakeRead;
+	loop->fds[n].events = POLLIN;
+	loop->fdReqs[n++] = NULL;
+	for (req = loop->first; req != NULL && n < loop->fdSlots;
+	     req = req->next) {
+		loop->fds[n].fd = req->sock;
+		loop->fds[n].events = req->state == HTTP_ASYNC_RECEIVING ?
+			POLLIN : POLLOUT;
+		loop->fdReqs[n++] = req;
+	}
+	if (poll(loop->fds, (nfds_t)n, timeout) <= 0)
+		return;
+	for (i = (size_t)0; i < n; i++) {
+		if (loop->fds[i].revents == 0)
+			continue;
+		if (loop->fdReqs[i] == NULL) {
+			while (read(loop->wakeRead, drain, sizeof drain) > 0)
+				continue;
+		} else {
+			http_async_handle(loop, loop->fdReqs[i]);
+		}
+	}
+#endif /* HTTP_ASYNC_HAVE_EPOLL */
+}
+
+
+/*!
+ * \brief Event loop thread.
+ */
+static void *http_async_loop_thread(
+	/*! [in] Loop. */
+	void *arg)
+{
+	http_async_loop *loop = (http_async_loop *)arg;
+	http_async_request *incoming;
+	http_async_request *req;
+	int stop;
+	int timeout;
+
+	while (TRUE) {
+		ithread_mutex_lock(&loop->mutex);
+		incoming = loop->incoming;
+		loop->incoming = NULL;
+		loop->incomingTail = NULL;
+		loop->wakePending = FALSE;
+		stop = loop->stop;
+		ithread_mutex_unlock(&loop->mutex);
+		while ((req = incoming) != NULL) {
+			incoming = req->next;
+			req->next = NULL;
+			if (stop)
+				http_async_finish(NULL, req, UPNP_E_FINISH);
+			else
+				http_async_connect(loop, req, TRUE);
+		}
+		if (stop)
+			break;
+		timeout = http_async_expire(loop);
+		if (http_async_start_worker() &&
+		    (timeout < 0 || timeout > HTTP_ASYNC_RETRY_WAIT))
+			timeout = HTTP_ASYNC_RETRY_WAIT;
+		http_async_poll(loop, timeout);
+	}
+	while (loop->first != NULL)
+		http_async_finish(loop, loop->first, UPNP_E_FINISH);
+	ithread_mutex_lock(&gAsyncMutex);
+	gAsyncLoopsRunning--;
+	ithread_cond_broadcast(&gAsyncCond);
+	ithread_mutex_unlock(&gAsyncMutex);
+
+	return NULL;
+}
+
+
+/*!
+ * \brief Wakes a loop up.
+ */
+static void http_async_wake(
+	/*! [in] Loop. */
+	http_async_loop *loop)
+{
+	ssize_t rc;
+
+	do {
+		rc = write(loop->wakeWrite, "", (size_t)1);
+	} while (rc < 0 && errno == EINTR);
+}
+
+
+/*!
+ * \brief Releases the resources of a loop.
+ */
+static void http_async_loop_destroy(
+	/*! [in] Loop. */
+	http_async_loop *loop)
+{
+#ifdef HTTP_ASYNC_HAVE_EPOLL
+	if (loop->epfd != -1)
+		close(loop->epfd);
+#else /* HTTP_ASYNC_HAVE_EPOLL */
+	free(loop->fds);
+	free(loop->fdReqs);
+#endif /* HTTP_ASYNC_HAVE_EPOLL */
+	if (loop->wakeRead != -1)
+		close(loop->wakeRead);
+	if (loop->wakeWrite != -1)
+		close(loop->wakeWrite);
+	ithread_mutex_destroy(&loop->mutex);
+	memset(loop, 0, sizeof(*loop));
+}
+
+
+/*!
+ * \brief Initializes a loop.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_INIT_FAILED or UPNP_E_OUTOF_MEMORY.
+ */
+static int http_async_loop_init(
+	/*! [in] Loop. */
+	http_async_loop *loop)
+{
+	int fds[2];
+#ifdef HTTP_ASYNC_HAVE_EPOLL
+	struct epoll_event ev;
+#endif /* HTTP_ASYNC_HAVE_EPOLL */
+
+	memset(loop, 0, sizeof(*loop));
+	loop->wakeRead = -1;
+	loop->wakeWrite = -1;
+#ifdef HTTP_ASYNC_HAVE_EPOLL
+	loop->epfd = -1;
+#endif /* HTTP_ASYNC_HAVE_EPOLL */
+	ithread_mutex_init(&loop->mutex, NULL);
+	if (pipe(fds) == -1)
+		goto error_handler;
+	loop->wakeRead = fds[0];
+	loop->wakeWrite = fds[1];
+	if (fcntl(fds[0], F_SETFL, O_NONBLOCK) == -1 ||
+	    fcntl(fds[1], F_SETFL, O_NONBLOCK) == -1)
+		goto error_handler;
+#ifdef HTTP_ASYNC_HAVE_EPOLL
+	loop->epfd = epoll_create(HTTP_ASYNC_MAX_EVENTS);
+	if (loop->epfd == -1)
+		goto error_handler;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->wakeRead, &ev) == -1)
+		goto error_handler;
+#else /* HTTP_ASYNC_HAVE_EPOLL */
+	loop->fdSlots = (size_t)16;
+	loop->fds = malloc(loop->fdSlots * sizeof(*loop->fds));
+	loop->fdReqs = malloc(loop->fdSlots * sizeof(*loop->fdReqs));
+	if (loop->fds == NULL || loop->fdReqs == NULL) {
+		http_async_loop_destroy(loop);
+		return UPNP_E_OUTOF_MEMORY;
+	}
+#endif /* HTTP_ASYNC_HAVE_EPOLL */
+
+	return UPNP_E_SUCCESS;
+
+error_handler:
+	http_async_loop_destroy(loop);
+	return UPNP_E_INIT_FAILED;
+}
+
+
+int http_AsyncInit(ThreadPool *tp)
+{
+	ThreadPoolJob job;
+	int ret;
+	int i;
+
+	if (gAsyncRunning)
+		return UPNP_E_INIT;
+	ithread_mutex_init(&gAsyncMutex, NULL);
+	ithread_cond_init(&gAsyncCond, NULL);
+	gAsyncPool = tp;
+	gAsyncNextLoop = 0;
+	gAsyncLoopsRunning = 0;
+	gAsyncDone = NULL;
+	gAsyncDoneTail = NULL;
+	gAsyncWorkers = 0;
+	for (i = 0; i < HTTP_ASYNC_THREADS; i++) {
+		ret = http_async_loop_init(&gAsyncLoops[i]);
+		if (ret != UPNP_E_SUCCESS) {
+			while (--i >= 0)
+				http_async_loop_destroy(&gAsyncLoops[i]);
+			ithread_cond_destroy(&gAsyncCond);
+			ithread_mutex_destroy(&gAsyncMutex);
+			return ret;
+		}
+	}
+	gAsyncRunning = TRUE;
+	for (i = 0; i < HTTP_ASYNC_THREADS; i++) {
+		memset(&job, 0, sizeof(job));
+		TPJobInit(&job, (start_routine)http_async_loop_thread,
+			&gAsyncLoops[i]);
+		ithread_mutex_lock(&gAsyncMutex);
+		gAsyncLoopsRunning++;
+		ithread_mutex_unlock(&gAsyncMutex);
+		if (ThreadPoolAddPersistent(tp, &job, NULL) != 0) {
+			ithread_mutex_lock(&gAsyncMutex);
+			gAsyncLoopsRunning--;
+			ithread_mutex_unlock(&gAsyncMutex);
+			/* the loops already started exit before they get any
+			 * request */
+			http_AsyncShutdown();
+			return UPNP_E_INIT_FAILED;
+		}
+	}
+
+	return UPNP_E_SUCCESS;
+}
+
+
+void http_AsyncShutdown(void)
+{
+	int i;
+
+	if (!gAsyncRunning)
+		return;
+	ithread_mutex_lock(&gAsyncMutex);
+	gAsyncRunning = FALSE;
+	ithread_mutex_unlock(&gAsyncMutex);
+	for (i = 0; i < HTTP_ASYNC_THREADS; i++) {
+		ithread_mutex_lock(&gAsyncLoops[i].mutex);
+		gAsyncLoops[i].stop = TRUE;
+		ithread_mutex_unlock(&gAsyncLoops[i].mutex);
+		http_async_wake(&gAsyncLoops[i]);
+	}
+	ithread_mutex_lock(&gAsyncMutex);
+	while (gAsyncLoopsRunning > 0)
+		ithread_cond_wait(&gAsyncCond, &gAsyncMutex);
+	while (gAsyncDone != NULL || gAsyncWorkers > 0) {
+		if (gAsyncWorkers == 0) {
+			/* no job could be started: deliver here */
+			gAsyncWorkers++;
+			ithread_mutex_unlock(&gAsyncMutex);
+			http_async_worker(NULL);
+			ithread_mutex_lock(&gAsyncMutex);
+			continue;
+		}
+		ithread_cond_wait(&gAsyncCond, &gAsyncMutex);
+	}
+	ithread_mutex_unlock(&gAsyncMutex);
+	for (i = 0; i < HTTP_ASYNC_THREADS; i++)
+		http_async_loop_destroy(&gAsyncLoops[i]);
+	ithread_cond_destroy(&gAsyncCond);
+	ithread_mutex_destroy(&gAsyncMutex);
+}
+
+
+int http_AsyncRequestAndResponse(
+	uri_type *destination,
+	membuffer *request,
+	http_method_t req_method,
+	int timeout_secs,
+	http_async_callback callback,
+	void *cookie)
+{
+	http_async_request *req;
+	http_async_loop *loop;
+	int wake;
+
+	if (!gAsyncRunning)
+		return UPNP_E_FINISH;
+	req = malloc(sizeof(*req));
+	if (req == NULL)
+		return UPNP_E_OUTOF_MEMORY;
+	memset(req, 0, sizeof(*req));
+	memcpy(&req->peer, &destination->hostport.IPaddress,
+		sizeof(req->peer));
+	req->sock = INVALID_SOCKET;
+	req->method = req_method;
+	req->endTime = timeout_secs > 0 ?
+		imillinow() + (int64_t)timeout_secs * 1000 :
+		HTTP_ASYNC_NO_DEADLINE;
+	req->callback = callback;
+	req->cookie = cookie;
+	parser_response_init(&req->response, req_method);
+	ithread_mutex_lock(&gAsyncMutex);
+	loop = &gAsyncLoops[gAsyncNextLoop++ % HTTP_ASYNC_THREADS];
+	ithread_mutex_unlock(&gAsyncMutex);
+	ithread_mutex_lock(&loop->mutex);
+	if (loop->stop) {
+		ithread_mutex_unlock(&loop->mutex);
+		httpmsg_destroy(&req->response.msg);
+		free(req);
+		return UPNP_E_FINISH;
+	}
+	/* take the contents of the request */
+	req->request = *request;
+	membuffer_init(request);
+	if (loop->incomingTail != NULL)
+		loop->incomingTail->next = req;
+	else
+		loop->incoming = req;
+	loop->incomingTail = req;
+	wake = !loop->wakePending;
+	loop->wakePending = TRUE;
+	ithread_mutex_unlock(&loop->mutex);
+	if (wake)
+		http_async_wake(loop);
+
+	return UPNP_E_SUCCESS;
+}
+
+
+#else /* HTTP_ASYNC_ENABLED */
+
+
+int http_AsyncInit(ThreadPool *tp)
+{
+	(void)tp;
+
+	return UPNP_E_SUCCESS;
+}
+
+
+void http_AsyncShutdown(void)
+{
+}
+
+
+int http_AsyncRequestAndResponse(
+	uri_type *destination,
+	membuffer *request,
+	http_method_t req_method,
+	int timeout_secs,
+	http_async_callback callback,
+	void *cookie)
+{
+	(void)destination;
+	(void)request;
+	(void)req_method;
+	(void)timeout_secs;
+	(void)callback;
+	(void)cookie;
+
+	/* the callers fall back to the blocking client */
+	return UPNP_E_FINISH;
+}
+
+
+#endif /* HTTP_ASYNC_ENABLED */
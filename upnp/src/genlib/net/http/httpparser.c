@@ -45,6 +45,7 @@
 #include "statcodes.h"
 #include "unixutil.h"
 #include "upnpdebug.h"
+#include "UpnpStdInt.h"
 
 #include <assert.h>
 #include <ctype.h>
@@ -53,6 +54,12 @@
 #include <stdio.h>
 #include <string.h>
 
+#if HTTP_SCANNER_USE_SIMD && defined(__GNUC__) && defined(__SSE2__) && \
+	(defined(__x86_64__) || defined(__i386__))
+	#define HTTP_SCANNER_SSE2 1
+	#include <immintrin.h>
+#endif /* HTTP_SCANNER_USE_SIMD */
+
 /* entity positions */
 
 #define NUM_HTTP_METHODS 9
@@ -68,7 +75,7 @@ static str_int_entry Http_Method_Table[NUM_HTTP_METHODS] = {
 	{"POST", SOAPMETHOD_POST},
 };
 
-#define NUM_HTTP_HEADER_NAMES 33
+#define NUM_HTTP_HEADER_NAMES 35
 str_int_entry Http_Header_Names[NUM_HTTP_HEADER_NAMES] = {
 	{"ACCEPT", HDR_ACCEPT},
 	{"ACCEPT-CHARSET", HDR_ACCEPT_CHARSET},
@@ -84,9 +91,11 @@ str_int_entry Http_Header_Names[NUM_HTTP_HEADER_NAMES] = {
 	{"CONTENT-RANGE", HDR_CONTENT_RANGE},
 	{"CONTENT-TYPE", HDR_CONTENT_TYPE},
 	{"DATE", HDR_DATE},
+	{"ETAG", HDR_ETAG},
 	{"EXT", HDR_EXT},
 	{"HOST", HDR_HOST},
 	{"IF-RANGE", HDR_IF_RANGE},
+	{"LAST-MODIFIED", HDR_LAST_MODIFIED},
 	{"LOCATION", HDR_LOCATION},
 	{"MAN", HDR_MAN},
 	{"MX", HDR_MX},
@@ -105,6 +114,190 @@ str_int_entry Http_Header_Names[NUM_HTTP_HEADER_NAMES] = {
 	{"USN", HDR_USN},
 };
 
+/*! Longest name of Http_Header_Names. */
+#define HTTP_HEADER_NAME_MAX 17
+
+/*! Entry of Http_Header_Hash. */
+typedef struct {
+	/*! upper case name, padded with zeros. */
+	char name[24];
+	/*! length of the name. */
+	size_t length;
+	/*! header id. */
+	int id;
+} http_header_hash_entry;
+
+/*!
+ * \brief Perfect hash of the NUM_HTTP_HEADER_NAMES (35) names of
+ * Http_Header_Names: case-insensitive on its own letters, different for
+ * every name, and below 64.
+ *
+ * Http_Header_Hash was generated by searching for the multipliers, it has
+ * one entry per name. Not every id below NUM_HTTP_HEADER_IDS (38) has a
+ * name.
+ */
+#define HTTP_HEADER_HASH(name, len) \
+	((size_t)((((unsigned char)(name)[0] | 0x20) * 35) ^ \
+		  (((unsigned char)(name)[(len) - 1] | 0x20) * 18) ^ \
+		  (((unsigned char)(name)[1] | 0x20) * 20) ^ (len)) & 63)
+
+/*! Http_Header_Names by HTTP_HEADER_HASH(). */
+static const http_header_hash_entry Http_Header_Hash[64] = {
+	{"", 0, HDR_UNKNOWN},
+	{"", 0, HDR_UNKNOWN},
+	{"", 0, HDR_UNKNOWN},
+	{"ST", 2, HDR_ST},
+	{"EXT", 3, HDR_EXT},
+	{"", 0, HDR_UNKNOWN},
+	{"SID", 3, HDR_SID},
+	{"TIMEOUT", 7, HDR_TIMEOUT},
+	{"CACHE-CONTROL", 13, HDR_CACHE_CONTROL},
+	{"CONTENT-LOCATION", 16, HDR_CONTENT_LOCATION},
+	{"", 0, HDR_UNKNOWN},
+	{"CONTENT-ENCODING", 16, HDR_CONTENT_ENCODING},
+	{"MAN", 3, HDR_MAN},
+	{"", 0, HDR_UNKNOWN},
+	{"ACCEPT-ENCODING", 15, HDR_ACCEPT_ENCODING},
+	{"NTS", 3, HDR_NTS},
+	{"", 0, HDR_UNKNOWN},
+	{"ACCEPT", 6, HDR_ACCEPT},
+	{"", 0, HDR_UNKNOWN},
+	{"CALLBACK", 8, HDR_CALLBACK},
+	{"", 0, HDR_UNKNOWN},
+	{"LAST-MODIFIED", 13, HDR_LAST_MODIFIED},
+	{"", 0, HDR_UNKNOWN},
+	{"", 0, HDR_UNKNOWN},
+	{"", 0, HDR_UNKNOWN},
+	{"ACCEPT-CHARSET", 14, HDR_ACCEPT_CHARSET},
+	{"", 0, HDR_UNKNOWN},
+	{"TRANSFER-ENCODING", 17, HDR_TRANSFER_ENCODING},
+	{"LOCATION", 8, HDR_LOCATION},
+	{"RANGE", 5, HDR_RANGE},
+	{"", 0, HDR_UNKNOWN},
+	{"SERVER", 6, HDR_SERVER},
+	{"TE", 2, HDR_TE},
+	{"USER-AGENT", 10, HDR_USER_AGENT},
+	{"", 0, HDR_UNKNOWN},
+	{"SOAPACTION", 10, HDR_SOAPACTION},
+	{"ACCEPT-RANGES", 13, HDR_ACCEPT_RANGE},
+	{"ETAG", 4, HDR_ETAG},
+	{"DATE", 4, HDR_DATE},
+	{"", 0, HDR_UNKNOWN},
+	{"", 0, HDR_UNKNOWN},
+	{"", 0, HDR_UNKNOWN},
+	{"ACCEPT-LANGUAGE", 15, HDR_ACCEPT_LANGUAGE},
+	{"", 0, HDR_UNKNOWN},
+	{"SEQ", 3, HDR_SEQ},
+	{"", 0, HDR_UNKNOWN},
+	{"", 0, HDR_UNKNOWN},
+	{"CONTENT-LANGUAGE", 16, HDR_CONTENT_LANGUAGE},
+	{"NT", 2, HDR_NT},
+	{"IF-RANGE", 8, HDR_IF_RANGE},
+	{"CONTENT-RANGE", 13, HDR_CONTENT_RANGE},
+	{"CONTENT-TYPE", 12, HDR_CONTENT_TYPE},
+	{"", 0, HDR_UNKNOWN},
+	{"MX", 2, HDR_MX},
+	{"", 0, HDR_UNKNOWN},
+	{"", 0, HDR_UNKNOWN},
+	{"HOST", 4, HDR_HOST},
+	{"", 0, HDR_UNKNOWN},
+	{"", 0, HDR_UNKNOWN},
+	{"CONTENT-LENGTH", 14, HDR_CONTENT_LENGTH},
+	{"USN", 3, HDR_USN},
+	{"", 0, HDR_UNKNOWN},
+	{"", 0, HDR_UNKNOWN},
+	{"", 0, HDR_UNKNOWN},
+};
+
+/*!
+ * \brief Converts the lower case ASCII letters of 8 bytes to upper case,
+ * all at once.
+ */
+static UPNP_INLINE uint64_t swar_toupper(uint64_t x)
+{
+	const uint64_t ones = 0x0101010101010101ULL;
+	uint64_t heptets = x & (0x7F * ones);
+	/* high bit set in the bytes >= 'a', and in the bytes > 'z' */
+	uint64_t ge_a = heptets + (0x80 - 'a') * ones;
+	uint64_t gt_z = heptets + (0x80 - 'z' - 1) * ones;
+	uint64_t lower = ge_a & ~gt_z & ~x & (0x80 * ones);
+
+	/* 0x80 >> 2 == 'a' - 'A' */
+	return x - (lower >> 2);
+}
+
+int http_header_name_to_id(const char *name, size_t length)
+{
+	const http_header_hash_entry *entry;
+	uint64_t word;
+	uint64_t expected;
+	size_t i;
+	size_t n;
+
+	if (length < (size_t)2 || length > (size_t)HTTP_HEADER_NAME_MAX)
+		return HDR_UNKNOWN;
+	entry = &Http_Header_Hash[HTTP_HEADER_HASH(name, length)];
+	if (entry->length != length)
+		return HDR_UNKNOWN;
+	for (i = 0; i < length; i += sizeof(word)) {
+		n = length - i < sizeof(word) ? length - i : sizeof(word);
+		word = 0;
+		memcpy(&word, name + i, n);
+		memcpy(&expected, entry->name + i, sizeof(expected));
+		if (swar_toupper(word) != expected)
+			return HDR_UNKNOWN;
+	}
+
+	return entry->id;
+}
+
+/*!
+ * \brief Classifies a request method, case-sensitively.
+ *
+ * \return The method, or -1 if it is unknown.
+ */
+static int http_method_to_id(
+	/*! [in] Method name, not null-terminated. */
+	const char *name,
+	/*! [in] Length of the name. */
+	size_t length)
+{
+	switch (length) {
+	case 3:
+		if (memcmp(name, "GET", 3) == 0)
+			return HTTPMETHOD_GET;
+		break;
+	case 4:
+		if (memcmp(name, "POST", 4) == 0)
+			return HTTPMETHOD_POST;
+		if (memcmp(name, "HEAD", 4) == 0)
+			return HTTPMETHOD_HEAD;
+		break;
+	case 6:
+		if (memcmp(name, "NOTIFY", 6) == 0)
+			return HTTPMETHOD_NOTIFY;
+		if (memcmp(name, "M-POST", 6) == 0)
+			return HTTPMETHOD_MPOST;
+		break;
+	case 8:
+		if (memcmp(name, "M-SEARCH", 8) == 0)
+			return HTTPMETHOD_MSEARCH;
+		break;
+	case 9:
+		if (memcmp(name, "SUBSCRIBE", 9) == 0)
+			return HTTPMETHOD_SUBSCRIBE;
+		break;
+	case 11:
+		if (memcmp(name, "UNSUBSCRIBE", 11) == 0)
+			return HTTPMETHOD_UNSUBSCRIBE;
+		break;
+	default:
+		break;
+	}
+
+	return -1;
+}
+
 /***********************************************************************/
 /*************                 scanner                     *************/
 /***********************************************************************/
@@ -132,6 +325,55 @@ static UPNP_INLINE void scanner_init(OUT scanner_t *scanner, IN membuffer *bufpt
 	scanner->entire_msg_loaded = FALSE;
 }
 
+/*! Character class bits of Http_Char_Class. */
+#define CC_IDENTIFIER	0x01	/* token char */
+#define CC_SEPARATOR	0x02	/* separator, including '\0' */
+#define CC_CONTROL	0x04	/* 0 to 31 and 127 */
+#define CC_STOP		0x08	/* CR, LF, '"' and the 8 bit chars */
+
+/*!
+ * \brief Class of every octet, indexed by unsigned char.
+ *
+ * CC_STOP marks the octets that can change how a line is tokenized: the
+ * ends of line, the start of a quoted string, and the 8 bit chars on which
+ * scanner_get_token() fails. Any other run of octets is a sequence of
+ * complete tokens, whatever those are.
+ */
+static const unsigned char Http_Char_Class[256] = {
+	0x06, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,	/* 0x00 */
+	0x04, 0x06, 0x0c, 0x04, 0x04, 0x0c, 0x04, 0x04,	/* 0x08 */
+	0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,	/* 0x10 */
+	0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,	/* 0x18 */
+	0x02, 0x01, 0x0a, 0x01, 0x01, 0x01, 0x01, 0x01,	/* 0x20 */
+	0x02, 0x02, 0x01, 0x01, 0x02, 0x01, 0x01, 0x02,	/* 0x28 */
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,	/* 0x30 */
+	0x01, 0x01, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,	/* 0x38 */
+	0x02, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,	/* 0x40 */
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,	/* 0x48 */
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,	/* 0x50 */
+	0x01, 0x01, 0x01, 0x02, 0x02, 0x02, 0x01, 0x01,	/* 0x58 */
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,	/* 0x60 */
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,	/* 0x68 */
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,	/* 0x70 */
+	0x01, 0x01, 0x01, 0x02, 0x01, 0x02, 0x01, 0x04,	/* 0x78 */
+	0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08,	/* 0x80 */
+	0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08,	/* 0x88 */
+	0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08,	/* 0x90 */
+	0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08,	/* 0x98 */
+	0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08,	/* 0xa0 */
+	0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08,	/* 0xa8 */
+	0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08,	/* 0xb0 */
+	0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08,	/* 0xb8 */
+	0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08,	/* 0xc0 */
+	0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08,	/* 0xc8 */
+	0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08,	/* 0xd0 */
+	0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08,	/* 0xd8 */
+	0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08,	/* 0xe0 */
+	0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08,	/* 0xe8 */
+	0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08,	/* 0xf0 */
+	0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08,	/* 0xf8 */
+};
+
 /************************************************************************
 * Function :	is_separator_char
 *
@@ -143,7 +385,7 @@ static UPNP_INLINE void scanner_init(OUT scanner_t *scanner, IN membuffer *bufpt
 ************************************************************************/
 static UPNP_INLINE int is_separator_char(IN int c)
 {
-	return strchr(" \t()<>@,;:\\\"/[]?={}", c) != 0;
+	return Http_Char_Class[(unsigned char)c] & CC_SEPARATOR;
 }
 
 /************************************************************************
@@ -157,7 +399,7 @@ static UPNP_INLINE int is_separator_char(IN int c)
 ************************************************************************/
 static UPNP_INLINE int is_identifier_char(IN int c)
 {
-    return c >= 32 && c <= 126 && !is_separator_char(c);
+	return Http_Char_Class[(unsigned char)c] & CC_IDENTIFIER;
 }
 
 /************************************************************************
@@ -171,7 +413,105 @@ static UPNP_INLINE int is_identifier_char(IN int c)
 ************************************************************************/
 static UPNP_INLINE int is_control_char(IN int c)
 {
-    return (c >= 0 && c <= 31) || c == 127;
+	return Http_Char_Class[(unsigned char)c] & CC_CONTROL;
+}
+
+/*!
+ * \brief Finds the first CC_STOP char of [cursor, end), one char at a time.
+ *
+ * \return The stop char, or end if there is none.
+ */
+static const char *scan_stop_scalar(const char *cursor, const char *end)
+{
+	while (cursor < end &&
+	       !(Http_Char_Class[(unsigned char)*cursor] & CC_STOP))
+		cursor++;
+
+	return cursor;
+}
+
+#ifdef HTTP_SCANNER_SSE2
+/*!
+ * \brief Finds the first CC_STOP char of [cursor, end), 16 chars at a time.
+ */
+static const char *scan_stop_sse2(const char *cursor, const char *end)
+{
+	const __m128i cr = _mm_set1_epi8(TOKCHAR_CR);
+	const __m128i lf = _mm_set1_epi8(TOKCHAR_LF);
+	const __m128i quote = _mm_set1_epi8('"');
+	__m128i v;
+	int mask;
+
+	while (end - cursor >= 16) {
+		v = _mm_loadu_si128((const __m128i *)cursor);
+		/* the sign bit flags the 8 bit chars */
+		mask = _mm_movemask_epi8(_mm_or_si128(v, _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, cr),
+				     _mm_cmpeq_epi8(v, lf)),
+			_mm_cmpeq_epi8(v, quote))));
+		if (mask != 0)
+			return cursor + __builtin_ctz((unsigned)mask);
+		cursor += 16;
+	}
+
+	return scan_stop_scalar(cursor, end);
+}
+
+/*!
+ * \brief Finds the first CC_STOP char of [cursor, end), 32 chars at a time.
+ */
+__attribute__((target("avx2")))
+static const char *scan_stop_avx2(const char *cursor, const char *end)
+{
+	const __m256i cr = _mm256_set1_epi8(TOKCHAR_CR);
+	const __m256i lf = _mm256_set1_epi8(TOKCHAR_LF);
+	const __m256i quote = _mm256_set1_epi8('"');
+	__m256i v;
+	unsigned mask;
+
+	while (end - cursor >= 32) {
+		v = _mm256_loadu_si256((const __m256i *)cursor);
+		mask = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(v,
+			_mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, cr),
+					_mm256_cmpeq_epi8(v, lf)),
+			_mm256_cmpeq_epi8(v, quote))));
+		if (mask != 0)
+			return cursor + __builtin_ctz(mask);
+		cursor += 32;
+	}
+
+	return scan_stop_sse2(cursor, end);
+}
+#endif /* HTTP_SCANNER_SSE2 */
+
+static const char *scan_stop_resolve(const char *cursor, const char *end);
+
+/*!
+ * \brief Stop char search used by the scanner, chosen on first use for the
+ * running CPU.
+ */
+static const char *(*scan_stop)(const char *cursor, const char *end) =
+	scan_stop_resolve;
+
+/*!
+ * \brief Selects the best scan_stop implementation, then runs it.
+ *
+ * Every thread selects the same function, so the unsynchronized store is
+ * harmless.
+ */
+static const char *scan_stop_resolve(const char *cursor, const char *end)
+{
+#ifdef HTTP_SCANNER_SSE2
+	if (__builtin_cpu_supports("avx2"))
+		scan_stop = scan_stop_avx2;
+	else
+		scan_stop = scan_stop_sse2;
+#else /* HTTP_SCANNER_SSE2 */
+	scan_stop = scan_stop_scalar;
+#endif /* HTTP_SCANNER_SSE2 */
+
+	return scan_stop(cursor, end);
 }
 
 /************************************************************************
@@ -340,49 +680,114 @@ static UPNP_INLINE char *scanner_get_str(IN scanner_t * scanner)
 	return scanner->msg->buf + scanner->cursor;
 }
 
+/*!
+ * \brief Moves the scanner over the tokens that precede the next CR, LF,
+ * quote or 8 bit char.
+ *
+ * Those tokens would all be returned as PARSE_OK by scanner_get_token(), and
+ * none of them ends a line. Nothing is skipped if the stop char is not in
+ * the buffer yet: the last token may be incomplete and the caller has to
+ * see it.
+ *
+ * \return The number of chars skipped.
+ */
+static UPNP_INLINE size_t scanner_skip_plain(INOUT scanner_t *scanner)
+{
+	const char *cursor = scanner_get_str(scanner);
+	const char *end = scanner->msg->buf + scanner->msg->length;
+	const char *stop;
+
+	stop = scan_stop(cursor, end);
+	if (stop == end)
+		return (size_t)0;
+	scanner->cursor += (size_t)(stop - cursor);
+
+	return (size_t)(stop - cursor);
+}
+
 
-/************************************************************************
-* Function :	httpmsg_compare
-*
-* Parameters :
-*	void* param1 ;	
-*	void* param2 ;	
-*
-* Description :	Compares name id in the http headers.
-*
-* Return : int ;
-*
-* Note :
-************************************************************************/
-static int httpmsg_compare(void *param1, void *param2)
+/*! value_offset of the headers with an empty value. */
+#define EMPTY_HDR_VALUE ((size_t)-1)
+
+/*! Value of the headers with an empty value: a 1 byte string, as it has
+ * always been. Callers may temporarily null-terminate it. */
+static char empty_hdr_value[2];
+
+/*!
+ * \brief Returns the storage of the header at a given position.
+ */
+static UPNP_INLINE http_header_t *httpmsg_hdr_slot(
+	/*! [in] HTTP Message Object. */
+	http_message_t *msg,
+	/*! [in] Position of the header. */
+	size_t position)
 {
-    assert( param1 != NULL );
-    assert( param2 != NULL );
+	if (position < (size_t)HTTP_INLINE_HEADERS)
+		return &msg->header_array[position];
+	return &msg->extra_headers[position - (size_t)HTTP_INLINE_HEADERS];
+}
+
+/*!
+ * \brief Points the name and the value of a header to where they currently
+ * are.
+ *
+ * \return The header.
+ */
+static http_header_t *httpmsg_resolve_hdr(
+	/*! [in] HTTP Message Object. */
+	http_message_t *msg,
+	/*! [in] Header of that message. */
+	http_header_t *hdr)
+{
+	if (hdr->name_buf.buf != NULL) {
+		hdr->name.buf = hdr->name_buf.buf;
+		hdr->name.length = hdr->name_buf.length;
+	} else {
+		hdr->name.buf = msg->msg.buf + hdr->name_offset;
+	}
+	if (hdr->value_buf.buf != NULL) {
+		hdr->value.buf = hdr->value_buf.buf;
+		hdr->value.length = hdr->value_buf.length;
+	} else if (hdr->value_offset == EMPTY_HDR_VALUE) {
+		hdr->value.buf = empty_hdr_value;
+	} else {
+		hdr->value.buf = msg->msg.buf + hdr->value_offset;
+	}
 
-    return
-	    ((http_header_t *)param1)->name_id ==
-	    ((http_header_t *)param2)->name_id;
+	return hdr;
 }
 
-/************************************************************************
-* Function :	httpheader_free
-*
-* Parameters :
-*	void *msg ;	
-*
-* Description :	Free memory allocated for the http header
-*
-* Return : void ;
-*
-* Note :
-************************************************************************/
-static void httpheader_free(void *msg)
+/*!
+ * \brief Adds a header to a message.
+ *
+ * \return The new header, or NULL if there is not enough memory.
+ */
+static http_header_t *httpmsg_add_hdr(
+	/*! [in] HTTP Message Object. */
+	http_message_t *msg)
 {
-    http_header_t *hdr = ( http_header_t * ) msg;
+	http_header_t *extra;
+	size_t size;
+	http_header_t *hdr;
+
+	if (msg->num_headers >= (size_t)HTTP_INLINE_HEADERS +
+	    msg->extra_headers_size) {
+		size = msg->extra_headers_size ?
+			2 * msg->extra_headers_size :
+			(size_t)HTTP_INLINE_HEADERS;
+		extra = realloc(msg->extra_headers, size * sizeof(http_header_t));
+		if (extra == NULL)
+			return NULL;
+		msg->extra_headers = extra;
+		msg->extra_headers_size = size;
+	}
+	hdr = httpmsg_hdr_slot(msg, msg->num_headers);
+	msg->num_headers++;
+	memset(hdr, 0, sizeof(http_header_t));
+	membuffer_init(&hdr->name_buf);
+	membuffer_init(&hdr->value_buf);
 
-    membuffer_destroy( &hdr->name_buf );
-    membuffer_destroy( &hdr->value );
-    free( hdr );
+	return hdr;
 }
 
 /************************************************************************
@@ -402,7 +807,10 @@ void httpmsg_init(INOUT http_message_t *msg)
     msg->initialized = 1;
     msg->entity.buf = NULL;
     msg->entity.length = ( size_t ) 0;
-    ListInit( &msg->headers, httpmsg_compare, httpheader_free );
+    msg->num_headers = ( size_t ) 0;
+    msg->extra_headers = NULL;
+    msg->extra_headers_size = ( size_t ) 0;
+    memset( msg->header_index, 0, sizeof( msg->header_index ) );
     membuffer_init( &msg->msg );
     membuffer_init( &msg->status_msg );
 }
@@ -421,10 +829,20 @@ void httpmsg_init(INOUT http_message_t *msg)
 ************************************************************************/
 void httpmsg_destroy( INOUT http_message_t * msg )
 {
+    http_header_t *hdr;
+    size_t i;
+
     assert( msg != NULL );
 
     if( msg->initialized == 1 ) {
-        ListDestroy( &msg->headers, 1 );
+        for( i = ( size_t ) 0; i < msg->num_headers; i++ ) {
+            hdr = httpmsg_hdr_slot( msg, i );
+            membuffer_destroy( &hdr->name_buf );
+            membuffer_destroy( &hdr->value_buf );
+        }
+        free( msg->extra_headers );
+        msg->extra_headers = NULL;
+        msg->num_headers = ( size_t ) 0;
         membuffer_destroy( &msg->msg );
         membuffer_destroy( &msg->status_msg );
         free( msg->urlbuf );
@@ -440,7 +858,7 @@ void httpmsg_destroy( INOUT http_message_t * msg )
 *	IN const char* header_name ; Header name to be compared with
 *
 * Description :	Compares the header name with the header names stored
-*	in	the linked list of messages
+*	in	the message
 *
 * Return : http_header_t* - Pointer to a header on success;
 *		 NULL on failure
@@ -452,19 +870,13 @@ http_header_t *httpmsg_find_hdr_str(
 	IN const char *header_name)
 {
     http_header_t *header;
+    size_t i;
 
-    ListNode *node;
-
-    node = ListHead( &msg->headers );
-    while( node != NULL ) {
-
-        header = ( http_header_t * ) node->item;
-
+    for( i = ( size_t ) 0; i < msg->num_headers; i++ ) {
+        header = httpmsg_resolve_hdr( msg, httpmsg_hdr_slot( msg, i ) );
         if( memptr_cmp_nocase( &header->name, header_name ) == 0 ) {
             return header;
         }
-
-        node = ListNext( &msg->headers, node );
     }
     return NULL;
 }
@@ -477,7 +889,7 @@ http_header_t *httpmsg_find_hdr_str(
 *	IN int header_name_id ;	 Header Name ID to be compared with
 *	OUT memptr* value ;		 Buffer to get the ouput to.
 *
-* Description :	Finds header from a list, with the given 'name_id'.
+* Description :	Finds header from the message, with the given 'name_id'.
 *
 * Return : http_header_t*  - Pointer to a header on success;
 *				NULL on failure
@@ -489,16 +901,18 @@ http_header_t *httpmsg_find_hdr(
 	IN int header_name_id,
 	OUT memptr *value)
 {
-    http_header_t header;       /* temp header for searching */
-    ListNode *node;
     http_header_t *data;
+    size_t position;
 
-    header.name_id = header_name_id;
-    node = ListFind( &msg->headers, NULL, &header );
-    if( node == NULL ) {
+    if( header_name_id < 0 || header_name_id >= NUM_HTTP_HEADER_IDS ) {
         return NULL;
     }
-    data = ( http_header_t * ) node->item;
+    position = msg->header_index[header_name_id];
+    if( position == ( size_t ) 0 ) {
+        return NULL;
+    }
+    data = httpmsg_resolve_hdr( msg,
+        httpmsg_hdr_slot( msg, position - ( size_t ) 1 ) );
     if( value != NULL ) {
         value->buf = data->value.buf;
         value->length = data->value.length;
@@ -507,6 +921,27 @@ http_header_t *httpmsg_find_hdr(
     return data;
 }
 
+http_header_t *httpmsg_get_hdr(http_message_t *msg, size_t position)
+{
+	if (position >= msg->num_headers)
+		return NULL;
+
+	return httpmsg_resolve_hdr(msg, httpmsg_hdr_slot(msg, position));
+}
+
+int httpmsg_keep_hdr_value(http_message_t *msg, http_header_t *header)
+{
+	httpmsg_resolve_hdr(msg, header);
+	if (header->value_buf.buf != NULL)
+		return UPNP_E_SUCCESS;
+	if (membuffer_assign(&header->value_buf, header->value.buf,
+			     header->value.length) != 0)
+		return UPNP_E_OUTOF_MEMORY;
+	httpmsg_resolve_hdr(msg, header);
+
+	return UPNP_E_SUCCESS;
+}
+
 /************************************************************************
 * Function :	skip_blank_lines
 *
@@ -699,6 +1134,8 @@ static UPNP_INLINE parse_status_t match_raw_value(
     raw_value->length = ( size_t ) 0;
 
     while( !done ) {
+        if( !saw_crlf )
+            raw_value->length += scanner_skip_plain( scanner );
         status = scanner_get_token( scanner, &token, &tok_type );
         if( status == ( parse_status_t ) PARSE_OK ) {
             if( !saw_crlf ) {
@@ -838,6 +1275,7 @@ read_until_crlf( INOUT scanner_t * scanner,
 
     /* read until we hit a crlf */
     do {
+        scanner_skip_plain( scanner );
         status = scanner_get_token( scanner, &token, &tok_type );
     } while( status == ( parse_status_t ) PARSE_OK &&
 	tok_type != ( token_type_t ) TT_CRLF );
@@ -1246,7 +1684,7 @@ parser_parse_requestline( INOUT http_parser_t * parser )
     http_message_t *hmsg = &parser->msg;
     memptr method_str;
     memptr version_str;
-    int index;
+    int method;
     char save_char;
     int num_scanned;
     memptr url_str;
@@ -1264,17 +1702,15 @@ parser_parse_requestline( INOUT http_parser_t * parser )
 
     if( status == ( parse_status_t ) PARSE_OK ) {
 
-        index =
-            map_str_to_int( method_str.buf, method_str.length,
-                            Http_Method_Table, NUM_HTTP_METHODS, TRUE );
+        method = http_method_to_id( method_str.buf, method_str.length );
 
-        if( index < 0 ) {
+        if( method < 0 ) {
             /* error; method not found */
             parser->http_error_code = HTTP_NOT_IMPLEMENTED;
             return PARSE_FAILURE;
         }
 
-        if( Http_Method_Table[index].id != HTTPMETHOD_GET ) {
+        if( method != HTTPMETHOD_GET ) {
             parser->http_error_code = HTTP_BAD_REQUEST;
             return PARSE_FAILURE;
         }
@@ -1316,10 +1752,8 @@ parser_parse_requestline( INOUT http_parser_t * parser )
         return PARSE_FAILURE;
     }
 
-    index =
-        map_str_to_int( method_str.buf, method_str.length,
-                        Http_Method_Table, NUM_HTTP_METHODS, TRUE );
-    if( index < 0 ) {
+    method = http_method_to_id( method_str.buf, method_str.length );
+    if( method < 0 ) {
         /* error; method not found */
         parser->http_error_code = HTTP_NOT_IMPLEMENTED;
         return PARSE_FAILURE;
@@ -1336,13 +1770,13 @@ parser_parse_requestline( INOUT http_parser_t * parser )
          * UPnP certification tool */
         hmsg->major_version < 0 ||
 	( hmsg->major_version == 1 && hmsg->minor_version < 1 &&
-	  Http_Method_Table[index].id == HTTPMETHOD_MSEARCH )) {
+	  method == HTTPMETHOD_MSEARCH )) {
         parser->http_error_code = HTTP_HTTP_VERSION_NOT_SUPPORTED;
         /* error; bad http version */
         return PARSE_FAILURE;
     }
 
-    hmsg->method = ( http_method_t ) Http_Method_Table[index].id;
+    hmsg->method = ( http_method_t ) method;
     parser->position = POS_HEADERS; /* move to headers */
 
     return PARSE_OK;
@@ -1448,14 +1882,16 @@ parse_status_t parser_parse_headers(INOUT http_parser_t *parser)
 	memptr hdr_value;
 	token_type_t tok_type;
 	scanner_t *scanner = &parser->scanner;
+	http_message_t *msg = &parser->msg;
 	size_t save_pos;
 	http_header_t *header;
 	int header_id;
 	int ret = 0;
-	int index;
 	http_header_t *orig_header;
 	char save_char;
 	int ret2;
+	/* trailers are deleted from the raw message once parsed */
+	int is_trailer = parser->position != (parser_pos_t)POS_HEADERS;
 
 	assert(parser->position == (parser_pos_t)POS_HEADERS ||
 	       parser->ent_position == ENTREAD_CHUNKY_HEADERS);
@@ -1494,68 +1930,70 @@ parse_status_t parser_parse_headers(INOUT http_parser_t *parser)
 		}
 		/* add header */
 		/* find header */
-		index =
-		    map_str_to_int(token.buf, token.length, Http_Header_Names,
-				   NUM_HTTP_HEADER_NAMES, FALSE);
-		if (index != -1) {
+		header_id = http_header_name_to_id(token.buf, token.length);
+		if (header_id != HDR_UNKNOWN) {
 			/*Check if it is a soap header */
-			if (Http_Header_Names[index].id == HDR_SOAPACTION) {
+			if (header_id == HDR_SOAPACTION) {
 				parser->msg.method = SOAPMETHOD_POST;
 			}
-			header_id = Http_Header_Names[index].id;
 			orig_header =
-			    httpmsg_find_hdr(&parser->msg, header_id, NULL);
+			    httpmsg_find_hdr(msg, header_id, NULL);
 		} else {
-			header_id = HDR_UNKNOWN;
 			save_char = token.buf[token.length];
 			token.buf[token.length] = '\0';
 			orig_header =
-			    httpmsg_find_hdr_str(&parser->msg, token.buf);
+			    httpmsg_find_hdr_str(msg, token.buf);
 			token.buf[token.length] = save_char;	/* restore */
 		}
 		if (orig_header == NULL) {
 			/* add new header */
-			header =
-			    (http_header_t *) malloc(sizeof(http_header_t));
+			header = httpmsg_add_hdr(msg);
 			if (header == NULL) {
 				parser->http_error_code =
 				    HTTP_INTERNAL_SERVER_ERROR;
 				return PARSE_FAILURE;
 			}
-			membuffer_init(&header->name_buf);
-			membuffer_init(&header->value);
+			ret = UPNP_E_SUCCESS;
+			header->name_id = header_id;
+			header->name.length = token.length;
+			header->value.length = hdr_value.length;
+			header->name_offset = (size_t)(token.buf - msg->msg.buf);
+			header->value_offset =
+				(size_t)(hdr_value.buf - msg->msg.buf);
+			if (header_id >= 0 && header_id < NUM_HTTP_HEADER_IDS)
+				msg->header_index[header_id] = msg->num_headers;
 			/* value can be 0 length */
 			if (hdr_value.length == (size_t)0) {
-				/* FIXME: Is this a bug? buf is not const. */
-				hdr_value.buf = "\0";
+				hdr_value.buf = empty_hdr_value;
 				hdr_value.length = (size_t)1;
+				header->value_offset = EMPTY_HDR_VALUE;
+				header->value.length = hdr_value.length;
 			}
-			/* save in header in buffers */
-			if (membuffer_assign(&header->name_buf, token.buf, token.length) ||
-			    membuffer_assign(&header->value, hdr_value.buf, hdr_value.length)) {
-				/* not enough mem */
-				membuffer_destroy(&header->value);
-				membuffer_destroy(&header->name_buf);
-				free(header);
-				parser->http_error_code = HTTP_INTERNAL_SERVER_ERROR;
-				return PARSE_FAILURE;
+			if (is_trailer) {
+				ret = membuffer_assign(&header->name_buf,
+					token.buf, token.length);
+				if (ret == 0)
+					ret = membuffer_assign(&header->value_buf,
+						hdr_value.buf, hdr_value.length);
 			}
-			header->name.buf = header->name_buf.buf;
-			header->name.length = header->name_buf.length;
-			header->name_id = header_id;
-			if (!ListAddTail(&parser->msg.headers, header)) {
-				membuffer_destroy(&header->value);
-				membuffer_destroy(&header->name_buf);
-				free(header);
+			if (ret != 0) {
+				/* not enough mem */
 				parser->http_error_code = HTTP_INTERNAL_SERVER_ERROR;
 				return PARSE_FAILURE;
 			}
 		} else if (hdr_value.length > (size_t)0) {
 			/* append value to existing header */
+			ret = UPNP_E_SUCCESS;
+			if (orig_header->value_buf.buf == NULL)
+				ret = membuffer_assign(&orig_header->value_buf,
+					orig_header->value.buf,
+					orig_header->value.length);
 			/* append space */
-			ret = membuffer_append_str(&orig_header->value, ", ");
+			ret2 = membuffer_append_str(&orig_header->value_buf, ", ");
+			if (ret == UPNP_E_SUCCESS)
+				ret = ret2;
 			/* append continuation of header value */
-			ret2 = membuffer_append(&orig_header->value,
+			ret2 = membuffer_append(&orig_header->value_buf,
 						hdr_value.buf,
 						hdr_value.length);
 			if (ret == UPNP_E_OUTOF_MEMORY
@@ -2140,13 +2578,14 @@ int raw_find_str(IN memptr *raw_value, IN const char *str)
 {
     char c;
     char *ptr;
-    int i = 0;
+    size_t i;
 
     /* save */
     c = raw_value->buf[raw_value->length];
 
-    /* Make it lowercase */
-    for (i = 0; raw_value->buf[i]; ++i) {
+    /* Make it lowercase; the value is a span of the raw message, so
+     * only its own bytes */
+    for (i = (size_t)0; i < raw_value->length; ++i) {
         raw_value->buf[i] = (char)tolower(raw_value->buf[i]);
     }
 
@@ -2194,9 +2633,8 @@ const char *method_to_str(IN http_method_t method)
 #ifdef DEBUG
 void print_http_headers(http_message_t *hmsg)
 {
-    ListNode *node;
-    /* NNS:  dlist_node *node; */
     http_header_t *header;
+    size_t i;
 
     /* print start line */
     if( hmsg->is_request ) {
@@ -2210,17 +2648,11 @@ void print_http_headers(http_message_t *hmsg)
     }
 
     /* print headers */
-    node = ListHead( &hmsg->headers );
-    /* NNS: node = dlist_first_node( &hmsg->headers ); */
-    while( node != NULL ) {
-        header = ( http_header_t * ) node->item;
-        /* NNS: header = (http_header_t *)node->data; */
+    for( i = ( size_t ) 0; ( header = httpmsg_get_hdr( hmsg, i ) ) != NULL;
+         i++ ) {
         printf( "hdr name: %.*s, value: %.*s\n", 
             (int)header->name.length, header->name.buf,
             (int)header->value.length, header->value.buf );
-
-        node = ListNext( &hmsg->headers, node );
-        /* NNS: node = dlist_next( &hmsg->headers, node ); */
     }
 }
 #endif /* DEBUG */
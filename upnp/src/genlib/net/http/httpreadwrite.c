@@ -41,6 +41,7 @@
 
 #include "httpreadwrite.h"
 
+#include "ithread.h"
 #include "unixutil.h"
 #include "upnp.h"
 #include "upnpapi.h"
@@ -365,10 +366,14 @@ int http_RecvMessage(
 
 ExitFunction:
 	if (ret != UPNP_E_SUCCESS) {
+		/* keep the errno of the failed read for the caller */
+		int err = errno;
+
 		UpnpPrintf(UPNP_ALL, HTTP, __FILE__, line,
 			"(http_RecvMessage): Error %d, http_error_code = %d.\n",
 			ret,
 			*http_error_code);
+		errno = err;
 	}
 
 	return ret;
@@ -553,6 +558,265 @@ ExitFunction:
 }
 
 
+/*! Idle connection kept open for reuse. */
+typedef struct HTTP_POOLED_CONN {
+	/*! Connected socket, INVALID_SOCKET if the slot is free. */
+	SOCKET sock;
+	/*! Address of the peer. */
+	struct sockaddr_storage addr;
+	/*! Time the connection became idle. */
+	time_t idleSince;
+} http_pooled_conn_t;
+
+/*! Idle connections, see HTTP_CONN_POOL_MAX_IDLE. */
+static http_pooled_conn_t gHttpConnPool[HTTP_CONN_POOL_MAX_IDLE + 1];
+/*! Protects gHttpConnPool. */
+static ithread_mutex_t gHttpConnPoolMutex;
+/*! TRUE between http_ConnPoolInit and http_ConnPoolDestroy. */
+static int gHttpConnPoolEnabled = FALSE;
+
+/*!
+ * \brief Compares the address and port of two peers.
+ *
+ * \return TRUE if they are the same.
+ */
+static int same_peer(
+	const struct sockaddr_storage *a,
+	const struct sockaddr_storage *b)
+{
+	const struct sockaddr_in *a4 = (const struct sockaddr_in *)a;
+	const struct sockaddr_in *b4 = (const struct sockaddr_in *)b;
+	const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *)a;
+	const struct sockaddr_in6 *b6 = (const struct sockaddr_in6 *)b;
+
+	if (a->ss_family != b->ss_family)
+		return FALSE;
+	switch (a->ss_family) {
+	case AF_INET:
+		return a4->sin_port == b4->sin_port &&
+			a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+	case AF_INET6:
+		return a6->sin6_port == b6->sin6_port &&
+			a6->sin6_scope_id == b6->sin6_scope_id &&
+			memcmp(&a6->sin6_addr, &b6->sin6_addr,
+				sizeof(a6->sin6_addr)) == 0;
+	default:
+		return FALSE;
+	}
+}
+
+/*!
+ * \brief Checks that an idle connection has not been closed by the peer.
+ *
+ * An idle connection must not be readable: either the peer closed it or
+ * it sent unsolicited data, and it cannot be reused in both cases.
+ *
+ * \return TRUE if the connection can be reused.
+ */
+static int idle_conn_is_alive(SOCKET sock)
+{
+	fd_set readSet;
+	struct timeval timeout = {0, 0};
+
+	FD_ZERO(&readSet);
+	FD_SET(sock, &readSet);
+
+	return select((int)sock + 1, &readSet, NULL, NULL, &timeout) == 0;
+}
+
+/*!
+ * \brief Closes the idle connections older than HTTP_CONN_POOL_IDLE_TIME.
+ * Must be called with gHttpConnPoolMutex held.
+ */
+static void http_ConnPoolExpire(time_t now)
+{
+	int i;
+
+	for (i = 0; i < HTTP_CONN_POOL_MAX_IDLE; i++) {
+		if (gHttpConnPool[i].sock != INVALID_SOCKET &&
+		    now - gHttpConnPool[i].idleSince >= HTTP_CONN_POOL_IDLE_TIME) {
+			sock_close(gHttpConnPool[i].sock);
+			gHttpConnPool[i].sock = INVALID_SOCKET;
+		}
+	}
+}
+
+int http_ConnPoolInit(void)
+{
+	int i;
+
+	for (i = 0; i < HTTP_CONN_POOL_MAX_IDLE + 1; i++)
+		gHttpConnPool[i].sock = INVALID_SOCKET;
+	if (ithread_mutex_init(&gHttpConnPoolMutex, NULL) != 0)
+		return UPNP_E_INIT_FAILED;
+	gHttpConnPoolEnabled = HTTP_CONN_POOL_MAX_IDLE > 0;
+
+	return UPNP_E_SUCCESS;
+}
+
+void http_ConnPoolDestroy(void)
+{
+	int i;
+
+	ithread_mutex_lock(&gHttpConnPoolMutex);
+	gHttpConnPoolEnabled = FALSE;
+	for (i = 0; i < HTTP_CONN_POOL_MAX_IDLE; i++) {
+		sock_close(gHttpConnPool[i].sock);
+		gHttpConnPool[i].sock = INVALID_SOCKET;
+	}
+	ithread_mutex_unlock(&gHttpConnPoolMutex);
+	ithread_mutex_destroy(&gHttpConnPoolMutex);
+}
+
+SOCKET http_ConnPoolTake(const struct sockaddr_storage *peer)
+{
+	SOCKET sock = INVALID_SOCKET;
+	int i;
+
+	if (!gHttpConnPoolEnabled)
+		return INVALID_SOCKET;
+	ithread_mutex_lock(&gHttpConnPoolMutex);
+	http_ConnPoolExpire(time(NULL));
+	for (i = 0; i < HTTP_CONN_POOL_MAX_IDLE; i++) {
+		if (gHttpConnPool[i].sock == INVALID_SOCKET ||
+		    !same_peer(&gHttpConnPool[i].addr, peer))
+			continue;
+		sock = gHttpConnPool[i].sock;
+		gHttpConnPool[i].sock = INVALID_SOCKET;
+		if (idle_conn_is_alive(sock))
+			break;
+		sock_close(sock);
+		sock = INVALID_SOCKET;
+	}
+	ithread_mutex_unlock(&gHttpConnPoolMutex);
+
+	return sock;
+}
+
+int http_ConnPoolAcquire(
+	uri_type *destination,
+	int allowReuse,
+	SOCKINFO *info,
+	int *reused)
+{
+	SOCKET sock = INVALID_SOCKET;
+	size_t sockaddr_len;
+
+	*reused = FALSE;
+	if (allowReuse) {
+		sock = http_ConnPoolTake(&destination->hostport.IPaddress);
+		if (sock != INVALID_SOCKET) {
+			*reused = TRUE;
+			return sock_init(info, sock);
+		}
+	}
+	sock = socket(
+		(int)destination->hostport.IPaddress.ss_family, SOCK_STREAM, 0);
+	if (sock == INVALID_SOCKET)
+		return UPNP_E_SOCKET_ERROR;
+	if (sock_init(info, sock) != UPNP_E_SUCCESS) {
+		sock_destroy(info, SD_BOTH);
+		return UPNP_E_SOCKET_ERROR;
+	}
+	/* connect */
+	sockaddr_len = destination->hostport.IPaddress.ss_family == AF_INET6 ?
+		sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+	if (private_connect(info->socket,
+		(struct sockaddr *)&(destination->hostport.IPaddress),
+		(socklen_t)sockaddr_len) == -1) {
+		sock_destroy(info, SD_BOTH);
+		return UPNP_E_SOCKET_CONNECT;
+	}
+
+	return UPNP_E_SUCCESS;
+}
+
+void http_ConnPoolRelease(
+	const struct sockaddr_storage *peer,
+	SOCKET sock)
+{
+	int i;
+	int freeSlot = -1;
+	int oldest = -1;
+	int perHost = 0;
+	time_t now = time(NULL);
+
+	if (!gHttpConnPoolEnabled) {
+		shutdown(sock, SD_BOTH);
+		sock_close(sock);
+		return;
+	}
+	ithread_mutex_lock(&gHttpConnPoolMutex);
+	http_ConnPoolExpire(now);
+	for (i = 0; i < HTTP_CONN_POOL_MAX_IDLE; i++) {
+		if (gHttpConnPool[i].sock == INVALID_SOCKET) {
+			if (freeSlot < 0)
+				freeSlot = i;
+			continue;
+		}
+		if (oldest < 0 ||
+		    gHttpConnPool[i].idleSince < gHttpConnPool[oldest].idleSince)
+			oldest = i;
+		if (same_peer(&gHttpConnPool[i].addr, peer))
+			perHost++;
+	}
+	if (perHost >= HTTP_CONN_POOL_MAX_PER_HOST) {
+		freeSlot = -1;
+	} else if (freeSlot < 0) {
+		/* make room by dropping the least recently used connection */
+		freeSlot = oldest;
+		sock_close(gHttpConnPool[freeSlot].sock);
+	}
+	if (freeSlot >= 0) {
+		gHttpConnPool[freeSlot].sock = sock;
+		gHttpConnPool[freeSlot].addr = *peer;
+		gHttpConnPool[freeSlot].idleSince = now;
+		sock = INVALID_SOCKET;
+	}
+	ithread_mutex_unlock(&gHttpConnPoolMutex);
+	if (sock != INVALID_SOCKET) {
+		shutdown(sock, SD_BOTH);
+		sock_close(sock);
+	}
+}
+
+int http_IsPersistent(http_parser_t *response)
+{
+	http_header_t *header;
+
+	if (response->ent_position == ENTREAD_UNTIL_CLOSE)
+		return FALSE;
+	if (response->msg.major_version < 1 ||
+	    (response->msg.major_version == 1 &&
+	     response->msg.minor_version < 1))
+		return FALSE;
+	header = httpmsg_find_hdr_str(&response->msg, "CONNECTION");
+	if (header && header->value.length >= strlen("close") &&
+	    strncasecmp(header->value.buf, "close", strlen("close")) == 0)
+		return FALSE;
+
+	return TRUE;
+}
+
+
+int http_IsStaleConnection(
+	int ret_code,
+	int err,
+	http_parser_t *response)
+{
+	if (response->msg.msg.length > (size_t)0)
+		return FALSE;
+	/* closed by the peer */
+	if (ret_code == UPNP_E_BAD_HTTPMSG)
+		return TRUE;
+	/* reset by the peer */
+	if (ret_code == UPNP_E_SOCKET_ERROR || ret_code == -1)
+		return err == ECONNRESET || err == EPIPE;
+
+	return FALSE;
+}
+
+
 /************************************************************************
  * Function: http_RequestAndResponse
  *
@@ -566,8 +830,13 @@ ExitFunction:
  *	OUT http_parser_t* response;	Parser object to receive the repsonse
  *
  * Description:
- *	Initiates socket, connects to the destination, sends a
- *	request and waits for the response from the remote end
+ *	Gets a connection to the destination, sends a request and waits
+ *	for the response from the remote end. Idle HTTP/1.1 connections
+ *	are reused, and put back in the pool when the response allows it.
+ *	A request whose reused connection was closed or reset by the peer
+ *	before any response byte was received is sent again on a new
+ *	connection. A time out is never retried, the peer may have
+ *	acted on the request.
  *
  * Returns:
  *	UPNP_E_SOCKET_ERROR
@@ -583,77 +852,101 @@ int http_RequestAndResponse(
 	IN int timeout_secs,
 	OUT http_parser_t *response)
 {
-	SOCKET tcp_connection;
 	int ret_code;
-	size_t sockaddr_len;
 	int http_error_code;
+	int timeout;
+	int reused = FALSE;
+	int attempt;
 	SOCKINFO info;
 
-	tcp_connection = socket(
-		(int)destination->hostport.IPaddress.ss_family, SOCK_STREAM, 0);
-	if (tcp_connection == INVALID_SOCKET) {
-		parser_response_init(response, req_method);
-		return UPNP_E_SOCKET_ERROR;
-	}
-	if (sock_init(&info, tcp_connection) != UPNP_E_SUCCESS) {
-		parser_response_init(response, req_method);
-		ret_code = UPNP_E_SOCKET_ERROR;
-		goto end_function;
-	}
-	/* connect */
-	sockaddr_len = destination->hostport.IPaddress.ss_family == AF_INET6 ?
-		sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
-	ret_code = private_connect(info.socket,
-		(struct sockaddr *)&(destination->hostport.IPaddress),
-		(socklen_t)sockaddr_len);
-	if (ret_code == -1) {
-		parser_response_init(response, req_method);
-		ret_code = UPNP_E_SOCKET_CONNECT;
-		goto end_function;
-	}
-	/* send request */
-	ret_code = http_SendMessage(&info, &timeout_secs, "b",
-		request, request_length);
-	if (ret_code != 0) {
-		parser_response_init(response, req_method);
-		goto end_function;
+	for (attempt = 0; attempt < 2; attempt++) {
+		timeout = timeout_secs;
+		/* a retry always uses a new connection */
+		ret_code = http_ConnPoolAcquire(destination, attempt == 0,
+			&info, &reused);
+		if (ret_code != UPNP_E_SUCCESS) {
+			parser_response_init(response, req_method);
+			return ret_code;
+		}
+		/* send request */
+		ret_code = http_SendMessage(&info, &timeout, "b",
+			request, request_length);
+		if (ret_code != 0) {
+			parser_response_init(response, req_method);
+		} else {
+			/* recv response */
+			ret_code = http_RecvMessage(&info, response, req_method,
+				&timeout, &http_error_code);
+		}
+		if (reused && http_IsStaleConnection(ret_code, errno, response)) {
+			/* The idle connection was closed by the peer before
+			 * it saw the request, try again on a new one. */
+			UpnpPrintf(UPNP_INFO, HTTP, __FILE__, __LINE__,
+				"Stale pooled connection, retrying\n");
+			sock_destroy(&info, SD_BOTH);
+			httpmsg_destroy(&response->msg);
+			continue;
+		}
+		break;
 	}
-	/* recv response */
-	ret_code = http_RecvMessage(&info, response, req_method,
-		&timeout_secs, &http_error_code);
-
-end_function:
-	/* should shutdown completely */
-	sock_destroy(&info, SD_BOTH);
+	if (ret_code == 0 && http_IsPersistent(response))
+		http_ConnPoolRelease(&destination->hostport.IPaddress,
+			info.socket);
+	else
+		/* should shutdown completely */
+		sock_destroy(&info, SD_BOTH);
 
 	return ret_code;
 }
 
 
-/************************************************************************
- * Function: http_Download
- *
- * Parameters:
- *	IN const char* url_str;	String as a URL
- *	IN int timeout_secs;	time out value
- *	OUT char** document;	buffer to store the document extracted
- *				from the donloaded message.
- *	OUT int* doc_length;	length of the extracted document
- *	OUT char* content_type;	Type of content
- *
- * Description:
- *	Download the document message and extract the document 
- *	from the message.
- *
- * Return: int
- *	UPNP_E_SUCCESS
- *	UPNP_E_INVALID_URL
- ************************************************************************/
+/*!
+ * \brief Copies the value of a response header into a LINE_SIZE buffer.
+ * The buffer is set to the empty string if the header is not present.
+ */
+static void copy_hdr_value(
+	/*! [in] Response message. */
+	http_message_t *msg,
+	/*! [in] Header id. */
+	int header_id,
+	/*! [out] Buffer of LINE_SIZE bytes, may be NULL. */
+	char *value)
+{
+	memptr hdr;
+	size_t copy_len;
+
+	if (!value)
+		return;
+	if (httpmsg_find_hdr(msg, header_id, &hdr) == NULL) {
+		*value = '\0';
+		return;
+	}
+	copy_len = hdr.length < LINE_SIZE - (size_t)1 ?
+		hdr.length : LINE_SIZE - (size_t)1;
+	memcpy(value, hdr.buf, copy_len);
+	value[copy_len] = '\0';
+}
+
 int http_Download( IN const char *url_str,
                IN int timeout_secs,
                OUT char **document,
                OUT size_t *doc_length,
                OUT char *content_type )
+{
+	return http_DownloadEx(url_str, timeout_secs, NULL, NULL,
+		document, doc_length, content_type, NULL, NULL);
+}
+
+int http_DownloadEx(
+	const char *url_str,
+	int timeout_secs,
+	const char *if_none_match,
+	const char *if_modified_since,
+	char **document,
+	size_t *doc_length,
+	char *content_type,
+	char *etag,
+	char *last_modified)
 {
 	int ret_code;
 	uri_type url;
@@ -694,10 +987,19 @@ int http_Download( IN const char *url_str,
 	UpnpPrintf(UPNP_INFO, HTTP, __FILE__, __LINE__,
 		   "HOSTNAME : %s Length : %" PRIzu "\n", hoststr, hostlen);
 	ret_code = http_MakeMessage(&request, 1, 1,
-				    "Q" "s" "bcDCUc",
+				    "Q" "s" "bcDU",
 				    HTTPMETHOD_GET, url.pathquery.buff,
 				    url.pathquery.size, "HOST: ", hoststr,
 				    hostlen);
+	/* optional validators of a previously downloaded copy */
+	if (ret_code == 0 && if_none_match && *if_none_match)
+		ret_code = http_MakeMessage(&request, 1, 1, "ssc",
+			"IF-NONE-MATCH: ", if_none_match);
+	if (ret_code == 0 && if_modified_since && *if_modified_since)
+		ret_code = http_MakeMessage(&request, 1, 1, "ssc",
+			"IF-MODIFIED-SINCE: ", if_modified_since);
+	if (ret_code == 0)
+		ret_code = http_MakeMessage(&request, 1, 1, "c");
 	if (ret_code != 0) {
 		UpnpPrintf(UPNP_INFO, HTTP, __FILE__, __LINE__,
 			   "HTTP Makemessage failed\n");
@@ -732,7 +1034,10 @@ int http_Download( IN const char *url_str,
 			content_type[copy_len] = '\0';
 		}
 	}
+	copy_hdr_value(&response.msg, HDR_ETAG, etag);
+	copy_hdr_value(&response.msg, HDR_LAST_MODIFIED, last_modified);
 	/* extract doc from msg */
+	*document = NULL;
 	if ((*doc_length = response.msg.entity.length) == (size_t)0) {
 		/* 0-length msg */
 		*document = NULL;
@@ -1482,7 +1787,7 @@ int http_OpenHttpGetProxy(const char *url_str, const char *proxy_str,
 	int ret_code;
 	size_t sockaddr_len;
 	int http_error_code;
-	memptr ctype;
+	http_header_t *ctype_hdr;
 	SOCKET tcp_connection;
 	membuffer request;
 	http_get_handle_t *handle = NULL;
@@ -1558,11 +1863,15 @@ int http_OpenHttpGetProxy(const char *url_str, const char *proxy_str,
 	}
 	*httpStatus = handle->response.msg.status_code;
 	ret_code = UPNP_E_SUCCESS;
-	if (!httpmsg_find_hdr(&handle->response.msg, HDR_CONTENT_TYPE, &ctype))
+	ctype_hdr = httpmsg_find_hdr(&handle->response.msg, HDR_CONTENT_TYPE,
+		NULL);
+	/* the user keeps it while the body is read into the message */
+	if (!ctype_hdr || httpmsg_keep_hdr_value(&handle->response.msg,
+		ctype_hdr) != UPNP_E_SUCCESS)
 		/* no content-type */
 		*contentType = NULL;
 	else
-		*contentType = ctype.buf;
+		*contentType = ctype_hdr->value.buf;
 	if (handle->response.position == (parser_pos_t)POS_COMPLETE)
 		*contentLength = 0;
 	else if (handle->response.ent_position == ENTREAD_USING_CHUNKED)
@@ -2008,7 +2317,7 @@ int http_OpenHttpGetEx(
 	IN int timeout)
 {
 	int http_error_code;
-	memptr ctype;
+	http_header_t *ctype_hdr;
 	SOCKET tcp_connection;
 	size_t sockaddr_len;
 	membuffer request;
@@ -2101,11 +2410,15 @@ int http_OpenHttpGetEx(
 		*httpStatus = handle->response.msg.status_code;
 		errCode = UPNP_E_SUCCESS;
 
-		if (!httpmsg_find_hdr(&handle->response.msg, HDR_CONTENT_TYPE, &ctype))
+		ctype_hdr = httpmsg_find_hdr(&handle->response.msg, HDR_CONTENT_TYPE,
+			NULL);
+		/* the user keeps it while the body is read into the message */
+		if (!ctype_hdr || httpmsg_keep_hdr_value(&handle->response.msg,
+			ctype_hdr) != UPNP_E_SUCCESS)
 			/* no content-type */
 			*contentType = NULL;
 		else
-			*contentType = ctype.buf;
+			*contentType = ctype_hdr->value.buf;
 		if (handle->response.position == (parser_pos_t)POS_COMPLETE)
 			*contentLength = 0;
 		else if(handle->response.ent_position == ENTREAD_USING_CHUNKED)
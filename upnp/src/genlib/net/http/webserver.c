@@ -130,7 +130,6 @@ static const char *gMediaTypes[] = {
 
 /* general */
 #define NUM_MEDIA_TYPES       70
-#define NUM_HTTP_HEADER_NAMES 33
 
 #define ASCTIME_R_BUFFER_SIZE 26
 #ifdef WIN32
@@ -232,7 +231,6 @@ membuffer gDocumentRootDir;
 /*! XML document. */
 static struct xml_alias_t gAliasDoc;
 static ithread_mutex_t gWebMutex;
-extern str_int_entry Http_Header_Names[NUM_HTTP_HEADER_NAMES];
 
 /*!
  * \brief Decodes list and stores it in gMediaTypeList.
@@ -903,22 +901,15 @@ static int CheckOtherHTTPHeaders(
 	off_t FileSize)
 {
 	http_header_t *header;
-	ListNode *node;
-	/*NNS: dlist_node* node; */
-	int index, RetCode = HTTP_OK;
+	size_t i;
+	int RetCode = HTTP_OK;
 	char *TmpBuf;
 	size_t TmpBufSize = LINE_SIZE;
 
 	TmpBuf = (char *)malloc(TmpBufSize);
 	if (!TmpBuf)
 		return HTTP_INTERNAL_SERVER_ERROR;
-	node = ListHead(&Req->headers);
-	while (node != NULL) {
-		header = (http_header_t *) node->item;
-		/* find header type. */
-		index = map_str_to_int((const char *)header->name.buf,
-				header->name.length, Http_Header_Names,
-				NUM_HTTP_HEADER_NAMES, FALSE);
+	for (i = 0; (header = httpmsg_get_hdr(Req, i)) != NULL; i++) {
 		if (header->value.length >= TmpBufSize) {
 			free(TmpBuf);
 			TmpBufSize = header->value.length + 1;
@@ -928,8 +919,9 @@ static int CheckOtherHTTPHeaders(
 		}
 		memcpy(TmpBuf, header->value.buf, header->value.length);
 		TmpBuf[header->value.length] = '\0';
-		if (index >= 0) {
-			switch (Http_Header_Names[index].id) {
+		/* header type, as found by the parser. */
+		if (header->name_id != HDR_UNKNOWN) {
+			switch (header->name_id) {
 			case HDR_TE: {
 				/* Request */
 				RespInstr->IsChunkActive = 1;
@@ -1001,7 +993,6 @@ static int CheckOtherHTTPHeaders(
 				break;
 			}
 		}
-		node = ListNext(&Req->headers, node);
 	}
 	free(TmpBuf);
 
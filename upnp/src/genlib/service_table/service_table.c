@@ -67,17 +67,87 @@ copy_subscription( subscription * in,
     memcpy( out->sid, in->sid, SID_SIZE );
     out->sid[SID_SIZE] = 0;
     out->eventKey = in->eventKey;
-    out->ToSendEventKey = in->ToSendEventKey;
     out->expireTime = in->expireTime;
     out->active = in->active;
+    /* the queue belongs to the original */
+    out->queueHead = NULL;
+    out->queueTail = NULL;
+    out->queueLength = 0;
+    out->sending = 0;
     if( ( return_code =
           copy_URL_list( &in->DeliveryURLs, &out->DeliveryURLs ) )
         != HTTP_SUCCESS )
         return return_code;
     out->next = NULL;
+    out->prev = NULL;
     return HTTP_SUCCESS;
 }
 
+/*!
+ * \brief Unlinks a subscription from its service and frees it.
+ */
+static void removeSubscription(
+	/*! [in] Service object providing the list of subscriptions. */
+	service_info *service,
+	/*! [in] Subscription of the service. */
+	subscription *sub)
+{
+	HashTableRemove(&service->subscriptionsBySID, sub->sid);
+	if (sub->prev)
+		sub->prev->next = sub->next;
+	else
+		service->subscriptionList = sub->next;
+	if (sub->next)
+		sub->next->prev = sub->prev;
+	sub->next = NULL;
+	sub->prev = NULL;
+	freeSubscriptionList(sub);
+	service->TotalSubscriptions--;
+}
+
+/*!
+ * \brief Returns the first active subscription from sub on, removing the
+ * expired subscriptions met on the way.
+ */
+static subscription *firstValidSubscription(
+	/*! [in] Service object providing the list of subscriptions. */
+	service_info *service,
+	/*! [in] Subscription to start from, may be NULL. */
+	subscription *sub)
+{
+	time_t current_time;
+	subscription *next;
+
+	time(&current_time);
+	while (sub) {
+		next = sub->next;
+		if (sub->expireTime != 0 && sub->expireTime < current_time)
+			removeSubscription(service, sub);
+		else if (sub->active)
+			return sub;
+		sub = next;
+	}
+
+	return NULL;
+}
+
+int AddSubscription(subscription *sub, service_info *service)
+{
+	if (!service->subscriptionsBySID.slots &&
+	    HashTableInit(&service->subscriptionsBySID, 0) != 0)
+		return UPNP_E_OUTOF_MEMORY;
+	if (HashTableAdd(&service->subscriptionsBySID, sub->sid, sub, NULL) != 0)
+		return UPNP_E_OUTOF_MEMORY;
+	sub->prev = NULL;
+	sub->next = service->subscriptionList;
+	if (sub->next)
+		sub->next->prev = sub;
+	service->subscriptionList = sub;
+	service->TotalSubscriptions++;
+
+	return UPNP_E_SUCCESS;
+}
+
 /************************************************************************
 *	Function :	RemoveSubscriptionSID
 *
@@ -94,112 +164,97 @@ copy_subscription( subscription * in,
 *
 *	Note :
 ************************************************************************/
-void
-RemoveSubscriptionSID( Upnp_SID sid,
-                       service_info * service )
+void RemoveSubscriptionSID(Upnp_SID sid, service_info *service)
 {
-    subscription *finger = service->subscriptionList;
-    subscription *previous = NULL;
-
-    while( finger ) {
-        if( !( strcmp( sid, finger->sid ) ) ) {
-            if( previous )
-                previous->next = finger->next;
-            else
-                service->subscriptionList = finger->next;
-            finger->next = NULL;
-            freeSubscriptionList( finger );
-            finger = NULL;
-            service->TotalSubscriptions--;
-        } else {
-            previous = finger;
-            finger = finger->next;
-        }
-    }
+	subscription *sub;
 
+	if (!service->subscriptionsBySID.slots)
+		return;
+	sub = HashTableFind(&service->subscriptionsBySID, sid);
+	if (sub)
+		removeSubscription(service, sub);
 }
 
 
 subscription *GetSubscriptionSID(const Upnp_SID sid, service_info *service)
 {
-    subscription *next = service->subscriptionList;
-    subscription *previous = NULL;
-    subscription *found = NULL;
-
-    time_t current_time;
-
-    while( ( next ) && ( found == NULL ) ) {
-        if( !strcmp( next->sid, sid ) )
-            found = next;
-        else {
-            previous = next;
-            next = next->next;
-        }
-    }
-    if( found ) {
-        /*get the current_time */
-        time( &current_time );
-        if( ( found->expireTime != 0 )
-            && ( found->expireTime < current_time ) ) {
-            if( previous )
-                previous->next = found->next;
-            else
-                service->subscriptionList = found->next;
-            found->next = NULL;
-            freeSubscriptionList( found );
-            found = NULL;
-            service->TotalSubscriptions--;
-        }
-    }
-    return found;
+	subscription *found;
+	time_t current_time;
+
+	if (!service->subscriptionsBySID.slots)
+		return NULL;
+	found = HashTableFind(&service->subscriptionsBySID, sid);
+	if (found) {
+		/*get the current_time */
+		time(&current_time);
+		if (found->expireTime != 0 && found->expireTime < current_time) {
+			removeSubscription(service, found);
+			found = NULL;
+		}
+	}
 
+	return found;
 }
 
 
 subscription *GetNextSubscription(service_info *service, subscription *current)
 {
-    time_t current_time;
-    subscription *next = NULL;
-    subscription *previous = NULL;
-    int notDone = 1;
-
-    /* get the current_time */
-    time( &current_time );
-    while( ( notDone ) && ( current ) ) {
-        previous = current;
-        current = current->next;
-
-        if( current == NULL ) {
-            notDone = 0;
-            next = current;
-        } else
-            if( ( current->expireTime != 0 )
-                && ( current->expireTime < current_time ) ) {
-            previous->next = current->next;
-            current->next = NULL;
-            freeSubscriptionList( current );
-            current = previous;
-            service->TotalSubscriptions--;
-        } else if( current->active ) {
-            notDone = 0;
-            next = current;
-        }
-    }
-    return next;
+	if (!current)
+		return NULL;
+
+	return firstValidSubscription(service, current->next);
 }
 
 
 subscription *GetFirstSubscription(service_info *service)
 {
-	subscription temp;
-	subscription *next = NULL;
-
-	temp.next = service->subscriptionList;
-	next = GetNextSubscription(service, &temp);
-	service->subscriptionList = temp.next;
-	/* service->subscriptionList = next; */
-	
-	return next;
+	return firstValidSubscription(service, service->subscriptionList);
+}
+
+
+void releaseNotifyEvent(notify_event *event)
+{
+	int i;
+
+	if (--event->refcount > 0)
+		return;
+	free(event->headers);
+	ixmlFreeDOMString(event->propertySet);
+	for (i = 0; i < event->varCount; i++) {
+		free(event->names[i]);
+		free(event->values[i]);
+	}
+	free(event->names);
+	free(event->values);
+	free(event);
+}
+
+
+void freeEventModeration(service_info *service)
+{
+	event_moderation *m;
+
+	while ((m = service->moderation) != NULL) {
+		service->moderation = m->next;
+		free(m->name);
+		free(m->sentValue);
+		free(m->pendingValue);
+		free(m);
+	}
+}
+
+
+void freeNotifyQueue(subscription *sub)
+{
+	notify_entry *entry;
+
+	while ((entry = sub->queueHead) != NULL) {
+		sub->queueHead = entry->next;
+		releaseNotifyEvent(entry->event);
+		free(entry);
+	}
+	sub->queueTail = NULL;
+	sub->queueLength = 0;
 }
 
 
@@ -207,6 +262,7 @@ void freeSubscription(subscription *sub)
 {
 	if (sub) {
 		free_URL_list(&sub->DeliveryURLs);
+		freeNotifyQueue(sub);
 	}
 }
 
@@ -236,6 +292,143 @@ freeSubscriptionList( subscription * head )
     }
 }
 
+/*! Separates the UDN from the serviceId in the keys of the serviceId index.
+ * Control characters cannot appear in a description document. */
+#define SERVICE_KEY_SEPARATOR '\001'
+
+/*!
+ * \brief Builds the key of a service in the serviceId index into buf, or
+ * into an allocated buffer if buf is too small.
+ *
+ * \return The key, to be freed if it is not buf, or NULL on failure.
+ */
+static char *makeServiceKey(
+	/*! [in] Buffer, may be NULL. */
+	char *buf,
+	/*! [in] Size of buf. */
+	size_t size,
+	/*! [in] UDN of the service. */
+	const char *UDN,
+	/*! [in] serviceId of the service. */
+	const char *serviceId)
+{
+	size_t udnLength = strlen(UDN);
+	size_t length = udnLength + strlen(serviceId) + (size_t)2;
+	char *key = buf;
+
+	if (length > size) {
+		key = malloc(length);
+		if (!key)
+			return NULL;
+	}
+	memcpy(key, UDN, udnLength);
+	key[udnLength] = SERVICE_KEY_SEPARATOR;
+	strcpy(key + udnLength + 1, serviceId);
+
+	return key;
+}
+
+/*!
+ * \brief Copies the path and query of an URL, the part compared by
+ * FindServiceControlURLPath() and FindServiceEventURLPath().
+ *
+ * \return UPNP_E_SUCCESS, with *path NULL if url is NULL or cannot be
+ * parsed, or UPNP_E_OUTOF_MEMORY.
+ */
+static int getURLPath(
+	/*! [in] URL, may be NULL. */
+	const char *url,
+	/*! [out] Allocated path. */
+	char **path)
+{
+	uri_type parsed_url;
+
+	*path = NULL;
+	if (!url ||
+	    parse_uri(url, strlen(url), &parsed_url) != HTTP_SUCCESS)
+		return UPNP_E_SUCCESS;
+	*path = malloc(parsed_url.pathquery.size + (size_t)1);
+	if (!*path)
+		return UPNP_E_OUTOF_MEMORY;
+	memcpy(*path, parsed_url.pathquery.buff, parsed_url.pathquery.size);
+	(*path)[parsed_url.pathquery.size] = '\0';
+
+	return UPNP_E_SUCCESS;
+}
+
+/*!
+ * \brief Adds a service to an index, unless a previous service of the list
+ * has the same key: the lookups used to return the first match.
+ *
+ * \return 0 on success, EOUTOFMEM on failure.
+ */
+static int indexService(HashTable *index, const char *key, service_info *service)
+{
+	if (!key || HashTableFind(index, key))
+		return 0;
+
+	return HashTableAdd(index, key, service, NULL);
+}
+
+/*!
+ * \brief Frees the service indexes of the table.
+ */
+static void destroyServiceIndexes(
+	/*! [in] Service table. */
+	service_table *table)
+{
+	HashTableDestroy(&table->byServiceId, NULL);
+	HashTableDestroy(&table->byControlURLPath, NULL);
+	HashTableDestroy(&table->byEventURLPath, NULL);
+}
+
+/*!
+ * \brief Rebuilds the service indexes of the table from its service list.
+ * On failure the table is left without indexes.
+ */
+static void indexServiceTable(
+	/*! [in] Service table. */
+	service_table *table)
+{
+	service_info *service;
+
+	destroyServiceIndexes(table);
+	if (HashTableInit(&table->byServiceId, 0) != 0 ||
+	    HashTableInit(&table->byControlURLPath, 0) != 0 ||
+	    HashTableInit(&table->byEventURLPath, 0) != 0)
+		goto error_handler;
+	for (service = table->serviceList; service; service = service->next) {
+		if (!service->idKey) {
+			service->idKey = makeServiceKey(NULL, (size_t)0,
+				service->UDN, service->serviceId);
+			if (!service->idKey)
+				goto error_handler;
+		}
+		if (!service->controlURLPath &&
+		    getURLPath(service->controlURL,
+			&service->controlURLPath) != UPNP_E_SUCCESS)
+			goto error_handler;
+		if (!service->eventURLPath &&
+		    getURLPath(service->eventURL,
+			&service->eventURLPath) != UPNP_E_SUCCESS)
+			goto error_handler;
+		if (indexService(&table->byServiceId,
+			service->idKey, service) != 0 ||
+		    indexService(&table->byControlURLPath,
+			service->controlURLPath, service) != 0 ||
+		    indexService(&table->byEventURLPath,
+			service->eventURLPath, service) != 0)
+			goto error_handler;
+	}
+
+	return;
+
+error_handler:
+	UpnpPrintf(UPNP_CRITICAL, GENA, __FILE__, __LINE__,
+		"Out of memory indexing the service table\n");
+	destroyServiceIndexes(table);
+}
+
 /************************************************************************
 *	Function :	FindServiceId
 *
@@ -260,7 +453,23 @@ FindServiceId( service_table * table,
                const char *UDN )
 {
     service_info *finger = NULL;
-
+    char buf[LINE_SIZE];
+    char *key;
+
+    if( table && table->byServiceId.slots ) {
+        key = makeServiceKey( buf, sizeof( buf ), UDN, serviceId );
+        if( key ) {
+            finger = HashTableFind( &table->byServiceId, key );
+            if( key != buf )
+                free( key );
+            /* the keys of the index cannot contain the separator, but the
+             * arguments could */
+            if( finger && ( strcmp( serviceId, finger->serviceId ) ||
+                            strcmp( UDN, finger->UDN ) ) )
+                finger = NULL;
+            return finger;
+        }
+    }
     if( table ) {
         finger = table->serviceList;
         while( finger ) {
@@ -304,6 +513,10 @@ FindServiceEventURLPath( service_table * table,
         ( parse_uri( eventURLPath,
                      strlen( eventURLPath ),
                      &parsed_url_in ) == HTTP_SUCCESS ) ) {
+        if( table->byEventURLPath.slots )
+            return HashTableFindN( &table->byEventURLPath,
+                                   parsed_url_in.pathquery.buff,
+                                   parsed_url_in.pathquery.size );
 
         finger = table->serviceList;
         while( finger ) {
@@ -356,6 +569,10 @@ FindServiceControlURLPath( service_table * table,
         ( parse_uri
           ( controlURLPath, strlen( controlURLPath ),
             &parsed_url_in ) == HTTP_SUCCESS ) ) {
+        if( table->byControlURLPath.slots )
+            return HashTableFindN( &table->byControlURLPath,
+                                   parsed_url_in.pathquery.buff,
+                                   parsed_url_in.pathquery.size );
         finger = table->serviceList;
         while( finger ) {
             if( finger->controlURL )
@@ -557,6 +774,12 @@ void freeService( service_info * in )
 
         if( in->subscriptionList )
             freeSubscriptionList( in->subscriptionList );
+        HashTableDestroy( &in->subscriptionsBySID, NULL );
+
+        free( in->idKey );
+        free( in->controlURLPath );
+        free( in->eventURLPath );
+        freeEventModeration( in );
 
         in->TotalSubscriptions = 0;
         free( in );
@@ -596,6 +819,11 @@ freeServiceList( service_info * head )
             ixmlFreeDOMString( head->UDN );
         if( head->subscriptionList )
             freeSubscriptionList( head->subscriptionList );
+        HashTableDestroy( &head->subscriptionsBySID, NULL );
+        free( head->idKey );
+        free( head->controlURLPath );
+        free( head->eventURLPath );
+        freeEventModeration( head );
 
         head->TotalSubscriptions = 0;
         next = head->next;
@@ -625,6 +853,7 @@ freeServiceTable( service_table * table )
     freeServiceList( table->serviceList );
     table->serviceList = NULL;
     table->endServiceList = NULL;
+    destroyServiceIndexes( table );
 }
 
 /************************************************************************
@@ -779,6 +1008,13 @@ service_info *getServiceList(
 				current->SCPDURL = NULL;
 				current->active = 1;
 				current->subscriptionList = NULL;
+				memset(&current->subscriptionsBySID, 0,
+					sizeof(current->subscriptionsBySID));
+				current->idKey = NULL;
+				current->controlURLPath = NULL;
+				current->eventURLPath = NULL;
+				current->moderation = NULL;
+				current->moderationDue = 0;
 				current->TotalSubscriptions = 0;
 				if (!(current->UDN = getElementValue(UDN)))
 					fail = 1;
@@ -967,6 +1203,7 @@ removeServiceTable( IXML_Node * node,
 
             ixmlNodeList_free( deviceList );
         }
+        indexServiceTable( in );
     }
     return 1;
 }
@@ -1016,6 +1253,7 @@ addServiceTable( IXML_Node * node,
         if( ( in->endServiceList->next =
               getAllServiceList( root, in->URLBase, &tempEnd ) ) ) {
             in->endServiceList = tempEnd;
+            indexServiceTable( in );
             return 1;
         }
 
@@ -1061,6 +1299,7 @@ getServiceTable( IXML_Node * node,
 
         if( ( out->serviceList = getAllServiceList(
             root, out->URLBase, &out->endServiceList ) ) ) {
+            indexServiceTable( out );
             return 1;
         }
 
@@ -42,6 +42,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "membuffer.h"
+#include "ithread.h"
 #include "upnp.h"
 #include "unixutil.h"
 
@@ -101,11 +102,155 @@ static UPNP_INLINE void membuffer_initialize(
 	m->capacity = (size_t)0;
 }
 
+#if MEMBUF_POOL_SIZE > 0
+/*! Freed buffers kept by a thread for its next messages. */
+typedef struct {
+	/*! number of buffers in the pool. */
+	int count;
+	/*! the buffers. */
+	char *buf[MEMBUF_POOL_SIZE];
+	/*! capacity of each buffer, as in membuffer::capacity. */
+	size_t capacity[MEMBUF_POOL_SIZE];
+} membuffer_pool;
+
+/*! Initializes gMembufPoolKey once. */
+static ithread_once_t gMembufPoolOnce = ITHREAD_ONCE_INIT;
+/*! Key of the membuffer_pool of each thread. */
+static ithread_key_t gMembufPoolKey;
+/*! TRUE if gMembufPoolKey could be created. */
+static int gMembufPoolKeyValid = FALSE;
+
+/*!
+ * \brief Frees the pool of an exiting thread.
+ */
+static void membuffer_pool_free(
+	/*! [in] membuffer_pool of the thread. */
+	void *arg)
+{
+	membuffer_pool *pool = (membuffer_pool *)arg;
+	int i;
+
+	for (i = 0; i < pool->count; i++)
+		free(pool->buf[i]);
+	free(pool);
+}
+
+/*!
+ * \brief Creates gMembufPoolKey.
+ */
+static void membuffer_pool_init(void)
+{
+	gMembufPoolKeyValid =
+		ithread_key_create(&gMembufPoolKey, membuffer_pool_free) == 0;
+}
+
+/*!
+ * \brief Returns the pool of the calling thread.
+ *
+ * \return The pool, or NULL if the thread has none and it must not, or
+ * cannot, be created.
+ */
+static membuffer_pool *membuffer_get_pool(
+	/*! [in] TRUE to create the pool of the thread if it has none. */
+	int create)
+{
+	membuffer_pool *pool;
+
+	ithread_once(&gMembufPoolOnce, membuffer_pool_init);
+	if (!gMembufPoolKeyValid)
+		return NULL;
+	pool = (membuffer_pool *)ithread_getspecific(gMembufPoolKey);
+	if (pool == NULL && create) {
+		pool = (membuffer_pool *)malloc(sizeof(membuffer_pool));
+		if (pool == NULL)
+			return NULL;
+		pool->count = 0;
+		if (ithread_setspecific(gMembufPoolKey, pool) != 0) {
+			free(pool);
+			return NULL;
+		}
+	}
+
+	return pool;
+}
+
+/*!
+ * \brief Takes the smallest pooled buffer holding at least 'alloc_len' bytes.
+ *
+ * \return The buffer, or NULL if the pool has none.
+ */
+static char *membuffer_pool_get(
+	/*! [in] Capacity needed. */
+	size_t alloc_len,
+	/*! [out] Capacity of the buffer. */
+	size_t *capacity)
+{
+	membuffer_pool *pool;
+	char *buf;
+	int best = -1;
+	int i;
+
+	if (alloc_len > (size_t)MEMBUF_POOL_MAX_SIZE)
+		return NULL;
+	pool = membuffer_get_pool(FALSE);
+	if (pool == NULL)
+		return NULL;
+	for (i = 0; i < pool->count; i++) {
+		if (pool->capacity[i] >= alloc_len &&
+		    (best < 0 || pool->capacity[i] < pool->capacity[best]))
+			best = i;
+	}
+	if (best < 0)
+		return NULL;
+	buf = pool->buf[best];
+	*capacity = pool->capacity[best];
+	pool->count--;
+	pool->buf[best] = pool->buf[pool->count];
+	pool->capacity[best] = pool->capacity[pool->count];
+
+	return buf;
+}
+#endif /* MEMBUF_POOL_SIZE > 0 */
+
+/*!
+ * \brief Frees a buffer, or keeps it in the pool of the calling thread if it
+ * is of a size worth reusing.
+ */
+static void membuffer_release(
+	/*! [in] Buffer to free, may be NULL. */
+	char *buf,
+	/*! [in] Capacity of the buffer. */
+	size_t capacity)
+{
+#if MEMBUF_POOL_SIZE > 0
+	membuffer_pool *pool;
+
+	if (buf != NULL &&
+	    capacity >= (size_t)MEMBUF_POOL_MIN_SIZE &&
+	    capacity <= (size_t)MEMBUF_POOL_MAX_SIZE) {
+		pool = membuffer_get_pool(TRUE);
+		if (pool != NULL && pool->count < MEMBUF_POOL_SIZE) {
+			/* one byte less, since a buffer given to
+			 * membuffer_attach() may have no room for the
+			 * terminating null */
+			pool->buf[pool->count] = buf;
+			pool->capacity[pool->count] = capacity - (size_t)1;
+			pool->count++;
+			return;
+		}
+	}
+#endif /* MEMBUF_POOL_SIZE > 0 */
+	free(buf);
+}
+
 int membuffer_set_size(membuffer *m, size_t new_length)
 {
-	size_t diff;
+	size_t growth;
 	size_t alloc_len;
 	char *temp_buf;
+#if MEMBUF_POOL_SIZE > 0
+	size_t pool_capacity;
+#endif /* MEMBUF_POOL_SIZE > 0 */
 
 	if (new_length >= m->length) {	/* increase length */
 		/* need more mem? */
@@ -113,18 +258,35 @@ int membuffer_set_size(membuffer *m, size_t new_length)
 			return 0;	/* have enough mem; done */
 		}
 
-		diff = new_length - m->length;
-		alloc_len = MAXVAL(m->size_inc, diff) + m->capacity;
+		/* double the capacity, by at least size_inc and at most
+		 * MEMBUF_MAX_GROWTH bytes, so that appending costs a constant
+		 * number of copies per byte */
+		growth = MINVAL(MAXVAL(m->capacity, m->size_inc),
+				(size_t)MEMBUF_MAX_GROWTH);
+		alloc_len = MAXVAL(m->capacity + growth, new_length);
+#if MEMBUF_POOL_SIZE > 0
+		temp_buf = membuffer_pool_get(alloc_len, &pool_capacity);
+		if (temp_buf != NULL) {
+			if (m->length)
+				memcpy(temp_buf, m->buf, m->length);
+			membuffer_release(m->buf, m->capacity);
+			m->buf = temp_buf;
+			m->capacity = pool_capacity;
+			return 0;
+		}
+#endif /* MEMBUF_POOL_SIZE > 0 */
 	} else {		/* decrease length */
 
 		assert(new_length <= m->length);
 
-		/* if diff is 0..m->size_inc, don't free */
-		if ((m->capacity - new_length) <= m->size_inc) {
+		/* if diff is 0..m->size_inc, or the buffer stays at least a
+		 * quarter full, don't free */
+		if ((m->capacity - new_length) <= m->size_inc ||
+		    new_length >= m->capacity / (size_t)4) {
 			return 0;
 		}
 
-		alloc_len = new_length + m->size_inc;
+		alloc_len = new_length + MAXVAL(m->size_inc, new_length);
 	}
 
 	assert(alloc_len >= new_length);
@@ -163,7 +325,7 @@ void membuffer_destroy(membuffer *m)
 		return;
 	}
 
-	free(m->buf);
+	membuffer_release(m->buf, m->capacity);
 	membuffer_init(m);
 }
 
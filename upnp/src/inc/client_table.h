@@ -13,6 +13,7 @@ extern "C" {
 #endif
 
 
+#include "HashTable.h"
 #include "service_table.h"
 #include "upnp.h"
 #include "UpnpString.h"
@@ -35,6 +36,31 @@ extern TimerThread gTimerThread;
 typedef struct s_ClientSubscription ClientSubscription;
 
 
+/*!
+ * \brief Sequencer delivering the events of a subscription in SEQ order,
+ * see UpnpSetEventSequencing(). Defined in gena_ctrlpt.c.
+ */
+typedef struct s_ClientEventSeq ClientEventSeq;
+
+
+/*!
+ * \brief Subscriptions of a control point.
+ *
+ * The subscriptions are kept in a list and indexed by the SID returned to
+ * the application and by the actual SID returned by the publisher, so that
+ * the lookups made for every received event do not walk the list. The
+ * indexes are allocated on the first subscription.
+ */
+typedef struct s_ClientSubTable {
+	/*! Head of the subscription list. */
+	ClientSubscription *head;
+	/*! Subscriptions by SID. */
+	HashTable bySID;
+	/*! Subscriptions by actual SID. */
+	HashTable byActualSID;
+} ClientSubTable;
+
+
 /*!
  * \brief Constructor.
  */
@@ -179,6 +205,35 @@ void UpnpClientSubscription_set_Next(
 	ClientSubscription *q);
 
 
+/*!
+ * \brief Returns the event sequencer, NULL if the events are not sequenced.
+ */
+ClientEventSeq *UpnpClientSubscription_get_EventSeq(
+	/*! [in] The \b this pointer. */
+	const ClientSubscription *p);
+
+
+/*!
+ * \brief Sets the event sequencer, owned by the subscription.
+ */
+void UpnpClientSubscription_set_EventSeq(
+	/*! [in] The \b this pointer. */
+	ClientSubscription *p,
+	/*! [in] . */
+	ClientEventSeq *s);
+
+
+/*!
+ * \brief Frees an event sequencer, or leaves it to the thread delivering its
+ * events.
+ *
+ * Must be called with HandleLock held.
+ */
+void ClientEventSeq_delete(
+	/*! [in] Sequencer to be freed. */
+	ClientEventSeq *s);
+
+
 
 /*!
  * \brief Free memory allocated for client subscription data.
@@ -191,21 +246,67 @@ void free_client_subscription(
 
 
 /*!
- * \brief Free the client subscription table.
+ * \brief Free a list of client subscriptions.
  */
 void freeClientSubList(
 	/*! [in] Client subscription list to be freed. */
 	ClientSubscription *list);
 
 
+/*!
+ * \brief Initializes an empty client subscription table. Does not allocate
+ * memory.
+ */
+void ClientSubTableInit(
+	/*! [in] The table to initialize. */
+	ClientSubTable *table);
+
+
+/*!
+ * \brief Frees the client subscription table and all its subscriptions.
+ */
+void ClientSubTableDestroy(
+	/*! [in] The table to free. */
+	ClientSubTable *table);
+
+
+/*!
+ * \brief Adds a subscription to the table. The SID and the actual SID of
+ * the subscription must be set, and may only be changed through
+ * SetClientSubActualSID() while the subscription is in the table.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_OUTOF_MEMORY.
+ */
+int AddClientSub(
+	/*! [in] The table. */
+	ClientSubTable *table,
+	/*! [in] Subscription to be added, owned by the table on success. */
+	ClientSubscription *sub);
+
+
+/*!
+ * \brief Changes the actual SID of a subscription of the table.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_OUTOF_MEMORY, in which case the
+ * subscription is no longer found by GetClientSubActualSID().
+ */
+int SetClientSubActualSID(
+	/*! [in] The table. */
+	ClientSubTable *table,
+	/*! [in] Subscription of the table. */
+	ClientSubscription *sub,
+	/*! [in] New actual SID. */
+	const UpnpString *actualSID);
+
+
 /*!
  * \brief Remove the client subscription matching the subscritpion id
  * represented by the const Upnp_SID sid parameter from the table and
  * update the table.
  */
 void RemoveClientSubClientSID(
-	/*! [in] Head of the subscription list. */
-	ClientSubscription **head,
+	/*! [in] The table. */
+	ClientSubTable *table,
 	/*! [in] Subscription ID to be mactched. */
 	const UpnpString *sid);
 
@@ -217,8 +318,8 @@ void RemoveClientSubClientSID(
  * \return The matching subscription.
  */
 ClientSubscription *GetClientSubClientSID(
-	/*! [in] Head of the subscription list. */
-	ClientSubscription *head,
+	/*! [in] The table. */
+	ClientSubTable *table,
 	/*! [in] Subscription ID to be mactched. */
 	const UpnpString *sid);
 
@@ -230,8 +331,8 @@ ClientSubscription *GetClientSubClientSID(
  * \return The matching subscription.
  */
 ClientSubscription *GetClientSubActualSID(
-	/*! [in] Head of the subscription list. */
-	ClientSubscription *head,
+	/*! [in] The table. */
+	ClientSubTable *table,
 	/*! [in] Subscription ID to be mactched. */
 	token *sid);
 
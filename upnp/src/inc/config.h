@@ -295,6 +295,169 @@
 /* @} */
 
 
+/*!
+ * \name DESC_CACHE_MAX_ENTRIES
+ *
+ * The {\tt DESC_CACHE_MAX_ENTRIES} is the maximum number of description
+ * documents kept by {\tt UpnpDownloadXmlDocCached}. When the cache is
+ * full, the least recently used document is dropped. The default is 64.
+ *
+ * @{
+ */
+#define DESC_CACHE_MAX_ENTRIES 64
+/* @} */
+
+
+/*!
+ * \name HTTP_CONN_POOL_MAX_IDLE
+ *
+ * The {\tt HTTP_CONN_POOL_MAX_IDLE} is the maximum number of idle HTTP/1.1
+ * connections the control point keeps open for reuse by SOAP, GENA and
+ * download requests. 0 disables connection reuse. The default is 16.
+ *
+ * @{
+ */
+#define HTTP_CONN_POOL_MAX_IDLE 16
+/* @} */
+
+
+/*!
+ * \name HTTP_CONN_POOL_MAX_PER_HOST
+ *
+ * The {\tt HTTP_CONN_POOL_MAX_PER_HOST} is the maximum number of idle
+ * connections kept open to the same host and port. The default is 2.
+ *
+ * @{
+ */
+#define HTTP_CONN_POOL_MAX_PER_HOST 2
+/* @} */
+
+
+/*!
+ * \name HTTP_CONN_POOL_IDLE_TIME
+ *
+ * The {\tt HTTP_CONN_POOL_IDLE_TIME} is the time, in seconds, an idle
+ * connection is kept open before being closed. It should be shorter than
+ * the keep-alive timeout of the devices. The default is 15 seconds.
+ *
+ * @{
+ */
+#define HTTP_CONN_POOL_IDLE_TIME 15
+/* @} */
+
+
+/*!
+ * \name HTTP_ASYNC_THREADS
+ *
+ * Number of threads of the asynchronous HTTP client, which sends the SOAP
+ * requests of UpnpSendActionAsync(), UpnpSendActionExAsync() and
+ * UpnpGetServiceVarStatusAsync() on non-blocking sockets. Each thread
+ * multiplexes any number of requests. 0 disables the asynchronous client:
+ * each request then holds a thread of the send thread pool until it
+ * completes. The default is 1.
+ *
+ * @{
+ */
+#define HTTP_ASYNC_THREADS 1
+/* @} */
+
+
+/*!
+ * \name HTTP_ASYNC_WORKERS
+ *
+ * Maximum number of jobs of the send thread pool delivering the completed
+ * asynchronous requests to their callbacks at the same time. The default
+ * is 4.
+ *
+ * @{
+ */
+#define HTTP_ASYNC_WORKERS 4
+/* @} */
+
+
+/*!
+ * \name MINISERVER_USE_EPOLL
+ *
+ * If this flag is set to 1, the miniserver waits for its sockets with an
+ * edge-triggered epoll instance on Linux, and drains every ready socket
+ * (all pending connections and datagrams) on each wakeup. If it is set to
+ * 0, or if epoll is not available, select() is used.
+ *
+ * @{
+ */
+#define MINISERVER_USE_EPOLL 1
+/* @} */
+
+
+/*!
+ * \name HTTP_SCANNER_USE_SIMD
+ *
+ * If this flag is set to 1, the HTTP parser looks for the ends of lines in
+ * header values with SSE2 or, when the CPU supports it, AVX2 instructions on
+ * x86 compilers that provide them. If it is set to 0, or on other targets,
+ * a portable byte loop is used.
+ *
+ * @{
+ */
+#define HTTP_SCANNER_USE_SIMD 1
+/* @} */
+
+
+/*!
+ * \name SSDP_RECV_BATCH_SIZE
+ *
+ * Maximum number of SSDP datagrams read with one system call (recvmmsg()
+ * where available) and handled by one job of the receive thread pool.
+ *
+ * @{
+ */
+#define SSDP_RECV_BATCH_SIZE 16
+/* @} */
+
+
+/*!
+ * \name SSDP_RECV_RING_BATCHES
+ *
+ * Number of batches of the preallocated SSDP receive ring. Each batch holds
+ * SSDP_RECV_BATCH_SIZE datagrams of BUFSIZE bytes. When all batches are
+ * queued, further datagrams are dropped.
+ *
+ * @{
+ */
+#define SSDP_RECV_RING_BATCHES 16
+/* @} */
+
+
+/*!
+ * \name MEMBUF_MAX_GROWTH
+ *
+ * A membuffer doubles its capacity when it runs out of room, so that
+ * building a message piece by piece costs a constant number of copies per
+ * byte. The {\tt MEMBUF_MAX_GROWTH} is the largest number of bytes added
+ * by one growth step, so that large documents grow linearly past it.
+ * The default is 256 KB.
+ *
+ * @{
+ */
+#define MEMBUF_MAX_GROWTH 262144
+/* @} */
+
+
+/*!
+ * \name MEMBUF_POOL_SIZE
+ *
+ * Number of freed membuffer buffers of MEMBUF_POOL_MIN_SIZE to
+ * MEMBUF_POOL_MAX_SIZE bytes each thread keeps for reuse by its next
+ * messages. 0 disables the pool. The default is 4.
+ *
+ * @{
+ */
+#define MEMBUF_POOL_SIZE 4
+#define MEMBUF_POOL_MIN_SIZE 2048
+#define MEMBUF_POOL_MAX_SIZE 65536
+/* @} */
+
+
 /*!
  * \name GENA_NOTIFICATION_SENDING_TIMEOUT
  *
@@ -339,6 +502,41 @@
 /* @} */
 
 
+/*!
+ * \name GENA_MAX_QUEUED_EVENTS
+ *
+ * The {\tt GENA_MAX_QUEUED_EVENTS} specifies the maximum number of events
+ * waiting to be sent to one subscription.
+ *
+ * Each subscription has a queue of events sent in order, one at a time, over
+ * a persistent connection when the Control Point allows it. A new event is
+ * merged into the last waiting one unless both change a variable that is
+ * not moderated, see UpnpSetEventModeration(), so the queue only grows with
+ * such events. When a Control Point still does not keep up, the oldest
+ * waiting event is dropped to make room for a new one: the Control Point
+ * sees the gap in the SEQ numbers and must unsubscribe and subscribe again
+ * to get a new initial event, renewing the subscription does not send one.
+ * The initial event and the event being sent are never dropped.
+ *
+ * @{
+ */
+#define GENA_MAX_QUEUED_EVENTS 100
+/* @} */
+
+
+/*!
+ * \name GENA_MAX_NOTIFY_SENDERS
+ *
+ * The {\tt GENA_MAX_NOTIFY_SENDERS} specifies the maximum number of threads
+ * of the send thread pool sending GENA events at the same time. Each of them
+ * takes the subscriptions having events to send one after the other.
+ *
+ * @{
+ */
+#define GENA_MAX_NOTIFY_SENDERS MAX_THREADS
+/* @} */
+
+
 /*!
  * \name Module Exclusion
  *
@@ -0,0 +1,111 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+#ifndef DESC_CACHE_H
+#define DESC_CACHE_H
+
+
+/*!
+ * \file
+ *
+ * \brief Cache of the description documents downloaded by the control point.
+ *
+ * Documents are keyed by the LOCATION of the advertisement and the USN (or
+ * UDN) of the advertised device, and are kept for the max-age announced in
+ * the CACHE-CONTROL header. Once a document is stale it is revalidated with
+ * a conditional GET using the ETAG and LAST-MODIFIED headers of the previous
+ * response.
+ */
+
+
+#include "ixml.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#ifdef INCLUDE_CLIENT_APIS
+
+
+/*!
+ * \brief Initializes the description cache.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_INIT_FAILED.
+ */
+int DescCacheInit(void);
+
+
+/*!
+ * \brief Drops every cached document and frees the cache resources.
+ */
+void DescCacheDestroy(void);
+
+
+/*!
+ * \brief Returns a copy of the description document at url, downloading
+ * or revalidating it if the cached copy is missing or stale.
+ *
+ * \return UPNP_E_SUCCESS or one of the error codes of UpnpDownloadXmlDoc.
+ */
+int DescCacheDownload(
+	/*! [in] LOCATION of the description document. */
+	const char *url,
+	/*! [in] USN or UDN of the advertisement, may be NULL. */
+	const char *usn,
+	/*! [in] Freshness lifetime in seconds, <= 0 for DEFAULT_MAXAGE. */
+	int maxAge,
+	/*! [out] Copy of the document, owned by the caller. */
+	IXML_Document **xmlDoc);
+
+
+/*!
+ * \brief Drops the cached documents matching url and usn. A NULL argument
+ * matches any value, so passing two NULL pointers flushes the cache.
+ */
+void DescCacheInvalidate(
+	/*! [in] LOCATION of the description document, or NULL. */
+	const char *url,
+	/*! [in] USN or UDN of the advertisement, or NULL. */
+	const char *usn);
+
+
+#endif /* INCLUDE_CLIENT_APIS */
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* DESC_CACHE_H */
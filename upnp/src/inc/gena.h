@@ -139,17 +139,22 @@ extern ithread_mutex_t GlobalClientSubscribeMutex;
 
 
 /*!
- * Structure to send NOTIFY message to all subscribed control points
+ * Subscription with queued events in the ready list, see genaNotifyThread.
  */
 typedef struct NOTIFY_THREAD_STRUCT {
-	char *headers;
-	DOMString propertySet;
 	char *servId;
 	char *UDN;
 	Upnp_SID sid;
-	int eventKey;
-	int *reference_count;
 	UpnpDevice_Handle device_handle;
+	/*! Connection kept from one event to the next, its socket is
+	 * INVALID_SOCKET if there is none. */
+	SOCKINFO conn;
+	/*! Index of the delivery URL the connection goes to. */
+	size_t connURL;
+	/*! Address of the control point at the other end of conn. */
+	struct sockaddr_storage connPeer;
+	/*! Next subscription of the ready list. */
+	struct NOTIFY_THREAD_STRUCT *next;
 } notify_thread_struct;
 
 
@@ -314,6 +319,28 @@ EXTERN_C int genaNotifyAllExt(
 #endif /* INCLUDE_DEVICE_APIS */
 
 
+/*!
+ * \brief Sets the moderation of the events of a state variable.
+ *
+ * \return GENA_SUCCESS if successful, otherwise the appropriate error code.
+ */
+#ifdef INCLUDE_DEVICE_APIS
+EXTERN_C int genaSetEventModeration(
+	/*! [in] Device handle. */
+	UpnpDevice_Handle device_handle,
+	/*! [in] Device udn. */
+	const char *UDN,
+	/*! [in] Service ID. */
+	const char *servId,
+	/*! [in] Name of the state variable. */
+	const char *varName,
+	/*! [in] Minimum time between two events of the variable, in ms. */
+	int maxRate,
+	/*! [in] Minimum change of a numeric value to be evented. */
+	double minDelta);
+#endif /* INCLUDE_DEVICE_APIS */
+
+
 /*!
  * \brief Sends the intial state table dump to newly subscribed control point.
  *
@@ -0,0 +1,133 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+#ifndef GENLIB_NET_HTTP_HTTPASYNC_H
+#define GENLIB_NET_HTTP_HTTPASYNC_H
+
+
+/*!
+ * \file
+ *
+ * \brief Asynchronous HTTP client.
+ *
+ * Requests are sent and their responses received on non-blocking sockets
+ * by HTTP_ASYNC_THREADS event loop threads, so that a request in flight
+ * holds no thread. The connections come from, and go back to, the pool of
+ * http_RequestAndResponse(). Each request has a deadline; its completion
+ * callback runs in a job of the thread pool given to http_AsyncInit().
+ */
+
+
+#include "httpparser.h"
+#include "membuffer.h"
+#include "ThreadPool.h"
+#include "uri.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+ * \brief Called in a thread pool job when an asynchronous request completes.
+ *
+ * The request and the response are freed when the callback returns. The
+ * callback may pass the request to http_AsyncRequestAndResponse() again,
+ * which takes its contents.
+ */
+typedef void (*http_async_callback)(
+	/*! [in] UPNP_E_SUCCESS, or the error code http_RequestAndResponse()
+	 * would have returned. */
+	int ret_code,
+	/*! [in,out] The request that was sent. */
+	membuffer *request,
+	/*! [in] The response; complete only if ret_code is UPNP_E_SUCCESS. */
+	http_parser_t *response,
+	/*! [in] Cookie given with the request. */
+	void *cookie);
+
+
+/*!
+ * \brief Starts the event loop threads.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_INIT_FAILED or UPNP_E_OUTOF_MEMORY.
+ */
+int http_AsyncInit(
+	/*! [in] Thread pool running the loops and the callbacks. */
+	ThreadPool *tp);
+
+
+/*!
+ * \brief Stops the event loop threads.
+ *
+ * The requests in flight complete with UPNP_E_FINISH, and the function
+ * returns once every callback has returned. The thread pool must still be
+ * running.
+ */
+void http_AsyncShutdown(void);
+
+
+/*!
+ * \brief Sends a request and receives its response without blocking.
+ *
+ * Behaves like http_RequestAndResponse(): an idle pooled connection is
+ * used if there is one, and the request is sent again on a new connection
+ * if the reused one turns out to be closed before any byte of the
+ * response arrives.
+ *
+ * \return UPNP_E_SUCCESS if the request was queued, in which case the
+ * callback will be called exactly once; UPNP_E_FINISH if the client is not
+ * running or UPNP_E_OUTOF_MEMORY. On error the request is left untouched.
+ */
+int http_AsyncRequestAndResponse(
+	/*! [in] Destination; only its address is used. */
+	uri_type *destination,
+	/*! [in,out] Request to send. Its contents are taken and it is left
+	 * empty. */
+	membuffer *request,
+	/*! [in] Method of the request. */
+	http_method_t req_method,
+	/*! [in] Time out, in seconds, for the whole request. */
+	int timeout_secs,
+	/*! [in] Completion callback. */
+	http_async_callback callback,
+	/*! [in] Cookie passed to the callback. */
+	void *cookie);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* GENLIB_NET_HTTP_HTTPASYNC_H */
@@ -113,7 +113,7 @@ typedef enum
 #define HDR_HOST			7
 /*define HDR_IF_MODIFIED_SINCE		8 */
 /*define HDR_IF_UNMODIFIED_SINCE	9 */
-/*define HDR_LAST_MODIFIED		10 */
+#define HDR_LAST_MODIFIED		10
 #define HDR_LOCATION			11
 #define HDR_MAN				12
 #define HDR_MX				13
@@ -142,6 +142,13 @@ typedef enum
 #define HDR_IF_RANGE			34
 #define HDR_RANGE			35
 #define HDR_TE				36
+#define HDR_ETAG			37
+
+/*! one more than the largest header name id. */
+#define NUM_HTTP_HEADER_IDS		38
+
+/*! number of headers a http_message_t holds without allocating memory. */
+#define HTTP_INLINE_HEADERS		16
 
 /*! status of parsing */
 typedef enum {
@@ -161,15 +168,30 @@ typedef enum {
 	PARSE_CONTINUE_1
 } parse_status_t;
 
+/*!
+ * The name and the value of a header are stored as spans of the raw message
+ * buffer, which may move while the message is read, so the name and value
+ * pointers are only valid from httpmsg_find_hdr(), httpmsg_find_hdr_str()
+ * or httpmsg_get_hdr() until the message buffer is modified again. They
+ * are not null-terminated.
+ */
 typedef struct {
 	/*! header name as a string. */
 	memptr name;
 	/*! header name id (for a selective group of headers only). */
 	int name_id;
 	/*! raw-value; could be multi-lined; min-length = 0. */
-	membuffer value;
+	memptr value;
 	/* private. */
+	/*! offset of the name in the raw message. */
+	size_t name_offset;
+	/*! offset of the value in the raw message. */
+	size_t value_offset;
+	/*! name, if it is not in the raw message (trailers). */
 	membuffer name_buf;
+	/*! value, if it is not in the raw message (trailers, repeated
+	 * headers and empty values). */
+	membuffer value_buf;
 } http_header_t;
 
 typedef struct {
@@ -195,8 +217,16 @@ typedef struct {
 	int major_version;
 	/* http minor version. */
 	int minor_version;
-	/*! . */
-	LinkedList headers;
+	/*! number of headers. */
+	size_t num_headers;
+	/*! first headers. */
+	http_header_t header_array[HTTP_INLINE_HEADERS];
+	/*! headers after the first HTTP_INLINE_HEADERS ones. */
+	http_header_t *extra_headers;
+	/*! number of headers extra_headers can hold. */
+	size_t extra_headers_size;
+	/*! position + 1 of the header with a given name id, 0 if absent. */
+	size_t header_index[NUM_HTTP_HEADER_IDS];
 	/*! message body(entity). */
 	memptr entity;
 	/* private fields. */
@@ -292,6 +322,42 @@ http_header_t* httpmsg_find_hdr_str( IN http_message_t* msg,
 http_header_t* httpmsg_find_hdr( IN http_message_t* msg, 
 			IN int header_name_id, OUT memptr* value );
 
+/*!
+ * \brief Returns a header of a message by position, in the order they were
+ * received.
+ *
+ * \return The header, or NULL if position is past the last header.
+ */
+http_header_t *httpmsg_get_hdr(
+	/*! [in] HTTP Message Object. */
+	http_message_t *msg,
+	/*! [in] Position of the header. */
+	size_t position);
+
+/*!
+ * \brief Copies the value of a header out of the raw message, so that it
+ * stays valid when the message buffer is modified, e.g. when more of the
+ * message body is read.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_OUTOF_MEMORY.
+ */
+int httpmsg_keep_hdr_value(
+	/*! [in] HTTP Message Object. */
+	http_message_t *msg,
+	/*! [in] Header returned for that message. */
+	http_header_t *header);
+
+/*!
+ * \brief Classifies a header name, case-insensitively.
+ *
+ * \return The header id, or HDR_UNKNOWN.
+ */
+int http_header_name_to_id(
+	/*! [in] Header name, not null-terminated. */
+	const char *name,
+	/*! [in] Length of the name. */
+	size_t length);
+
 /************************************************************************
 * Function: parser_request_init											
 *																		
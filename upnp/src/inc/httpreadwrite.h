@@ -158,6 +158,84 @@ int http_SendMessage(
 	/* [in] Variable parameter list. */
 	...);
 
+/*!
+ * \brief Initializes the pool of idle client connections used by
+ * http_RequestAndResponse.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_INIT_FAILED.
+ */
+int http_ConnPoolInit(void);
+
+/*!
+ * \brief Closes the idle client connections and disables the pool.
+ */
+void http_ConnPoolDestroy(void);
+
+/*!
+ * \brief Takes an idle connection to a peer out of the pool.
+ *
+ * \return The connected socket, or INVALID_SOCKET if the pool has no live
+ * connection to this peer.
+ */
+SOCKET http_ConnPoolTake(
+	/*! [in] Address and port of the peer. */
+	const struct sockaddr_storage *peer);
+
+/*!
+ * \brief Gets a connection to destination, reusing an idle one if allowed.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_SOCKET_ERROR or UPNP_E_SOCKET_CONNECT.
+ */
+int http_ConnPoolAcquire(
+	/*! [in] Destination of the request. */
+	uri_type *destination,
+	/*! [in] TRUE if an idle connection may be used. */
+	int allowReuse,
+	/*! [out] Connection. */
+	SOCKINFO *info,
+	/*! [out] TRUE if the connection is a reused one. */
+	int *reused);
+
+/*!
+ * \brief Gives back a blocking connection whose response has been fully
+ * read. The connection is closed if the pool is full for this peer.
+ */
+void http_ConnPoolRelease(
+	/*! [in] Address and port of the peer. */
+	const struct sockaddr_storage *peer,
+	/*! [in] Connected socket. */
+	SOCKET sock);
+
+/*!
+ * \brief Tells whether the connection may be reused after a response.
+ *
+ * The response must be HTTP/1.1 or later, must not carry a CONNECTION:
+ * close header and its end must not have been delimited by the close of
+ * the connection.
+ *
+ * \return TRUE if the connection may be reused.
+ */
+int http_IsPersistent(
+	/*! [in] Complete response. */
+	http_parser_t *response);
+
+/*!
+ * \brief Tells whether a request failed because the peer had closed or
+ * reset a reused connection before it saw the request.
+ *
+ * Only then may the request be sent again on a new connection: a time out
+ * or an error after a part of the response arrived is never retried.
+ *
+ * \return TRUE if the request may be sent again.
+ */
+int http_IsStaleConnection(
+	/*! [in] Error of http_SendMessage or http_RecvMessage. */
+	int ret_code,
+	/*! [in] errno of the failed call. */
+	int err,
+	/*! [in] Response received so far. */
+	http_parser_t *response);
+
 /************************************************************************
  * Function: http_RequestAndResponse
  *
@@ -171,8 +249,13 @@ int http_SendMessage(
  *	OUT http_parser_t* response;	Parser object to receive the repsonse
  *
  * Description:
- *	Initiates socket, connects to the destination, sends a
- *	request and waits for the response from the remote end
+ *	Gets a connection to the destination, sends a request and waits
+ *	for the response from the remote end. Idle HTTP/1.1 connections
+ *	are reused, and put back in the pool when the response allows it.
+ *	A request whose reused connection was closed or reset by the peer
+ *	before any response byte was received is sent again on a new
+ *	connection. A time out is never retried, the peer may have
+ *	acted on the request.
  *
  * Returns:
  *	UPNP_E_SOCKET_ERROR
@@ -228,6 +311,41 @@ int http_Download(
 	OUT size_t *doc_length,
 	OUT char* content_type );
 
+/*!
+ * \brief Conditional variant of http_Download.
+ *
+ * The validators of a previously downloaded copy are sent as
+ * IF-NONE-MATCH and IF-MODIFIED-SINCE headers, and the validators of
+ * the response are returned to the caller.
+ *
+ * \return
+ *	\li 0 if the document was downloaded.
+ *	\li HTTP_NOT_MODIFIED if the copy identified by the validators is
+ *		still current; *document is NULL in that case.
+ *	\li Another HTTP status code or an UPNP_E_* error code otherwise.
+ */
+int http_DownloadEx(
+	/*! [in] String as a URL. */
+	const char *url,
+	/*! [in] Time out value. */
+	int timeout_secs,
+	/*! [in] Entity tag of the cached copy, NULL or empty if unknown. */
+	const char *if_none_match,
+	/*! [in] Last-Modified date of the cached copy, NULL or empty if
+	 * unknown. */
+	const char *if_modified_since,
+	/*! [out] Buffer to store the downloaded document. */
+	char **document,
+	/*! [out] Length of the downloaded document. */
+	size_t *doc_length,
+	/*! [out] Content type, LINE_SIZE bytes, may be NULL. */
+	char *content_type,
+	/*! [out] ETAG header of the response, LINE_SIZE bytes, may be NULL. */
+	char *etag,
+	/*! [out] LAST-MODIFIED header of the response, LINE_SIZE bytes, may
+	 * be NULL. */
+	char *last_modified);
+
 
 /************************************************************************
  * Function: http_WriteHttpPost
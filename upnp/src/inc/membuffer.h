@@ -60,7 +60,8 @@ typedef struct {
 	size_t length;
 	/*! total allocated memory (read-only). */
 	size_t capacity;
-	/*! used to increase size; MUST be > 0; (read/write). */
+	/*! smallest growth step, and slack kept when shrinking; MUST be > 0;
+	 * (read/write). */
 	size_t size_inc;
 	/*! default value of size_inc. */
 #define MEMBUF_DEF_SIZE_INC (size_t)5
@@ -121,6 +122,10 @@ int memptr_cmp_nocase(
  * \brief Increases or decreases buffer cap so that at least 'new_length'
  * bytes can be stored.
  *
+ * The capacity grows geometrically, by at most MEMBUF_MAX_GROWTH bytes at a
+ * time, and may be taken from buffers the calling thread freed earlier. It
+ * only shrinks when the buffer would be less than a quarter full.
+ *
  * \return
  * \li UPNP_E_SUCCESS - On Success
  * \li UPNP_E_OUTOF_MEMORY - On failure to allocate memory.
@@ -143,6 +148,9 @@ void membuffer_init(
 
 /*!
  * \brief Free's memory allocated for membuffer* m.
+ *
+ * Buffers of MEMBUF_POOL_MIN_SIZE to MEMBUF_POOL_MAX_SIZE bytes are kept by
+ * the calling thread for its next messages.
  */
 void membuffer_destroy(
 	/*! [in,out] Buffer to be destroyed. */
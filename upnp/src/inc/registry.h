@@ -0,0 +1,222 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+
+/*!
+ * \file
+ *
+ * \brief Registry of the devices and services discovered by the control
+ * point.
+ *
+ * Devices are indexed by UDN; services by USN ("UDN::serviceType"), control
+ * URL, event URL and the SID of the client subscription. Every device has a
+ * single timer pending on the SDK timer thread, which removes it when its
+ * advertisement expires; refreshing an advertisement only moves the
+ * expiration time, the timer reschedules itself when it fires early.
+ */
+
+
+#include "ixml.h"
+#include "upnp.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#ifdef INCLUDE_CLIENT_APIS
+
+
+/*!
+ * \brief Initializes the registry, disabled and empty.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_INIT_FAILED.
+ */
+int RegistryInit(void);
+
+
+/*!
+ * \brief Drops every entry and frees the registry resources.
+ */
+void RegistryDestroy(void);
+
+
+/*!
+ * \brief Enables or disables the registry. Disabling it drops every entry.
+ */
+void RegistryEnable(
+	/*! [in] TRUE to enable the registry. */
+	int enable);
+
+
+/*!
+ * \brief Adds, refreshes or removes the device of an SSDP advertisement or
+ * search reply. Does nothing when the registry is disabled.
+ */
+void RegistryHandleDiscovery(
+	/*! [in] UPNP_DISCOVERY_ADVERTISEMENT_ALIVE,
+	 * UPNP_DISCOVERY_ADVERTISEMENT_BYEBYE or
+	 * UPNP_DISCOVERY_SEARCH_RESULT. */
+	Upnp_EventType eventType,
+	/*! [in] Discovery information. */
+	const struct Upnp_Discovery *discovery);
+
+
+/*!
+ * \brief Adds the devices and services of a description document.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_FINISH if the registry is disabled,
+ * UPNP_E_INVALID_DESC or UPNP_E_OUTOF_MEMORY.
+ */
+int RegistryAddDescription(
+	/*! [in] URL the document was downloaded from. */
+	const char *location,
+	/*! [in] Description document. */
+	IXML_Document *descDoc,
+	/*! [in] Lifetime of the new devices in seconds, <= 0 for
+	 * DEFAULT_MAXAGE. */
+	int expires);
+
+
+/*!
+ * \brief Removes a device and its services.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_INVALID_DEVICE.
+ */
+int RegistryRemoveDevice(
+	/*! [in] UDN or USN of the device. */
+	const char *udn);
+
+
+/*!
+ * \brief Records the client subscription to the service whose event URL
+ * is eventURL. Does nothing if no such service is registered.
+ */
+void RegistrySetSubscription(
+	/*! [in] Event URL the subscription was sent to. */
+	const char *eventURL,
+	/*! [in] Client SID of the subscription. */
+	const char *sid);
+
+
+/*!
+ * \brief Forgets a client subscription.
+ */
+void RegistryClearSubscription(
+	/*! [in] Client SID of the subscription. */
+	const char *sid);
+
+
+/*!
+ * \brief Copies a device out of the registry.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_FINISH if the registry is disabled or
+ * UPNP_E_INVALID_DEVICE.
+ */
+int RegistryGetDevice(
+	/*! [in] UDN or USN of the device. */
+	const char *udn,
+	/*! [out] Copy of the device. */
+	struct Upnp_Registry_Device *device);
+
+
+/*!
+ * \brief Keys of RegistryGetService.
+ */
+typedef enum {
+	REGISTRY_BY_USN,
+	REGISTRY_BY_SID,
+	REGISTRY_BY_CONTROL_URL
+} RegistryIndex;
+
+
+/*!
+ * \brief Copies a service out of the registry.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_FINISH if the registry is disabled or
+ * UPNP_E_INVALID_SERVICE.
+ */
+int RegistryGetService(
+	/*! [in] Index to look key up in. */
+	RegistryIndex index,
+	/*! [in] USN, SID or control URL of the service. */
+	const char *key,
+	/*! [out] Copy of the service. */
+	struct Upnp_Registry_Service *service);
+
+
+/*!
+ * \brief Calls visitor for a copy of every registered device, until it
+ * returns a non zero value. The devices are copied with the registry read
+ * locked and visitor is called without any lock held.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_FINISH if the registry is disabled or
+ * UPNP_E_OUTOF_MEMORY.
+ */
+int RegistryForEachDevice(
+	/*! [in] Function to call. */
+	Upnp_RegistryDeviceVisitor visitor,
+	/*! [in] Argument of visitor. */
+	void *cookie);
+
+
+/*!
+ * \brief Calls visitor for a copy of every service of a device, or of every
+ * device, until it returns a non zero value. Same locking as
+ * RegistryForEachDevice.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_FINISH if the registry is disabled,
+ * UPNP_E_INVALID_DEVICE or UPNP_E_OUTOF_MEMORY.
+ */
+int RegistryForEachService(
+	/*! [in] UDN or USN of the device, NULL for every device. */
+	const char *udn,
+	/*! [in] Function to call. */
+	Upnp_RegistryServiceVisitor visitor,
+	/*! [in] Argument of visitor. */
+	void *cookie);
+
+
+#endif /* INCLUDE_CLIENT_APIS */
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* REGISTRY_H */
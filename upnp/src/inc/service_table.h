@@ -42,6 +42,7 @@ extern "C" {
 #endif
 
 #include "config.h"
+#include "HashTable.h"
 #include "uri.h"
 #include "ixml.h"
 #include "upnp.h"
@@ -54,14 +55,79 @@ extern "C" {
 
 #ifdef INCLUDE_DEVICE_APIS
 
+/*!
+ * Event sent to the subscribers of a service. It is shared by the queues of
+ * all the subscribers and freed when the last of them has sent it.
+ */
+typedef struct NOTIFY_EVENT {
+	/*! Number of references, protected by HandleLock. */
+	int refcount;
+	/*! Headers of the NOTIFY request, except SID and SEQ. */
+	char *headers;
+	/*! The evented XML. */
+	DOMString propertySet;
+	/*! Number of variables, 0 if they are unknown and the event cannot
+	 * be merged with another one. */
+	int varCount;
+	/*! Names of the variables. */
+	char **names;
+	/*! Values of the variables, as they appear in the property set. */
+	char **values;
+} notify_event;
+
+/*!
+ * Event waiting in the queue of a subscription.
+ */
+typedef struct NOTIFY_ENTRY {
+	/*! Shared event. */
+	notify_event *event;
+	/*! SEQ of the event for this subscription. */
+	int eventKey;
+	/*! Next, more recent, event of the queue. */
+	struct NOTIFY_ENTRY *next;
+} notify_entry;
+
+/*!
+ * Moderation of the events of a state variable, see UpnpSetEventModeration().
+ */
+typedef struct EVENT_MODERATION {
+	/*! Name of the state variable. */
+	char *name;
+	/*! Minimum time between two events of the variable, in ms, 0 if the
+	 * rate is not moderated. */
+	int maxRate;
+	/*! Minimum change of a numeric value to be evented, 0 if every change
+	 * is evented. */
+	double minDelta;
+	/*! Value sent by the last event, NULL if none was sent. */
+	char *sentValue;
+	/*! Time of the last event, in ms. */
+	int64_t sentTime;
+	/*! Latest value held back until maxRate allows to send it, NULL if
+	 * none. */
+	char *pendingValue;
+	struct EVENT_MODERATION *next;
+} event_moderation;
+
 typedef struct SUBSCRIPTION {
 	Upnp_SID sid;
 	int eventKey;
-	int ToSendEventKey;
 	time_t expireTime;
 	int active;
 	URL_list DeliveryURLs;
+	/*! Events waiting to be sent, oldest first. The head may be being
+	 * sent while sending is set. */
+	notify_entry *queueHead;
+	/*! Last event of the queue. */
+	notify_entry *queueTail;
+	/*! Number of events in the queue. */
+	int queueLength;
+	/*! TRUE while the subscription is in the ready list of the senders
+	 * or one of them sends its queue. */
+	int sending;
 	struct SUBSCRIPTION *next;
+	/*! Only maintained while the subscription is in a service. */
+	struct SUBSCRIPTION *prev;
 } subscription;
 
 typedef struct SERVICE_INFO {
@@ -74,6 +140,19 @@ typedef struct SERVICE_INFO {
 	int		active;
 	int		TotalSubscriptions;
 	subscription	*subscriptionList;
+	/*! Subscriptions by SID, allocated on the first subscription. */
+	HashTable	subscriptionsBySID;
+	/*! Key of the service in the serviceId index of the table. */
+	char		*idKey;
+	/*! Path and query of controlURL, key of the control URL index. */
+	char		*controlURLPath;
+	/*! Path and query of eventURL, key of the event URL index. */
+	char		*eventURLPath;
+	/*! Moderated state variables. */
+	event_moderation	*moderation;
+	/*! Time the timer sending the held back values is set for, in ms,
+	 * 0 if none is set. */
+	int64_t		moderationDue;
 	struct SERVICE_INFO	 *next;
 } service_info;
 
@@ -81,6 +160,14 @@ typedef struct SERVICE_TABLE {
 	DOMString URLBase;
 	service_info *serviceList;
 	service_info *endServiceList;
+	/*! Services by UDN and serviceId. The indexes are rebuilt when the
+	 * service list changes; if that fails, they are left unallocated and
+	 * the lookups walk the list. */
+	HashTable byServiceId;
+	/*! Services by control URL path. */
+	HashTable byControlURLPath;
+	/*! Services by event URL path. */
+	HashTable byEventURLPath;
 } service_table;
 
 /* Functions for Subscriptions */
@@ -96,6 +183,17 @@ int copy_subscription(
 	/*! [in] Destination subscription. */
 	subscription *out);
 
+/*!
+ * \brief Adds a subscription, whose SID is set, to a service.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_OUTOF_MEMORY.
+ */
+int AddSubscription(
+	/*! [in] Subscription, owned by the service on success. */
+	subscription *sub,
+	/*! [in] Service object providing the list of subscriptions. */
+	service_info *service);
+
 /*
  * \brief Remove the subscription represented by the const Upnp_SID sid parameter
  * from the service table and update the service table.
@@ -118,6 +216,27 @@ subscription *GetSubscriptionSID(
 	/*! [in] Service object providing the list of subscriptions. */
 	service_info *service); 
 
+/*!
+ * \brief Drops a reference to an event, and frees it if it was the last one.
+ */
+void releaseNotifyEvent(
+	/*! [in] Event. */
+	notify_event *event);
+
+/*!
+ * \brief Frees the moderation of the state variables of a service.
+ */
+void freeEventModeration(
+	/*! [in] Service. */
+	service_info *service);
+
+/*!
+ * \brief Frees the events waiting in the queue of a subscription.
+ */
+void freeNotifyQueue(
+	/*! [in] Subscription. */
+	subscription *sub);
+
 /*!
  * \brief Gets pointer to the first subscription node in the service table.
  *
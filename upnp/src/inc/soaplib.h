@@ -76,6 +76,28 @@ int SoapSendAction(
 	IN IXML_Document *action_node,
 	OUT IXML_Document **response_node);
 
+/*!
+ * \brief Sends a SOAP action like SoapSendAction(), but streams the SOAP
+ * envelope of the response to SAX callbacks instead of building a DOM
+ * document.
+ *
+ * For a SOAP fault, the callbacks see the fault envelope and its UPnP error
+ * code is returned.
+ *
+ * \return UPNP_E_SUCCESS if successful else returns appropriate error.
+ */
+int SoapSendActionSax(
+	/*! [in] Device control URL. */
+	IN char *action_url,
+	/*! [in] Device service type. */
+	IN char *service_type,
+	/*! [in] SOAP action node. */
+	IN IXML_Document *action_node,
+	/*! [in] The callbacks. */
+	IN const IXML_SaxHandler *handler,
+	/*! [in] Cookie passed to the callbacks. */
+	IN void *cookie);
+
 /****************************************************************************
  * Function: SoapSendActionEx
  *
@@ -103,6 +125,42 @@ int SoapSendActionEx(
 	IN IXML_Document *ActNode,
 	OUT IXML_Document **RespNode);
 
+/*!
+ * \brief Called in a thread pool job when an action sent with
+ * SoapSendActionAsync() completes.
+ */
+typedef void (*SoapActionCallback)(
+	/*! [in] UPNP_E_SUCCESS, the UPnP error code of a SOAP fault, or an SDK
+	 * error, as returned by SoapSendActionEx(). */
+	int err_code,
+	/*! [in] SOAP response node, or the UPnPError node of a fault; the
+	 * callback must free it. */
+	IXML_Document *response_node,
+	/*! [in] Cookie given with the action. */
+	void *cookie);
+
+/*!
+ * \brief Sends a SOAP action like SoapSendActionEx() but does not wait for
+ * the response: the callback gets it.
+ *
+ * \return UPNP_E_SUCCESS if the action was sent, in which case the callback
+ * will be called exactly once, else an error; UPNP_E_FINISH if the
+ * asynchronous client is not running.
+ */
+int SoapSendActionAsync(
+	/*! [in] Device control URL. */
+	char *action_url,
+	/*! [in] Device service type. */
+	char *service_type,
+	/*! [in] SOAP header, or NULL. */
+	IXML_Document *header,
+	/*! [in] SOAP action node. */
+	IXML_Document *action_node,
+	/*! [in] Completion callback. */
+	SoapActionCallback callback,
+	/*! [in] Cookie passed to the callback. */
+	void *cookie);
+
 /****************************************************************************
  * Function: SoapGetServiceVarStatus
  *
@@ -123,6 +181,38 @@ int SoapGetServiceVarStatus(
 	IN DOMString VarName,
 	OUT DOMString *StVar);
 
+/*!
+ * \brief Called in a thread pool job when a query sent with
+ * SoapGetServiceVarStatusAsync() completes.
+ */
+typedef void (*SoapVarCallback)(
+	/*! [in] UPNP_E_SUCCESS, the UPnP error code of a SOAP fault, or an SDK
+	 * error, as returned by SoapGetServiceVarStatus(). */
+	int err_code,
+	/*! [in] Value of the variable, or the description of the fault; the
+	 * callback must free it. */
+	DOMString var_value,
+	/*! [in] Cookie given with the query. */
+	void *cookie);
+
+/*!
+ * \brief Queries a state variable like SoapGetServiceVarStatus() but does
+ * not wait for the response: the callback gets it.
+ *
+ * \return UPNP_E_SUCCESS if the query was sent, in which case the callback
+ * will be called exactly once, else an error; UPNP_E_FINISH if the
+ * asynchronous client is not running.
+ */
+int SoapGetServiceVarStatusAsync(
+	/*! [in] Device control URL. */
+	char *action_url,
+	/*! [in] Name of the variable. */
+	char *var_name,
+	/*! [in] Completion callback. */
+	SoapVarCallback callback,
+	/*! [in] Cookie passed to the callback. */
+	void *cookie);
+
 extern const char* ContentTypeHeader;
 
 #endif /* SOAPLIB_H */
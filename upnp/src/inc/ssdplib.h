@@ -142,10 +142,13 @@ typedef struct ssdpsearchreply
 
 typedef struct ssdpsearcharg
 {
-	int timeoutEventId;
 	char * searchTarget;
 	void *cookie;
 	enum SsdpSearchType requestType;
+	/*! TRUE while the search is in the search index. */
+	int indexed;
+	/*! Next search of the same list or index bucket. */
+	struct ssdpsearcharg *next;
 } SsdpSearchArg;
 
 
@@ -231,12 +234,55 @@ int ssdp_request_type(
 	SsdpEvent *Evt);
 
 /*!
- * \brief This function reads the data from the ssdp socket.
+ * \brief This function reads the pending datagrams of the ssdp socket, up
+ * to SSDP_RECV_BATCH_SIZE, into a batch of the receive ring and queues one
+ * job to handle them.
+ *
+ * \return 0 if at least one datagram was read, -1 if none was available
+ * (the socket would block) or on error.
  */
-void readFromSSDPSocket(
+int readFromSSDPSocket(
 	/* [in] SSDP socket. */
 	SOCKET socket);
 
+/*!
+ * \brief Allocates the ring of datagram slots used by readFromSSDPSocket().
+ *
+ * \return UPNP_E_SUCCESS if successful else returns appropriate error.
+ */
+int initSSDPRecvRing(void);
+
+/*!
+ * \brief Frees the ring of datagram slots. No SSDP job must be pending.
+ */
+void destroySSDPRecvRing(void);
+
+/*!
+ * \brief Sets the number of discovery lanes, see UpnpSetDiscoveryLanes(),
+ * and resets their counters.
+ *
+ * \return UPNP_E_SUCCESS.
+ */
+int ssdp_set_lanes(
+	/*! [in] Number of lanes, 0 to UPNP_DISCOVERY_LANES_MAX. */
+	int count);
+
+/*!
+ * \brief Returns the number of discovery lanes in use.
+ */
+int ssdp_lane_count(void);
+
+/*!
+ * \brief Returns the counters of the discovery lanes.
+ *
+ * \return The number of lanes in use.
+ */
+int ssdp_get_lane_stats(
+	/*! [out] Counters, one per lane. */
+	struct Upnp_Discovery_Lane_Stats *stats,
+	/*! [in] Number of elements of stats. */
+	int size);
+
 /*!
  * \brief Creates the IPv4 and IPv6 ssdp sockets required by the
  *  control point and device operation.
@@ -273,6 +319,101 @@ void ssdp_handle_ctrlpt_msg(
 	 * Only in search reply. */
 	void *cookie);
 
+/*!
+ * \brief Initializes the list of the M-SEARCH transmissions in progress.
+ *
+ * \return UPNP_E_SUCCESS if successful else returns appropriate error.
+ */
+int initSSDPSearchTx(void);
+
+/*!
+ * \brief Destroys the list of the M-SEARCH transmissions in progress. The
+ * timer thread must be shut down.
+ */
+void destroySSDPSearchTx(void);
+
+/*!
+ * \brief Initializes the index of the active searches.
+ *
+ * \return UPNP_E_SUCCESS if successful else returns appropriate error.
+ */
+int initSSDPSearchIndex(void);
+
+/*!
+ * \brief Destroys the index of the active searches. The timer thread must be
+ * shut down.
+ */
+void destroySSDPSearchIndex(void);
+
+/*!
+ * \brief Removes every search from the index, when the control point is
+ * unregistered. The searches are freed when they time out.
+ */
+void ssdp_clear_searches(void);
+
+/*!
+ * \brief Initializes the filter of the duplicate discovery messages.
+ *
+ * \return UPNP_E_SUCCESS if successful else returns appropriate error.
+ */
+int initSSDPDedup(void);
+
+/*!
+ * \brief Destroys the filter of the duplicate discovery messages.
+ */
+void destroySSDPDedup(void);
+
+/*!
+ * \brief Forgets the messages seen and resets the counters of the filter of
+ * the duplicate discovery messages, see UpnpSetDiscoveryDedup().
+ */
+void ssdp_reset_dedup(void);
+
+/*!
+ * \brief Returns the counters of the filter of the duplicate discovery
+ * messages.
+ */
+void ssdp_get_dedup_stats(
+	/*! [out] Counters. */
+	struct Upnp_Discovery_Dedup_Stats *stats);
+
+/*!
+ * \brief Initializes the discovery filter, which lets every message through.
+ *
+ * \return UPNP_E_SUCCESS if successful else returns appropriate error.
+ */
+int initSSDPFilter(void);
+
+/*!
+ * \brief Destroys the discovery filter.
+ */
+void destroySSDPFilter(void);
+
+/*!
+ * \brief Sets the prefixes of the discovery filter, see
+ * UpnpSetDiscoveryFilter().
+ *
+ * \return UPNP_E_SUCCESS if successful else returns appropriate error.
+ */
+int ssdp_set_filter(
+	/*! [in] Prefixes, copied. */
+	const char **prefixes,
+	/*! [in] Number of prefixes, 0 to let every message through. */
+	int count);
+
+/*!
+ * \brief Checks a raw datagram against the discovery filter, before it is
+ * parsed. Advertisements and search replies are wanted if their NT, ST or
+ * USN header starts with one of the prefixes; search requests always are.
+ *
+ * \return TRUE if the datagram is to be handled.
+ */
+int ssdp_filter_datagram(
+	/*! [in] Datagram, null-terminated. */
+	const char *buf,
+	/*! [in] Length of the datagram. */
+	size_t length);
+
 /*!
  * \brief Creates and send the search request for a specific URL.
  *
@@ -288,6 +429,10 @@ void ssdp_handle_ctrlpt_msg(
  *     \li "urn:<domain-name>:device:<deviceType:v>"
  *     \li "urn:<domain-name>:service:<serviceType:v>"
  *
+ * The requests are sent by the timer thread, NUM_SSDP_COPY times SSDP_PAUSE
+ * ms apart; a search of a target whose requests are still being sent only
+ * waits for their replies.
+ *
  * \return 1 if successful else appropriate error.
  */
 int SearchByTarget(
@@ -112,10 +112,24 @@ struct Handle_Info
 
 	/* Client only */
 #ifdef INCLUDE_CLIENT_APIS
-	/*! Client subscription list. */
-	ClientSubscription *ClientSubList;
-	/*! Active SSDP searches. */
-	LinkedList SsdpSearchList;
+	/*! Client subscriptions. */
+	ClientSubTable ClientSubs;
+	/*! TRUE if the events are streamed to EventSaxHandler instead of
+	 * being parsed into a DOM document. */
+	int EventSaxEnabled;
+	/*! SAX callbacks set by UpnpSetEventSaxHandler(). */
+	IXML_SaxHandler EventSaxHandler;
+	/*! Cookie given to UpnpSetEventSaxHandler(). */
+	void *EventSaxCookie;
+	/*! Number of events a subscription may hold back until the missing
+	 * ones arrive, 0 if the events are not sequenced. Set by
+	 * UpnpSetEventSequencing(). */
+	int EventSeqWindow;
+	/*! Time the missing events are waited for, in ms. */
+	int EventSeqTimeout;
+	/*! Time a discovery message is remembered to drop its duplicates,
+	 * in ms, 0 to pass them on. Set by UpnpSetDiscoveryDedup(). */
+	int DiscoveryDedupWindow;
 #endif
 };
 
@@ -41,6 +41,7 @@
 
 #include "miniserver.h"
 #include "membuffer.h"
+#include "httpasync.h"
 #include "httpparser.h"
 #include "httpreadwrite.h"
 #include "statcodes.h"
@@ -389,7 +390,7 @@ get_response_value( IN http_message_t * hmsg,
 	     hmsg->status_code != HTTP_INTERNAL_SERVER_ERROR) ||
 	    !has_xml_content_type(hmsg))
 		goto error_handler;
-	if (ixmlParseBufferEx(hmsg->entity.buf, &doc) != IXML_SUCCESS)
+	if (ixmlParseBufferArenaEx(hmsg->entity.buf, &doc) != IXML_SUCCESS)
 		goto error_handler;
 	root_node = ixmlNode_getFirstChild((IXML_Node *) doc);
 	if (root_node == NULL)
@@ -497,64 +498,97 @@ get_response_value( IN http_message_t * hmsg,
 	return err_code;
 }
 
-/****************************************************************************
-*	Function :	SoapSendAction
-*
-*	Parameters :
-*		IN char* action_url :	device contrl URL 
-*		IN char *service_type :	device service type
-*		IN IXML_Document *action_node : SOAP action node	
-*		OUT IXML_Document **response_node :	SOAP response node
-*
-*	Description :	This function is called by UPnP API to send the SOAP 
-*		action request and waits till it gets the response from the device
-*		pass the response to the API layer
-*
-*	Return :	int
-*		returns UPNP_E_SUCCESS if successful else returns appropriate error
-*	Note :
-****************************************************************************/
-int
-SoapSendAction( IN char *action_url,
-                IN char *service_type,
-                IN IXML_Document * action_node,
-                OUT IXML_Document ** response_node )
+/*!
+ * \brief Streams the SOAP envelope of a response to SAX callbacks.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_OUTOF_MEMORY or UPNP_E_BAD_RESPONSE.
+ */
+static int get_response_sax(
+	/*! [in] The response message. */
+	http_message_t *hmsg,
+	/*! [in] The callbacks. */
+	const IXML_SaxHandler *handler,
+	/*! [in] The cookie passed to the callbacks. */
+	void *cookie)
 {
+	if (!has_xml_content_type(hmsg))
+		return UPNP_E_BAD_RESPONSE;
+	switch (ixmlSaxParse(hmsg->entity.buf, handler, cookie)) {
+	case IXML_SUCCESS:
+		return UPNP_E_SUCCESS;
+	case IXML_INSUFFICIENT_MEMORY:
+		return UPNP_E_OUTOF_MEMORY;
+	default:
+		return UPNP_E_BAD_RESPONSE;
+	}
+}
+
+/*!
+ * \brief Builds the request of a SOAP action, with a SOAP header if one is
+ * given.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_OUTOF_MEMORY, UPNP_E_INVALID_ACTION or
+ * UPNP_E_INVALID_URL.
+ */
+static int make_action_request(
+	/*! [in] Device control URL; url points into it. */
+	char *action_url,
+	/*! [in] Device service type. */
+	char *service_type,
+	/*! [in] SOAP header, or NULL. */
+	IXML_Document *header,
+	/*! [in] SOAP action node. */
+	IXML_Document *action_node,
+	/*! [out] Parsed control URL. */
+	uri_type *url,
+	/*! [out] The request; initialized by the caller. */
+	membuffer *request,
+	/*! [out] Name of the response node; initialized by the caller. */
+	membuffer *responsename)
+{
+    char *xml_header_str = NULL;
     char *action_str = NULL;
     memptr name;
-    membuffer request;
-    membuffer responsename;
     int err_code;
     int ret_code;
-    http_parser_t response;
-    uri_type url;
-    int upnp_error_code;
-    char *upnp_error_str;
-    int got_response = FALSE;
-
-    off_t content_length;
     const char *xml_start =
         "<s:Envelope "
         "xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" "
-        "s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\">\r\n"
+        "s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\">\r\n";
+    const char *xml_header_start =
+        "<s:Header>\r\n";
+    const char *xml_header_end =
+        "</s:Header>\r\n";
+    const char *xml_body_start =
         "<s:Body>";
-    const char *xml_end =
+    /* the end of the envelope has always differed with and without a
+     * header; keep the bytes on the wire as they were. */
+    const char *xml_end = header != NULL ?
+        "</s:Body>\r\n"
+        "</s:Envelope>\r\n" :
         "</s:Body>\r\n"
         "</s:Envelope>\r\n\r\n";
     size_t xml_start_len;
-    size_t xml_end_len;
+    size_t xml_header_start_len = 0;
+    size_t xml_header_str_len = 0;
+    size_t xml_header_end_len = 0;
+    size_t xml_body_start_len;
     size_t action_str_len;
-
-    *response_node = NULL;      /* init */
+    size_t xml_end_len;
+    off_t content_length;
 
     err_code = UPNP_E_OUTOF_MEMORY; /* default error */
 
-    UpnpPrintf( UPNP_INFO, SOAP, __FILE__, __LINE__,
-        "Inside SoapSendAction():" );
-    /* init */
-    membuffer_init( &request );
-    membuffer_init( &responsename );
-
+    /* header string */
+    if( header != NULL ) {
+        xml_header_str = ixmlPrintNode( ( IXML_Node * ) header );
+        if( xml_header_str == NULL ) {
+            goto error_handler;
+        }
+        xml_header_start_len = strlen( xml_header_start );
+        xml_header_str_len = strlen( xml_header_str );
+        xml_header_end_len = strlen( xml_header_end );
+    }
     /* print action */
     action_str = ixmlPrintNode( ( IXML_Node * ) action_node );
     if( action_str == NULL ) {
@@ -566,35 +600,167 @@ SoapSendAction( IN char *action_url,
         goto error_handler;
     }
     /* parse url */
-    if( http_FixStrUrl( action_url, strlen( action_url ), &url ) != 0 ) {
+    if( http_FixStrUrl( action_url, strlen( action_url ), url ) != 0 ) {
         err_code = UPNP_E_INVALID_URL;
         goto error_handler;
     }
 
     UpnpPrintf( UPNP_INFO, SOAP, __FILE__, __LINE__,
         "path=%.*s, hostport=%.*s\n",
-        (int)url.pathquery.size,
-        url.pathquery.buff,
-        (int)url.hostport.text.size,
-        url.hostport.text.buff );
+        (int)url->pathquery.size,
+        url->pathquery.buff,
+        (int)url->hostport.text.size,
+        url->hostport.text.buff );
 
     xml_start_len = strlen( xml_start );
+    xml_body_start_len = strlen( xml_body_start );
     xml_end_len = strlen( xml_end );
     action_str_len = strlen( action_str );
 
     /* make request msg */
-    request.size_inc = 50;
-    content_length = (off_t)(xml_start_len + action_str_len + xml_end_len);
+    request->size_inc = 50;
+    content_length = (off_t)(xml_start_len + xml_header_start_len +
+        xml_header_str_len + xml_header_end_len +
+        xml_body_start_len + action_str_len + xml_end_len);
+    ret_code = header != NULL ?
+        http_MakeMessage(
+            request, 1, 1,
+            "q" "N" "s" "sssbsc" "Uc" "b" "b" "b" "b" "b" "b" "b",
+            SOAPMETHOD_POST, url,
+            content_length,
+            ContentTypeHeader,
+            "SOAPACTION: \"", service_type, "#", name.buf, name.length, "\"",
+            xml_start, xml_start_len,
+            xml_header_start, xml_header_start_len,
+            xml_header_str, xml_header_str_len,
+            xml_header_end, xml_header_end_len,
+            xml_body_start, xml_body_start_len,
+            action_str, action_str_len,
+            xml_end, xml_end_len ) :
+        http_MakeMessage(
+            request, 1, 1,
+            "q" "N" "s" "sssbsc" "Uc" "b" "b" "b" "b",
+            SOAPMETHOD_POST, url,
+            content_length,
+            ContentTypeHeader,
+            "SOAPACTION: \"", service_type, "#", name.buf, name.length, "\"",
+            xml_start, xml_start_len,
+            xml_body_start, xml_body_start_len,
+            action_str, action_str_len,
+            xml_end, xml_end_len );
+    if( ret_code != 0 ) {
+        goto error_handler;
+    }
+    if( membuffer_append( responsename, name.buf, name.length ) != 0 ||
+        membuffer_append_str( responsename, "Response" ) != 0 ) {
+        goto error_handler;
+    }
+    err_code = UPNP_E_SUCCESS;
+
+error_handler:
+    ixmlFreeDOMString( action_str );
+    ixmlFreeDOMString( xml_header_str );
+
+    return err_code;
+}
+
+/*!
+ * \brief Builds the request of a state variable query.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_OUTOF_MEMORY or UPNP_E_INVALID_URL.
+ */
+static int make_var_request(
+	/*! [in] Device control URL; url points into it. */
+	char *action_url,
+	/*! [in] Name of the variable. */
+	char *var_name,
+	/*! [out] Parsed control URL. */
+	uri_type *url,
+	/*! [out] The request; initialized by the caller. */
+	membuffer *request)
+{
+    const memptr host;                /* value for HOST header */
+    const memptr path;                /* ctrl path in first line in msg */
+    off_t content_length;
+    const char *xml_start =
+        "<s:Envelope "
+        "xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" "
+        "s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\">\r\n"
+        "<s:Body>\r\n"
+        "<u:QueryStateVariable xmlns:u=\"urn:schemas-upnp-org:control-1-0\">\r\n"
+        "<u:varName>";
+    const char *xml_end =
+        "</u:varName>\r\n"
+        "</u:QueryStateVariable>\r\n"
+        "</s:Body>\r\n"
+        "</s:Envelope>\r\n";
+
+    /* get host hdr and url path */
+    if( get_host_and_path( action_url, &host, &path, url ) == -1 ) {
+        return UPNP_E_INVALID_URL;
+    }
+    /* make headers */
+    request->size_inc = 50;
+    content_length = (off_t)(strlen(xml_start) + strlen(var_name) +
+	strlen(xml_end));
     if (http_MakeMessage(
-       	&request, 1, 1,
-        "q" "N" "s" "sssbsc" "Uc" "b" "b" "b",
-        SOAPMETHOD_POST, &url, 
-        content_length,
-        ContentTypeHeader,
-        "SOAPACTION: \"", service_type, "#", name.buf, name.length, "\"",
-        xml_start, xml_start_len,
-        action_str, action_str_len,
-        xml_end, xml_end_len ) != 0 ) {
+	request, 1, 1,
+	"Q" "sbc" "N" "s" "sc" "Ucc" "sss",
+	SOAPMETHOD_POST, path.buf, path.length,
+	"HOST: ", host.buf, host.length,
+	content_length,
+	ContentTypeHeader,
+	"SOAPACTION: \"urn:schemas-upnp-org:control-1-0#QueryStateVariable\"",
+	xml_start, var_name, xml_end ) != 0 ) {
+        return UPNP_E_OUTOF_MEMORY;
+    }
+
+    return UPNP_E_SUCCESS;
+}
+
+/*!
+ * \brief Sends a SOAP action and delivers the response either as a DOM
+ * document or, if handler is not NULL, to SAX callbacks.
+ *
+ * \return UPNP_E_SUCCESS, the UPnP error code of a SOAP fault, or an SDK
+ * error.
+ */
+static int soap_send_action(
+	/*! [in] Device control URL. */
+	IN char *action_url,
+	/*! [in] Device service type. */
+	IN char *service_type,
+	/*! [in] SOAP action node. */
+	IN IXML_Document *action_node,
+	/*! [out] SOAP response node, or the UPnPError node of a fault. */
+	OUT IXML_Document **response_node,
+	/*! [in] SAX callbacks of the response, or NULL. */
+	IN const IXML_SaxHandler *handler,
+	/*! [in] Cookie passed to the SAX callbacks. */
+	IN void *cookie)
+{
+    membuffer request;
+    membuffer responsename;
+    int err_code;
+    int ret_code;
+    http_parser_t response;
+    uri_type url;
+    int upnp_error_code;
+    char *upnp_error_str;
+    int got_response = FALSE;
+
+    *response_node = NULL;      /* init */
+
+    UpnpPrintf( UPNP_INFO, SOAP, __FILE__, __LINE__,
+        "Inside SoapSendAction():" );
+    /* init */
+    membuffer_init( &request );
+    membuffer_init( &responsename );
+
+    err_code = make_action_request( action_url, service_type, NULL,
+                                    action_node, &url, &request,
+                                    &responsename );
+    if( err_code != UPNP_E_SUCCESS ) {
         goto error_handler;
     }
 
@@ -605,10 +771,12 @@ SoapSendAction( IN char *action_url,
         goto error_handler;
     }
 
-    if( membuffer_append( &responsename, name.buf, name.length ) != 0 ||
-        membuffer_append_str( &responsename, "Response" ) != 0 ) {
+    if( handler != NULL && response.msg.status_code == HTTP_OK ) {
+        /* stream the response without building a DOM */
+        err_code = get_response_sax( &response.msg, handler, cookie );
         goto error_handler;
     }
+
     /* get action node from the response */
     ret_code = get_response_value( &response.msg, SOAP_ACTION_RESP,
                                    responsename.buf, &upnp_error_code,
@@ -619,12 +787,15 @@ SoapSendAction( IN char *action_url,
         err_code = UPNP_E_SUCCESS;
     } else if( ret_code == SOAP_ACTION_RESP_ERROR ) {
         err_code = upnp_error_code;
+        if( handler != NULL ) {
+            /* the fault is small; the callbacks see it too */
+            get_response_sax( &response.msg, handler, cookie );
+        }
     } else {
         err_code = ret_code;
     }
 
 error_handler:
-    ixmlFreeDOMString( action_str );
     membuffer_destroy( &request );
     membuffer_destroy( &responsename );
     if( got_response ) {
@@ -634,6 +805,33 @@ error_handler:
     return err_code;
 }
 
+int SoapSendAction(
+	IN char *action_url,
+	IN char *service_type,
+	IN IXML_Document *action_node,
+	OUT IXML_Document **response_node)
+{
+	return soap_send_action(action_url, service_type, action_node,
+		response_node, NULL, NULL);
+}
+
+int SoapSendActionSax(
+	IN char *action_url,
+	IN char *service_type,
+	IN IXML_Document *action_node,
+	IN const IXML_SaxHandler *handler,
+	IN void *cookie)
+{
+	IXML_Document *fault = NULL;
+	int ret_code;
+
+	ret_code = soap_send_action(action_url, service_type, action_node,
+		&fault, handler, cookie);
+	ixmlDocument_free(fault);
+
+	return ret_code;
+}
+
 /****************************************************************************
 *	Function :	SoapSendActionEx
 *
@@ -661,9 +859,6 @@ int SoapSendActionEx(
 	IN IXML_Document * action_node,
 	OUT IXML_Document ** response_node )
 {
-    char *xml_header_str = NULL;
-    char *action_str = NULL;
-    memptr name;
     membuffer request;
     membuffer responsename;
     int err_code;
@@ -673,94 +868,19 @@ int SoapSendActionEx(
     int upnp_error_code;
     char *upnp_error_str;
     int got_response = FALSE;
-    const char *xml_start =
-        "<s:Envelope "
-        "xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" "
-        "s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\">\r\n";
-    const char *xml_header_start =
-        "<s:Header>\r\n";
-    const char *xml_header_end =
-        "</s:Header>\r\n";
-    const char *xml_body_start =
-        "<s:Body>";
-    const char *xml_end =
-        "</s:Body>\r\n"
-        "</s:Envelope>\r\n";
-    size_t xml_start_len;
-    size_t xml_header_start_len;
-    size_t xml_header_str_len;
-    size_t xml_header_end_len;
-    size_t xml_body_start_len;
-    size_t action_str_len;
-    size_t xml_end_len;
-    off_t content_length;
 
     *response_node = NULL;      /* init */
 
-    err_code = UPNP_E_OUTOF_MEMORY; /* default error */
-
     UpnpPrintf( UPNP_INFO, SOAP, __FILE__, __LINE__,
         "Inside SoapSendActionEx():" );
     /* init */
     membuffer_init( &request );
     membuffer_init( &responsename );
 
-    /* header string */
-    xml_header_str = ixmlPrintNode( ( IXML_Node * ) header );
-    if( xml_header_str == NULL ) {
-        goto error_handler;
-    }
-    /* print action */
-    action_str = ixmlPrintNode( ( IXML_Node * ) action_node );
-    if( action_str == NULL ) {
-        goto error_handler;
-    }
-    /* get action name */
-    if( get_action_name( action_str, &name ) != 0 ) {
-        err_code = UPNP_E_INVALID_ACTION;
-        goto error_handler;
-    }
-    /* parse url */
-    if( http_FixStrUrl( action_url, strlen( action_url ), &url ) != 0 ) {
-        err_code = UPNP_E_INVALID_URL;
-        goto error_handler;
-    }
-
-    UpnpPrintf( UPNP_INFO, SOAP, __FILE__, __LINE__,
-        "path=%.*s, hostport=%.*s\n",
-        (int)url.pathquery.size,
-        url.pathquery.buff,
-        (int)url.hostport.text.size,
-        url.hostport.text.buff );
-
-    xml_start_len = strlen( xml_start );
-    xml_body_start_len = strlen( xml_body_start );
-    xml_end_len = strlen( xml_end );
-    action_str_len = strlen( action_str );
-
-    xml_header_start_len = strlen( xml_header_start );
-    xml_header_end_len = strlen( xml_header_end );
-    xml_header_str_len = strlen( xml_header_str );
-
-    /* make request msg */
-    request.size_inc = 50;
-    content_length = (off_t)(xml_start_len + xml_header_start_len +
-	xml_header_str_len + xml_header_end_len +
-        xml_body_start_len + action_str_len + xml_end_len);
-    if (http_MakeMessage(
-        &request, 1, 1,
-        "q" "N" "s" "sssbsc" "Uc" "b" "b" "b" "b" "b" "b" "b",
-        SOAPMETHOD_POST, &url,
-        content_length,
-        ContentTypeHeader,
-        "SOAPACTION: \"", service_type, "#", name.buf, name.length, "\"",
-        xml_start, xml_start_len,
-        xml_header_start, xml_header_start_len,
-        xml_header_str, xml_header_str_len,
-        xml_header_end, xml_header_end_len,
-        xml_body_start, xml_body_start_len,
-        action_str, action_str_len,
-        xml_end, xml_end_len ) != 0 ) {
+    err_code = make_action_request( action_url, service_type, header,
+                                    action_node, &url, &request,
+                                    &responsename );
+    if( err_code != UPNP_E_SUCCESS ) {
         goto error_handler;
     }
 
@@ -771,10 +891,6 @@ int SoapSendActionEx(
         goto error_handler;
     }
 
-    if( membuffer_append( &responsename, name.buf, name.length ) != 0 ||
-        membuffer_append_str( &responsename, "Response" ) != 0 ) {
-        goto error_handler;
-    }
     /* get action node from the response */
     ret_code = get_response_value( &response.msg, SOAP_ACTION_RESP,
                                    responsename.buf, &upnp_error_code,
@@ -790,9 +906,6 @@ int SoapSendActionEx(
     }
 
   error_handler:
-
-    ixmlFreeDOMString( action_str );
-    ixmlFreeDOMString( xml_header_str );
     membuffer_destroy( &request );
     membuffer_destroy( &responsename );
     if( got_response ) {
@@ -823,47 +936,18 @@ SoapGetServiceVarStatus( IN char *action_url,
                          IN char *var_name,
                          OUT char **var_value )
 {
-    const memptr host;                /* value for HOST header */
-    const memptr path;                /* ctrl path in first line in msg */
     uri_type url;
     membuffer request;
     int ret_code;
     http_parser_t response;
     int upnp_error_code;
-    off_t content_length;
-    const char *xml_start =
-        "<s:Envelope "
-        "xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" "
-        "s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\">\r\n"
-        "<s:Body>\r\n"
-        "<u:QueryStateVariable xmlns:u=\"urn:schemas-upnp-org:control-1-0\">\r\n"
-        "<u:varName>";
-    const char *xml_end =
-        "</u:varName>\r\n"
-        "</u:QueryStateVariable>\r\n"
-        "</s:Body>\r\n"
-        "</s:Envelope>\r\n";
 
     *var_value = NULL;          /* return NULL in case of an error */
     membuffer_init( &request );
-    /* get host hdr and url path */
-    if( get_host_and_path( action_url, &host, &path, &url ) == -1 ) {
-        return UPNP_E_INVALID_URL;
-    }
-    /* make headers */
-    request.size_inc = 50;
-    content_length = (off_t)(strlen(xml_start) + strlen(var_name) +
-	strlen(xml_end));
-    if (http_MakeMessage(
-	&request, 1, 1,
-	"Q" "sbc" "N" "s" "sc" "Ucc" "sss",
-	SOAPMETHOD_POST, path.buf, path.length,
-	"HOST: ", host.buf, host.length,
-	content_length,
-	ContentTypeHeader,
-	"SOAPACTION: \"urn:schemas-upnp-org:control-1-0#QueryStateVariable\"",
-	xml_start, var_name, xml_end ) != 0 ) {
-        return UPNP_E_OUTOF_MEMORY;
+    ret_code = make_var_request( action_url, var_name, &url, &request );
+    if( ret_code != UPNP_E_SUCCESS ) {
+        membuffer_destroy( &request );
+        return ret_code;
     }
     /* send msg and get reply */
     ret_code = soap_request_and_response( &request, &url, &response );
@@ -884,6 +968,186 @@ SoapGetServiceVarStatus( IN char *action_url,
     }
 }
 
+/*! State of an asynchronous SOAP request. */
+typedef struct {
+	/*! Copy of the control URL, which url points into. */
+	char *action_url;
+	/*! Parsed control URL. */
+	uri_type url;
+	/*! Name of the response node of an action. */
+	membuffer responsename;
+	/*! TRUE once the request was sent again as M-POST. */
+	int mpost;
+	/*! Completion callback of an action, NULL for a variable query. */
+	SoapActionCallback action_callback;
+	/*! Completion callback of a variable query. */
+	SoapVarCallback var_callback;
+	/*! Cookie of the callback. */
+	void *cookie;
+} soap_async_ctx;
+
+/*!
+ * \brief Allocates the state of an asynchronous SOAP request.
+ *
+ * \return The state, or NULL if out of memory.
+ */
+static soap_async_ctx *soap_async_new(
+	/*! [in] Device control URL. */
+	const char *action_url,
+	/*! [in] Cookie of the callback. */
+	void *cookie)
+{
+	soap_async_ctx *ctx;
+
+	ctx = malloc(sizeof(*ctx));
+	if (ctx == NULL)
+		return NULL;
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->action_url = strdup(action_url);
+	if (ctx->action_url == NULL) {
+		free(ctx);
+		return NULL;
+	}
+	membuffer_init(&ctx->responsename);
+	ctx->cookie = cookie;
+
+	return ctx;
+}
+
+/*!
+ * \brief Frees the state of an asynchronous SOAP request.
+ */
+static void soap_async_free(
+	/*! [in] State to free. */
+	soap_async_ctx *ctx)
+{
+	membuffer_destroy(&ctx->responsename);
+	free(ctx->action_url);
+	free(ctx);
+}
+
+/*!
+ * \brief Completion of an asynchronous SOAP request: sends it again as
+ * M-POST if POST is not allowed, as soap_request_and_response() does, or
+ * parses the response and calls the callback of the request.
+ */
+static void soap_async_done(
+	/*! [in] Result of the HTTP request. */
+	int ret_code,
+	/*! [in,out] The request. */
+	membuffer *request,
+	/*! [in] The response. */
+	http_parser_t *response,
+	/*! [in] State of the SOAP request. */
+	void *cookie)
+{
+	soap_async_ctx *ctx = (soap_async_ctx *)cookie;
+	IXML_Document *response_node = NULL;
+	char *var_value = NULL;
+	char *upnp_error_str = NULL;
+	int upnp_error_code = 0;
+	int err_code = ret_code;
+
+	if (ret_code == UPNP_E_SUCCESS && !ctx->mpost &&
+	    response->msg.status_code == HTTP_METHOD_NOT_ALLOWED) {
+		/* change to M-POST msg and try again */
+		ctx->mpost = TRUE;
+		err_code = add_man_header(request);
+		if (err_code == 0) {
+			err_code = http_AsyncRequestAndResponse(&ctx->url,
+				request, HTTPMETHOD_MPOST, UPNP_TIMEOUT,
+				soap_async_done, ctx);
+			if (err_code == UPNP_E_SUCCESS)
+				return;
+		}
+	} else if (ret_code == UPNP_E_SUCCESS && ctx->action_callback) {
+		/* get action node from the response */
+		ret_code = get_response_value(&response->msg,
+			SOAP_ACTION_RESP, ctx->responsename.buf,
+			&upnp_error_code, (IXML_Node **)&response_node,
+			&upnp_error_str);
+		if (ret_code == SOAP_ACTION_RESP)
+			err_code = UPNP_E_SUCCESS;
+		else if (ret_code == SOAP_ACTION_RESP_ERROR)
+			err_code = upnp_error_code;
+		else
+			err_code = ret_code;
+	} else if (ret_code == UPNP_E_SUCCESS) {
+		/* get variable value from the response */
+		ret_code = get_response_value(&response->msg, SOAP_VAR_RESP,
+			NULL, &upnp_error_code, NULL, &var_value);
+		if (ret_code == SOAP_VAR_RESP)
+			err_code = UPNP_E_SUCCESS;
+		else if (ret_code == SOAP_VAR_RESP_ERROR)
+			err_code = upnp_error_code;
+		else
+			err_code = ret_code;
+	}
+	if (ctx->action_callback)
+		ctx->action_callback(err_code, response_node, ctx->cookie);
+	else
+		ctx->var_callback(err_code, var_value, ctx->cookie);
+	soap_async_free(ctx);
+}
+
+int SoapSendActionAsync(
+	char *action_url,
+	char *service_type,
+	IXML_Document *header,
+	IXML_Document *action_node,
+	SoapActionCallback callback,
+	void *cookie)
+{
+	soap_async_ctx *ctx;
+	membuffer request;
+	int err_code;
+
+	UpnpPrintf(UPNP_INFO, SOAP, __FILE__, __LINE__,
+		"Inside SoapSendActionAsync():");
+	ctx = soap_async_new(action_url, cookie);
+	if (ctx == NULL)
+		return UPNP_E_OUTOF_MEMORY;
+	ctx->action_callback = callback;
+	membuffer_init(&request);
+	err_code = make_action_request(ctx->action_url, service_type, header,
+		action_node, &ctx->url, &request, &ctx->responsename);
+	if (err_code == UPNP_E_SUCCESS)
+		err_code = http_AsyncRequestAndResponse(&ctx->url, &request,
+			SOAPMETHOD_POST, UPNP_TIMEOUT, soap_async_done, ctx);
+	membuffer_destroy(&request);
+	if (err_code != UPNP_E_SUCCESS)
+		soap_async_free(ctx);
+
+	return err_code;
+}
+
+int SoapGetServiceVarStatusAsync(
+	char *action_url,
+	char *var_name,
+	SoapVarCallback callback,
+	void *cookie)
+{
+	soap_async_ctx *ctx;
+	membuffer request;
+	int err_code;
+
+	ctx = soap_async_new(action_url, cookie);
+	if (ctx == NULL)
+		return UPNP_E_OUTOF_MEMORY;
+	ctx->var_callback = callback;
+	membuffer_init(&request);
+	err_code = make_var_request(ctx->action_url, var_name, &ctx->url,
+		&request);
+	if (err_code == UPNP_E_SUCCESS)
+		err_code = http_AsyncRequestAndResponse(&ctx->url, &request,
+			SOAPMETHOD_POST, UPNP_TIMEOUT, soap_async_done, ctx);
+	membuffer_destroy(&request);
+	if (err_code != UPNP_E_SUCCESS)
+		soap_async_free(ctx);
+
+	return err_code;
+}
+
 #endif /* EXCLUDE_SOAP */
 #endif /* INCLUDE_CLIENT_APIS */
 
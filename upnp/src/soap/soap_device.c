@@ -736,7 +736,7 @@ void soap_device_callback(
 		goto error_handler;
 	}
 	/* parse XML */
-	err_code = ixmlParseBufferEx(request->entity.buf, &xml_doc);
+	err_code = ixmlParseBufferArenaEx(request->entity.buf, &xml_doc);
 	if (err_code != IXML_SUCCESS) {
 		if (IXML_INSUFFICIENT_MEMORY == err_code)
 			err_code = HTTP_INTERNAL_SERVER_ERROR;
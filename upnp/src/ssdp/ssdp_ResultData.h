@@ -13,12 +13,15 @@
  * \author Marcelo Roberto Jimenez
  */
 
-/*! Structure to contain Discovery response. */
+/*! Structure to contain Discovery response and the searches it matches. */
 typedef struct resultData
 {
 	struct Upnp_Discovery param;
-	void *cookie;
 	Upnp_FunPtr ctrlpt_callback;
+	/*! Number of cookies. */
+	int cookieCount;
+	/*! Cookies of the searches, allocated with the structure. */
+	void **cookies;
 } ResultData;
 
 /* @} SSDPlib */
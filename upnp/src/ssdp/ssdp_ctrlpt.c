@@ -45,8 +45,10 @@
 #ifdef INCLUDE_CLIENT_APIS
 #if EXCLUDE_SSDP == 0
 
+#include "HashTable.h"
 #include "httpparser.h"
 #include "httpreadwrite.h"
+#include "registry.h"
 #include "ssdp_ResultData.h"
 #include "ssdplib.h"
 #include "statcodes.h"
@@ -55,6 +57,7 @@
 #include "UpnpInet.h"
 #include "ThreadPool.h"
 
+#include <ctype.h>
 #include <stdio.h>
 
 #ifdef WIN32
@@ -71,12 +74,684 @@ static void send_search_result(
 	IN void *data)
 {
 	ResultData *temp = (ResultData *) data;
+	int i;
 
-	temp->ctrlpt_callback(UPNP_DISCOVERY_SEARCH_RESULT, &temp->param,
-			      temp->cookie);
+	for (i = 0; i < temp->cookieCount; i++)
+		temp->ctrlpt_callback(UPNP_DISCOVERY_SEARCH_RESULT,
+				      &temp->param, temp->cookies[i]);
 	free(temp);
 }
 
+/*! Searches of the same index key. */
+typedef struct s_SsdpSearchBucket {
+	/*! UDN, or device or service type without its version. */
+	char *key;
+	/*! Searches, linked by their next field. */
+	SsdpSearchArg *searches;
+} SsdpSearchBucket;
+
+/*!
+ * \brief Protects the search index. It is taken after the handle lock, never
+ * before.
+ */
+static ithread_rwlock_t gSsdpSearchLock;
+/*! ssdp:all searches. */
+static SsdpSearchArg *gSsdpSearchAll = NULL;
+/*! upnp:rootdevice searches. */
+static SsdpSearchArg *gSsdpSearchRoot = NULL;
+/*! Buckets of the other searches by key, see search_key_length(). */
+static HashTable gSsdpSearchIndex;
+
+/*!
+ * \brief Returns the length of the index key of a search target or of the ST
+ * of a reply: the whole UDN, or the device or service type without its
+ * ":<version>" suffix, so that the searches of a type without a version
+ * share the bucket of the replies of every version.
+ */
+static size_t search_key_length(
+	/*! [in] Type of the search target or ST. */
+	enum SsdpSearchType type,
+	/*! [in] Search target or ST, not necessarily NULL terminated. */
+	const char *target,
+	/*! [in] Length of target. */
+	size_t length)
+{
+	size_t i = length;
+
+	if (type != SSDP_DEVICETYPE && type != SSDP_SERVICE)
+		return length;
+	while (i > 0 && isdigit((unsigned char)target[i - 1]))
+		i--;
+	if (i > 0 && i < length && target[i - 1] == ':')
+		return i - 1;
+
+	return length;
+}
+
+/*!
+ * \brief Returns the head of the list a search belongs to, creating its
+ * bucket if needed. Must be called with the search lock held for writing.
+ *
+ * \return The head, or NULL if the bucket could not be created.
+ */
+static SsdpSearchArg **search_list(
+	/*! [in] Search. */
+	SsdpSearchArg *arg,
+	/*! [in] TRUE to create the bucket of the search. */
+	int create,
+	/*! [out] Bucket of the search, NULL for the lists. */
+	SsdpSearchBucket **out)
+{
+	SsdpSearchBucket *bucket;
+	size_t length;
+
+	*out = NULL;
+	switch (arg->requestType) {
+	case SSDP_ALL:
+		return &gSsdpSearchAll;
+	case SSDP_ROOTDEVICE:
+		return &gSsdpSearchRoot;
+	default:
+		break;
+	}
+	length = search_key_length(arg->requestType, arg->searchTarget,
+		strlen(arg->searchTarget));
+	bucket = HashTableFindN(&gSsdpSearchIndex, arg->searchTarget, length);
+	*out = bucket;
+	if (bucket || !create)
+		return bucket ? &bucket->searches : NULL;
+	bucket = (SsdpSearchBucket *)malloc(sizeof(SsdpSearchBucket));
+	if (!bucket)
+		return NULL;
+	bucket->key = (char *)malloc(length + (size_t)1);
+	if (!bucket->key) {
+		free(bucket);
+		return NULL;
+	}
+	memcpy(bucket->key, arg->searchTarget, length);
+	bucket->key[length] = '\0';
+	bucket->searches = NULL;
+	if (HashTableAdd(&gSsdpSearchIndex, bucket->key, bucket, NULL) != 0) {
+		free(bucket->key);
+		free(bucket);
+		return NULL;
+	}
+	*out = bucket;
+
+	return &bucket->searches;
+}
+
+/*!
+ * \brief Adds a search to the index.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_OUTOF_MEMORY.
+ */
+static int index_search(
+	/*! [in] Search. */
+	SsdpSearchArg *arg)
+{
+	SsdpSearchArg **head;
+	SsdpSearchBucket *bucket;
+
+	ithread_rwlock_wrlock(&gSsdpSearchLock);
+	head = search_list(arg, TRUE, &bucket);
+	if (head) {
+		arg->next = *head;
+		*head = arg;
+		arg->indexed = TRUE;
+	}
+	ithread_rwlock_unlock(&gSsdpSearchLock);
+
+	return head ? UPNP_E_SUCCESS : UPNP_E_OUTOF_MEMORY;
+}
+
+/*!
+ * \brief Removes a search from the index.
+ *
+ * \return TRUE if the search was in the index.
+ */
+static int unindex_search(
+	/*! [in] Search. */
+	SsdpSearchArg *arg)
+{
+	SsdpSearchArg **head;
+	SsdpSearchArg **prev;
+	SsdpSearchBucket *bucket = NULL;
+	int indexed;
+
+	ithread_rwlock_wrlock(&gSsdpSearchLock);
+	indexed = arg->indexed;
+	head = indexed ? search_list(arg, FALSE, &bucket) : NULL;
+	for (prev = head; prev && *prev; prev = &(*prev)->next) {
+		if (*prev == arg) {
+			*prev = arg->next;
+			break;
+		}
+	}
+	arg->indexed = FALSE;
+	if (bucket && !bucket->searches) {
+		HashTableRemove(&gSsdpSearchIndex, bucket->key);
+		free(bucket->key);
+		free(bucket);
+	}
+	ithread_rwlock_unlock(&gSsdpSearchLock);
+
+	return indexed;
+}
+
+/*!
+ * \brief Frees a search.
+ */
+static void free_search(
+	/*! [in] Search. */
+	SsdpSearchArg *arg)
+{
+	free(arg->searchTarget);
+	free(arg);
+}
+
+/*!
+ * \brief Removes a search from the index and frees it, when its timeout job
+ * is dropped by the timer thread.
+ */
+static void drop_search(
+	/*! [in] SsdpSearchArg. */
+	void *arg)
+{
+	unindex_search((SsdpSearchArg *)arg);
+	free_search((SsdpSearchArg *)arg);
+}
+
+/*!
+ * \brief Checks the ST of a reply against a search target.
+ *
+ * \return TRUE if the search matches.
+ */
+static int search_matches(
+	/*! [in] Search. */
+	const SsdpSearchArg *arg,
+	/*! [in] Type of the ST. */
+	enum SsdpSearchType type,
+	/*! [in] ST, not NULL terminated. */
+	const char *st,
+	/*! [in] Length of st. */
+	size_t length)
+{
+	size_t m;
+
+	switch (arg->requestType) {
+	case SSDP_ALL:
+		return TRUE;
+	case SSDP_ROOTDEVICE:
+		return type == SSDP_ROOTDEVICE;
+	case SSDP_DEVICEUDN:
+		return !strncmp(arg->searchTarget, st, length);
+	case SSDP_DEVICETYPE:
+	case SSDP_SERVICE:
+		m = min(length, strlen(arg->searchTarget));
+		return !strncmp(arg->searchTarget, st, m);
+	default:
+		return FALSE;
+	}
+}
+
+/*!
+ * \brief Collects the cookies of the searches a reply matches. Must be called
+ * with the search lock held.
+ *
+ * \return The number of searches matched.
+ */
+static int match_searches(
+	/*! [in] Type of the ST. */
+	enum SsdpSearchType type,
+	/*! [in] ST, not NULL terminated. */
+	const char *st,
+	/*! [in] Length of st. */
+	size_t length,
+	/*! [out] Cookies of the searches, NULL to count them only. */
+	void **cookies)
+{
+	SsdpSearchBucket *bucket = NULL;
+	SsdpSearchArg *lists[3];
+	SsdpSearchArg *arg;
+	int count = 0;
+	int i;
+
+	lists[0] = gSsdpSearchAll;
+	lists[1] = type == SSDP_ROOTDEVICE ? gSsdpSearchRoot : NULL;
+	if (type == SSDP_DEVICEUDN || type == SSDP_DEVICETYPE ||
+	    type == SSDP_SERVICE)
+		bucket = HashTableFindN(&gSsdpSearchIndex, st,
+			search_key_length(type, st, length));
+	lists[2] = bucket ? bucket->searches : NULL;
+	for (i = 0; i < 3; i++) {
+		for (arg = lists[i]; arg; arg = arg->next) {
+			if (!search_matches(arg, type, st, length))
+				continue;
+			if (cookies)
+				cookies[count] = arg->cookie;
+			count++;
+		}
+	}
+
+	return count;
+}
+
+int initSSDPSearchIndex(void)
+{
+	if (ithread_rwlock_init(&gSsdpSearchLock, NULL) != 0)
+		return UPNP_E_INIT_FAILED;
+	if (HashTableInit(&gSsdpSearchIndex, 0) != 0) {
+		ithread_rwlock_destroy(&gSsdpSearchLock);
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	gSsdpSearchAll = NULL;
+	gSsdpSearchRoot = NULL;
+
+	return UPNP_E_SUCCESS;
+}
+
+void ssdp_clear_searches(void)
+{
+	SsdpSearchBucket *bucket;
+	SsdpSearchArg *arg;
+	long pos = 0;
+
+	ithread_rwlock_wrlock(&gSsdpSearchLock);
+	for (arg = gSsdpSearchAll; arg; arg = arg->next)
+		arg->indexed = FALSE;
+	for (arg = gSsdpSearchRoot; arg; arg = arg->next)
+		arg->indexed = FALSE;
+	gSsdpSearchAll = NULL;
+	gSsdpSearchRoot = NULL;
+	while ((bucket = HashTableIterNext(&gSsdpSearchIndex, &pos)) != NULL) {
+		for (arg = bucket->searches; arg; arg = arg->next)
+			arg->indexed = FALSE;
+		HashTableRemove(&gSsdpSearchIndex, bucket->key);
+		free(bucket->key);
+		free(bucket);
+	}
+	ithread_rwlock_unlock(&gSsdpSearchLock);
+}
+
+void destroySSDPSearchIndex(void)
+{
+	ssdp_clear_searches();
+	HashTableDestroy(&gSsdpSearchIndex, NULL);
+	ithread_rwlock_destroy(&gSsdpSearchLock);
+}
+
+/*! Number of entries of the duplicate filter, a power of two. */
+#define SSDP_DEDUP_SIZE 4096
+
+/*! Number of entries a key may use, a power of two. */
+#define SSDP_DEDUP_WAYS 4
+
+/*! Message remembered by the duplicate filter. */
+typedef struct s_SsdpDedupEntry {
+	/*! Hash of the USN, LOCATION, BOOTID, CONFIGID and kind, 0 if free. */
+	uint64_t key;
+	/*! Time the message was first seen, in ms. */
+	int64_t seen;
+} SsdpDedupEntry;
+
+/*! Protects the duplicate filter. */
+static ithread_mutex_t gSsdpDedupMutex;
+/*! Messages seen, SSDP_DEDUP_WAYS entries per set. */
+static SsdpDedupEntry gSsdpDedup[SSDP_DEDUP_SIZE];
+/*! Counters of the duplicate filter. */
+static struct Upnp_Discovery_Dedup_Stats gSsdpDedupStats;
+/*! Incremented by each search, so that its replies are not taken for the
+ * duplicates of the replies to the previous ones. */
+static unsigned long gSsdpSearchEpoch = 0;
+
+/*!
+ * \brief Adds a header value to a FNV-1a hash.
+ *
+ * \return The new hash.
+ */
+static uint64_t dedup_hash(
+	/*! [in] Hash so far. */
+	uint64_t hash,
+	/*! [in] Value, not NULL terminated. */
+	const char *buf,
+	/*! [in] Length of buf. */
+	size_t length)
+{
+	size_t i;
+
+	for (i = 0; i < length; i++) {
+		hash ^= (unsigned char)buf[i];
+		hash *= 0x100000001b3ULL;
+	}
+	/* separator, so that values do not run into each other */
+	hash ^= 0xff;
+	hash *= 0x100000001b3ULL;
+
+	return hash;
+}
+
+/*!
+ * \brief Adds the value of a header to a hash, or an empty one.
+ *
+ * \return The new hash.
+ */
+static uint64_t dedup_hash_hdr(
+	/*! [in] Hash so far. */
+	uint64_t hash,
+	/*! [in] Message. */
+	http_message_t *hmsg,
+	/*! [in] Header id, or HDR_UNKNOWN to look name up. */
+	int id,
+	/*! [in] Header name, if id is HDR_UNKNOWN. */
+	const char *name)
+{
+	http_header_t *header;
+	memptr value;
+
+	if (id != HDR_UNKNOWN) {
+		if (httpmsg_find_hdr(hmsg, id, &value) != NULL)
+			return dedup_hash(hash, value.buf, value.length);
+	} else {
+		header = httpmsg_find_hdr_str(hmsg, name);
+		if (header != NULL)
+			return dedup_hash(hash, header->value.buf,
+				header->value.length);
+	}
+
+	return dedup_hash(hash, "", (size_t)0);
+}
+
+/*!
+ * \brief Returns the first entry of the set of a key.
+ */
+static UPNP_INLINE SsdpDedupEntry *dedup_set(
+	/*! [in] Key. */
+	uint64_t key)
+{
+	/* the low bits of a FNV hash only depend on the low bits of its
+	 * input, fold the high ones in */
+	key ^= key >> 29;
+	key ^= key >> 17;
+
+	return &gSsdpDedup[key & (SSDP_DEDUP_SIZE - SSDP_DEDUP_WAYS)];
+}
+
+/*!
+ * \brief Looks a key up in the duplicate filter. Must be called with the
+ * filter mutex held.
+ *
+ * \return The entry of the key, or NULL.
+ */
+static SsdpDedupEntry *dedup_find(
+	/*! [in] Key. */
+	uint64_t key)
+{
+	SsdpDedupEntry *set;
+	int i;
+
+	set = dedup_set(key);
+	for (i = 0; i < SSDP_DEDUP_WAYS; i++)
+		if (set[i].key == key)
+			return &set[i];
+
+	return NULL;
+}
+
+/*!
+ * \brief Checks whether a discovery message was received less than window
+ * ms ago, and remembers it otherwise. Nothing is allocated.
+ *
+ * \return TRUE if the message is a duplicate to be dropped.
+ */
+static int ssdp_is_duplicate(
+	/*! [in] Advertisement, byebye or search reply. */
+	http_message_t *hmsg,
+	/*! [in] Time a message is remembered, in ms, 0 to remember none. */
+	int window)
+{
+	SsdpDedupEntry *set;
+	SsdpDedupEntry *entry;
+	memptr nts;
+	uint64_t base;
+	uint64_t key;
+	uint64_t other = 0;
+	int64_t now;
+	int is_alive;
+	int i;
+
+	if (window <= 0)
+		return FALSE;
+	/* FNV-1a offset basis */
+	base = dedup_hash_hdr(0xcbf29ce484222325ULL, hmsg, HDR_USN, NULL);
+	base = dedup_hash_hdr(base, hmsg, HDR_LOCATION, NULL);
+	base = dedup_hash_hdr(base, hmsg, HDR_UNKNOWN, "BOOTID.UPNP.ORG");
+	base = dedup_hash_hdr(base, hmsg, HDR_UNKNOWN, "CONFIGID.UPNP.ORG");
+	now = imillinow();
+	ithread_mutex_lock(&gSsdpDedupMutex);
+	if (hmsg->is_request) {
+		if (httpmsg_find_hdr(hmsg, HDR_NTS, &nts) == NULL) {
+			ithread_mutex_unlock(&gSsdpDedupMutex);
+			return FALSE;
+		}
+		key = dedup_hash(base, nts.buf, nts.length);
+		/* the key of the other kind, forgotten below */
+		is_alive = memptr_cmp(&nts, "ssdp:alive") == 0;
+		other = is_alive ? dedup_hash(base, "ssdp:byebye", (size_t)11) :
+			dedup_hash(base, "ssdp:alive", (size_t)10);
+	} else {
+		key = dedup_hash(base, (const char *)&gSsdpSearchEpoch,
+			sizeof(gSsdpSearchEpoch));
+	}
+	if (key == 0)
+		key = 1;
+	entry = dedup_find(key);
+	if (entry && now - entry->seen < (int64_t)window) {
+		if (hmsg->is_request)
+			gSsdpDedupStats.SuppressedAdvertisements++;
+		else
+			gSsdpDedupStats.SuppressedSearchResults++;
+		ithread_mutex_unlock(&gSsdpDedupMutex);
+		return TRUE;
+	}
+	if (!entry) {
+		/* replace the oldest entry of the set */
+		set = dedup_set(key);
+		entry = &set[0];
+		for (i = 1; i < SSDP_DEDUP_WAYS; i++)
+			if (set[i].seen < entry->seen)
+				entry = &set[i];
+	}
+	entry->key = key;
+	entry->seen = now;
+	if (hmsg->is_request) {
+		if (other != 0 && (entry = dedup_find(other)) != NULL) {
+			entry->key = 0;
+			entry->seen = 0;
+		}
+		gSsdpDedupStats.Advertisements++;
+	} else {
+		gSsdpDedupStats.SearchResults++;
+	}
+	ithread_mutex_unlock(&gSsdpDedupMutex);
+
+	return FALSE;
+}
+
+int initSSDPDedup(void)
+{
+	if (ithread_mutex_init(&gSsdpDedupMutex, NULL) != 0)
+		return UPNP_E_INIT_FAILED;
+	ssdp_reset_dedup();
+
+	return UPNP_E_SUCCESS;
+}
+
+void destroySSDPDedup(void)
+{
+	ithread_mutex_destroy(&gSsdpDedupMutex);
+}
+
+void ssdp_reset_dedup(void)
+{
+	ithread_mutex_lock(&gSsdpDedupMutex);
+	memset(gSsdpDedup, 0, sizeof(gSsdpDedup));
+	memset(&gSsdpDedupStats, 0, sizeof(gSsdpDedupStats));
+	ithread_mutex_unlock(&gSsdpDedupMutex);
+}
+
+void ssdp_get_dedup_stats(struct Upnp_Discovery_Dedup_Stats *stats)
+{
+	ithread_mutex_lock(&gSsdpDedupMutex);
+	*stats = gSsdpDedupStats;
+	ithread_mutex_unlock(&gSsdpDedupMutex);
+}
+
+/*! Prefix of the discovery filter. */
+typedef struct s_SsdpFilterPrefix {
+	/*! Prefix, not NULL terminated. */
+	const char *buf;
+	/*! Length of buf. */
+	size_t length;
+} SsdpFilterPrefix;
+
+/*! Discovery filter, allocated with its prefixes in one block. */
+typedef struct s_SsdpFilter {
+	/*! Number of prefixes. */
+	int count;
+	/*! Prefixes. */
+	SsdpFilterPrefix prefixes[1];
+} SsdpFilter;
+
+/*! Protects gSsdpFilter. */
+static ithread_rwlock_t gSsdpFilterLock;
+/*! Discovery filter, NULL if every message is wanted. */
+static SsdpFilter *gSsdpFilter = NULL;
+
+/*!
+ * \brief Checks whether a header value starts with one of the prefixes of
+ * the discovery filter. Must be called with the filter lock held.
+ *
+ * \return TRUE if the value matches.
+ */
+static int filter_matches(
+	/*! [in] Value, not NULL terminated. */
+	const char *value,
+	/*! [in] Length of value. */
+	size_t length)
+{
+	const SsdpFilterPrefix *prefix;
+	int i;
+
+	for (i = 0; i < gSsdpFilter->count; i++) {
+		prefix = &gSsdpFilter->prefixes[i];
+		if (prefix->length <= length &&
+		    strncasecmp(value, prefix->buf, prefix->length) == 0)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+int ssdp_filter_datagram(const char *buf, size_t length)
+{
+	const char *end = buf + length;
+	const char *line;
+	const char *eol;
+	const char *value;
+	size_t name_len;
+	int wanted;
+
+	/* the search requests are for the devices */
+	if (length >= (size_t)8 && strncmp(buf, "M-SEARCH", (size_t)8) == 0)
+		return TRUE;
+	ithread_rwlock_rdlock(&gSsdpFilterLock);
+	if (gSsdpFilter == NULL) {
+		ithread_rwlock_unlock(&gSsdpFilterLock);
+		return TRUE;
+	}
+	wanted = FALSE;
+	/* skip the start line, then look at the NT, ST and USN headers */
+	line = memchr(buf, '\n', length);
+	while (!wanted && line != NULL && ++line < end) {
+		eol = memchr(line, '\n', (size_t)(end - line));
+		if (eol == NULL)
+			eol = end;
+		value = memchr(line, ':', (size_t)(eol - line));
+		if (value == NULL)
+			/* blank line, end of the headers */
+			break;
+		name_len = (size_t)(value - line);
+		while (name_len > 0 && (line[name_len - 1] == ' ' ||
+					line[name_len - 1] == '\t'))
+			name_len--;
+		if ((name_len == (size_t)2 &&
+		     (strncasecmp(line, "NT", (size_t)2) == 0 ||
+		      strncasecmp(line, "ST", (size_t)2) == 0)) ||
+		    (name_len == (size_t)3 &&
+		     strncasecmp(line, "USN", (size_t)3) == 0)) {
+			value++;
+			while (value < eol && (*value == ' ' || *value == '\t'))
+				value++;
+			wanted = filter_matches(value, (size_t)(eol - value));
+		}
+		line = eol < end ? eol : NULL;
+	}
+	ithread_rwlock_unlock(&gSsdpFilterLock);
+
+	return wanted;
+}
+
+int ssdp_set_filter(const char **prefixes, int count)
+{
+	SsdpFilter *filter = NULL;
+	SsdpFilter *old;
+	size_t size;
+	char *p;
+	int i;
+
+	if (count > 0) {
+		size = sizeof(SsdpFilter) +
+			sizeof(SsdpFilterPrefix) * (size_t)(count - 1);
+		for (i = 0; i < count; i++)
+			size += strlen(prefixes[i]);
+		filter = (SsdpFilter *)malloc(size);
+		if (filter == NULL)
+			return UPNP_E_OUTOF_MEMORY;
+		filter->count = count;
+		p = (char *)&filter->prefixes[count];
+		for (i = 0; i < count; i++) {
+			filter->prefixes[i].buf = p;
+			filter->prefixes[i].length = strlen(prefixes[i]);
+			memcpy(p, prefixes[i], filter->prefixes[i].length);
+			p += filter->prefixes[i].length;
+		}
+	}
+	ithread_rwlock_wrlock(&gSsdpFilterLock);
+	old = gSsdpFilter;
+	gSsdpFilter = filter;
+	ithread_rwlock_unlock(&gSsdpFilterLock);
+	free(old);
+
+	return UPNP_E_SUCCESS;
+}
+
+int initSSDPFilter(void)
+{
+	if (ithread_rwlock_init(&gSsdpFilterLock, NULL) != 0)
+		return UPNP_E_INIT_FAILED;
+	gSsdpFilter = NULL;
+
+	return UPNP_E_SUCCESS;
+}
+
+void destroySSDPFilter(void)
+{
+	free(gSsdpFilter);
+	gSsdpFilter = NULL;
+	ithread_rwlock_destroy(&gSsdpFilterLock);
+}
+
 void ssdp_handle_ctrlpt_msg(http_message_t *hmsg, struct sockaddr_storage *dest_addr,
 			    int timeout, void *cookie)
 {
@@ -94,9 +769,8 @@ void ssdp_handle_ctrlpt_msg(http_message_t *hmsg, struct sockaddr_storage *dest_
 	Upnp_EventType event_type;
 	Upnp_FunPtr ctrlpt_callback;
 	void *ctrlpt_cookie;
-	ListNode *node = NULL;
-	SsdpSearchArg *searchArg = NULL;
-	int matched = 0;
+	int dedup_window;
+	int matched;
 	ResultData *threadData = NULL;
 	ThreadPoolJob job;
 
@@ -112,12 +786,16 @@ void ssdp_handle_ctrlpt_msg(http_message_t *hmsg, struct sockaddr_storage *dest_
 	/* copy */
 	ctrlpt_callback = ctrlpt_info->Callback;
 	ctrlpt_cookie = ctrlpt_info->Cookie;
+	dedup_window = ctrlpt_info->DiscoveryDedupWindow;
 	HandleUnlock();
 	/* search timeout */
 	if (timeout) {
 		ctrlpt_callback(UPNP_DISCOVERY_SEARCH_TIMEOUT, NULL, cookie);
 		return;
 	}
+	/* drop the copies of a message before anything is done with them */
+	if (ssdp_is_duplicate(hmsg, dedup_window))
+		return;
 	param.ErrCode = UPNP_E_SUCCESS;
 	/* MAX-AGE, assume error */
 	param.Expires = -1;
@@ -209,6 +887,8 @@ void ssdp_handle_ctrlpt_msg(http_message_t *hmsg, struct sockaddr_storage *dest_
 			}
 			event_type = UPNP_DISCOVERY_ADVERTISEMENT_ALIVE;
 		}
+		/* update the registry before the application sees it */
+		RegistryHandleDiscovery(event_type, &param);
 		/* call callback */
 		ctrlpt_callback(event_type, &param, ctrlpt_cookie);
 	} else {
@@ -227,79 +907,37 @@ void ssdp_handle_ctrlpt_msg(http_message_t *hmsg, struct sockaddr_storage *dest_
 		    strlen(param.Location) == 0 || !usn_found || !st_found) {
 			return;	/* bad reply */
 		}
-		/* check each current search */
-		HandleLock();
-		if (GetClientHandleInfo(&handle, &ctrlpt_info) != HND_CLIENT) {
-			HandleUnlock();
-			return;
+		RegistryHandleDiscovery(UPNP_DISCOVERY_SEARCH_RESULT, &param);
+		/* check the current searches indexed by the ST, then
+		 * schedule one callback job for all those matched */
+		ithread_rwlock_rdlock(&gSsdpSearchLock);
+		matched = match_searches(event.RequestType, hdr_value.buf,
+			hdr_value.length, NULL);
+		if (matched > 0)
+			threadData = (ResultData *)malloc(sizeof(ResultData) +
+				sizeof(void *) * (size_t)matched);
+		if (threadData != NULL) {
+			threadData->param = param;
+			threadData->ctrlpt_callback = ctrlpt_callback;
+			threadData->cookies = (void **)(threadData + 1);
+			threadData->cookieCount = match_searches(
+				event.RequestType, hdr_value.buf,
+				hdr_value.length, threadData->cookies);
 		}
-		node = ListHead(&ctrlpt_info->SsdpSearchList);
-		/* temporary add null termination */
-		/*save_char = hdr_value.buf[ hdr_value.length ]; */
-		/*hdr_value.buf[ hdr_value.length ] = '\0'; */
-		while (node != NULL) {
-			searchArg = node->item;
-			/* check for match of ST header and search target */
-			switch (searchArg->requestType) {
-			case SSDP_ALL:
-				matched = 1;
-				break;
-			case SSDP_ROOTDEVICE:
-				matched =
-				    (event.RequestType == SSDP_ROOTDEVICE);
-				break;
-			case SSDP_DEVICEUDN:
-				matched = !strncmp(searchArg->searchTarget,
-						   hdr_value.buf,
-						   hdr_value.length);
-				break;
-			case SSDP_DEVICETYPE:{
-					size_t m = min(hdr_value.length,
-						       strlen
-						       (searchArg->searchTarget));
-					matched =
-					    !strncmp(searchArg->searchTarget,
-						     hdr_value.buf, m);
-					break;
-				}
-			case SSDP_SERVICE:{
-					size_t m = min(hdr_value.length,
-						       strlen
-						       (searchArg->searchTarget));
-					matched =
-					    !strncmp(searchArg->searchTarget,
-						     hdr_value.buf, m);
-					break;
-				}
-			default:
-				matched = 0;
-				break;
-			}
-			if (matched) {
-				/* schedule call back */
-				threadData =
-				    (ResultData *) malloc(sizeof(ResultData));
-				if (threadData != NULL) {
-					threadData->param = param;
-					threadData->cookie = searchArg->cookie;
-					threadData->ctrlpt_callback =
-					    ctrlpt_callback;
-					TPJobInit(&job, (start_routine)
-						  send_search_result,
-						  threadData);
-					TPJobSetPriority(&job, MED_PRIORITY);
-					TPJobSetFreeFunction(&job,
-							     (free_routine)
-							     free);
-					if (ThreadPoolAdd(&gRecvThreadPool, &job, NULL) != 0) {
-						free(threadData);
-					}
-				}
-			}
-			node = ListNext(&ctrlpt_info->SsdpSearchList, node);
+		ithread_rwlock_unlock(&gSsdpSearchLock);
+		if (threadData != NULL && ssdp_lane_count() > 0) {
+			/* already on the discovery lane of the device, keep
+			 * the results in order with its advertisements; this
+			 * frees threadData */
+			send_search_result(threadData);
+		} else if (threadData != NULL) {
+			TPJobInit(&job, (start_routine)send_search_result,
+				  threadData);
+			TPJobSetPriority(&job, MED_PRIORITY);
+			TPJobSetFreeFunction(&job, (free_routine)free);
+			if (ThreadPoolAdd(&gRecvThreadPool, &job, NULL) != 0)
+				free(threadData);
 		}
-
-		HandleUnlock();
 		/*ctrlpt_callback( UPNP_DISCOVERY_SEARCH_RESULT, &param, cookie ); */
 	}
 }
@@ -450,84 +1088,330 @@ static int CreateClientRequestPacketUlaGua(
 #endif /* UPNP_ENABLE_IPV6 */
 
 /*!
- * \brief
+ * \brief Timer job removing a search from the index when its time is up,
+ * and calling the control point back if it was still there.
  */
 static void searchExpired(
-	/* [in] . */
+	/* [in] SsdpSearchArg. */
 	void *arg)
 {
-
-	int *id = (int *)arg;
+	SsdpSearchArg *item = (SsdpSearchArg *)arg;
 	int handle = -1;
 	struct Handle_Info *ctrlpt_info = NULL;
+	Upnp_FunPtr ctrlpt_callback = NULL;
 
-	/* remove search Target from list and call client back */
-	ListNode *node = NULL;
-	SsdpSearchArg *item;
-	Upnp_FunPtr ctrlpt_callback;
-	void *cookie = NULL;
-	int found = 0;
+	HandleReadLock();
+	if (GetClientHandleInfo(&handle, &ctrlpt_info) == HND_CLIENT)
+		ctrlpt_callback = ctrlpt_info->Callback;
+	/* under the handle lock, so that the search is not dropped by an
+	 * unregistration after the callback was read */
+	if (!unindex_search(item))
+		ctrlpt_callback = NULL;
+	HandleUnlock();
+	if (ctrlpt_callback)
+		ctrlpt_callback(UPNP_DISCOVERY_SEARCH_TIMEOUT, NULL,
+				item->cookie);
+	free_search(item);
+}
 
-	HandleLock();
+/*!
+ * \brief M-SEARCH requests being sent for a search target. The searches of
+ * the same target started while it is being sent share it.
+ */
+typedef struct s_SsdpSearchTx {
+	/*! Search target. */
+	char *searchTarget;
+	/*! MX of the requests. */
+	int mx;
+	/*! Number of copies of the requests sent so far. */
+	int sent;
+	/*! Time the next copy is due, in ms. */
+	int64_t due;
+	/*! IPv4 request. */
+	char reqBufv4[BUFSIZE];
+#ifdef UPNP_ENABLE_IPV6
+	/*! IPv6 link-local request. */
+	char reqBufv6[BUFSIZE];
+	/*! IPv6 site-local request. */
+	char reqBufv6UlaGua[BUFSIZE];
+#endif /* UPNP_ENABLE_IPV6 */
+	/*! Next transmission in gSsdpSearchTxList. */
+	struct s_SsdpSearchTx *next;
+} SsdpSearchTx;
 
-	/* remove search target from search list */
-	if (GetClientHandleInfo(&handle, &ctrlpt_info) != HND_CLIENT) {
-		free(id);
-		HandleUnlock();
-		return;
-	}
-	ctrlpt_callback = ctrlpt_info->Callback;
-	node = ListHead(&ctrlpt_info->SsdpSearchList);
-	while (node != NULL) {
-		item = (SsdpSearchArg *) node->item;
-		if (item->timeoutEventId == (*id)) {
-			free(item->searchTarget);
-			cookie = item->cookie;
-			found = 1;
-			item->searchTarget = NULL;
-			free(item);
-			ListDelNode(&ctrlpt_info->SsdpSearchList, node, 0);
-			break;
-		}
-		node = ListNext(&ctrlpt_info->SsdpSearchList, node);
-	}
-	HandleUnlock();
+/*!
+ * \brief Protects the transmissions below. The timer thread calls the free
+ * function of a dropped job with its own mutex held, so this one is never
+ * held while calling into the timer thread.
+ */
+static ithread_mutex_t gSsdpSearchTxMutex;
+/*! Transmissions in progress. */
+static SsdpSearchTx *gSsdpSearchTxList = NULL;
+/*! Number of SsdpSearchTxThread() jobs scheduled and not finished. */
+static int gSsdpSearchTxJobs = 0;
+/*! TRUE while a job scheduled for new transmissions has not started. */
+static int gSsdpSearchTxKick = FALSE;
+/*! Argument of the jobs scheduled for new transmissions. */
+static int gSsdpSearchTxKickArg;
+/*! Argument of the jobs scheduled for retransmissions. */
+static int gSsdpSearchTxTickArg;
 
-	if (found)
-		ctrlpt_callback(UPNP_DISCOVERY_SEARCH_TIMEOUT, NULL, cookie);
+/*!
+ * \brief Frees a transmission.
+ */
+static void free_search_tx(
+	/*! [in] Transmission. */
+	SsdpSearchTx *tx)
+{
+	free(tx->searchTarget);
+	free(tx);
+}
 
-	free(id);
+/*!
+ * \brief Accounts for a SsdpSearchTxThread() job dropped by the timer thread,
+ * at shutdown or when the thread pool is full. The transmissions left are
+ * sent by the job the next search schedules when no job is left, even if
+ * it joins one of them.
+ */
+static void drop_search_tx_job(
+	/*! [in] gSsdpSearchTxKickArg or gSsdpSearchTxTickArg. */
+	void *arg)
+{
+	ithread_mutex_lock(&gSsdpSearchTxMutex);
+	gSsdpSearchTxJobs--;
+	if (arg == &gSsdpSearchTxKickArg)
+		gSsdpSearchTxKick = FALSE;
+	ithread_mutex_unlock(&gSsdpSearchTxMutex);
 }
 
-int SearchByTarget(int Mx, char *St, void *Cookie)
+/*!
+ * \brief Sends one copy of the requests of a transmission.
+ */
+static void send_search_requests(
+	/*! [in] Transmission. */
+	SsdpSearchTx *tx)
 {
-	char errorBuffer[ERROR_BUFFER_LEN];
-	int *id = NULL;
-	int ret = 0;
-	char ReqBufv4[BUFSIZE];
-#ifdef UPNP_ENABLE_IPV6
-	char ReqBufv6[BUFSIZE];
-	char ReqBufv6UlaGua[BUFSIZE];
-#endif
 	struct sockaddr_storage __ss_v4;
-#ifdef UPNP_ENABLE_IPV6
-	struct sockaddr_storage __ss_v6;
-#endif
 	struct sockaddr_in *destAddr4 = (struct sockaddr_in *)&__ss_v4;
 #ifdef UPNP_ENABLE_IPV6
+	struct sockaddr_storage __ss_v6;
 	struct sockaddr_in6 *destAddr6 = (struct sockaddr_in6 *)&__ss_v6;
-#endif
-	fd_set wrSet;
+#endif /* UPNP_ENABLE_IPV6 */
+	unsigned long addrv4 = inet_addr(gIF_IPV4);
+
+#ifdef UPNP_ENABLE_IPV6
+	if (gSsdpReqSocket6 != INVALID_SOCKET) {
+		if (tx->sent == 0)
+			setsockopt(gSsdpReqSocket6, IPPROTO_IPV6,
+				IPV6_MULTICAST_IF, (char *)&gIF_INDEX,
+				sizeof(gIF_INDEX));
+		memset(&__ss_v6, 0, sizeof(__ss_v6));
+		destAddr6->sin6_family = (sa_family_t)AF_INET6;
+		inet_pton(AF_INET6, SSDP_IPV6_SITELOCAL, &destAddr6->sin6_addr);
+		destAddr6->sin6_port = htons(SSDP_PORT);
+		destAddr6->sin6_scope_id = gIF_INDEX;
+		UpnpPrintf(UPNP_INFO, SSDP, __FILE__, __LINE__,
+			   ">>> SSDP SEND M-SEARCH >>>\n%s\n",
+			   tx->reqBufv6UlaGua);
+		sendto(gSsdpReqSocket6, tx->reqBufv6UlaGua,
+		       strlen(tx->reqBufv6UlaGua), 0,
+		       (struct sockaddr *)&__ss_v6,
+		       sizeof(struct sockaddr_in6));
+		inet_pton(AF_INET6, SSDP_IPV6_LINKLOCAL, &destAddr6->sin6_addr);
+		UpnpPrintf(UPNP_INFO, SSDP, __FILE__, __LINE__,
+			   ">>> SSDP SEND M-SEARCH >>>\n%s\n",
+			   tx->reqBufv6);
+		sendto(gSsdpReqSocket6, tx->reqBufv6, strlen(tx->reqBufv6), 0,
+		       (struct sockaddr *)&__ss_v6,
+		       sizeof(struct sockaddr_in6));
+	}
+#endif /* UPNP_ENABLE_IPV6 */
+	if (gSsdpReqSocket4 != INVALID_SOCKET) {
+		if (tx->sent == 0)
+			setsockopt(gSsdpReqSocket4, IPPROTO_IP,
+				IP_MULTICAST_IF, (char *)&addrv4,
+				sizeof(addrv4));
+		memset(&__ss_v4, 0, sizeof(__ss_v4));
+		destAddr4->sin_family = (sa_family_t)AF_INET;
+		inet_pton(AF_INET, SSDP_IP, &destAddr4->sin_addr);
+		destAddr4->sin_port = htons(SSDP_PORT);
+		UpnpPrintf(UPNP_INFO, SSDP, __FILE__, __LINE__,
+			   ">>> SSDP SEND M-SEARCH >>>\n%s\n",
+			   tx->reqBufv4);
+		sendto(gSsdpReqSocket4, tx->reqBufv4, strlen(tx->reqBufv4), 0,
+		       (struct sockaddr *)&__ss_v4,
+		       sizeof(struct sockaddr_in));
+	}
+}
+
+static void SsdpSearchTxThread(void *arg);
+
+/*!
+ * \brief Schedules a SsdpSearchTxThread() job. gSsdpSearchTxJobs must have
+ * been incremented for it.
+ */
+static void schedule_search_tx(
+	/*! [in] gSsdpSearchTxKickArg or gSsdpSearchTxTickArg. */
+	int *arg,
+	/*! [in] Delay in ms. */
+	time_t delay)
+{
+	ThreadPoolJob job;
+
+	memset(&job, 0, sizeof(job));
+	TPJobInit(&job, (start_routine)SsdpSearchTxThread, arg);
+	TPJobSetFreeFunction(&job, (free_routine)drop_search_tx_job);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	if (TimerThreadSchedule(&gTimerThread, delay, REL_MSEC, &job,
+		SHORT_TERM, NULL) != 0)
+		drop_search_tx_job(arg);
+}
+
+/*!
+ * \brief Timer job sending the copies of the requests that are due, and
+ * scheduling itself again for the next ones.
+ *
+ * Every new transmission schedules a job unless one scheduled for an earlier
+ * one has not started yet, and a job scheduled for retransmissions is due
+ * before the copies sent by the jobs running after it was scheduled, so
+ * only the last job needs to schedule the next one.
+ */
+static void SsdpSearchTxThread(
+	/*! [in] gSsdpSearchTxKickArg or gSsdpSearchTxTickArg. */
+	void *arg)
+{
+	SsdpSearchTx **prev;
+	SsdpSearchTx *tx;
+	SsdpSearchTx *done = NULL;
+	int64_t now;
+	int64_t next = 0;
+	int reschedule = FALSE;
+
+	ithread_mutex_lock(&gSsdpSearchTxMutex);
+	if (arg == &gSsdpSearchTxKickArg)
+		gSsdpSearchTxKick = FALSE;
+	now = imillinow();
+	prev = &gSsdpSearchTxList;
+	while ((tx = *prev) != NULL) {
+		if (tx->due <= now) {
+			/* UDP sends do not block for long */
+			send_search_requests(tx);
+			tx->sent++;
+			tx->due = now + SSDP_PAUSE;
+		}
+		if (tx->sent >= NUM_SSDP_COPY) {
+			/* later searches of this target start a new one */
+			*prev = tx->next;
+			tx->next = done;
+			done = tx;
+			continue;
+		}
+		if (next == 0 || tx->due < next)
+			next = tx->due;
+		prev = &tx->next;
+	}
+	if (gSsdpSearchTxJobs == 1 && next != 0)
+		/* this job stays accounted for in the next one */
+		reschedule = TRUE;
+	else
+		gSsdpSearchTxJobs--;
+	ithread_mutex_unlock(&gSsdpSearchTxMutex);
+	if (reschedule)
+		schedule_search_tx(&gSsdpSearchTxTickArg,
+			(time_t)(next > now ? next - now : 0));
+	while (done) {
+		tx = done;
+		done = tx->next;
+		free_search_tx(tx);
+	}
+}
+
+/*!
+ * \brief Creates the transmission of the requests of a search.
+ *
+ * \return The transmission or NULL, in which case retVal is set.
+ */
+static SsdpSearchTx *new_search_tx(
+	/*! [in] MX of the requests. */
+	int Mx,
+	/*! [in] Search target. */
+	char *St,
+	/*! [out] Error code. */
+	int *retVal)
+{
+	SsdpSearchTx *tx;
+
+	tx = (SsdpSearchTx *)malloc(sizeof(SsdpSearchTx));
+	if (!tx) {
+		*retVal = UPNP_E_OUTOF_MEMORY;
+		return NULL;
+	}
+	tx->searchTarget = strdup(St);
+	tx->mx = Mx;
+	tx->sent = 0;
+	tx->due = 0;
+	tx->next = NULL;
+	if (!tx->searchTarget) {
+		*retVal = UPNP_E_OUTOF_MEMORY;
+		goto error_handler;
+	}
+	*retVal = CreateClientRequestPacket(tx->reqBufv4,
+		sizeof(tx->reqBufv4), Mx, St, AF_INET);
+	if (*retVal != UPNP_E_SUCCESS)
+		goto error_handler;
+#ifdef UPNP_ENABLE_IPV6
+	*retVal = CreateClientRequestPacket(tx->reqBufv6,
+		sizeof(tx->reqBufv6), Mx, St, AF_INET6);
+	if (*retVal != UPNP_E_SUCCESS)
+		goto error_handler;
+	*retVal = CreateClientRequestPacketUlaGua(tx->reqBufv6UlaGua,
+		sizeof(tx->reqBufv6UlaGua), Mx, St, AF_INET6);
+	if (*retVal != UPNP_E_SUCCESS)
+		goto error_handler;
+#endif /* UPNP_ENABLE_IPV6 */
+
+	return tx;
+
+error_handler:
+	free_search_tx(tx);
+
+	return NULL;
+}
+
+int initSSDPSearchTx(void)
+{
+	if (ithread_mutex_init(&gSsdpSearchTxMutex, NULL) != 0)
+		return UPNP_E_INIT_FAILED;
+	gSsdpSearchTxList = NULL;
+	gSsdpSearchTxJobs = 0;
+	gSsdpSearchTxKick = FALSE;
+
+	return UPNP_E_SUCCESS;
+}
+
+void destroySSDPSearchTx(void)
+{
+	SsdpSearchTx *tx;
+
+	while (gSsdpSearchTxList) {
+		tx = gSsdpSearchTxList;
+		gSsdpSearchTxList = tx->next;
+		free_search_tx(tx);
+	}
+	ithread_mutex_destroy(&gSsdpSearchTxMutex);
+}
+
+int SearchByTarget(int Mx, char *St, void *Cookie)
+{
 	SsdpSearchArg *newArg = NULL;
+	SsdpSearchTx *tx;
+	SsdpSearchTx *newTx;
 	int timeTillRead = 0;
 	int handle;
 	struct Handle_Info *ctrlpt_info = NULL;
 	enum SsdpSearchType requestType;
-	unsigned long addrv4 = inet_addr(gIF_IPV4);
-	SOCKET max_fd = 0;
 	int retVal;
-
-	/*ThreadData *ThData; */
+	int kick = FALSE;
 	ThreadPoolJob job;
 
 	memset(&job, 0, sizeof(job));
@@ -542,128 +1426,84 @@ int SearchByTarget(int Mx, char *St, void *Cookie)
 		timeTillRead = MIN_SEARCH_TIME;
 	else if (timeTillRead > MAX_SEARCH_TIME)
 		timeTillRead = MAX_SEARCH_TIME;
-	retVal = CreateClientRequestPacket(ReqBufv4, sizeof(ReqBufv4), timeTillRead, St, AF_INET);
-	if (retVal != UPNP_E_SUCCESS)
-		return retVal;
-#ifdef UPNP_ENABLE_IPV6
-	retVal = CreateClientRequestPacket(ReqBufv6, sizeof(ReqBufv6), timeTillRead, St, AF_INET6);
-	if (retVal != UPNP_E_SUCCESS)
-		return retVal;
-	retVal = CreateClientRequestPacketUlaGua(ReqBufv6UlaGua, sizeof(ReqBufv6UlaGua), timeTillRead, St, AF_INET6);
-	if (retVal != UPNP_E_SUCCESS)
+	/* the replies to this search are not duplicates of earlier ones */
+	ithread_mutex_lock(&gSsdpDedupMutex);
+	gSsdpSearchEpoch++;
+	ithread_mutex_unlock(&gSsdpDedupMutex);
+	/* built before locking, dropped if the search joins a transmission */
+	newTx = new_search_tx(timeTillRead, St, &retVal);
+	if (!newTx)
 		return retVal;
-#endif
-
-	memset(&__ss_v4, 0, sizeof(__ss_v4));
-	destAddr4->sin_family = (sa_family_t)AF_INET;
-	inet_pton(AF_INET, SSDP_IP, &destAddr4->sin_addr);
-	destAddr4->sin_port = htons(SSDP_PORT);
+	newArg = (SsdpSearchArg *)malloc(sizeof(SsdpSearchArg));
+	if (!newArg || !(newArg->searchTarget = strdup(St))) {
+		free(newArg);
+		free_search_tx(newTx);
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	newArg->cookie = Cookie;
+	newArg->requestType = requestType;
+	newArg->indexed = FALSE;
+	newArg->next = NULL;
 
-#ifdef UPNP_ENABLE_IPV6
-	memset(&__ss_v6, 0, sizeof(__ss_v6));
-	destAddr6->sin6_family = (sa_family_t)AF_INET6;
-	inet_pton(AF_INET6, SSDP_IPV6_SITELOCAL, &destAddr6->sin6_addr);
-	destAddr6->sin6_port = htons(SSDP_PORT);
-	destAddr6->sin6_scope_id = gIF_INDEX;
-#endif
-
-	/* add search criteria to list */
-	HandleLock();
+	/* add search criteria to the index, under the handle lock so that
+	 * an unregistration clears it */
+	HandleReadLock();
 	if (GetClientHandleInfo(&handle, &ctrlpt_info) != HND_CLIENT) {
 		HandleUnlock();
+		free_search(newArg);
+		free_search_tx(newTx);
 		return UPNP_E_INTERNAL_ERROR;
 	}
-	newArg = (SsdpSearchArg *) malloc(sizeof(SsdpSearchArg));
-	newArg->searchTarget = strdup(St);
-	newArg->cookie = Cookie;
-	newArg->requestType = requestType;
-	id = (int *)malloc(sizeof(int));
-	TPJobInit(&job, (start_routine) searchExpired, id);
-	TPJobSetPriority(&job, MED_PRIORITY);
-	TPJobSetFreeFunction(&job, (free_routine) free);
-	/* Schedule a timeout event to remove search Arg */
-	TimerThreadSchedule(&gTimerThread, timeTillRead,
-			    REL_SEC, &job, SHORT_TERM, id);
-	newArg->timeoutEventId = *id;
-	ListAddTail(&ctrlpt_info->SsdpSearchList, newArg);
+	retVal = index_search(newArg);
 	HandleUnlock();
 	/* End of lock */
-
-	FD_ZERO(&wrSet);
-	if (gSsdpReqSocket4 != INVALID_SOCKET) {
-		setsockopt(gSsdpReqSocket4, IPPROTO_IP, IP_MULTICAST_IF,
-			   (char *)&addrv4, sizeof(addrv4));
-		FD_SET(gSsdpReqSocket4, &wrSet);
-		max_fd = max(max_fd, gSsdpReqSocket4);
+	if (retVal != UPNP_E_SUCCESS) {
+		free_search(newArg);
+		free_search_tx(newTx);
+		return retVal;
 	}
-#ifdef UPNP_ENABLE_IPV6
-	if (gSsdpReqSocket6 != INVALID_SOCKET) {
-		setsockopt(gSsdpReqSocket6, IPPROTO_IPV6, IPV6_MULTICAST_IF,
-			   (char *)&gIF_INDEX, sizeof(gIF_INDEX));
-		FD_SET(gSsdpReqSocket6, &wrSet);
-		max_fd = max(max_fd, gSsdpReqSocket6);
-	}
-#endif
-	ret = select(max_fd + 1, NULL, &wrSet, NULL, NULL);
-	if (ret == -1) {
-		strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
-		UpnpPrintf(UPNP_INFO, SSDP, __FILE__, __LINE__,
-			   "SSDP_LIB: Error in select(): %s\n", errorBuffer);
-		UpnpCloseSocket(gSsdpReqSocket4);
-#ifdef UPNP_ENABLE_IPV6
-		UpnpCloseSocket(gSsdpReqSocket6);
-#endif
+	/* Schedule a timeout event to remove search Arg, which then owns it */
+	TPJobInit(&job, (start_routine) searchExpired, newArg);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	TPJobSetFreeFunction(&job, (free_routine) drop_search);
+	if (TimerThreadSchedule(&gTimerThread, timeTillRead,
+			    REL_SEC, &job, SHORT_TERM, NULL) != 0) {
+		drop_search(newArg);
+		free_search_tx(newTx);
 		return UPNP_E_INTERNAL_ERROR;
 	}
-#ifdef UPNP_ENABLE_IPV6
-	if (gSsdpReqSocket6 != INVALID_SOCKET &&
-	    FD_ISSET(gSsdpReqSocket6, &wrSet)) {
-		int NumCopy = 0;
-
-		while (NumCopy < NUM_SSDP_COPY) {
-			UpnpPrintf(UPNP_INFO, SSDP, __FILE__, __LINE__,
-				   ">>> SSDP SEND M-SEARCH >>>\n%s\n",
-				   ReqBufv6UlaGua);
-			sendto(gSsdpReqSocket6,
-			       ReqBufv6UlaGua, strlen(ReqBufv6UlaGua), 0,
-			       (struct sockaddr *)&__ss_v6,
-			       sizeof(struct sockaddr_in6));
-			NumCopy++;
-			imillisleep(SSDP_PAUSE);
-		}
-		NumCopy = 0;
-		inet_pton(AF_INET6, SSDP_IPV6_LINKLOCAL, &destAddr6->sin6_addr);
-		while (NumCopy < NUM_SSDP_COPY) {
-			UpnpPrintf(UPNP_INFO, SSDP, __FILE__, __LINE__,
-				   ">>> SSDP SEND M-SEARCH >>>\n%s\n",
-				   ReqBufv6);
-			sendto(gSsdpReqSocket6,
-			       ReqBufv6, strlen(ReqBufv6), 0,
-			       (struct sockaddr *)&__ss_v6,
-			       sizeof(struct sockaddr_in6));
-			NumCopy++;
-			imillisleep(SSDP_PAUSE);
-		}
+
+	/* the replies are matched against every search of the index, and the
+	 * devices answer each copy of the request, so a search of the same
+	 * target joins a transmission still being sent, unless it would time
+	 * out before the devices answer */
+	ithread_mutex_lock(&gSsdpSearchTxMutex);
+	for (tx = gSsdpSearchTxList; tx; tx = tx->next)
+		if (tx->mx <= timeTillRead &&
+		    strcmp(tx->searchTarget, St) == 0)
+			break;
+	if (!tx) {
+		newTx->due = imillinow();
+		newTx->next = gSsdpSearchTxList;
+		gSsdpSearchTxList = newTx;
+		newTx = NULL;
 	}
-#endif /* IPv6 */
-	if (gSsdpReqSocket4 != INVALID_SOCKET &&
-	    FD_ISSET(gSsdpReqSocket4, &wrSet)) {
-		int NumCopy = 0;
-		while (NumCopy < NUM_SSDP_COPY) {
-			UpnpPrintf(UPNP_INFO, SSDP, __FILE__, __LINE__,
-				   ">>> SSDP SEND M-SEARCH >>>\n%s\n",
-				   ReqBufv4);
-			sendto(gSsdpReqSocket4,
-			       ReqBufv4, strlen(ReqBufv4), 0,
-			       (struct sockaddr *)&__ss_v4,
-			       sizeof(struct sockaddr_in));
-			NumCopy++;
-			imillisleep(SSDP_PAUSE);
-		}
+	/* a transmission that was joined may have been left without a job
+	 * when the timer thread dropped the last one */
+	if (!gSsdpSearchTxKick && (!tx || gSsdpSearchTxJobs == 0)) {
+		gSsdpSearchTxKick = TRUE;
+		gSsdpSearchTxJobs++;
+		kick = TRUE;
 	}
+	ithread_mutex_unlock(&gSsdpSearchTxMutex);
+	if (newTx)
+		free_search_tx(newTx);
+	if (kick)
+		schedule_search_tx(&gSsdpSearchTxKickArg, 0);
 
 	return 1;
 }
+
 #endif /* EXCLUDE_SSDP */
 #endif /* INCLUDE_CLIENT_APIS */
 
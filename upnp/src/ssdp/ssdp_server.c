@@ -38,6 +38,8 @@
  * \file
  */
 
+#define _GNU_SOURCE	/* For recvmmsg() in sys/socket.h */
+
 #ifndef WIN32
 	#include <sys/param.h>
 #else
@@ -58,10 +60,97 @@
 #include "ThreadPool.h"
 #include "upnpapi.h"
 
+#include <ctype.h>
+#include <errno.h>
 #include <stdio.h>
 
 #define MAX_TIME_TOREAD  45
 
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+	/* recvmmsg() is available (Linux 2.6.33, glibc 2.12). */
+	#define SSDP_HAVE_RECVMMSG 1
+#endif
+
+struct ssdp_recv_batch;
+
+/*!
+ * \brief One slot of the SSDP receive ring.
+ */
+typedef struct ssdp_recv_slot
+{
+	/*! Received datagram, null-terminated. */
+	char buf[BUFSIZE];
+	/*! Length of the datagram. */
+	size_t length;
+	/*! Address of the sender. */
+	struct sockaddr_storage dest_addr;
+	/*! Batch of the slot. */
+	struct ssdp_recv_batch *batch;
+	/*! TRUE if the datagram is queued in a discovery lane rather than
+	 * handled by the job of its batch. */
+	int laned;
+	/*! Next datagram of the discovery lane. */
+	struct ssdp_recv_slot *next;
+} ssdp_recv_slot;
+
+/*!
+ * \brief Datagrams received with one system call and handled by one job.
+ */
+typedef struct ssdp_recv_batch
+{
+	/*! Next free batch. */
+	struct ssdp_recv_batch *next;
+	/*! TRUE if the datagrams were received on a M-SEARCH socket. */
+	int isResponse;
+	/*! Number of slots in use. */
+	int count;
+	/*! Number of holders of the batch: the reading thread, the job of the
+	 * batch and the slots queued in discovery lanes. Protected by
+	 * gSsdpRecvRingMutex. */
+	int pending;
+	/*! Slots. */
+	ssdp_recv_slot slots[SSDP_RECV_BATCH_SIZE];
+} ssdp_recv_batch;
+
+/*! Receive ring, preallocated by initSSDPRecvRing(). */
+static ssdp_recv_batch *gSsdpRecvRing = NULL;
+/*! Batches of the ring that are neither queued nor being handled. */
+static ssdp_recv_batch *gSsdpRecvFreeBatches = NULL;
+/*! Protects gSsdpRecvFreeBatches, the pending counts of the batches and
+ * gSsdpLaneCount. */
+static ithread_mutex_t gSsdpRecvRingMutex;
+
+#ifdef INCLUDE_CLIENT_APIS
+/*!
+ * \brief Discovery lane: the advertisements and search replies of the
+ * devices hashed to it, handled in the order they were received by one
+ * job at a time.
+ */
+typedef struct
+{
+	/*! Protects the other fields. */
+	ithread_mutex_t mutex;
+	/*! First queued datagram. */
+	ssdp_recv_slot *head;
+	/*! Last queued datagram. */
+	ssdp_recv_slot *tail;
+	/*! Number of queued datagrams. */
+	int depth;
+	/*! Largest depth since the lanes were set. */
+	int maxDepth;
+	/*! Datagrams handled since the lanes were set. */
+	unsigned long handled;
+	/*! TRUE while a job handles the lane. */
+	int scheduled;
+} ssdp_lane;
+
+/*! Discovery lanes, see UpnpSetDiscoveryLanes(). */
+static ssdp_lane gSsdpLanes[UPNP_DISCOVERY_LANES_MAX];
+/*! Number of discovery lanes in use, 0 to handle the datagrams with the
+ * job of their batch. */
+static int gSsdpLaneCount = 0;
+#endif /* INCLUDE_CLIENT_APIS */
+
 #ifdef INCLUDE_CLIENT_APIS
 	SOCKET gSsdpReqSocket4 = INVALID_SOCKET;
 	#ifdef UPNP_ENABLE_IPV6
@@ -533,15 +622,49 @@ int unique_service_name(char *cmd, SsdpEvent *Evt)
 
 enum SsdpSearchType ssdp_request_type1(char *cmd)
 {
-	if (strstr(cmd, ":all"))
+	/* Every pattern contains a colon: look for all of them at once,
+	 * hopping from colon to colon, then apply the precedence the
+	 * patterns have always had. */
+	int all = FALSE;
+	int rootdevice = FALSE;
+	int uuid = FALSE;
+	int urn = FALSE;
+	int device = FALSE;
+	int service = FALSE;
+	char *colon;
+
+	for (colon = strchr(cmd, ':'); colon; colon = strchr(colon + 1, ':')) {
+		switch (colon[1]) {
+		case 'a':
+			all = all || strncmp(colon, ":all", 4) == 0;
+			break;
+		case 'r':
+			rootdevice = rootdevice ||
+				strncmp(colon, ":rootdevice", 11) == 0;
+			break;
+		case 'd':
+			device = device || strncmp(colon, ":device:", 8) == 0;
+			break;
+		case 's':
+			service = service || strncmp(colon, ":service:", 9) == 0;
+			break;
+		default:
+			break;
+		}
+		if (colon - cmd >= 4 && strncmp(colon - 4, "uuid", 4) == 0)
+			uuid = TRUE;
+		if (colon - cmd >= 3 && strncmp(colon - 3, "urn", 3) == 0)
+			urn = TRUE;
+	}
+	if (all)
 		return SSDP_ALL;
-	if (strstr(cmd, ":rootdevice"))
+	if (rootdevice)
 		return SSDP_ROOTDEVICE;
-	if (strstr(cmd, "uuid:"))
+	if (uuid)
 		return SSDP_DEVICEUDN;
-	if (strstr(cmd, "urn:") && strstr(cmd, ":device:"))
+	if (urn && device)
 		return SSDP_DEVICETYPE;
-	if (strstr(cmd, "urn:") && strstr(cmd, ":service:"))
+	if (urn && service)
 		return SSDP_SERVICE;
 	return SSDP_SERROR;
 }
@@ -559,24 +682,6 @@ int ssdp_request_type(char *cmd, SsdpEvent *Evt)
 	return 0;
 }
 
-/*!
- * \brief Frees the ssdp request.
- */
-static void free_ssdp_event_handler_data(
-	/*! [in] ssdp_thread_data structure. This structure contains SSDP
-	 * request message. */
-	void *the_data)
-{
-	ssdp_thread_data *data = (ssdp_thread_data *) the_data;
-
-	if (data != NULL) {
-		http_message_t *hmsg = &data->parser.msg;
-		/* free data */
-		httpmsg_destroy(hmsg);
-		free(data);
-	}
-}
-
 /*!
  * \brief Does some quick checking of the ssdp msg.
  *
@@ -621,21 +726,18 @@ static UPNP_INLINE int valid_ssdp_msg(
 }
 
 /*!
- * \brief Parses the message and dispatches it to a handler which handles the
- * ssdp request msg.
+ * \brief Parses the message and checks that it is a valid ssdp request.
  *
  * \return 0 if successful, -1 if error.
  */
 static UPNP_INLINE int start_event_handler(
 	/*! [in] ssdp_thread_data structure. This structure contains SSDP
 	 * request message. */
-	void *Data)
+	ssdp_thread_data *data)
 {
-	http_parser_t *parser = NULL;
+	http_parser_t *parser = &data->parser;
 	parse_status_t status;
-	ssdp_thread_data *data = (ssdp_thread_data *) Data;
 
-	parser = &data->parser;
 	status = parser_parse(parser);
 	if (status == (parse_status_t)PARSE_FAILURE) {
 		if (parser->msg.method != (http_method_t)HTTPMETHOD_NOTIFY ||
@@ -643,140 +745,551 @@ static UPNP_INLINE int start_event_handler(
 			UpnpPrintf(UPNP_INFO, SSDP, __FILE__, __LINE__,
 				   "SSDP recvd bad msg code = %d\n", status);
 			/* ignore bad msg, or not enuf mem */
-			goto error_handler;
+			return -1;
 		}
 		/* valid notify msg */
 	} else if (status != (parse_status_t)PARSE_SUCCESS) {
 		UpnpPrintf(UPNP_INFO, SSDP, __FILE__, __LINE__,
 			   "SSDP recvd bad msg code = %d\n", status);
-
-		goto error_handler;
+		return -1;
 	}
 	/* check msg */
-	if (valid_ssdp_msg(&parser->msg) != TRUE) {
-		goto error_handler;
-	}
-	/* done; thread will free 'data' */
-	return 0;
+	if (valid_ssdp_msg(&parser->msg) != TRUE)
+		return -1;
 
- error_handler:
-	free_ssdp_event_handler_data(data);
-	return -1;
+	return 0;
 }
 
 /*!
- * \brief This function is a thread that handles SSDP requests.
+ * \brief Parses one received datagram and dispatches it to the device or
+ * control point handler.
  */
-static void ssdp_event_handler_thread(
-	/*! [] ssdp_thread_data structure. This structure contains SSDP
-	 * request message. */
-	void *the_data)
+static void ssdp_handle_datagram(
+	/*! [in] Datagram to handle. */
+	ssdp_recv_slot *slot,
+	/*! [in] TRUE if the datagram was received on a M-SEARCH socket. */
+	int isResponse)
 {
-	ssdp_thread_data *data = (ssdp_thread_data *) the_data;
-	http_message_t *hmsg = &data->parser.msg;
-
-	if (start_event_handler(the_data) != 0)
-		return;
-	/* send msg to device or ctrlpt */
-	if (hmsg->method == (http_method_t)HTTPMETHOD_NOTIFY ||
-	    hmsg->request_method == (http_method_t)HTTPMETHOD_MSEARCH) {
+	ssdp_thread_data data;
+	http_message_t *hmsg = &data.parser.msg;
+	membuffer *msg = &data.parser.msg.msg;
+
+#ifdef INCLUDE_CLIENT_APIS
+	if (isResponse)
+		parser_response_init(&data.parser, HTTPMETHOD_MSEARCH);
+	else
+		parser_request_init(&data.parser);
+#else /* INCLUDE_CLIENT_APIS */
+	parser_request_init(&data.parser);
+#endif /* INCLUDE_CLIENT_APIS */
+	/* parse in place from the ring slot; the size increment keeps
+	 * membuffer_delete() from ever reallocating it. */
+	membuffer_attach(msg, slot->buf, slot->length);
+	msg->size_inc = BUFSIZE;
+	memcpy(&data.dest_addr, &slot->dest_addr, sizeof(data.dest_addr));
+	if (start_event_handler(&data) == 0) {
+		/* send msg to device or ctrlpt */
+		if (hmsg->method == (http_method_t)HTTPMETHOD_NOTIFY ||
+		    hmsg->request_method == (http_method_t)HTTPMETHOD_MSEARCH) {
 #ifdef INCLUDE_CLIENT_APIS
-		ssdp_handle_ctrlpt_msg(hmsg,
-				       &data->dest_addr,
-				       FALSE, NULL);
+			ssdp_handle_ctrlpt_msg(hmsg, &data.dest_addr,
+					       FALSE, NULL);
 #endif /* INCLUDE_CLIENT_APIS */
-	} else {
-		ssdp_handle_device_request(hmsg,
-					   &data->dest_addr);
+		} else {
+			ssdp_handle_device_request(hmsg, &data.dest_addr);
+		}
+	}
+	/* the slot belongs to the ring */
+	membuffer_detach(msg);
+	httpmsg_destroy(hmsg);
+}
+
+/*!
+ * \brief Releases a hold on a batch of the receive ring, and returns it to
+ * the free list when it was the last one.
+ */
+static void put_recv_batch(
+	/*! [in] ssdp_recv_batch structure. */
+	void *the_batch)
+{
+	ssdp_recv_batch *batch = (ssdp_recv_batch *)the_batch;
+
+	ithread_mutex_lock(&gSsdpRecvRingMutex);
+	if (--batch->pending == 0) {
+		batch->count = 0;
+		batch->next = gSsdpRecvFreeBatches;
+		gSsdpRecvFreeBatches = batch;
 	}
+	ithread_mutex_unlock(&gSsdpRecvRingMutex);
+}
 
-	/* free data */
-	free_ssdp_event_handler_data(data);
+/*!
+ * \brief Adds a hold on a batch of the receive ring.
+ */
+static void hold_recv_batch(
+	/*! [in] ssdp_recv_batch structure. */
+	ssdp_recv_batch *batch)
+{
+	ithread_mutex_lock(&gSsdpRecvRingMutex);
+	batch->pending++;
+	ithread_mutex_unlock(&gSsdpRecvRingMutex);
 }
 
-void readFromSSDPSocket(SOCKET socket)
+/*!
+ * \brief Takes a batch from the free list of the receive ring.
+ *
+ * \return The batch, or NULL if all the batches are queued or being handled.
+ */
+static ssdp_recv_batch *get_recv_batch(void)
 {
-	char *requestBuf = NULL;
-	char staticBuf[BUFSIZE];
-	struct sockaddr_storage __ss;
+	ssdp_recv_batch *batch;
+
+	ithread_mutex_lock(&gSsdpRecvRingMutex);
+	batch = gSsdpRecvFreeBatches;
+	if (batch != NULL) {
+		gSsdpRecvFreeBatches = batch->next;
+		/* held by the reading thread */
+		batch->pending = 1;
+	}
+	ithread_mutex_unlock(&gSsdpRecvRingMutex);
+
+	return batch;
+}
+
+#ifdef INCLUDE_CLIENT_APIS
+/*!
+ * \brief Hashes the UDN of the USN header of a raw datagram, so that the
+ * messages of a device go to the same discovery lane.
+ *
+ * \return The hash, 0 if the datagram has no USN.
+ */
+static unsigned int lane_hash(
+	/*! [in] Datagram, null-terminated. */
+	const char *buf,
+	/*! [in] Length of the datagram. */
+	size_t length)
+{
+	const char *end = buf + length;
+	const char *line;
+	const char *eol;
+	const char *value;
+	/* FNV-1a */
+	unsigned int hash = 2166136261U;
+
+	line = memchr(buf, '\n', length);
+	while (line != NULL && ++line < end) {
+		eol = memchr(line, '\n', (size_t)(end - line));
+		if (eol == NULL)
+			eol = end;
+		if (eol - line > 4 && strncasecmp(line, "USN:", (size_t)4) == 0) {
+			value = line + 4;
+			while (value < eol && (*value == ' ' || *value == '\t'))
+				value++;
+			/* the UDN ends at the "::" before the type */
+			while (value < eol && *value != '\r' && *value != ' ' &&
+			       !(*value == ':' && value + 1 < eol &&
+				 value[1] == ':')) {
+				hash ^= (unsigned char)tolower(*value);
+				hash *= 16777619U;
+				value++;
+			}
+			return hash;
+		}
+		line = eol < end ? eol : NULL;
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Takes the datagrams out of a lane, dropping them. Used as the free
+ * function of the lane jobs, when they cannot run.
+ */
+static void drop_lane(
+	/*! [in] ssdp_lane structure. */
+	void *the_lane)
+{
+	ssdp_lane *lane = (ssdp_lane *)the_lane;
+	ssdp_recv_slot *slot;
+	ssdp_recv_slot *next;
+
+	ithread_mutex_lock(&lane->mutex);
+	slot = lane->head;
+	lane->head = NULL;
+	lane->tail = NULL;
+	lane->depth = 0;
+	lane->scheduled = FALSE;
+	ithread_mutex_unlock(&lane->mutex);
+	for (; slot != NULL; slot = next) {
+		next = slot->next;
+		put_recv_batch(slot->batch);
+	}
+}
+
+/*!
+ * \brief This function is a thread that handles the datagrams of a
+ * discovery lane in order, until the lane is empty.
+ */
+static void ssdp_lane_thread(
+	/*! [in] ssdp_lane structure. */
+	void *the_lane)
+{
+	ssdp_lane *lane = (ssdp_lane *)the_lane;
+	ssdp_recv_slot *slot;
+
+	for (;;) {
+		ithread_mutex_lock(&lane->mutex);
+		slot = lane->head;
+		if (slot == NULL) {
+			lane->scheduled = FALSE;
+			ithread_mutex_unlock(&lane->mutex);
+			return;
+		}
+		lane->head = slot->next;
+		if (lane->head == NULL)
+			lane->tail = NULL;
+		lane->depth--;
+		lane->handled++;
+		ithread_mutex_unlock(&lane->mutex);
+		ssdp_handle_datagram(slot, slot->batch->isResponse);
+		put_recv_batch(slot->batch);
+	}
+}
+
+/*!
+ * \brief Queues a datagram for the control point in the discovery lane of
+ * its device, and adds a job to handle the lane unless one is running.
+ */
+static void queue_lane_slot(
+	/*! [in] Datagram. */
+	ssdp_recv_slot *slot,
+	/*! [in] Number of lanes. */
+	int laneCount)
+{
+	ssdp_lane *lane;
 	ThreadPoolJob job;
-	ssdp_thread_data *data = NULL;
-	socklen_t socklen = sizeof(__ss);
-	ssize_t byteReceived = 0;
+	int schedule;
+
+	lane = &gSsdpLanes[lane_hash(slot->buf, slot->length) %
+			   (unsigned int)laneCount];
+	slot->laned = TRUE;
+	slot->next = NULL;
+	hold_recv_batch(slot->batch);
+	ithread_mutex_lock(&lane->mutex);
+	if (lane->tail != NULL)
+		lane->tail->next = slot;
+	else
+		lane->head = slot;
+	lane->tail = slot;
+	if (++lane->depth > lane->maxDepth)
+		lane->maxDepth = lane->depth;
+	schedule = !lane->scheduled;
+	lane->scheduled = TRUE;
+	ithread_mutex_unlock(&lane->mutex);
+	if (schedule) {
+		memset(&job, 0, sizeof(job));
+		TPJobInit(&job, (start_routine)ssdp_lane_thread, lane);
+		TPJobSetFreeFunction(&job, drop_lane);
+		TPJobSetPriority(&job, MED_PRIORITY);
+		/* the lane was empty, only this datagram is dropped */
+		if (ThreadPoolAdd(&gRecvThreadPool, &job, NULL) != 0)
+			drop_lane(lane);
+	}
+}
+
+int ssdp_set_lanes(int count)
+{
+	int i;
+
+	ithread_mutex_lock(&gSsdpRecvRingMutex);
+	gSsdpLaneCount = count;
+	ithread_mutex_unlock(&gSsdpRecvRingMutex);
+	for (i = 0; i < UPNP_DISCOVERY_LANES_MAX; i++) {
+		ithread_mutex_lock(&gSsdpLanes[i].mutex);
+		gSsdpLanes[i].maxDepth = gSsdpLanes[i].depth;
+		gSsdpLanes[i].handled = 0;
+		ithread_mutex_unlock(&gSsdpLanes[i].mutex);
+	}
+
+	return UPNP_E_SUCCESS;
+}
+
+int ssdp_lane_count(void)
+{
+	int count;
+
+	ithread_mutex_lock(&gSsdpRecvRingMutex);
+	count = gSsdpLaneCount;
+	ithread_mutex_unlock(&gSsdpRecvRingMutex);
+
+	return count;
+}
+
+int ssdp_get_lane_stats(struct Upnp_Discovery_Lane_Stats *stats, int size)
+{
+	int count = ssdp_lane_count();
+	int i;
+
+	for (i = 0; i < count && i < size; i++) {
+		ithread_mutex_lock(&gSsdpLanes[i].mutex);
+		stats[i].Depth = gSsdpLanes[i].depth;
+		stats[i].MaxDepth = gSsdpLanes[i].maxDepth;
+		stats[i].Handled = gSsdpLanes[i].handled;
+		ithread_mutex_unlock(&gSsdpLanes[i].mutex);
+	}
+
+	return count;
+}
+#endif /* INCLUDE_CLIENT_APIS */
+
+/*!
+ * \brief This function is a thread that handles a batch of SSDP requests.
+ */
+static void ssdp_event_handler_thread(
+	/*! [in] ssdp_recv_batch structure. This structure contains the
+	 * received SSDP messages. */
+	void *the_batch)
+{
+	ssdp_recv_batch *batch = (ssdp_recv_batch *)the_batch;
+	int i;
+
+	for (i = 0; i < batch->count; i++)
+		if (!batch->slots[i].laned)
+			ssdp_handle_datagram(&batch->slots[i],
+					     batch->isResponse);
+	put_recv_batch(batch);
+}
+
+/*!
+ * \brief Receives the pending datagrams of a socket into a batch.
+ *
+ * \return The number of datagrams received, 0 if none was available.
+ */
+static int recv_batch(
+	/*! [in] SSDP socket. */
+	SOCKET socket,
+	/*! [in,out] Batch receiving the datagrams. */
+	ssdp_recv_batch *batch)
+{
+#ifdef SSDP_HAVE_RECVMMSG
+	struct mmsghdr msgs[SSDP_RECV_BATCH_SIZE];
+	struct iovec iov[SSDP_RECV_BATCH_SIZE];
+	int i;
+	int n;
+
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < SSDP_RECV_BATCH_SIZE; i++) {
+		iov[i].iov_base = batch->slots[i].buf;
+		iov[i].iov_len = BUFSIZE - (size_t)1;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = &batch->slots[i].dest_addr;
+		msgs[i].msg_hdr.msg_namelen =
+			sizeof(batch->slots[i].dest_addr);
+	}
+	do {
+		n = recvmmsg(socket, msgs, SSDP_RECV_BATCH_SIZE,
+			     MSG_DONTWAIT, NULL);
+	} while (n < 0 && errno == EINTR);
+	if (n <= 0)
+		return 0;
+	for (i = 0; i < n; i++)
+		batch->slots[i].length = (size_t)msgs[i].msg_len;
+	return n;
+#else /* SSDP_HAVE_RECVMMSG */
+	ssdp_recv_slot *slot = &batch->slots[0];
+	socklen_t socklen = sizeof(slot->dest_addr);
+	ssize_t byteReceived;
+
+	byteReceived = recvfrom(socket, slot->buf, BUFSIZE - (size_t)1, 0,
+				(struct sockaddr *)&slot->dest_addr, &socklen);
+	if (byteReceived <= 0)
+		return 0;
+	slot->length = (size_t)byteReceived;
+	return 1;
+#endif /* SSDP_HAVE_RECVMMSG */
+}
+
+/*!
+ * \brief Prints a received datagram.
+ */
+static void print_datagram(
+	/*! [in] Received datagram. */
+	const char *buf,
+	/*! [in] Sender address. */
+	const struct sockaddr_storage *ss)
+{
 	char ntop_buf[INET6_ADDRSTRLEN];
 
-	memset(&job, 0, sizeof(job));
+	switch (ss->ss_family) {
+	case AF_INET:
+		inet_ntop(AF_INET,
+			  &((const struct sockaddr_in *)ss)->sin_addr,
+			  ntop_buf, sizeof(ntop_buf));
+		break;
+#ifdef UPNP_ENABLE_IPV6
+	case AF_INET6:
+		inet_ntop(AF_INET6,
+			  &((const struct sockaddr_in6 *)ss)->sin6_addr,
+			  ntop_buf, sizeof(ntop_buf));
+		break;
+#endif /* UPNP_ENABLE_IPV6 */
+	default:
+		memset(ntop_buf, 0, sizeof(ntop_buf));
+		strncpy(ntop_buf, "<Invalid address family>",
+			sizeof(ntop_buf) - 1);
+	}
+	UpnpPrintf(UPNP_INFO, SSDP, __FILE__, __LINE__,
+		   "Start of received response ----------------------------------------------------\n"
+		   "%s\n"
+		   "End of received response ------------------------------------------------------\n"
+		   "From host %s\n", buf, ntop_buf);
+}
 
-	requestBuf = staticBuf;
-	/* in case memory can't be allocated, still drain the socket using a
-	 * static buffer. */
-	data = malloc(sizeof(ssdp_thread_data));
-	if (data) {
-		/* initialize parser */
+int readFromSSDPSocket(SOCKET socket)
+{
+	char staticBuf[BUFSIZE];
+	struct sockaddr_storage __ss;
+	socklen_t socklen = sizeof(__ss);
+	ssize_t byteReceived;
+	ThreadPoolJob job;
+	ssdp_recv_batch *batch;
+	ssdp_recv_slot *slot;
+	ssdp_recv_slot *kept;
+	int count;
+	int batchSlots;
 #ifdef INCLUDE_CLIENT_APIS
-		if (socket == gSsdpReqSocket4
+	int laneCount;
+#endif /* INCLUDE_CLIENT_APIS */
+	int i;
+
+	batch = get_recv_batch();
+	if (batch == NULL) {
+		/* every batch is queued; still drain the socket using a
+		 * static buffer. */
+		byteReceived = recvfrom(socket, staticBuf,
+					BUFSIZE - (size_t)1, 0,
+					(struct sockaddr *)&__ss, &socklen);
+		if (byteReceived <= 0)
+			return -1;
+		staticBuf[byteReceived] = '\0';
+		print_datagram(staticBuf, &__ss);
+		UpnpPrintf(UPNP_INFO, SSDP, __FILE__, __LINE__,
+			   "SSDP receive ring full, datagram dropped\n");
+		return 0;
+	}
+	count = recv_batch(socket, batch);
+	if (count == 0) {
+		put_recv_batch(batch);
+		return -1;
+	}
+#ifdef INCLUDE_CLIENT_APIS
+	batch->isResponse = socket == gSsdpReqSocket4
 	#ifdef UPNP_ENABLE_IPV6
-		    || socket == gSsdpReqSocket6
+		|| socket == gSsdpReqSocket6
 	#endif /* UPNP_ENABLE_IPV6 */
-		    )
-			parser_response_init(&data->parser, HTTPMETHOD_MSEARCH);
-		else
-			parser_request_init(&data->parser);
+		;
 #else /* INCLUDE_CLIENT_APIS */
-		parser_request_init(&data->parser);
+	batch->isResponse = FALSE;
 #endif /* INCLUDE_CLIENT_APIS */
-		/* set size of parser buffer */
-		if (membuffer_set_size(&data->parser.msg.msg, BUFSIZE) == 0)
-			/* use this as the buffer for recv */
-			requestBuf = data->parser.msg.msg.buf;
-		else {
-			free(data);
-			data = NULL;
+	batch->count = 0;
+	for (i = 0; i < count; i++) {
+		slot = &batch->slots[i];
+		/* null-terminate */
+		slot->buf[slot->length] = '\0';
+#ifdef INCLUDE_CLIENT_APIS
+		/* drop the discovery messages the control point does not
+		 * want before they are parsed or queued */
+		if (!ssdp_filter_datagram(slot->buf, slot->length))
+			continue;
+#endif /* INCLUDE_CLIENT_APIS */
+		print_datagram(slot->buf, &slot->dest_addr);
+		if (batch->count != i) {
+			kept = &batch->slots[batch->count];
+			memcpy(kept->buf, slot->buf, slot->length + (size_t)1);
+			kept->length = slot->length;
+			memcpy(&kept->dest_addr, &slot->dest_addr,
+			       sizeof(kept->dest_addr));
 		}
+		batch->slots[batch->count].laned = FALSE;
+		batch->count++;
 	}
-	byteReceived = recvfrom(socket, requestBuf, BUFSIZE - (size_t)1, 0,
-				(struct sockaddr *)&__ss, &socklen);
-	if (byteReceived > 0) {
-		requestBuf[byteReceived] = '\0';
-		switch (__ss.ss_family) {
-		case AF_INET:
-			inet_ntop(AF_INET,
-				  &((struct sockaddr_in *)&__ss)->sin_addr,
-				  ntop_buf, sizeof(ntop_buf));
-			break;
-#ifdef UPNP_ENABLE_IPV6
-		case AF_INET6:
-			inet_ntop(AF_INET6,
-				  &((struct sockaddr_in6 *)&__ss)->sin6_addr,
-				  ntop_buf, sizeof(ntop_buf));
-			break;
-#endif /* UPNP_ENABLE_IPV6 */
-		default:
-			memset(ntop_buf, 0, sizeof(ntop_buf));
-			strncpy(ntop_buf, "<Invalid address family>",
-				sizeof(ntop_buf) - 1);
-		}
-		UpnpPrintf(UPNP_INFO, SSDP, __FILE__, __LINE__,
-			   "Start of received response ----------------------------------------------------\n"
-			   "%s\n"
-			   "End of received response ------------------------------------------------------\n"
-			   "From host %s\n", requestBuf, ntop_buf);
-		/* add thread pool job to handle request */
-		if (data != NULL) {
-			data->parser.msg.msg.length += (size_t) byteReceived;
-			/* null-terminate */
-			data->parser.msg.msg.buf[byteReceived] = 0;
-			memcpy(&data->dest_addr, &__ss, sizeof(__ss));
-			TPJobInit(&job, (start_routine)
-				  ssdp_event_handler_thread, data);
-			TPJobSetFreeFunction(&job,
-					     free_ssdp_event_handler_data);
-			TPJobSetPriority(&job, MED_PRIORITY);
-			if (ThreadPoolAdd(&gRecvThreadPool, &job, NULL) != 0)
-				free_ssdp_event_handler_data(data);
+	batchSlots = batch->count;
+#ifdef INCLUDE_CLIENT_APIS
+	/* the messages for the control point go to the lanes of their
+	 * devices, so that each device sees its callbacks in order */
+	laneCount = ssdp_lane_count();
+	for (i = 0; laneCount > 0 && i < batch->count; i++) {
+		slot = &batch->slots[i];
+		if (batch->isResponse ||
+		    strncmp(slot->buf, "NOTIFY", (size_t)6) == 0) {
+			queue_lane_slot(slot, laneCount);
+			batchSlots--;
 		}
-	} else
-		free_ssdp_event_handler_data(data);
+	}
+#endif /* INCLUDE_CLIENT_APIS */
+	if (batchSlots > 0) {
+		/* add one thread pool job to handle the rest of the batch */
+		hold_recv_batch(batch);
+		memset(&job, 0, sizeof(job));
+		TPJobInit(&job, (start_routine)ssdp_event_handler_thread,
+			  batch);
+		TPJobSetFreeFunction(&job, put_recv_batch);
+		TPJobSetPriority(&job, MED_PRIORITY);
+		if (ThreadPoolAdd(&gRecvThreadPool, &job, NULL) != 0)
+			put_recv_batch(batch);
+	}
+	/* the hold of the reading thread */
+	put_recv_batch(batch);
+
+	return 0;
+}
+
+int initSSDPRecvRing(void)
+{
+	int i;
+	int j;
+
+	if (ithread_mutex_init(&gSsdpRecvRingMutex, NULL) != 0)
+		return UPNP_E_INIT_FAILED;
+	gSsdpRecvRing = malloc(sizeof(ssdp_recv_batch) *
+			       (size_t)SSDP_RECV_RING_BATCHES);
+	if (gSsdpRecvRing == NULL) {
+		ithread_mutex_destroy(&gSsdpRecvRingMutex);
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	gSsdpRecvFreeBatches = NULL;
+	for (i = SSDP_RECV_RING_BATCHES - 1; i >= 0; i--) {
+		gSsdpRecvRing[i].count = 0;
+		gSsdpRecvRing[i].pending = 0;
+		for (j = 0; j < SSDP_RECV_BATCH_SIZE; j++)
+			gSsdpRecvRing[i].slots[j].batch = &gSsdpRecvRing[i];
+		gSsdpRecvRing[i].next = gSsdpRecvFreeBatches;
+		gSsdpRecvFreeBatches = &gSsdpRecvRing[i];
+	}
+#ifdef INCLUDE_CLIENT_APIS
+	gSsdpLaneCount = 0;
+	memset(gSsdpLanes, 0, sizeof(gSsdpLanes));
+	for (i = 0; i < UPNP_DISCOVERY_LANES_MAX; i++)
+		ithread_mutex_init(&gSsdpLanes[i].mutex, NULL);
+#endif /* INCLUDE_CLIENT_APIS */
+
+	return UPNP_E_SUCCESS;
+}
+
+void destroySSDPRecvRing(void)
+{
+#ifdef INCLUDE_CLIENT_APIS
+	int i;
+
+	for (i = 0; i < UPNP_DISCOVERY_LANES_MAX; i++)
+		ithread_mutex_destroy(&gSsdpLanes[i].mutex);
+	gSsdpLaneCount = 0;
+#endif /* INCLUDE_CLIENT_APIS */
+	ithread_mutex_destroy(&gSsdpRecvRingMutex);
+	free(gSsdpRecvRing);
+	gSsdpRecvRing = NULL;
+	gSsdpRecvFreeBatches = NULL;
 }
 
 /*!
@@ -0,0 +1,167 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+
+/*!
+ * \file
+ *
+ * \brief Measures the throughput of the thread pool schedulers.
+ *
+ * For each scheduler and each number of producer threads, the producers
+ * add small jobs to a pool of workers as fast as they can. The program reports the jobs run per second of wall
+ * clock time and per CPU second.
+ *
+ * Usage: bench_threadpool [jobs/producer] [workers] [job work]
+ */
+
+
+#include "ThreadPool.h"
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+
+static ThreadPool pool;
+static int jobsPerProducer;
+static volatile int jobWork;
+static ithread_mutex_t doneMutex = PTHREAD_MUTEX_INITIALIZER;
+static ithread_cond_t doneCond = PTHREAD_COND_INITIALIZER;
+static long done = 0;
+
+static void job_func(void *arg)
+{
+	volatile int x = 0;
+	int i;
+
+	(void)arg;
+	for (i = 0; i < jobWork; i++)
+		x += i;
+	ithread_mutex_lock(&doneMutex);
+	done++;
+	ithread_cond_signal(&doneCond);
+	ithread_mutex_unlock(&doneMutex);
+}
+
+static void *producer(void *arg)
+{
+	ThreadPoolJob job;
+	int i;
+
+	(void)arg;
+	TPJobInit(&job, (start_routine)job_func, NULL);
+	for (i = 0; i < jobsPerProducer; i++) {
+		TPJobSetPriority(&job, (ThreadPriority)(i % 3));
+		if (ThreadPoolAdd(&pool, &job, NULL) != 0) {
+			printf("** ERROR ThreadPoolAdd()\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	return NULL;
+}
+
+static double ts_ms(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void run(SchedulerMode mode, int producers, int workers)
+{
+	ThreadPoolAttr attr;
+	ithread_t threads[16];
+	long total = (long)jobsPerProducer * producers;
+	double start;
+	double cpuStart;
+	double wall;
+	double cpu;
+	int i;
+
+	TPAttrInit(&attr);
+	TPAttrSetMinThreads(&attr, workers);
+	TPAttrSetMaxThreads(&attr, workers);
+	/* the pool complains on stderr about every rejected job */
+	TPAttrSetMaxJobsTotal(&attr, (int)total + 1);
+	TPAttrSetSchedulerMode(&attr, mode);
+	if (ThreadPoolInit(&pool, &attr) != 0) {
+		printf("** ERROR ThreadPoolInit()\n");
+		exit(EXIT_FAILURE);
+	}
+	done = 0;
+	start = ts_ms(CLOCK_MONOTONIC);
+	cpuStart = ts_ms(CLOCK_PROCESS_CPUTIME_ID);
+	for (i = 0; i < producers; i++)
+		ithread_create(&threads[i], NULL, producer, NULL);
+	for (i = 0; i < producers; i++)
+		ithread_join(threads[i], NULL);
+	ithread_mutex_lock(&doneMutex);
+	while (done < total)
+		ithread_cond_wait(&doneCond, &doneMutex);
+	ithread_mutex_unlock(&doneMutex);
+	wall = ts_ms(CLOCK_MONOTONIC) - start;
+	cpu = ts_ms(CLOCK_PROCESS_CPUTIME_ID) - cpuStart;
+	ThreadPoolShutdown(&pool);
+	printf("%-13s %9d %9ld %12.0f %12.0f\n",
+		mode == TP_SCHED_SHARED ? "shared" : "work-stealing",
+		producers, total,
+		wall > 0.0 ? (double)total * 1000.0 / wall : 0.0,
+		cpu > 0.0 ? (double)total * 1000.0 / cpu : 0.0);
+}
+
+int main(int argc, char *argv[])
+{
+	static const int producers[] = {1, 4, 16};
+	int workers;
+	size_t i;
+
+	jobsPerProducer = argc > 1 ? atoi(argv[1]) : 100000;
+	workers = argc > 2 ? atoi(argv[2]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+	jobWork = argc > 3 ? atoi(argv[3]) : 100;
+	if (workers < 1)
+		workers = 1;
+	printf("jobs/producer=%d workers=%d job work=%d\n",
+		jobsPerProducer, workers, jobWork);
+	printf("%-13s %9s %9s %12s %12s\n",
+		"scheduler", "producers", "jobs", "jobs/s", "jobs/cpu-s");
+	for (i = 0; i < sizeof(producers) / sizeof(producers[0]); i++) {
+		run(TP_SCHED_SHARED, producers[i], workers);
+		run(TP_SCHED_WORK_STEALING, producers[i], workers);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,233 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Tests the client subscription table.
+ *
+ * The test fills a table with subscriptions and checks that each one is
+ * found by its SID and by the whole token of its actual SID, that a
+ * renewal moves it to its new actual SID, that a removed subscription is
+ * no longer found or listed while the others still are, and that two
+ * subscriptions sharing an actual SID do not unindex each other.
+ */
+
+
+#include "testutil.h"
+#include "../src/inc/client_table.h"
+
+
+#include <string.h>
+
+
+/*! Number of subscriptions. */
+#define SUBS 1000
+
+static ClientSubTable table;
+static ClientSubscription *subs[SUBS];
+/*! Actual SID of each subscription. */
+static char actual[SUBS][64];
+static UpnpString *str;
+
+static void make_sid(char *buf, size_t size, const char *prefix, int i)
+{
+	snprintf(buf, size, "uuid:%s-%08x-4f1e-9a3b-00112233%04x",
+		prefix, (unsigned)i * 2654435761u, (unsigned)i & 0xffff);
+}
+
+static ClientSubscription *find_sid(int i)
+{
+	char buf[64];
+
+	make_sid(buf, sizeof(buf), "client", i);
+	UpnpString_set_String(str, buf);
+
+	return GetClientSubClientSID(&table, str);
+}
+
+static ClientSubscription *find_actual(const char *sid, size_t size)
+{
+	token tok;
+
+	tok.buff = sid;
+	tok.size = size;
+
+	return GetClientSubActualSID(&table, &tok);
+}
+
+static void remove_sid(int i)
+{
+	char buf[64];
+
+	make_sid(buf, sizeof(buf), "client", i);
+	UpnpString_set_String(str, buf);
+	RemoveClientSubClientSID(&table, str);
+	if (i < SUBS)
+		subs[i] = NULL;
+}
+
+static ClientSubscription *add_sub(int i, const char *actualSID)
+{
+	ClientSubscription *sub;
+	char buf[64];
+
+	sub = UpnpClientSubscription_new();
+	CHECK(sub != NULL);
+	UpnpClientSubscription_set_RenewEventId(sub, -1);
+	make_sid(buf, sizeof(buf), "client", i);
+	UpnpClientSubscription_strcpy_SID(sub, buf);
+	UpnpClientSubscription_strcpy_ActualSID(sub, actualSID);
+	CHECK_INT(AddClientSub(&table, sub), UPNP_E_SUCCESS);
+
+	return sub;
+}
+
+/*!
+ * \brief Checks that the subscriptions still in subs, and only them, are
+ * listed and found by both keys.
+ */
+static void check_table(void)
+{
+	ClientSubscription *sub;
+	int listed = 0;
+	int count = 0;
+	int i;
+
+	for (sub = table.head; sub != NULL;
+	     sub = UpnpClientSubscription_get_Next(sub)) {
+		for (i = 0; i < SUBS && subs[i] != sub; i++)
+			;
+		CHECK(i < SUBS);
+		listed++;
+	}
+	for (i = 0; i < SUBS; i++) {
+		CHECK(find_sid(i) == subs[i]);
+		CHECK(find_actual(actual[i], strlen(actual[i])) == subs[i]);
+		if (subs[i] != NULL)
+			count++;
+	}
+	CHECK_INT(listed, count);
+}
+
+int main(int argc, char *argv[])
+{
+	ClientSubscription *first;
+	ClientSubscription *second;
+	char buf[80];
+	size_t len;
+	int i;
+
+	(void)argc;
+	(void)argv;
+	str = UpnpString_new();
+	CHECK(str != NULL);
+	ClientSubTableInit(&table);
+
+	/* nothing is found before the first subscription */
+	CHECK(find_sid(0) == NULL);
+	CHECK(find_actual("uuid:none", 9) == NULL);
+	remove_sid(0);
+	CHECK(table.head == NULL);
+
+	for (i = 0; i < SUBS; i++) {
+		make_sid(actual[i], sizeof(actual[i]), "device", i);
+		subs[i] = add_sub(i, actual[i]);
+	}
+	check_table();
+
+	/* the whole token of the actual SID must match, as received in the
+	 * SID header of a NOTIFY */
+	len = strlen(actual[7]);
+	CHECK(find_actual(actual[7], len - 1) == NULL);
+	snprintf(buf, sizeof(buf), "%s1", actual[7]);
+	CHECK(find_actual(buf, len + 1) == NULL);
+	CHECK(find_actual(buf, len) == subs[7]);
+	CHECK(find_sid(SUBS) == NULL);
+
+	/* a renewal changes the actual SID only */
+	for (i = 0; i < SUBS; i += 3) {
+		CHECK(find_sid(i) == subs[i]);
+		snprintf(buf, sizeof(buf), "%s", actual[i]);
+		make_sid(actual[i], sizeof(actual[i]), "renewed", i);
+		UpnpString_set_String(str, actual[i]);
+		CHECK_INT(SetClientSubActualSID(&table, subs[i], str),
+			UPNP_E_SUCCESS);
+		CHECK(find_actual(buf, strlen(buf)) == NULL);
+	}
+	check_table();
+
+	/* the head, the tail and every other subscription go */
+	remove_sid(SUBS - 1);
+	remove_sid(0);
+	check_table();
+	for (i = 1; i < SUBS; i += 2)
+		remove_sid(i);
+	check_table();
+	/* twice is harmless */
+	remove_sid(1);
+	check_table();
+
+	/* back under the same SIDs */
+	for (i = 0; i < SUBS; i += 4)
+		if (subs[i] == NULL)
+			subs[i] = add_sub(i, actual[i]);
+	check_table();
+
+	/* a subscription sharing the actual SID of another takes it over,
+	 * and keeps it when the other one goes */
+	second = add_sub(SUBS, actual[2]);
+	CHECK(find_actual(actual[2], strlen(actual[2])) == second);
+	remove_sid(2);
+	CHECK(find_actual(actual[2], strlen(actual[2])) == second);
+	CHECK(find_sid(SUBS) == second);
+	for (first = table.head; first != NULL && first != second;
+	     first = UpnpClientSubscription_get_Next(first))
+		;
+	CHECK(first == second);
+	remove_sid(SUBS);
+	CHECK(find_actual(actual[2], strlen(actual[2])) == NULL);
+	check_table();
+
+	/* everything goes */
+	for (i = 0; i < SUBS; i++)
+		remove_sid(i);
+	CHECK(table.head == NULL);
+	check_table();
+	for (i = 0; i < 10; i++)
+		subs[i] = add_sub(i, actual[i]);
+	check_table();
+	ClientSubTableDestroy(&table);
+	UpnpString_delete(str);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,328 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Tests the pool of idle client connections.
+ *
+ * The test plays an HTTP/1.1 server that keeps its connections open and
+ * counts the connections it accepts and the requests it serves. It checks
+ * that sequential downloads share one connection, that a connection is
+ * not reused after a CONNECTION: close, an HTTP/1.0 response or a response
+ * delimited by the close of the connection, that a connection closed by
+ * the server while idle is replaced without error, that a request the
+ * server dropped on a reused connection is sent again once, that a cut
+ * response is not sent again, and that at most
+ * HTTP_CONN_POOL_MAX_PER_HOST idle connections are kept per server.
+ */
+
+
+#include "testutil.h"
+#include "../src/inc/config.h"
+#include "../src/inc/httpreadwrite.h"
+
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+
+static SOCKET listener = INVALID_SOCKET;
+static volatile int stop_server = FALSE;
+
+/*! Connections accepted by the server. */
+static TestCounter accepts;
+/*! Requests received by the server. */
+static TestCounter requests;
+/*! Connections closed by the client while the server waited for a
+ * request. */
+static TestCounter closes;
+/*! Requests carrying a CONNECTION: close header. */
+static TestCounter closeHeaders;
+
+/*!
+ * \brief Sends a response with a body of the given text.
+ */
+static void reply(SOCKET sock, const char *version, const char *headers,
+	const char *body)
+{
+	char msg[512];
+
+	snprintf(msg, sizeof(msg),
+		"%s 200 OK\r\n"
+		"CONTENT-TYPE: text/plain\r\n"
+		"%s\r\n%s", version, headers, body);
+	send(sock, msg, strlen(msg), MSG_NOSIGNAL);
+}
+
+/*!
+ * \brief Thread serving the requests of one connection until one of them
+ * asks the server to close it, or the client closes it.
+ *
+ * The path of a request selects the response:
+ * \li /keep: a response with a CONTENT-LENGTH, the connection stays open.
+ * \li /close: a response with a CONNECTION: close header.
+ * \li /http10: an HTTP/1.0 response, the connection stays open.
+ * \li /eof: a response delimited by the close of the connection.
+ * \li /drop: as /keep, then the connection is closed while idle.
+ * \li /stale: as /keep, then the next request is read and the connection
+ * closed without a response.
+ * \li /partial: the status line alone, then the connection is closed.
+ */
+static void *conn_thread(void *arg)
+{
+	SOCKET sock = (SOCKET)(intptr_t)arg;
+	char request[2048];
+	char path[64];
+	char *end;
+	size_t length = 0;
+	ssize_t n;
+	int dropNext = FALSE;
+
+	request[0] = '\0';
+	for (;;) {
+		while ((end = strstr(request, "\r\n\r\n")) == NULL) {
+			n = recv(sock, request + length,
+				sizeof(request) - 1 - length, 0);
+			if (n <= 0) {
+				if (n == 0)
+					test_counter_add(&closes, 1);
+				close(sock);
+				return NULL;
+			}
+			length += (size_t)n;
+			request[length] = '\0';
+		}
+		*end = '\0';
+		test_counter_add(&requests, 1);
+		if (strstr(request, "CONNECTION: close") != NULL)
+			test_counter_add(&closeHeaders, 1);
+		path[0] = '\0';
+		sscanf(request, "GET %63s", path);
+		/* keep what follows the request */
+		end += strlen("\r\n\r\n");
+		length -= (size_t)(end - request);
+		memmove(request, end, length + 1);
+		if (dropNext)
+			break;
+		if (strcmp(path, "/keep") == 0) {
+			reply(sock, "HTTP/1.1", "CONTENT-LENGTH: 4\r\n", "keep");
+		} else if (strcmp(path, "/close") == 0) {
+			reply(sock, "HTTP/1.1",
+				"CONTENT-LENGTH: 5\r\nCONNECTION: close\r\n",
+				"close");
+			break;
+		} else if (strcmp(path, "/http10") == 0) {
+			reply(sock, "HTTP/1.0", "CONTENT-LENGTH: 6\r\n",
+				"http10");
+		} else if (strcmp(path, "/eof") == 0) {
+			reply(sock, "HTTP/1.1", "", "eof");
+			break;
+		} else if (strcmp(path, "/drop") == 0) {
+			reply(sock, "HTTP/1.1", "CONTENT-LENGTH: 4\r\n", "drop");
+			break;
+		} else if (strcmp(path, "/stale") == 0) {
+			reply(sock, "HTTP/1.1", "CONTENT-LENGTH: 5\r\n", "stale");
+			dropNext = TRUE;
+		} else {
+			send(sock, "HTTP/1.1 200 OK\r\n", 17, MSG_NOSIGNAL);
+			break;
+		}
+	}
+	close(sock);
+
+	return NULL;
+}
+
+/*!
+ * \brief Thread accepting the connections of the server.
+ */
+static void *server_thread(void *arg)
+{
+	ithread_t thread;
+	SOCKET sock;
+
+	(void)arg;
+	while (!stop_server) {
+		sock = accept(listener, NULL, NULL);
+		if (sock == INVALID_SOCKET)
+			continue;
+		test_counter_add(&accepts, 1);
+		ithread_create(&thread, NULL, conn_thread,
+			(void *)(intptr_t)sock);
+		ithread_detach(thread);
+	}
+
+	return NULL;
+}
+
+/*!
+ * \brief Downloads a path of the server and checks the numbers of
+ * connections it accepted and requests it received meanwhile.
+ */
+static void download(unsigned short port, const char *path, int expectedRet,
+	long expectedAccepts, long expectedRequests)
+{
+	char url[128];
+	char contentType[LINE_SIZE];
+	char *body = NULL;
+	long acceptsBefore = test_counter_get(&accepts);
+	long requestsBefore = test_counter_get(&requests);
+
+	snprintf(url, sizeof(url), "http://127.0.0.1:%u%s", port, path);
+	CHECK_INT(UpnpDownloadUrlItem(url, &body, contentType), expectedRet);
+	if (expectedRet == UPNP_E_SUCCESS) {
+		/* the body is the path */
+		CHECK(body != NULL);
+		CHECK(strcmp(body, path + 1) == 0);
+		free(body);
+	}
+	CHECK_INT(test_counter_get(&accepts) - acceptsBefore, expectedAccepts);
+	CHECK_INT(test_counter_get(&requests) - requestsBefore,
+		expectedRequests);
+}
+
+static int callback(Upnp_EventType EventType, void *Event, void *Cookie)
+{
+	(void)EventType;
+	(void)Event;
+	(void)Cookie;
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	UpnpClient_Handle handle = -1;
+	struct sockaddr_in addr;
+	struct sockaddr_storage peer;
+	socklen_t addrLen = sizeof(addr);
+	ithread_t thread;
+	SOCKET socks[HTTP_CONN_POOL_MAX_PER_HOST + 1];
+	SOCKET sock;
+	unsigned short port;
+	long count;
+	int i;
+	int j;
+
+	(void)argc;
+	(void)argv;
+	test_counter_init(&accepts);
+	test_counter_init(&requests);
+	test_counter_init(&closes);
+	test_counter_init(&closeHeaders);
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	CHECK(listener != INVALID_SOCKET);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	CHECK(bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+	CHECK(listen(listener, 8) == 0);
+	CHECK(getsockname(listener, (struct sockaddr *)&addr, &addrLen) == 0);
+	port = ntohs(addr.sin_port);
+	memset(&peer, 0, sizeof(peer));
+	memcpy(&peer, &addr, sizeof(addr));
+	ithread_create(&thread, NULL, server_thread, NULL);
+	test_start_client(callback, &handle);
+
+	/* sequential downloads share one connection */
+	download(port, "/keep", UPNP_E_SUCCESS, 1, 1);
+	download(port, "/keep", UPNP_E_SUCCESS, 0, 1);
+	download(port, "/keep", UPNP_E_SUCCESS, 0, 1);
+	CHECK_INT(test_counter_get(&closeHeaders), 0);
+
+	/* not reused after a CONNECTION: close */
+	download(port, "/close", UPNP_E_SUCCESS, 0, 1);
+	download(port, "/keep", UPNP_E_SUCCESS, 1, 1);
+	/* nor after an HTTP/1.0 response, which the client closes */
+	count = test_counter_get(&closes);
+	download(port, "/http10", UPNP_E_SUCCESS, 0, 1);
+	CHECK_INT(test_counter_wait(&closes, count + 1), count + 1);
+	download(port, "/keep", UPNP_E_SUCCESS, 1, 1);
+	/* nor after a response delimited by the close */
+	download(port, "/eof", UPNP_E_SUCCESS, 0, 1);
+	download(port, "/keep", UPNP_E_SUCCESS, 1, 1);
+
+	/* closed by the server while idle: replaced, the request is sent
+	 * once */
+	download(port, "/drop", UPNP_E_SUCCESS, 0, 1);
+	imillisleep(100);
+	download(port, "/keep", UPNP_E_SUCCESS, 1, 1);
+	/* closed by the server on the next request, before any response
+	 * byte: sent again once on a new connection */
+	download(port, "/stale", UPNP_E_SUCCESS, 0, 1);
+	download(port, "/keep", UPNP_E_SUCCESS, 1, 2);
+	/* closed in the middle of the response: not sent again */
+	download(port, "/partial", UPNP_E_BAD_HTTPMSG, 0, 1);
+	download(port, "/keep", UPNP_E_SUCCESS, 1, 1);
+	CHECK_INT(test_counter_get(&closeHeaders), 0);
+
+	/* at most HTTP_CONN_POOL_MAX_PER_HOST idle connections per server */
+	while ((sock = http_ConnPoolTake(&peer)) != INVALID_SOCKET)
+		close(sock);
+	count = test_counter_get(&accepts);
+	for (i = 0; i < HTTP_CONN_POOL_MAX_PER_HOST + 1; i++) {
+		socks[i] = socket(AF_INET, SOCK_STREAM, 0);
+		CHECK(socks[i] != INVALID_SOCKET);
+		CHECK(connect(socks[i], (struct sockaddr *)&addr,
+			sizeof(addr)) == 0);
+	}
+	CHECK_INT(test_counter_wait(&accepts,
+		count + HTTP_CONN_POOL_MAX_PER_HOST + 1),
+		count + HTTP_CONN_POOL_MAX_PER_HOST + 1);
+	count = test_counter_get(&closes);
+	for (i = 0; i < HTTP_CONN_POOL_MAX_PER_HOST + 1; i++)
+		http_ConnPoolRelease(&peer, socks[i]);
+	/* the extra one is closed */
+	CHECK_INT(test_counter_wait(&closes, count + 1), count + 1);
+	for (i = 0; i < HTTP_CONN_POOL_MAX_PER_HOST; i++) {
+		sock = http_ConnPoolTake(&peer);
+		for (j = 0; j < HTTP_CONN_POOL_MAX_PER_HOST; j++)
+			if (sock == socks[j])
+				break;
+		CHECK(j < HTTP_CONN_POOL_MAX_PER_HOST);
+		socks[j] = INVALID_SOCKET;
+		close(sock);
+	}
+	CHECK(http_ConnPoolTake(&peer) == INVALID_SOCKET);
+
+	test_finish_client(handle);
+	stop_server = TRUE;
+	shutdown(listener, SHUT_RDWR);
+	close(listener);
+	ithread_join(thread, NULL);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,333 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Tests the description document cache of the control point.
+ *
+ * The test plays a device serving a description document with an ETAG and
+ * a LAST-MODIFIED header, and answering 304 to a conditional GET while the
+ * document is unchanged. It checks that a fresh document is served from
+ * the cache, that the cache is keyed by LOCATION and USN, that a stale one
+ * is revalidated with the validators of the cached copy and downloaded
+ * again only once it changed, that invalidated entries and failed
+ * downloads are fetched again, and that the least recently used entry is
+ * evicted first.
+ */
+
+
+#include "testutil.h"
+#include "../src/inc/config.h"
+
+
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+
+/*! Freshness lifetime of the documents that go stale, in s: the cache
+ * counts whole seconds, so a document is fresh for at least 1 s. */
+#define SHORT_MAX_AGE 2
+
+static const char *desc_fmt =
+	"<?xml version=\"1.0\"?>\n"
+	"<root xmlns=\"urn:schemas-upnp-org:device-1-0\">\n"
+	"<specVersion><major>1</major><minor>0</minor></specVersion>\n"
+	"<device>\n"
+	"<deviceType>urn:schemas-upnp-org:device:Test:1</deviceType>\n"
+	"<friendlyName>Version %d</friendlyName>\n"
+	"<UDN>uuid:5f9ec1b3-ed59-49ad-b3e8-0000000dc001</UDN>\n"
+	"</device>\n"
+	"</root>\n";
+
+static SOCKET listener = INVALID_SOCKET;
+static volatile int stop_server = FALSE;
+
+/*! Last request received by the device. */
+static struct {
+	ithread_mutex_t mutex;
+	/*! Requests received. */
+	long count;
+	char path[64];
+	char ifNoneMatch[64];
+	char ifModifiedSince[64];
+} last = { PTHREAD_MUTEX_INITIALIZER, 0, "", "", "" };
+
+/*! Version of the document served. */
+static volatile int version = 1;
+
+/*!
+ * \brief Copies the value of a header of a request, "" if absent.
+ */
+static void copy_header(const char *request, const char *name, char *value,
+	size_t size)
+{
+	const char *start = strstr(request, name);
+	size_t length;
+
+	value[0] = '\0';
+	if (start == NULL)
+		return;
+	start += strlen(name);
+	while (*start == ' ')
+		start++;
+	length = strcspn(start, "\r\n");
+	if (length >= size)
+		length = size - 1;
+	memcpy(value, start, length);
+	value[length] = '\0';
+}
+
+/*!
+ * \brief Thread of the device, answering one request per connection.
+ */
+static void *server_thread(void *arg)
+{
+	char request[2048];
+	char body[1024];
+	char reply[2048];
+	char etag[32];
+	ssize_t n;
+	size_t length;
+	SOCKET sock;
+
+	(void)arg;
+	while (!stop_server) {
+		sock = accept(listener, NULL, NULL);
+		if (sock == INVALID_SOCKET)
+			continue;
+		length = 0;
+		do {
+			n = recv(sock, request + length,
+				sizeof(request) - 1 - length, 0);
+			if (n > 0)
+				length += (size_t)n;
+			request[length] = '\0';
+		} while (n > 0 && strstr(request, "\r\n\r\n") == NULL);
+		if (n <= 0) {
+			close(sock);
+			continue;
+		}
+		ithread_mutex_lock(&last.mutex);
+		last.count++;
+		sscanf(request, "GET %63s", last.path);
+		copy_header(request, "IF-NONE-MATCH:", last.ifNoneMatch,
+			sizeof(last.ifNoneMatch));
+		copy_header(request, "IF-MODIFIED-SINCE:",
+			last.ifModifiedSince, sizeof(last.ifModifiedSince));
+		snprintf(etag, sizeof(etag), "\"v%d\"", version);
+		if (strcmp(last.path, "/desc.xml") != 0) {
+			snprintf(reply, sizeof(reply),
+				"HTTP/1.1 404 Not Found\r\n"
+				"CONTENT-LENGTH: 0\r\n"
+				"CONNECTION: close\r\n\r\n");
+		} else if (strcmp(last.ifNoneMatch, etag) == 0) {
+			snprintf(reply, sizeof(reply),
+				"HTTP/1.1 304 Not Modified\r\n"
+				"ETAG: %s\r\n"
+				"CONTENT-LENGTH: 0\r\n"
+				"CONNECTION: close\r\n\r\n", etag);
+		} else {
+			snprintf(body, sizeof(body), desc_fmt, version);
+			snprintf(reply, sizeof(reply),
+				"HTTP/1.1 200 OK\r\n"
+				"CONTENT-TYPE: text/xml\r\n"
+				"ETAG: %s\r\n"
+				"LAST-MODIFIED: Mon, 0%d Jan 2024 00:00:00 GMT\r\n"
+				"CONTENT-LENGTH: %u\r\n"
+				"CONNECTION: close\r\n\r\n%s",
+				etag, version, (unsigned)strlen(body), body);
+		}
+		ithread_mutex_unlock(&last.mutex);
+		send(sock, reply, strlen(reply), MSG_NOSIGNAL);
+		close(sock);
+	}
+
+	return NULL;
+}
+
+static long requests(void)
+{
+	long count;
+
+	ithread_mutex_lock(&last.mutex);
+	count = last.count;
+	ithread_mutex_unlock(&last.mutex);
+
+	return count;
+}
+
+/*!
+ * \brief Downloads a document through the cache and checks its version
+ * and the number of requests the device received meanwhile.
+ */
+static void download(const char *url, const char *usn, int maxAge,
+	int expectedVersion, long expectedRequests)
+{
+	IXML_Document *doc = NULL;
+	IXML_NodeList *nodes;
+	IXML_Node *text;
+	char name[32];
+	long before = requests();
+
+	CHECK_INT(UpnpDownloadXmlDocCached(url, usn, maxAge, &doc),
+		UPNP_E_SUCCESS);
+	CHECK_INT(requests() - before, expectedRequests);
+	nodes = ixmlDocument_getElementsByTagName(doc, "friendlyName");
+	CHECK(nodes != NULL);
+	text = ixmlNode_getFirstChild(ixmlNodeList_item(nodes, 0));
+	snprintf(name, sizeof(name), "Version %d", expectedVersion);
+	CHECK(strcmp(ixmlNode_getNodeValue(text), name) == 0);
+	/* the caller owns a copy: changing it does not change the cache */
+	CHECK_INT(ixmlNode_setNodeValue(text, "Changed"), IXML_SUCCESS);
+	ixmlNodeList_free(nodes);
+	ixmlDocument_free(doc);
+}
+
+static int callback(Upnp_EventType EventType, void *Event, void *Cookie)
+{
+	(void)EventType;
+	(void)Event;
+	(void)Cookie;
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	IXML_Document *doc = NULL;
+	UpnpClient_Handle handle = -1;
+	struct sockaddr_in addr;
+	socklen_t addrLen = sizeof(addr);
+	ithread_t thread;
+	char url[128];
+	char missing[128];
+	char usn[64];
+	long before;
+	int i;
+
+	(void)argc;
+	(void)argv;
+	CHECK_INT(UpnpInvalidateXmlDocCache(NULL, NULL), UPNP_E_FINISH);
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	CHECK(listener != INVALID_SOCKET);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	CHECK(bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+	CHECK(listen(listener, 8) == 0);
+	CHECK(getsockname(listener, (struct sockaddr *)&addr, &addrLen) == 0);
+	ithread_create(&thread, NULL, server_thread, NULL);
+	snprintf(url, sizeof(url), "http://127.0.0.1:%u/desc.xml",
+		ntohs(addr.sin_port));
+	snprintf(missing, sizeof(missing), "http://127.0.0.1:%u/missing.xml",
+		ntohs(addr.sin_port));
+	test_start_client(callback, &handle);
+
+	/* downloaded once, then fresh */
+	download(url, "uuid:a", 0, 1, 1);
+	CHECK(last.ifNoneMatch[0] == '\0');
+	CHECK(last.ifModifiedSince[0] == '\0');
+	download(url, "uuid:a", 0, 1, 0);
+	/* another USN, or none, is another entry */
+	download(url, "uuid:b", SHORT_MAX_AGE, 1, 1);
+	download(url, NULL, 0, 1, 1);
+	download(url, NULL, 0, 1, 0);
+
+	/* stale and unchanged: revalidated, not downloaded */
+	imillisleep(SHORT_MAX_AGE * 1000 + 100);
+	download(url, "uuid:a", 0, 1, 0);
+	download(url, "uuid:b", SHORT_MAX_AGE, 1, 1);
+	CHECK(strcmp(last.ifNoneMatch, "\"v1\"") == 0);
+	CHECK(strcmp(last.ifModifiedSince,
+		"Mon, 01 Jan 2024 00:00:00 GMT") == 0);
+	download(url, "uuid:b", SHORT_MAX_AGE, 1, 0);
+
+	/* stale and changed: downloaded with the new validators */
+	version = 2;
+	imillisleep(SHORT_MAX_AGE * 1000 + 100);
+	download(url, "uuid:b", SHORT_MAX_AGE, 2, 1);
+	CHECK(strcmp(last.ifNoneMatch, "\"v1\"") == 0);
+	download(url, "uuid:b", SHORT_MAX_AGE, 2, 0);
+	imillisleep(SHORT_MAX_AGE * 1000 + 100);
+	download(url, "uuid:b", SHORT_MAX_AGE, 2, 1);
+	CHECK(strcmp(last.ifNoneMatch, "\"v2\"") == 0);
+	CHECK(strcmp(last.ifModifiedSince,
+		"Mon, 02 Jan 2024 00:00:00 GMT") == 0);
+	/* the fresh entries keep their copy */
+	download(url, "uuid:a", 0, 1, 0);
+
+	/* invalidated entries are downloaded again, unconditionally */
+	CHECK_INT(UpnpInvalidateXmlDocCache(url, "uuid:a"), UPNP_E_SUCCESS);
+	download(url, NULL, 0, 1, 0);
+	download(url, "uuid:a", 0, 2, 1);
+	CHECK(last.ifNoneMatch[0] == '\0');
+	CHECK_INT(UpnpInvalidateXmlDocCache(NULL, "uuid:a"), UPNP_E_SUCCESS);
+	download(url, NULL, 0, 1, 0);
+	download(url, "uuid:a", 0, 2, 1);
+	CHECK_INT(UpnpInvalidateXmlDocCache(url, NULL), UPNP_E_SUCCESS);
+	download(url, "uuid:a", 0, 2, 1);
+	download(url, NULL, 0, 2, 1);
+	CHECK_INT(UpnpInvalidateXmlDocCache(NULL, NULL), UPNP_E_SUCCESS);
+	download(url, "uuid:a", 0, 2, 1);
+
+	/* failures are not cached */
+	for (i = 1; i <= 2; i++) {
+		before = requests();
+		CHECK_INT(UpnpDownloadXmlDocCached(missing, "uuid:a", 0, &doc),
+			UPNP_E_INVALID_URL);
+		CHECK_INT(requests() - before, 1);
+		CHECK(strcmp(last.path, "/missing.xml") == 0);
+	}
+
+	/* the least recently used entry goes first */
+	CHECK_INT(UpnpInvalidateXmlDocCache(NULL, NULL), UPNP_E_SUCCESS);
+	for (i = 0; i < DESC_CACHE_MAX_ENTRIES; i++) {
+		snprintf(usn, sizeof(usn), "uuid:%d", i);
+		download(url, usn, 0, 2, 1);
+	}
+	download(url, "uuid:0", 0, 2, 0);
+	download(url, "uuid:new", 0, 2, 1);
+	download(url, "uuid:0", 0, 2, 0);
+	download(url, "uuid:2", 0, 2, 0);
+	download(url, "uuid:1", 0, 2, 1);
+
+	test_finish_client(handle);
+	stop_server = TRUE;
+	shutdown(listener, SHUT_RDWR);
+	close(listener);
+	ithread_join(thread, NULL);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,177 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Tests the delivery of GENA events to the subscriptions of a
+ * device.
+ *
+ * Control points subscribe to the test device, half of them closing the
+ * connection after each NOTIFY. The test checks that every control point
+ * gets its initial event, then every event of a burst in SEQ order over a
+ * kept connection when it allows it. With two control points stalled, it
+ * overflows their queues and checks that the others still get the events,
+ * and that the oldest queued events of the stalled ones are dropped,
+ * leaving one gap in the SEQ numbers, while the event being sent and the
+ * latest ones are delivered.
+ */
+
+
+#include "testsink.h"
+#include "../src/inc/config.h"
+
+
+#include <string.h>
+
+
+/*! Number of control points. */
+#define SINKS 8
+
+/*! Events of a burst. */
+#define EVENTS 50
+
+/*! Control points stalled, one keeping connections, one closing them. */
+#define STALLED 2
+
+/*! Events sent to full queues, beyond the one being sent. */
+#define OVERFLOW (GENA_MAX_QUEUED_EVENTS + 10)
+
+static TestSink sinks[SINKS];
+static UpnpDevice_Handle device = -1;
+
+/*!
+ * \brief Changes the Value variable of the test device.
+ */
+static void notify_value(long value)
+{
+	const char *name = "Value";
+	char buf[32];
+	const char *valuePtr = buf;
+
+	snprintf(buf, sizeof(buf), "%ld", value);
+	CHECK_INT(UpnpNotify(device, test_sink_udn, test_sink_service_id,
+		&name, &valuePtr, 1), UPNP_E_SUCCESS);
+}
+
+/*!
+ * \brief Checks the NOTIFY a control point received from first to count,
+ * their SEQ following each other from seq and the value being the SEQ plus
+ * offset.
+ */
+static void check_events(TestSink *sink, int first, int count, int seq,
+	long offset)
+{
+	int i;
+
+	for (i = first; i < count; i++, seq++) {
+		CHECK_INT(sink->log[i].seq, seq);
+		CHECK_INT(sink->log[i].value, seq + offset);
+		CHECK_INT(sink->log[i].other, -1);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	long accepts;
+	int count;
+	int i;
+	int j;
+
+	(void)argc;
+	(void)argv;
+	test_sink_start_device(&device);
+	for (i = 0; i < SINKS; i++)
+		sinks[i].closeConnections = i % 2;
+	test_sink_open(sinks, SINKS);
+	for (i = 0; i < SINKS; i++)
+		test_sink_subscribe(&sinks[i]);
+	/* initial events */
+	for (i = 0; i < SINKS; i++) {
+		CHECK_INT(test_sink_wait(&sinks[i], 1), 1);
+		CHECK_INT(sinks[i].log[0].seq, 0);
+		CHECK_INT(sinks[i].log[0].value, 0);
+		CHECK_INT(sinks[i].log[0].other, 0);
+	}
+
+	/* every event in order, a kept connection serving the burst */
+	for (i = 1; i <= EVENTS; i++)
+		notify_value(i);
+	for (i = 0; i < SINKS; i++) {
+		CHECK_INT(test_sink_wait(&sinks[i], 1 + EVENTS), 1 + EVENTS);
+		check_events(&sinks[i], 1, 1 + EVENTS, 1, 0);
+		accepts = sinks[i].accepts;
+		if (sinks[i].closeConnections)
+			CHECK(accepts >= EVENTS);
+		else
+			CHECK(accepts <= 2);
+	}
+
+	/* the queues overflow while control points do not answer */
+	for (i = 0; i < STALLED; i++)
+		test_sink_stall(&sinks[i], TRUE);
+	notify_value(100);
+	for (i = 0; i < STALLED; i++)
+		CHECK_INT(test_sink_wait(&sinks[i], 2 + EVENTS), 2 + EVENTS);
+	for (j = 1; j <= OVERFLOW; j++)
+		notify_value(100 + j);
+	for (i = STALLED; i < SINKS; i++) {
+		count = test_sink_wait_value(&sinks[i], 100 + OVERFLOW);
+		for (j = 2 + EVENTS; j < count; j++)
+			CHECK(sinks[i].log[j].seq > sinks[i].log[j - 1].seq);
+		check_events(&sinks[i], 1 + EVENTS, 2 + EVENTS, 1 + EVENTS,
+			100 - (1 + EVENTS));
+		CHECK_INT(sinks[i].log[count - 1].value, 100 + OVERFLOW);
+	}
+	for (i = 0; i < STALLED; i++) {
+		CHECK_INT(sinks[i].count, 2 + EVENTS);
+		test_sink_stall(&sinks[i], FALSE);
+	}
+	for (i = 0; i < STALLED; i++) {
+		/* the event being sent, then the queue of the latest ones */
+		CHECK_INT(test_sink_wait(&sinks[i],
+			1 + EVENTS + GENA_MAX_QUEUED_EVENTS),
+			1 + EVENTS + GENA_MAX_QUEUED_EVENTS);
+		check_events(&sinks[i], 1 + EVENTS, 2 + EVENTS, 1 + EVENTS,
+			100 - (1 + EVENTS));
+		check_events(&sinks[i], 2 + EVENTS,
+			1 + EVENTS + GENA_MAX_QUEUED_EVENTS,
+			2 + EVENTS + OVERFLOW - (GENA_MAX_QUEUED_EVENTS - 1),
+			100 - (1 + EVENTS));
+		CHECK_INT(sinks[i].log[EVENTS + GENA_MAX_QUEUED_EVENTS].value,
+			100 + OVERFLOW);
+	}
+
+	test_sink_finish(device);
+
+	return EXIT_SUCCESS;
+}
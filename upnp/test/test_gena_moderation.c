@@ -0,0 +1,205 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Tests the moderation of the events of a state variable and the
+ * merging of queued events.
+ *
+ * Two control points, one keeping its connection and one closing it,
+ * subscribe to the test device whose Value variable is moderated with
+ * UpnpSetEventModeration(). The test checks that a burst of changes within
+ * the maximum rate sends the first value at once and the latest one when
+ * the period ends, that changes smaller than the minimum delta are not
+ * sent, and that events queued behind a stalled control point are merged
+ * into one property set, except for the values of a variable that is not
+ * moderated. The SEQ numbers never have a gap.
+ */
+
+
+#include "testsink.h"
+
+
+#include <string.h>
+
+
+/*! Number of control points. */
+#define SINKS 2
+
+/*! Maximum rate of the Value variable, in ms. */
+#define MAX_RATE 300
+
+/*! Changes of a burst. */
+#define BURST 20
+
+static TestSink sinks[SINKS];
+static UpnpDevice_Handle device = -1;
+
+/*!
+ * \brief Changes a variable of the test device.
+ */
+static void notify_var(const char *name, long value)
+{
+	char buf[32];
+	const char *valuePtr = buf;
+
+	snprintf(buf, sizeof(buf), "%ld", value);
+	CHECK_INT(UpnpNotify(device, test_sink_udn, test_sink_service_id,
+		&name, &valuePtr, 1), UPNP_E_SUCCESS);
+}
+
+/*!
+ * \brief Checks a NOTIFY received by every control point.
+ */
+static void check_notify(int index, long value, long other)
+{
+	int i;
+
+	for (i = 0; i < SINKS; i++) {
+		CHECK_INT(sinks[i].log[index].value, value);
+		CHECK_INT(sinks[i].log[index].other, other);
+	}
+}
+
+/*!
+ * \brief Waits until every control point received a number of NOTIFY.
+ */
+static void wait_all(int count)
+{
+	int i;
+
+	for (i = 0; i < SINKS; i++)
+		CHECK_INT(test_sink_wait(&sinks[i], count), count);
+}
+
+static void stall_all(int stalled)
+{
+	int i;
+
+	for (i = 0; i < SINKS; i++)
+		test_sink_stall(&sinks[i], stalled);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *udn;
+	const char *serviceId;
+	int i;
+	int j;
+
+	(void)argc;
+	(void)argv;
+	test_sink_start_device(&device);
+	udn = test_sink_udn;
+	serviceId = test_sink_service_id;
+	CHECK_INT(UpnpSetEventModeration(device, udn, serviceId, NULL,
+		MAX_RATE, 0.0), UPNP_E_INVALID_PARAM);
+	CHECK_INT(UpnpSetEventModeration(device, udn, serviceId, "Value",
+		-1, 0.0), UPNP_E_INVALID_PARAM);
+	CHECK_INT(UpnpSetEventModeration(device, udn, serviceId, "Value",
+		MAX_RATE, -1.0), UPNP_E_INVALID_PARAM);
+	CHECK_INT(UpnpSetEventModeration(-1, udn, serviceId, "Value",
+		MAX_RATE, 0.0), UPNP_E_INVALID_HANDLE);
+	CHECK_INT(UpnpSetEventModeration(device, udn,
+		"urn:upnp-org:serviceId:None", "Value", MAX_RATE, 0.0),
+		UPNP_E_INVALID_SERVICE);
+	CHECK_INT(UpnpSetEventModeration(device, udn, serviceId, "Value",
+		MAX_RATE, 0.0), UPNP_E_SUCCESS);
+	sinks[1].closeConnections = TRUE;
+	test_sink_open(sinks, SINKS);
+	for (i = 0; i < SINKS; i++)
+		test_sink_subscribe(&sinks[i]);
+	wait_all(1);
+	check_notify(0, 0, 0);
+
+	/* the first change is sent, the latest one when the period ends,
+	 * while a variable that is not moderated is sent at once */
+	for (j = 1; j <= BURST; j++)
+		notify_var("Value", j);
+	notify_var("Other", 7);
+	wait_all(3);
+	check_notify(1, 1, -1);
+	check_notify(2, -1, 7);
+	for (i = 0; i < SINKS; i++)
+		CHECK_INT(test_sink_wait_value(&sinks[i], BURST), 4);
+	check_notify(3, BURST, -1);
+
+	/* changes smaller than the minimum delta from the sent value */
+	CHECK_INT(UpnpSetEventModeration(device, udn, serviceId, "Value",
+		0, 5.0), UPNP_E_SUCCESS);
+	notify_var("Value", BURST + 2);
+	notify_var("Value", BURST + 4);
+	notify_var("Value", BURST + 6);
+	notify_var("Value", BURST + 3);
+	notify_var("Value", BURST + 10);
+	notify_var("Value", BURST + 11);
+	for (i = 0; i < SINKS; i++)
+		CHECK_INT(test_sink_wait_value(&sinks[i], BURST + 11), 6);
+	check_notify(4, BURST + 6, -1);
+	check_notify(5, BURST + 11, -1);
+
+	/* events queued behind the one being sent are merged */
+	CHECK_INT(UpnpSetEventModeration(device, udn, serviceId, "Value",
+		0, 0.0), UPNP_E_SUCCESS);
+	stall_all(TRUE);
+	notify_var("Value", 40);
+	wait_all(7);
+	notify_var("Value", 41);
+	notify_var("Other", 8);
+	notify_var("Value", 42);
+	stall_all(FALSE);
+	wait_all(8);
+	check_notify(6, 40, -1);
+	check_notify(7, 42, 8);
+
+	/* but not two values of a variable that is not moderated */
+	stall_all(TRUE);
+	notify_var("Value", 50);
+	wait_all(9);
+	notify_var("Other", 9);
+	notify_var("Other", 10);
+	notify_var("Value", 51);
+	stall_all(FALSE);
+	wait_all(11);
+	check_notify(8, 50, -1);
+	check_notify(9, -1, 9);
+	check_notify(10, 51, 10);
+
+	for (i = 0; i < SINKS; i++)
+		for (j = 0; j < sinks[i].count; j++)
+			CHECK_INT(sinks[i].log[j].seq, j);
+
+	test_sink_finish(device);
+
+	return EXIT_SUCCESS;
+}
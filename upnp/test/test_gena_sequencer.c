@@ -0,0 +1,313 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Tests the sequencing of the GENA events received by a control
+ * point.
+ *
+ * The test plays the publisher of two subscriptions of the control point,
+ * sequenced with UpnpSetEventSequencing(): it answers their SUBSCRIBE
+ * requests, then sends events one NOTIFY at a time, out of order, with
+ * duplicates and with missing events. It checks that the events of each
+ * subscription reach the callback in SEQ order, that a missing event is
+ * reported by a gap once the window is full or the gap timeout expired,
+ * and that late and duplicate events are dropped.
+ */
+
+
+#include "testutil.h"
+
+
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+
+/*! Number of subscriptions. */
+#define SUBS 2
+
+/*! Events held back per subscription. */
+#define WINDOW 3
+
+/*! Time a missing event is waited for, in ms. */
+#define GAP_TIMEOUT 300
+
+/*! Maximum number of callbacks of a subscription. */
+#define LOG_SIZE 64
+
+/*! Callback made for a subscription: an event, or a gap if missing. */
+typedef struct {
+	int eventKey;
+	int missing;
+} LogEntry;
+
+static Upnp_SID sids[SUBS];
+/*! Callbacks of each subscription, in order. */
+static LogEntry logs[SUBS][LOG_SIZE];
+static TestCounter log_count[SUBS];
+static SOCKET publisher = INVALID_SOCKET;
+static volatile int stop_publisher = FALSE;
+
+/*!
+ * \brief Returns the value of the Value property of an event.
+ */
+static int event_value(IXML_Document *doc)
+{
+	IXML_NodeList *nodes;
+	IXML_Node *text;
+	int value = -1;
+
+	nodes = ixmlDocument_getElementsByTagName(doc, "Value");
+	CHECK(nodes != NULL);
+	text = ixmlNode_getFirstChild(ixmlNodeList_item(nodes, 0));
+	CHECK(text != NULL);
+	value = atoi(ixmlNode_getNodeValue(text));
+	ixmlNodeList_free(nodes);
+
+	return value;
+}
+
+static void add_log(const char *sid, int eventKey, int missing)
+{
+	LogEntry *entry;
+	int sub;
+	long n;
+
+	for (sub = 0; sub < SUBS && strcmp(sids[sub], sid) != 0; sub++)
+		;
+	CHECK(sub < SUBS);
+	n = test_counter_get(&log_count[sub]);
+	CHECK(n < LOG_SIZE);
+	entry = &logs[sub][n];
+	entry->eventKey = eventKey;
+	entry->missing = missing;
+	test_counter_add(&log_count[sub], 1);
+}
+
+static int callback(Upnp_EventType EventType, void *Event, void *Cookie)
+{
+	struct Upnp_Event *e_event = (struct Upnp_Event *)Event;
+	struct Upnp_Event_Gap *g_event = (struct Upnp_Event_Gap *)Event;
+
+	(void)Cookie;
+	switch (EventType) {
+	case UPNP_EVENT_RECEIVED:
+		CHECK_INT(event_value(e_event->ChangedVariables),
+			e_event->EventKey);
+		add_log(e_event->Sid, e_event->EventKey, 0);
+		break;
+	case UPNP_EVENT_SEQUENCE_GAP:
+		CHECK(g_event->Missing > 0);
+		add_log(g_event->Sid, g_event->EventKey, g_event->Missing);
+		break;
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Thread answering the SUBSCRIBE requests of the control point.
+ */
+static void *publisher_thread(void *arg)
+{
+	char buf[2048];
+	char reply[256];
+	int count = 0;
+	SOCKET sock;
+
+	(void)arg;
+	while (!stop_publisher) {
+		sock = accept(publisher, NULL, NULL);
+		if (sock == INVALID_SOCKET)
+			continue;
+		if (recv(sock, buf, sizeof(buf) - 1, 0) > 0) {
+			snprintf(reply, sizeof(reply),
+				"HTTP/1.1 200 OK\r\n"
+				"SID: uuid:publisher-%d\r\n"
+				"TIMEOUT: Second-1800\r\n"
+				"CONTENT-LENGTH: 0\r\n\r\n", count++);
+			send(sock, reply, strlen(reply), MSG_NOSIGNAL);
+		}
+		close(sock);
+	}
+
+	return NULL;
+}
+
+/*!
+ * \brief Sends an event of a subscription to the control point and waits
+ * for its answer, so that the events are received in the order sent.
+ */
+static void send_event(int sub, int eventKey)
+{
+	struct sockaddr_in addr;
+	char body[256];
+	char msg[1024];
+	char reply[512];
+	SOCKET sock;
+
+	snprintf(body, sizeof(body),
+		"<e:propertyset xmlns:e=\"urn:schemas-upnp-org:event-1-0\">\n"
+		"<e:property>\n<Value>%d</Value>\n</e:property>\n"
+		"</e:propertyset>\n", eventKey);
+	snprintf(msg, sizeof(msg),
+		"NOTIFY / HTTP/1.1\r\n"
+		"HOST: %s:%u\r\n"
+		"CONTENT-TYPE: text/xml; charset=\"utf-8\"\r\n"
+		"CONTENT-LENGTH: %u\r\n"
+		"NT: upnp:event\r\n"
+		"NTS: upnp:propchange\r\n"
+		"SID: uuid:publisher-%d\r\n"
+		"SEQ: %d\r\n\r\n%s",
+		UpnpGetServerIpAddress(), UpnpGetServerPort(),
+		(unsigned)strlen(body), sub, eventKey,
+		body);
+	sock = socket(AF_INET, SOCK_STREAM, 0);
+	CHECK(sock != INVALID_SOCKET);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(UpnpGetServerPort());
+	addr.sin_addr.s_addr = inet_addr(UpnpGetServerIpAddress());
+	CHECK(connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+	CHECK(send(sock, msg, strlen(msg), MSG_NOSIGNAL) ==
+		(ssize_t)strlen(msg));
+	CHECK(recv(sock, reply, sizeof(reply) - 1, 0) > 0);
+	close(sock);
+}
+
+/*!
+ * \brief Checks the callbacks made for a subscription.
+ */
+static void check_log(int sub, const LogEntry *expected, int count)
+{
+	int i;
+
+	CHECK_INT(test_counter_wait(&log_count[sub], count), count);
+	for (i = 0; i < count; i++) {
+		CHECK_INT(logs[sub][i].eventKey, expected[i].eventKey);
+		CHECK_INT(logs[sub][i].missing, expected[i].missing);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	static const LogEntry first[] = {
+		{ 0, 0 }, { 1, 0 }, { 2, 0 }, { 3, 0 }
+	};
+	static const LogEntry windowed[] = {
+		{ 0, 0 }, { 1, 0 }, { 2, 0 }, { 3, 0 },
+		{ 4, 1 }, { 5, 0 }, { 6, 0 }, { 7, 0 }, { 8, 0 }
+	};
+	static const LogEntry timed_out[] = {
+		{ 0, 0 }, { 1, 0 }, { 2, 0 }, { 3, 0 },
+		{ 4, 1 }, { 5, 0 }, { 6, 0 }, { 7, 0 }, { 8, 0 },
+		{ 9, 2 }, { 11, 0 }
+	};
+	static const int sub0_first[] = { 0, 2, 1, 3 };
+	static const int sub1_first[] = { 1, 3, 2, 0 };
+	UpnpClient_Handle handle = -1;
+	struct sockaddr_in addr;
+	socklen_t addrLen = sizeof(addr);
+	ithread_t thread;
+	char url[128];
+	int timeout = 1800;
+	int sub;
+	int i;
+
+	(void)argc;
+	(void)argv;
+	for (sub = 0; sub < SUBS; sub++)
+		test_counter_init(&log_count[sub]);
+	test_start_client(callback, &handle);
+	CHECK_INT(UpnpSetEventSequencing(handle, -1, GAP_TIMEOUT),
+		UPNP_E_INVALID_PARAM);
+	CHECK_INT(UpnpSetEventSequencing(handle, WINDOW, -1),
+		UPNP_E_INVALID_PARAM);
+	CHECK_INT(UpnpSetEventSequencing(-1, WINDOW, GAP_TIMEOUT),
+		UPNP_E_INVALID_HANDLE);
+	CHECK_INT(UpnpSetEventSequencing(handle, WINDOW, GAP_TIMEOUT),
+		UPNP_E_SUCCESS);
+	publisher = socket(AF_INET, SOCK_STREAM, 0);
+	CHECK(publisher != INVALID_SOCKET);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	CHECK(bind(publisher, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+	CHECK(listen(publisher, 8) == 0);
+	CHECK(getsockname(publisher, (struct sockaddr *)&addr, &addrLen) == 0);
+	ithread_create(&thread, NULL, publisher_thread, NULL);
+	snprintf(url, sizeof(url), "http://127.0.0.1:%u/evt",
+		ntohs(addr.sin_port));
+	for (sub = 0; sub < SUBS; sub++)
+		CHECK_INT(UpnpSubscribe(handle, url, &timeout, sids[sub]),
+			UPNP_E_SUCCESS);
+
+	/* reordered, the subscriptions interleaved */
+	for (i = 0; i < 4; i++) {
+		send_event(0, sub0_first[i]);
+		send_event(1, sub1_first[i]);
+	}
+	check_log(0, first, 4);
+	check_log(1, first, 4);
+
+	/* 4 is given up when WINDOW later events are held back, then
+	 * dropped when it comes late, as is a duplicate of 8 */
+	for (i = 5; i <= 5 + WINDOW; i++)
+		send_event(0, i);
+	check_log(0, windowed, 9);
+	send_event(0, 4);
+	send_event(0, 8);
+
+	/* 9 and 10 are given up after GAP_TIMEOUT, 11 came twice */
+	send_event(0, 11);
+	send_event(0, 11);
+	imillisleep(GAP_TIMEOUT / 3);
+	CHECK_INT(test_counter_get(&log_count[0]), 9);
+	check_log(0, timed_out, 11);
+	/* nothing more */
+	imillisleep(GAP_TIMEOUT);
+	CHECK_INT(test_counter_get(&log_count[0]), 11);
+	CHECK_INT(test_counter_get(&log_count[1]), 4);
+
+	test_finish_client(handle);
+	stop_publisher = TRUE;
+	shutdown(publisher, SHUT_RDWR);
+	close(publisher);
+	ithread_join(thread, NULL);
+
+	return EXIT_SUCCESS;
+}
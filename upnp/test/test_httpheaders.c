@@ -0,0 +1,296 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Tests the storage of the headers of parsed HTTP messages.
+ *
+ * The headers are spans of the raw message, which moves while the message
+ * is read. The test parses messages all at once and one byte at a time,
+ * and checks every header by position, by id and by name: more headers
+ * than fit inline, repeated headers joined with ", ", empty values, chunked
+ * trailers deleted from the raw message, and a value kept across changes
+ * of the message buffer.
+ */
+
+
+#include "testutil.h"
+#include "../src/inc/httpparser.h"
+
+
+#include <string.h>
+
+
+/*! Unknown headers of the long message, more than fit inline. */
+#define MANY_HEADERS (2 * HTTP_INLINE_HEADERS + 3)
+
+/*! Header expected in a parsed message. */
+typedef struct {
+	int id;
+	const char *name;
+	const char *value;
+} ExpectedHeader;
+
+static const char *dup_msg =
+	"HTTP/1.1 200 OK\r\n"
+	"NT: first\r\n"
+	"X-Dup: a\r\n"
+	"X-Empty:\r\n"
+	"CONTENT-LENGTH: 2\r\n"
+	"x-dup: b\r\n"
+	"X-DUP:\r\n"
+	"nt: second\r\n"
+	"X-Dup:   c\r\n"
+	"\r\n"
+	"ok";
+
+static const ExpectedHeader dup_headers[] = {
+	{ HDR_NT, "NT", "first, second" },
+	{ HDR_UNKNOWN, "X-Dup", "a, b, c" },
+	{ HDR_UNKNOWN, "X-Empty", "" },
+	{ HDR_CONTENT_LENGTH, "CONTENT-LENGTH", "2" }
+};
+
+static const char *chunked_msg =
+	"HTTP/1.1 200 OK\r\n"
+	"TRANSFER-ENCODING: chunked\r\n"
+	"X-Before: 1\r\n"
+	"\r\n"
+	"5\r\nhello\r\n"
+	"6\r\n world\r\n"
+	"0\r\n"
+	"ETAG: \"t\"\r\n"
+	"X-Trailer: 2\r\n"
+	"\r\n";
+
+static const ExpectedHeader chunked_headers[] = {
+	{ HDR_TRANSFER_ENCODING, "TRANSFER-ENCODING", "chunked" },
+	{ HDR_UNKNOWN, "X-Before", "1" },
+	{ HDR_ETAG, "ETAG", "\"t\"" },
+	{ HDR_UNKNOWN, "X-Trailer", "2" }
+};
+
+/*!
+ * \brief Parses a response, all at once or one byte at a time, which must
+ * be complete.
+ */
+static void parse(http_parser_t *parser, const char *msg, int byByte)
+{
+	parse_status_t status = PARSE_INCOMPLETE;
+	size_t length = strlen(msg);
+	size_t i;
+
+	parser_response_init(parser, HTTPMETHOD_GET);
+	if (byByte) {
+		for (i = 0; i < length; i++) {
+			CHECK_INT(status, PARSE_INCOMPLETE);
+			status = parser_append(parser, msg + i, (size_t)1);
+		}
+	} else {
+		status = parser_append(parser, msg, length);
+	}
+	CHECK_INT(status, PARSE_SUCCESS);
+}
+
+/*!
+ * \brief Checks that a memptr holds a string. An empty value is the 1
+ * byte "\0" string.
+ */
+static void check_memptr(const memptr *m, const char *expected)
+{
+	if (*expected == '\0') {
+		CHECK_INT(m->length, 1);
+		CHECK(m->buf[0] == '\0');
+		return;
+	}
+	CHECK_INT(m->length, strlen(expected));
+	CHECK(strncmp(m->buf, expected, m->length) == 0);
+}
+
+/*!
+ * \brief Checks the headers of a message, in order.
+ */
+static void check_headers(http_message_t *msg,
+	const ExpectedHeader *expected, size_t count)
+{
+	http_header_t *header;
+	memptr value;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		header = httpmsg_get_hdr(msg, i);
+		CHECK(header != NULL);
+		CHECK_INT(header->name_id, expected[i].id);
+		check_memptr(&header->name, expected[i].name);
+		check_memptr(&header->value, expected[i].value);
+		if (expected[i].id != HDR_UNKNOWN) {
+			CHECK(httpmsg_find_hdr(msg, expected[i].id, &value) ==
+				header);
+			check_memptr(&value, expected[i].value);
+		}
+		CHECK(httpmsg_find_hdr_str(msg, expected[i].name) == header);
+	}
+	CHECK(httpmsg_get_hdr(msg, count) == NULL);
+}
+
+/*!
+ * \brief Checks a message with more headers than fit inline, the known
+ * ones among the last.
+ */
+static void test_many(int byByte)
+{
+	static ExpectedHeader expected[MANY_HEADERS + 2];
+	static char names[MANY_HEADERS][16];
+	static char values[MANY_HEADERS][32];
+	char msg[4096];
+	size_t length;
+	http_parser_t parser;
+	int i;
+
+	length = (size_t)snprintf(msg, sizeof(msg), "HTTP/1.1 200 OK\r\n");
+	for (i = 0; i < MANY_HEADERS; i++) {
+		snprintf(names[i], sizeof(names[i]), "X-H%02d", i);
+		snprintf(values[i], sizeof(values[i]), "value of header %d",
+			i);
+		expected[i].id = HDR_UNKNOWN;
+		expected[i].name = names[i];
+		expected[i].value = values[i];
+		length += (size_t)snprintf(msg + length, sizeof(msg) - length,
+			"%s: %s\r\n", names[i], values[i]);
+	}
+	expected[i].id = HDR_ETAG;
+	expected[i].name = "ETag";
+	expected[i].value = "\"many\"";
+	expected[i + 1].id = HDR_CONTENT_LENGTH;
+	expected[i + 1].name = "Content-Length";
+	expected[i + 1].value = "4";
+	snprintf(msg + length, sizeof(msg) - length,
+		"ETag: \"many\"\r\nContent-Length: 4\r\n\r\nbody");
+	parse(&parser, msg, byByte);
+	CHECK_INT(parser.msg.num_headers, MANY_HEADERS + 2);
+	check_headers(&parser.msg, expected, MANY_HEADERS + 2);
+	CHECK_INT(parser.msg.entity.length, 4);
+	CHECK(strncmp(parser.msg.entity.buf, "body", 4) == 0);
+	httpmsg_destroy(&parser.msg);
+}
+
+/*!
+ * \brief Checks the repeated headers and the empty values.
+ */
+static void test_repeated(int byByte)
+{
+	http_parser_t parser;
+
+	parse(&parser, dup_msg, byByte);
+	check_headers(&parser.msg, dup_headers,
+		sizeof(dup_headers) / sizeof(dup_headers[0]));
+	httpmsg_destroy(&parser.msg);
+}
+
+/*!
+ * \brief Checks the trailers of a chunked message and the headers before
+ * them, once the chunk lines and the trailers left the raw message.
+ */
+static void test_trailers(int byByte)
+{
+	http_parser_t parser;
+
+	parse(&parser, chunked_msg, byByte);
+	check_headers(&parser.msg, chunked_headers,
+		sizeof(chunked_headers) / sizeof(chunked_headers[0]));
+	CHECK_INT(parser.msg.entity.length, 11);
+	CHECK(strncmp(parser.msg.entity.buf, "hello world", 11) == 0);
+	CHECK(strstr(parser.msg.msg.buf, "X-Trailer") == NULL);
+	httpmsg_destroy(&parser.msg);
+}
+
+/*!
+ * \brief Checks that a kept value survives the changes of the message
+ * buffer, and the other headers follow the buffer.
+ */
+static void test_keep(void)
+{
+	static const char padding[4096];
+	http_parser_t parser;
+	http_header_t *kept;
+	http_header_t *dup;
+	memptr value;
+	size_t i;
+
+	parse(&parser, dup_msg, FALSE);
+	kept = httpmsg_find_hdr(&parser.msg, HDR_CONTENT_LENGTH, NULL);
+	CHECK(kept != NULL);
+	CHECK_INT(httpmsg_keep_hdr_value(&parser.msg, kept), UPNP_E_SUCCESS);
+	CHECK(kept->value.buf < parser.msg.msg.buf ||
+		kept->value.buf >= parser.msg.msg.buf + parser.msg.msg.length);
+	/* the message moves, the kept value does not */
+	value = kept->value;
+	for (i = 0; i < 8; i++) {
+		CHECK_INT(membuffer_insert(&parser.msg.msg, padding, i + 1,
+			parser.msg.msg.length), 0);
+		CHECK_INT(membuffer_append(&parser.msg.msg, padding,
+			sizeof(padding)), 0);
+	}
+	CHECK(kept->value.buf == value.buf);
+	check_memptr(&kept->value, "2");
+	CHECK(httpmsg_find_hdr(&parser.msg, HDR_CONTENT_LENGTH, &value) == kept);
+	check_memptr(&value, "2");
+	/* kept twice */
+	CHECK_INT(httpmsg_keep_hdr_value(&parser.msg, kept), UPNP_E_SUCCESS);
+	CHECK(kept->value.buf == value.buf);
+	/* the joined values have their own buffer already */
+	dup = httpmsg_find_hdr_str(&parser.msg, "X-DUP");
+	CHECK(dup != NULL);
+	value = dup->value;
+	CHECK_INT(httpmsg_keep_hdr_value(&parser.msg, dup), UPNP_E_SUCCESS);
+	CHECK(dup->value.buf == value.buf);
+	check_headers(&parser.msg, dup_headers,
+		sizeof(dup_headers) / sizeof(dup_headers[0]));
+	httpmsg_destroy(&parser.msg);
+}
+
+int main(int argc, char *argv[])
+{
+	int byByte;
+
+	(void)argc;
+	(void)argv;
+	for (byByte = FALSE; byByte <= TRUE; byByte++) {
+		test_many(byByte);
+		test_repeated(byByte);
+		test_trailers(byByte);
+	}
+	test_keep();
+
+	return EXIT_SUCCESS;
+}
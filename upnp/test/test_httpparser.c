@@ -0,0 +1,322 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Tests the classification of header names, request methods and
+ * SSDP search targets by the HTTP parser.
+ *
+ * The test looks up every name of Http_Header_Names in upper, lower and
+ * mixed case, and names that only nearly match one. It parses a request of
+ * every method, checks that methods are case-sensitive, classifies search
+ * targets with ssdp_request_type1(), and parses SSDP and SOAP messages to
+ * check the id and the value of each of their headers.
+ */
+
+
+#include "testutil.h"
+#include "../src/inc/httpparser.h"
+#include "../src/inc/ssdplib.h"
+#include "../src/inc/statcodes.h"
+#include "../src/inc/strintmap.h"
+
+
+#include <ctype.h>
+#include <string.h>
+
+
+/*! Table of the header names, see httpparser.c. */
+extern str_int_entry Http_Header_Names[];
+
+/*! Number of entries of Http_Header_Names. */
+#define NUM_HTTP_HEADER_NAMES 35
+
+/*! Header expected in a parsed message. */
+typedef struct {
+	int id;
+	const char *name;
+	const char *value;
+} ExpectedHeader;
+
+static const char *notify_msg =
+	"NOTIFY * HTTP/1.1\r\n"
+	"HOST: 239.255.255.250:1900\r\n"
+	"CACHE-CONTROL: max-age=1800\r\n"
+	"LOCATION: http://192.0.2.1:49152/description.xml\r\n"
+	"NT: urn:schemas-upnp-org:service:AVTransport:1\r\n"
+	"NTS: ssdp:alive\r\n"
+	"SERVER: Linux/3.0 UPnP/1.0 Renderer/1.0\r\n"
+	"USN: uuid:5f9ec1b3-ed59-49ad-b3e8-2c9c4e5e4a8b"
+		"::urn:schemas-upnp-org:service:AVTransport:1\r\n"
+	"X-TEST: 1\r\n"
+	"\r\n";
+
+static const ExpectedHeader notify_headers[] = {
+	{ HDR_HOST, "HOST", "239.255.255.250:1900" },
+	{ HDR_CACHE_CONTROL, "CACHE-CONTROL", "max-age=1800" },
+	{ HDR_LOCATION, "LOCATION",
+		"http://192.0.2.1:49152/description.xml" },
+	{ HDR_NT, "NT", "urn:schemas-upnp-org:service:AVTransport:1" },
+	{ HDR_NTS, "NTS", "ssdp:alive" },
+	{ HDR_SERVER, "SERVER", "Linux/3.0 UPnP/1.0 Renderer/1.0" },
+	{ HDR_USN, "USN", "uuid:5f9ec1b3-ed59-49ad-b3e8-2c9c4e5e4a8b"
+		"::urn:schemas-upnp-org:service:AVTransport:1" },
+	{ HDR_UNKNOWN, "X-TEST", "1" }
+};
+
+static const char *soap_msg =
+	"POST /upnp/control/AVTransport1 HTTP/1.1\r\n"
+	"Host: 192.0.2.1:49152\r\n"
+	"Content-Length: 4\r\n"
+	"Content-Type: text/xml; charset=\"utf-8\"\r\n"
+	"SOAPACTION: \"urn:schemas-upnp-org:service:AVTransport:1#Play\"\r\n"
+	"User-Agent: Linux/3.0, UPnP/1.0, Portable SDK for UPnP devices\r\n"
+	"Connection: keep-alive\r\n"
+	"accept-encoding: gzip\r\n"
+	"Accept-Language: en-US\r\n"
+	"\r\n"
+	"body";
+
+static const ExpectedHeader soap_headers[] = {
+	{ HDR_HOST, "Host", "192.0.2.1:49152" },
+	{ HDR_CONTENT_LENGTH, "Content-Length", "4" },
+	{ HDR_CONTENT_TYPE, "Content-Type", "text/xml; charset=\"utf-8\"" },
+	{ HDR_SOAPACTION, "SOAPACTION",
+		"\"urn:schemas-upnp-org:service:AVTransport:1#Play\"" },
+	{ HDR_USER_AGENT, "User-Agent",
+		"Linux/3.0, UPnP/1.0, Portable SDK for UPnP devices" },
+	{ HDR_UNKNOWN, "Connection", "keep-alive" },
+	{ HDR_ACCEPT_ENCODING, "accept-encoding", "gzip" },
+	{ HDR_ACCEPT_LANGUAGE, "Accept-Language", "en-US" }
+};
+
+static int name_to_id(const char *name)
+{
+	return http_header_name_to_id(name, strlen(name));
+}
+
+/*!
+ * \brief Checks the lookup of every known header name.
+ */
+static void test_header_names(void)
+{
+	static const char *unknown[] = {
+		"", "H", "HOS", "HOSTS", "HOSX", "H0ST", "HOS\xd4", "HOST ",
+		"CONTENT_LENGTH", "ACCEPT-RANGE", "IF-MODIFIED-SINCE",
+		"CONNECTION", "X-TEST", "TRANSFER-ENCODINGS"
+	};
+	char name[32];
+	size_t length;
+	size_t j;
+	int i;
+
+	for (i = 0; i < NUM_HTTP_HEADER_NAMES; i++) {
+		length = strlen(Http_Header_Names[i].name);
+		CHECK(length < sizeof(name));
+		memcpy(name, Http_Header_Names[i].name, length + 1);
+		CHECK_INT(name_to_id(name), Http_Header_Names[i].id);
+		for (j = 0; j < length; j++)
+			name[j] = (char)tolower((unsigned char)name[j]);
+		CHECK_INT(name_to_id(name), Http_Header_Names[i].id);
+		for (j = 0; j < length; j += 2)
+			name[j] = (char)toupper((unsigned char)name[j]);
+		CHECK_INT(name_to_id(name), Http_Header_Names[i].id);
+		/* only the given length is read */
+		memcpy(name, Http_Header_Names[i].name, length);
+		strcpy(name + length, "S");
+		CHECK_INT(http_header_name_to_id(name, length),
+			Http_Header_Names[i].id);
+	}
+	for (j = 0; j < sizeof(unknown) / sizeof(unknown[0]); j++)
+		CHECK_INT(name_to_id(unknown[j]), HDR_UNKNOWN);
+}
+
+/*!
+ * \brief Parses a message, which must be complete.
+ */
+static void parse(http_parser_t *parser, const char *msg, int isRequest)
+{
+	parse_status_t status;
+
+	if (isRequest)
+		parser_request_init(parser);
+	else
+		parser_response_init(parser, HTTPMETHOD_MSEARCH);
+	status = parser_append(parser, msg, strlen(msg));
+	/* as ssdp_handle_datagram(), accept a NOTIFY without body length */
+	CHECK(status == PARSE_SUCCESS || parser->valid_ssdp_notify_hack);
+}
+
+/*!
+ * \brief Parses a request, returns its parse status.
+ */
+static parse_status_t parse_method(http_parser_t *parser,
+	const char *method)
+{
+	char msg[256];
+
+	snprintf(msg, sizeof(msg),
+		"%s /ctl HTTP/1.1\r\n"
+		"HOST: 192.0.2.1:49152\r\n"
+		"CONTENT-LENGTH: 0\r\n"
+		"\r\n", method);
+	parser_request_init(parser);
+
+	return parser_append(parser, msg, strlen(msg));
+}
+
+/*!
+ * \brief Checks the classification of the request methods.
+ */
+static void test_methods(void)
+{
+	static const struct {
+		const char *name;
+		int id;
+	} methods[] = {
+		{ "GET", HTTPMETHOD_GET },
+		{ "HEAD", HTTPMETHOD_HEAD },
+		{ "M-POST", HTTPMETHOD_MPOST },
+		{ "M-SEARCH", HTTPMETHOD_MSEARCH },
+		{ "NOTIFY", HTTPMETHOD_NOTIFY },
+		{ "POST", HTTPMETHOD_POST },
+		{ "SUBSCRIBE", HTTPMETHOD_SUBSCRIBE },
+		{ "UNSUBSCRIBE", HTTPMETHOD_UNSUBSCRIBE }
+	};
+	static const char *unknown[] = {
+		"get", "Post", "GETS", "NOTIFZ", "M-SEARCHX", "SUBSCRIB", "PUT"
+	};
+	http_parser_t parser;
+	size_t i;
+
+	for (i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+		CHECK_INT(parse_method(&parser, methods[i].name),
+			PARSE_SUCCESS);
+		CHECK_INT(parser.msg.method, methods[i].id);
+		httpmsg_destroy(&parser.msg);
+	}
+	for (i = 0; i < sizeof(unknown) / sizeof(unknown[0]); i++) {
+		CHECK_INT(parse_method(&parser, unknown[i]), PARSE_FAILURE);
+		CHECK_INT(parser.http_error_code, HTTP_NOT_IMPLEMENTED);
+		httpmsg_destroy(&parser.msg);
+	}
+}
+
+/*!
+ * \brief Checks the classification of the SSDP search targets.
+ */
+static void test_search_targets(void)
+{
+	static const struct {
+		const char *target;
+		enum SsdpSearchType type;
+	} targets[] = {
+		{ "ssdp:all", SSDP_ALL },
+		{ "upnp:rootdevice", SSDP_ROOTDEVICE },
+		{ "uuid:5f9ec1b3-ed59-49ad-b3e8-2c9c4e5e4a8b", SSDP_DEVICEUDN },
+		{ "urn:schemas-upnp-org:device:MediaRenderer:1",
+			SSDP_DEVICETYPE },
+		{ "urn:schemas-upnp-org:service:AVTransport:1", SSDP_SERVICE },
+		/* the precedence of the patterns */
+		{ "uuid:5f9ec1b3::upnp:rootdevice", SSDP_ROOTDEVICE },
+		{ "uuid:5f9ec1b3::urn:schemas-upnp-org:device:Basic:1",
+			SSDP_DEVICEUDN },
+		{ "upnp:rootdevice::ssdp:all", SSDP_ALL },
+		{ "urn:x:device:y:service:z", SSDP_DEVICETYPE },
+		/* no match */
+		{ "", SSDP_SERROR },
+		{ "bogus", SSDP_SERROR },
+		{ "schemas-upnp-org:device:MediaRenderer:1", SSDP_SERROR },
+		{ "urn:schemas-upnp-org:device", SSDP_SERROR },
+		{ "ssdp:al", SSDP_SERROR }
+	};
+	char target[128];
+	size_t i;
+
+	for (i = 0; i < sizeof(targets) / sizeof(targets[0]); i++) {
+		snprintf(target, sizeof(target), "%s", targets[i].target);
+		CHECK_INT(ssdp_request_type1(target), targets[i].type);
+	}
+}
+
+static void check_memptr(const memptr *m, const char *expected)
+{
+	CHECK_INT(m->length, strlen(expected));
+	CHECK(strncmp(m->buf, expected, m->length) == 0);
+}
+
+/*!
+ * \brief Parses a message and checks its headers, in order.
+ */
+static void test_message(const char *msg, int isRequest,
+	const ExpectedHeader *expected, size_t count)
+{
+	http_parser_t parser;
+	http_header_t *header;
+	memptr value;
+	size_t i;
+
+	parse(&parser, msg, isRequest);
+	for (i = 0; i < count; i++) {
+		header = httpmsg_get_hdr(&parser.msg, i);
+		CHECK(header != NULL);
+		CHECK_INT(header->name_id, expected[i].id);
+		check_memptr(&header->name, expected[i].name);
+		check_memptr(&header->value, expected[i].value);
+		if (expected[i].id != HDR_UNKNOWN) {
+			CHECK(httpmsg_find_hdr(&parser.msg, expected[i].id,
+				&value) == header);
+			check_memptr(&value, expected[i].value);
+		}
+		CHECK(httpmsg_find_hdr_str(&parser.msg, expected[i].name) ==
+			header);
+	}
+	CHECK(httpmsg_get_hdr(&parser.msg, count) == NULL);
+	CHECK(httpmsg_find_hdr(&parser.msg, HDR_ETAG, NULL) == NULL);
+	httpmsg_destroy(&parser.msg);
+}
+
+int main(int argc, char *argv[])
+{
+	(void)argc;
+	(void)argv;
+	test_header_names();
+	test_methods();
+	test_search_targets();
+	test_message(notify_msg, TRUE, notify_headers,
+		sizeof(notify_headers) / sizeof(notify_headers[0]));
+	test_message(soap_msg, TRUE, soap_headers,
+		sizeof(soap_headers) / sizeof(soap_headers[0]));
+
+	return EXIT_SUCCESS;
+}
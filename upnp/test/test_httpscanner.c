@@ -0,0 +1,195 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Tests the line scan of the HTTP scanner.
+ *
+ * The scanner skips runs of plain octets up to the next CR, LF, quote or
+ * 8 bit char, many octets at a time. The test parses responses whose
+ * status line and header value have every length up to several scan
+ * widths, followed by each kind of stop char: a CRLF or LF end of line, a
+ * quoted string holding a CRLF, a folded line, and an 8 bit char outside
+ * quotes. Each response is fed in two parts split at every offset, so that
+ * the end of the buffer also falls on every octet.
+ */
+
+
+#include "testutil.h"
+#include "../src/inc/httpparser.h"
+
+
+#include <string.h>
+
+
+/*! Longest run of plain octets, a few times the widest scan. */
+#define MAX_RUN 100
+
+/*! Plain octets, with separators, white space and a control char. */
+static const char plain[] = "Ab0;c=d, e/f(g)h\t-{x}\x01?@[y]\\z";
+
+/*! Stop char following the run of plain octets of the header value. */
+typedef enum {
+	/*! The line ends with a CRLF. */
+	STOP_CRLF,
+	/*! The line ends with a LF alone. */
+	STOP_LF,
+	/*! A quoted string holding a CRLF and an 8 bit char. */
+	STOP_QUOTE,
+	/*! The value goes on on the next line. */
+	STOP_FOLD,
+	/*! An 8 bit char outside quotes, the message is bad. */
+	STOP_8BIT,
+	NUM_STOPS
+} Stop;
+
+/*!
+ * \brief Builds a run of plain octets.
+ */
+static void plain_run(char *buf, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		buf[i] = plain[i % (sizeof(plain) - 1)];
+	buf[n] = '\0';
+}
+
+/*!
+ * \brief Parses a response fed in two parts.
+ *
+ * \return The status of the parse.
+ */
+static parse_status_t parse_split(http_parser_t *parser, const char *msg,
+	size_t split)
+{
+	parse_status_t status = PARSE_INCOMPLETE;
+	size_t length = strlen(msg);
+
+	parser_response_init(parser, HTTPMETHOD_GET);
+	if (split > (size_t)0)
+		status = parser_append(parser, msg, split);
+	if (split < length) {
+		if (status != PARSE_INCOMPLETE)
+			return status;
+		status = parser_append(parser, msg + split, length - split);
+	}
+
+	return status;
+}
+
+/*!
+ * \brief Checks the responses with a run of n plain octets.
+ */
+static void test_run(size_t n, Stop stop)
+{
+	char run[MAX_RUN + 1];
+	char value[MAX_RUN + 32];
+	char expected[MAX_RUN + 32];
+	char msg[3 * MAX_RUN];
+	const char *eol = stop == STOP_LF ? "\n" : "\r\n";
+	http_parser_t parser;
+	http_header_t *header;
+	size_t length;
+	size_t split;
+
+	plain_run(run, n);
+	switch (stop) {
+	case STOP_QUOTE:
+		snprintf(value, sizeof(value), "%s\"q\r\nX-Not: \xe9\\\"\"!",
+			run);
+		break;
+	case STOP_FOLD:
+		snprintf(value, sizeof(value), "%s\r\n\t+", run);
+		break;
+	case STOP_8BIT:
+		snprintf(value, sizeof(value), "%s\xe9!", run);
+		break;
+	default:
+		snprintf(value, sizeof(value), "%s", run);
+		break;
+	}
+	/* the white space around the value, folds included before it, is
+	 * not part of it */
+	snprintf(expected, sizeof(expected), "%s",
+		value + strspn(value, " \t\r\n"));
+	length = strlen(expected);
+	while (length > 0 && (expected[length - 1] == ' ' ||
+	       expected[length - 1] == '\t'))
+		expected[--length] = '\0';
+	length = (size_t)snprintf(msg, sizeof(msg),
+		"HTTP/1.1 200 %s%sX-Value: %s%sCONTENT-LENGTH: 0%s%s",
+		run, eol, value, eol, eol, eol);
+	CHECK(length < sizeof(msg));
+	for (split = 0; split <= length; split++) {
+		if (stop == STOP_8BIT) {
+			CHECK_INT(parse_split(&parser, msg, split),
+				PARSE_FAILURE);
+			httpmsg_destroy(&parser.msg);
+			continue;
+		}
+		CHECK_INT(parse_split(&parser, msg, split), PARSE_SUCCESS);
+		CHECK_INT(parser.msg.status_code, 200);
+		CHECK_INT(parser.msg.status_msg.length, n);
+		CHECK(memcmp(parser.msg.status_msg.buf, run, n) == 0);
+		CHECK_INT(parser.msg.num_headers, 2);
+		header = httpmsg_find_hdr_str(&parser.msg, "X-Value");
+		CHECK(header != NULL);
+		if (*expected == '\0') {
+			/* an empty value is the 1 byte "\0" string */
+			CHECK_INT(header->value.length, 1);
+			CHECK(header->value.buf[0] == '\0');
+		} else {
+			CHECK_INT(header->value.length, strlen(expected));
+			CHECK(memcmp(header->value.buf, expected,
+				header->value.length) == 0);
+		}
+		CHECK(httpmsg_find_hdr(&parser.msg, HDR_CONTENT_LENGTH, NULL) !=
+			NULL);
+		httpmsg_destroy(&parser.msg);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	size_t n;
+	int stop;
+
+	(void)argc;
+	(void)argv;
+	for (n = 0; n <= MAX_RUN; n++)
+		for (stop = 0; stop < NUM_STOPS; stop++)
+			test_run(n, (Stop)stop);
+
+	return EXIT_SUCCESS;
+}
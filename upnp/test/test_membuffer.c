@@ -0,0 +1,282 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Tests the growth and the recycling of membuffers.
+ *
+ * The test checks that a buffer appended one byte at a time is moved a
+ * logarithmic number of times, never by more than MEMBUF_MAX_GROWTH bytes
+ * at once, and only shrinks once less than a quarter full. It checks that
+ * freed buffers of the pooled sizes are reused by the next buffers of the
+ * same thread, the smallest fitting one first, up to MEMBUF_POOL_SIZE of
+ * them, and never by another thread. Random appends, inserts, deletes and
+ * assignments are then checked against a plain array.
+ */
+
+
+#include "testutil.h"
+#include "../src/inc/config.h"
+#include "../src/inc/membuffer.h"
+
+
+#include <string.h>
+
+
+/*! Bytes appended one at a time. */
+#define APPENDS (4 * 1024 * 1024)
+
+/*! Random operations of the content check. */
+#define OPERATIONS 20000
+
+/*! Largest content of the content check. */
+#define MAX_CONTENT 100000
+
+/*! Buffer freed by the other thread, while it waits. */
+static char *other_buf;
+static TestCounter other_freed;
+static ithread_mutex_t other_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ithread_cond_t other_cond = PTHREAD_COND_INITIALIZER;
+static int other_done;
+
+/*!
+ * \brief Returns a buffer holding length bytes, grown from empty.
+ */
+static void make_buffer(membuffer *m, size_t length)
+{
+	static char bytes[MEMBUF_POOL_MAX_SIZE];
+
+	membuffer_init(m);
+	CHECK_INT(membuffer_append(m, bytes, length), 0);
+	CHECK_INT(m->length, length);
+}
+
+/*!
+ * \brief Frees a buffer of its thread, then waits until told to exit.
+ */
+static void *other_thread(void *arg)
+{
+	membuffer m;
+
+	(void)arg;
+	make_buffer(&m, 3000);
+	other_buf = m.buf;
+	membuffer_destroy(&m);
+	test_counter_add(&other_freed, 1);
+	ithread_mutex_lock(&other_mutex);
+	while (!other_done)
+		ithread_cond_wait(&other_cond, &other_mutex);
+	ithread_mutex_unlock(&other_mutex);
+
+	return NULL;
+}
+
+static void test_pool(void)
+{
+	static const size_t sizes[MEMBUF_POOL_SIZE + 1] = {
+		16000, 4000, 8000, 3000, 5000 };
+	char *freed[MEMBUF_POOL_SIZE + 1];
+	size_t capacity[MEMBUF_POOL_SIZE + 1];
+	membuffer m[MEMBUF_POOL_SIZE + 1];
+	membuffer n;
+	ithread_t thread;
+	char *buf;
+	int i;
+
+	/* a buffer freed by another thread is not reused */
+	test_counter_init(&other_freed);
+	ithread_create(&thread, NULL, other_thread, NULL);
+	CHECK_INT(test_counter_wait(&other_freed, 1), 1);
+	make_buffer(&n, 3000);
+	CHECK(n.buf != other_buf);
+	buf = n.buf;
+	membuffer_destroy(&n);
+	ithread_mutex_lock(&other_mutex);
+	other_done = TRUE;
+	ithread_cond_broadcast(&other_cond);
+	ithread_mutex_unlock(&other_mutex);
+	ithread_join(thread, NULL);
+
+	/* but by the next buffer of this thread, less one byte */
+	make_buffer(&n, 2000);
+	CHECK(n.buf == buf);
+	CHECK_INT(n.capacity, 2999);
+
+	/* the pool keeps MEMBUF_POOL_SIZE buffers */
+	for (i = 0; i <= MEMBUF_POOL_SIZE; i++) {
+		make_buffer(&m[i], sizes[i]);
+		CHECK_INT(m[i].capacity, sizes[i]);
+	}
+	for (i = 0; i <= MEMBUF_POOL_SIZE; i++) {
+		freed[i] = m[i].buf;
+		capacity[i] = m[i].capacity;
+		membuffer_destroy(&m[i]);
+	}
+	/* the smallest fitting one first: 8000 for 5000 */
+	make_buffer(&m[0], 5000);
+	CHECK(m[0].buf == freed[2]);
+	CHECK_INT(m[0].capacity, capacity[2] - 1);
+	/* 4000 for 3500, 16000 for 9000 */
+	make_buffer(&m[1], 3500);
+	CHECK(m[1].buf == freed[1]);
+	make_buffer(&m[2], 9000);
+	CHECK(m[2].buf == freed[0]);
+	/* 3000 for a small one */
+	make_buffer(&m[3], 10);
+	CHECK(m[3].buf == freed[3]);
+	CHECK_INT(m[3].capacity, capacity[3] - 1);
+	/* the fifth buffer was freed, the pool is empty */
+	make_buffer(&m[4], 2500);
+	CHECK_INT(m[4].capacity, 2500);
+	for (i = 0; i <= MEMBUF_POOL_SIZE; i++)
+		membuffer_destroy(&m[i]);
+	membuffer_destroy(&n);
+}
+
+static void test_growth(void)
+{
+	membuffer m;
+	char *buf = NULL;
+	size_t capacity = 0;
+	long moves = 0;
+	long i;
+
+	membuffer_init(&m);
+	for (i = 0; i < APPENDS; i++) {
+		CHECK_INT(membuffer_append(&m, "x", 1), 0);
+		if (m.capacity != capacity) {
+			/* doubled, by at most MEMBUF_MAX_GROWTH bytes */
+			CHECK(m.capacity - capacity <=
+				(size_t)MEMBUF_MAX_GROWTH);
+			CHECK(m.capacity >= 2 * capacity ||
+				m.capacity - capacity ==
+				(size_t)MEMBUF_MAX_GROWTH);
+			moves++;
+		}
+		capacity = m.capacity;
+		buf = m.buf;
+	}
+	CHECK(buf[APPENDS - 1] == 'x');
+	CHECK(buf[APPENDS] == '\0');
+	/* 20 doublings up to MEMBUF_MAX_GROWTH, then steps */
+	CHECK(moves < 20 + APPENDS / MEMBUF_MAX_GROWTH + 2);
+
+	/* kept while at least a quarter full */
+	membuffer_delete(&m, 0, APPENDS - capacity / 4);
+	CHECK_INT(m.capacity, capacity);
+	CHECK_INT(m.length, capacity / 4);
+	membuffer_delete(&m, 0, 1);
+	CHECK(m.capacity < capacity);
+	CHECK(m.capacity >= m.length);
+	CHECK(m.buf[m.length - 1] == 'x');
+	CHECK(m.buf[m.length] == '\0');
+	membuffer_destroy(&m);
+}
+
+/*!
+ * \brief Random edits checked against a plain array.
+ */
+static void test_contents(void)
+{
+	static char model[MAX_CONTENT + 1];
+	static char bytes[MAX_CONTENT];
+	unsigned long seed = 1;
+	size_t length = 0;
+	size_t index;
+	size_t count;
+	membuffer m;
+	int i;
+
+	for (i = 0; i < MAX_CONTENT; i++)
+		bytes[i] = (char)('a' + i % 26);
+	membuffer_init(&m);
+	for (i = 0; i < OPERATIONS; i++) {
+		seed = seed * 1103515245 + 12345;
+		count = (seed >> 8) % (i % 100 == 0 ? 20000 : 300);
+		index = length ? (seed >> 4) % (length + 1) : 0;
+		switch ((seed >> 16) % 5) {
+		case 0:
+			if (length + count > MAX_CONTENT)
+				count = MAX_CONTENT - length;
+			CHECK_INT(membuffer_append(&m, bytes + i % 26, count),
+				0);
+			memcpy(model + length, bytes + i % 26, count);
+			length += count;
+			break;
+		case 1:
+			if (length + count > MAX_CONTENT)
+				count = MAX_CONTENT - length;
+			CHECK_INT(membuffer_insert(&m, bytes + i % 7, count,
+				index), 0);
+			memmove(model + index + count, model + index,
+				length - index);
+			memcpy(model + index, bytes + i % 7, count);
+			length += count;
+			break;
+		case 2:
+		case 3:
+			if (index + count > length)
+				count = length - index;
+			membuffer_delete(&m, index, count);
+			memmove(model + index, model + index + count,
+				length - index - count);
+			length -= count;
+			break;
+		default:
+			count %= 64;
+			CHECK_INT(membuffer_assign(&m, bytes + i % 3, count),
+				0);
+			memcpy(model, bytes + i % 3, count);
+			length = count;
+			break;
+		}
+		CHECK_INT(m.length, length);
+		CHECK(m.capacity >= m.length);
+		if (length > 0) {
+			CHECK(memcmp(m.buf, model, length) == 0);
+			CHECK(m.buf[length] == '\0');
+		}
+	}
+	membuffer_destroy(&m);
+}
+
+int main(int argc, char *argv[])
+{
+	(void)argc;
+	(void)argv;
+	test_pool();
+	test_growth();
+	test_contents();
+
+	return EXIT_SUCCESS;
+}
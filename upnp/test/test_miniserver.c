@@ -0,0 +1,179 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Tests the receive loop of the running miniserver.
+ *
+ * The test sends bursts of NOTIFY datagrams of distinct devices to the
+ * SSDP port, and opens a number of connections to the HTTP port before
+ * sending a request on any of them. Each burst and each set of connections
+ * arrives while the loop waits, so that an edge-triggered poller gets one
+ * wakeup for all of them: every device must reach the control point
+ * exactly once and every connection must get a response, without further
+ * traffic. The library must then stop its loop when it finishes.
+ */
+
+
+#include "testutil.h"
+#include "../src/inc/config.h"
+
+
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+
+/*! Number of bursts, and of sets of connections. */
+#define BURSTS 3
+
+/*! Datagrams per burst, more than a read of the SSDP socket takes. */
+#define BURST_LEN (3 * SSDP_RECV_BATCH_SIZE + 5)
+
+/*! Connections per set. */
+#define CONNS 16
+
+static const char *device_type = "urn:schemas-upnp-org:device:MediaRenderer:1";
+
+static TestCounter alive_count;
+/*! Number of advertisements of each device. */
+static int seen[BURSTS * BURST_LEN];
+
+static int callback(Upnp_EventType EventType, void *Event, void *Cookie)
+{
+	struct Upnp_Discovery *d_event = (struct Upnp_Discovery *)Event;
+	int device;
+	int seq;
+
+	(void)Cookie;
+	if (EventType != UPNP_DISCOVERY_ADVERTISEMENT_ALIVE)
+		return 0;
+	CHECK(test_location(d_event->Location, &device, &seq) == 0);
+	CHECK(device >= 0 && device < BURSTS * BURST_LEN);
+	ithread_mutex_lock(&alive_count.mutex);
+	seen[device]++;
+	ithread_mutex_unlock(&alive_count.mutex);
+	test_counter_add(&alive_count, 1);
+
+	return 0;
+}
+
+/*!
+ * \brief Opens connections to the HTTP port, then sends a request on each
+ * of them and checks that each one gets a response.
+ */
+static void check_connections(void)
+{
+	static const char *request =
+		"GET /test_miniserver.xml HTTP/1.1\r\n"
+		"HOST: 127.0.0.1\r\n"
+		"CONNECTION: close\r\n\r\n";
+	struct sockaddr_in addr;
+	struct timeval tv;
+	SOCKET socks[CONNS];
+	char reply[512];
+	ssize_t n;
+	int i;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(UpnpGetServerPort());
+	addr.sin_addr.s_addr = inet_addr(UpnpGetServerIpAddress());
+	/* fail rather than wait for a connection never accepted */
+	tv.tv_sec = TEST_TIMEOUT / 1000;
+	tv.tv_usec = 0;
+	for (i = 0; i < CONNS; i++) {
+		socks[i] = socket(AF_INET, SOCK_STREAM, 0);
+		CHECK(socks[i] != INVALID_SOCKET);
+		CHECK(setsockopt(socks[i], SOL_SOCKET, SO_RCVTIMEO, &tv,
+			sizeof(tv)) == 0);
+		CHECK(connect(socks[i], (struct sockaddr *)&addr,
+			sizeof(addr)) == 0);
+	}
+	for (i = 0; i < CONNS; i++)
+		CHECK(send(socks[i], request, strlen(request), MSG_NOSIGNAL) ==
+			(ssize_t)strlen(request));
+	for (i = 0; i < CONNS; i++) {
+		n = recv(socks[i], reply, sizeof(reply) - 1, 0);
+		CHECK(n > 0);
+		reply[n] = '\0';
+		CHECK(strncmp(reply, "HTTP/1.1 ", 9) == 0);
+		close(socks[i]);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	UpnpClient_Handle handle = -1;
+	struct sockaddr_in addr;
+	char msg[1024];
+	SOCKET tx;
+	int device;
+	int b;
+	int i;
+
+	(void)argc;
+	(void)argv;
+	test_counter_init(&alive_count);
+	test_start_client(callback, &handle);
+	tx = socket(AF_INET, SOCK_DGRAM, 0);
+	CHECK(tx != INVALID_SOCKET);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(1900);
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	for (b = 0; b < BURSTS; b++) {
+		for (i = 0; i < BURST_LEN; i++) {
+			device = b * BURST_LEN + i;
+			test_notify(msg, sizeof(msg), device, device_type,
+				"ssdp:alive", 0);
+			CHECK(sendto(tx, msg, strlen(msg), 0,
+				(struct sockaddr *)&addr, sizeof(addr)) ==
+				(ssize_t)strlen(msg));
+		}
+		CHECK_INT(test_counter_wait(&alive_count, (b + 1) * BURST_LEN),
+			(b + 1) * BURST_LEN);
+		check_connections();
+	}
+	/* no extra advertisement */
+	imillisleep(100);
+	CHECK_INT(test_counter_get(&alive_count), BURSTS * BURST_LEN);
+	for (device = 0; device < BURSTS * BURST_LEN; device++)
+		CHECK_INT(seen[device], 1);
+	close(tx);
+	test_finish_client(handle);
+
+	return EXIT_SUCCESS;
+}
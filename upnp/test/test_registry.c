@@ -0,0 +1,310 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Tests the control point device registry.
+ *
+ * The test enables the registry, reads advertisements of a few devices
+ * through the SSDP receive path and registers the description of one of
+ * them. It checks the lookups by UDN, USN and control URL, the expiry of
+ * a device not advertised again within its max-age, the removal on byebye
+ * and by UpnpRegistry_RemoveDevice(), and that the visitors may call back
+ * into the registry.
+ */
+
+
+#include "testutil.h"
+
+
+#include <string.h>
+#include <unistd.h>
+
+
+/*! Number of devices. */
+#define DEVICES 4
+
+/*! Device that expires. */
+#define EXPIRING 0
+
+/*! Device advertised again before it expires. */
+#define REFRESHED 1
+
+/*! Device whose description is registered. */
+#define DESCRIBED 2
+
+/*! Device that sends a byebye. */
+#define LEAVING 3
+
+/*! Max-age of the devices that expire, in s. */
+#define SHORT_MAX_AGE 2
+
+static const char *device_type =
+	"urn:schemas-upnp-org:device:MediaRenderer:1";
+static const char *avtransport =
+	"urn:schemas-upnp-org:service:AVTransport:1";
+
+static const char *description_fmt =
+	"<?xml version=\"1.0\"?>\n"
+	"<root xmlns=\"urn:schemas-upnp-org:device-1-0\">\n"
+	"<specVersion><major>1</major><minor>0</minor></specVersion>\n"
+	"<device>\n"
+	"<deviceType>urn:schemas-upnp-org:device:MediaRenderer:1</deviceType>\n"
+	"<friendlyName>Renderer</friendlyName>\n"
+	"<UDN>%s</UDN>\n"
+	"<serviceList>\n"
+	"<service>\n"
+	"<serviceType>urn:schemas-upnp-org:service:AVTransport:1</serviceType>\n"
+	"<serviceId>urn:upnp-org:serviceId:AVTransport</serviceId>\n"
+	"<controlURL>/avt/control</controlURL>\n"
+	"<eventSubURL>/avt/event</eventSubURL>\n"
+	"</service>\n"
+	"<service>\n"
+	"<serviceType>urn:schemas-upnp-org:service:RenderingControl:1"
+	"</serviceType>\n"
+	"<serviceId>urn:upnp-org:serviceId:RenderingControl</serviceId>\n"
+	"<controlURL>rc/control</controlURL>\n"
+	"<eventSubURL>rc/event</eventSubURL>\n"
+	"</service>\n"
+	"</serviceList>\n"
+	"</device>\n"
+	"</root>\n";
+
+static TestCounter alive_count;
+static TestCounter byebye_count;
+static TestCounter expired_count;
+/*! DeviceId of the last UPNP_DISCOVERY_DEVICE_EXPIRED callback. */
+static char expired_udn[LINE_SIZE];
+
+static int callback(Upnp_EventType EventType, void *Event, void *Cookie)
+{
+	struct Upnp_Discovery *d_event = (struct Upnp_Discovery *)Event;
+
+	(void)Cookie;
+	switch (EventType) {
+	case UPNP_DISCOVERY_ADVERTISEMENT_ALIVE:
+		test_counter_add(&alive_count, 1);
+		break;
+	case UPNP_DISCOVERY_ADVERTISEMENT_BYEBYE:
+		test_counter_add(&byebye_count, 1);
+		break;
+	case UPNP_DISCOVERY_DEVICE_EXPIRED:
+		ithread_mutex_lock(&expired_count.mutex);
+		strcpy(expired_udn, d_event->DeviceId);
+		ithread_mutex_unlock(&expired_count.mutex);
+		test_counter_add(&expired_count, 1);
+		break;
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Sends the advertisement of a service of a device and reads it.
+ */
+static void advertise(SOCKET rx, const struct sockaddr_in *addr,
+	int device, const char *nts, int maxAge)
+{
+	char msg[1024];
+
+	test_notify_max_age(msg, sizeof(msg), device, avtransport, nts, 0,
+		maxAge);
+	test_send(addr, msg);
+	test_drain(rx, FALSE);
+}
+
+static int count_device(const struct Upnp_Registry_Device *Device,
+	void *Cookie)
+{
+	(void)Device;
+	(*(int *)Cookie)++;
+
+	return 0;
+}
+
+/*! Removes the devices it visits, which needs the registry lock. */
+static int remove_device(const struct Upnp_Registry_Device *Device,
+	void *Cookie)
+{
+	struct Upnp_Registry_Device copy;
+
+	CHECK_INT(UpnpRegistry_GetDevice(Device->DeviceId, &copy),
+		UPNP_E_SUCCESS);
+	CHECK_INT(UpnpRegistry_RemoveDevice(Device->DeviceId),
+		UPNP_E_SUCCESS);
+	(*(int *)Cookie)++;
+
+	return 0;
+}
+
+/*! Looks the services it visits up, then stops. */
+static int check_service(const struct Upnp_Registry_Service *Service,
+	void *Cookie)
+{
+	struct Upnp_Registry_Service copy;
+
+	CHECK_INT(UpnpRegistry_GetServiceByControlURL(Service->ControlURL,
+		&copy), UPNP_E_SUCCESS);
+	CHECK(strcmp(copy.ServiceId, Service->ServiceId) == 0);
+	(*(int *)Cookie)++;
+
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	UpnpClient_Handle handle = -1;
+	struct Upnp_Registry_Device device;
+	struct Upnp_Registry_Service service;
+	struct sockaddr_in addr;
+	char udn[DEVICES][LINE_SIZE];
+	char usn[LINE_SIZE];
+	char desc[2048];
+	char location[LINE_SIZE];
+	IXML_Document *doc;
+	SOCKET rx;
+	int count;
+	int seq;
+	int i;
+
+	(void)argc;
+	(void)argv;
+	test_counter_init(&alive_count);
+	test_counter_init(&byebye_count);
+	test_counter_init(&expired_count);
+	test_start_client(callback, &handle);
+	rx = test_loopback_socket(&addr);
+	for (i = 0; i < DEVICES; i++)
+		snprintf(udn[i], sizeof(udn[i]), TEST_UDN_FMT, i);
+	CHECK_INT(UpnpRegistry_GetDevice(udn[0], &device), UPNP_E_FINISH);
+	CHECK_INT(UpnpRegistry_Enable(-1, 1), UPNP_E_INVALID_HANDLE);
+	CHECK_INT(UpnpRegistry_Enable(handle, 1), UPNP_E_SUCCESS);
+
+	for (i = 0; i < DEVICES; i++)
+		advertise(rx, &addr, i, "ssdp:alive",
+			i == EXPIRING || i == REFRESHED ? SHORT_MAX_AGE : TEST_MAX_AGE);
+	CHECK_INT(test_counter_wait(&alive_count, DEVICES), DEVICES);
+	count = 0;
+	CHECK_INT(UpnpRegistry_ForEachDevice(count_device, &count),
+		UPNP_E_SUCCESS);
+	CHECK_INT(count, DEVICES);
+	/* by UDN and by USN */
+	CHECK_INT(UpnpRegistry_GetDevice(udn[EXPIRING], &device),
+		UPNP_E_SUCCESS);
+	CHECK(strcmp(device.DeviceId, udn[EXPIRING]) == 0);
+	CHECK(test_location(device.Location, &i, &seq) == 0);
+	CHECK_INT(i, EXPIRING);
+	CHECK(device.Expires > 0 && device.Expires <= SHORT_MAX_AGE);
+	CHECK_INT(device.ServiceCount, 1);
+	snprintf(usn, sizeof(usn), "%s::%s", udn[DESCRIBED], avtransport);
+	CHECK_INT(UpnpRegistry_GetDevice(usn, &device), UPNP_E_SUCCESS);
+	CHECK(strcmp(device.DeviceId, udn[DESCRIBED]) == 0);
+	CHECK(device.FriendlyName[0] == '\0');
+	CHECK_INT(UpnpRegistry_GetServiceByUSN(usn, &service),
+		UPNP_E_SUCCESS);
+	CHECK(strcmp(service.ServiceType, avtransport) == 0);
+	CHECK(service.ControlURL[0] == '\0');
+	CHECK_INT(UpnpRegistry_GetDevice("uuid:unknown", &device),
+		UPNP_E_INVALID_DEVICE);
+
+	/* the description adds the URLs, resolved against the location */
+	snprintf(desc, sizeof(desc), description_fmt, udn[DESCRIBED]);
+	CHECK(ixmlParseBufferEx(desc, &doc) == IXML_SUCCESS);
+	CHECK_INT(UpnpRegistry_AddDescription(device.Location, doc, 0),
+		UPNP_E_SUCCESS);
+	strcpy(location, device.Location);
+	ixmlDocument_free(doc);
+	CHECK_INT(UpnpRegistry_GetDevice(udn[DESCRIBED], &device),
+		UPNP_E_SUCCESS);
+	CHECK(strcmp(device.FriendlyName, "Renderer") == 0);
+	CHECK_INT(device.ServiceCount, 2);
+	CHECK_INT(UpnpRegistry_GetServiceByControlURL(
+		"http://192.0.2.1:49152/avt/control", &service),
+		UPNP_E_SUCCESS);
+	CHECK(strcmp(service.DeviceId, udn[DESCRIBED]) == 0);
+	CHECK(strcmp(service.ServiceId,
+		"urn:upnp-org:serviceId:AVTransport") == 0);
+	CHECK(strcmp(service.EventURL, "http://192.0.2.1:49152/avt/event") ==
+		0);
+	CHECK(strncmp(location, "http://192.0.2.1:49152/", 23) == 0);
+	CHECK_INT(UpnpRegistry_GetServiceByControlURL("/avt/control",
+		&service), UPNP_E_INVALID_SERVICE);
+	count = 0;
+	CHECK_INT(UpnpRegistry_ForEachService(udn[DESCRIBED], check_service,
+		&count), UPNP_E_SUCCESS);
+	CHECK_INT(count, 1);
+	CHECK_INT(UpnpRegistry_ForEachService("uuid:unknown", check_service,
+		&count), UPNP_E_INVALID_DEVICE);
+
+	/* a byebye removes the device */
+	advertise(rx, &addr, LEAVING, "ssdp:byebye", TEST_MAX_AGE);
+	CHECK_INT(test_counter_wait(&byebye_count, 1), 1);
+	CHECK_INT(UpnpRegistry_GetDevice(udn[LEAVING], &device),
+		UPNP_E_INVALID_DEVICE);
+
+	/* a device advertised again does not expire, the other one does */
+	advertise(rx, &addr, REFRESHED, "ssdp:alive", TEST_MAX_AGE);
+	CHECK_INT(test_counter_wait(&expired_count, 1), 1);
+	CHECK(strcmp(expired_udn, udn[EXPIRING]) == 0);
+	CHECK_INT(UpnpRegistry_GetDevice(udn[EXPIRING], &device),
+		UPNP_E_INVALID_DEVICE);
+	CHECK_INT(UpnpRegistry_GetDevice(udn[REFRESHED], &device),
+		UPNP_E_SUCCESS);
+	CHECK(device.Expires > SHORT_MAX_AGE);
+
+	/* the visitor is called without the registry lock */
+	count = 0;
+	CHECK_INT(UpnpRegistry_ForEachDevice(remove_device, &count),
+		UPNP_E_SUCCESS);
+	CHECK_INT(count, 2);
+	CHECK_INT(UpnpRegistry_RemoveDevice(udn[DESCRIBED]),
+		UPNP_E_INVALID_DEVICE);
+	count = 0;
+	CHECK_INT(UpnpRegistry_ForEachDevice(count_device, &count),
+		UPNP_E_SUCCESS);
+	CHECK_INT(count, 0);
+
+	/* disabled, the registry ignores the advertisements */
+	CHECK_INT(UpnpRegistry_Enable(handle, 0), UPNP_E_SUCCESS);
+	advertise(rx, &addr, EXPIRING, "ssdp:alive", TEST_MAX_AGE);
+	CHECK_INT(test_counter_wait(&alive_count, DEVICES + 2), DEVICES + 2);
+	CHECK_INT(UpnpRegistry_GetDevice(udn[EXPIRING], &device),
+		UPNP_E_FINISH);
+	CHECK_INT(test_counter_get(&expired_count), 1);
+	close(rx);
+	test_finish_client(handle);
+
+	return EXIT_SUCCESS;
+}
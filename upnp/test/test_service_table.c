@@ -0,0 +1,384 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Tests the service table of a device.
+ *
+ * The test builds the service table of description documents whose
+ * services share some of their serviceIds and URLs, and checks that the
+ * lookups by (UDN, serviceId) and by event and control URL path agree with
+ * a walk of the service list, the first service winning a shared key,
+ * before and after services are added. It then checks the lookups,
+ * removals and expiry of the subscriptions of a service.
+ */
+
+
+#include "testutil.h"
+#include "../src/inc/service_table.h"
+
+
+#include <string.h>
+#include <time.h>
+
+
+/*! Number of devices of the first description, the root included. */
+#define DEVICES 3
+
+/*! Number of services of a device. */
+#define SERVICES 4
+
+/*! Number of subscriptions of a service. */
+#define SUBS 50
+
+static const char *base = "http://192.168.1.20:49152/";
+
+/*!
+ * \brief Lookup by (UDN, serviceId): the first service of the list.
+ */
+static service_info *walk_service_id(service_table *table,
+	const char *serviceId, const char *UDN)
+{
+	service_info *finger;
+
+	for (finger = table->serviceList; finger; finger = finger->next)
+		if (!strcmp(serviceId, finger->serviceId) &&
+		    !strcmp(UDN, finger->UDN))
+			return finger;
+
+	return NULL;
+}
+
+/*!
+ * \brief Lookup by URL path: the first service of the list whose event or
+ * control URL has the path and query of url.
+ */
+static service_info *walk_url(service_table *table, const char *url,
+	int event)
+{
+	service_info *finger;
+	const char *serviceURL;
+	uri_type parsed_url;
+	uri_type parsed_url_in;
+
+	if (parse_uri(url, strlen(url), &parsed_url_in) != HTTP_SUCCESS)
+		return NULL;
+	for (finger = table->serviceList; finger; finger = finger->next) {
+		serviceURL = event ? finger->eventURL : finger->controlURL;
+		if (serviceURL &&
+		    parse_uri(serviceURL, strlen(serviceURL),
+			&parsed_url) == HTTP_SUCCESS &&
+		    !token_cmp(&parsed_url.pathquery, &parsed_url_in.pathquery))
+			return finger;
+	}
+
+	return NULL;
+}
+
+static void make_udn(char *buf, size_t size, int device)
+{
+	snprintf(buf, size, "uuid:3e1a6c20-5d2b-4f7e-9c41-%012d", device);
+}
+
+/*!
+ * \brief Appends a service to a description.
+ */
+static size_t add_service(char *doc, size_t size, size_t length,
+	const char *serviceId, const char *control, const char *event)
+{
+	return length + (size_t)snprintf(doc + length, size - length,
+		"<service>"
+		"<serviceType>urn:schemas-upnp-org:service:Test:1</serviceType>"
+		"<serviceId>urn:upnp-org:serviceId:%s</serviceId>"
+		"<SCPDURL>/scpd.xml</SCPDURL>"
+		"<controlURL>%s</controlURL>"
+		"<eventSubURL>%s</eventSubURL>"
+		"</service>\n", serviceId, control, event);
+}
+
+/*!
+ * \brief Parses a description of devices from first on. Device d has the
+ * services Service0 to Service<SERVICES - 1>, at /devd/srvs/control and
+ * devd/srvs/event, and the services below, which share a key with one of
+ * them.
+ */
+static IXML_Document *make_description(int first, int devices)
+{
+	IXML_Document *doc = NULL;
+	char buf[8192];
+	char control[64];
+	char event[64];
+	char udn[64];
+	char id[32];
+	size_t length = 0;
+	int d;
+	int s;
+
+	length += (size_t)snprintf(buf + length, sizeof(buf) - length,
+		"<?xml version=\"1.0\"?>\n"
+		"<root xmlns=\"urn:schemas-upnp-org:device-1-0\">\n"
+		"<URLBase>%s</URLBase>\n", base);
+	for (d = first; d < first + devices; d++) {
+		make_udn(udn, sizeof(udn), d);
+		length += (size_t)snprintf(buf + length, sizeof(buf) - length,
+			"<device><UDN>%s</UDN><serviceList>\n", udn);
+		for (s = 0; s < SERVICES; s++) {
+			snprintf(id, sizeof(id), "Service%d", s);
+			snprintf(control, sizeof(control),
+				"/dev%d/srv%d/control", d, s);
+			snprintf(event, sizeof(event),
+				"dev%d/srv%d/event?id=%d", d, s, s);
+			length = add_service(buf, sizeof(buf), length, id,
+				control, event);
+		}
+		/* the serviceId of the first service, the event URL of the
+		 * first service of the first device, and the control URL of
+		 * the last one, absolute */
+		snprintf(control, sizeof(control),
+			"http://10.0.0.1/dev%d/srv%d/control", d, SERVICES - 1);
+		snprintf(event, sizeof(event), "/dev%d/srv0/event?id=0",
+			first);
+		length = add_service(buf, sizeof(buf), length, "Service0",
+			control, event);
+		length += (size_t)snprintf(buf + length, sizeof(buf) - length,
+			"</serviceList>%s\n",
+			d == first ? "<deviceList>" : "</device>");
+	}
+	snprintf(buf + length, sizeof(buf) - length,
+		"</deviceList></device></root>\n");
+	CHECK(ixmlParseBufferEx(buf, &doc) == IXML_SUCCESS);
+
+	return doc;
+}
+
+/*!
+ * \brief Checks the lookups of the services of the devices below devices,
+ * of missing ones and of URLs which are no service URL.
+ */
+static void check_services(service_table *table, int devices)
+{
+	static const char *misses[] = {
+		"/", "", "/dev0", "/dev0/srv0/event", "/dev0/srv0/event?id=1",
+		"/dev0/srv0/controlx", "/DEV0/srv0/control",
+		"http://192.168.1.20:49152/dev0/srv1/event?id=2"
+	};
+	char serviceId[64];
+	char udn[64];
+	char url[128];
+	service_info *service;
+	int found = 0;
+	int d;
+	int s;
+	int i;
+
+	for (d = 0; d <= devices; d++) {
+		make_udn(udn, sizeof(udn), d);
+		for (s = 0; s <= SERVICES; s++) {
+			snprintf(serviceId, sizeof(serviceId),
+				"urn:upnp-org:serviceId:Service%d", s);
+			service = FindServiceId(table, serviceId, udn);
+			CHECK(service == walk_service_id(table, serviceId,
+				udn));
+			if (service == NULL)
+				continue;
+			found++;
+			CHECK(strcmp(service->UDN, udn) == 0);
+			/* the first service of the device with this id */
+			CHECK(s > 0 ||
+				strstr(service->controlURL, "10.0.0.1") == NULL);
+			/* as sent in the request line, or absolute */
+			snprintf(url, sizeof(url), "/dev%d/srv%d/control",
+				d, s);
+			CHECK(FindServiceControlURLPath(table, url) == service);
+			snprintf(url, sizeof(url), "/dev%d/srv%d/event?id=%d",
+				d, s, s);
+			CHECK(FindServiceEventURLPath(table, url) == service);
+			snprintf(url, sizeof(url),
+				"%sdev%d/srv%d/event?id=%d", base, d, s, s);
+			CHECK(FindServiceEventURLPath(table, url) == service);
+		}
+		/* unknown service, and a serviceId of another device */
+		CHECK(FindServiceId(table, "urn:upnp-org:serviceId:Other",
+			udn) == NULL);
+		CHECK(FindServiceId(table, udn, udn) == NULL);
+	}
+	CHECK_INT(found, devices * SERVICES);
+	for (i = 0; i < (int)(sizeof(misses) / sizeof(misses[0])); i++) {
+		snprintf(url, sizeof(url), "%s", misses[i]);
+		CHECK(FindServiceEventURLPath(table, url) ==
+			walk_url(table, url, TRUE));
+		CHECK(FindServiceControlURLPath(table, url) ==
+			walk_url(table, url, FALSE));
+	}
+	CHECK(FindServiceEventURLPath(table, "/dev0/srv1/event?id=2") == NULL);
+	CHECK(FindServiceControlURLPath(table, "/dev0/srv0/controlx") == NULL);
+}
+
+static subscription *new_subscription(const char *sid)
+{
+	subscription *sub;
+
+	sub = calloc(1, sizeof(subscription));
+	CHECK(sub != NULL);
+	snprintf(sub->sid, sizeof(sub->sid), "%s", sid);
+	sub->active = 1;
+
+	return sub;
+}
+
+static void make_sid(Upnp_SID sid, int i)
+{
+	snprintf(sid, sizeof(Upnp_SID), "uuid:1c4f07d2-9e3a-4b5c-8d6e-%012d",
+		i);
+}
+
+/*!
+ * \brief Checks the links of the subscription list of a service.
+ *
+ * \return The number of subscriptions in the list.
+ */
+static int check_subscriptions(service_info *service)
+{
+	subscription *sub;
+	int count = 0;
+
+	for (sub = service->subscriptionList; sub; sub = sub->next) {
+		CHECK(sub->prev == NULL ? sub == service->subscriptionList :
+			sub->prev->next == sub);
+		CHECK(GetSubscriptionSID(sub->sid, service) == sub);
+		count++;
+	}
+	CHECK_INT(count, service->TotalSubscriptions);
+
+	return count;
+}
+
+int main(int argc, char *argv[])
+{
+	service_table table;
+	IXML_Document *doc;
+	IXML_Document *doc2;
+	service_info *service;
+	service_info *other;
+	subscription *subs[SUBS];
+	subscription *sub;
+	Upnp_SID sid;
+	char udn[64];
+	time_t now;
+	int count;
+	int i;
+
+	(void)argc;
+	(void)argv;
+	memset(&table, 0, sizeof(table));
+	doc = make_description(0, DEVICES);
+	CHECK(getServiceTable((IXML_Node *)doc, &table, NULL));
+	CHECK(table.byServiceId.slots != NULL);
+	check_services(&table, DEVICES);
+
+	/* a second root device: the indexes are rebuilt, and its event URL
+	 * shared with the first one does not hide it */
+	doc2 = make_description(DEVICES, 1);
+	CHECK(addServiceTable((IXML_Node *)doc2, &table, NULL));
+	check_services(&table, DEVICES + 1);
+	make_udn(udn, sizeof(udn), 0);
+	service = FindServiceId(&table, "urn:upnp-org:serviceId:Service0",
+		udn);
+	CHECK(FindServiceEventURLPath(&table, "/dev0/srv0/event?id=0") ==
+		service);
+	make_udn(udn, sizeof(udn), DEVICES);
+	other = FindServiceId(&table, "urn:upnp-org:serviceId:Service1", udn);
+	CHECK(other != NULL && other != service);
+
+	/* subscriptions of a service */
+	for (i = 0; i < SUBS; i++) {
+		make_sid(sid, i);
+		subs[i] = new_subscription(sid);
+		CHECK_INT(AddSubscription(subs[i], service), UPNP_E_SUCCESS);
+	}
+	/* the same SID in another service is another subscription */
+	make_sid(sid, 0);
+	sub = new_subscription(sid);
+	CHECK(GetSubscriptionSID(sid, other) == NULL);
+	CHECK_INT(AddSubscription(sub, other), UPNP_E_SUCCESS);
+	CHECK(GetSubscriptionSID(sid, other) == sub);
+	CHECK(GetSubscriptionSID(sid, service) == subs[0]);
+	CHECK_INT(check_subscriptions(service), SUBS);
+	make_sid(sid, SUBS);
+	CHECK(GetSubscriptionSID(sid, service) == NULL);
+
+	/* head, tail and middle */
+	RemoveSubscriptionSID(subs[SUBS - 1]->sid, service);
+	RemoveSubscriptionSID(subs[0]->sid, service);
+	RemoveSubscriptionSID(subs[SUBS / 2]->sid, service);
+	subs[0] = subs[SUBS / 2] = subs[SUBS - 1] = NULL;
+	for (i = 0; i < SUBS; i++) {
+		make_sid(sid, i);
+		CHECK(GetSubscriptionSID(sid, service) == subs[i]);
+	}
+	CHECK_INT(check_subscriptions(service), SUBS - 3);
+	make_sid(sid, 0);
+	RemoveSubscriptionSID(sid, service);
+	CHECK_INT(check_subscriptions(service), SUBS - 3);
+	CHECK(GetSubscriptionSID(sid, other) == sub);
+
+	/* an expired subscription goes when met, an inactive one is
+	 * skipped by the iteration only */
+	time(&now);
+	subs[1]->expireTime = now - 10;
+	subs[2]->expireTime = now + 1800;
+	subs[3]->active = 0;
+	CHECK(GetSubscriptionSID(subs[1]->sid, service) == NULL);
+	subs[1] = NULL;
+	CHECK(GetSubscriptionSID(subs[2]->sid, service) == subs[2]);
+	CHECK(GetSubscriptionSID(subs[3]->sid, service) == subs[3]);
+	subs[4]->expireTime = now - 10;
+	subs[SUBS - 2]->expireTime = now - 10;
+	count = 0;
+	for (sub = GetFirstSubscription(service); sub;
+	     sub = GetNextSubscription(service, sub)) {
+		CHECK(sub->active);
+		CHECK(sub != subs[4] && sub != subs[SUBS - 2]);
+		count++;
+	}
+	CHECK_INT(count, SUBS - 7);
+	CHECK_INT(check_subscriptions(service), SUBS - 6);
+	make_sid(sid, 4);
+	CHECK(GetSubscriptionSID(sid, service) == NULL);
+
+	freeServiceTable(&table);
+	ixmlDocument_free(doc);
+	ixmlDocument_free(doc2);
+
+	return EXIT_SUCCESS;
+}
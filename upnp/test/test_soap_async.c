@@ -0,0 +1,556 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Tests the asynchronous SOAP actions and state variable queries of
+ * a control point.
+ *
+ * The test plays a device that answers each request as its control URL
+ * asks: at once, after a delay, with a fault, with 405 to a POST, by
+ * closing the connection or never. It checks that every request completes
+ * exactly once with the right result, that the requests to a slow device
+ * are all in flight at the same time, that a POST refused with 405 is sent
+ * again as M-POST, and that the requests still in flight complete with
+ * UPNP_E_FINISH when the library finishes.
+ */
+
+
+#include "testutil.h"
+
+
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+
+/*! Number of actions sent to the slow device. */
+#define ACTIONS 64
+
+/*! Time the slow device takes to answer, in ms. */
+#define DELAY 500
+
+/*! Number of requests in flight when the library finishes. */
+#define HANGING 16
+
+/*! Maximum number of requests of the test. */
+#define MAX_REQUESTS 128
+
+/*! Maximum number of connections of the device. */
+#define MAX_CONNS 256
+
+/*! Service type of the action. */
+#define SERVICE_TYPE "urn:schemas-upnp-org:service:RenderingControl:1"
+
+static const char *action_xml =
+	"<u:GetVolume xmlns:u=\"" SERVICE_TYPE "\">"
+	"<InstanceID>0</InstanceID><Channel>Master</Channel>"
+	"</u:GetVolume>";
+
+static const char *header_xml = "<h:Token xmlns:h=\"urn:test\">abc</h:Token>";
+
+static const char *action_body =
+	"<s:Body><u:GetVolumeResponse xmlns:u=\"" SERVICE_TYPE "\">"
+	"<CurrentVolume>42</CurrentVolume>"
+	"</u:GetVolumeResponse></s:Body>";
+
+static const char *var_body =
+	"<s:Body><u:QueryStateVariableResponse "
+	"xmlns:u=\"urn:schemas-upnp-org:control-1-0\">"
+	"<return>17</return>"
+	"</u:QueryStateVariableResponse></s:Body>";
+
+static const char *fault_body =
+	"<s:Body><s:Fault><faultcode>s:Client</faultcode>"
+	"<faultstring>UPnPError</faultstring><detail>"
+	"<UPnPError xmlns=\"urn:schemas-upnp-org:control-1-0\">"
+	"<errorCode>402</errorCode>"
+	"<errorDescription>Invalid Args</errorDescription>"
+	"</UPnPError></detail></s:Fault></s:Body>";
+
+/*! A connection of the device. */
+typedef struct {
+	SOCKET sock;
+	char buf[4096];
+	size_t len;
+	/*! Time the response is due, 0 if none is pending. */
+	unsigned long due;
+	/*! Body of the response, NULL for a 405. */
+	const char *body;
+	/*! The request never gets a response. */
+	int hang;
+} Conn;
+
+/*! Completion of a request. */
+typedef struct {
+	int calls;
+	int errCode;
+	/*! Returned value: CurrentVolume of an action, or the variable. */
+	long value;
+	char ctrlUrl[NAME_SIZE];
+} Result;
+
+static Conn conns[MAX_CONNS];
+static int num_conns = 0;
+static SOCKET listener = INVALID_SOCKET;
+static volatile int stop_device = FALSE;
+
+static ithread_mutex_t device_mutex = PTHREAD_MUTEX_INITIALIZER;
+/*! Requests received, and received as M-POST. */
+static long requests = 0;
+static long mposts = 0;
+/*! Requests waiting for their response, and the most seen. */
+static long pending = 0;
+static long max_pending = 0;
+/*! Requests received carrying header_xml. */
+static long headers = 0;
+
+static Result results[MAX_REQUESTS];
+static TestCounter completed;
+
+static unsigned long now_ms(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return (unsigned long)tv.tv_sec * 1000UL +
+		(unsigned long)tv.tv_usec / 1000UL;
+}
+
+/*!
+ * \brief Returns the length of the request in the buffer of a connection,
+ * 0 if it is not complete yet.
+ */
+static size_t request_length(Conn *c)
+{
+	char *end;
+	char *cl;
+	size_t body;
+
+	c->buf[c->len] = '\0';
+	end = strstr(c->buf, "\r\n\r\n");
+	if (end == NULL)
+		return 0;
+	cl = strstr(c->buf, "CONTENT-LENGTH:");
+	body = cl != NULL && cl < end ? (size_t)atol(cl + 15) : 0;
+	if (c->len < (size_t)(end + 4 - c->buf) + body)
+		return 0;
+
+	return (size_t)(end + 4 - c->buf) + body;
+}
+
+/*!
+ * \brief Sends the pending response of a connection.
+ */
+static void send_response(Conn *c)
+{
+	char body[1024];
+	char msg[2048];
+	int len;
+
+	if (c->body == NULL) {
+		len = snprintf(msg, sizeof(msg),
+			"HTTP/1.1 405 Method Not Allowed\r\n"
+			"CONTENT-LENGTH: 0\r\n\r\n");
+	} else {
+		snprintf(body, sizeof(body),
+			"<s:Envelope "
+			"xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" "
+			"s:encodingStyle="
+			"\"http://schemas.xmlsoap.org/soap/encoding/\">"
+			"%s</s:Envelope>", c->body);
+		len = snprintf(msg, sizeof(msg),
+			"HTTP/1.1 %s\r\n"
+			"CONTENT-TYPE: text/xml; charset=\"utf-8\"\r\n"
+			"CONTENT-LENGTH: %u\r\n"
+			"EXT:\r\n\r\n%s",
+			c->body == fault_body ?
+				"500 Internal Server Error" : "200 OK",
+			(unsigned)strlen(body), body);
+	}
+	if (send(c->sock, msg, (size_t)len, MSG_NOSIGNAL) != len) {
+		close(c->sock);
+		c->sock = INVALID_SOCKET;
+	}
+	c->due = 0;
+	ithread_mutex_lock(&device_mutex);
+	pending--;
+	ithread_mutex_unlock(&device_mutex);
+}
+
+/*!
+ * \brief Handles a request received on a connection.
+ *
+ * The path of the control URL tells how to answer: /ok, /slow, /fault,
+ * /var, /405, /close or /hang.
+ */
+static void handle_request(Conn *c)
+{
+	const char *path = strchr(c->buf, ' ');
+	int mpost = strncmp(c->buf, "M-POST ", 7) == 0;
+
+	CHECK(path != NULL);
+	path++;
+	ithread_mutex_lock(&device_mutex);
+	requests++;
+	if (mpost) {
+		CHECK(strstr(c->buf, "MAN: \"http://schemas.xmlsoap.org/"
+			"soap/envelope/\"; ns=01\r\n") != NULL);
+		CHECK(strstr(c->buf, "01-SOAPACTION: ") != NULL);
+		mposts++;
+	}
+	if (strstr(c->buf, header_xml) != NULL)
+		headers++;
+	if (strncmp(path, "/close ", 7) != 0 &&
+	    ++pending > max_pending)
+		max_pending = pending;
+	ithread_mutex_unlock(&device_mutex);
+	c->body = action_body;
+	c->due = now_ms();
+	if (strncmp(path, "/slow ", 6) == 0) {
+		c->due += DELAY;
+	} else if (strncmp(path, "/fault ", 7) == 0) {
+		c->body = fault_body;
+	} else if (strncmp(path, "/var ", 5) == 0) {
+		CHECK(strstr(c->buf, "<u:varName>Volume</u:varName>") !=
+			NULL);
+		c->body = var_body;
+	} else if (strncmp(path, "/405 ", 5) == 0) {
+		if (!mpost)
+			c->body = NULL;
+	} else if (strncmp(path, "/close ", 7) == 0) {
+		close(c->sock);
+		c->sock = INVALID_SOCKET;
+		c->due = 0;
+	} else if (strncmp(path, "/hang ", 6) == 0) {
+		c->hang = TRUE;
+		c->due = 0;
+	} else {
+		CHECK(strncmp(path, "/ok ", 4) == 0);
+	}
+}
+
+/*!
+ * \brief The device: answers the requests of its connections.
+ */
+static void *device_thread(void *arg)
+{
+	static struct pollfd fds[MAX_CONNS + 1];
+	unsigned long now;
+	size_t length;
+	ssize_t n;
+	SOCKET sock;
+	int i;
+	int j;
+
+	(void)arg;
+	while (!stop_device) {
+		/* drop the closed connections */
+		for (i = 0, j = 0; i < num_conns; i++)
+			if (conns[i].sock != INVALID_SOCKET)
+				conns[j++] = conns[i];
+		num_conns = j;
+		now = now_ms();
+		for (i = 0; i < num_conns; i++)
+			if (conns[i].due != 0 && conns[i].due <= now)
+				send_response(&conns[i]);
+		fds[0].fd = listener;
+		fds[0].events = POLLIN;
+		fds[0].revents = 0;
+		for (i = 0; i < num_conns; i++) {
+			fds[i + 1].fd = conns[i].sock;
+			fds[i + 1].events = POLLIN;
+			fds[i + 1].revents = 0;
+		}
+		if (poll(fds, (nfds_t)(num_conns + 1), 10) <= 0)
+			continue;
+		for (i = 0; i < num_conns; i++) {
+			if (fds[i + 1].revents == 0 ||
+			    conns[i].sock == INVALID_SOCKET)
+				continue;
+			n = recv(conns[i].sock, conns[i].buf + conns[i].len,
+				sizeof(conns[i].buf) - 1 - conns[i].len, 0);
+			if (n <= 0) {
+				if (conns[i].due != 0 || conns[i].hang) {
+					ithread_mutex_lock(&device_mutex);
+					pending--;
+					ithread_mutex_unlock(&device_mutex);
+				}
+				close(conns[i].sock);
+				conns[i].sock = INVALID_SOCKET;
+				continue;
+			}
+			conns[i].len += (size_t)n;
+			length = request_length(&conns[i]);
+			if (length == 0)
+				continue;
+			handle_request(&conns[i]);
+			/* one request at a time on a connection, ending
+			 * with a CRLF or not */
+			CHECK(conns[i].len - length <= 2);
+			conns[i].len = 0;
+		}
+		if (fds[0].revents != 0) {
+			sock = accept(listener, NULL, NULL);
+			CHECK(sock != INVALID_SOCKET);
+			CHECK(num_conns < MAX_CONNS);
+			memset(&conns[num_conns], 0, sizeof(Conn));
+			conns[num_conns].sock = sock;
+			num_conns++;
+		}
+	}
+	for (i = 0; i < num_conns; i++)
+		if (conns[i].sock != INVALID_SOCKET)
+			close(conns[i].sock);
+
+	return NULL;
+}
+
+/*!
+ * \brief Returns the integer value of the first element of a document
+ * with the given name, -1 if none.
+ */
+static long element_value(IXML_Document *doc, const char *name)
+{
+	IXML_NodeList *nodes;
+	IXML_Node *text;
+	long value = -1;
+
+	nodes = ixmlDocument_getElementsByTagName(doc, name);
+	if (nodes == NULL)
+		return -1;
+	text = ixmlNode_getFirstChild(ixmlNodeList_item(nodes, 0));
+	if (text != NULL)
+		value = atol(ixmlNode_getNodeValue(text));
+	ixmlNodeList_free(nodes);
+
+	return value;
+}
+
+static int callback(Upnp_EventType EventType, void *Event, void *Cookie)
+{
+	struct Upnp_Action_Complete *a_event =
+		(struct Upnp_Action_Complete *)Event;
+	struct Upnp_State_Var_Complete *v_event =
+		(struct Upnp_State_Var_Complete *)Event;
+	Result *result = (Result *)Cookie;
+
+	CHECK(result >= results && result < results + MAX_REQUESTS);
+	switch (EventType) {
+	case UPNP_CONTROL_ACTION_COMPLETE:
+		result->errCode = a_event->ErrCode;
+		CHECK(a_event->ActionRequest != NULL);
+		CHECK_INT(element_value(a_event->ActionRequest, "InstanceID"),
+			0);
+		if (a_event->ActionResult != NULL)
+			result->value = element_value(a_event->ActionResult,
+				"CurrentVolume");
+		strcpy(result->ctrlUrl, a_event->CtrlUrl);
+		break;
+	case UPNP_CONTROL_GET_VAR_COMPLETE:
+		result->errCode = v_event->ErrCode;
+		CHECK(strcmp(v_event->StateVarName, "Volume") == 0);
+		if (v_event->CurrentVal != NULL)
+			result->value = atol(v_event->CurrentVal);
+		strcpy(result->ctrlUrl, v_event->CtrlUrl);
+		break;
+	default:
+		CHECK(FALSE);
+	}
+	/* the library finishes with these requests in flight */
+	if (result->errCode == UPNP_E_FINISH)
+		CHECK(result >= results + MAX_REQUESTS - HANGING);
+	result->calls++;
+	test_counter_add(&completed, 1);
+
+	return 0;
+}
+
+/*!
+ * \brief Waits for the completions of the requests sent so far and checks
+ * that none completed twice.
+ */
+static void wait_completed(long count)
+{
+	int i;
+
+	CHECK_INT(test_counter_wait(&completed, count), count);
+	/* no extra completion */
+	imillisleep(50);
+	CHECK_INT(test_counter_get(&completed), count);
+	for (i = 0; i < MAX_REQUESTS; i++)
+		CHECK(results[i].calls <= 1);
+}
+
+static long device_count(long *counter)
+{
+	long value;
+
+	ithread_mutex_lock(&device_mutex);
+	value = *counter;
+	ithread_mutex_unlock(&device_mutex);
+
+	return value;
+}
+
+int main(int argc, char *argv[])
+{
+	UpnpClient_Handle handle = -1;
+	IXML_Document *action = NULL;
+	IXML_Document *header = NULL;
+	struct sockaddr_in addr;
+	socklen_t addrLen = sizeof(addr);
+	ithread_t device;
+	unsigned short port;
+	char url[128];
+	char base[64];
+	unsigned long start;
+	long sent = 0;
+	int i;
+
+	(void)argc;
+	(void)argv;
+	test_counter_init(&completed);
+	for (i = 0; i < MAX_REQUESTS; i++)
+		results[i].value = -1;
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	CHECK(listener != INVALID_SOCKET);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	CHECK(bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+	CHECK(listen(listener, MAX_CONNS) == 0);
+	CHECK(getsockname(listener, (struct sockaddr *)&addr, &addrLen) == 0);
+	port = ntohs(addr.sin_port);
+	snprintf(base, sizeof(base), "http://127.0.0.1:%u", port);
+	ithread_create(&device, NULL, device_thread, NULL);
+	test_start_client(callback, &handle);
+	CHECK(ixmlParseBufferEx(action_xml, &action) == IXML_SUCCESS);
+	CHECK(ixmlParseBufferEx(header_xml, &header) == IXML_SUCCESS);
+
+	/* all the actions to a slow device are in flight at once */
+	snprintf(url, sizeof(url), "%s/slow", base);
+	start = now_ms();
+	for (i = 0; i < ACTIONS; i++)
+		CHECK_INT(UpnpSendActionAsync(handle, url, SERVICE_TYPE, NULL,
+			action, callback, &results[sent++]), UPNP_E_SUCCESS);
+	wait_completed(sent);
+	CHECK(now_ms() - start >= DELAY);
+	CHECK_INT(device_count(&max_pending), ACTIONS);
+	for (i = 0; i < ACTIONS; i++) {
+		CHECK_INT(results[i].errCode, UPNP_E_SUCCESS);
+		CHECK_INT(results[i].value, 42);
+		CHECK(strcmp(results[i].ctrlUrl, url) == 0);
+	}
+
+	/* a fault gives its UPnP error code */
+	snprintf(url, sizeof(url), "%s/fault", base);
+	CHECK_INT(UpnpSendActionAsync(handle, url, SERVICE_TYPE, NULL,
+		action, callback, &results[sent++]), UPNP_E_SUCCESS);
+	wait_completed(sent);
+	CHECK_INT(results[sent - 1].errCode, 402);
+	CHECK_INT(results[sent - 1].value, -1);
+
+	/* the SOAP header reaches the device */
+	snprintf(url, sizeof(url), "%s/ok", base);
+	CHECK_INT(UpnpSendActionExAsync(handle, url, SERVICE_TYPE, NULL,
+		header, action, callback, &results[sent++]), UPNP_E_SUCCESS);
+	wait_completed(sent);
+	CHECK_INT(results[sent - 1].errCode, UPNP_E_SUCCESS);
+	CHECK_INT(results[sent - 1].value, 42);
+	CHECK_INT(device_count(&headers), 1);
+
+	/* a state variable query */
+	snprintf(url, sizeof(url), "%s/var", base);
+	CHECK_INT(UpnpGetServiceVarStatusAsync(handle, url, "Volume",
+		callback, &results[sent++]), UPNP_E_SUCCESS);
+	wait_completed(sent);
+	CHECK_INT(results[sent - 1].errCode, UPNP_E_SUCCESS);
+	CHECK_INT(results[sent - 1].value, 17);
+	CHECK(strcmp(results[sent - 1].ctrlUrl, url) == 0);
+
+	/* a POST refused with 405 is sent again as M-POST */
+	CHECK_INT(device_count(&mposts), 0);
+	snprintf(url, sizeof(url), "%s/405", base);
+	CHECK_INT(UpnpSendActionAsync(handle, url, SERVICE_TYPE, NULL,
+		action, callback, &results[sent++]), UPNP_E_SUCCESS);
+	wait_completed(sent);
+	CHECK_INT(results[sent - 1].errCode, UPNP_E_SUCCESS);
+	CHECK_INT(results[sent - 1].value, 42);
+	CHECK_INT(device_count(&mposts), 1);
+	CHECK_INT(device_count(&requests), ACTIONS + 5);
+
+	/* a connection closed without a response, and a refused one */
+	snprintf(url, sizeof(url), "%s/close", base);
+	CHECK_INT(UpnpSendActionAsync(handle, url, SERVICE_TYPE, NULL,
+		action, callback, &results[sent++]), UPNP_E_SUCCESS);
+	wait_completed(sent);
+	CHECK(results[sent - 1].errCode < 0);
+	CHECK_INT(results[sent - 1].value, -1);
+	CHECK_INT(UpnpSendActionAsync(handle, "http://127.0.0.1:1/ok",
+		SERVICE_TYPE, NULL, action, callback, &results[sent++]),
+		UPNP_E_SUCCESS);
+	wait_completed(sent);
+	CHECK(results[sent - 1].errCode < 0);
+	CHECK_INT(device_count(&pending), 0);
+
+	/* the requests in flight complete when the library finishes */
+	snprintf(url, sizeof(url), "%s/hang", base);
+	for (i = MAX_REQUESTS - HANGING; i < MAX_REQUESTS; i++)
+		CHECK_INT(UpnpSendActionAsync(handle, url, SERVICE_TYPE, NULL,
+			action, callback, &results[i]), UPNP_E_SUCCESS);
+	sent += HANGING;
+	for (i = 0; i < TEST_TIMEOUT / 10 &&
+	     device_count(&pending) < HANGING; i++)
+		imillisleep(10);
+	CHECK_INT(device_count(&pending), HANGING);
+	CHECK_INT(test_counter_get(&completed), sent - HANGING);
+	test_finish_client(handle);
+	CHECK_INT(test_counter_get(&completed), sent);
+	for (i = MAX_REQUESTS - HANGING; i < MAX_REQUESTS; i++) {
+		CHECK_INT(results[i].calls, 1);
+		CHECK_INT(results[i].errCode, UPNP_E_FINISH);
+	}
+
+	ixmlDocument_free(action);
+	ixmlDocument_free(header);
+	stop_device = TRUE;
+	ithread_join(device, NULL);
+	close(listener);
+
+	return EXIT_SUCCESS;
+}
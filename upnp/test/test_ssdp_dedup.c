@@ -0,0 +1,216 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Tests the suppression of duplicate discovery callbacks.
+ *
+ * Devices send each advertisement several times and answer each copy of a
+ * search request. The test queues such copies on a loopback socket drained
+ * by the SSDP receive path, with a window set by UpnpSetDiscoveryDedup(),
+ * and checks the callbacks made and the counters of
+ * UpnpGetDiscoveryDedupStats(): the copies are dropped, while a new
+ * LOCATION, a byebye after an advertisement, an advertisement after a
+ * byebye and the replies to a new search are not duplicates.
+ */
+
+
+#include "testutil.h"
+
+
+#include <string.h>
+#include <unistd.h>
+
+
+/*! Number of devices. */
+#define DEVICES 20
+
+/*! Copies of each message. */
+#define COPIES 3
+
+/*! Duplicate filter window, in ms. */
+#define WINDOW 60000
+
+static const char *device_type =
+	"urn:schemas-upnp-org:device:MediaRenderer:1";
+
+static TestCounter alive_count;
+static TestCounter byebye_count;
+/*! Search results of each search. */
+static TestCounter result_count[2];
+static int cookies[2];
+
+static int callback(Upnp_EventType EventType, void *Event, void *Cookie)
+{
+	(void)Event;
+	switch (EventType) {
+	case UPNP_DISCOVERY_ADVERTISEMENT_ALIVE:
+		test_counter_add(&alive_count, 1);
+		break;
+	case UPNP_DISCOVERY_ADVERTISEMENT_BYEBYE:
+		test_counter_add(&byebye_count, 1);
+		break;
+	case UPNP_DISCOVERY_SEARCH_RESULT:
+		if (Cookie == &cookies[0])
+			test_counter_add(&result_count[0], 1);
+		else if (Cookie == &cookies[1])
+			test_counter_add(&result_count[1], 1);
+		break;
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Sends copies of the advertisement or byebye of every device.
+ */
+static void send_notifies(SOCKET rx, const struct sockaddr_in *addr,
+	const char *nts, int seq, int copies)
+{
+	char msg[1024];
+	int c;
+	int i;
+
+	for (c = 0; c < copies; c++)
+		for (i = 0; i < DEVICES; i++) {
+			test_notify(msg, sizeof(msg), i, device_type, nts, seq);
+			test_send(addr, msg);
+		}
+	test_drain(rx, FALSE);
+}
+
+/*!
+ * \brief Sends copies of the search reply of every device.
+ */
+static void send_replies(SOCKET rx, const struct sockaddr_in *addr,
+	int copies)
+{
+	char msg[1024];
+	int c;
+	int i;
+
+	for (c = 0; c < copies; c++)
+		for (i = 0; i < DEVICES; i++) {
+			test_reply(msg, sizeof(msg), i, device_type, 0);
+			test_send(addr, msg);
+		}
+	test_drain(rx, TRUE);
+}
+
+static void check_stats(UpnpClient_Handle handle, unsigned long adverts,
+	unsigned long suppressedAdverts, unsigned long results,
+	unsigned long suppressedResults)
+{
+	struct Upnp_Discovery_Dedup_Stats stats;
+
+	CHECK_INT(UpnpGetDiscoveryDedupStats(handle, &stats), UPNP_E_SUCCESS);
+	CHECK_INT(stats.Advertisements, adverts);
+	CHECK_INT(stats.SuppressedAdvertisements, suppressedAdverts);
+	CHECK_INT(stats.SearchResults, results);
+	CHECK_INT(stats.SuppressedSearchResults, suppressedResults);
+}
+
+int main(int argc, char *argv[])
+{
+	UpnpClient_Handle handle = -1;
+	struct sockaddr_in addr;
+	SOCKET rx;
+
+	(void)argc;
+	(void)argv;
+	test_counter_init(&alive_count);
+	test_counter_init(&byebye_count);
+	test_counter_init(&result_count[0]);
+	test_counter_init(&result_count[1]);
+	test_start_client(callback, &handle);
+	rx = test_loopback_socket(&addr);
+	CHECK_INT(UpnpSetDiscoveryDedup(handle, -1), UPNP_E_INVALID_PARAM);
+	CHECK_INT(UpnpSetDiscoveryDedup(-1, WINDOW), UPNP_E_INVALID_HANDLE);
+	CHECK_INT(UpnpGetDiscoveryDedupStats(handle, NULL),
+		UPNP_E_INVALID_PARAM);
+
+	/* off by default */
+	send_notifies(rx, &addr, "ssdp:alive", 0, 2);
+	CHECK_INT(test_counter_wait(&alive_count, 2 * DEVICES), 2 * DEVICES);
+	check_stats(handle, 0, 0, 0, 0);
+
+	CHECK_INT(UpnpSetDiscoveryDedup(handle, WINDOW), UPNP_E_SUCCESS);
+	send_notifies(rx, &addr, "ssdp:alive", 0, COPIES);
+	CHECK_INT(test_counter_wait(&alive_count, 3 * DEVICES), 3 * DEVICES);
+	check_stats(handle, DEVICES, (COPIES - 1) * DEVICES, 0, 0);
+
+	/* a new LOCATION */
+	send_notifies(rx, &addr, "ssdp:alive", 1, COPIES);
+	CHECK_INT(test_counter_wait(&alive_count, 4 * DEVICES), 4 * DEVICES);
+	check_stats(handle, 2 * DEVICES, 2 * (COPIES - 1) * DEVICES, 0, 0);
+
+	/* a byebye forgets the advertisement, and the other way around */
+	send_notifies(rx, &addr, "ssdp:byebye", 1, COPIES);
+	CHECK_INT(test_counter_wait(&byebye_count, DEVICES), DEVICES);
+	send_notifies(rx, &addr, "ssdp:alive", 1, COPIES);
+	CHECK_INT(test_counter_wait(&alive_count, 5 * DEVICES), 5 * DEVICES);
+	send_notifies(rx, &addr, "ssdp:byebye", 1, COPIES);
+	CHECK_INT(test_counter_wait(&byebye_count, 2 * DEVICES),
+		2 * DEVICES);
+	check_stats(handle, 5 * DEVICES, 5 * (COPIES - 1) * DEVICES, 0, 0);
+
+	/* the replies to each search */
+	CHECK_INT(UpnpSearchAsync(handle, 30, "ssdp:all", &cookies[0]),
+		UPNP_E_SUCCESS);
+	send_replies(rx, &addr, COPIES);
+	CHECK_INT(test_counter_wait(&result_count[0], DEVICES), DEVICES);
+	check_stats(handle, 5 * DEVICES, 5 * (COPIES - 1) * DEVICES,
+		DEVICES, (COPIES - 1) * DEVICES);
+	CHECK_INT(UpnpSearchAsync(handle, 30, device_type, &cookies[1]),
+		UPNP_E_SUCCESS);
+	send_replies(rx, &addr, COPIES);
+	CHECK_INT(test_counter_wait(&result_count[1], DEVICES), DEVICES);
+	/* the replies match both searches */
+	CHECK_INT(test_counter_get(&result_count[0]), 2 * DEVICES);
+	check_stats(handle, 5 * DEVICES, 5 * (COPIES - 1) * DEVICES,
+		2 * DEVICES, 2 * (COPIES - 1) * DEVICES);
+
+	/* off again, the counters are reset */
+	CHECK_INT(UpnpSetDiscoveryDedup(handle, 0), UPNP_E_SUCCESS);
+	check_stats(handle, 0, 0, 0, 0);
+	send_notifies(rx, &addr, "ssdp:alive", 1, COPIES);
+	CHECK_INT(test_counter_wait(&alive_count, (5 + COPIES) * DEVICES),
+		(5 + COPIES) * DEVICES);
+	check_stats(handle, 0, 0, 0, 0);
+	close(rx);
+	test_finish_client(handle);
+
+	return EXIT_SUCCESS;
+}
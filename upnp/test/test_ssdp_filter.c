@@ -0,0 +1,205 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Tests the discovery filter.
+ *
+ * The test checks which raw datagrams ssdp_filter_datagram() lets through
+ * once UpnpSetDiscoveryFilter() set prefixes, then queues advertisements
+ * of wanted and unwanted devices on a loopback socket drained with
+ * readFromSSDPSocket(), and checks that only the wanted ones reach the
+ * callback until the filter is removed.
+ */
+
+
+#include "testutil.h"
+#include "../src/inc/ssdplib.h"
+
+
+#include <string.h>
+#include <unistd.h>
+
+
+/*! Number of devices of each type sent to the control point. */
+#define DEVICES 20
+
+/*! Device let through by its UDN whatever its type. */
+#define KNOWN_DEVICE 3
+
+static const char *renderer =
+	"urn:schemas-upnp-org:device:MediaRenderer:1";
+static const char *server =
+	"urn:schemas-upnp-org:device:MediaServer:1";
+
+static const char *msearch =
+	"M-SEARCH * HTTP/1.1\r\n"
+	"HOST: 239.255.255.250:1900\r\n"
+	"MAN: \"ssdp:discover\"\r\n"
+	"MX: 2\r\n"
+	"ST: urn:schemas-upnp-org:device:MediaServer:1\r\n"
+	"\r\n";
+
+static TestCounter alive_count;
+/*! Advertisements of the MediaServer devices delivered. */
+static TestCounter server_count;
+
+static int callback(Upnp_EventType EventType, void *Event, void *Cookie)
+{
+	struct Upnp_Discovery *d_event = (struct Upnp_Discovery *)Event;
+
+	(void)Cookie;
+	if (EventType != UPNP_DISCOVERY_ADVERTISEMENT_ALIVE)
+		return 0;
+	if (strcmp(d_event->DeviceType, server) == 0)
+		test_counter_add(&server_count, 1);
+	test_counter_add(&alive_count, 1);
+
+	return 0;
+}
+
+static int passes(const char *msg)
+{
+	return ssdp_filter_datagram(msg, strlen(msg));
+}
+
+/*!
+ * \brief Sends an advertisement of each device of both types and drains
+ * the socket.
+ */
+static void send_all(SOCKET rx, const struct sockaddr_in *addr)
+{
+	char msg[1024];
+	int i;
+
+	for (i = 0; i < DEVICES; i++) {
+		test_notify(msg, sizeof(msg), i, renderer, "ssdp:alive", 0);
+		test_send(addr, msg);
+		test_notify(msg, sizeof(msg), DEVICES + i, server,
+			"ssdp:alive", 0);
+		test_send(addr, msg);
+	}
+	test_drain(rx, FALSE);
+}
+
+int main(int argc, char *argv[])
+{
+	UpnpClient_Handle handle = -1;
+	struct sockaddr_in addr;
+	char known[LINE_SIZE];
+	const char *prefixes[2];
+	const char *nulls[1] = { NULL };
+	char msg[1024];
+	SOCKET rx;
+
+	(void)argc;
+	(void)argv;
+	test_counter_init(&alive_count);
+	test_counter_init(&server_count);
+	test_start_client(callback, &handle);
+	snprintf(known, sizeof(known), TEST_UDN_FMT, DEVICES + KNOWN_DEVICE);
+	prefixes[0] = "urn:schemas-upnp-org:device:MediaRenderer:";
+	prefixes[1] = known;
+
+	CHECK_INT(UpnpSetDiscoveryFilter(handle, prefixes, -1),
+		UPNP_E_INVALID_PARAM);
+	CHECK_INT(UpnpSetDiscoveryFilter(handle, NULL, 1),
+		UPNP_E_INVALID_PARAM);
+	CHECK_INT(UpnpSetDiscoveryFilter(handle, nulls, 1),
+		UPNP_E_INVALID_PARAM);
+	CHECK_INT(UpnpSetDiscoveryFilter(-1, prefixes, 2),
+		UPNP_E_INVALID_HANDLE);
+
+	/* no filter */
+	test_notify(msg, sizeof(msg), 0, server, "ssdp:alive", 0);
+	CHECK(passes(msg));
+
+	CHECK_INT(UpnpSetDiscoveryFilter(handle, prefixes, 2), UPNP_E_SUCCESS);
+	test_notify(msg, sizeof(msg), 0, renderer, "ssdp:alive", 0);
+	CHECK(passes(msg));
+	test_notify(msg, sizeof(msg), 0, renderer, "ssdp:byebye", 0);
+	CHECK(passes(msg));
+	test_notify(msg, sizeof(msg), 0,
+		"URN:SCHEMAS-UPNP-ORG:DEVICE:MEDIARENDERER:2", "ssdp:alive", 0);
+	CHECK(passes(msg));
+	test_reply(msg, sizeof(msg), 0, renderer, 0);
+	CHECK(passes(msg));
+	test_notify(msg, sizeof(msg), 0, server, "ssdp:alive", 0);
+	CHECK(!passes(msg));
+	test_notify(msg, sizeof(msg), 0, "upnp:rootdevice", "ssdp:byebye",
+		0);
+	CHECK(!passes(msg));
+	test_reply(msg, sizeof(msg), 0, server, 0);
+	CHECK(!passes(msg));
+	/* by the USN */
+	test_notify(msg, sizeof(msg), DEVICES + KNOWN_DEVICE, server,
+		"ssdp:alive", 0);
+	CHECK(passes(msg));
+	test_notify(msg, sizeof(msg), DEVICES + KNOWN_DEVICE,
+		"upnp:rootdevice", "ssdp:byebye", 0);
+	CHECK(passes(msg));
+	/* the requests are for the devices */
+	CHECK(passes(msearch));
+	/* a prefix longer than the value */
+	CHECK(!passes("NOTIFY * HTTP/1.1\r\nNT: urn:\r\n\r\n"));
+
+	/* the prefixes were copied */
+	known[0] = 'x';
+	test_notify(msg, sizeof(msg), DEVICES + KNOWN_DEVICE, server,
+		"ssdp:alive", 0);
+	CHECK(passes(msg));
+
+	rx = test_loopback_socket(&addr);
+	send_all(rx, &addr);
+	CHECK_INT(test_counter_wait(&alive_count, DEVICES + 1), DEVICES + 1);
+	CHECK_INT(test_counter_get(&server_count), 1);
+
+	/* removed */
+	CHECK_INT(UpnpSetDiscoveryFilter(handle, NULL, 0), UPNP_E_SUCCESS);
+	test_notify(msg, sizeof(msg), 0, server, "ssdp:alive", 0);
+	CHECK(passes(msg));
+	send_all(rx, &addr);
+	CHECK_INT(test_counter_wait(&alive_count, 3 * DEVICES + 1),
+		3 * DEVICES + 1);
+	CHECK_INT(test_counter_get(&server_count), DEVICES + 1);
+	close(rx);
+
+	/* removed by the unregistration */
+	CHECK_INT(UpnpSetDiscoveryFilter(handle, prefixes, 1), UPNP_E_SUCCESS);
+	CHECK(!passes(msg));
+	CHECK_INT(UpnpUnRegisterClient(handle), UPNP_E_SUCCESS);
+	CHECK(passes(msg));
+	CHECK_INT(UpnpFinish(), UPNP_E_SUCCESS);
+
+	return EXIT_SUCCESS;
+}
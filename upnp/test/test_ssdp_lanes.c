@@ -0,0 +1,212 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Tests the ordered delivery of the discovery callbacks.
+ *
+ * With discovery lanes set by UpnpSetDiscoveryLanes(), devices send
+ * numbered advertisements and byebyes, then numbered replies to a search,
+ * read through the SSDP receive path. The callback blocks for a while, as
+ * when it fetches the description of a device. The test checks that the
+ * callbacks of a device arrive in order, one at a time and none lost,
+ * that those of distinct devices run in parallel, and the counters of
+ * UpnpGetDiscoveryLaneStats().
+ */
+
+
+#include "testutil.h"
+
+
+#include <string.h>
+#include <unistd.h>
+
+
+/*! Number of lanes. */
+#define LANES 4
+
+/*! Number of devices. */
+#define DEVICES 8
+
+/*! Messages of each kind sent by each device. */
+#define ROUNDS 10
+
+/*! Time the callback blocks, in ms. */
+#define WORK_TIME 2
+
+static const char *device_type =
+	"urn:schemas-upnp-org:device:MediaRenderer:1";
+
+static TestCounter delivered;
+static int search_cookie;
+/*! Protects the fields below. */
+static ithread_mutex_t state_mutex;
+/*! Number of the last message delivered, per device. */
+static int last_seq[DEVICES];
+/*! TRUE while the callback handles a message of the device. */
+static int busy[DEVICES];
+/*! Callbacks running, and the most that ran at once. */
+static int running = 0;
+static int max_running = 0;
+
+static int callback(Upnp_EventType EventType, void *Event, void *Cookie)
+{
+	struct Upnp_Discovery *d_event = (struct Upnp_Discovery *)Event;
+	int device;
+	int seq;
+
+	switch (EventType) {
+	case UPNP_DISCOVERY_ADVERTISEMENT_ALIVE:
+	case UPNP_DISCOVERY_ADVERTISEMENT_BYEBYE:
+		break;
+	case UPNP_DISCOVERY_SEARCH_RESULT:
+		CHECK(Cookie == &search_cookie);
+		break;
+	default:
+		return 0;
+	}
+	CHECK(test_location(d_event->Location, &device, &seq) == 0);
+	CHECK(device >= 0 && device < DEVICES);
+	ithread_mutex_lock(&state_mutex);
+	CHECK(!busy[device]);
+	CHECK_INT(seq, last_seq[device] + 1);
+	CHECK_INT(EventType, seq < ROUNDS ? (seq % 2 ?
+		UPNP_DISCOVERY_ADVERTISEMENT_BYEBYE :
+		UPNP_DISCOVERY_ADVERTISEMENT_ALIVE) :
+		UPNP_DISCOVERY_SEARCH_RESULT);
+	busy[device] = TRUE;
+	if (++running > max_running)
+		max_running = running;
+	ithread_mutex_unlock(&state_mutex);
+	imillisleep(WORK_TIME);
+	ithread_mutex_lock(&state_mutex);
+	running--;
+	busy[device] = FALSE;
+	last_seq[device] = seq;
+	ithread_mutex_unlock(&state_mutex);
+	test_counter_add(&delivered, 1);
+
+	return 0;
+}
+
+static void check_stats(UpnpClient_Handle handle, unsigned long handled)
+{
+	struct Upnp_Discovery_Lane_Stats stats[UPNP_DISCOVERY_LANES_MAX];
+	unsigned long total = 0;
+	int count = UPNP_DISCOVERY_LANES_MAX;
+	int i;
+
+	CHECK_INT(UpnpGetDiscoveryLaneStats(handle, stats, &count),
+		UPNP_E_SUCCESS);
+	CHECK_INT(count, LANES);
+	for (i = 0; i < count; i++) {
+		CHECK_INT(stats[i].Depth, 0);
+		CHECK(stats[i].MaxDepth >= 0 &&
+			(unsigned long)stats[i].MaxDepth <= stats[i].Handled);
+		total += stats[i].Handled;
+	}
+	CHECK_INT(total, handled);
+}
+
+int main(int argc, char *argv[])
+{
+	UpnpClient_Handle handle = -1;
+	struct Upnp_Discovery_Lane_Stats stats[1];
+	struct sockaddr_in addr;
+	char msg[1024];
+	SOCKET rx;
+	int count;
+	int seq;
+	int i;
+
+	(void)argc;
+	(void)argv;
+	test_counter_init(&delivered);
+	ithread_mutex_init(&state_mutex, NULL);
+	for (i = 0; i < DEVICES; i++)
+		last_seq[i] = -1;
+	test_start_client(callback, &handle);
+	rx = test_loopback_socket(&addr);
+	CHECK_INT(UpnpSetDiscoveryLanes(handle, -1), UPNP_E_INVALID_PARAM);
+	CHECK_INT(UpnpSetDiscoveryLanes(handle, UPNP_DISCOVERY_LANES_MAX + 1),
+		UPNP_E_INVALID_PARAM);
+	CHECK_INT(UpnpSetDiscoveryLanes(-1, LANES), UPNP_E_INVALID_HANDLE);
+	CHECK_INT(UpnpSetDiscoveryLanes(handle, LANES), UPNP_E_SUCCESS);
+	count = 1;
+	CHECK_INT(UpnpGetDiscoveryLaneStats(handle, stats, &count),
+		UPNP_E_SUCCESS);
+	CHECK_INT(count, LANES);
+	CHECK_INT(UpnpGetDiscoveryLaneStats(handle, NULL, &count),
+		UPNP_E_INVALID_PARAM);
+
+	/* the bursts are read while the callbacks of the previous ones are
+	 * still running */
+	for (seq = 0; seq < ROUNDS; seq++) {
+		for (i = 0; i < DEVICES; i++) {
+			test_notify(msg, sizeof(msg), i, device_type,
+				seq % 2 ? "ssdp:byebye" : "ssdp:alive", seq);
+			test_send(&addr, msg);
+		}
+		test_drain(rx, FALSE);
+	}
+	CHECK_INT(test_counter_wait(&delivered, ROUNDS * DEVICES),
+		ROUNDS * DEVICES);
+	check_stats(handle, ROUNDS * DEVICES);
+
+	/* the search results go through the lanes too */
+	CHECK_INT(UpnpSearchAsync(handle, 30, "ssdp:all", &search_cookie),
+		UPNP_E_SUCCESS);
+	for (seq = ROUNDS; seq < 2 * ROUNDS; seq++) {
+		for (i = 0; i < DEVICES; i++) {
+			test_reply(msg, sizeof(msg), i, device_type, seq);
+			test_send(&addr, msg);
+		}
+		test_drain(rx, TRUE);
+	}
+	CHECK_INT(test_counter_wait(&delivered, 2 * ROUNDS * DEVICES),
+		2 * ROUNDS * DEVICES);
+	check_stats(handle, 2 * ROUNDS * DEVICES);
+	for (i = 0; i < DEVICES; i++)
+		CHECK_INT(last_seq[i], 2 * ROUNDS - 1);
+	/* distinct devices do not wait for each other */
+	CHECK(max_running > 1);
+
+	/* setting the lanes resets the counters */
+	CHECK_INT(UpnpSetDiscoveryLanes(handle, LANES), UPNP_E_SUCCESS);
+	check_stats(handle, 0);
+	close(rx);
+	test_finish_client(handle);
+	ithread_mutex_destroy(&state_mutex);
+
+	return EXIT_SUCCESS;
+}
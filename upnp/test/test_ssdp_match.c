@@ -0,0 +1,185 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Tests the matching of search replies against the searches in
+ * progress.
+ *
+ * The control point starts searches of each kind of target, then replies
+ * of distinct devices are read through the SSDP receive path. The test
+ * checks that each reply reaches exactly the searches it matches, once
+ * each, and that no reply reaches a search once it timed out.
+ */
+
+
+#include "testutil.h"
+
+
+#include <string.h>
+#include <unistd.h>
+
+
+/*! Searches of the test, indexes of cookies. */
+enum {
+	S_ALL,
+	S_ROOT,
+	S_RENDERER1,
+	S_RENDERER2,
+	S_AVTRANSPORT,
+	S_UDN,
+	SEARCHES
+};
+
+/*! Number of devices. */
+#define DEVICES 8
+
+/*! MX of the searches, in s. */
+#define MX 2
+
+static const char *renderer1 =
+	"urn:schemas-upnp-org:device:MediaRenderer:1";
+static const char *renderer2 =
+	"urn:schemas-upnp-org:device:MediaRenderer:2";
+static const char *avtransport =
+	"urn:schemas-upnp-org:service:AVTransport:1";
+static const char *server =
+	"urn:schemas-upnp-org:device:MediaServer:1";
+
+static int cookies[SEARCHES];
+static TestCounter result_count;
+static TestCounter timeout_count;
+/*! Results of each search, per device. */
+static int results[SEARCHES][DEVICES];
+
+static int callback(Upnp_EventType EventType, void *Event, void *Cookie)
+{
+	struct Upnp_Discovery *d_event = (struct Upnp_Discovery *)Event;
+	int search;
+	int device;
+	int seq;
+
+	if (EventType != UPNP_DISCOVERY_SEARCH_RESULT &&
+	    EventType != UPNP_DISCOVERY_SEARCH_TIMEOUT)
+		return 0;
+	search = (int)((int *)Cookie - cookies);
+	CHECK(search >= 0 && search < SEARCHES);
+	if (EventType == UPNP_DISCOVERY_SEARCH_TIMEOUT) {
+		test_counter_add(&timeout_count, 1);
+		return 0;
+	}
+	CHECK(test_location(d_event->Location, &device, &seq) == 0);
+	CHECK(device >= 0 && device < DEVICES);
+	ithread_mutex_lock(&result_count.mutex);
+	results[search][device]++;
+	ithread_mutex_unlock(&result_count.mutex);
+	test_counter_add(&result_count, 1);
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	/* reply of each device, and the searches it matches */
+	const struct {
+		const char *st;
+		int search;
+	} replies[DEVICES] = {
+		{ renderer1, S_RENDERER1 },
+		{ renderer2, S_RENDERER2 },
+		{ "upnp:rootdevice", S_ROOT },
+		{ avtransport, S_AVTRANSPORT },
+		/* the UDN of the search, see below */
+		{ NULL, S_UDN },
+		{ server, S_ALL },
+		{ NULL, S_ALL },
+		{ "urn:schemas-upnp-org:service:AVTransport:2", S_ALL },
+	};
+	UpnpClient_Handle handle = -1;
+	struct sockaddr_in addr;
+	char msg[1024];
+	char udn[LINE_SIZE];
+	SOCKET rx;
+	int expected;
+	int search;
+	int i;
+
+	(void)argc;
+	(void)argv;
+	test_counter_init(&result_count);
+	test_counter_init(&timeout_count);
+	test_start_client(callback, &handle);
+	rx = test_loopback_socket(&addr);
+	snprintf(udn, sizeof(udn), TEST_UDN_FMT, 4);
+	CHECK_INT(UpnpSearchAsync(handle, MX, "ssdp:all", &cookies[S_ALL]),
+		UPNP_E_SUCCESS);
+	CHECK_INT(UpnpSearchAsync(handle, MX, "upnp:rootdevice",
+		&cookies[S_ROOT]), UPNP_E_SUCCESS);
+	CHECK_INT(UpnpSearchAsync(handle, MX, renderer1,
+		&cookies[S_RENDERER1]), UPNP_E_SUCCESS);
+	CHECK_INT(UpnpSearchAsync(handle, MX, renderer2,
+		&cookies[S_RENDERER2]), UPNP_E_SUCCESS);
+	CHECK_INT(UpnpSearchAsync(handle, MX, avtransport,
+		&cookies[S_AVTRANSPORT]), UPNP_E_SUCCESS);
+	CHECK_INT(UpnpSearchAsync(handle, MX, udn, &cookies[S_UDN]),
+		UPNP_E_SUCCESS);
+	CHECK_INT(UpnpSearchAsync(handle, MX, "bogus", &cookies[S_ALL]),
+		UPNP_E_INVALID_PARAM);
+
+	/* each reply matches ssdp:all and at most one other search */
+	expected = 0;
+	for (i = 0; i < DEVICES; i++) {
+		test_reply(msg, sizeof(msg), i, replies[i].st, 0);
+		test_send(&addr, msg);
+		expected += replies[i].search == S_ALL ? 1 : 2;
+	}
+	test_drain(rx, TRUE);
+	CHECK_INT(test_counter_wait(&result_count, expected), expected);
+	for (search = 0; search < SEARCHES; search++)
+		for (i = 0; i < DEVICES; i++)
+			CHECK_INT(results[search][i], search == S_ALL ||
+				search == replies[i].search ? 1 : 0);
+
+	/* the searches time out after MX s and are forgotten */
+	CHECK_INT(test_counter_wait(&timeout_count, SEARCHES), SEARCHES);
+	for (i = 0; i < DEVICES; i++) {
+		test_reply(msg, sizeof(msg), i, replies[i].st, 1);
+		test_send(&addr, msg);
+	}
+	test_drain(rx, TRUE);
+	CHECK_INT(test_counter_wait(&result_count, expected + 1), expected);
+	close(rx);
+	test_finish_client(handle);
+
+	return EXIT_SUCCESS;
+}
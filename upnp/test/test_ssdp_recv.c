@@ -0,0 +1,127 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Tests the SSDP receive ring.
+ *
+ * The test queues bursts of NOTIFY datagrams of distinct devices on a
+ * loopback socket of its own and drains them with readFromSSDPSocket(), the
+ * function the miniserver calls when a SSDP socket is readable. Each call
+ * must read a full batch of SSDP_RECV_BATCH_SIZE datagrams while enough are
+ * pending, and each device must reach the control point exactly once. The
+ * bursts are larger than a batch and outnumber the batches of the ring, so
+ * that the batches are reused.
+ */
+
+
+#include "testutil.h"
+#include "../src/inc/ssdplib.h"
+
+
+#include <string.h>
+#include <unistd.h>
+
+
+/*! Number of bursts. */
+#define BURSTS (2 * SSDP_RECV_RING_BATCHES)
+
+/*! Datagrams per burst, not a multiple of the batch size. */
+#define BURST_LEN (2 * SSDP_RECV_BATCH_SIZE + 5)
+
+static const char *device_type = "urn:schemas-upnp-org:device:MediaRenderer:1";
+
+static TestCounter alive_count;
+/*! Number of advertisements of each device. */
+static int seen[BURSTS * BURST_LEN];
+
+static int callback(Upnp_EventType EventType, void *Event, void *Cookie)
+{
+	struct Upnp_Discovery *d_event = (struct Upnp_Discovery *)Event;
+	char udn[LINE_SIZE];
+	int device;
+	int seq;
+
+	(void)Cookie;
+	if (EventType != UPNP_DISCOVERY_ADVERTISEMENT_ALIVE)
+		return 0;
+	CHECK(test_location(d_event->Location, &device, &seq) == 0);
+	CHECK(device >= 0 && device < BURSTS * BURST_LEN);
+	snprintf(udn, sizeof(udn), TEST_UDN_FMT, device);
+	CHECK(strcmp(d_event->DeviceId, udn) == 0);
+	CHECK(strcmp(d_event->DeviceType, device_type) == 0);
+	ithread_mutex_lock(&alive_count.mutex);
+	seen[device]++;
+	ithread_mutex_unlock(&alive_count.mutex);
+	test_counter_add(&alive_count, 1);
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	UpnpClient_Handle handle = -1;
+	struct sockaddr_in addr;
+	char msg[1024];
+	SOCKET rx;
+	int device;
+	int b;
+	int i;
+
+	(void)argc;
+	(void)argv;
+	test_counter_init(&alive_count);
+	test_start_client(callback, &handle);
+	rx = test_loopback_socket(&addr);
+	/* nothing pending */
+	CHECK_INT(readFromSSDPSocket(rx), -1);
+	for (b = 0; b < BURSTS; b++) {
+		for (i = 0; i < BURST_LEN; i++) {
+			device = b * BURST_LEN + i;
+			test_notify(msg, sizeof(msg), device, device_type,
+				"ssdp:alive", 0);
+			test_send(&addr, msg);
+		}
+		CHECK_INT(test_drain(rx, FALSE),
+			(BURST_LEN + SSDP_RECV_BATCH_SIZE - 1) /
+			SSDP_RECV_BATCH_SIZE);
+		CHECK_INT(test_counter_wait(&alive_count, (b + 1) * BURST_LEN),
+			(b + 1) * BURST_LEN);
+	}
+	for (device = 0; device < BURSTS * BURST_LEN; device++)
+		CHECK_INT(seen[device], 1);
+	close(rx);
+	test_finish_client(handle);
+
+	return EXIT_SUCCESS;
+}
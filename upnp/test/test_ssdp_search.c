@@ -0,0 +1,324 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Tests the transmission of the M-SEARCH requests.
+ *
+ * The test captures the M-SEARCH requests the control point multicasts. It
+ * checks that UpnpSearchAsync() returns without waiting for them, that
+ * NUM_SSDP_COPY copies of each are sent SSDP_PAUSE ms apart, and that a
+ * search of a target being sent joins its transmission unless it has a
+ * shorter MX. Each reply must reach every search of its target, and each
+ * search must time out once, MX s after it started.
+ */
+
+
+#include "testutil.h"
+#include "../src/inc/config.h"
+#include "../src/inc/ssdplib.h"
+
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+/*! Search targets of the test. */
+enum {
+	T_A,
+	T_B,
+	T_C,
+	TARGETS
+};
+
+/*! Searches of the test, indexes of cookies. */
+enum {
+	S_A,
+	/*! joins S_A */
+	S_A_JOIN,
+	S_B,
+	S_C3,
+	/*! shorter MX, does not join S_C3 */
+	S_C2,
+	/*! joins one of the above */
+	S_C4,
+	/*! started once S_A was sent, does not join it */
+	S_A_AGAIN,
+	SEARCHES
+};
+
+/*! Copies of the requests captured per target, at most. */
+#define MAX_COPIES 16
+
+/*! Time the requests of a burst of searches take to be sent, in ms. */
+#define TX_TIME ((NUM_SSDP_COPY + 2) * SSDP_PAUSE)
+
+static const char *targets[TARGETS] = {
+	"urn:schemas-upnp-org:device:SearchTestA:1",
+	"urn:schemas-upnp-org:device:SearchTestB:1",
+	"urn:schemas-upnp-org:service:SearchTestC:1",
+};
+
+static const struct {
+	int target;
+	int mx;
+} searches[SEARCHES] = {
+	{ T_A, 2 },
+	{ T_A, 2 },
+	{ T_B, 2 },
+	{ T_C, 3 },
+	{ T_C, 2 },
+	{ T_C, 4 },
+	{ T_A, 2 },
+};
+
+static int cookies[SEARCHES];
+/*! Start of each search, in ms. */
+static int64_t started[SEARCHES];
+static TestCounter result_count;
+static TestCounter timeout_count;
+/*! Results of each search, per target replied to. */
+static int results[SEARCHES][TARGETS];
+/*! Timeouts of each search. */
+static int timeouts[SEARCHES];
+/*! Time of the timeout of each search, in ms. */
+static int64_t timed_out[SEARCHES];
+/*! Copies of the requests captured per target. */
+static int copies[TARGETS];
+/*! Time each copy was captured, in ms. */
+static int64_t captured[TARGETS][MAX_COPIES];
+
+static int callback(Upnp_EventType EventType, void *Event, void *Cookie)
+{
+	struct Upnp_Discovery *d_event = (struct Upnp_Discovery *)Event;
+	int search;
+	int device;
+	int seq;
+
+	if (EventType != UPNP_DISCOVERY_SEARCH_RESULT &&
+	    EventType != UPNP_DISCOVERY_SEARCH_TIMEOUT)
+		return 0;
+	search = (int)((int *)Cookie - cookies);
+	CHECK(search >= 0 && search < SEARCHES);
+	if (EventType == UPNP_DISCOVERY_SEARCH_TIMEOUT) {
+		ithread_mutex_lock(&timeout_count.mutex);
+		timeouts[search]++;
+		timed_out[search] = imillinow();
+		ithread_mutex_unlock(&timeout_count.mutex);
+		test_counter_add(&timeout_count, 1);
+		return 0;
+	}
+	CHECK(test_location(d_event->Location, &device, &seq) == 0);
+	CHECK(device >= 0 && device < TARGETS);
+	ithread_mutex_lock(&result_count.mutex);
+	results[search][device]++;
+	ithread_mutex_unlock(&result_count.mutex);
+	test_counter_add(&result_count, 1);
+
+	return 0;
+}
+
+/*!
+ * \brief Opens a socket receiving the M-SEARCH requests multicast on the
+ * interface of the library.
+ *
+ * \return The socket.
+ */
+static SOCKET capture_socket(void)
+{
+	struct sockaddr_in addr;
+	struct ip_mreq mreq;
+	int on = 1;
+	SOCKET sock;
+
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	CHECK(sock != INVALID_SOCKET);
+	/* shared with the SSDP socket of the library */
+	CHECK(setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on,
+		sizeof(on)) == 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(SSDP_PORT);
+	CHECK(bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+	memset(&mreq, 0, sizeof(mreq));
+	mreq.imr_multiaddr.s_addr = inet_addr(SSDP_IP);
+	mreq.imr_interface.s_addr = inet_addr(UpnpGetServerIpAddress());
+	CHECK(setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq,
+		sizeof(mreq)) == 0);
+
+	return sock;
+}
+
+/*!
+ * \brief Counts the requests of the test targets captured for some time.
+ */
+static void capture(
+	/*! [in] Socket opened by capture_socket(). */
+	SOCKET sock,
+	/*! [in] Time to capture for, in ms. */
+	int64_t duration)
+{
+	int64_t end = imillinow() + duration;
+	int64_t now;
+	struct pollfd pfd;
+	char buf[BUFSIZE];
+	const char *st;
+	ssize_t len;
+	int t;
+
+	pfd.fd = sock;
+	pfd.events = POLLIN;
+	while ((now = imillinow()) < end) {
+		if (poll(&pfd, 1, (int)(end - now)) <= 0)
+			continue;
+		len = recv(sock, buf, sizeof(buf) - 1, 0);
+		if (len <= 0)
+			continue;
+		buf[len] = '\0';
+		st = strstr(buf, "\r\nST: ");
+		if (strncmp(buf, "M-SEARCH ", 9) != 0 || !st)
+			continue;
+		st += 6;
+		for (t = 0; t < TARGETS; t++) {
+			if (strncmp(st, targets[t], strlen(targets[t])) != 0 ||
+			    strncmp(st + strlen(targets[t]), "\r\n", 2) != 0)
+				continue;
+			CHECK(copies[t] < MAX_COPIES);
+			captured[t][copies[t]++] = imillinow();
+		}
+	}
+}
+
+/*!
+ * \brief Starts a search, which must not wait for its requests to be sent.
+ */
+static void start_search(
+	/*! [in] Control point. */
+	UpnpClient_Handle handle,
+	/*! [in] Search. */
+	int search)
+{
+	started[search] = imillinow();
+	CHECK_INT(UpnpSearchAsync(handle, searches[search].mx,
+		targets[searches[search].target], &cookies[search]),
+		UPNP_E_SUCCESS);
+	CHECK(imillinow() - started[search] < (int64_t)SSDP_PAUSE / 2);
+}
+
+/*!
+ * \brief Checks the copies of the requests of a target sent for a search.
+ */
+static void check_copies(
+	/*! [in] Target. */
+	int target,
+	/*! [in] Index of the first copy. */
+	int first,
+	/*! [in] Search. */
+	int search)
+{
+	int i;
+
+	/* the first at once, the others SSDP_PAUSE ms apart */
+	CHECK(captured[target][first] - started[search] <
+		(int64_t)SSDP_PAUSE / 2);
+	for (i = first + 1; i < first + NUM_SSDP_COPY; i++)
+		CHECK(captured[target][i] - captured[target][i - 1] >=
+			(int64_t)SSDP_PAUSE * 3 / 4);
+}
+
+int main(int argc, char *argv[])
+{
+	UpnpClient_Handle handle = -1;
+	struct sockaddr_in addr;
+	char msg[1024];
+	SOCKET rx;
+	SOCKET sock;
+	int64_t elapsed;
+	int search;
+	int t;
+
+	(void)argc;
+	(void)argv;
+	test_counter_init(&result_count);
+	test_counter_init(&timeout_count);
+	test_start_client(callback, &handle);
+	rx = test_loopback_socket(&addr);
+	sock = capture_socket();
+
+	/* searches of the same target share the requests */
+	for (search = 0; search < S_A_AGAIN; search++)
+		start_search(handle, search);
+	capture(sock, TX_TIME);
+	CHECK_INT(copies[T_A], NUM_SSDP_COPY);
+	CHECK_INT(copies[T_B], NUM_SSDP_COPY);
+	CHECK_INT(copies[T_C], 2 * NUM_SSDP_COPY);
+	check_copies(T_A, 0, S_A);
+	check_copies(T_B, 0, S_B);
+
+	/* a reply reaches every search of its target, device t replying
+	 * for target t */
+	for (t = 0; t < TARGETS; t++) {
+		test_reply(msg, sizeof(msg), t, targets[t], 0);
+		test_send(&addr, msg);
+	}
+	test_drain(rx, TRUE);
+	CHECK_INT(test_counter_wait(&result_count, S_A_AGAIN), S_A_AGAIN);
+	for (search = 0; search < S_A_AGAIN; search++)
+		for (t = 0; t < TARGETS; t++)
+			CHECK_INT(results[search][t],
+				t == searches[search].target ? 1 : 0);
+
+	/* sent again once the requests of S_A are done */
+	start_search(handle, S_A_AGAIN);
+	capture(sock, TX_TIME);
+	CHECK_INT(copies[T_A], 2 * NUM_SSDP_COPY);
+	check_copies(T_A, NUM_SSDP_COPY, S_A_AGAIN);
+
+	/* each search times out once, after its MX */
+	CHECK_INT(test_counter_wait(&timeout_count, SEARCHES), SEARCHES);
+	for (search = 0; search < SEARCHES; search++) {
+		CHECK_INT(timeouts[search], 1);
+		elapsed = timed_out[search] - started[search];
+		CHECK(elapsed >= (int64_t)searches[search].mx * 1000);
+		CHECK(elapsed < (int64_t)searches[search].mx * 1000 + 500);
+	}
+	close(sock);
+	close(rx);
+	test_finish_client(handle);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,310 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Tests the schedulers of the thread pool.
+ *
+ * For each scheduler, the test checks with a single worker that queued
+ * jobs run by priority then in the order they were added, that a queued
+ * job can be removed, that a job waiting longer than the starvation time is
+ * bumped ahead of newer jobs of a higher priority, and that no more than
+ * maxJobsTotal jobs are queued. With several workers and producers, it
+ * checks that every job runs exactly once and is counted in the
+ * statistics.
+ */
+
+
+#include "testutil.h"
+#include "ThreadPool.h"
+
+
+#include <string.h>
+
+
+/*! Number of producer threads. */
+#define PRODUCERS 4
+
+/*! Jobs added by each producer. */
+#define JOBS 1000
+
+/*! Maximum number of jobs logged by run order. */
+#define LOG_SIZE 16
+
+/*! Starvation time of the bumping check, in ms. */
+#define STARVATION_TIME 50
+
+static ThreadPool pool;
+
+/*! Jobs in the order they ran. */
+static int run_log[LOG_SIZE];
+static TestCounter run_count;
+
+/*! The gate job holds the single worker until opened. */
+static ithread_mutex_t gate_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ithread_cond_t gate_cond = PTHREAD_COND_INITIALIZER;
+static int gate_open;
+static TestCounter gate_entered;
+
+/*! Runs of each job of the producers. */
+static int hits[PRODUCERS * JOBS];
+static TestCounter hit_count;
+
+static void log_job(void *arg)
+{
+	long n;
+
+	ithread_mutex_lock(&run_count.mutex);
+	n = run_count.value++;
+	CHECK(n < LOG_SIZE);
+	run_log[n] = (int)(long)arg;
+	ithread_mutex_unlock(&run_count.mutex);
+}
+
+static void count_job(void *arg)
+{
+	(void)arg;
+	test_counter_add(&run_count, 1);
+}
+
+static int try_add_job(start_routine func, long arg,
+	ThreadPriority priority, int *jobId)
+{
+	ThreadPoolJob job;
+
+	TPJobInit(&job, func, (void *)arg);
+	TPJobSetPriority(&job, priority);
+
+	return ThreadPoolAdd(&pool, &job, jobId);
+}
+
+static void add_job(start_routine func, long arg, ThreadPriority priority,
+	int *jobId)
+{
+	CHECK_INT(try_add_job(func, arg, priority, jobId), 0);
+}
+
+/*!
+ * \brief Logs itself, then adds a high priority job logging the next
+ * number.
+ */
+static void chain_job(void *arg)
+{
+	log_job(arg);
+	add_job(log_job, (long)arg + 1, HIGH_PRIORITY, NULL);
+}
+
+static void gate_job(void *arg)
+{
+	(void)arg;
+	test_counter_add(&gate_entered, 1);
+	ithread_mutex_lock(&gate_mutex);
+	while (!gate_open)
+		ithread_cond_wait(&gate_cond, &gate_mutex);
+	ithread_mutex_unlock(&gate_mutex);
+}
+
+/*!
+ * \brief Holds the single worker of the pool, so that the next jobs are
+ * queued.
+ */
+static void close_gate(void)
+{
+	long entered = test_counter_get(&gate_entered);
+
+	gate_open = FALSE;
+	add_job(gate_job, 0, HIGH_PRIORITY, NULL);
+	CHECK_INT(test_counter_wait(&gate_entered, entered + 1), entered + 1);
+}
+
+static void open_gate(void)
+{
+	ithread_mutex_lock(&gate_mutex);
+	gate_open = TRUE;
+	ithread_cond_broadcast(&gate_cond);
+	ithread_mutex_unlock(&gate_mutex);
+}
+
+/*!
+ * \brief Checks the jobs run since the log was cleared.
+ */
+static void check_log(const int *expected, int count)
+{
+	int i;
+
+	CHECK_INT(test_counter_wait(&run_count, count), count);
+	for (i = 0; i < count; i++)
+		CHECK_INT(run_log[i], expected[i]);
+	ithread_mutex_lock(&run_count.mutex);
+	run_count.value = 0;
+	ithread_mutex_unlock(&run_count.mutex);
+}
+
+static void init_pool(SchedulerMode mode, int workers, int starvationTime,
+	int maxJobsTotal)
+{
+	ThreadPoolAttr attr;
+
+	TPAttrInit(&attr);
+	TPAttrSetMinThreads(&attr, 1);
+	TPAttrSetMaxThreads(&attr, workers);
+	TPAttrSetJobsPerThread(&attr, 1);
+	TPAttrSetStarvationTime(&attr, starvationTime);
+	TPAttrSetMaxJobsTotal(&attr, maxJobsTotal);
+	TPAttrSetSchedulerMode(&attr, mode);
+	CHECK_INT(ThreadPoolInit(&pool, &attr), 0);
+}
+
+/*!
+ * \brief Checks the order of the jobs of a pool with a single worker.
+ */
+static void test_order(SchedulerMode mode)
+{
+	static const int by_priority[] = { 5, 7, 3, 1, 2 };
+	static const int bumped[] = { 10, 20, 11 };
+	ThreadPoolJob removed;
+	int jobId;
+	int i;
+
+	/* by priority, then in order */
+	init_pool(mode, 1, 60000, 100);
+	close_gate();
+	add_job(log_job, 1, LOW_PRIORITY, NULL);
+	add_job(log_job, 3, MED_PRIORITY, NULL);
+	add_job(log_job, 5, HIGH_PRIORITY, NULL);
+	add_job(log_job, 2, LOW_PRIORITY, NULL);
+	add_job(log_job, 4, MED_PRIORITY, &jobId);
+	add_job(log_job, 7, HIGH_PRIORITY, NULL);
+	memset(&removed, 0, sizeof(removed));
+	CHECK_INT(ThreadPoolRemove(&pool, jobId, &removed), 0);
+	CHECK(removed.func == log_job);
+	CHECK_INT((long)removed.arg, 4);
+	CHECK_INT(ThreadPoolRemove(&pool, jobId, &removed), INVALID_JOB_ID);
+	open_gate();
+	check_log(by_priority, 5);
+
+	/* no more than maxJobsTotal queued jobs */
+	close_gate();
+	for (i = 0; i < 99; i++)
+		add_job(count_job, 0, LOW_PRIORITY, NULL);
+	add_job(count_job, 0, LOW_PRIORITY, &jobId);
+	CHECK_INT(try_add_job(count_job, 0, HIGH_PRIORITY, NULL), EOUTOFMEM);
+	CHECK_INT(ThreadPoolRemove(&pool, jobId, &removed), 0);
+	add_job(count_job, 0, HIGH_PRIORITY, NULL);
+	CHECK_INT(try_add_job(count_job, 0, HIGH_PRIORITY, NULL), EOUTOFMEM);
+	open_gate();
+	CHECK_INT(test_counter_wait(&run_count, 100), 100);
+	ithread_mutex_lock(&run_count.mutex);
+	run_count.value = 0;
+	ithread_mutex_unlock(&run_count.mutex);
+	CHECK_INT(ThreadPoolShutdown(&pool), 0);
+
+	/* a starving job goes ahead of newer jobs of a higher priority */
+	init_pool(mode, 1, STARVATION_TIME, 100);
+	close_gate();
+	add_job(log_job, 20, MED_PRIORITY, NULL);
+	imillisleep(2 * STARVATION_TIME);
+	add_job(chain_job, 10, HIGH_PRIORITY, NULL);
+	open_gate();
+	check_log(bumped, 3);
+	CHECK_INT(ThreadPoolShutdown(&pool), 0);
+}
+
+static void hit_job(void *arg)
+{
+	long i = (long)arg;
+
+	ithread_mutex_lock(&hit_count.mutex);
+	hits[i]++;
+	hit_count.value++;
+	ithread_mutex_unlock(&hit_count.mutex);
+}
+
+static void *producer(void *arg)
+{
+	long first = (long)arg * JOBS;
+	long i;
+
+	/* a third of the jobs with each priority */
+	for (i = first; i < first + JOBS; i++)
+		add_job(hit_job, i, (ThreadPriority)(i % 3), NULL);
+
+	return NULL;
+}
+
+/*!
+ * \brief Checks that every job of several producers runs once.
+ */
+static void test_producers(SchedulerMode mode)
+{
+	ThreadPoolStats stats;
+	ithread_t threads[PRODUCERS];
+	long i;
+
+	init_pool(mode, 4, 60000, PRODUCERS * JOBS);
+	memset(hits, 0, sizeof(hits));
+	hit_count.value = 0;
+	for (i = 0; i < PRODUCERS; i++)
+		ithread_create(&threads[i], NULL, producer, (void *)i);
+	for (i = 0; i < PRODUCERS; i++)
+		ithread_join(threads[i], NULL);
+	CHECK_INT(test_counter_wait(&hit_count, PRODUCERS * JOBS),
+		PRODUCERS * JOBS);
+	for (i = 0; i < PRODUCERS * JOBS; i++)
+		CHECK_INT(hits[i], 1);
+	ThreadPoolGetStats(&pool, &stats);
+	CHECK_INT(stats.totalJobsHQ, PRODUCERS * JOBS / 3);
+	CHECK_INT(stats.totalJobsMQ + stats.totalJobsLQ,
+		PRODUCERS * JOBS - PRODUCERS * JOBS / 3);
+	CHECK_INT(stats.currentJobsHQ + stats.currentJobsMQ +
+		stats.currentJobsLQ, 0);
+	CHECK(stats.totalThreads >= 1 && stats.totalThreads <= 4);
+	CHECK_INT(ThreadPoolShutdown(&pool), 0);
+}
+
+int main(int argc, char *argv[])
+{
+	(void)argc;
+	(void)argv;
+	test_counter_init(&run_count);
+	test_counter_init(&gate_entered);
+	test_counter_init(&hit_count);
+	CHECK_INT(ThreadPoolAdd(NULL, NULL, NULL), EINVAL);
+
+	test_order(TP_SCHED_SHARED);
+	test_order(TP_SCHED_WORK_STEALING);
+	test_producers(TP_SCHED_SHARED);
+	test_producers(TP_SCHED_WORK_STEALING);
+
+	return EXIT_SUCCESS;
+}
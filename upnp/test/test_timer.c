@@ -0,0 +1,226 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Tests the timer thread.
+ *
+ * The timer thread hands its events to a pool with a single worker, so
+ * that the jobs run in the order the events were due. The test checks
+ * that events run in the order of their time and never early, that
+ * removed events do not run and give their job back, that events can be
+ * removed in any order from a large queue, that ABS_SEC and REL_SEC times
+ * are on the same clock as REL_MSEC ones, and that the shutdown frees the
+ * pending events without running them.
+ */
+
+
+#include "testutil.h"
+#include "TimerThread.h"
+
+
+#include <string.h>
+
+
+/*! Events of the order check. */
+#define EVENTS 500
+
+/*! Shortest delay of the order check, in ms, leaving the time to remove
+ * events before any is due. */
+#define MIN_DELAY 200
+
+/*! Range of the delays of the order check, in ms. */
+#define DELAYS 300
+
+/*! Events of the removal check, far in the future. */
+#define MANY 10000
+
+/*! Step scrambling the event numbers, prime with EVENTS and MANY. */
+#define STEP 7919
+
+static ThreadPool pool;
+static TimerThread timer;
+
+/*! Events in the order they ran. */
+static int run_log[EVENTS];
+/*! Time each event ran, in ms on the clock of imillinow(). */
+static int64_t run_time[EVENTS];
+static TestCounter run_count;
+static TestCounter free_count;
+
+static void log_event(void *arg)
+{
+	long n;
+	int event = (int)(long)arg;
+
+	ithread_mutex_lock(&run_count.mutex);
+	n = run_count.value++;
+	CHECK(n < EVENTS);
+	run_log[n] = event;
+	run_time[event] = imillinow();
+	ithread_mutex_unlock(&run_count.mutex);
+}
+
+static void free_event(void *arg)
+{
+	(void)arg;
+	test_counter_add(&free_count, 1);
+}
+
+static void schedule(long arg, time_t time, TimeoutType type, int *id)
+{
+	ThreadPoolJob job;
+
+	TPJobInit(&job, log_event, (void *)arg);
+	TPJobSetFreeFunction(&job, free_event);
+	CHECK_INT(TimerThreadSchedule(&timer, time, type, &job, SHORT_TERM,
+		id), 0);
+}
+
+/*!
+ * \brief Removes an event and checks the job it gives back.
+ */
+static void remove_event(int id, long arg)
+{
+	ThreadPoolJob job;
+
+	memset(&job, 0, sizeof(job));
+	CHECK_INT(TimerThreadRemove(&timer, id, &job), 0);
+	CHECK(job.func == log_event);
+	CHECK_INT((long)job.arg, arg);
+	CHECK_INT(TimerThreadRemove(&timer, id, &job), INVALID_EVENT_ID);
+}
+
+static void clear_log(void)
+{
+	ithread_mutex_lock(&run_count.mutex);
+	run_count.value = 0;
+	ithread_mutex_unlock(&run_count.mutex);
+}
+
+int main(int argc, char *argv[])
+{
+	static int ids[MANY];
+	/* bounds of the time each event of the order check is due */
+	static int64_t dueMin[EVENTS];
+	static int64_t dueMax[EVENTS];
+	static int ran[EVENTS];
+	ThreadPoolAttr attr;
+	int64_t latest;
+	int64_t start;
+	long delay;
+	long expected;
+	int event;
+	int i;
+
+	(void)argc;
+	(void)argv;
+	test_counter_init(&run_count);
+	test_counter_init(&free_count);
+	/* one thread for the timer, one worker */
+	TPAttrInit(&attr);
+	TPAttrSetMinThreads(&attr, 2);
+	TPAttrSetMaxThreads(&attr, 2);
+	TPAttrSetJobsPerThread(&attr, 1);
+	TPAttrSetStarvationTime(&attr, 60000);
+	TPAttrSetMaxJobsTotal(&attr, EVENTS);
+	CHECK_INT(ThreadPoolInit(&pool, &attr), 0);
+	CHECK_INT(TimerThreadInit(&timer, &pool), 0);
+
+	/* in the order of their time, never early, removed ones never */
+	expected = 0;
+	for (i = 0; i < EVENTS; i++) {
+		event = (int)(((long)i * STEP) % EVENTS);
+		delay = MIN_DELAY + event % DELAYS;
+		dueMin[event] = imillinow() + delay;
+		schedule(event, (time_t)delay, REL_MSEC, &ids[event]);
+		dueMax[event] = imillinow() + delay;
+	}
+	for (i = 0; i < EVENTS; i++) {
+		event = (int)(((long)i * STEP) % EVENTS);
+		if (event % 3 == 0)
+			remove_event(ids[event], event);
+		else
+			expected++;
+	}
+	CHECK_INT(test_counter_wait(&run_count, expected), expected);
+	latest = 0;
+	for (i = 0; i < expected; i++) {
+		event = run_log[i];
+		CHECK(event % 3 != 0);
+		CHECK(!ran[event]);
+		ran[event] = TRUE;
+		CHECK(run_time[event] >= dueMin[event]);
+		/* not after an event that was due later */
+		if (dueMin[event] > latest)
+			latest = dueMin[event];
+		CHECK(latest <= dueMax[event]);
+		/* gone once run */
+		CHECK_INT(TimerThreadRemove(&timer, ids[event], NULL),
+			INVALID_EVENT_ID);
+	}
+	clear_log();
+
+	/* removal in any order from a large queue */
+	for (i = 0; i < MANY; i++)
+		schedule(i, 3600, REL_SEC, &ids[i]);
+	for (i = 0; i < MANY; i++) {
+		event = (int)(((long)i * STEP) % MANY);
+		remove_event(ids[event], event);
+	}
+	CHECK_INT(test_counter_get(&free_count), 0);
+
+	/* ABS_SEC, REL_SEC and REL_MSEC on the same clock */
+	start = imillinow();
+	schedule(2, time(NULL) + 3, ABS_SEC, NULL);
+	schedule(1, 1, REL_SEC, NULL);
+	schedule(0, 500, REL_MSEC, NULL);
+	CHECK_INT(test_counter_wait(&run_count, 3), 3);
+	for (i = 0; i < 3; i++)
+		CHECK_INT(run_log[i], i);
+	CHECK(run_time[0] >= start + 500);
+	CHECK(run_time[1] >= start + 1000);
+	CHECK(run_time[2] >= start + 2000);
+	CHECK(run_time[2] < start + 4000);
+	clear_log();
+
+	/* the shutdown frees the pending events */
+	for (i = 0; i < 10; i++)
+		schedule(i, 3600, REL_SEC, NULL);
+	CHECK_INT(TimerThreadShutdown(&timer), 0);
+	CHECK_INT(test_counter_get(&free_count), 10);
+	CHECK_INT(test_counter_get(&run_count), 0);
+	CHECK_INT(ThreadPoolShutdown(&pool), 0);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,482 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Test device and control points of the GENA tests.
+ */
+
+
+#include "testsink.h"
+
+
+#include <poll.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+
+/*! Maximum number of connections to the control points. */
+#define MAX_CONNS 256
+
+/*! Size of the buffer of a connection. */
+#define CONN_BUF 8192
+
+/*! Time test_sink_wait() waits for extra NOTIFY, in ms. */
+#define SETTLE_TIME 50
+
+const char *test_sink_udn = "uuid:5f9ec1b3-ed59-49ad-b3e8-0000000e7e01";
+const char *test_sink_service_id = "urn:upnp-org:serviceId:Test";
+
+static const char *desc_fmt =
+	"<?xml version=\"1.0\"?>\n"
+	"<root xmlns=\"urn:schemas-upnp-org:device-1-0\">\n"
+	"<specVersion><major>1</major><minor>0</minor></specVersion>\n"
+	"<device>\n"
+	"<deviceType>urn:schemas-upnp-org:device:Test:1</deviceType>\n"
+	"<friendlyName>Test</friendlyName>\n"
+	"<UDN>%s</UDN>\n"
+	"<serviceList><service>\n"
+	"<serviceType>urn:schemas-upnp-org:service:Test:1</serviceType>\n"
+	"<serviceId>%s</serviceId>\n"
+	"<SCPDURL>/scpd.xml</SCPDURL>\n"
+	"<controlURL>/ctl</controlURL>\n"
+	"<eventSubURL>/evt</eventSubURL>\n"
+	"</service></serviceList>\n"
+	"</device>\n"
+	"</root>\n";
+
+/*! Connection accepted by a control point. */
+typedef struct {
+	SOCKET fd;
+	TestSink *sink;
+	/*! The last NOTIFY is not answered yet. */
+	int due;
+	size_t len;
+	char buf[CONN_BUF];
+} SinkConn;
+
+static TestSink *sinks;
+static int sink_count;
+static SinkConn *conns[MAX_CONNS];
+static ithread_t sink_thread_id;
+static ithread_mutex_t sink_mutex = PTHREAD_MUTEX_INITIALIZER;
+static volatile int sink_stop = FALSE;
+static UpnpDevice_Handle sink_device = -1;
+
+static int device_callback(Upnp_EventType EventType, void *Event, void *Cookie)
+{
+	struct Upnp_Subscription_Request *req;
+	const char *names[] = { "Value", "Other" };
+	const char *values[] = { "0", "0" };
+
+	(void)Cookie;
+	if (EventType == UPNP_EVENT_SUBSCRIPTION_REQUEST) {
+		req = (struct Upnp_Subscription_Request *)Event;
+		CHECK_INT(UpnpAcceptSubscription(sink_device, req->UDN,
+			req->ServiceId, names, values, 2, req->Sid),
+			UPNP_E_SUCCESS);
+	}
+
+	return 0;
+}
+
+void test_sink_start_device(UpnpDevice_Handle *device)
+{
+	char desc[2048];
+	int rc;
+
+	rc = UpnpInit(NULL, 0);
+	if (rc != UPNP_E_SUCCESS) {
+		printf("** ERROR UpnpInit(): %d\n", rc);
+		exit(EXIT_FAILURE);
+	}
+	snprintf(desc, sizeof(desc), desc_fmt, test_sink_udn,
+		test_sink_service_id);
+	rc = UpnpRegisterRootDevice2(UPNPREG_BUF_DESC, desc, strlen(desc), 1,
+		device_callback, NULL, &sink_device);
+	if (rc != UPNP_E_SUCCESS) {
+		printf("** ERROR UpnpRegisterRootDevice2(): %d\n", rc);
+		UpnpFinish();
+		exit(EXIT_FAILURE);
+	}
+	*device = sink_device;
+}
+
+/*!
+ * \brief Finds a header in a request head.
+ *
+ * \return The value of the header, or -1 if not found.
+ */
+static long find_header(
+	/*! [in] Request head. */
+	const char *head,
+	/*! [in] Name of the header. */
+	const char *name)
+{
+	const char *p = head;
+	size_t len = strlen(name);
+
+	while ((p = strstr(p, "\r\n")) != NULL) {
+		p += 2;
+		if (strncasecmp(p, name, len) == 0 && p[len] == ':')
+			return atol(p + len + 1);
+	}
+
+	return -1;
+}
+
+/*!
+ * \brief Finds a variable in a property set.
+ *
+ * \return The value of the variable, or -1 if not found.
+ */
+static long find_variable(
+	/*! [in] Property set. */
+	const char *body,
+	/*! [in] Name of the variable. */
+	const char *name)
+{
+	char tag[32];
+	const char *p;
+
+	snprintf(tag, sizeof(tag), "<%s>", name);
+	p = strstr(body, tag);
+
+	return p != NULL ? atol(p + strlen(tag)) : -1;
+}
+
+/*!
+ * \brief Answers the last NOTIFY of a connection unless its control point
+ * is stalled.
+ *
+ * \return 0, or -1 if the connection must be closed.
+ */
+static int sink_answer(
+	/*! [in] Connection. */
+	SinkConn *c)
+{
+	static const char *ok =
+		"HTTP/1.1 200 OK\r\nCONTENT-LENGTH: 0\r\n\r\n";
+	static const char *ok_close =
+		"HTTP/1.1 200 OK\r\nCONTENT-LENGTH: 0\r\n"
+		"CONNECTION: close\r\n\r\n";
+	const char *reply;
+	int stalled;
+
+	ithread_mutex_lock(&sink_mutex);
+	stalled = c->sink->stalled;
+	ithread_mutex_unlock(&sink_mutex);
+	if (!c->due || stalled)
+		return 0;
+	c->due = FALSE;
+	reply = c->sink->closeConnections ? ok_close : ok;
+	if (send(c->fd, reply, strlen(reply), MSG_NOSIGNAL) < 0)
+		return -1;
+
+	return c->sink->closeConnections ? -1 : 0;
+}
+
+/*!
+ * \brief Records and answers the complete NOTIFY received on a connection.
+ *
+ * \return 0, or -1 if the connection must be closed.
+ */
+static int sink_handle(
+	/*! [in] Connection. */
+	SinkConn *c)
+{
+	SinkNotify *notify;
+	char *end;
+	size_t headLen;
+	size_t total;
+	long length;
+	char last;
+
+	while (!c->due) {
+		c->buf[c->len] = '\0';
+		end = strstr(c->buf, "\r\n\r\n");
+		if (end == NULL)
+			return 0;
+		headLen = (size_t)(end - c->buf) + 4;
+		length = find_header(c->buf, "CONTENT-LENGTH");
+		if (length < 0)
+			return -1;
+		total = headLen + (size_t)length;
+		if (total > c->len)
+			return 0;
+		last = c->buf[total];
+		c->buf[total] = '\0';
+		ithread_mutex_lock(&sink_mutex);
+		CHECK(c->sink->count < SINK_LOG_SIZE);
+		notify = &c->sink->log[c->sink->count];
+		notify->seq = (int)find_header(c->buf, "SEQ");
+		notify->value = find_variable(c->buf + headLen, "Value");
+		notify->other = find_variable(c->buf + headLen, "Other");
+		c->sink->count++;
+		ithread_mutex_unlock(&sink_mutex);
+		c->buf[total] = last;
+		memmove(c->buf, c->buf + total, c->len - total);
+		c->len -= total;
+		c->due = TRUE;
+		if (sink_answer(c) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static void close_conn(int i)
+{
+	close(conns[i]->fd);
+	free(conns[i]);
+	conns[i] = NULL;
+}
+
+/*!
+ * \brief Accepts a connection to a control point.
+ */
+static void accept_conn(
+	/*! [in] Control point. */
+	TestSink *sink)
+{
+	SOCKET fd;
+	int i;
+
+	fd = accept(sink->listener, NULL, NULL);
+	if (fd == INVALID_SOCKET)
+		return;
+	for (i = 0; i < MAX_CONNS && conns[i] != NULL; i++)
+		;
+	CHECK(i < MAX_CONNS);
+	conns[i] = (SinkConn *)calloc(1, sizeof(SinkConn));
+	CHECK(conns[i] != NULL);
+	conns[i]->fd = fd;
+	conns[i]->sink = sink;
+	ithread_mutex_lock(&sink_mutex);
+	sink->accepts++;
+	ithread_mutex_unlock(&sink_mutex);
+}
+
+/*!
+ * \brief Thread serving the control points.
+ */
+static void *sink_thread(void *arg)
+{
+	struct pollfd fds[SINK_MAX + MAX_CONNS];
+	int index[SINK_MAX + MAX_CONNS];
+	int nfds;
+	int i;
+	int j;
+	ssize_t n;
+
+	(void)arg;
+	while (!sink_stop) {
+		nfds = 0;
+		for (i = 0; i < sink_count; i++) {
+			fds[nfds].fd = sinks[i].listener;
+			fds[nfds].events = POLLIN;
+			index[nfds++] = -1 - i;
+		}
+		for (i = 0; i < MAX_CONNS; i++) {
+			if (conns[i] == NULL)
+				continue;
+			/* answers held back while stalled */
+			if (sink_answer(conns[i]) < 0 ||
+			    sink_handle(conns[i]) < 0) {
+				close_conn(i);
+				continue;
+			}
+			fds[nfds].fd = conns[i]->fd;
+			fds[nfds].events = POLLIN;
+			index[nfds++] = i;
+		}
+		if (poll(fds, (nfds_t)nfds, 10) <= 0)
+			continue;
+		for (j = 0; j < nfds; j++) {
+			if (!fds[j].revents)
+				continue;
+			if (index[j] < 0) {
+				accept_conn(&sinks[-1 - index[j]]);
+				continue;
+			}
+			i = index[j];
+			n = recv(conns[i]->fd, conns[i]->buf + conns[i]->len,
+				CONN_BUF - 1 - conns[i]->len, 0);
+			if (n <= 0) {
+				close_conn(i);
+				continue;
+			}
+			conns[i]->len += (size_t)n;
+			if (sink_handle(conns[i]) < 0)
+				close_conn(i);
+		}
+	}
+	for (i = 0; i < MAX_CONNS; i++)
+		if (conns[i] != NULL)
+			close_conn(i);
+
+	return NULL;
+}
+
+void test_sink_open(TestSink *s, int count)
+{
+	struct sockaddr_in addr;
+	socklen_t len;
+	int i;
+
+	CHECK(count <= SINK_MAX);
+	for (i = 0; i < count; i++) {
+		s[i].listener = socket(AF_INET, SOCK_STREAM, 0);
+		CHECK(s[i].listener != INVALID_SOCKET);
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+		len = sizeof(addr);
+		CHECK(bind(s[i].listener, (struct sockaddr *)&addr,
+			sizeof(addr)) == 0);
+		CHECK(listen(s[i].listener, 64) == 0);
+		CHECK(getsockname(s[i].listener, (struct sockaddr *)&addr,
+			&len) == 0);
+		s[i].port = ntohs(addr.sin_port);
+		s[i].stalled = FALSE;
+		s[i].accepts = 0;
+		s[i].count = 0;
+	}
+	sinks = s;
+	sink_count = count;
+	ithread_create(&sink_thread_id, NULL, sink_thread, NULL);
+}
+
+void test_sink_finish(UpnpDevice_Handle device)
+{
+	int i;
+
+	for (i = 0; i < sink_count; i++)
+		test_sink_stall(&sinks[i], FALSE);
+	CHECK_INT(UpnpUnRegisterRootDevice(device), UPNP_E_SUCCESS);
+	CHECK_INT(UpnpFinish(), UPNP_E_SUCCESS);
+	sink_stop = TRUE;
+	ithread_join(sink_thread_id, NULL);
+	for (i = 0; i < sink_count; i++)
+		close(sinks[i].listener);
+}
+
+void test_sink_subscribe(TestSink *sink)
+{
+	struct sockaddr_in addr;
+	char msg[512];
+	char reply[1024];
+	SOCKET fd;
+	ssize_t n;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	CHECK(fd != INVALID_SOCKET);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(UpnpGetServerPort());
+	addr.sin_addr.s_addr = inet_addr(UpnpGetServerIpAddress());
+	CHECK(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+	snprintf(msg, sizeof(msg),
+		"SUBSCRIBE /evt HTTP/1.1\r\n"
+		"HOST: %s:%u\r\n"
+		"CALLBACK: <http://127.0.0.1:%u/>\r\n"
+		"NT: upnp:event\r\n"
+		"TIMEOUT: Second-1800\r\n"
+		"\r\n", UpnpGetServerIpAddress(), UpnpGetServerPort(),
+		sink->port);
+	CHECK(send(fd, msg, strlen(msg), MSG_NOSIGNAL) ==
+		(ssize_t)strlen(msg));
+	n = recv(fd, reply, sizeof(reply) - 1, 0);
+	close(fd);
+	CHECK(n > 0);
+	reply[n] = '\0';
+	CHECK(strstr(reply, " 200 ") != NULL);
+}
+
+void test_sink_stall(TestSink *sink, int stalled)
+{
+	ithread_mutex_lock(&sink_mutex);
+	sink->stalled = stalled;
+	ithread_mutex_unlock(&sink_mutex);
+}
+
+/*!
+ * \brief Waits until a control point received a number of NOTIFY, or one
+ * with a value of the Value variable, then a little more for extra ones.
+ *
+ * \return The number of NOTIFY received.
+ */
+static int sink_wait(
+	/*! [in] Control point. */
+	TestSink *sink,
+	/*! [in] Number of NOTIFY, or -1 to wait for the value. */
+	int count,
+	/*! [in] Value of the Value variable of the last NOTIFY. */
+	long value)
+{
+	int waited;
+	int done;
+	int n;
+
+	for (waited = 0; waited < TEST_TIMEOUT; waited++) {
+		ithread_mutex_lock(&sink_mutex);
+		n = sink->count;
+		if (count >= 0)
+			done = n >= count;
+		else
+			done = n > 0 && sink->log[n - 1].value == value;
+		ithread_mutex_unlock(&sink_mutex);
+		if (done)
+			break;
+		imillisleep(1);
+	}
+	imillisleep(SETTLE_TIME);
+	ithread_mutex_lock(&sink_mutex);
+	n = sink->count;
+	ithread_mutex_unlock(&sink_mutex);
+
+	return n;
+}
+
+int test_sink_wait(TestSink *sink, int count)
+{
+	return sink_wait(sink, count, 0);
+}
+
+int test_sink_wait_value(TestSink *sink, long value)
+{
+	return sink_wait(sink, -1, value);
+}
@@ -0,0 +1,163 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+#ifndef TESTSINK_H
+#define TESTSINK_H
+
+/*!
+ * \file
+ *
+ * \brief Helpers shared by the tests of the GENA events sent by a device: a
+ * test device with one evented service, and control points recording the
+ * NOTIFY they receive.
+ *
+ * The control points are listening sockets on the loopback interface served
+ * by one thread. They answer every NOTIFY with 200 OK, keeping the
+ * connection open unless told to close it, and can be stalled to hold back
+ * their answers while the device queues more events for them.
+ */
+
+
+#include "testutil.h"
+
+
+/*! Maximum number of NOTIFY a control point records. */
+#define SINK_LOG_SIZE 256
+
+/*! Maximum number of control points. */
+#define SINK_MAX 16
+
+/*! UDN of the test device. */
+extern const char *test_sink_udn;
+
+/*! Service ID of the evented service of the test device. */
+extern const char *test_sink_service_id;
+
+/*!
+ * \brief NOTIFY received by a control point.
+ */
+typedef struct {
+	/*! SEQ. */
+	int seq;
+	/*! Value of the Value variable, -1 if not in the property set. */
+	long value;
+	/*! Value of the Other variable, -1 if not in the property set. */
+	long other;
+} SinkNotify;
+
+/*!
+ * \brief Control point subscribed to the test device.
+ */
+typedef struct {
+	SOCKET listener;
+	unsigned short port;
+	/*! Answers with "CONNECTION: close". */
+	int closeConnections;
+	/*! Holds back its answers, see test_sink_stall(). */
+	int stalled;
+	/*! Connections accepted. */
+	long accepts;
+	/*! NOTIFY received. */
+	int count;
+	SinkNotify log[SINK_LOG_SIZE];
+} TestSink;
+
+/*!
+ * \brief Initializes the library and registers the test device. Its Value
+ * and Other variables are 0 in the initial events.
+ */
+void test_sink_start_device(
+	/*! [out] Handle of the device. */
+	UpnpDevice_Handle *device);
+
+/*!
+ * \brief Opens control points and starts the thread serving them.
+ */
+void test_sink_open(
+	/*! [in] Control points. */
+	TestSink *sinks,
+	/*! [in] Number of control points, at most SINK_MAX. */
+	int count);
+
+/*!
+ * \brief Stops the control points, then unregisters the device and
+ * finishes the library.
+ */
+void test_sink_finish(
+	/*! [in] Handle of the device. */
+	UpnpDevice_Handle device);
+
+/*!
+ * \brief Subscribes a control point to the evented service of the test
+ * device.
+ */
+void test_sink_subscribe(
+	/*! [in] Control point. */
+	TestSink *sink);
+
+/*!
+ * \brief Holds back or sends the answers of a control point. A stalled
+ * control point still records the NOTIFY it receives.
+ *
+ * The device waits for the answer with one of its sender threads, so only a
+ * few control points should be stalled at once.
+ */
+void test_sink_stall(
+	/*! [in] Control point. */
+	TestSink *sink,
+	/*! [in] TRUE to hold back the answers. */
+	int stalled);
+
+/*!
+ * \brief Waits until a control point received a number of NOTIFY, then a
+ * little more for extra ones.
+ *
+ * \return The number of NOTIFY received.
+ */
+int test_sink_wait(
+	/*! [in] Control point. */
+	TestSink *sink,
+	/*! [in] Number of NOTIFY. */
+	int count);
+
+/*!
+ * \brief Waits until the last NOTIFY a control point received carries a
+ * value of the Value variable, then a little more for extra ones.
+ *
+ * \return The number of NOTIFY received.
+ */
+int test_sink_wait_value(
+	/*! [in] Control point. */
+	TestSink *sink,
+	/*! [in] Value of the Value variable. */
+	long value);
+
+#endif /* TESTSINK_H */
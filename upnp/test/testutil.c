@@ -0,0 +1,243 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Helpers shared by the tests of the library.
+ */
+
+
+#include "testutil.h"
+#include "../src/inc/ssdplib.h"
+
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+
+/*! Time test_counter_wait() waits for more callbacks, in ms. */
+#define SETTLE_TIME 50
+
+static const char *notify_fmt =
+	"NOTIFY * HTTP/1.1\r\n"
+	"HOST: 239.255.255.250:1900\r\n"
+	"CACHE-CONTROL: max-age=%d\r\n"
+	"LOCATION: http://192.0.2.1:49152/%d/%d.xml\r\n"
+	"NT: %s\r\n"
+	"NTS: %s\r\n"
+	"SERVER: Linux/3.0 UPnP/1.0 Test/1.0\r\n"
+	"USN: %s\r\n"
+	"BOOTID.UPNP.ORG: 1\r\n"
+	"CONFIGID.UPNP.ORG: 1\r\n"
+	"\r\n";
+
+static const char *reply_fmt =
+	"HTTP/1.1 200 OK\r\n"
+	"CACHE-CONTROL: max-age=%d\r\n"
+	"EXT:\r\n"
+	"LOCATION: http://192.0.2.1:49152/%d/%d.xml\r\n"
+	"SERVER: Linux/3.0 UPnP/1.0 Test/1.0\r\n"
+	"ST: %s\r\n"
+	"USN: %s\r\n"
+	"BOOTID.UPNP.ORG: 1\r\n"
+	"CONFIGID.UPNP.ORG: 1\r\n"
+	"\r\n";
+
+/*! Socket test_send() sends from. */
+static SOCKET send_socket = INVALID_SOCKET;
+
+void test_start_client(Upnp_FunPtr callback, UpnpClient_Handle *handle)
+{
+	int rc;
+
+	rc = UpnpInit(NULL, 0);
+	if (rc != UPNP_E_SUCCESS) {
+		printf("** ERROR UpnpInit(): %d\n", rc);
+		exit(EXIT_FAILURE);
+	}
+	rc = UpnpRegisterClient(callback, NULL, handle);
+	if (rc != UPNP_E_SUCCESS) {
+		printf("** ERROR UpnpRegisterClient(): %d\n", rc);
+		UpnpFinish();
+		exit(EXIT_FAILURE);
+	}
+}
+
+void test_finish_client(UpnpClient_Handle handle)
+{
+	CHECK_INT(UpnpUnRegisterClient(handle), UPNP_E_SUCCESS);
+	CHECK_INT(UpnpFinish(), UPNP_E_SUCCESS);
+}
+
+/*!
+ * \brief Formats the NT or ST and the USN of a message of a test device.
+ */
+static void format_usn(
+	/*! [out] NT or ST. */
+	char *nt,
+	/*! [out] USN. */
+	char *usn,
+	/*! [in] Number of the device. */
+	int device,
+	/*! [in] Type, NULL for the UDN. */
+	const char *type)
+{
+	snprintf(usn, LINE_SIZE, TEST_UDN_FMT, device);
+	if (type) {
+		snprintf(nt, LINE_SIZE, "%s", type);
+		strncat(usn, "::", LINE_SIZE - strlen(usn) - 1);
+		strncat(usn, type, LINE_SIZE - strlen(usn) - 1);
+	} else {
+		snprintf(nt, LINE_SIZE, "%s", usn);
+	}
+}
+
+void test_notify(char *buf, size_t size, int device, const char *type,
+	const char *nts, int seq)
+{
+	test_notify_max_age(buf, size, device, type, nts, seq,
+		TEST_MAX_AGE);
+}
+
+void test_notify_max_age(char *buf, size_t size, int device,
+	const char *type, const char *nts, int seq, int maxAge)
+{
+	char nt[LINE_SIZE];
+	char usn[LINE_SIZE];
+
+	format_usn(nt, usn, device, type);
+	snprintf(buf, size, notify_fmt, maxAge, device, seq, nt, nts, usn);
+}
+
+void test_reply(char *buf, size_t size, int device, const char *type,
+	int seq)
+{
+	char st[LINE_SIZE];
+	char usn[LINE_SIZE];
+
+	format_usn(st, usn, device, type);
+	snprintf(buf, size, reply_fmt, TEST_MAX_AGE, device, seq, st, usn);
+}
+
+int test_location(const char *location, int *device, int *seq)
+{
+	if (sscanf(location, "http://192.0.2.1:49152/%d/%d.xml", device,
+		   seq) != 2)
+		return -1;
+
+	return 0;
+}
+
+SOCKET test_loopback_socket(struct sockaddr_in *addr)
+{
+	socklen_t addrLen = sizeof(*addr);
+	int rcvbuf = 1024 * 1024;
+	SOCKET sock;
+
+	if (send_socket == INVALID_SOCKET) {
+		send_socket = socket(AF_INET, SOCK_DGRAM, 0);
+		CHECK(send_socket != INVALID_SOCKET);
+	}
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	CHECK(sock != INVALID_SOCKET);
+	setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	CHECK(fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK) == 0);
+	memset(addr, 0, sizeof(*addr));
+	addr->sin_family = AF_INET;
+	addr->sin_addr.s_addr = inet_addr("127.0.0.1");
+	CHECK(bind(sock, (struct sockaddr *)addr, sizeof(*addr)) == 0);
+	CHECK(getsockname(sock, (struct sockaddr *)addr, &addrLen) == 0);
+
+	return sock;
+}
+
+void test_send(const struct sockaddr_in *addr, const char *msg)
+{
+	CHECK(sendto(send_socket, msg, strlen(msg), 0,
+		(const struct sockaddr *)addr, sizeof(*addr)) ==
+		(ssize_t)strlen(msg));
+}
+
+int test_drain(SOCKET sock, int replies)
+{
+	SOCKET reqSocket = gSsdpReqSocket4;
+	int reads = 0;
+
+	/* the datagrams of sock are taken for replies while it stands for
+	 * the M-SEARCH socket */
+	if (replies)
+		gSsdpReqSocket4 = sock;
+	while (readFromSSDPSocket(sock) == 0)
+		reads++;
+	gSsdpReqSocket4 = reqSocket;
+
+	return reads;
+}
+
+void test_counter_init(TestCounter *counter)
+{
+	ithread_mutex_init(&counter->mutex, NULL);
+	counter->value = 0;
+}
+
+void test_counter_add(TestCounter *counter, long n)
+{
+	ithread_mutex_lock(&counter->mutex);
+	counter->value += n;
+	ithread_mutex_unlock(&counter->mutex);
+}
+
+long test_counter_get(TestCounter *counter)
+{
+	long value;
+
+	ithread_mutex_lock(&counter->mutex);
+	value = counter->value;
+	ithread_mutex_unlock(&counter->mutex);
+
+	return value;
+}
+
+long test_counter_wait(TestCounter *counter, long value)
+{
+	int64_t end = imillinow() + TEST_TIMEOUT;
+
+	while (test_counter_get(counter) < value && imillinow() < end)
+		imillisleep(1);
+	imillisleep(SETTLE_TIME);
+
+	return test_counter_get(counter);
+}
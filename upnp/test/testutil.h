@@ -0,0 +1,246 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+#ifndef TESTUTIL_H
+#define TESTUTIL_H
+
+/*!
+ * \file
+ *
+ * \brief Helpers shared by the tests of the library: checks, SSDP messages
+ * of numbered test devices, loopback sockets and callback counters.
+ */
+
+
+#include "upnp.h"
+#include "ithread.h"
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <netinet/in.h>
+
+
+/*! Fails the test when expr is false. */
+#define CHECK(expr) \
+	do { \
+		if (!(expr)) { \
+			printf("** ERROR %s:%d: %s\n", __FILE__, __LINE__, \
+				#expr); \
+			exit(EXIT_FAILURE); \
+		} \
+	} while (0)
+
+/*! Fails the test when the integer actual is not expected. */
+#define CHECK_INT(actual, expected) \
+	do { \
+		long check_actual_ = (long)(actual); \
+		long check_expected_ = (long)(expected); \
+		if (check_actual_ != check_expected_) { \
+			printf("** ERROR %s:%d: %s is %ld, expected %ld\n", \
+				__FILE__, __LINE__, #actual, check_actual_, \
+				check_expected_); \
+			exit(EXIT_FAILURE); \
+		} \
+	} while (0)
+
+/*! UDN of the test device of the given number. */
+#define TEST_UDN_FMT "uuid:5f9ec1b3-ed59-49ad-b3e8-%012d"
+
+/*! Max-age of the messages of the test devices, in s. */
+#define TEST_MAX_AGE 1800
+
+/*! Time the tests wait for the callbacks of the library, in ms. */
+#define TEST_TIMEOUT 5000
+
+/*!
+ * \brief Counter updated by the callbacks and waited for by the test.
+ */
+typedef struct {
+	ithread_mutex_t mutex;
+	long value;
+} TestCounter;
+
+/*!
+ * \brief Initializes the library and registers a control point.
+ */
+void test_start_client(
+	/*! [in] Callback of the control point. */
+	Upnp_FunPtr callback,
+	/*! [out] Handle of the control point. */
+	UpnpClient_Handle *handle);
+
+/*!
+ * \brief Unregisters the control point and finishes the library.
+ */
+void test_finish_client(
+	/*! [in] Handle of the control point. */
+	UpnpClient_Handle handle);
+
+/*!
+ * \brief Formats the NOTIFY a test device sends for one of its types.
+ *
+ * The LOCATION carries the device and seq, see test_location().
+ */
+void test_notify(
+	/*! [out] Message. */
+	char *buf,
+	/*! [in] Size of buf. */
+	size_t size,
+	/*! [in] Number of the device. */
+	int device,
+	/*! [in] NT, also the suffix of the USN, NULL for the UDN alone. */
+	const char *type,
+	/*! [in] NTS. */
+	const char *nts,
+	/*! [in] Number of the message. */
+	int seq);
+
+/*!
+ * \brief Formats the NOTIFY a test device sends for one of its types, with
+ * a max-age other than TEST_MAX_AGE.
+ */
+void test_notify_max_age(
+	/*! [out] Message. */
+	char *buf,
+	/*! [in] Size of buf. */
+	size_t size,
+	/*! [in] Number of the device. */
+	int device,
+	/*! [in] NT, also the suffix of the USN, NULL for the UDN alone. */
+	const char *type,
+	/*! [in] NTS. */
+	const char *nts,
+	/*! [in] Number of the message. */
+	int seq,
+	/*! [in] Max-age, in s. */
+	int maxAge);
+
+/*!
+ * \brief Formats the reply of a test device to a search of one of its
+ * types.
+ */
+void test_reply(
+	/*! [out] Message. */
+	char *buf,
+	/*! [in] Size of buf. */
+	size_t size,
+	/*! [in] Number of the device. */
+	int device,
+	/*! [in] ST, also the suffix of the USN, NULL for the UDN alone. */
+	const char *type,
+	/*! [in] Number of the message. */
+	int seq);
+
+/*!
+ * \brief Reads the device and message numbers of a LOCATION formatted by
+ * test_notify() or test_reply().
+ *
+ * \return 0 on success, -1 if the LOCATION is not from a test device.
+ */
+int test_location(
+	/*! [in] LOCATION. */
+	const char *location,
+	/*! [out] Number of the device. */
+	int *device,
+	/*! [out] Number of the message. */
+	int *seq);
+
+/*!
+ * \brief Opens a non blocking UDP socket bound to the loopback interface,
+ * as the SSDP sockets the miniserver drains.
+ *
+ * \return The socket.
+ */
+SOCKET test_loopback_socket(
+	/*! [out] Address of the socket. */
+	struct sockaddr_in *addr);
+
+/*!
+ * \brief Sends a datagram to a socket opened by test_loopback_socket().
+ */
+void test_send(
+	/*! [in] Address of the socket. */
+	const struct sockaddr_in *addr,
+	/*! [in] Datagram. */
+	const char *msg);
+
+/*!
+ * \brief Hands the datagrams pending on a socket opened by
+ * test_loopback_socket() to the SSDP receive path, as the miniserver does.
+ *
+ * \return The number of calls of readFromSSDPSocket() that read datagrams.
+ */
+int test_drain(
+	/*! [in] Socket. */
+	SOCKET sock,
+	/*! [in] TRUE to read the datagrams as replies to the M-SEARCH
+	 * requests of the control point. */
+	int replies);
+
+/*!
+ * \brief Initializes a counter to 0.
+ */
+void test_counter_init(
+	/*! [in] Counter. */
+	TestCounter *counter);
+
+/*!
+ * \brief Adds to a counter.
+ */
+void test_counter_add(
+	/*! [in] Counter. */
+	TestCounter *counter,
+	/*! [in] Value added. */
+	long n);
+
+/*!
+ * \brief Reads a counter.
+ *
+ * \return The value of the counter.
+ */
+long test_counter_get(
+	/*! [in] Counter. */
+	TestCounter *counter);
+
+/*!
+ * \brief Waits up to TEST_TIMEOUT ms for a counter to reach a value, and
+ * then a little more to let a callback overshoot it.
+ *
+ * \return The value of the counter.
+ */
+long test_counter_wait(
+	/*! [in] Counter. */
+	TestCounter *counter,
+	/*! [in] Value waited for. */
+	long value);
+
+#endif /* TESTUTIL_H */